@@ -60,7 +60,7 @@ int main(int narg, char* arg[])
 	if(cl.size()==1 || cl.search(2,"--help","-h"))
 	{
 		std::cout<<"Usage: " << std::endl;
-		std::cout<< arg[0] << " -s segmentationFile -f fiber.vtk -c #clusters -n #points  -e #fibers for eigen  -o outputFolder -d [s:straight d:diagonal a:all o:none] "  << std::endl;
+		std::cout<< arg[0] << " -s segmentationFile -f fiber.vtk -c #clusters -n #points  -e #fibers for eigen [-knn #neighbors]  -o outputFolder -d [s:straight d:diagonal a:all o:none] "  << std::endl;
 		return -1;
 	}
 	
@@ -71,6 +71,7 @@ int main(int narg, char* arg[])
 	int numberOfClusters = cl.follow(200,"-c");
 	int numberOfPoints = cl.follow(10, "-n");
 	int numberOfFibers = cl.follow(500, "-e");
+	int numberOfNeighbors = cl.follow(0, "-knn");
 	vtkDirectory::MakeDirectory(outputFolder);
 	std::vector<std::string> labels;
 	std::vector<std::pair<std::string,std::string>> clusterIdHierarchy;
@@ -458,6 +459,7 @@ int main(int narg, char* arg[])
 		normalizeCuts->SetNumberOfClusters(numberOfClusters);
 		normalizeCuts->SetMembershipFunctionVector(&functionList);
 		normalizeCuts->SetNumberOfFibersForEigenDecomposition(numberOfFibers);
+		normalizeCuts->SetNumberOfNearestNeighbors(numberOfNeighbors);
 		normalizeCuts->SetInput(mesh);
 		normalizeCuts->Update();
 
@@ -15,6 +15,8 @@
 #include "itkWeightedCentroidKdTreeGenerator.h"
 #include "itkMeshToMeshFilter.h"
 #include "ThreadedMembershipFunction.h"
+#include "ThreadedKnnAffinity.h"
+#include "ThreadedSparseMatrixVectorProduct.h"
 #if ITK_VERSION_MAJOR < 4
 #include "itkMaximumDecisionRule2.h"
 #else
@@ -67,6 +69,7 @@ class NormalizedCutsFilter :
 		typedef typename MembershipFunctionType::MeasurementVectorType MeasurementVectorType;
 
 		typedef ThreadedMembershipFunction<MembershipFunctionType> ThreadedMembershipFunctionType;
+		typedef ThreadedKnnAffinity<MembershipFunctionType> ThreadedKnnAffinityType;
 	
 
 		typedef ListSample< MeasurementVectorType > SampleType;
@@ -109,6 +112,16 @@ class NormalizedCutsFilter :
 		{
 			return m_numberOfFibersForEigenDecomposition;
 		}
+		// > 0: cut a k-nearest-neighbour affinity over all the fibers instead
+		// of the full affinity of a subsample
+		void SetNumberOfNearestNeighbors(int k)
+		{
+			this->m_numberOfNearestNeighbors = k;
+		}
+		int GetNumberOfNearestNeighbors()
+		{
+			return m_numberOfNearestNeighbors;
+		}
 
 		std::vector<std::string> GetLabels()
 		{ return this->labels;}
@@ -147,11 +160,12 @@ class NormalizedCutsFilter :
 
 		std::vector<std::pair<int,int>> SelectCentroids(typename SampleType::Pointer samples, const typename MembershipFunctionType::Pointer);
 		std::vector<std::pair<int,int>> SelectCentroidsParallel(typename SampleType::Pointer samples, const typename MembershipFunctionType::Pointer);
+		std::vector<std::pair<int,int>> SelectCentroidsKnn(typename SampleType::Pointer samples, const typename MembershipFunctionType::Pointer);
 		MeshPointerType input;
 		std::vector<std::string> labels;
 		ListOfOutputMeshTypePointer m_Output;
 		int numberOfClusters;
-		NormalizedCutsFilter() {}
+		NormalizedCutsFilter() : m_numberOfNearestNeighbors(0) {}
 		~NormalizedCutsFilter() {}
 
 		//    virtual void GenerateData (void);
@@ -162,6 +176,7 @@ class NormalizedCutsFilter :
 		void operator=(const Self&);    
 		int m_SigmaCurrents;
 		int m_numberOfFibersForEigenDecomposition;
+		int m_numberOfNearestNeighbors;
 //		void SaveClustersInMeshes(MembershipFunctionVectorType mfv);
 		MembershipFunctionVectorType *m_membershipFunctions; 
 };  
@@ -27,6 +27,8 @@
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 #include <set>
 #include "ThreadedMembershipFunction.h"
+#include "ThreadedKnnAffinity.h"
+#include "ThreadedSparseMatrixVectorProduct.h"
 
 template< class T>
 class PriorityNode {
@@ -69,12 +71,16 @@ NormalizedCutsFilter < TMesh,TMembershipFunctionType >::Update()
 		sample = node._thing;
 		lastLabel=node._id;
 		queue.pop();
-		std::vector<std::pair<int,int>> centroidIndeces =  this->SelectCentroidsParallel( sample,(*this->GetMembershipFunctionVector())[0]);	
+		std::vector<std::pair<int,int>> centroidIndeces;
+		if(this->GetNumberOfNearestNeighbors() > 0)
+			centroidIndeces =  this->SelectCentroidsKnn( sample,(*this->GetMembershipFunctionVector())[0]);
+		else
+			centroidIndeces =  this->SelectCentroidsParallel( sample,(*this->GetMembershipFunctionVector())[0]);	
 
 		typename SampleType::Pointer samplePositives = SampleType::New();
 		typename SampleType::Pointer sampleNegatives = SampleType::New();
 		
-		if(sample->Size() > this->GetNumberOfFibersForEigenDecomposition())
+		if(this->GetNumberOfNearestNeighbors() <= 0 && sample->Size() > this->GetNumberOfFibersForEigenDecomposition())
 		{
 			//Multi-thread
 			std::vector<std::pair<int, int>> inIndeces;
@@ -243,6 +249,189 @@ NormalizedCutsFilter < TMesh ,TMembershipFunctionType>::SelectCentroidsParallel(
 	delete ms;
 	return indices;
 }
+template< class TMesh,class  TMembershipFunctionType>
+	std::vector<std::pair<int,int>>	
+NormalizedCutsFilter < TMesh ,TMembershipFunctionType>::SelectCentroidsKnn(typename SampleType::Pointer samples, const typename MembershipFunctionType::Pointer membershipFunction )
+{
+	// Every fiber takes part: the affinity keeps only the k most similar
+	// fibers of each one, and the second eigenvector of
+	// D^-1/2 W D^-1/2 comes from a restarted Lanczos iteration that only
+	// needs products with W.
+	std::vector<std::pair<int,int>> indices;
+	const int n = samples->Size();
+	if(n < 2)
+	{
+		for(int i=0;i<n;i++)
+			indices.push_back(std::pair<int,int>(0,i));
+		return indices;
+	}
+	const int k = std::min(this->GetNumberOfNearestNeighbors(), n-1);
+
+	typename ThreadedKnnAffinityType::Pointer threadedKnnAffinity = ThreadedKnnAffinityType::New();
+	typename ThreadedKnnAffinityType::DomainType domain;
+	domain[0]=0;
+	domain[1]= n-1;
+	typename MembershipFunctionType::Pointer hola = (*this->GetMembershipFunctionVector())[0];
+	threadedKnnAffinity->SetStuff(samples, hola, k, std::max(4*k,32));
+	threadedKnnAffinity->Execute(hola ,domain);
+	SparseAffinityMatrix affinity;
+	threadedKnnAffinity->GetAffinity(affinity);
+
+	// scale = D^-1/2; u0 = D^1/2 1 is the eigenvector of eigenvalue 1 and is
+	// projected out of every Lanczos vector
+	std::vector<double> scale(n,0), u0(n,0);
+	double norm=0;
+	for(int i=0;i<n;i++)
+	{
+		double degree=0;
+		for(long e=affinity.m_rowStart[i];e<affinity.m_rowStart[i+1];e++)
+			degree += affinity.m_values[e];
+		if(degree > 0)
+		{
+			scale[i] = 1.0/sqrt(degree);
+			u0[i] = sqrt(degree);
+		}
+		norm += degree;
+	}
+	for(int i=0;i<n;i++)
+		u0[i] /= sqrt(norm);
+
+	ThreadedSparseMatrixVectorProduct::Pointer product = ThreadedSparseMatrixVectorProduct::New();
+	ThreadedSparseMatrixVectorProduct::DomainType rows;
+	rows[0]=0;
+	rows[1]= n-1;
+
+	auto deflate = [&](std::vector<double>& x)
+	{
+		double dot=0;
+		for(int i=0;i<n;i++)
+			dot += x[i]*u0[i];
+		for(int i=0;i<n;i++)
+			x[i] -= dot*u0[i];
+	};
+	auto normalize = [&](std::vector<double>& x)
+	{
+		double len=0;
+		for(int i=0;i<n;i++)
+			len += x[i]*x[i];
+		len = sqrt(len);
+		for(int i=0;i<n;i++)
+			x[i] /= len;
+		return len;
+	};
+
+	// fixed start vector so the clustering is reproducible
+	std::vector<double> v(n);
+	for(int i=0;i<n;i++)
+		v[i] = 1.0 + (i%7)/7.0 + (i%13)/13.0;
+	deflate(v);
+	normalize(v);
+
+	// thick restart: the best Ritz vectors of one cycle, plus the last
+	// residual direction, start the next one
+	const int m = std::min(30, n-1);
+	const int kept = std::min(10, m-1);
+	std::vector<std::vector<double>> basis(m, std::vector<double>(n)), ritzVectors(kept, std::vector<double>(n));
+	std::vector<double> w(n), theta(kept);
+	vnl_matrix<double> projected(m,m,0);
+	basis[0] = v;
+	int start=0;
+	double lambda=0;
+	for(int restart=0;restart<300;restart++)
+	{
+		int size=m;
+		double lastBeta=0;
+		for(int j=start;j<m;j++)
+		{
+			product->SetStuff(&scale, &basis[j][0], &w[0]);
+			product->Execute(&affinity, rows);
+			deflate(w);
+			// full reorthogonalization; the coefficients are the entries of
+			// the projected matrix
+			for(int l=0;l<=j;l++)
+			{
+				double dot=0;
+				for(int i=0;i<n;i++)
+					dot += w[i]*basis[l][i];
+				for(int i=0;i<n;i++)
+					w[i] -= dot*basis[l][i];
+				projected(l,j) = projected(j,l) = dot;
+			}
+			double beta = normalize(w);
+			if(j+1 == m)
+			{
+				lastBeta = beta;
+				break;
+			}
+			if(beta < 1e-10)
+			{
+				// invariant subspace: the Ritz values are exact
+				size = j+1;
+				break;
+			}
+			projected(j,j+1) = projected(j+1,j) = beta;
+			basis[j+1] = w;
+		}
+
+		vnl_matrix<double> t(size,size,0);
+		for(int i=0;i<size;i++)
+			for(int j=0;j<size;j++)
+				t(i,j) = projected(i,j);
+		vnl_symmetric_eigensystem<double> ed(t);
+		// eigenvalues come in increasing order
+		lambda = ed.get_eigenvalue(size-1);
+		vnl_vector<double> ritz = ed.get_eigenvector(size-1);
+		for(int i=0;i<n;i++)
+		{
+			v[i]=0;
+			for(int j=0;j<size;j++)
+				v[i] += ritz(j)*basis[j][i];
+		}
+		double residual = lastBeta*fabs(ritz(size-1));
+		if(size < m || residual < 1e-6)
+			break;
+
+		for(int r=0;r<kept;r++)
+		{
+			vnl_vector<double> y = ed.get_eigenvector(size-1-r);
+			theta[r] = ed.get_eigenvalue(size-1-r);
+			for(int i=0;i<n;i++)
+			{
+				ritzVectors[r][i]=0;
+				for(int j=0;j<size;j++)
+					ritzVectors[r][i] += y(j)*basis[j][i];
+			}
+		}
+		projected.fill(0);
+		for(int r=0;r<kept;r++)
+		{
+			basis[r].swap(ritzVectors[r]);
+			projected(r,r) = theta[r];
+		}
+		basis[kept] = w;
+		start = kept;
+	}
+	deflate(v);
+	std::cout << " e1 " << 1-lambda << std::endl;
+
+	// D^-1/2 v has the sign of v
+	int positivos=0, negativos=0;
+	for(int i=0;i<n;i++)
+	{
+		if(v[i]> 0)
+		{
+			positivos++;
+			indices.push_back(  std::pair<int, int>(0,i));
+		}
+		else
+		{
+			negativos++;
+			indices.push_back(  std::pair<int, int >(1, i));
+		}	
+	}
+	std::cout << " positivos " << positivos << " negativos " << negativos << std::endl;
+	return indices;
+}
 template< class TMesh,class  TMembershipFunctionType>
 	std::vector<std::pair<int,int>>	
 NormalizedCutsFilter < TMesh ,TMembershipFunctionType>::SelectCentroids(typename SampleType::Pointer samples, const typename MembershipFunctionType::Pointer membershipFunction )
@@ -0,0 +1,78 @@
+#ifndef _ThreadedKnnAffinity_h
+#define _ThreadedKnnAffinity_h
+
+#include "itkDomainThreader.h"
+#include "itkThreadedIndexedContainerPartitioner.h"
+#include <vector>
+
+/* Sparse symmetric affinity in compressed row form: the entries of row i
+ * are m_columns/m_values[m_rowStart[i] .. m_rowStart[i+1]-1]. */
+struct SparseAffinityMatrix
+{
+	std::vector<long> m_rowStart;
+	std::vector<int> m_columns;
+	std::vector<double> m_values;
+	int GetSize() const { return (int)m_rowStart.size()-1;}
+};
+
+/* Builds a k-nearest-neighbour affinity between fibers. Candidate
+ * neighbours come from a kd-tree on the first, middle and last points of
+ * each resampled fiber (inserted in both orientations), and the k most
+ * similar candidates under the membership function are kept. The kd-tree
+ * is never written to after it is built, so all threads query it at once. */
+template<class TMembershipFunctionType>
+class ThreadedKnnAffinity :  public itk::DomainThreader<itk::ThreadedIndexedContainerPartitioner, TMembershipFunctionType>
+{
+	public :
+		using Self = ThreadedKnnAffinity;
+		using Superclass =  itk::DomainThreader<itk::ThreadedIndexedContainerPartitioner,TMembershipFunctionType>;
+		using Pointer =  itk::SmartPointer<Self>;
+		using ConstPointer = itk::SmartPointer<const Self>;
+
+		using DomainType = typename Superclass::DomainType;
+		itkNewMacro(Self);
+		typedef TMembershipFunctionType MembershipFunctionType;
+		typedef typename TMembershipFunctionType::MeasurementVectorType MeasurementVectorType;
+		typedef itk::Statistics::ListSample< MeasurementVectorType > SampleType;
+
+		void SetStuff(typename SampleType::Pointer samples, typename MembershipFunctionType::Pointer msf, int numberOfNeighbors, int numberOfCandidates)
+		{
+			m_samples = samples;
+			m_membershipFunction =  msf;
+			m_numberOfNeighbors = numberOfNeighbors;
+			m_numberOfCandidates = numberOfCandidates;
+		}
+		// symmetric: i~j if j is among the neighbours of i or i among those of j
+		void GetAffinity(SparseAffinityMatrix& affinity);
+
+	protected:
+		ThreadedKnnAffinity(){}
+		~ThreadedKnnAffinity(){}
+
+	private:
+		enum { DescriptorSize = 9 };
+		int m_numberOfNeighbors;
+		int m_numberOfCandidates;
+		typename SampleType::Pointer  m_samples;
+		typename MembershipFunctionType::Pointer m_membershipFunction;
+
+		// kd-tree over m_descriptors, implicit in the order of m_tree:
+		// the node spanning [lo,hi) splits at mid=(lo+hi)/2 along m_splitDim[mid]
+		std::vector<float> m_descriptors;
+		std::vector<int> m_tree;
+		std::vector<unsigned char> m_splitDim;
+		void BuildTree(int lo, int hi);
+		void SearchTree(int lo, int hi, const float* query, std::vector<std::pair<float,int>>& heap) const;
+
+		std::vector<int> m_neighbors;
+		std::vector<double> m_values;
+		std::vector<double> m_selfValues;
+
+		void BeforeThreadedExecution();
+		void ThreadedExecution(const DomainType&, const itk::ThreadIdType);
+		void AfterThreadedExecution();
+
+};
+#include "ThreadedKnnAffinity.txx"
+#endif
+
@@ -0,0 +1,226 @@
+#ifndef _ThreadedKnnAffinity_txx
+#define _ThreadedKnnAffinity_txx
+
+
+#include "ThreadedKnnAffinity.h"
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+
+const int KnnAffinityLeafSize = 8;
+
+template< class  TMembershipFunctionType> void
+ThreadedKnnAffinity< TMembershipFunctionType >::BuildTree(int lo, int hi)
+{
+	if( hi - lo <= KnnAffinityLeafSize)
+		return;
+	// split along the dimension of largest spread
+	int dim=0;
+	float spread=-1;
+	for(int k=0;k<DescriptorSize;k++)
+	{
+		float mn = m_descriptors[m_tree[lo]*DescriptorSize+k], mx=mn;
+		for(int q=lo+1;q<hi;q++)
+		{
+			float v = m_descriptors[m_tree[q]*DescriptorSize+k];
+			mn = std::min(mn,v);
+			mx = std::max(mx,v);
+		}
+		if( mx-mn > spread)
+		{
+			spread = mx-mn;
+			dim = k;
+		}
+	}
+	int mid = (lo+hi)/2;
+	const float* desc = &m_descriptors[0];
+	std::nth_element(m_tree.begin()+lo, m_tree.begin()+mid, m_tree.begin()+hi,
+			[desc,dim](int a, int b) { return desc[a*DescriptorSize+dim] < desc[b*DescriptorSize+dim]; });
+	m_splitDim[mid]=dim;
+	this->BuildTree(lo, mid);
+	this->BuildTree(mid+1, hi);
+}
+
+template< class  TMembershipFunctionType> void
+ThreadedKnnAffinity< TMembershipFunctionType >::SearchTree(int lo, int hi, const float* query, std::vector<std::pair<float,int>>& heap) const
+{
+	// heap is a max-heap on distance holding the closest m_numberOfCandidates so far
+	auto consider = [&](int id)
+	{
+		const float* d = &m_descriptors[id*DescriptorSize];
+		float dist=0;
+		for(int k=0;k<DescriptorSize;k++)
+			dist += (d[k]-query[k])*(d[k]-query[k]);
+		if( (int)heap.size() < m_numberOfCandidates)
+		{
+			heap.push_back(std::make_pair(dist,id));
+			std::push_heap(heap.begin(), heap.end());
+		}
+		else if( dist < heap.front().first)
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.back() = std::make_pair(dist,id);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	};
+	if( hi - lo <= KnnAffinityLeafSize)
+	{
+		for(int q=lo;q<hi;q++)
+			consider(m_tree[q]);
+		return;
+	}
+	int mid = (lo+hi)/2;
+	int id = m_tree[mid];
+	consider(id);
+	int dim = m_splitDim[mid];
+	float diff = query[dim] - m_descriptors[id*DescriptorSize+dim];
+	if( diff < 0)
+		this->SearchTree(lo, mid, query, heap);
+	else
+		this->SearchTree(mid+1, hi, query, heap);
+	if( (int)heap.size() < m_numberOfCandidates || diff*diff < heap.front().first)
+	{
+		if( diff < 0)
+			this->SearchTree(mid+1, hi, query, heap);
+		else
+			this->SearchTree(lo, mid, query, heap);
+	}
+}
+
+template< class  TMembershipFunctionType> void
+ThreadedKnnAffinity< TMembershipFunctionType >::BeforeThreadedExecution()
+{
+	const int n = m_samples->Size();
+	// first, middle and last point of each fiber, in both orientations
+	m_descriptors.resize(2*n*DescriptorSize);
+	for(int i=0;i<n;i++)
+	{
+		const MeasurementVectorType& mv = m_samples->GetMeasurementVector(i);
+		int numberOfPoints = mv.Size()/3;
+		int m0 = (numberOfPoints-1)/2, m1= numberOfPoints/2;
+		float* fwd = &m_descriptors[(2*i)*DescriptorSize];
+		float* bwd = &m_descriptors[(2*i+1)*DescriptorSize];
+		for(int k=0;k<3;k++)
+		{
+			float first = mv[k], last = mv[(numberOfPoints-1)*3+k];
+			float middle = 0.5*(mv[m0*3+k]+mv[m1*3+k]);
+			fwd[k] = first; fwd[3+k] = middle; fwd[6+k] = last;
+			bwd[k] = last; bwd[3+k] = middle; bwd[6+k] = first;
+		}
+	}
+	m_tree.resize(2*n);
+	for(int i=0;i<2*n;i++)
+		m_tree[i]=i;
+	m_splitDim.assign(2*n,0);
+	this->BuildTree(0, 2*n);
+
+	m_neighbors.assign((size_t)n*m_numberOfNeighbors, -1);
+	m_values.assign((size_t)n*m_numberOfNeighbors, 0);
+	m_selfValues.assign(n, 0);
+}
+template< class  TMembershipFunctionType> void
+ThreadedKnnAffinity< TMembershipFunctionType >::ThreadedExecution(const DomainType& subDomain, const itk::ThreadIdType threadId)
+{
+	const int n = m_samples->Size();
+	std::vector<std::pair<float,int>> heap;
+	std::vector<std::pair<double,int>> candidates;
+	heap.reserve(m_numberOfCandidates);
+	for( itk::IndexValueType i = subDomain[0]; i <= subDomain[1]; ++i )
+	{
+		heap.clear();
+		this->SearchTree(0, 2*n, &m_descriptors[(2*i)*DescriptorSize], heap);
+
+		std::vector<int> ids;
+		for(unsigned int q=0;q<heap.size();q++)
+			if( heap[q].second/2 != i)
+				ids.push_back(heap[q].second/2);
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+		candidates.clear();
+		for(unsigned int q=0;q<ids.size();q++)
+		{
+			double val = m_membershipFunction->Evaluate(&m_samples->GetMeasurementVector(i), &m_samples->GetMeasurementVector(ids[q]));
+			// most similar first, ties by fiber index so the result does not depend on threading
+			candidates.push_back(std::make_pair(-val,ids[q]));
+		}
+		int k = std::min((int)candidates.size(), m_numberOfNeighbors);
+		std::partial_sort(candidates.begin(), candidates.begin()+k, candidates.end());
+		for(int q=0;q<k;q++)
+		{
+			m_neighbors[(size_t)i*m_numberOfNeighbors+q] = candidates[q].second;
+			m_values[(size_t)i*m_numberOfNeighbors+q] = -candidates[q].first;
+		}
+		m_selfValues[i] = m_membershipFunction->Evaluate(&m_samples->GetMeasurementVector(i), &m_samples->GetMeasurementVector(i));
+	}
+}
+
+template< class  TMembershipFunctionType> void
+ThreadedKnnAffinity< TMembershipFunctionType >::AfterThreadedExecution()
+{
+	m_descriptors.clear();
+	m_tree.clear();
+	m_splitDim.clear();
+}
+
+template< class  TMembershipFunctionType> void
+ThreadedKnnAffinity< TMembershipFunctionType >::GetAffinity(SparseAffinityMatrix& affinity)
+{
+	const int n = m_selfValues.size();
+	const int k = m_numberOfNeighbors;
+	std::vector<long> count(n+1,0);
+	for(int i=0;i<n;i++)
+	{
+		count[i]++;	// diagonal
+		for(int q=0;q<k;q++)
+		{
+			int j = m_neighbors[(size_t)i*k+q];
+			if( j < 0) continue;
+			count[i]++;
+			count[j]++;
+		}
+	}
+	std::vector<long> start(n+1,0);
+	for(int i=0;i<n;i++)
+		start[i+1]=start[i]+count[i];
+	std::vector<std::pair<int,double>> entries(start[n]);
+	std::vector<long> fill(start.begin(), start.end()-1);
+	for(int i=0;i<n;i++)
+	{
+		entries[fill[i]++] = std::make_pair(i, m_selfValues[i]);
+		for(int q=0;q<k;q++)
+		{
+			int j = m_neighbors[(size_t)i*k+q];
+			if( j < 0) continue;
+			double val = m_values[(size_t)i*k+q];
+			entries[fill[i]++] = std::make_pair(j, val);
+			entries[fill[j]++] = std::make_pair(i, val);
+		}
+	}
+	m_neighbors.clear();
+	m_values.clear();
+
+	// sort each row and merge pairs found from both ends, keeping the larger value
+	affinity.m_rowStart.assign(n+1,0);
+	affinity.m_columns.clear();
+	affinity.m_values.clear();
+	affinity.m_columns.reserve(start[n]);
+	affinity.m_values.reserve(start[n]);
+	for(int i=0;i<n;i++)
+	{
+		std::sort(entries.begin()+start[i], entries.begin()+start[i+1]);
+		for(long e=start[i];e<start[i+1];e++)
+		{
+			if( e > start[i] && entries[e].first == affinity.m_columns.back())
+			{
+				affinity.m_values.back() = std::max(affinity.m_values.back(), entries[e].second);
+				continue;
+			}
+			affinity.m_columns.push_back(entries[e].first);
+			affinity.m_values.push_back(entries[e].second);
+		}
+		affinity.m_rowStart[i+1] = affinity.m_columns.size();
+	}
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef _ThreadedSparseMatrixVectorProduct_h
+#define _ThreadedSparseMatrixVectorProduct_h
+
+#include "itkDomainThreader.h"
+#include "itkThreadedIndexedContainerPartitioner.h"
+#include "ThreadedKnnAffinity.h"
+#include <vector>
+
+/* y = S W S x for a sparse affinity W and a diagonal scaling S, one block of
+ * rows per thread. With S = D^-1/2 this is the normalized affinity whose
+ * eigenvectors give the normalized cut. */
+class ThreadedSparseMatrixVectorProduct :  public itk::DomainThreader<itk::ThreadedIndexedContainerPartitioner, SparseAffinityMatrix>
+{
+	public :
+		using Self = ThreadedSparseMatrixVectorProduct;
+		using Superclass =  itk::DomainThreader<itk::ThreadedIndexedContainerPartitioner,SparseAffinityMatrix>;
+		using Pointer =  itk::SmartPointer<Self>;
+		using ConstPointer = itk::SmartPointer<const Self>;
+
+		using DomainType = Superclass::DomainType;
+		itkNewMacro(Self);
+
+		void SetStuff(const std::vector<double>* scale, const double* x, double* y)
+		{
+			m_scale = scale;
+			m_x = x;
+			m_y = y;
+		}
+
+	protected:
+		ThreadedSparseMatrixVectorProduct(){}
+		~ThreadedSparseMatrixVectorProduct(){}
+
+	private:
+		const std::vector<double>* m_scale;
+		const double* m_x;
+		double* m_y;
+		void BeforeThreadedExecution(){}
+		void ThreadedExecution(const DomainType& subDomain, const itk::ThreadIdType threadId)
+		{
+			const SparseAffinityMatrix* w = this->m_Associate;
+			const std::vector<double>& s = *m_scale;
+			for( itk::IndexValueType i = subDomain[0]; i <= subDomain[1]; ++i )
+			{
+				double sum=0;
+				for(long e=w->m_rowStart[i];e<w->m_rowStart[i+1];e++)
+				{
+					int j = w->m_columns[e];
+					sum += w->m_values[e]*s[j]*m_x[j];
+				}
+				m_y[i] = s[i]*sum;
+			}
+		}
+		void AfterThreadedExecution(){}
+
+};
+#endif
@@ -84,7 +84,10 @@ FSVolume::FSVolume( FSVolume* ref, QObject* parent ) : QObject( parent ),
   m_bValidHistogram(false),
   m_bSharedMRI(false),
   m_lta(NULL),
-  m_bIgnoreHeader(false)
+  m_bIgnoreHeader(false),
+  m_brickPyramid(NULL),
+  m_nBrickLevel(0),
+  m_nStreamBudget(1024)
 {
   m_imageData = NULL;
   if ( ref )
@@ -144,6 +147,11 @@ FSVolume::~FSVolume()
   {
     ::LTAfree(&m_lta);
   }
+
+  if (m_brickPyramid)
+  {
+    ::MRIbrickPyramidClose(&m_brickPyramid);
+  }
 }
 
 bool FSVolume::LoadMRI( const QString& filename, const QString& reg_filename )
@@ -161,7 +169,10 @@ bool FSVolume::LoadMRI( const QString& filename, const QString& reg_filename )
   MRI* tempMRI = m_MRI;
   try
   {
-    m_MRI = ::MRIread( filename.toLatin1().data() );      // could be long process
+    if ( ::MRIisBrickPyramid( filename.toLatin1().data() ) )
+      m_MRI = LoadBrickPyramid( filename );
+    else
+      m_MRI = ::MRIread( filename.toLatin1().data() );      // could be long process
   }
   catch (int ret)
   {
@@ -242,6 +253,33 @@ bool FSVolume::LoadMRI( const QString& filename, const QString& reg_filename )
   return true;
 }
 
+MRI* FSVolume::LoadBrickPyramid( const QString& filename )
+{
+  if ( m_brickPyramid )
+  {
+    ::MRIbrickPyramidClose( &m_brickPyramid );
+  }
+
+  size_t budget = (size_t)qMax(m_nStreamBudget, 1)*1024*1024;
+  m_brickPyramid = ::MRIbrickPyramidOpen( filename.toLatin1().data(), budget );
+  if ( !m_brickPyramid )
+  {
+    return NULL;
+  }
+
+  // a quarter of the budget goes to the resident overview level, the rest
+  // caches the full resolution bricks streamed in for the displayed slices
+  m_nBrickLevel = ::MRIbrickPyramidLevelForBudget( m_brickPyramid, budget/4 );
+  ::MRIbrickPyramidSetMemoryBudget( m_brickPyramid,
+                                    budget - qMin(budget/2, ::MRIbrickPyramidLevelBytes( m_brickPyramid, m_nBrickLevel )) );
+  if ( m_nBrickLevel > 0 )
+  {
+    cout << "Streaming " << qPrintable(filename) << " from level " << m_nBrickLevel
+         << " (memory budget " << m_nStreamBudget << " MB)\n";
+  }
+  return ::MRIbrickPyramidReadLevel( m_brickPyramid, m_nBrickLevel );
+}
+
 bool FSVolume::MRIRead( const QString& filename, const QString& reg_filename )
 {
 #ifdef HAVE_OPENMP
@@ -800,6 +838,12 @@ bool FSVolume::MRIWrite( const QString& filename, int nSampleMethod, bool resamp
     return false;
   }
 
+  if ( IsStreaming() )
+  {
+    cerr << "Warning: only a downsampled level of " << m_brickPyramid->fname
+         << " is in memory. Saved volume will be at that resolution.\n";
+  }
+
   // check if transformation needed
   bool bTransformed = false;
   bool bRefTransformed = false;
@@ -1936,6 +1980,61 @@ void FSVolume::UpdateRASToRASMatrix()
   MatrixFree( &mTarg );
 }
 
+// create the scalars for all of the images. set the element size
+// for the data we will read.
+static bool AllocateImageScalars( vtkImageData* image, int nType, int zFrames )
+{
+#if VTK_MAJOR_VERSION > 5
+  switch ( nType )
+  {
+  case MRI_UCHAR:
+  case MRI_RGB:
+    image->AllocateScalars(VTK_UNSIGNED_CHAR, zFrames);
+    break;
+  case MRI_INT:
+    image->AllocateScalars(VTK_INT, zFrames);
+    break;
+  case MRI_LONG:
+    image->AllocateScalars(VTK_LONG, zFrames);
+    break;
+  case MRI_FLOAT:
+    image->AllocateScalars(VTK_FLOAT, zFrames);
+    break;
+  case MRI_SHORT:
+    image->AllocateScalars(VTK_SHORT, zFrames);
+    break;
+  default:
+    return false;
+  }
+#else
+  image->SetNumberOfScalarComponents(zFrames);
+  switch ( nType )
+  {
+  case MRI_UCHAR:
+  case MRI_RGB:
+    image->SetScalarTypeToUnsignedChar();
+    break;
+  case MRI_INT:
+    image->SetScalarTypeToInt();
+    break;
+  case MRI_LONG:
+    image->SetScalarTypeToLong();
+    break;
+  case MRI_FLOAT:
+    image->SetScalarTypeToFloat();
+    break;
+  case MRI_SHORT:
+    image->SetScalarTypeToShort();
+    break;
+  default:
+    return false;
+  }
+  image->AllocateScalars();
+#endif
+
+  return true;
+}
+
 bool FSVolume::CreateImage( MRI* rasMRI )
 {
   // first copy mri data to image
@@ -2021,57 +2120,7 @@ bool FSVolume::CreateImage( MRI* rasMRI )
   if (rasMRI->type == MRI_RGB)
     zFrames = 4;
 
-  // create the scalars for all of the images. set the element size
-  // for the data we will read.
-#if VTK_MAJOR_VERSION > 5
-  switch ( rasMRI->type )
-  {
-  case MRI_UCHAR:
-  case MRI_RGB:
-    imageData->AllocateScalars(VTK_UNSIGNED_CHAR, zFrames);
-    break;
-  case MRI_INT:
-    imageData->AllocateScalars(VTK_INT, zFrames);
-    break;
-  case MRI_LONG:
-    imageData->AllocateScalars(VTK_LONG, zFrames);
-    break;
-  case MRI_FLOAT:
-    imageData->AllocateScalars(VTK_FLOAT, zFrames);
-    break;
-  case MRI_SHORT:
-    imageData->AllocateScalars(VTK_SHORT, zFrames);
-    break;
-  default:
-    return false;
-  }
-#else
-  imageData->SetNumberOfScalarComponents(zFrames);
-  switch ( rasMRI->type )
-  {
-  case MRI_UCHAR:
-  case MRI_RGB:
-    imageData->SetScalarTypeToUnsignedChar();
-    break;
-  case MRI_INT:
-    imageData->SetScalarTypeToInt();
-    break;
-  case MRI_LONG:
-    imageData->SetScalarTypeToLong();
-    break;
-  case MRI_FLOAT:
-    imageData->SetScalarTypeToFloat();
-    break;
-  case MRI_SHORT:
-    imageData->SetScalarTypeToShort();
-    break;
-  default:
-    return false;
-  }
-  imageData->AllocateScalars();
-#endif
-
-  return true;
+  return AllocateImageScalars( imageData, rasMRI->type, zFrames );
 }
 
 bool FSVolume::ResizeRotatedImage( MRI* rasMRI, MRI* refTarget, vtkImageData* refImageData,
@@ -2359,7 +2408,7 @@ MATRIX* FSVolume::GetRotationMatrix( int nPlane, double angle, double* origin )
 }
 
 void FSVolume::CopyMRIDataToImage( MRI* mri,
-                                   vtkImageData* image )
+                                   vtkImageData* image, bool bReportProgress )
 {
   // Copy the slice data into the scalars.
   int zX = mri->width;
@@ -2415,7 +2464,7 @@ void FSVolume::CopyMRIDataToImage( MRI* mri,
       }
     }
 
-    if ( nZ%(max(1, zZ/5)) == 0 )
+    if ( bReportProgress && nZ%(max(1, zZ/5)) == 0 )
     {
       nProgress += nProgressStep;
       emit ProgressChanged( nProgress );
@@ -2423,6 +2472,150 @@ void FSVolume::CopyMRIDataToImage( MRI* mri,
   }
 }
 
+/*
+ * Resamples one slice of the target space from the full resolution level of
+ * the brick pyramid. The slice is 1 voxel thick along nPlane and 2^level
+ * times finer than the displayed image in plane. Only the bricks crossed by
+ * the slice are read (and kept in the pyramid's cache). Safe to call from a
+ * worker thread. Returns NULL if there is nothing to stream.
+ */
+vtkSmartPointer<vtkImageData> FSVolume::CreateStreamedSlice( int nPlane, double dSlicePos )
+{
+  if ( !IsStreaming() || m_matReg || !m_MRITarget || !m_imageData )
+  {
+    return NULL;
+  }
+
+  int F = (1 << m_nBrickLevel);
+  int dim[3];
+  double origin[3], vs[3];
+  m_imageData->GetDimensions( dim );
+  m_imageData->GetOrigin( origin );
+  m_imageData->GetSpacing( vs );
+
+  // slab voxel -> target voxel
+  MATRIX* A = MatrixIdentity( 4, NULL );
+  int slab_dim[3];
+  for ( int i = 0; i < 3; i++ )
+  {
+    if ( i == nPlane )
+    {
+      slab_dim[i] = 1;
+      *MATRIX_RELT( A, i+1, 4 ) = ( dSlicePos - origin[i] ) / vs[i];
+    }
+    else
+    {
+      slab_dim[i] = dim[i]*F;
+      *MATRIX_RELT( A, i+1, i+1 ) = 1.0/F;
+      *MATRIX_RELT( A, i+1, 4 ) = (1.0-F)/(2.0*F);
+    }
+  }
+  double k = *MATRIX_RELT( A, nPlane+1, 4 );
+  if ( k < -0.5 || k > dim[nPlane]-0.5 )
+  {
+    MatrixFree( &A );
+    return NULL;
+  }
+
+  MRI* slab = ::MRIallocSequence( slab_dim[0], slab_dim[1], slab_dim[2],
+                                  m_brickPyramid->type, m_brickPyramid->nframes );
+  if ( !slab )
+  {
+    MatrixFree( &A );
+    return NULL;
+  }
+  ::MRIcopyHeader( m_MRITarget, slab );
+  slab->xsize = m_MRITarget->xsize * ( nPlane == 0 ? 1 : 1.0/F );
+  slab->ysize = m_MRITarget->ysize * ( nPlane == 1 ? 1 : 1.0/F );
+  slab->zsize = m_MRITarget->zsize * ( nPlane == 2 ? 1 : 1.0/F );
+  MATRIX* T = MRIxfmCRS2XYZ( m_MRITarget, 0 );
+  MATRIX* vox2ras = MatrixMultiply( T, A, NULL );
+  MRIsetVox2RASFromMatrix( slab, vox2ras );
+  MRIreInitCache( slab );
+
+  // bounding box of the slab in full resolution voxels
+  MATRIX* V0 = ::MRIbrickPyramidLevelVox2RAS( m_brickPyramid, 0, NULL );
+  MATRIX* V0inv = MatrixInverse( V0, NULL );
+  MATRIX* slab2src = MatrixMultiply( V0inv, vox2ras, NULL );
+  double bmin[3] = { 1e10, 1e10, 1e10 }, bmax[3] = { -1e10, -1e10, -1e10 };
+  MATRIX* c = MatrixAlloc( 4, 1, MATRIX_REAL );
+  MATRIX* p = NULL;
+  for ( int n = 0; n < 8; n++ )
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      c->rptr[i+1][1] = ( n & (1 << i) ) ? slab_dim[i]-1 : 0;
+    }
+    c->rptr[4][1] = 1;
+    p = MatrixMultiply( slab2src, c, p );
+    for ( int i = 0; i < 3; i++ )
+    {
+      bmin[i] = qMin( bmin[i], (double)p->rptr[i+1][1] );
+      bmax[i] = qMax( bmax[i], (double)p->rptr[i+1][1] );
+    }
+  }
+  MatrixFree( &c );
+  MatrixFree( &p );
+  MatrixFree( &slab2src );
+  MatrixFree( &V0inv );
+  MatrixFree( &V0 );
+  MatrixFree( &vox2ras );
+  MatrixFree( &T );
+  MatrixFree( &A );
+
+  BRICK_LEVEL* lv = &m_brickPyramid->level[0];
+  int lv_dim[3] = { lv->width, lv->height, lv->depth };
+  int r0[3], r1[3];
+  for ( int i = 0; i < 3; i++ )
+  {
+    r0[i] = qMax( 0, (int)floor( bmin[i] ) - 1 );
+    r1[i] = qMin( lv_dim[i]-1, (int)ceil( bmax[i] ) + 1 );
+    if ( r0[i] > r1[i] )
+    {
+      ::MRIfree( &slab );
+      return NULL;
+    }
+  }
+
+  MRI* region = ::MRIbrickPyramidReadRegion( m_brickPyramid, 0, r0[0], r0[1], r0[2],
+                                             r1[0]-r0[0]+1, r1[1]-r0[1]+1, r1[2]-r0[2]+1 );
+  if ( !region )
+  {
+    ::MRIfree( &slab );
+    return NULL;
+  }
+  ::MRIvol2Vol( region, slab, NULL, m_nInterpolationMethod, 0 );
+  ::MRIfree( &region );
+
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  double slab_origin[3], slab_vs[3];
+  for ( int i = 0; i < 3; i++ )
+  {
+    if ( i == nPlane )
+    {
+      slab_vs[i] = vs[i];
+      slab_origin[i] = dSlicePos;
+    }
+    else
+    {
+      slab_vs[i] = vs[i]/F;
+      slab_origin[i] = origin[i] + (1.0-F)/(2.0*F)*vs[i];
+    }
+  }
+  image->SetSpacing( slab_vs );
+  image->SetOrigin( slab_origin );
+  image->SetDimensions( slab_dim );
+  if ( !AllocateImageScalars( image, slab->type, slab->nframes ) )
+  {
+    ::MRIfree( &slab );
+    return NULL;
+  }
+  CopyMRIDataToImage( slab, image, false );
+  ::MRIfree( &slab );
+
+  return image;
+}
+
 vtkImageData* FSVolume::GetImageOutput()
 {
   return m_imageData;
@@ -34,6 +34,7 @@
 #include "histo.h"
 #include "colortab.h"
 #include "transform.h"
+#include "mribrick.h"
 
 
 class vtkTransform;
@@ -224,6 +225,20 @@ public:
     m_bIgnoreHeader = b;
   }
 
+  // memory budget (in MB) when reading a brick pyramid (.fsbrick)
+  void SetStreamMemoryBudget(int nMB)
+  {
+    m_nStreamBudget = nMB;
+  }
+
+  // true when only a downsampled level of a brick pyramid is held in memory
+  bool IsStreaming()
+  {
+    return m_brickPyramid && m_nBrickLevel > 0;
+  }
+
+  vtkSmartPointer<vtkImageData> CreateStreamedSlice(int nPlane, double dSlicePos);
+
 Q_SIGNALS:
   void ProgressChanged( int n );
 
@@ -236,7 +251,8 @@ public slots:
 protected:
   bool LoadMRI( const QString& filename, const QString& reg_filename );
   void UpdateHistoCDF(int frame = 0, float threshold = -1, bool bHighThreshold = false);
-  void CopyMRIDataToImage( MRI* mri, vtkImageData* image );
+  void CopyMRIDataToImage( MRI* mri, vtkImageData* image, bool bReportProgress = true );
+  MRI* LoadBrickPyramid( const QString& filename );
   void CopyMatricesFromMRI();
   bool CreateImage( MRI* mri );
   bool ResizeRotatedImage( MRI* mri, MRI* refTarget, vtkImageData* refImageData, double* rasPoint );
@@ -289,6 +305,10 @@ protected:
   bool      m_bCropToOriginal;
 
   bool      m_bSharedMRI;
+
+  MRI_BRICK_PYRAMID* m_brickPyramid;
+  int       m_nBrickLevel;
+  int       m_nStreamBudget;
 };
 
 #endif
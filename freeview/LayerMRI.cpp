@@ -71,6 +71,7 @@
 #include <QDebug>
 #include "ProgressCallback.h"
 #include "LayerMRIWorkerThread.h"
+#include "LayerMRIBrickStreamer.h"
 #include "vtkImageFlip.h"
 #include "LayerSurface.h"
 #include "vtkImageResample.h"
@@ -108,7 +109,8 @@ LayerMRI::LayerMRI( LayerMRI* ref, QObject* parent ) : LayerVolumeBase( parent )
   m_nGotoLabelOrientation(-1),
   m_layerMask(NULL),
   m_correlationSurface(NULL),
-  m_bIgnoreHeader(false)
+  m_bIgnoreHeader(false),
+  m_nStreamBudget(1024)
 {
   m_strTypeNames.push_back( "Supplement" );
   m_strTypeNames.push_back( "MRI" );
@@ -186,6 +188,8 @@ LayerMRI::LayerMRI( LayerMRI* ref, QObject* parent ) : LayerVolumeBase( parent )
   qRegisterMetaType< IntList >( "IntList" );
   m_worker = new LayerMRIWorkerThread(this);
   connect(m_worker, SIGNAL(LabelInformationReady()), this, SLOT(OnLabelInformationReady()));
+  m_brickStreamer = new LayerMRIBrickStreamer(this);
+  connect(m_brickStreamer, SIGNAL(SliceReady(int)), this, SLOT(OnStreamedSliceReady(int)), Qt::QueuedConnection);
 
   connect(this, SIGNAL(Modified()), this, SLOT(UpdateLabelInformation()));
   
@@ -203,6 +207,8 @@ LayerMRI::~LayerMRI()
 {
   if (m_worker->isRunning())
     m_worker->Abort();
+  m_brickStreamer->Abort();
+  m_brickStreamer->wait();
   for ( int i = 0; i < 3; i++ )
   {
     m_sliceActor2D[i]->Delete();
@@ -356,6 +362,7 @@ bool LayerMRI::LoadVolumeFromFile()
   m_volumeSource->SetConform( m_bConform );
   m_volumeSource->SetInterpolationMethod( m_nSampleMethod );
   m_volumeSource->SetIgnoreHeader(m_bIgnoreHeader);
+  m_volumeSource->SetStreamMemoryBudget(m_nStreamBudget);
   
   if ( !m_volumeSource->MRIRead( m_sFilename.toLatin1().data(),
                                  m_sRegFilename.size() > 0 ? m_sRegFilename.toLatin1().data() : NULL ) )
@@ -1307,6 +1314,53 @@ void LayerMRI::OnSlicePositionChanged( int nPlane )
   {
     UpdateLabelOutline();
   }
+
+  // show the coarse level right away and fetch full resolution in background
+  if ( mResliceStreamed[nPlane].GetPointer() )
+  {
+    if ( mColorMap[nPlane]->GetInputConnection(0, 0) == mResliceStreamed[nPlane]->GetOutputPort() )
+      mColorMap[nPlane]->SetInputConnection( mReslice[nPlane]->GetOutputPort() );
+    mResliceStreamed[nPlane] = NULL;
+  }
+  if ( CanStreamSlices() )
+  {
+    m_brickStreamer->RequestSlice( nPlane, m_dSlicePosition[nPlane] );
+  }
+}
+
+bool LayerMRI::CanStreamSlices()
+{
+  // streamed slices replace the plain reslice output only
+  return ( m_volumeSource && m_volumeSource->IsStreaming() &&
+           !GetProperty()->GetDisplayVector() && !GetProperty()->GetDisplayTensor() &&
+           !GetProperty()->GetDisplayRGB() && !GetProperty()->GetShowLabelOutline() &&
+           GetProperty()->GetUpSampleMethod() == LayerPropertyMRI::UM_None );
+}
+
+void LayerMRI::OnStreamedSliceReady(int nPlane)
+{
+  vtkSmartPointer<vtkImageData> image = m_brickStreamer->TakeSlice( nPlane, m_dSlicePosition[nPlane] );
+  if ( !image || !CanStreamSlices() || !mColorMap[nPlane].GetPointer() )
+  {
+    return;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> axes = vtkSmartPointer<vtkMatrix4x4>::New();
+  axes->DeepCopy( mReslice[nPlane]->GetResliceAxes() );
+  mResliceStreamed[nPlane] = vtkSmartPointer<vtkImageReslice>::New();
+#if VTK_MAJOR_VERSION > 5
+  mResliceStreamed[nPlane]->SetInputData( image );
+#else
+  mResliceStreamed[nPlane]->SetInput( image );
+#endif
+  mResliceStreamed[nPlane]->BorderOn();
+  mResliceStreamed[nPlane]->SetResliceTransform( mReslice[nPlane]->GetResliceTransform() );
+  mResliceStreamed[nPlane]->AutoCropOutputOn();
+  mResliceStreamed[nPlane]->SetOutputDimensionality( 2 );
+  mResliceStreamed[nPlane]->SetResliceAxes( axes );
+  mResliceStreamed[nPlane]->SetInterpolationMode( mReslice[nPlane]->GetInterpolationMode() );
+  mColorMap[nPlane]->SetInputConnection( mResliceStreamed[nPlane]->GetOutputPort() );
+  emit ActorUpdated();
 }
 
 void LayerMRI::UpdateDisplayMode()
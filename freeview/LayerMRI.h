@@ -54,6 +54,7 @@ class Contour2D;
 class SurfaceRegion;
 class SurfaceRegionGroups;
 class LayerMRIWorkerThread;
+class LayerMRIBrickStreamer;
 class LayerSurface;
 class LayerROI;
 class GeoSWorker;
@@ -331,6 +332,11 @@ public:
     m_bIgnoreHeader = b;
   }
 
+  void SetStreamMemoryBudget(int nMB)
+  {
+    m_nStreamBudget = nMB;
+  }
+
   QVector<double> GetVoxelList(int nVal, bool bForce = false);
 
   int GetLabelCount(int nVal);
@@ -434,6 +440,8 @@ protected slots:
   void UpdateLabelInformation();
   void OnLabelInformationReady();
 
+  void OnStreamedSliceReady(int nPlane);
+
   void UpdateVectorLineWidth(double val);
 
 protected:
@@ -465,6 +473,7 @@ protected:
 
   // Pipeline ------------------------------------------------------------
   vtkSmartPointer<vtkImageReslice>      mReslice[3];
+  vtkSmartPointer<vtkImageReslice>      mResliceStreamed[3];
   vtkSmartPointer<vtkImageMapToColors>  mColorMap[3];
   vtkSmartPointer<vtkImageMapToColors>  mColorMapMaxProjection[3];
   vtkSmartPointer<vtkSimpleLabelEdgeFilter>   mEdgeFilter[3];
@@ -478,6 +487,7 @@ protected:
   bool    m_bConform;
   bool    m_bWriteResampled;
   bool    m_bIgnoreHeader;
+  int     m_nStreamBudget;
 
   vtkImageActor*  m_sliceActor2D[3];
   vtkImageActor*  m_sliceActor3D[3];
@@ -520,7 +530,10 @@ private:
   double**    private_buf1_3x3;
   double**    private_buf2_3x3;
 
+  bool CanStreamSlices();
+
   LayerMRIWorkerThread* m_worker;
+  LayerMRIBrickStreamer* m_brickStreamer;
   QList<int>  m_nAvailableLabels;
   QMap<int, QList<double> > m_listLabelCenters;
   QMap<int, QVector<double> > m_voxelLists;
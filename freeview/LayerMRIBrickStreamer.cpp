@@ -0,0 +1,98 @@
+#include "LayerMRIBrickStreamer.h"
+#include "LayerMRI.h"
+#include "FSVolume.h"
+#include <QMutexLocker>
+
+LayerMRIBrickStreamer::LayerMRIBrickStreamer(LayerMRI *mri) :
+  QThread(mri), m_bAbort(false), m_bIdle(true)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    m_bPending[i] = false;
+    m_dPendingPos[i] = m_dSlicePos[i] = 0;
+  }
+}
+
+void LayerMRIBrickStreamer::Abort()
+{
+  QMutexLocker locker(&mutex);
+  m_bAbort = true;
+  for (int i = 0; i < 3; i++)
+    m_bPending[i] = false;
+}
+
+void LayerMRIBrickStreamer::RequestSlice(int nPlane, double dPos)
+{
+  bool bStart = false;
+  {
+    QMutexLocker locker(&mutex);
+    if (m_bAbort)
+      return;
+    m_bPending[nPlane] = true;
+    m_dPendingPos[nPlane] = dPos;
+    if (m_bIdle)
+    {
+      m_bIdle = false;
+      bStart = true;
+    }
+  }
+  if (bStart)
+  {
+    // run() may still be on its way out after finding the queue empty
+    wait();
+    start();
+  }
+}
+
+vtkSmartPointer<vtkImageData> LayerMRIBrickStreamer::TakeSlice(int nPlane, double dPos)
+{
+  QMutexLocker locker(&mutex);
+  if (!m_slice[nPlane] || m_dSlicePos[nPlane] != dPos)
+    return NULL;
+  vtkSmartPointer<vtkImageData> image = m_slice[nPlane];
+  m_slice[nPlane] = NULL;
+  return image;
+}
+
+void LayerMRIBrickStreamer::run()
+{
+  LayerMRI* mri = qobject_cast<LayerMRI*>(parent());
+  FSVolume* volume = mri->GetSourceVolume();
+  while (true)
+  {
+    int nPlane = -1;
+    double dPos = 0;
+    {
+      QMutexLocker locker(&mutex);
+      for (int i = 0; i < 3; i++)
+      {
+        if (m_bPending[i])
+        {
+          nPlane = i;
+          dPos = m_dPendingPos[i];
+          m_bPending[i] = false;
+          break;
+        }
+      }
+      if (nPlane < 0 || m_bAbort)
+      {
+        m_bIdle = true;
+        return;
+      }
+    }
+
+    vtkSmartPointer<vtkImageData> image = volume->CreateStreamedSlice(nPlane, dPos);
+    if (image)
+    {
+      {
+        QMutexLocker locker(&mutex);
+        // a newer request for this plane makes the result useless
+        if (m_bAbort || (m_bPending[nPlane] && m_dPendingPos[nPlane] != dPos))
+          continue;
+        m_slice[nPlane] = image;
+        m_dSlicePos[nPlane] = dPos;
+      }
+      emit SliceReady(nPlane);
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef LAYERMRIBRICKSTREAMER_H
+#define LAYERMRIBRICKSTREAMER_H
+
+#include <QThread>
+#include <QMutex>
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+class LayerMRI;
+
+// Fetches full resolution slices of a brick pyramid volume in the background.
+// Only the latest requested position of each plane is kept, so scrolling
+// through slices never queues up stale reads.
+class LayerMRIBrickStreamer : public QThread
+{
+  Q_OBJECT
+public:
+  explicit LayerMRIBrickStreamer(LayerMRI *mri);
+
+  void RequestSlice(int nPlane, double dPos);
+
+  // returns the streamed slice if it was made for the given position
+  vtkSmartPointer<vtkImageData> TakeSlice(int nPlane, double dPos);
+
+signals:
+  void SliceReady(int nPlane);
+
+public slots:
+  void Abort();
+
+protected:
+  void run();
+
+  bool m_bAbort;
+  bool m_bIdle;
+  bool m_bPending[3];
+  double m_dPendingPos[3];
+  double m_dSlicePos[3];
+  vtkSmartPointer<vtkImageData> m_slice[3];
+  QMutex mutex;
+};
+
+#endif // LAYERMRIBRICKSTREAMER_H
@@ -2584,6 +2584,15 @@ void MainWindow::CommandLoadVolume( const QStringList& sa )
       {
         sup_data["IgnoreHeader"] = true;
       }
+      else if (subOption == "stream_budget")
+      {
+        bool bOK;
+        int nMB = subArgu.toInt(&bOK);
+        if (bOK && nMB > 0)
+          sup_data["StreamBudget"] = nMB;
+        else
+          cerr << "Unrecognized memory budget for :stream_budget.\n";
+      }
       else if (subOption == "binary_color")
       {
         QColor color = ParseColorInput( subArgu );
@@ -5642,6 +5651,9 @@ void MainWindow::LoadVolumeFile( const QString& filename,
   if (sup_data.value("IgnoreHeader").toBool())
     layer->SetIgnoreHeader(true);
 
+  if (sup_data.contains("StreamBudget"))
+    layer->SetStreamMemoryBudget(sup_data["StreamBudget"].toInt());
+
   m_threadIOWorker->LoadVolume( layer );
 }
 
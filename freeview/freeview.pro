@@ -139,6 +139,7 @@ SOURCES += \
     WindowTimeCourse.cpp \
     WidgetTimeCoursePlot.cpp \
     LayerMRIWorkerThread.cpp \
+    LayerMRIBrickStreamer.cpp \
     DialogLabelStats.cpp \
     VolumeFilterWorkerThread.cpp \
     FSGroupDescriptor.cpp \
@@ -319,6 +320,7 @@ HEADERS  += \
     WindowTimeCourse.h \
     WidgetTimeCoursePlot.h \
     LayerMRIWorkerThread.h \
+    LayerMRIBrickStreamer.h \
     DialogLabelStats.h \
     VolumeFilterWorkerThread.h \
     FSGroupDescriptor.h \
@@ -293,6 +293,9 @@ char *ElementValueString(DCM_ELEMENT *e, int DoBackslash);
 int FreeElementData(DCM_ELEMENT *e);
 DCM_ELEMENT *GetElementFromFile(const char *dicomfile, long grpid, long elid);
 DCM_OBJECT *GetObjectFromFile(const char *fname, unsigned long options);
+DCM_ELEMENT *GetElementFromObject(DCM_OBJECT **object, long grpid, long elid);
+DCM_OBJECT *dcmHoldObject(const char *dcmfile);
+int dcmReleaseObject(void);
 int IsSiemensDICOM(const char *dcmfile);
 char *SiemensAsciiTag(const char *dcmfile,const  char *TagString, int flag);
 char *SiemensAsciiTagEx(const char *dcmfile,const  char *TagString, int cleanup);
@@ -15,8 +15,24 @@ typedef struct {
   float dist[MAX_GEODESICS];  // distances to vertices
 } Geodesics;
 
+// geodesics of all vertices in compressed sparse row form: the neighbors
+// of vertex k are v[offset[k]] ... v[offset[k+1]-1], sorted by vertex
+// number, at distances dist[offset[k]] ... dist[offset[k+1]-1]
+typedef struct {
+  int nvertices;
+  long long nnbrs;    // total number of neighbors (offset[nvertices])
+  long long *offset;  // nvertices+1
+  int *v;
+  float *dist;
+} GeodesicsCSR;
+
 // computes and returns the nearest geodesics for every vertex in the surface:
 Geodesics* computeGeodesics(MRIS* surf, float maxdist);
+GeodesicsCSR* computeGeodesicsCSR(MRIS* surf, float maxdist);
+Geodesics* geodesicsCSRToGeodesics(GeodesicsCSR* csr);
+void geodesicsCSRFree(GeodesicsCSR** pcsr);
+int geodesicsCSRWriteV2(GeodesicsCSR* csr, char* fname);
+GeodesicsCSR* geodesicsCSRReadV2(char* fname);
 
 // save/load geodesics:
 void geodesicsWrite(Geodesics* geo, int nvertices, char* fname);
@@ -30,6 +46,7 @@ typedef struct {
 }  VTXVOLINDEX;
 
 MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex, MRI *out);
+MRI *GeoSmoothCSR(MRI *src, double fwhm, MRIS *surf, GeodesicsCSR *geod, MRI *volindex, MRI *out);
 int GeoCount(Geodesics *geod, int nvertices);
 int GeoDumpVertex(char *fname, Geodesics *geod, int vtxno);
 int geodesicsWriteV2(Geodesics* geo, int nvertices, char* fname) ;
@@ -43,6 +60,7 @@ int VtxVolIndexPrint(VTXVOLINDEX *vvi, int nlist);
 int VtxVolIndexSortTest(int nlist);
 VTXVOLINDEX *VtxVolIndexUnique(VTXVOLINDEX *vvi, int nlist, int *nunique);
 VTXVOLINDEX *VtxVolIndexPack(Geodesics *geod, int vtxno, MRI *volindex);
+VTXVOLINDEX *VtxVolIndexPackList(int vnum, const int *v, const float *dist, MRI *volindex);
 Geodesics *VtxVolPruneGeod(Geodesics *geod, int vtxno, MRI *volindex);
 
 #endif
@@ -63,6 +63,20 @@ typedef struct
   MATRIX *p;
 } GTM_CONTRAST, GTMCON;
 
+/*
+  Sparse (compressed column) GTM design matrix. Each column is a seg
+  smoothed by the PSF, which is nonzero only within the padded bounding
+  box of the seg, so only those entries are kept. Rows are the voxels in
+  the mask in the same order as the dense X (see GTMvol2mat()).
+*/
+typedef struct
+{
+  int rows, cols;
+  int *nnz;    // number of entries in each column
+  int **rowno; // 0-based row of each entry, ascending
+  float **val; // value of each entry
+} GTM_SPARSE_X;
+
 typedef struct 
 {
   int nrad;
@@ -116,6 +130,8 @@ typedef struct
 
   // GLM stuff for GTM
   MATRIX *X,*X0;
+  int UseSparseX; // build Xs and X0s instead of X and X0
+  GTM_SPARSE_X *Xs,*X0s;
   MATRIX *y, *XtX, *iXtX, *Xty, *beta, *res, *yhat,*betavar;
   MATRIX *rvar,*rvargm,*rvarbrain,*rvarUnscaled; // residual variance, all vox and only GM
   MATRIX *som; // spillover matrix
@@ -209,6 +225,15 @@ int GTMprintReplaceList(FILE *fp, const int nReplace, const int *ReplaceThis, co
 int GTMcheckReplaceList(const int nReplace, const int *ReplaceThis, const int *WithThat);
 int GTMloadReplacmentList(const char *fname, int *nReplace, int *ReplaceThis, int *WithThat);
 int GTMcheckX(MATRIX *X);
+GTM_SPARSE_X *GTMsparseXalloc(int rows, int cols);
+int GTMsparseXfree(GTM_SPARSE_X **pXs);
+MATRIX *GTMsparseXtoDense(GTM_SPARSE_X *Xs, MATRIX *X);
+MATRIX *GTMsparseAtB(GTM_SPARSE_X *A, GTM_SPARSE_X *B, MATRIX *AtB);
+MATRIX *GTMsparseAtY(GTM_SPARSE_X *A, MATRIX *y, MATRIX *Aty);
+MATRIX *GTMsparseMultiply(GTM_SPARSE_X *A, MATRIX *beta, MATRIX *yhat);
+int GTMcholeskySolve(MATRIX *XtX, MATRIX *Xty, MATRIX *beta, MATRIX *iXtX);
+int GTMhaveX(GTM *gtm);
+int *GTMrowSegNo(GTM *gtm);
 int GTMautoMask(GTM *gtm);
 int GTMrvarGM(GTM *gtm);
 int GTMttest(GTM *gtm);
@@ -107,6 +107,14 @@ MATRIX  *MatrixMultiply_wkr( const MATRIX *m1, const MATRIX *m2, MATRIX *m3,
     	// (r1 x c1) * (r2 x c2) = (r1 x c2)
 	// c1 must equal r2
 
+/* Large real products (MatrixMultiply, MatrixMultiplyD, MatrixAtB, MatrixMtM),
+   inverses and SVDs are done with BLAS/LAPACK when utils is built with them.
+   An operation goes there when it needs at least min_madds multiply-adds.
+   MatrixBlasThreshold sets that (negative turns the backend off) and returns
+   the old value; FREESURFER_MatrixBlasMin overrides the default. */
+int     MatrixBlasAvailable(void);
+double  MatrixBlasThreshold(double min_madds);
+
 MATRIX *MatrixMultiplyElts(MATRIX *m1, MATRIX *m2, MATRIX *m12); // like matlab m1.*m2
 MATRIX *MatrixDivideElts(MATRIX *num, MATRIX *den, MATRIX *quotient); // like matlab num./den
 MATRIX *MatrixReplicate(MATRIX *mIn, int nr, int nc, MATRIX *mOut); // like matlab repmat()
@@ -834,6 +834,27 @@ int   MRIsampleSeqVolumeType(MRI *mri,
 			     double x, double y, double z,
 			     float *valvect,
 			     int firstframe, int lastframe, int type);
+
+/* A sampling stencil holds the source voxels and weights that make up
+   one interpolated sample, so that the geometry is worked out once and
+   then applied to every frame of a 4D volume. */
+typedef struct
+{
+  int nvox;          // 0 = outside the volume, 1 = nearest neighbor, 8 = trilinear
+  int c[8], r[8], s[8];
+  double w[8];       // trilinear weights, in the order MRIsampleSeqVolume() sums them
+} MRI_SAMPLE_STENCIL;
+
+int   MRIsampleStencilVoxel(const MRI *mri, int c, int r, int s,
+                            MRI_SAMPLE_STENCIL *st);
+int   MRIsampleStencilSeq(const MRI *mri, double x, double y, double z,
+                          MRI_SAMPLE_STENCIL *st);
+int   MRIsampleStencilType(const MRI *mri, double x, double y, double z,
+                           int type, MRI_SAMPLE_STENCIL *st);
+int   MRIsampleStencilFrames(const MRI *mri, const MRI_SAMPLE_STENCIL *st,
+                             float *valvect, int firstframe, int lastframe);
+int   MRIsetVoxValFrames(MRI *mri, int c, int r, int s,
+                         const float *valvect, int firstframe, int lastframe);
 int   MRIsampleVolumeType( const MRI *mri,
                            double x, double y, double z,
                            double *pval,
@@ -0,0 +1,76 @@
+/**
+ * @brief bricked, multi-resolution volume files for out-of-core access
+ *
+ * A brick pyramid stores a volume as a stack of resolution levels (level 0
+ * is the full-resolution volume, each further level is downsampled by 2 in
+ * every direction). Every level is cut into cubic bricks that are stored
+ * contiguously, so any sub-region of any level can be read with a handful
+ * of seeks. Bricks read from disk are held in an LRU cache bounded by a
+ * memory budget, which lets viewers show a coarse level immediately and
+ * stream full-resolution data for the region they actually display.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#ifndef MRIBRICK_H
+#define MRIBRICK_H
+
+#include <stdio.h>
+
+#include "mri.h"
+
+#define BRICK_PYRAMID_MAGIC          "FSBRICK"
+#define BRICK_PYRAMID_VERSION        1
+#define BRICK_PYRAMID_MAX_LEVELS     16
+#define BRICK_PYRAMID_DEFAULT_SIZE   64
+#define BRICK_PYRAMID_HEADER_BYTES   1024
+
+typedef struct
+{
+  int width, height, depth;   // dimensions of this level in voxels
+  int nbx, nby, nbz;          // number of bricks along each axis
+  long long offset;           // file offset of the first brick of this level
+} BRICK_LEVEL;
+
+typedef struct
+{
+  char fname[STRLEN];
+  int fd;
+  int type;                   // MRI_UCHAR, MRI_SHORT, MRI_INT, MRI_LONG or MRI_FLOAT
+  int nframes;
+  int brick_size;             // bricks are brick_size^3 voxels (x nframes)
+  int nlevels;
+  BRICK_LEVEL level[BRICK_PYRAMID_MAX_LEVELS];
+  MRI *mri_header;            // header-only MRI with the level 0 geometry
+  size_t max_bytes;           // memory budget for cached bricks
+  void *cache;                // brick LRU, private to mribrick.cpp
+} MRI_BRICK_PYRAMID;
+
+int MRIwriteBrickPyramid(MRI *mri, const char *fname, int brick_size, int nlevels, int nearest);
+int MRIisBrickPyramid(const char *fname);
+
+MRI_BRICK_PYRAMID *MRIbrickPyramidOpen(const char *fname, size_t max_bytes);
+int MRIbrickPyramidClose(MRI_BRICK_PYRAMID **pbp);
+int MRIbrickPyramidSetMemoryBudget(MRI_BRICK_PYRAMID *bp, size_t max_bytes);
+size_t MRIbrickPyramidCachedBytes(MRI_BRICK_PYRAMID *bp);
+
+size_t MRIbrickPyramidLevelBytes(MRI_BRICK_PYRAMID *bp, int level);
+int MRIbrickPyramidLevelForBudget(MRI_BRICK_PYRAMID *bp, size_t max_bytes);
+MATRIX *MRIbrickPyramidLevelVox2RAS(MRI_BRICK_PYRAMID *bp, int level, MATRIX *m);
+MRI *MRIbrickPyramidLevelHeader(MRI_BRICK_PYRAMID *bp, int level);
+
+MRI *MRIbrickPyramidReadLevel(MRI_BRICK_PYRAMID *bp, int level);
+MRI *MRIbrickPyramidReadRegion(MRI_BRICK_PYRAMID *bp, int level,
+                               int x0, int y0, int z0, int width, int height, int depth);
+
+#endif
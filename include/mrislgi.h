@@ -0,0 +1,37 @@
+/**
+ * @brief local gyrification index (lGI) of a pial surface
+ *
+ * Implements the measure of Schaer et al., "A Surface-based Approach to
+ * Quantify Local Cortical Gyrification", IEEE TMI 2007. Around every
+ * stepsize-th vertex of the outer (hull) surface a region of radius mm is
+ * cut out of the hull, its perimeter is carried over to the pial surface
+ * and closed into a path, and the pial region inside that path is filled.
+ * The lGI of the hull vertex is the ratio of the pial area to the hull
+ * area. Every pial vertex then gets the average lGI of all the regions it
+ * belongs to, weighted by its distance to the axis of each region.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#ifndef MRISLGI_H
+#define MRISLGI_H
+
+#include "mrisurf.h"
+
+#define LGI_DEFAULT_RADIUS     25.0  // mm, radius of the hull regions
+#define LGI_DEFAULT_STEPSIZE   100   // one hull region every stepsize vertices
+
+int MRIScomputeLGI(MRI_SURFACE *pial, MRI_SURFACE *outer, double radius, int stepsize,
+                   float *pial_lgi, float *outer_lgi);
+
+#endif
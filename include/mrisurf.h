@@ -903,6 +903,11 @@ int          MRIScomputeSurfaceNormals(MRI_SURFACE *mris,
                                        int which,
                                        int navgs) ;
 int          MRIScomputeMetricProperties(MRI_SURFACE *mris) ;
+typedef struct MRIS_INCREMENTAL_METRIC MRIS_INCREMENTAL_METRIC ;
+MRIS_INCREMENTAL_METRIC *MRISallocIncrementalMetric(MRI_SURFACE *mris) ;
+void         MRISfreeIncrementalMetric(MRIS_INCREMENTAL_METRIC **pim) ;
+int          MRIScomputeMetricPropertiesIncremental(MRI_SURFACE *mris, MRIS_INCREMENTAL_METRIC *im,
+                                                    const int *vnos, int nvnos) ;
 double       MRISrescaleMetricProperties(MRIS *surf);
 int          MRISrestoreOldPositions(MRI_SURFACE *mris) ;
 int          MRISstoreCurrentPositions(MRI_SURFACE *mris) ;
@@ -1084,6 +1089,7 @@ MRI   *MRISwriteSurfaceIntoVolume(MRI_SURFACE *mris, MRI *mri_template,
                                   MRI *mri) ;
 int   MRISmeasureCorticalThickness(MRI_SURFACE *mris, int nbhd_size,
                                    float max_thickness) ;
+int   MRISmeasureCorticalThicknessClosestPoint(MRI_SURFACE *mris, float max_thickness) ;
 
 int  MRISmeasureThicknessFromCorrespondence(MRI_SURFACE *mris, MHT *mht, float max_thick) ;
 int MRISfindClosestOrigVertices(MRI_SURFACE *mris, int nbhd_size) ;
@@ -1451,6 +1457,10 @@ MRI *MRISmakeBoundingVolume(MRIS *mris, double resolution);
 MRI *MRISfillInterior(MRI_SURFACE *mris,
                       double resolution,
                       MRI *mri_interior) ;
+MRI *MRISfillInteriorParity(MRI_SURFACE *mris,
+                            double resolution,
+                            MRI *mri_interior) ;
+int MRISfillInteriors(MRI_SURFACE **surfs, int nsurfs, MRI *mri_bits) ;
 int MRISfillInteriorRibbonTest(char *subject, int UseNew, FILE *fp);
 MRI   *MRISshell(MRI *mri_src,
                  MRI_SURFACE *mris,
@@ -1580,6 +1590,18 @@ int  MRIScopyMRI(MRIS *Surf, MRI *Src, int Frame, const char *Field);
 MRI *MRIcopyMRIS(MRI *mri, MRIS *surf, int Frame, const char *Field);
 
 MRI *MRISsmoothMRI(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask, MRI *Targ);
+
+// one step of nearest-neighbor averaging as a sparse matrix; each row is
+// the average of the listed vertices, empty rows are set to 0
+typedef struct
+{
+  int nvertices;
+  int *rowptr;   // nvertices+1
+  int *col;
+} MRIS_SMOOTH_OP;
+MRIS_SMOOTH_OP *MRISsmoothOpBuild(MRIS *Surf, MRI *IncMask);
+MRI *MRISsmoothOpApply(MRIS_SMOOTH_OP *op, MRI *Src, int nSmoothSteps, MRI *Targ);
+int MRISsmoothOpFree(MRIS_SMOOTH_OP **pop);
 MRI *MRISsmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask,  MRI *Targ);
 MRI *MRISsmoothMRIFastD(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask,  MRI *Targ);
 int MRISsmoothMRIFastCheck(int nSmoothSteps);
@@ -20,6 +20,10 @@
     ELT(const,  int,         nfaces         ) SEP \
     ELT(const,  char,        nsize          ) SEP \
     ELT(const,  double,      radius         ) SEP \
+    /* following needed for SSE */              \
+    ELT(const,  float,       orig_area      ) SEP \
+    ELT(const,  int,         patch          ) SEP \
+    ELT(const,  int,         noscale        ) SEP \
     ELT(const,  VERTEX_TOPOLOGY const *, vertices_topology) \
     ELTX(const, FACE_TOPOLOGY   const *, faces_topology)
 
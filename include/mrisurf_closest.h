@@ -0,0 +1,62 @@
+/**
+ * @brief exact closest-point queries against a surface
+ *
+ * The thickness and surface comparison tools need, for every vertex of one
+ * surface, the closest point of another (the pial surface for a white
+ * vertex, the other time point for a longitudinal comparison). A face grid
+ * bins the faces of a surface into a uniform grid of cells. A query visits
+ * the cells in rings around the probe, nearest first, and measures the
+ * exact distance to the triangles in them, so the result is the closest
+ * point of the whole surface rather than of the faces of a nearby vertex.
+ * The grid keeps its own copy of the coordinates and is never written to
+ * by a query, so it can be shared by all the threads of a parallel loop.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#ifndef MRISURF_CLOSEST_H
+#define MRISURF_CLOSEST_H
+
+#include "mrisurf.h"
+
+typedef struct MRIS_FACE_GRID MRIS_FACE_GRID;
+
+// Bins the faces of the which (CURRENT_VERTICES, ORIGINAL_VERTICES,
+// WHITE_VERTICES, PIAL_VERTICES, ...) surface of mris into cells of
+// cell_size mm, or of twice the average edge length if cell_size <= 0.
+// Ripped faces and faces with a ripped vertex are left out.
+MRIS_FACE_GRID *MRISfaceGridAlloc(MRI_SURFACE *mris, int which, double cell_size);
+void MRISfaceGridFree(MRIS_FACE_GRID **pgrid);
+
+// Returns the face whose closest point to (x, y, z) is nearest, or -1 if no
+// face is within max_dist. The distance goes to *pdist and, if bary is not
+// NULL, the barycentric coordinates of the closest point with respect to
+// face->v[0..2] to bary[0..2].
+int MRISfaceGridClosestPoint(MRIS_FACE_GRID const *grid,
+                             double x, double y, double z,
+                             double max_dist,
+                             double *pdist,
+                             double bary[3]);
+
+// For every unripped vertex of the which_src surface of mris_src, the
+// distance to the closest point of the which_dst surface of mris_dst, at
+// most max_dist. The distances go to dists[vno] and the faces to fnos[vno]
+// (-1 if none was within max_dist) if fnos is not NULL. Returns the number
+// of vertices with no face within max_dist.
+int MRISmeasureDistancesToSurface(MRI_SURFACE *mris_src, int which_src,
+                                  MRI_SURFACE *mris_dst, int which_dst,
+                                  double max_dist,
+                                  float *dists,
+                                  int *fnos);
+
+#endif
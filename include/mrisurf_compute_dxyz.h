@@ -70,3 +70,6 @@ void vertexComputeNormalSpringTerm(MRIS* mris, int vno, float* dx, float* dy, fl
 // tangential spring
 void mrisComputeTangentialSpringTerm(MRIS *mris, double l_spring);
 void vertexComputeTangentialSpringTerm(MRIS* mris, int vno, float* dx, float* dy, float* dz, double l_spring = 1.0);
+
+// spring, Laplacian, normalized, normal and tangential spring terms in one pass
+int mrisComputeSpringTerms(MRIS *mris, double l_spring, double l_spring_norm, double l_nspring, double l_tspring, double l_lap);
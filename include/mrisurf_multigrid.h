@@ -0,0 +1,57 @@
+/**
+ * @brief coarse-to-fine (multigrid) inflation and spherical mapping
+ *
+ * The inflation and spherical unfolding integrate for hundreds to thousands
+ * of steps on the full mesh, most of them with heavy gradient averaging to
+ * move the low spatial frequencies. In multigrid mode the surface is first
+ * decimated into a hierarchy of coarser meshes by edge collapses. Each
+ * coarse mesh keeps a subset of the vertices of the next finer one, so the
+ * result on a coarse level can be carried back (prolongated) by harmonic
+ * interpolation over the vertices that were collapsed away. The coarsest
+ * level runs the full schedule, every finer level only the steps with less
+ * gradient averaging.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#ifndef MRISURF_MULTIGRID_H
+#define MRISURF_MULTIGRID_H
+
+#include "mrisurf.h"
+
+#define MULTIGRID_MIN_VERTICES  2000  // no level is decimated below this
+
+// Decimates mris down to about target_nvertices by collapsing the shortest
+// edges of the which (CURRENT_VERTICES or ORIGINAL_VERTICES) surface into
+// one of their vertices. The coarse surface has the current and original
+// positions of the vertices it keeps. If given, coarse_to_fine[cno] is the
+// vertex of mris that coarse vertex cno came from (coarse nvertices entries)
+// and fine_to_coarse[vno] the coarse vertex that vertex vno was collapsed
+// into (mris nvertices entries).
+MRI_SURFACE *MRISdecimateByEdgeCollapse(MRI_SURFACE *mris, int target_nvertices, int which,
+                                        int *coarse_to_fine, int *fine_to_coarse);
+
+// MRISinflateBrain on a hierarchy of nlevels coarser meshes first. The
+// accumulated sulc (curv) is carried to the finer levels with the positions.
+int MRISinflateBrainMultigrid(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int nlevels);
+
+// MRISunfold on a hierarchy of nlevels coarser meshes first, decimated on
+// the original surface. mris must already be projected onto the sphere.
+MRI_SURFACE *MRISunfoldMultigrid(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int max_passes, int nlevels);
+
+// prints the distance error (if the distances are current), the mean areal
+// distortion |log(area/origarea)|, the number of negative faces and, unless
+// mris is a sphere, the rms height over the tangent planes
+int MRISprintDistortion(MRI_SURFACE *mris, FILE *fp, const char *label);
+
+#endif
@@ -50,6 +50,12 @@ double MRIScomputeSSE        (MRIS*    mris, INTEGRATION_PARMS *parms);
 double MRIScomputeSSEExternal(MRIS*    mris, INTEGRATION_PARMS *parms, double *ext_sse);
 double MRIScomputeSSE        (MRIS_MP* mris, INTEGRATION_PARMS *parms);
 
+// The spring, Laplacian and tangential spring energies for the weights enabled in parms, from one pass over the neighbourhoods.
+// Setting FREESURFER_checkFusedTerms makes MRIScomputeSSE and mrisComputeSpringTerms compare their fused passes with the single terms.
+//
+void   mrisComputeSpringEnergies(MRIS* mris, INTEGRATION_PARMS *parms, double *sse_spring, double *sse_lap, double *sse_tspring);
+bool   mrisCheckFusedTerms();
+
 
 
 // MEF support
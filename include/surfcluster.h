@@ -79,6 +79,9 @@ int sclustReMap(MRI_SURFACE *Surf, int nClusters, SCS *scs_sorted);
 double sclustMaxClusterArea(SURFCLUSTERSUM *scs, int nClusters);
 int sclustMaxClusterCount(SURFCLUSTERSUM *scs, int nClusters);
 float sclustMaxClusterWeightVtx(SURFCLUSTERSUM *scs, int nClusters, int thsign);
+int sclustMaxClusterStats(const MRI_SURFACE *Surf, const float *val,
+                          float thmin, float thmax, int thsign, int *nClusters,
+                          double *maxarea, int *maxcount, float *maxweightvtx);
 SCS *sclustPruneByCWPval(SCS *ClusterList, int nclusters, 
 			 double cwpvalthresh,int *nPruned, 
 			 MRIS *surf);
@@ -0,0 +1,73 @@
+/**
+ * @brief sparse vertex-by-voxel sampling matrices for volume-to-surface mapping
+ *
+ * Sampling a volume onto a surface (projection along the normal, nearest or
+ * trilinear interpolation, averaging over several projection depths) only
+ * depends on the geometry of the surface, the registration and the voxel
+ * grid, not on the data. MRIvol2surfMatBuild() does that geometry once and
+ * stores the result as a sparse matrix (one row per vertex, one column per
+ * voxel) that is then applied to all frames with MRIvol2surfMatApply().
+ * The matrix can be saved and reloaded so that runs that share the same
+ * surface and registration do not have to redo the geometry.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#ifndef VOL2SURFMAT_H
+#define VOL2SURFMAT_H
+
+#include "mri.h"
+#include "mrisurf.h"
+
+#define VOL2SURF_MAT_MAGIC    0x56325330   // "V2S0"
+#define VOL2SURF_MAT_VERSION  1
+
+// how the geometry is sampled. Mirrors the options of vol2surf_linear()
+// and MRIvol2surfVSM() so that the matrix reproduces either one.
+typedef struct
+{
+  int InterpMethod;   // SAMPLE_NEAREST or SAMPLE_TRILINEAR
+  int float2int;      // FLT2INT_ROUND, FLT2INT_FLOOR or FLT2INT_TKREG
+  int ProjDist;       // 1 = ProjFrac is in mm, 0 = fraction of thickness (in v->curv)
+  int SkipRipped;     // leave ripped vertices empty
+  int nproj;          // number of projection depths that are averaged
+  float *ProjFrac;    // nproj depths
+} VOL2SURF_SAMPLING;
+
+typedef struct
+{
+  int nvertices;       // rows
+  int width, height, depth;  // voxel grid of the source (columns)
+  int nproj;
+  long long nnz;
+  long long *rowptr;   // nvertices+1, CSR row pointers
+  int *col;            // voxel index c + r*width + s*width*height
+  float *weight;
+  int *hitvox;         // nvertices*nproj voxel hit by each sample, -1 if none
+  unsigned long long key;   // hash of everything the matrix was built from
+} MRI_VOL2SURF_MAT;
+
+unsigned long long MRIvol2surfMatKey(const MRI *SrcVol, const MATRIX *ras2vox, const MRI_SURFACE *surf,
+                                     const MRI *vsm, const VOL2SURF_SAMPLING *vs);
+MRI_VOL2SURF_MAT *MRIvol2surfMatBuild(const MRI *SrcVol, const MATRIX *ras2vox, const MRI_SURFACE *surf,
+                                      const MRI *vsm, const VOL2SURF_SAMPLING *vs);
+MRI_VOL2SURF_MAT *MRIvol2surfMatLoadOrBuild(const char *cachefile, const MRI *SrcVol, const MATRIX *ras2vox,
+                                            const MRI_SURFACE *surf, const MRI *vsm,
+                                            const VOL2SURF_SAMPLING *vs);
+MRI *MRIvol2surfMatApply(const MRI_VOL2SURF_MAT *m, const MRI *SrcVol, MRI *TrgVol);
+int MRIvol2surfMatHits(const MRI_VOL2SURF_MAT *m, MRI *SrcHitVol, int proj);
+int MRIvol2surfMatWrite(const MRI_VOL2SURF_MAT *m, const char *fname);
+MRI_VOL2SURF_MAT *MRIvol2surfMatRead(const char *fname);
+int MRIvol2surfMatFree(MRI_VOL2SURF_MAT **pm);
+
+#endif
@@ -105,6 +105,19 @@ VOLCLUSTER **clustGetClusters(MRI *vol, int frame,
                               MRI *binmask, int *nClusters,
                               MATRIX *XFM);
 int clustMaxClusterCount(VOLCLUSTER **VolClustList, int nClusters);
+
+MRI *clustLabelVolume(MRI *vol, int frame,
+                      float thmin, float thmax, int thsign,
+                      MRI *binmask, int maskframe, int AllowDiag,
+                      int *nClusters, int **nmembers);
+int clustMaxClusterCountVolume(MRI *vol, int frame,
+                               float thmin, float thmax, int thsign,
+                               MRI *binmask, int maskframe, int AllowDiag,
+                               int *nClusters);
+VOLCLUSTER **clustLabelClusters(MRI *vol, int frame,
+                                float thmin, float thmax, int thsign,
+                                MRI *binmask, int maskframe, int AllowDiag,
+                                MATRIX *XFM, int *nClusters);
 int clustDumpSummary(FILE *fp,VOLCLUSTER **VolClustList, int nClusters);
 
 /*----------------------------------------------------------*/
@@ -0,0 +1,268 @@
+/**
+ * @brief Converts a volume into a bricked, multi-resolution pyramid.
+ *
+ * The pyramid can be opened by freeview without reading the whole
+ * volume into memory: a coarse level is shown right away and
+ * full-resolution bricks are streamed for the slices being viewed.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+/*
+  BEGINHELP
+
+  Converts any volume that MRIread() can load into a brick pyramid
+  (see utils/mribrick.cpp). Level 0 holds the full-resolution volume,
+  each further level halves the resolution. Every level is cut into
+  cubic bricks so that viewers can read just the part of the volume
+  they display.
+
+  Use --nearest for segmentations so that the coarse levels contain
+  valid labels instead of averaged values.
+
+  EXAMPLES:
+
+  mri_brick_pyramid --i exvivo.mgz --o exvivo.fsbrick
+  mri_brick_pyramid --i aseg.mgz --o aseg.fsbrick --nearest
+
+  # then view with
+  freeview -v exvivo.fsbrick:stream_budget=2048
+
+  ENDHELP
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "cmdargs.h"
+#include "diag.h"
+#include "error.h"
+#include "macros.h"
+#include "mri.h"
+#include "mribrick.h"
+#include "timer.h"
+#include "utils.h"
+#include "version.h"
+
+static int  parse_commandline(int argc, char **argv);
+static void check_options(void);
+static void print_usage(void) ;
+static void usage_exit(void);
+static void print_help(void) ;
+static void print_version(void) ;
+static void dump_options(FILE *fp);
+int main(int argc, char *argv[]) ;
+
+const char *Progname = NULL;
+char *cmdline, cwd[2000];
+int debug=0;
+int checkoptsonly=0;
+struct utsname uts;
+
+char *InFile=NULL;
+char *OutFile=NULL;
+int BrickSize=BRICK_PYRAMID_DEFAULT_SIZE;
+int NLevels=0;
+int Nearest=0;
+
+/*---------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  int nargs;
+  MRI *mri;
+  Timer timer;
+
+  nargs = handleVersionOption(argc, argv, "mri_brick_pyramid");
+  if (nargs && argc - nargs == 1) exit (0);
+  argc -= nargs;
+  cmdline = argv2cmdline(argc,argv);
+  uname(&uts);
+  getcwd(cwd,2000);
+
+  Progname = argv[0] ;
+  argc --;
+  argv++;
+  ErrorInit(NULL, NULL, NULL) ;
+  DiagInit(NULL, NULL, NULL) ;
+  if (argc == 0) usage_exit();
+  parse_commandline(argc, argv);
+  check_options();
+  if (checkoptsonly) return(0);
+  dump_options(stdout);
+
+  printf("Reading %s\n",InFile);
+  mri = MRIread(InFile);
+  if(mri == NULL) exit(1);
+  printf("  %dx%dx%d, %d frames, type %d\n",mri->width,mri->height,mri->depth,mri->nframes,mri->type);
+
+  if(mri->type == MRI_RGB || mri->type == MRI_BITMAP || mri->type == MRI_TENSOR){
+    printf("ERROR: volume type %d cannot be bricked\n",mri->type);
+    exit(1);
+  }
+
+  if(debug) Gdiag |= DIAG_SHOW;
+  printf("Writing %s (brick size %d)\n",OutFile,BrickSize);
+  if(MRIwriteBrickPyramid(mri, OutFile, BrickSize, NLevels, Nearest) != NO_ERROR) exit(1);
+
+  MRIfree(&mri);
+  printf("mri_brick_pyramid done in %g sec\n",timer.seconds());
+  exit(0);
+  return(0);
+}
+/*-------------------------------------------------------*/
+static int parse_commandline(int argc, char **argv) {
+  int  nargc , nargsused;
+  char **pargv, *option ;
+
+  if (argc < 1) usage_exit();
+
+  nargc   = argc;
+  pargv = argv;
+  while (nargc > 0) {
+
+    option = pargv[0];
+    if (debug) printf("%d %s\n",nargc,option);
+    nargc -= 1;
+    pargv += 1;
+
+    nargsused = 0;
+
+    if (!strcasecmp(option, "--help"))  print_help() ;
+    else if (!strcasecmp(option, "--version")) print_version() ;
+    else if (!strcasecmp(option, "--debug"))   debug = 1;
+    else if (!strcasecmp(option, "--checkopts"))   checkoptsonly = 1;
+    else if (!strcasecmp(option, "--nocheckopts")) checkoptsonly = 0;
+    else if (!strcasecmp(option, "--nearest"))  Nearest = 1;
+
+    else if (!strcasecmp(option, "--i")) {
+      if (nargc < 1) CMDargNErr(option,1);
+      InFile = pargv[0];
+      nargsused = 1;
+    }
+    else if (!strcasecmp(option, "--o")) {
+      if (nargc < 1) CMDargNErr(option,1);
+      OutFile = pargv[0];
+      nargsused = 1;
+    }
+    else if (!strcasecmp(option, "--brick-size")) {
+      if (nargc < 1) CMDargNErr(option,1);
+      sscanf(pargv[0],"%d",&BrickSize);
+      nargsused = 1;
+    }
+    else if (!strcasecmp(option, "--levels")) {
+      if (nargc < 1) CMDargNErr(option,1);
+      sscanf(pargv[0],"%d",&NLevels);
+      nargsused = 1;
+    }
+    else {
+      fprintf(stderr,"ERROR: Option %s unknown\n",option);
+      if (CMDsingleDash(option))
+        fprintf(stderr,"       Did you really mean -%s ?\n",option);
+      exit(-1);
+    }
+    nargc -= nargsused;
+    pargv += nargsused;
+  }
+  return(0);
+}
+/*-------------------------------------------------------*/
+static void usage_exit(void) {
+  print_usage() ;
+  exit(1) ;
+}
+/*-------------------------------------------------------*/
+static void print_usage(void) {
+  printf("USAGE: %s \n",Progname) ;
+  printf("\n");
+  printf("   --i invol   : input volume (any format MRIread supports)\n");
+  printf("   --o pyramid : output brick pyramid\n");
+  printf("   --brick-size N : brick edge length in voxels (default %d)\n",BRICK_PYRAMID_DEFAULT_SIZE);
+  printf("   --levels N  : number of levels (default: until one brick holds the volume)\n");
+  printf("   --nearest   : subsample instead of averaging (for segmentations)\n");
+  printf("\n");
+  printf("   --debug     turn on debugging\n");
+  printf("   --checkopts don't run anything, just check options and exit\n");
+  printf("   --help      print out information on how to use this program\n");
+  printf("   --version   print out version and exit\n");
+  printf("\n");
+  std::cout << getVersion() << std::endl;
+  printf("\n");
+}
+/*-------------------------------------------------------*/
+static void print_help(void) {
+  print_usage() ;
+printf("\n");
+printf("  Converts any volume that MRIread() can load into a brick pyramid\n");
+printf("  (see utils/mribrick.cpp). Level 0 holds the full-resolution volume,\n");
+printf("  each further level halves the resolution. Every level is cut into\n");
+printf("  cubic bricks so that viewers can read just the part of the volume\n");
+printf("  they display.\n");
+printf("\n");
+printf("  Use --nearest for segmentations so that the coarse levels contain\n");
+printf("  valid labels instead of averaged values.\n");
+printf("\n");
+printf("  EXAMPLES:\n");
+printf("\n");
+printf("  mri_brick_pyramid --i exvivo.mgz --o exvivo.fsbrick\n");
+printf("  mri_brick_pyramid --i aseg.mgz --o aseg.fsbrick --nearest\n");
+printf("\n");
+printf("  # then view with\n");
+printf("  freeview -v exvivo.fsbrick:stream_budget=2048\n");
+printf("\n");
+  exit(1) ;
+}
+/*-------------------------------------------------------*/
+static void print_version(void) {
+  std::cout << getVersion() << std::endl;
+  exit(1) ;
+}
+/*-------------------------------------------------------*/
+static void check_options(void) {
+  if(InFile == NULL){
+    printf("ERROR: need an input volume\n");
+    exit(1);
+  }
+  if(OutFile == NULL){
+    printf("ERROR: need an output file\n");
+    exit(1);
+  }
+  if(BrickSize < 8){
+    printf("ERROR: brick size must be at least 8\n");
+    exit(1);
+  }
+  if(NLevels > BRICK_PYRAMID_MAX_LEVELS){
+    printf("ERROR: at most %d levels are supported\n",BRICK_PYRAMID_MAX_LEVELS);
+    exit(1);
+  }
+  return;
+}
+/*-------------------------------------------------------*/
+static void dump_options(FILE *fp) {
+  fprintf(fp,"\n");
+  fprintf(fp,"%s\n", getVersion().c_str());
+  fprintf(fp,"cwd %s\n",cwd);
+  fprintf(fp,"cmdline %s\n",cmdline);
+  fprintf(fp,"sysname  %s\n",uts.sysname);
+  fprintf(fp,"hostname %s\n",uts.nodename);
+  fprintf(fp,"machine  %s\n",uts.machine);
+  fprintf(fp,"user     %s\n",VERuser());
+  fprintf(fp,"Input    %s\n",InFile);
+  fprintf(fp,"Output   %s\n",OutFile);
+  fprintf(fp,"BrickSize %d\n",BrickSize);
+  fprintf(fp,"NLevels  %d\n",NLevels);
+  fprintf(fp,"Nearest  %d\n",Nearest);
+  return;
+}
@@ -18,7 +18,11 @@
  *
  */
 
+#include <algorithm>
+#include <float.h>
+#include <functional>
 #include <iostream>
+#include <vector>
 
 #include "macros.h"
 #include "diag.h"
@@ -209,3 +213,277 @@ int compute_tissue_modes( MRI *mri_inputs,
 
   return(NO_ERROR) ;
 }
+
+
+// ===========================================
+// Scoring many candidate linear transforms. The grid search in
+// find_optimal_linear_xform() evaluates hundreds of thousands of
+// transforms against the same samples; doing it one call to
+// GCAcomputeLogSampleProbability() at a time only parallelizes over the
+// samples. Here the samples are packed into arrays once and candidates
+// are scored in parallel, one candidate per thread, with the same
+// floating point operations as GCAcomputeLogSampleProbability() so the
+// scores (and thus the selected transform) are the same.
+
+EMREG_SAMPLES *emregSamplesAlloc(GCA *gca, GCA_SAMPLE *gcas, MRI *mri,
+                                 int nsamples, double clamp)
+{
+  EMREG_SAMPLES *es ;
+  int           i, x, y, z ;
+  double        ub ;
+
+  // only the plain single-input cost is reproduced
+  if (gca->ninputs != 1 || exvivo || robust || use_variance || nsamples <= 0)
+  {
+    return(NULL) ;
+  }
+
+  es = (EMREG_SAMPLES *)calloc(1, sizeof(EMREG_SAMPLES)) ;
+  es->nsamples = nsamples ;
+  es->clamp = clamp ;
+  es->xp = (float *)calloc(nsamples, sizeof(float)) ;
+  es->yp = (float *)calloc(nsamples, sizeof(float)) ;
+  es->zp = (float *)calloc(nsamples, sizeof(float)) ;
+  es->means = (float *)calloc(nsamples, sizeof(float)) ;
+  es->covars = (float *)calloc(nsamples, sizeof(float)) ;
+  es->log_norm = (double *)calloc(nsamples, sizeof(double)) ;
+  es->prior_log = (double *)calloc(nsamples, sizeof(double)) ;
+  es->ub_suffix = (double *)calloc(nsamples+1, sizeof(double)) ;
+  for (i = 0 ; i < nsamples ; i++)
+  {
+    es->xp[i] = gcas[i].xp ;
+    es->yp[i] = gcas[i].yp ;
+    es->zp[i] = gcas[i].zp ;
+    es->means[i] = gcas[i].means[0] ;
+    es->covars[i] = gcas[i].covars[0] ;
+    es->log_norm[i] = -log(sqrt((double)gcas[i].covars[0])) ;
+    es->prior_log[i] = gcas_getPriorLog(gcas[i]) ;
+  }
+  // log_p of a sample is at most its value for a perfect intensity
+  // match (or -clamp)
+  es->ub_suffix[nsamples] = 0 ;
+  for (i = nsamples-1 ; i >= 0 ; i--)
+  {
+    ub = es->log_norm[i] + es->prior_log[i] ;
+    if (ub < -clamp)
+    {
+      ub = -clamp ;
+    }
+    es->ub_suffix[i] = es->ub_suffix[i+1] + ub ;
+  }
+
+  es->width = mri->width ;
+  es->height = mri->height ;
+  es->depth = mri->depth ;
+  es->image = (float *)calloc((size_t)mri->width*mri->height*mri->depth,
+                              sizeof(float)) ;
+  for (z = 0 ; z < mri->depth ; z++)
+    for (y = 0 ; y < mri->height ; y++)
+      for (x = 0 ; x < mri->width ; x++)
+        es->image[x + (size_t)mri->width*(y + (size_t)mri->height*z)] =
+          MRIgetVoxVal(mri, x, y, z, 0) ;
+
+  es->gca = gca ;
+  es->mri = mri ;
+  es->transform = TransformAlloc(LINEAR_VOX_TO_VOX, NULL) ;
+  return(es) ;
+}
+
+int emregSamplesFree(EMREG_SAMPLES **pes)
+{
+  EMREG_SAMPLES *es = *pes ;
+
+  if (es == NULL)
+  {
+    return(NO_ERROR) ;
+  }
+  free(es->xp) ;
+  free(es->yp) ;
+  free(es->zp) ;
+  free(es->means) ;
+  free(es->covars) ;
+  free(es->log_norm) ;
+  free(es->prior_log) ;
+  free(es->ub_suffix) ;
+  free(es->image) ;
+  TransformFree(&es->transform) ;
+  free(es) ;
+  *pes = NULL ;
+  return(NO_ERROR) ;
+}
+
+/*
+  Computes the prior-to-source voxel matrix of the vox-to-vox transform
+  m_L exactly as GCAcomputeLogSampleProbability() does (invert, then
+  GCAgetPriorToSourceVoxelMatrix()). Not thread safe.
+*/
+int emregCandidateSetTransform(EMREG_SAMPLES *es, MATRIX *m_L,
+                               EMREG_CANDIDATE *cand)
+{
+  MATRIX *m_L_save, *m ;
+  LTA    *lta = (LTA *)es->transform->xform ;
+  int    r, c ;
+
+  m_L_save = lta->xforms[0].m_L ;
+  lta->xforms[0].m_L = m_L ;
+  TransformInvert(es->transform, es->mri) ;
+  m = GCAgetPriorToSourceVoxelMatrix(es->gca, es->mri, es->transform) ;
+  lta->xforms[0].m_L = m_L_save ;
+  for (r = 0 ; r < 3 ; r++)
+    for (c = 0 ; c < 4 ; c++)
+    {
+      cand->m_p2s[4*r+c] = *MATRIX_RELT(m, r+1, c+1) ;
+    }
+  MatrixFree(&m) ;
+  return(NO_ERROR) ;
+}
+
+/*
+  Mean clamped log probability of the samples under the transform m_p2s
+  (see emregCandidateSetTransform()). With stride > 1 only every
+  stride-th sample is used. If the running sum can no longer reach
+  abandon_below (a total, not a mean), the evaluation stops early,
+  *pabandoned is set and -DBL_MAX is returned.
+*/
+double emregSamplesLogP(const EMREG_SAMPLES *es, const float *m_p2s,
+                        int stride, double abandon_below, int *pabandoned)
+{
+  double total_log_p = 0.0, log_p ;
+  int    i, n, x, y, z ;
+  float  vx, vy, vz, v, d ;
+
+  if (pabandoned)
+  {
+    *pabandoned = 0 ;
+  }
+  for (n = i = 0 ; i < es->nsamples ; i += stride, n++)
+  {
+    // same order of operations as MatrixMultiply(m, v_src)
+    vx = 0 ;
+    vx += m_p2s[0] * es->xp[i] ;
+    vx += m_p2s[1] * es->yp[i] ;
+    vx += m_p2s[2] * es->zp[i] ;
+    vx += m_p2s[3] ;
+    vy = 0 ;
+    vy += m_p2s[4] * es->xp[i] ;
+    vy += m_p2s[5] * es->yp[i] ;
+    vy += m_p2s[6] * es->zp[i] ;
+    vy += m_p2s[7] ;
+    vz = 0 ;
+    vz += m_p2s[8] * es->xp[i] ;
+    vz += m_p2s[9] * es->yp[i] ;
+    vz += m_p2s[10] * es->zp[i] ;
+    vz += m_p2s[11] ;
+    x = nint(vx) ;
+    y = nint(vy) ;
+    z = nint(vz) ;
+    if (x >= 0 && x < es->width && y >= 0 && y < es->height &&
+        z >= 0 && z < es->depth)
+    {
+      v = es->image[x + (size_t)es->width*(y + (size_t)es->height*z)] -
+          es->means[i] ;
+      d = v * v / es->covars[i] ;
+      log_p = es->log_norm[i] - .5 * d ;
+      log_p += es->prior_log[i] ;
+      if (log_p < -es->clamp)
+      {
+        log_p = -es->clamp ;
+      }
+    }
+    else
+    {
+      log_p = -1000000 ;  // same as GCAcomputeLogSampleProbability()
+    }
+    total_log_p += log_p ;
+
+    if (stride == 1 && (i & 127) == 127 &&
+        total_log_p + es->ub_suffix[i+1] < abandon_below)
+    {
+      if (pabandoned)
+      {
+        *pabandoned = 1 ;
+      }
+      return(-DBL_MAX) ;
+    }
+  }
+  return((float)total_log_p / n) ;
+}
+
+/*
+  Scores ncands candidates in parallel and returns the index of the
+  first one (in array order) with the highest score above max_log_p, or
+  -1 if none beats it - the same candidate a serial loop with
+  "if (log_p > max_log_p)" would pick. Candidates are scored in blocks;
+  within a block a candidate is abandoned as soon as it provably cannot
+  beat the best score of the previous blocks, which does not change the
+  result. If decimate > 1, all candidates are first scored on every
+  decimate-th sample and only the best 10% are scored on all samples
+  (this is an approximation). Scores are left in cands[].log_p.
+*/
+#define EMREG_BLOCK_SIZE 2048
+int emregFindBestCandidate(EMREG_SAMPLES *es, EMREG_CANDIDATE *cands,
+                           int ncands, double max_log_p, int decimate)
+{
+  int    best = -1, i0, i1, i, nabandoned = 0 ;
+  double abandon_below, margin ;
+
+  std::vector<char> skip(ncands, 0) ;
+  if (decimate > 1 && ncands > 1)
+  {
+    std::vector<double> coarse(ncands), sorted ;
+    int    nkeep = MAX(1, ncands/10) ;
+
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (i = 0 ; i < ncands ; i++)
+    {
+      coarse[i] = emregSamplesLogP(es, cands[i].m_p2s, decimate, -DBL_MAX, NULL) ;
+    }
+    sorted = coarse ;
+    std::nth_element(sorted.begin(), sorted.begin()+(nkeep-1), sorted.end(),
+                     std::greater<double>()) ;
+    for (i = 0 ; i < ncands ; i++)
+    {
+      skip[i] = (coarse[i] < sorted[nkeep-1]) ;
+    }
+  }
+
+  for (i0 = 0 ; i0 < ncands ; i0 += EMREG_BLOCK_SIZE)
+  {
+    i1 = MIN(ncands, i0+EMREG_BLOCK_SIZE) ;
+    // leave room for the float rounding of the reported mean
+    margin = 1.0 + 1e-5 * fabs(max_log_p * es->nsamples) ;
+    abandon_below = max_log_p * es->nsamples - margin ;
+
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 8) reduction(+:nabandoned)
+#endif
+    for (i = i0 ; i < i1 ; i++)
+    {
+      int abandoned ;
+      if (skip[i])
+      {
+        cands[i].log_p = -DBL_MAX ;
+        continue ;
+      }
+      cands[i].log_p = emregSamplesLogP(es, cands[i].m_p2s, 1, abandon_below, &abandoned) ;
+      nabandoned += abandoned ;
+    }
+
+    for (i = i0 ; i < i1 ; i++)
+    {
+      if (cands[i].log_p > max_log_p)
+      {
+        max_log_p = cands[i].log_p ;
+        best = i ;
+      }
+    }
+  }
+  if (Gdiag & DIAG_SHOW)
+  {
+    printf("  scored %d candidate transforms (%d abandoned early)\n",
+           ncands, nabandoned) ;
+  }
+  return(best) ;
+}
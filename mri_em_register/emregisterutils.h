@@ -36,6 +36,42 @@ double local_GCAcomputeLogSampleProbability( GCA *gca,
                                              int nsamples,
                                              int exvivo, double clamp );
 
+// Samples packed as arrays (struct of arrays) for scoring many candidate
+// linear transforms against the same atlas samples. Reproduces
+// GCAcomputeLogSampleProbability() for single-input atlases.
+typedef struct
+{
+  int    nsamples ;
+  float  *xp, *yp, *zp ;     // prior coordinates
+  float  *means, *covars ;
+  double *log_norm ;         // -log(sqrt(covar))
+  double *prior_log ;
+  double *ub_suffix ;        // upper bound on the sum of log_p over samples i..nsamples-1
+  double clamp ;
+  int    width, height, depth ;
+  float  *image ;            // frame 0 of the input
+  GCA    *gca ;
+  MRI    *mri ;
+  TRANSFORM *transform ;
+} EMREG_SAMPLES ;
+
+typedef struct
+{
+  float  m_p2s[12] ;         // rows 1-3 of the prior-to-source voxel matrix
+  double params[9] ;         // whatever the caller needs to rebuild it
+  double log_p ;
+} EMREG_CANDIDATE ;
+
+EMREG_SAMPLES *emregSamplesAlloc(GCA *gca, GCA_SAMPLE *gcas, MRI *mri,
+                                 int nsamples, double clamp) ;
+int emregSamplesFree(EMREG_SAMPLES **pes) ;
+int emregCandidateSetTransform(EMREG_SAMPLES *es, MATRIX *m_L,
+                               EMREG_CANDIDATE *cand) ;
+double emregSamplesLogP(const EMREG_SAMPLES *es, const float *m_p2s,
+                        int stride, double abandon_below, int *pabandoned) ;
+int emregFindBestCandidate(EMREG_SAMPLES *es, EMREG_CANDIDATE *cands,
+                           int ncands, double max_log_p, int decimate) ;
+
 int compute_tissue_modes( MRI *mri_inputs,
                           GCA *gca,
                           GCA_SAMPLE *gcas,
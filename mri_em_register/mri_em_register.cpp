@@ -25,6 +25,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <vector>
 #ifdef HAVE_OPENMP
 #include "romp_support.h"
 #endif
@@ -96,6 +97,12 @@ static double find_optimal_linear_xform
  float angle_steps, float scale_steps, float trans_steps,
  int nreductions);
 
+// candidates collected before they are scored in parallel
+#define MAX_PENDING_CANDIDATES 65536
+static int search_decimate = 1 ;
+static int score_candidates(EMREG_SAMPLES *es, std::vector<EMREG_CANDIDATE> &cands,
+                            double *pmax_log_p, double *max_params) ;
+
 const char         *Progname ;
 static MORPH_PARMS  parms ;
 
@@ -1713,6 +1720,13 @@ get_option(int argc, char *argv[])
   {
     robust = 1 ;
   }
+  else if (!strcmp(option, "SEARCH_DECIMATE"))
+  {
+    search_decimate = atoi(argv[2]) ;
+    nargs = 1 ;
+    printf("prescreening linear search candidates with every %dth sample\n",
+           search_decimate) ;
+  }
   else if (!stricmp(option, "FLASH"))
   {
     map_to_flash = 1 ;
@@ -2263,10 +2277,20 @@ find_optimal_linear_xform
   m_scale = MatrixIdentity(4, NULL) ;
   max_log_p = local_GCAcomputeLogSampleProbability(gca, gcas, mri, m_L, nsamples, exvivo, Gclamp) ;
 
+  // for the plain log-likelihood cost the candidates are collected and
+  // scored in parallel instead of one at a time
+  Timer search_timer ;
+  EMREG_SAMPLES *es = emregSamplesAlloc(gca, gcas, mri, nsamples, Gclamp) ;
+  std::vector<EMREG_CANDIDATE> cands ;
+  double max_params[9] ;
+
   // Loop a set number of times to polish transform
 
   for (i = 0 ; i < nreductions ; i++)
   {
+    max_params[0] = max_params[1] = max_params[2] = 1.0 ;
+    max_params[3] = max_params[4] = max_params[5] = 0.0 ;
+    max_params[6] = max_params[7] = max_params[8] = 0.0 ;
     delta_trans = (max_trans-min_trans) / (trans_steps-1) ;
     delta_scale = (max_scale-min_scale) / (scale_steps-1) ;
     if (FZERO(delta_scale) || rigid)
@@ -2366,6 +2390,27 @@ find_optimal_linear_xform
                       m_L_tmp = MatrixMultiply
                                 (m_trans, m_tmp3, m_L_tmp) ;
 
+                      if (es)
+                      {
+                        // score later, in parallel with the others
+                        EMREG_CANDIDATE cand ;
+                        emregCandidateSetTransform(es, m_L_tmp, &cand) ;
+                        cand.params[0] = x_scale ;
+                        cand.params[1] = y_scale ;
+                        cand.params[2] = z_scale ;
+                        cand.params[3] = x_angle ;
+                        cand.params[4] = y_angle ;
+                        cand.params[5] = z_angle ;
+                        cand.params[6] = x_trans ;
+                        cand.params[7] = y_trans ;
+                        cand.params[8] = z_trans ;
+                        cands.push_back(cand) ;
+                        if (cands.size() >= MAX_PENDING_CANDIDATES)
+                        {
+                          score_candidates(es, cands, &max_log_p, max_params) ;
+                        }
+                        continue ;
+                      }
                       log_p = local_GCAcomputeLogSampleProbability(gca, gcas, mri, m_L_tmp, nsamples, exvivo, Gclamp);
                       if (log_p > max_log_p)
                       {
@@ -2403,6 +2448,20 @@ find_optimal_linear_xform
       }
     }
 
+    if (es)
+    {
+      score_candidates(es, cands, &max_log_p, max_params) ;
+      x_max_scale = max_params[0] ;
+      y_max_scale = max_params[1] ;
+      z_max_scale = max_params[2] ;
+      x_max_rot = max_params[3] ;
+      y_max_rot = max_params[4] ;
+      z_max_rot = max_params[5] ;
+      x_max_trans = max_params[6] ;
+      y_max_trans = max_params[7] ;
+      z_max_trans = max_params[8] ;
+    }
+
     if (Gdiag & DIAG_SHOW)
     {
       printf("  max log p = %2.3f @ R=(%2.3f,%2.3f,%2.3f),"
@@ -2477,10 +2536,43 @@ find_optimal_linear_xform
   MatrixFree(&m_tmp2) ;
   MatrixFree(&m_trans) ;
   MatrixFree(&m_tmp3) ;
+  if (es)
+  {
+    emregSamplesFree(&es) ;
+    printf("  parallel search took %2.2f sec\n", search_timer.seconds()) ;
+  }
 
   return(max_log_p) ;
 }
 
+/*
+  score the pending candidates of find_optimal_linear_xform() and keep
+  the parameters of the best one if it beats *pmax_log_p.
+*/
+static int
+score_candidates(EMREG_SAMPLES *es, std::vector<EMREG_CANDIDATE> &cands,
+                 double *pmax_log_p, double *max_params)
+{
+  int best, i ;
+
+  if (cands.empty())
+  {
+    return(-1) ;
+  }
+  best = emregFindBestCandidate(es, &cands[0], cands.size(), *pmax_log_p,
+                                search_decimate) ;
+  if (best >= 0)
+  {
+    *pmax_log_p = cands[best].log_p ;
+    for (i = 0 ; i < 9 ; i++)
+    {
+      max_params[i] = cands[best].params[i] ;
+    }
+  }
+  cands.clear() ;
+  return(best) ;
+}
+
 static int
 mark_gcas_classes(GCA_SAMPLE *gcas, int nsamples)
 {
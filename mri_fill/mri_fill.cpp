@@ -47,6 +47,7 @@
 #include "talairachex.h"
 #include "connectcomp.h"
 #include "mrisegment.h"
+#include "romp_support.h"
 
 
 /*-------------------------------------------------------------------
@@ -179,6 +180,15 @@ const char *Progname ;
 
 static int min_filled = 0 ;
 
+/* wall-clock time of each stage of mri_fill, reported at the end */
+#define MAX_STAGES 16
+static Timer stage_timer ;
+static int nstages = 0 ;
+static const char *stage_names[MAX_STAGES] ;
+static double stage_secs[MAX_STAGES] ;
+static void end_stage(const char *name) ;
+static void print_stage_times(void) ;
+
 static int neighbor_threshold = DEFAULT_NEIGHBOR_THRESHOLD ;
 
 static MRI *mri_fill, *mri_im ;
@@ -2028,6 +2038,7 @@ main(int argc, char *argv[])
   argc -= nargs;
 
   then.reset() ;
+  stage_timer.reset() ;
   DiagInit(NULL, NULL, NULL) ;
   ErrorInit(NULL, NULL, NULL) ;
 
@@ -2067,6 +2078,7 @@ main(int argc, char *argv[])
     MRIfree(&mri_im) ;
     mri_im = mri_tmp ;
   }
+  end_stage("reading input") ;
 
   if (find_rh_voxel)
   {
@@ -2086,8 +2098,11 @@ main(int argc, char *argv[])
     else   // assume it's lh
       MRIfillVolume
       (mri_rh_fill, mri_rh_im, lh_vol_x, lh_vol_y, lh_vol_z,lh_fill_val);
+    end_stage("filling") ;
 
     MRIwrite(mri_rh_fill, out_fname) ;
+    end_stage("writing output") ;
+    print_stage_times() ;
     exit(0) ;
   }
 
@@ -2796,6 +2811,7 @@ main(int argc, char *argv[])
   {
     fprintf(stderr, "done.\n") ;
   }
+  end_stage("cutting planes") ;
 
   voxsize = findMinSize(mri_im);
   seed_search_size = ceil(SEED_SEARCH_SIZE/voxsize); // in voxel space
@@ -3076,6 +3092,7 @@ main(int argc, char *argv[])
               "lh white matter seed point out of bounds (%d, %d, %d)\n",
               wm_lh_x, wm_lh_y, wm_lh_z) ;
   MRIfree(&mri_cc) ;
+  end_stage("seed points") ;
 
   if (segmentation_fname && (mri_seg != NULL))
   {
@@ -3094,6 +3111,7 @@ main(int argc, char *argv[])
     }
 
     mri_fill = fill_with_aseg(mri_im, mri_seg);
+    end_stage("filling with aseg") ;
   }
   else
   {
@@ -3121,6 +3139,7 @@ main(int argc, char *argv[])
     MRIfree(&mri_lh_im) ;
     MRIfree(&mri_rh_im) ;
     MRIfree(&mri_im) ;
+    end_stage("filling hemispheres") ;
 
     /* find and eliminate degenerate surface locations caused by diagonal
        connectivity in which a vertex is simultaneously on both sides of
@@ -3133,6 +3152,7 @@ main(int argc, char *argv[])
     fprintf
     (stderr,"filling degenerate right hemisphere surface locations...\n");
     MRIfillDegenerateLocations(mri_rh_fill, rh_fill_val) ;
+    end_stage("degenerate locations") ;
 
     /*  must redo filling to avoid holes
         caused by  filling of  degenerate  locations */
@@ -3146,6 +3166,7 @@ main(int argc, char *argv[])
     (mri_rh_fill, mri_rh_im, wm_rh_x, wm_rh_y, wm_rh_z,rh_fill_val);
     MRIfree(&mri_lh_im) ;
     MRIfree(&mri_rh_im) ;
+    end_stage("refilling hemispheres") ;
 
     fprintf(stderr, "combining hemispheres...\n") ;
     MRIvoxelToTalairachEx
@@ -3167,6 +3188,7 @@ main(int argc, char *argv[])
 
     MRIfree(&mri_lh_fill) ;
     MRIfree(&mri_rh_fill) ;
+    end_stage("combining hemispheres") ;
   }
 
   if (atlas_name)
@@ -3278,6 +3300,7 @@ main(int argc, char *argv[])
     MRIgrowLabel(mri_fill, mri_bg, 0, 1) ;
     MRIturnOnFG(mri_fill, mri_fg, mri_bg) ;
     MRIturnOffBG(mri_fill, mri_bg) ;
+    end_stage("filling ventricles") ;
   }
 
   if (topofix)
@@ -3377,10 +3400,13 @@ main(int argc, char *argv[])
     mri_fill->ct = ctab;
   }
 
+  end_stage("topology fix and edits") ;
   printf("mri_fill done, writing output to %s...\n", out_fname) ;
   MRIwrite(mri_fill, out_fname) ;
+  end_stage("writing output") ;
   msec = then.milliseconds() ;
   fprintf(stderr,"filling took %2.1f minutes\n", (float)msec/(60*1000.0f));
+  print_stage_times() ;
 
   if (lta && !lhonly && !rhonly)
   {
@@ -3415,14 +3441,51 @@ main(int argc, char *argv[])
   return(0) ;
 }
 
+/*----------------------------------------------------------------------
+  end_stage - record the time since the previous stage ended under
+  'name'. print_stage_times lists them.
+  ----------------------------------------------------------------------*/
+static void
+end_stage(const char *name)
+{
+  if (nstages < MAX_STAGES)
+  {
+    stage_names[nstages] = name ;
+    stage_secs[nstages] = stage_timer.seconds() ;
+    nstages++ ;
+  }
+  stage_timer.reset() ;
+}
+
+static void
+print_stage_times(void)
+{
+  int    i ;
+  double total = 0 ;
+
+  fprintf(stderr, "mri_fill stage times:\n") ;
+  for (i = 0 ; i < nstages ; i++)
+  {
+    fprintf(stderr, "  %-28s %8.2f sec\n", stage_names[i], stage_secs[i]) ;
+    total += stage_secs[i] ;
+  }
+  fprintf(stderr, "  %-28s %8.2f sec\n", "total", total) ;
+}
+
+/*----------------------------------------------------------------------
+  fill_brain_sweep - the original fill. Alternating forward and backward
+  raster sweeps turn on every eligible voxel that has an 'on' neighbor
+  in one of the three directions already visited by the sweep, until a
+  sweep fills nothing. Only used when the fill holds more than one
+  label, where the label a voxel gets depends on the sweep order.
+  ----------------------------------------------------------------------*/
 static int
-fill_brain(MRI *mri_fill, MRI *mri_im, int threshold)
+fill_brain_sweep(MRI *mri_fill, MRI *mri_im, int threshold)
 {
   int dir = -1, nfilled = 10000, ntotal = 0,iter = 0;
   int im0,im1,j0,j1,i0,i1,imnr,i,j;
   int v1,v2,v3,vmax ;
 
-  mriFindBoundingBox(mri_im) ;
   while (nfilled>min_filled && iter<MAX_ITERATIONS)
   {
     iter++;
@@ -3486,6 +3549,270 @@ fill_brain(MRI *mri_fill, MRI *mri_im, int threshold)
       fprintf(stderr, "%d voxels filled\n",nfilled);
     }
   }
+  return(ntotal) ;
+}
+
+/*
+  The sweeps above converge to the set of eligible voxels connected to
+  the initial fill, except that a voxel can only be entered from its
+  -x/-y/-z neighbor if it lies in the domain of the forward sweep and
+  from its +x/+y/+z neighbor if it lies in the domain of the backward
+  sweep. With a single label that set does not depend on the visiting
+  order, so it is computed with a scanline fill in z-slabs that are
+  filled in parallel, exchanging the voxels that cross slab boundaries
+  between rounds.
+*/
+#define FILL_FORWARD(mri, x, y, z)  \
+  ((z) >= 1 && (z) <= (mri)->depth-2 && (y) >= 1 && (x) >= 1)
+#define FILL_BACKWARD(mri, x, y, z) \
+  ((z) <= (mri)->depth-2 && (y) <= (mri)->height-2 && (x) <= (mri)->width-2)
+
+typedef struct
+{
+  int  *xyz ;      /* voxels that were filled but whose nbrs are unchecked */
+  int  n, nmax ;
+} FILL_STACK ;
+
+static void
+fill_stack_push(FILL_STACK *st, int x, int y, int z)
+{
+  if (st->n >= st->nmax)
+  {
+    st->nmax = st->nmax ? 2*st->nmax : 4096 ;
+    st->xyz = (int *)realloc(st->xyz, 3*st->nmax*sizeof(int)) ;
+    if (!st->xyz)
+      ErrorExit(ERROR_NOMEMORY, "%s: could not grow fill stack to %d",
+                Progname, st->nmax) ;
+  }
+  st->xyz[3*st->n] = x ;
+  st->xyz[3*st->n+1] = y ;
+  st->xyz[3*st->n+2] = z ;
+  st->n++ ;
+}
+
+static inline int
+fill_eligible(MRI *mri_fill, MRI *mri_im, int threshold, int x, int y, int z)
+{
+  int val ;
+
+  if (MRIvox(mri_fill, x, y, z))
+  {
+    return(0) ;
+  }
+  val = MRIvox(mri_im, x, y, z) ;
+  return(threshold < 0 ? val < -threshold : val > threshold) ;
+}
+
+/* fill (x,y,z) if it can be entered from its nbr in direction -dir */
+static inline int
+fill_voxel(MRI *mri_fill, MRI *mri_im, int threshold, int fillval,
+           int x, int y, int z, int dir, FILL_STACK *st)
+{
+  if (dir > 0 ? !FILL_FORWARD(mri_fill, x, y, z) :
+      !FILL_BACKWARD(mri_fill, x, y, z))
+  {
+    return(0) ;
+  }
+  if (!fill_eligible(mri_fill, mri_im, threshold, x, y, z))
+  {
+    return(0) ;
+  }
+  MRIvox(mri_fill, x, y, z) = fillval ;
+  fill_stack_push(st, x, y, z) ;
+  return(1) ;
+}
+
+/* scanline fill of slices z0 <= z < z1 from the voxels on the stack */
+static int
+fill_brain_slab(MRI *mri_fill, MRI *mri_im, int threshold, int fillval,
+                int z0, int z1, FILL_STACK *st)
+{
+  int  nfilled = 0, x, y, z, xl, xr, xk ;
+
+  while (st->n > 0)
+  {
+    st->n-- ;
+    x = st->xyz[3*st->n] ;
+    y = st->xyz[3*st->n+1] ;
+    z = st->xyz[3*st->n+2] ;
+
+    /* extend the run through (x,y,z) in both directions along x */
+    for (xl = x ; xl > 0 && FILL_BACKWARD(mri_fill, xl-1, y, z) &&
+         fill_eligible(mri_fill, mri_im, threshold, xl-1, y, z) ; xl--)
+    {
+      MRIvox(mri_fill, xl-1, y, z) = fillval ;
+      nfilled++ ;
+    }
+    for (xr = x ; xr < mri_fill->width-1 && FILL_FORWARD(mri_fill, xr+1, y, z) &&
+         fill_eligible(mri_fill, mri_im, threshold, xr+1, y, z) ; xr++)
+    {
+      MRIvox(mri_fill, xr+1, y, z) = fillval ;
+      nfilled++ ;
+    }
+
+    /* and fill from it into the neighboring rows of this slab */
+    for (xk = xl ; xk <= xr ; xk++)
+    {
+      if (y > 0)
+        nfilled += fill_voxel(mri_fill, mri_im, threshold, fillval,
+                              xk, y-1, z, -1, st) ;
+      if (y < mri_fill->height-1)
+        nfilled += fill_voxel(mri_fill, mri_im, threshold, fillval,
+                              xk, y+1, z, 1, st) ;
+      if (z > z0)
+        nfilled += fill_voxel(mri_fill, mri_im, threshold, fillval,
+                              xk, y, z-1, -1, st) ;
+      if (z < z1-1)
+        nfilled += fill_voxel(mri_fill, mri_im, threshold, fillval,
+                              xk, y, z+1, 1, st) ;
+    }
+  }
+  return(nfilled) ;
+}
+
+static int
+fill_brain(MRI *mri_fill, MRI *mri_im, int threshold)
+{
+  int        ntotal = 0, nslabs = 1, s, nexchanged, x, y, z,
+             width, height, depth, minval, maxval, forward ;
+  int        *nfilled ;
+  FILL_STACK *stacks ;
+
+  mriFindBoundingBox(mri_im) ;
+
+  width = mri_fill->width ;
+  height = mri_fill->height ;
+  depth = mri_fill->depth ;
+#ifdef HAVE_OPENMP
+  nslabs = omp_get_max_threads() ;
+#endif
+  if (nslabs > depth)
+  {
+    nslabs = depth ;
+  }
+  stacks = (FILL_STACK *)calloc(nslabs, sizeof(FILL_STACK)) ;
+  nfilled = (int *)calloc(nslabs, sizeof(int)) ;
+  if (!stacks || !nfilled)
+    ErrorExit(ERROR_NOMEMORY, "%s: could not allocate %d fill slabs",
+              Progname, nslabs) ;
+
+  /* find the labels in the fill, whether the first (forward) sweep of
+     the original fill would have filled anything, and the filled voxels
+     that the fill has to start from */
+  minval = 256 ;
+  maxval = 0 ;
+  forward = 0 ;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic,1) \
+    private(x, y, z) reduction(min:minval) reduction(max:maxval) reduction(||:forward)
+#endif
+  for (s = 0 ; s < nslabs ; s++)
+  {
+    ROMP_PFLB_begin
+    int z0 = (long long)s*depth/nslabs, z1 = (long long)(s+1)*depth/nslabs ;
+    int val, fwd, bwd ;
+
+    for (z = z0 ; z < z1 ; z++)
+      for (y = 0 ; y < height ; y++)
+        for (x = 0 ; x < width ; x++)
+        {
+          val = MRIvox(mri_fill, x, y, z) ;
+          if (val == 0)
+          {
+            continue ;
+          }
+          if (val < minval)
+          {
+            minval = val ;
+          }
+          if (val > maxval)
+          {
+            maxval = val ;
+          }
+          fwd =
+            (x < width-1 && FILL_FORWARD(mri_fill, x+1, y, z) &&
+             fill_eligible(mri_fill, mri_im, threshold, x+1, y, z)) ||
+            (y < height-1 && FILL_FORWARD(mri_fill, x, y+1, z) &&
+             fill_eligible(mri_fill, mri_im, threshold, x, y+1, z)) ||
+            (z < depth-1 && FILL_FORWARD(mri_fill, x, y, z+1) &&
+             fill_eligible(mri_fill, mri_im, threshold, x, y, z+1)) ;
+          bwd =
+            (x > 0 && FILL_BACKWARD(mri_fill, x-1, y, z) &&
+             fill_eligible(mri_fill, mri_im, threshold, x-1, y, z)) ||
+            (y > 0 && FILL_BACKWARD(mri_fill, x, y-1, z) &&
+             fill_eligible(mri_fill, mri_im, threshold, x, y-1, z)) ||
+            (z > 0 && FILL_BACKWARD(mri_fill, x, y, z-1) &&
+             fill_eligible(mri_fill, mri_im, threshold, x, y, z-1)) ;
+          if (fwd)
+          {
+            forward = 1 ;
+          }
+          if (fwd || bwd)
+          {
+            fill_stack_push(&stacks[s], x, y, z) ;
+          }
+        }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  if (minval < maxval || min_filled > 0)
+  {
+    ntotal = fill_brain_sweep(mri_fill, mri_im, threshold) ;
+  }
+  else if (forward)   /* otherwise the first sweep, and so the fill, stops */
+  {
+    do
+    {
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic,1)
+#endif
+      for (s = 0 ; s < nslabs ; s++)
+      {
+        ROMP_PFLB_begin
+        nfilled[s] +=
+          fill_brain_slab(mri_fill, mri_im, threshold, maxval,
+                          (long long)s*depth/nslabs,
+                          (long long)(s+1)*depth/nslabs, &stacks[s]) ;
+        ROMP_PFLB_end
+      }
+      ROMP_PF_end
+
+      /* carry the fill across the boundaries between the slabs */
+      nexchanged = 0 ;
+      for (s = 1 ; s < nslabs ; s++)
+      {
+        z = (long long)s*depth/nslabs ;
+        for (y = 0 ; y < height ; y++)
+          for (x = 0 ; x < width ; x++)
+          {
+            if (MRIvox(mri_fill, x, y, z-1))
+              nexchanged += fill_voxel(mri_fill, mri_im, threshold, maxval,
+                                       x, y, z, 1, &stacks[s]) ;
+            if (MRIvox(mri_fill, x, y, z))
+              nexchanged += fill_voxel(mri_fill, mri_im, threshold, maxval,
+                                       x, y, z-1, -1, &stacks[s-1]) ;
+          }
+      }
+      ntotal += nexchanged ;
+    }
+    while (nexchanged > 0) ;
+
+    for (s = 0 ; s < nslabs ; s++)
+    {
+      ntotal += nfilled[s] ;
+    }
+  }
+
+  for (s = 0 ; s < nslabs ; s++)
+  {
+    free(stacks[s].xyz) ;
+  }
+  free(stacks) ;
+  free(nfilled) ;
+
   fprintf(stderr, "total of %d voxels filled...",ntotal);
   if (Gdiag & DIAG_SHOW)
   {
@@ -3893,12 +4220,9 @@ find_cutting_plane
 (MRI *mri_tal, double x_tal, double y_tal,double z_tal,int orientation,
  int *pxv, int *pyv, int *pzv, int seed_set, const LTA *lta)
 {
-  // here is the limitation on the voxsize being up to .5 mm
-  MRI        *mri_slices[MAX_SLICES*2], *mri_filled[MAX_SLICES*2],
-             *mri_cut=NULL, *mri_cut_vol ;
-  double     dx, dy, dz, x, y, z, aspect,MIN_ASPECT,MAX_ASPECT,
-             aspects[MAX_SLICES*2] ;
-  int        slice, offset, area[MAX_SLICES*2],
+  MRI        *mri_cut=NULL, *mri_cut_vol ;
+  double     dx, dy, dz, x, y, z, aspect,MIN_ASPECT,MAX_ASPECT ;
+  int        slice, offset,
              min_area0, min_slice,xo,yo,found,
              xv, yv, zv, x0, y0, z0, xi, yi, zi, MIN_AREA, MAX_AREA, done, where ;
   FILE       *fp = NULL ;   /* for logging pons and cc statistics */
@@ -4006,6 +4330,10 @@ find_cutting_plane
   }
   max_area = ceil(MAX_AREA/(voxsize*voxsize));
   max_slices = ceil(MAX_SLICES/voxsize);
+  // one entry per candidate slice, so that any voxel size can be handled
+  std::vector<MRI *> mri_slices(max_slices), mri_filled(max_slices) ;
+  std::vector<double> aspects(max_slices) ;
+  std::vector<int> area(max_slices) ;
   half_slices = (max_slices-1)/2;
   cut_width = ceil(CUT_WIDTH/voxsize);
   half_cut = (cut_width-1)/2;
@@ -4170,6 +4498,12 @@ find_cutting_plane
   // now search the region for seed point which satisfy done condition
   if (!seed_set) while (!done)
     {
+      MRI        *cand_slices[27], *cand_filled[27] ;
+      MRI_REGION cand_region[27] ;
+      int        cand_x[27], cand_y[27], cand_z[27], cand_where[27],
+                 cand_xo[27], cand_yo[27], cand_area[27], cand_ok[27],
+                 ncand, cand ;
+
       offset += search_step ;   /* search at a greater radius */
       if (offset >= max_offset)
       {
@@ -4180,13 +4514,14 @@ find_cutting_plane
               offset);
       // looking around 3 dimensional area
       // note that loop contain xv, yv
-      for (z0 = zv-offset ; !done && z0 <= zv+offset ; z0 += offset)
+      ncand = 0 ;
+      for (z0 = zv-offset ; z0 <= zv+offset ; z0 += offset)
       {
         zi = mri_tal->zi[z0] ; // safe way of getting the value
-        for (y0 = yv-offset ; !done && y0 <= yv+offset ; y0 += offset)
+        for (y0 = yv-offset ; y0 <= yv+offset ; y0 += offset)
         {
           yi = mri_tal->yi[y0] ;
-          for (x0 = xv-offset ; !done && x0 <= xv+offset ; x0 += offset)
+          for (x0 = xv-offset ; x0 <= xv+offset ; x0 += offset)
           {
             xi = mri_tal->xi[x0] ;
             switch (orientation)
@@ -4208,100 +4543,130 @@ find_cutting_plane
               where = zi ;
               break ;
             }
-            mri_slices[0] =
-              MRIextractPlane(mri_tal, NULL, orientation, where);
-            /////////////////////////////////////////////////
-            // slice location (where) is different but the
-            // same point in the (xy) plane
-            // filled at the same point (xo,yo) given at the beginning
-            // the original way only one loop is enough
-            // for each orientation
-            // mri_filled[0] = MRIfillFG(mri_slices[0],
-            // NULL, xo, yo, 0,WM_MIN_VAL,127, &area[0]);
-            mri_filled[0] =
-              MRIfillFG
-              (mri_slices[0], NULL, xoo, yoo,
-               0,WM_MIN_VAL,127, &area[0]);
-            MRIboundingBox(mri_filled[0], 1, &region) ;
-
-            if (Gdiag & DIAG_WRITE && DIAG_VERBOSE_ON)
-            {
-              sprintf(fname, "%s_seed.mgz",
-                      orientation == MRI_SAGITTAL ? "cc":"pons");
-              MRIwrite(mri_slices[0], fname) ;
-              sprintf(fname, "%s_seed_fill.mgz",
-                      orientation == MRI_SAGITTAL ? "cc":"pons");
-              MRIwrite(mri_filled[0], fname) ;
-            }
+            cand_x[ncand] = xi ;
+            cand_y[ncand] = yi ;
+            cand_z[ncand] = zi ;
+            cand_where[ncand] = where ;
+            cand_xo[ncand] = xoo ;
+            cand_yo[ncand] = yoo ;
+            ncand++ ;
+          }
+        }
+      }
 
-            /* now check to see if it could be a
-               valid seed point based on:
-               1) bound on the area
-               2) the connected component is
-               completely contained in the slice.
-            */
-
-            aspect = (double)region.dy / (double)region.dx ;
-
-            // fprintf(stderr, "area[0] = %d (min = %d, max = %d),
-            // aspect = %.2f (min = %.2f, max = %.2f)\n",
-            //  area[0], min_area, max_area, aspect,
-            // MIN_ASPECT, MAX_ASPECT);
-
-            // does this  area satisfy the condition?
-            if ((area[0] >= min_area) &&
-                (area[0] <= max_area) &&
-                (aspect  >= MIN_ASPECT) &&
-                (aspect  <= MAX_ASPECT) &&
-                (region.y > 0) &&
-                (region.x > 0) &&
-                (region.x+region.dx < slice_size-1) && //SLICE_SIZE-1) &&
-                (region.y+region.dy < slice_size-1))   //SLICE_SIZE-1))
-            {
-              fprintf
-              (stderr,
-               "area[0] = %d (min = %d, max = %d), "
-               "aspect = %.2f (min = %.2f, max = %.2f)\n",
-               area[0], min_area, max_area, aspect,
-               MIN_ASPECT, MAX_ASPECT);
-
-              /* center the seed */
-              // xv and yv get modified, but done = 1 is
-              // set and thus ok.
-              find_slice_center
-              (mri_filled[0],&xv,&yv); // center index in the plane
-              // getting blob center
-              switch (orientation)
-              {
-              default:
-              case MRI_HORIZONTAL:
-                /*xi += xv - xo ; zi += yv - yo*/
-                xi = xv;
-                zi = yv ;
-                break ; // yi remains (slice value)
-              case MRI_SAGITTAL:
-                /* zi += xv - xo ; yi += yv - yo*/
-                zi = xv;
-                yi = yv ;
-                break ; // xi remains (slice value)
-              }
+      // the candidates are independent, so evaluate all of them and
+      // take the first valid one in the order they were searched in
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic,1)
+#endif
+      for (cand = 0 ; cand < ncand ; cand++)
+      {
+        ROMP_PFLB_begin
+        double cand_aspect ;
+
+        cand_slices[cand] =
+          MRIextractPlane(mri_tal, NULL, orientation, cand_where[cand]);
+        /////////////////////////////////////////////////
+        // slice location (where) is different but the
+        // same point in the (xy) plane
+        // filled at the same point (xo,yo) given at the beginning
+        // the original way only one loop is enough
+        // for each orientation
+        // mri_filled[0] = MRIfillFG(mri_slices[0],
+        // NULL, xo, yo, 0,WM_MIN_VAL,127, &area[0]);
+        cand_filled[cand] =
+          MRIfillFG
+          (cand_slices[cand], NULL, cand_xo[cand], cand_yo[cand],
+           0,WM_MIN_VAL,127, &cand_area[cand]);
+        MRIboundingBox(cand_filled[cand], 1, &cand_region[cand]) ;
+
+        /* now check to see if it could be a
+           valid seed point based on:
+           1) bound on the area
+           2) the connected component is
+           completely contained in the slice.
+        */
+        cand_aspect =
+          (double)cand_region[cand].dy / (double)cand_region[cand].dx ;
+        cand_ok[cand] =
+          ((cand_area[cand] >= min_area) &&
+           (cand_area[cand] <= max_area) &&
+           (cand_aspect  >= MIN_ASPECT) &&
+           (cand_aspect  <= MAX_ASPECT) &&
+           (cand_region[cand].y > 0) &&
+           (cand_region[cand].x > 0) &&
+           (cand_region[cand].x+cand_region[cand].dx < slice_size-1) &&
+           (cand_region[cand].y+cand_region[cand].dy < slice_size-1)) ;
+        ROMP_PFLB_end
+      }
+      ROMP_PF_end
 
-              x = (double)xi ;
-              y = (double)yi ;
-              z = (double)zi ;
-              // get the talairach RAS position
-              MRIvoxelToWorld
-              (mri_tal, x, y, z, &x_tal, &y_tal, &z_tal) ;
-              done = 1 ;
-              xv = xi ;
-              yv = yi ;
-              zv = zi ;
-            }
-            MRIfree(&mri_slices[0]) ;
-            MRIfree(&mri_filled[0]) ;
-          }
+      for (cand = 0 ; !done && cand < ncand ; cand++)
+      {
+        if (Gdiag & DIAG_WRITE && DIAG_VERBOSE_ON)
+        {
+          sprintf(fname, "%s_seed.mgz",
+                  orientation == MRI_SAGITTAL ? "cc":"pons");
+          MRIwrite(cand_slices[cand], fname) ;
+          sprintf(fname, "%s_seed_fill.mgz",
+                  orientation == MRI_SAGITTAL ? "cc":"pons");
+          MRIwrite(cand_filled[cand], fname) ;
+        }
+
+        // does this  area satisfy the condition?
+        if (cand_ok[cand])
+        {
+          aspect =
+            (double)cand_region[cand].dy / (double)cand_region[cand].dx ;
+          fprintf
+          (stderr,
+           "area[0] = %d (min = %d, max = %d), "
+           "aspect = %.2f (min = %.2f, max = %.2f)\n",
+           cand_area[cand], min_area, max_area, aspect,
+           MIN_ASPECT, MAX_ASPECT);
+
+          xi = cand_x[cand] ;
+          yi = cand_y[cand] ;
+          zi = cand_z[cand] ;
+          /* center the seed */
+          // xv and yv get modified, but done = 1 is
+          // set and thus ok.
+          find_slice_center
+          (cand_filled[cand],&xv,&yv); // center index in the plane
+          // getting blob center
+          switch (orientation)
+          {
+          default:
+          case MRI_HORIZONTAL:
+            /*xi += xv - xo ; zi += yv - yo*/
+            xi = xv;
+            zi = yv ;
+            break ; // yi remains (slice value)
+          case MRI_SAGITTAL:
+            /* zi += xv - xo ; yi += yv - yo*/
+            zi = xv;
+            yi = yv ;
+            break ; // xi remains (slice value)
+          }
+
+          x = (double)xi ;
+          y = (double)yi ;
+          z = (double)zi ;
+          // get the talairach RAS position
+          MRIvoxelToWorld
+          (mri_tal, x, y, z, &x_tal, &y_tal, &z_tal) ;
+          done = 1 ;
+          xv = xi ;
+          yv = yi ;
+          zv = zi ;
         }
       }
+      for (cand = 0 ; cand < ncand ; cand++)
+      {
+        MRIfree(&cand_slices[cand]) ;
+        MRIfree(&cand_filled[cand]) ;
+      }
     }
   if (Gdiag & DIAG_SHOW)
   {
@@ -4321,6 +4686,10 @@ find_cutting_plane
   // found the seed point look around the slice below and above
   if (!seed_set)   /* find slice with smallest cross-section */
   {
+    std::vector<int> slice_xv(max_slices), slice_yv(max_slices),
+        slice_zv(max_slices), slice_where(max_slices) ;
+
+    // MRIworldToVoxel is not thread safe, so locate the slices first
     for (slice = 0 ; slice < max_slices ; slice++)
     {
       offset = slice - half_slices ;
@@ -4328,67 +4697,87 @@ find_cutting_plane
       y = y_tal + dy*offset ;
       z = z_tal + dz*offset ;
       MRIworldToVoxel(mri_tal, x, y,  z, &x, &y,&z) ;
-      xv = nint(x) ;
-      yv = nint(y) ;
-      zv = nint(z) ;
+      slice_xv[slice] = nint(x) ;
+      slice_yv[slice] = nint(y) ;
+      slice_zv[slice] = nint(z) ;
       switch (orientation)
       {
       default:
       case MRI_HORIZONTAL:
-        where = yv ;
+        slice_where[slice] = slice_yv[slice] ;
         break ;
       case MRI_SAGITTAL:
-        where = xv ;
+        slice_where[slice] = slice_xv[slice] ;
         break ;
       case MRI_CORONAL:
-        where = zv ;
+        slice_where[slice] = slice_zv[slice] ;
         break ;
       }
-      mri_slices[slice] = MRIextractPlane(mri_tal,NULL,orientation, where);
+    }
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic,1)
+#endif
+    for (slice = 0 ; slice < max_slices ; slice++)
+    {
+      ROMP_PFLB_begin
+      MRI_REGION slice_region ;
+      int        sx, sy, slice_found ;
+
+      mri_slices[slice] =
+        MRIextractPlane(mri_tal,NULL,orientation, slice_where[slice]);
       mri_filled[slice] =
         MRIfillFG
         (mri_slices[slice],NULL,xo,yo,0,WM_MIN_VAL,127,&area[slice]);
-      MRIboundingBox(mri_filled[slice], 1, &region) ;
-      aspects[slice] = (double)region.dy / (double)region.dx ;
+      MRIboundingBox(mri_filled[slice], 1, &slice_region) ;
+      aspects[slice] = (double)slice_region.dy / (double)slice_region.dx ;
 
 #if 0
       /* don't trust slices that extend to the border of the image */
-      if (!region.x || !region.y || region.x+region.dx >= SLICE_SIZE-1 ||
-          region.y+region.dy >= SLICE_SIZE-1)
+      if (!slice_region.x || !slice_region.y ||
+          slice_region.x+slice_region.dx >= SLICE_SIZE-1 ||
+          slice_region.y+slice_region.dy >= SLICE_SIZE-1)
       {
         area[slice] = 0 ;
       }
 #endif
 
-      if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON)
-        fprintf
-        (stderr,
-         "cutting_plane_slice[%d] @ (%d, %d, %d): area = %d\n",
-         slice, xv, yv, zv, area[slice]) ;
-
       if (orientation == MRI_SAGITTAL)/* extend to top
                                          and bottom of slice */
       {
-        region.dy = slice_size - region.y;  //  SLICE_SIZE - region.y ;
+        slice_region.dy = slice_size - slice_region.y;  //  SLICE_SIZE - region.y ;
       }
 
       /*    for (yv = region.y ; yv < region.y+region.dy ; yv++)*/
-      for (xv = region.x ; xv < region.x+region.dx ; xv++)
+      for (sx = slice_region.x ; sx < slice_region.x+slice_region.dx ; sx++)
       {
-        found = 0 ;
-        for (yv = region.y ; yv < region.y+region.dy ; yv++)
+        slice_found = 0 ;
+        for (sy = slice_region.y ; sy < slice_region.y+slice_region.dy ; sy++)
         {
-          if (!found)
+          if (!slice_found)
           {
-            found  = (MRIvox(mri_filled[slice], xv, yv, 0) > 0) ;
+            slice_found  = (MRIvox(mri_filled[slice], sx, sy, 0) > 0) ;
           }
 
-          if (found)
+          if (slice_found)
           {
-            MRIvox(mri_filled[slice], xv, yv, 0) = 1 ;
+            MRIvox(mri_filled[slice], sx, sy, 0) = 1 ;
           }
         }
       }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    for (slice = 0 ; slice < max_slices ; slice++)
+    {
+      if (Gdiag & DIAG_SHOW && DIAG_VERBOSE_ON)
+        fprintf
+        (stderr,
+         "cutting_plane_slice[%d] @ (%d, %d, %d): area = %d\n",
+         slice, slice_xv[slice], slice_yv[slice], slice_zv[slice],
+         area[slice]) ;
 
       if ((Gdiag & DIAG_WRITE) && !(slice % 1) && DIAG_VERBOSE_ON)
       {
@@ -4426,7 +4815,7 @@ find_cutting_plane
     }
     else      /* search for middle of corpus callosum */
     {
-      int valid[255]; // MAX_SLICES]
+      std::vector<int> valid(max_slices) ;
       /*, num_on, max_num_on, max_on_slice_start */
 
       for (slice = 1 ; slice < max_slices-1 ; slice++)
@@ -5012,8 +5401,7 @@ find_cc_slice(MRI *mri_tal,
               double *pccx, double *pccy, double *pccz,
               const LTA *lta)
 {
-  // here we can handle only up to .5 mm voxel size
-  int         area[MAX_SLICES*2], min_area, min_slice, slice, offset,xv,yv,zv,
+  int         min_area, min_slice, slice, offset,xv,yv,zv,
               xo, yo ;
   MRI         *mri_slice, *mri_filled ;
   double      aspect, x_tal, y_tal, z_tal, x, y, z, xvv, yvv, zvv;
@@ -5023,6 +5411,7 @@ find_cc_slice(MRI *mri_tal,
   double voxsize = findMinSize(mri_tal);
   int slice_size = mri_tal->width;
   int max_slices = ceil(MAX_SLICES/voxsize);
+  std::vector<int> area(max_slices) ;
   int max_cc_area = ceil(MAX_CC_AREA/(voxsize*voxsize));
   int min_cc_area = floor(MIN_CC_AREA/(voxsize*voxsize));
 
@@ -1849,11 +1849,19 @@ int main(int argc, char **argv) {
 	    else {
 	      // volume clustering -------------
 	      if (debug) printf("Clustering on volume\n");
-	      VolClustList = clustGetClusters(sig, 0, threshadj,-1,csd->threshsign,0,
-					      mriglm->mask, &nClusters, NULL);
-	      csize = voxelsize*clustMaxClusterCount(VolClustList,nClusters);
-	      if (Gdiag_no > 0) clustDumpSummary(stdout,VolClustList,nClusters);
-	      clustFreeClusterList(&VolClustList,nClusters);
+	      if (Gdiag_no > 0) {
+		VolClustList = clustGetClusters(sig, 0, threshadj,-1,csd->threshsign,0,
+						mriglm->mask, &nClusters, NULL);
+		csize = voxelsize*clustMaxClusterCount(VolClustList,nClusters);
+		clustDumpSummary(stdout,VolClustList,nClusters);
+		clustFreeClusterList(&VolClustList,nClusters);
+	      }
+	      else {
+		// Only the size of the biggest cluster is needed, so
+		// skip building the cluster lists
+		csize = voxelsize*clustMaxClusterCountVolume(sig, 0, threshadj,-1,csd->threshsign,
+							     mriglm->mask, 0, 0, &nClusters);
+	      }
 	    }
 	    if(debug) printf("%s %d nc=%d  maxcsize=%g  sigmax=%g  Fmax=%g\n",
 			     mriglm->glm->Cname[n],nthsim,nClusters,csize,sigmax,Fmax);
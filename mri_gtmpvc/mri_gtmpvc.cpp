@@ -610,7 +610,7 @@ int main(int argc, char *argv[])
   PrintMemUsage(logfp);
   mytimer.reset();
   GTMbuildX(gtm);
-  if(gtm->X==NULL) exit(1);
+  if(!GTMhaveX(gtm)) exit(1);
   printf(" gtm build time %4.1f sec\n",mytimer.seconds());fflush(stdout);
   fprintf(logfp,"GTM-Build-time %4.1f sec\n",mytimer.seconds());fflush(logfp);
   if(Gdiag_no > 0) PrintMemUsage(stdout);
@@ -735,8 +735,10 @@ int main(int argc, char *argv[])
       mytimer.reset();
       MatrixFree(&gtm->X);
       MatrixFree(&gtm->X0);
+      GTMsparseXfree(&gtm->Xs);
+      GTMsparseXfree(&gtm->X0s);
       GTMbuildX(gtm);
-      if(gtm->X==NULL) exit(1);
+      if(!GTMhaveX(gtm)) exit(1);
       printf(" gtm build time %4.1f sec\n", mytimer.seconds()); fflush(stdout);
       fprintf(logfp,"GTM-rebuild-time %4.1f sec\n", mytimer.seconds()); fflush(logfp);
       if(Gdiag_no > 0) PrintMemUsage(stdout);
@@ -753,11 +755,21 @@ int main(int argc, char *argv[])
   //MRIfree(&gtm->segpvf);
   if(SaveX0) {
     printf("Writing X0 to %s\n",Xfile);
-    MatlabWrite(gtm->X0, X0file,"X0");
+    if(gtm->UseSparseX){
+      MATRIX *X0dense = GTMsparseXtoDense(gtm->X0s,NULL);
+      MatlabWrite(X0dense, X0file,"X0");
+      MatrixFree(&X0dense);
+    }
+    else MatlabWrite(gtm->X0, X0file,"X0");
   }
   if(SaveX) {
     printf("Writing X to %s\n",Xfile);
-    MatlabWrite(gtm->X, Xfile,"X");
+    if(gtm->UseSparseX){
+      MATRIX *Xdense = GTMsparseXtoDense(gtm->Xs,NULL);
+      MatlabWrite(Xdense, Xfile,"X");
+      MatrixFree(&Xdense);
+    }
+    else MatlabWrite(gtm->X, Xfile,"X");
   }
 
   printf("Solving ...\n");
@@ -772,14 +784,20 @@ int main(int argc, char *argv[])
   if(Gdiag_no > 0) PrintMemUsage(stdout);
   PrintMemUsage(logfp);
 
-  if(gtm->X0 && DoGTMMat){
-    MATRIX *X0tX0, *X0t,*X0tX,*iX0tX0,*gtmmat;
+  if((gtm->X0 || gtm->X0s) && DoGTMMat){
+    MATRIX *X0tX0, *X0t=NULL,*X0tX,*iX0tX0,*gtmmat;
     printf("Computing actual GTM Matrix\n"); fflush(stdout);
-    X0tX0 = MatrixMtM(gtm->X0,NULL);
+    if(gtm->UseSparseX){
+      X0tX0 = GTMsparseAtB(gtm->X0s,gtm->X0s,NULL);
+      X0tX  = GTMsparseAtB(gtm->X0s,gtm->Xs,NULL);
+    }
+    else {
+      X0tX0 = MatrixMtM(gtm->X0,NULL);
+      X0t = MatrixTranspose(gtm->X0,NULL);
+      X0tX = MatrixMultiplyD(X0t,gtm->X,NULL);
+    }
     iX0tX0 = MatrixInverse(X0tX0,NULL);
 
-    X0t = MatrixTranspose(gtm->X0,NULL);
-    X0tX = MatrixMultiplyD(X0t,gtm->X,NULL);
     gtmmat = MatrixMultiplyD(iX0tX0,X0tX,NULL);
     sprintf(tmpstr,"%s/gtm.mat",AuxDir);
     MatrixWriteTxt(tmpstr,gtmmat);
@@ -787,7 +805,7 @@ int main(int argc, char *argv[])
     sprintf(tmpstr,"%s/gtm.inv.mat",AuxDir);
     MatrixWriteTxt(tmpstr,gtmmat);
     printf("done computing gtm matrix\n"); fflush(stdout);
-    MatrixFree(&X0t);
+    if(X0t) MatrixFree(&X0t);
     MatrixFree(&X0tX0);
     MatrixFree(&X0tX);
     MatrixFree(&gtmmat);
@@ -915,6 +933,7 @@ int main(int argc, char *argv[])
 
   printf("Freeing X\n");
   MatrixFree(&gtm->X);
+  GTMsparseXfree(&gtm->Xs);
 
   nopvc = GTMnoPVC(gtm);
   sprintf(tmpstr,"%s/nopvc.nii.gz",OutDir);
@@ -997,6 +1016,7 @@ int main(int argc, char *argv[])
   
   printf("Freeing X0\n");
   MatrixFree(&gtm->X0);
+  GTMsparseXfree(&gtm->X0s);
 
 
   if(yhatFile|| yhatFullFoVFile){
@@ -1221,6 +1241,7 @@ static int parse_commandline(int argc, char **argv) {
     else if(!strcasecmp(option, "--no-vfc"))      gtm->DoVoxFracCor=0;
     else if(!strcasecmp(option, "--no-vox-frac")) gtm->DoVoxFracCor=0;
     else if(!strcasecmp(option, "--no-vox-frac-cor")) gtm->DoVoxFracCor=0;
+    else if(!strcasecmp(option, "--sparse-x")) gtm->UseSparseX = 1;
     else if(!strcasecmp(option, "--no-gm-rvar"))  DoGMRvar = 0;
     else if(!strcasecmp(option, "--sim-anat-seg"))  DoSimAnatSeg=1;
     else if (!strcasecmp(option, "--chunk")) setenv("FS_USE_MRI_CHUNK","1",1);
@@ -1715,6 +1736,8 @@ static void print_usage(void) {
   printf("   --ss bpc scale dcf : steady-state analysis spec blood plasma concentration, unit scale\n");
   printf("     and decay correction factor. You must also spec --km-ref. Turns off rescaling\n");
   printf("\n");
+  printf("   --sparse-x : only store the nonzero part of the GTM design matrix. Needs much\n");
+  printf("     less memory with many segs or many voxels, eg, dynamic PET with a fine seg\n");
   printf("   --X : save X matrix in matlab4 format as X.mat (it will be big)\n");
   printf("   --y : save y matrix in matlab4 format as y.mat\n");
   printf("   --beta : save beta matrix in matlab4 format as beta.mat\n");
@@ -2084,7 +2107,7 @@ double GTMcostPSF(GTM *gtm)
   GTMpsfStd(gtm);
 
   GTMbuildX(gtm);
-  if(gtm->X==NULL) exit(1);
+  if(!GTMhaveX(gtm)) exit(1);
 
   err=GTMsolve(gtm); 
   GTMrvarGM(gtm);
@@ -2408,24 +2431,39 @@ int GTMsom(GTM *gtm)
   gtm->som = MatrixAlloc(gtm->nsegs,gtm->nsegs,MATRIX_REAL);
 
   f = 0; // only one frame with the matrix
-  for(cthseg=0; cthseg < gtm->nsegs; cthseg++){
-    k = 0;
-    cbeta = gtm->beta->rptr[cthseg+1][f+1];
-    for(s=0; s < gtm->yvol->depth; s++){ // crs order is important here!
-      for(c=0; c < gtm->yvol->width; c++){
-	for(r=0; r < gtm->yvol->height; r++){
-	  if(gtm->mask && MRIgetVoxVal(gtm->mask,c,r,s,0) < 0.5) continue;
-	  val = cbeta*gtm->X->rptr[k+1][cthseg+1];
-	  segid = MRIgetVoxVal(gtm->gtmseg,c,r,s,0);
-	  if(segid != 0) {
-	    rthseg = GTMsegid2nthseg(gtm,segid);
-	    gtm->som->rptr[rthseg+1][cthseg+1] += val;
+  if(gtm->UseSparseX){
+    // Go down each sparse column, same sums as below
+    int *rowseg = GTMrowSegNo(gtm);
+    for(cthseg=0; cthseg < gtm->nsegs; cthseg++){
+      cbeta = gtm->beta->rptr[cthseg+1][f+1];
+      for(k=0; k < gtm->Xs->nnz[cthseg]; k++){
+	rthseg = rowseg[gtm->Xs->rowno[cthseg][k]];
+	if(rthseg < 0) continue;
+	gtm->som->rptr[rthseg+1][cthseg+1] += cbeta*gtm->Xs->val[cthseg][k];
+      }
+    }
+    free(rowseg);
+  }
+  else {
+    for(cthseg=0; cthseg < gtm->nsegs; cthseg++){
+      k = 0;
+      cbeta = gtm->beta->rptr[cthseg+1][f+1];
+      for(s=0; s < gtm->yvol->depth; s++){ // crs order is important here!
+	for(c=0; c < gtm->yvol->width; c++){
+	  for(r=0; r < gtm->yvol->height; r++){
+	    if(gtm->mask && MRIgetVoxVal(gtm->mask,c,r,s,0) < 0.5) continue;
+	    val = cbeta*gtm->X->rptr[k+1][cthseg+1];
+	    segid = MRIgetVoxVal(gtm->gtmseg,c,r,s,0);
+	    if(segid != 0) {
+	      rthseg = GTMsegid2nthseg(gtm,segid);
+	      gtm->som->rptr[rthseg+1][cthseg+1] += val;
+	    }
+	    k++;
 	  }
-	  k++;
 	}
       }
-    }
-  } // cthseg
+    } // cthseg
+  }
     
   /* Normalize SOM(rNoPVC,cGTM) is the proportion that cGTM
      contributes to rNoPVC, ie, it is the amount of spill-out of
@@ -43,45 +43,17 @@
 #include "tags.h"
 #include "gca.h"
 #include "MC.h"
-
-#define MAXFACES    3000000
-#define MAXVERTICES 1500000
-#define FACEINCREASE 1.2
-#define VERTEXINCREASE 1.2
+#include "romp_support.h"
 
 const char *Progname;
 
-typedef struct quad_face_type_ {
-  int imnr,i,j,f;
-  int num;
-  int v[4];
-}
-quad_face_type;
-
-typedef struct quad_vertex_type_ {
-  float imnr,i,j;
-  int num;
-  int f[9];
-}
-quad_vertex_type;
-
-
 typedef struct tesselation_parms_ {
   /*labeled volume*/
   MRI *mri;
 
-  //for the marching cube tesselation
-  int MC;
-
-  int imgsize,width,height;
-
-  unsigned char*** im;
-
   /*label information*/
   int number_of_labels;
   int* label_values;
-  int *imin,*imax,*jmin,*jmax,*kmin,*kmax;
-  int current_label;
   int ind;
   int xmin,xmax,ymin,ymax,zmin,zmax;
 
@@ -94,187 +66,31 @@ typedef struct tesselation_parms_ {
 
   /*to compute the tesselation consistent with a n topology*/
   int connectivity;
-
-  /*face information*/
-  int face_index;
-  quad_face_type *face;
-  int maxfaces;
-  int *face_index_table0;
-  int *face_index_table1;
-
-  /*vertex information*/
-  int vertex_index;
-  quad_vertex_type *vertex;
-  int maxvertices;
-  //  int *vertex_index_table;
-
-  /*used for the debugging*/
-  char fname[STRLEN];
-
 }
 tesselation_parms;
 
-
-static int downsample = 0 ;
-
-/*initialization of tesselation_parms*/
-/*note that not all the fields are allocated*/
-void initTesselationParms(tesselation_parms *parms) {
-  int i,j,k,n;
-  int depth,width,height;
-  int *xmin,*ymin,*zmin,*xmax,*ymax,*zmax;
-  int val,label_nbr,*labels;
-  unsigned char ***im;
-  MRI *mri=parms->mri;
-
-  depth=mri->depth;
-  width=mri->width;
-  height=mri->height;
-
-  parms->width=2*MAX(width,height)+1;
-  parms->height=parms->width;
-  parms->imgsize=parms->width*parms->height;
-
-  /* allocate and initialize the image*/
-  im=(unsigned char***)malloc(sizeof(unsigned char**)*depth);
-  if (!im)
-    ErrorExit(ERROR_NO_MEMORY,"MRIStesselate: could not allocate the image");
-  for (k=0;k<depth;k++) {
-    im[k] = (unsigned char **)malloc(height*sizeof(char *));
-    if (!im[k])
-      ErrorExit(ERROR_NO_MEMORY,"MRIStesselate: could not allocate the image");
-    for (j=0;j<height;j++) {
-      im[k][j] = (unsigned char *)calloc(width,sizeof(char));
-      if (!im[k][j])
-        ErrorExit(ERROR_NO_MEMORY,
-                  "MRIStesselate: could not allocate the image");
-    }
-  }
-  parms->im=im;
-
-  label_nbr=parms->number_of_labels;
-  labels=parms->label_values;
-
-  xmin=(int*)malloc(label_nbr*sizeof(int));
-  ymin=(int*)malloc(label_nbr*sizeof(int));
-  zmin=(int*)malloc(label_nbr*sizeof(int));
-  xmax=(int*)malloc(label_nbr*sizeof(int));
-  ymax=(int*)malloc(label_nbr*sizeof(int));
-  zmax=(int*)malloc(label_nbr*sizeof(int));
-
-  if ((!xmin) || (!ymin) || (!zmin) || (!xmax) || (!ymax) || (!zmax))
-    ErrorExit(ERROR_NO_MEMORY,"MRIStesselate: table of labels");
-
-  for (n=0;n<label_nbr;n++) {
-    xmin[n]=ymin[n]=zmin[n]=100000;
-    xmax[n]=ymax[n]=zmax[n]=0;
-  }
-
-  for (k=1;k<depth-1;k++)
-    for (j=1;j<height-1;j++)
-      for (i=1;i<width-1;i++)
-        im[k][j][i]=MRIvox(mri,i,j,k);
-
-  for (k=1;k<mri->depth-1;k++)
-    for (j=1;j<mri->height-1;j++)
-      for (i=1;i<mri->width-1;i++) {
-        val=MRIvox(mri,i,j,k);
-        for (n=0;n<label_nbr;n++)
-          if (val==labels[n] || (parms->all_flag && val)) {
-            if (i<xmin[n])  xmin[n]=i;
-            if (j<ymin[n])  ymin[n]=j;
-            if (k<zmin[n])  zmin[n]=k;
-
-            if (i>xmax[n])  xmax[n]=i;
-            if (j>ymax[n])  ymax[n]=j;
-            if (k>zmax[n])  zmax[n]=k;
-          }
-      }
-
-  /*be careful: the region is expanded by one voxel in the MRI referential*/
-  for (n=0;n<label_nbr;n++) {
-    xmin[n]--;
-    ymin[n]--;
-    zmin[n]--;
-    xmax[n]++;
-    ymax[n]++;
-    zmax[n]++;
-  }
-
-  parms->imin=xmin;
-  parms->jmin=ymin;
-  parms->kmin=zmin;
-  parms->imax=xmax;
-  parms->jmax=ymax;
-  parms->kmax=zmax;
-
-  parms->all_flag=0;
-}
-#if 1
-static int freeTesselationParms(tesselation_parms **parms) {
-  int j,k;
-  tesselation_parms *tmp=*parms;
-  int depth,width,height;
-  MRI *mri=tmp->mri;
-
-  depth=mri->depth;
-  height=mri->height;
-  width=mri->width;
-
-  for (k=0;k<depth;k++) {
-    for (j=0;j<height;j++)
-      free(tmp->im[k][j]);
-    free(tmp->im[k]);
-  }
-  free(tmp->im);
-
-
-  free(tmp->imin);
-  free(tmp->jmin);
-  free(tmp->kmin);
-  free(tmp->imax);
-  free(tmp->jmax);
-  free(tmp->kmax);
-
-  free(*parms);
-  return(NO_ERROR) ;
-}
-#endif
-void allocateTesselation(tesselation_parms *parms) {
-  int imgsize=parms->imgsize;
-  parms->face = (quad_face_type *)lcalloc(MAXFACES,sizeof(quad_face_type));
-  parms->maxfaces=MAXFACES;
-  parms->face_index_table0 = (int *)lcalloc(6*imgsize,sizeof(int));
-  parms->face_index_table1 = (int *)lcalloc(6*imgsize,sizeof(int));
-
-  parms->vertex = 
-    (quad_vertex_type *)lcalloc(MAXVERTICES,sizeof(quad_vertex_type));
-  parms->maxvertices=MAXVERTICES;
-  //  parms->vertex_index_table = (int *)lcalloc(8*imgsize,sizeof(int));
-
-  parms->face_index=0;
-  parms->vertex_index=0;
-
-  if ((!parms->face) || (!parms->face_index_table0)
-      || (!parms->face_index_table1)
-      || (!parms->vertex))
-    //     || (!parms->vertex_index_table))
-    ErrorExit(ERROR_NO_MEMORY,"MRIStesselate: local tesselation tables");
+/*The tesselation is generated in z-slabs that are processed independently.
+  Each slab numbers its vertices and faces in the same scan order as a
+  single pass over the volume, so the slabs are simply concatenated. The
+  vertices on the bottom plane of a slab are created by the slab below:
+  faces refer to them by their edge key on that plane (stored as -2-key)
+  and are welded to the vertices of the slab below once all are done.*/
+typedef struct mc_slab_ {
+  int kmin,kmax;  /*cubes kmin <= k < kmax*/
+  int nvertices,maxvertices;
+  float *vertex;  /*i,j,imnr of each vertex*/
+  int nfaces,maxfaces;
+  int *face;      /*3 vertices per face*/
+  int *top;       /*vertex on each edge of the plane kmax, by edge key*/
+  int voffset,foffset; /*first vertex and face in the surface*/
 }
+mc_slab;
 
-#if 0
-static void freeTesselation(tesselation_parms *parms) {
-  free(parms->face);
-  free(parms->face_index_table0);
-  free(parms->face_index_table1);
 
-  free(parms->vertex);
-  //  free(parms->vertex_index_table);
-}
-#endif
+static int downsample = 0 ;
 
 MRI* preprocessingStep(tesselation_parms *parms) {
-  int i,j,k,width,height,depth,n;
+  int width,height,depth;
   int xmin,ymin,zmin,xmax,ymax,zmax;
   MRI *mri;
 
@@ -287,36 +103,34 @@ MRI* preprocessingStep(tesselation_parms *parms) {
   xmin=ymin=zmin=100000;
   xmax=ymax=zmax=0;
 
-  if (!parms->all_flag) {
-    for (k=0;k<depth;k++)
-      for (j=0;j<height;j++)
-        for (i=0;i<width;i++)
-          for (n=0;n<parms->number_of_labels;n++)
-            if (MRIvox(parms->mri,i,j,k)==parms->label_values[n]) {
-              MRIvox(mri,i,j,k)=1;
-              if (i<xmin)  xmin=i;
-              if (j<ymin)  ymin=j;
-              if (k<zmin)  zmin=k;
-
-              if (i>xmax)  xmax=i;
-              if (j>ymax)  ymax=j;
-              if (k>zmax)  zmax=k;
-            }
-  } else {
-    for (k=0;k<depth;k++)
-      for (j=0;j<height;j++)
-        for (i=0;i<width;i++)
-          if (MRIvox(parms->mri,i,j,k)) {
-            MRIvox(mri,i,j,k)=1;
-            if (i<xmin)  xmin=i;
-            if (j<ymin)  ymin=j;
-            if (k<zmin)  zmin=k;
-
-            if (i>xmax)  xmax=i;
-            if (j>ymax)  ymax=j;
-            if (k>zmax)  zmax=k;
-          }
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) \
+    reduction(min:xmin,ymin,zmin) reduction(max:xmax,ymax,zmax)
+#endif
+  for (int k=0;k<depth;k++) {
+    ROMP_PFLB_begin
+    for (int j=0;j<height;j++)
+      for (int i=0;i<width;i++) {
+        int val=MRIvox(parms->mri,i,j,k),found=0;
+        if (parms->all_flag)
+          found=(val != 0);
+        else
+          for (int n=0;n<parms->number_of_labels && !found;n++)
+            found=(val==parms->label_values[n]);
+        if (!found) continue;
+        MRIvox(mri,i,j,k)=1;
+        if (i<xmin)  xmin=i;
+        if (j<ymin)  ymin=j;
+        if (k<zmin)  zmin=k;
+
+        if (i>xmax)  xmax=i;
+        if (j>ymax)  ymax=j;
+        if (k>zmax)  zmax=k;
+      }
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
   parms->xmin=xmin-1;
   parms->ymin=ymin-1;
@@ -329,116 +143,92 @@ MRI* preprocessingStep(tesselation_parms *parms) {
 
 }
 
-void reallocateVertices(tesselation_parms *parms) {
-  quad_vertex_type *tmp;
-  int k,n;
-  int vertex_index=parms->vertex_index;
-
-  parms->maxvertices=(int)(parms->maxvertices*VERTEXINCREASE);
-  tmp=(quad_vertex_type*)lcalloc(parms->maxvertices,sizeof(quad_vertex_type));
-  if (!tmp)
-    ErrorExit(ERROR_NOMEMORY, "%s: max vertices %d exceeded",
-              Progname,parms->maxvertices) ;
-  for (k=0;k<vertex_index;k++) {
-    tmp[k].imnr=parms->vertex[k].imnr;
-    tmp[k].i=parms->vertex[k].i;
-    tmp[k].j=parms->vertex[k].j;
-    tmp[k].num=parms->vertex[k].num;
-    for (n=0;n<9;n++)
-      tmp[k].f[n]=parms->vertex[k].f[n];
+static int addSlabVertex(mc_slab *slab, float i, float j, float imnr) {
+  if (slab->nvertices >= slab->maxvertices) {
+    slab->maxvertices=MAX(2*slab->maxvertices,1024);
+    slab->vertex=(float*)realloc(slab->vertex,3*slab->maxvertices*sizeof(float));
+    if (!slab->vertex)
+      ErrorExit(ERROR_NOMEMORY, "%s: could not allocate %d vertices",
+                Progname,slab->maxvertices) ;
   }
-  free(parms->vertex);
-  parms->vertex=tmp;
+  slab->vertex[3*slab->nvertices]=i;
+  slab->vertex[3*slab->nvertices+1]=j;
+  slab->vertex[3*slab->nvertices+2]=imnr;
+  return(slab->nvertices++);
 }
-void reallocateFaces(tesselation_parms *parms) {
-  quad_face_type *tmp;
-  int k,n;
-  int face_index=parms->face_index;
-
-  parms->maxfaces=(int)(parms->maxfaces*FACEINCREASE);
-  tmp=(quad_face_type*)lcalloc(parms->maxfaces,sizeof(quad_face_type));
-  if (!tmp)
-    ErrorExit(ERROR_NOMEMORY, "%s: max faces %d exceeded",
-              Progname,parms->maxfaces) ;
-  for (k=0;k<face_index;k++) {
-    tmp[k].imnr=parms->face[k].imnr;
-    tmp[k].i=parms->face[k].i;
-    tmp[k].j=parms->face[k].j;
-    tmp[k].f=parms->face[k].f;
-    tmp[k].num=parms->face[k].num;
-    for (n=0;n<4;n++)
-      tmp[k].v[n]=parms->face[k].v[n];
-  }
 
-  free(parms->face);
-  parms->face=tmp;
+static void addSlabFace(mc_slab *slab, int v0, int v1, int v2) {
+  if (slab->nfaces >= slab->maxfaces) {
+    slab->maxfaces=MAX(2*slab->maxfaces,2048);
+    slab->face=(int*)realloc(slab->face,3*slab->maxfaces*sizeof(int));
+    if (!slab->face)
+      ErrorExit(ERROR_NOMEMORY, "%s: could not allocate %d faces",
+                Progname,slab->maxfaces) ;
+  }
+  slab->face[3*slab->nfaces]=v0;
+  slab->face[3*slab->nfaces+1]=v1;
+  slab->face[3*slab->nfaces+2]=v2;
+  slab->nfaces++;
 }
 
-
-int saveTesselation2(tesselation_parms *parms) {
-  int vno,m,n,fno;
-  int nVFMultiplier=1;
-  quad_face_type *face2;
-  quad_vertex_type *vertex2;
+int saveTesselation2(tesselation_parms *parms, mc_slab *slabs, int nslabs) {
+  int vno,m,n,fno,s,nvertices,nfaces;
   MRIS* mris;
   FACE *face;
   float x, y, z, xhi, xlo, yhi, ylo, zhi, zlo ;
-  float st,ps,xx1,yy0,zz1;
-  float j,i,imnr;
-  double xw,yw,zw;
 
-  /*necessary for the coord transformation*/
-  ps=parms->mri->ps;
-  st=parms->mri->thick;
-
-  yy0=parms->mri->ystart;
-  xx1=parms->mri->xend;
-  zz1=parms->mri->zend;
+  nvertices=nfaces=0;
+  for (s=0;s<nslabs;s++) {
+    slabs[s].voffset=nvertices;
+    slabs[s].foffset=nfaces;
+    nvertices+=slabs[s].nvertices;
+    nfaces+=slabs[s].nfaces;
+  }
 
-  mris=MRISoverAlloc(nVFMultiplier*parms->vertex_index,nVFMultiplier*parms->face_index
-                     ,parms->vertex_index,parms->face_index);
+  mris=MRISoverAlloc(nvertices,nfaces,nvertices,nfaces);
 
   MRIScopyVolGeomFromMRI(mris, parms->mri) ;
   fprintf(stderr,"\n(surface with %d faces and %d vertices)...",
-          parms->face_index,parms->vertex_index);
+          nfaces,nvertices);
 
   mris->type=MRIS_TRIANGULAR_SURFACE;
-  /*first init vertices*/
-  for (vno=0;vno<mris->nvertices;vno++) {
-    VERTEX_TOPOLOGY* const vertext = &mris->vertices_topology[vno] ;
-
-    vertex2= &parms->vertex[vno];
-    i=vertex2->i;
-    j=vertex2->j;
-    imnr=vertex2->imnr;
-
-    //      x = xx1-(j-0.5)*ps;
-    //y = yy0+(imnr-0.5)*st;
-    //z = zz1-(i-0.5)*ps;
-
-    MRISsurfaceRASFromVoxelCached(mris, parms->mri, i, j, imnr, &xw, &yw,&zw);
-    //    MRIvoxelToWorld(parms->mri,i,j,imnr,&xw,&yw,&zw);
-    x=xw;
-    y=yw;
-    z=zw;
-
-    MRISsetXYZ(mris, vno,
-      x,
-      y,
-      z);
-    vertext->num=0;
+  /*the vertices and faces of each slab go straight into the surface*/
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic,1)
+#endif
+  for (s=0;s<nslabs;s++) {
+    ROMP_PFLB_begin
+    mc_slab *slab=&slabs[s];
+    for (int i=0;i<slab->nvertices;i++) {
+      int const vno=slab->voffset+i;
+      double xw,yw,zw;
+
+      MRISsurfaceRASFromVoxelCached(mris, parms->mri,
+                                    slab->vertex[3*i], slab->vertex[3*i+1],
+                                    slab->vertex[3*i+2], &xw, &yw, &zw);
+      MRISsetXYZ(mris, vno, xw, yw, zw);
+      mris->vertices_topology[vno].num=0;
+    }
+    for (int f=0;f<slab->nfaces;f++)
+      for (int p=0;p<VERTICES_PER_FACE;p++) {
+        int v=slab->face[3*f+p];
+        if (v >= 0)
+          v+=slab->voffset;
+        else if (v < -1) {
+          /*weld to the vertex created by the slab below*/
+          v=slabs[s-1].top[-2-v];
+          if (v >= 0) v+=slabs[s-1].voffset;
+        }
+        mris->faces[slab->foffset+f].v[p]=v;
+      }
+    ROMP_PFLB_end
   }
-  /*then init faces*/
-  for (m = 0 ; m < parms->face_index ; m ++) {
-
-    face2=&parms->face[m];
+  ROMP_PF_end
 
-    mris->faces[m].v[0] = face2->v[0] ;
-    mris->faces[m].v[1] = face2->v[1] ;
-    mris->faces[m].v[2] = face2->v[2] ;
+  for (m = 0 ; m < mris->nfaces ; m ++)
     for (n = 0 ; n < VERTICES_PER_FACE ; n++)
       mris->vertices_topology[mris->faces[m].v[n]].num++;
-  }
 
   /*allocate indices & faces for each vertex*/
   for (vno = 0 ; vno< mris->nvertices ; vno++) {
@@ -546,30 +336,21 @@ int saveTesselation2(tesselation_parms *parms) {
   return(NO_ERROR) ;
 }
 
-void generateMCtesselation(tesselation_parms * parms) {
+/*marching cubes over the cubes of one slab*/
+static void generateMCslab(tesselation_parms *parms, MRI *mri,
+                           int (*MC)[19], mc_slab *slab) {
   int i,j,k,width,imgsize,*tab1,*tab2,ref,ind,nf,p;
-  int xmin,ymin,zmin,xmax,ymax,zmax;
+  int xmin,ymin,xmax,ymax;
   int vt[12],*vk1,*vk2,*vj1,*vj2,*tmp;
   int f_c[12],vind[12];
-  MRI *mri;
-  int vertex_index;
-  int debug=0;
-
-  fprintf(stderr,"\npreprocessing...");
-  mri=preprocessingStep(parms);
-  allocateTesselation(parms);
-  fprintf(stderr,"done\n");
 
   width=mri->width;
   imgsize=mri->width*mri->height;
 
-
   xmin=parms->xmin;
   ymin=parms->ymin;
-  zmin=parms->zmin;
   xmax=parms->xmax;
   ymax=parms->ymax;
-  zmax=parms->zmax;
 
   tab1=(int*)calloc(imgsize,sizeof(int));
   tab2=(int*)calloc(imgsize,sizeof(int));
@@ -579,6 +360,8 @@ void generateMCtesselation(tesselation_parms * parms) {
   vk2=(int*)calloc(2*imgsize,sizeof(int));
   vj1=(int*)calloc(width,sizeof(int));
   vj2=(int*)calloc(width,sizeof(int));
+  if (!tab1 || !tab2 || !vk1 || !vk2 || !vj1 || !vj2)
+    ErrorExit(ERROR_NOMEMORY, "%s: could not allocate slab tables",Progname) ;
 
   f_c[0]=0;
   f_c[1]=1;
@@ -593,11 +376,31 @@ void generateMCtesselation(tesselation_parms * parms) {
   f_c[6]=0;
   f_c[7]=1;
 
-  fprintf(stderr,"starting generation of surface...");
+  if (slab->kmin > parms->zmin) {
+    /*the bottom plane was done by the slab below: remember its edge keys
+      and recompute the configuration of its voxels*/
+    for (ind=0;ind<2*imgsize;ind++)
+      vk1[ind]=-2-ind;
+    memset(vk2,-1,2*imgsize*sizeof(int));
+    memset(vj1,-1,width*sizeof(int));
+    memset(vj2,-1,width*sizeof(int));
+    k=slab->kmin;
+    for (j=ymin;j<ymax;j++)
+      for (i=xmin;i<xmax;i++) {
+        ref=0;
+        if (MRIvox(mri,i,j,k))
+          ref+=1;
+        if (((i+1)<mri->width) && MRIvox(mri,i+1,j,k))
+          ref+=2;
+        if (((j+1)<mri->height) && MRIvox(mri,i,j+1,k))
+          ref+=4;
+        if (((j+1)<mri->height) && ((i+1)<mri->width) && MRIvox(mri,i+1,j+1,k))
+          ref+=8;
+        tab1[i+width*j]=ref;
+      }
+  }
 
-  for (k=zmin;k<zmax;k++) {
-    if (!(k % 10))
-      fprintf(stderr,"\n   slice nb %d...",k);
+  for (k=slab->kmin;k<slab->kmax;k++) {
     for (j=ymin;j<ymax;j++) {
       for (i=xmin;i<xmax;i++) {
 
@@ -609,54 +412,23 @@ void generateMCtesselation(tesselation_parms * parms) {
           ref+=32;
         if (((k+1)<mri->depth) && ((j+1)<mri->height) && MRIvox(mri,i,j+1,k+1))
           ref+=64;
-        if (((k+1)<mri->depth) && 
-            ((j+1)<mri->height) && 
-            ((i+1)<mri->width) && 
+        if (((k+1)<mri->depth) &&
+            ((j+1)<mri->height) &&
+            ((i+1)<mri->width) &&
             MRIvox(mri,i+1,j+1,k+1))
           ref+=128;
 
         tab2[ind]=(ref/16);
         ref+=tab1[ind]; //this is the indice of the cube
 
-
         nf=0;
-        switch (parms->connectivity) {
-        case 1:
-          while (MC6p[ref][3*nf]>=0) nf++;
-          break;
-        case 2:
-          while (MC18[ref][3*nf]>=0) nf++;
-          break;
-        case 3:
-          while (MC6[ref][3*nf]>=0) nf++;
-          break;
-        default:
-          while (MC26[ref][3*nf]>=0) nf++;
-          break;
-        }
+        while (MC[ref][3*nf]>=0) nf++;
         if (nf==0) continue;
-        //fprintf(stderr,"\n %d %d. ",j,i);
-        //fprintf(stderr," ref=%d, ind=%d,",ref,ind);
-        //fprintf(stderr,"%d face(s)\n",nf);
 
         memset(vt,0,12*sizeof(int));
         memset(vind,0,12*sizeof(int));
 
-        switch (parms->connectivity) {
-        case 1:
-          for (p=0;p<3*nf;p++) vt[MC6p[ref][p]]++;
-          break;
-        case 2:
-          for (p=0;p<3*nf;p++) vt[MC18[ref][p]]++;
-          break;
-        case 3:
-          for (p=0;p<3*nf;p++) vt[MC6[ref][p]]++;
-          break;
-        default:
-          for (p=0;p<3*nf;p++) vt[MC26[ref][p]]++;
-          break;
-        }
-
+        for (p=0;p<3*nf;p++) vt[MC[ref][p]]++;
 
         //find references of vertices and eventually allocate them!
         for (p=0;p<4;p++) //find the vertex number
@@ -666,101 +438,32 @@ void generateMCtesselation(tesselation_parms * parms) {
           if (vt[p])
             vind[p]=vj1[i+f_c[p]];
         if (vt[6])         //already created
-        {
           vind[6]=vj2[i];
-        }
         if (vt[7]) //create a new vertex number and save it into v7 and vj2
         {
-          vertex_index=parms->vertex_index;
-          //fprintf(stderr,"c(7):%d- ",vertex_index);
-          if (vertex_index >= parms->maxvertices-1)
-            reallocateVertices(parms);
-          vind[7]=vertex_index;
-          parms->vertex[vertex_index].imnr = k+0.5;
-          parms->vertex[vertex_index].i = i+1;
-          parms->vertex[vertex_index].j = j+1;
-          parms->vertex[vertex_index].num = 0;
-          vj2[i+1]=vertex_index;
-          parms->vertex_index++;
-
-          //     printf(stderr," !!!!*!!! ");
+          vind[7]=addSlabVertex(slab,i+1,j+1,k+0.5);
+          vj2[i+1]=vind[7];
         }
         if (vt[8]) //already created
-        {
           vind[8]=vk2[2*ind+f_c[8]];
-        }
         if (vt[9]) //already created
-        {
           vind[9]=vk2[2*ind+f_c[9]];
-        }
         if (vt[10]) //create a new vertex number and save it into vk2
         {
-          vertex_index=parms->vertex_index;
-          //fprintf(stderr,"c(10):%d- ",vertex_index);
-          if (vertex_index >= parms->maxvertices-1)
-            reallocateVertices(parms);
-          vind[10]=vertex_index;
-          parms->vertex[vertex_index].imnr = k+1;
-          parms->vertex[vertex_index].i = i+0.5;
-          parms->vertex[vertex_index].j = j+1;
-          parms->vertex[vertex_index].num = 0;
-          vk2[2*ind+f_c[10]]=vertex_index;
-          parms->vertex_index++;
+          vind[10]=addSlabVertex(slab,i+0.5,j+1,k+1);
+          vk2[2*ind+f_c[10]]=vind[10];
         }
         if (vt[11]) //create a new vertex number and save it into vk2
         {
-          vertex_index=parms->vertex_index;
-          //fprintf(stderr,"c(11):%d- ",vertex_index);
-          if (vertex_index >= parms->maxvertices-1)
-            reallocateVertices(parms);
-          vind[11]=vertex_index;
-          parms->vertex[vertex_index].imnr = k+1;
-          parms->vertex[vertex_index].i = i+1;
-          parms->vertex[vertex_index].j = j+0.5;
-          parms->vertex[vertex_index].num = 0;
-          vk2[2*ind+f_c[11]]=vertex_index;
-          parms->vertex_index++;
+          vind[11]=addSlabVertex(slab,i+1,j+0.5,k+1);
+          vk2[2*ind+f_c[11]]=vind[11];
         }
         //now create faces
-        for (p=0;p<nf;p++) {
-          int face_index=parms->face_index;
-          if (face_index >= parms->maxfaces-1)
-            reallocateFaces(parms);
-
-          switch (parms->connectivity) {
-          case 1:
-            parms->face[face_index].v[0] = vind[MC6p[ref][3*p]];
-            parms->face[face_index].v[1] = vind[MC6p[ref][3*p+1]];
-            parms->face[face_index].v[2] = vind[MC6p[ref][3*p+2]];
-            break;
-          case 2:
-            parms->face[face_index].v[0] = vind[MC18[ref][3*p]];
-            parms->face[face_index].v[1] = vind[MC18[ref][3*p+1]];
-            parms->face[face_index].v[2] = vind[MC18[ref][3*p+2]];
-            break;
-          case 3:
-            parms->face[face_index].v[0] = vind[MC6[ref][3*p]];
-            parms->face[face_index].v[1] = vind[MC6[ref][3*p+1]];
-            parms->face[face_index].v[2] = vind[MC6[ref][3*p+2]];
-            break;
-          default:
-            parms->face[face_index].v[0] = vind[MC26[ref][3*p]];
-            parms->face[face_index].v[1] = vind[MC26[ref][3*p+1]];
-            parms->face[face_index].v[2] = vind[MC26[ref][3*p+2]];
-            break;
-          }
-          parms->face_index++;
-        }
-        //fprintf(stderr,"%d %d,",parms->face_index,parms->vertex_index);
-        //fprintf(stderr,"?");
-
-        //fprintf(stderr,"\n ");
-        //for(p=0;p<12;p++) fprintf(stderr,": p=%d vt=%d v=%d ",
-        //p,vt[p],vind[p]);
-
-        if (debug)
-          pause();
-
+        for (p=0;p<nf;p++)
+          addSlabFace(slab,
+                      vind[MC[ref][3*p]],
+                      vind[MC[ref][3*p+1]],
+                      vind[MC[ref][3*p+2]]);
       }
       tmp=vj1;
       vj1=vj2;
@@ -778,15 +481,75 @@ void generateMCtesselation(tesselation_parms * parms) {
     memset(vk2,-1,2*imgsize*sizeof(int));
 
   }
+  slab->top=vk1;
   free(tab1);
   free(tab2);
   free(vj1);
   free(vj2);
-  free(vk1);
   free(vk2);
+}
+
+void generateMCtesselation(tesselation_parms * parms) {
+  int s,nslabs=1,nk;
+  int (*MC)[19];
+  mc_slab *slabs;
+  MRI *mri;
+
+  fprintf(stderr,"\npreprocessing...");
+  mri=preprocessingStep(parms);
+  fprintf(stderr,"done\n");
+
+  switch (parms->connectivity) {
+  case 1:
+    MC=MC6p;
+    break;
+  case 2:
+    MC=MC18;
+    break;
+  case 3:
+    MC=MC6;
+    break;
+  default:
+    MC=MC26;
+    break;
+  }
+
+  nk=parms->zmax-parms->zmin;
+#ifdef HAVE_OPENMP
+  nslabs=omp_get_max_threads();
+#endif
+  if (nslabs > nk) nslabs=MAX(nk,1);
+  slabs=(mc_slab*)calloc(nslabs,sizeof(mc_slab));
+  if (!slabs)
+    ErrorExit(ERROR_NOMEMORY, "%s: could not allocate %d slabs",
+              Progname,nslabs) ;
+  for (s=0;s<nslabs;s++) {
+    slabs[s].kmin=parms->zmin+(long long)s*nk/nslabs;
+    slabs[s].kmax=parms->zmin+(long long)(s+1)*nk/nslabs;
+  }
+
+  fprintf(stderr,"starting generation of surface (%d slabs)...",nslabs);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(dynamic,1)
+#endif
+  for (s=0;s<nslabs;s++) {
+    ROMP_PFLB_begin
+    generateMCslab(parms,mri,MC,&slabs[s]);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
   MRIfree(&mri);
   fprintf(stderr,"\nconstructing final surface...");
-  saveTesselation2(parms);
+  saveTesselation2(parms,slabs,nslabs);
+  for (s=0;s<nslabs;s++) {
+    free(slabs[s].vertex);
+    free(slabs[s].face);
+    free(slabs[s].top);
+  }
+  free(slabs);
   fprintf(stderr,"done\n");
 }
 
@@ -867,14 +630,12 @@ int main(int argc, char *argv[]) {
   if (argc==5) parms->connectivity=atoi(argv[4]);//connectivity;
   else parms->connectivity=1;
 
-  initTesselationParms(parms);
-
   generateMCtesselation(parms);
 
   free(parms->label_values);
   mris=parms->mris_table[0];
   free(parms->mris_table);
-  freeTesselationParms(&parms);
+  free(parms);
 
   {
     float dist,max_e=0.0;
@@ -101,6 +101,7 @@ double round(double x);
 #include "volcluster.h"
 #include "surfcluster.h"
 #include "randomfields.h"
+#include "romp_support.h"
 
 static int  parse_commandline(int argc, char **argv);
 static void check_options(void);
@@ -110,6 +111,9 @@ static void print_help(void) ;
 static void print_version(void) ;
 static void dump_options(FILE *fp);
 int SaveOutput(void);
+static void SimFrame(MRI *zbatch, int frame, int nthFWHM, int rep, RFS *rfs, double avgvtxarea);
+static int WriteCheckpoint(const char *fname);
+static int ReadCheckpoint(const char *fname, int LoadData);
 int main(int argc, char *argv[]) ;
 
 const char *Progname = NULL;
@@ -140,13 +144,18 @@ char *SaveFile = NULL;
 int SaveMask = 1;
 int UseAvgVtxArea = 0;
 int SaveEachIter = 0;
+int nBatch = 32;
+char *CheckpointFile = NULL;
+int Resume = 0;
+int msecPrev = 0;
 
 CSD *csdList[100][100][3], *csd;
 MRI *mask=NULL;
 MRIS *surf;
 char tmpstr[2000];
 const char *signstr=NULL;
-int msecTime, nmask, nmaskout, nthRep;
+int msecTime, nmask, nmaskout, nthRep, *maskoutvtxno;
+unsigned char *MaskHalf, *MaskInt;
 int *nSmoothsList;
 double fwhmmax=30;
 int SaveWeight=0;
@@ -154,23 +163,20 @@ int FixFSALH = 1;
 
 /*---------------------------------------------------------------*/
 int main(int argc, char *argv[]) {
-  int nargs, n, err,k, *maskoutvtxno;
+  int nargs, n, err,k, nb;
   char tmpstr[2000], *SUBJECTS_DIR, fname[2000];
   const char *signstr = NULL; // Is this intended to mask the global?
   //char *OutDir = NULL;
   RFS *rfs;
   int nSmoothsPrev, nSmoothsDelta;
-  MRI *z, *zabs=NULL, *sig=NULL, *p=NULL;
+  MRI *z, *zbatch;
+  MRIS_SMOOTH_OP *smoothop;
   int FreeMask = 0;
   int nthSign, nthFWHM, nthThresh;
-  double sigmax, zmax, threshadj, csize, csizeavg, cweightvtx, searchspace,avgvtxarea;
-  int csizen;
-  int nClusters, cmax,rmax,smax;
-  SURFCLUSTERSUM *SurfClustList;
+  double searchspace,avgvtxarea;
   Timer mytimer;
   LABEL *clabel;
   FILE *fp, *fpLog=NULL;
-  float **ppVal, **ppSig, **ppVal0, **ppSig0, **ppZ, **ppZ0;
 
   nargs = handleVersionOption(argc, argv, "mri_mcsim");
   if (nargs && argc - nargs == 1) exit (0);
@@ -199,6 +205,10 @@ int main(int argc, char *argv[]) {
     dump_options(fpLog);
   } 
 
+  if(Resume && fio_FileExistsReadable(CheckpointFile)){
+    // Continue with the seed of the interrupted run
+    if(ReadCheckpoint(CheckpointFile,0)) exit(1);
+  }
   if(SynthSeed < 0) SynthSeed = PDFtodSeed();
   srand48(SynthSeed);
 
@@ -224,7 +234,7 @@ int main(int argc, char *argv[]) {
 	if( req >= STRLEN ) {
 	  std::cerr << __FUNCTION__ << ": Truncation on line " << __LINE__ << std::endl;
 	}
-	if(fio_FileExistsReadable(fname)){
+	if(fio_FileExistsReadable(fname) && !(Resume && fio_FileExistsReadable(CheckpointFile))){
 	  printf("ERROR: output file %s exists\n",fname);
 	  if(fpLog) fprintf(fpLog,"ERROR: output file %s exists\n",fname);
           exit(1);
@@ -359,15 +369,16 @@ int main(int argc, char *argv[]) {
     fprintf(fp,"%5.1f %4d\n",FWHMList[nthFWHM],nSmoothsList[nthFWHM]);
   fclose(fp);
 
-  // Alloc the z and sig maps
-  z   = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, 1);
-  sig = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, 1);
+  // Alloc the batch of z maps, one realization per frame
+  z = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, 1);
+  zbatch = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, nBatch);
 
   // Set up the random field specification
   rfs = RFspecInit(SynthSeed,NULL);
   rfs->name = strcpyalloc("gaussian");
   rfs->params[0] = 0;
   rfs->params[1] = 1;
+  RFexpectedMeanStddev(rfs); // used by the rescaling
 
   printf("Thresholds (%d): ",nThreshList);
   for(n=0; n < nThreshList; n++) printf("%5.2f ",ThreshList[n]);
@@ -379,35 +390,54 @@ int main(int argc, char *argv[]) {
   for(n=0; n < nFWHMList; n++) printf("%5.2f ",FWHMList[n]);
   printf("\n");
 
-  // Set up pointer to the val field
-  ppVal = (float **) calloc(surf->nvertices,sizeof(float *));
-  ppVal0 = ppVal;
-  ppSig = (float **) calloc(surf->nvertices,sizeof(float *));
-  ppSig0 = ppSig;
-  ppZ = (float **) calloc(surf->nvertices,sizeof(float *));
-  ppZ0 = ppZ;
+  // The smoothing operator is applied to the whole batch at once
+  smoothop = MRISsmoothOpBuild(surf, mask);
+  if(smoothop == NULL) exit(1);
+
+  // Mask tests as done by the routines the simulation used to call
+  MaskHalf = (unsigned char *) calloc(surf->nvertices,sizeof(unsigned char));
+  MaskInt  = (unsigned char *) calloc(surf->nvertices,sizeof(unsigned char));
   for(k=0; k < surf->nvertices; k++){
-    ppVal[k] = &(surf->vertices[k].val);
-    ppSig[k] = &(MRIFseq_vox(sig,k,0,0,0));
-    ppZ[k] = &(MRIFseq_vox(z,k,0,0,0));
+    double m = mask ? MRIgetVoxVal(mask,k,0,0,0) : 1;
+    MaskHalf[k] = (m >= 0.5);    // MRIframeMax()
+    MaskInt[k]  = ((int)m != 0); // RFrescale(), RFstat2P()
+  }
+
+  nthRep = 0;
+  if(Resume && fio_FileExistsReadable(CheckpointFile)){
+    if(ReadCheckpoint(CheckpointFile,1)) exit(1);
+    // Draw the fields of the repetitions already done so that the
+    // rest of the run sees the same random numbers as a single run
+    printf("Resuming after %d repetitions\n",nthRep);
+    if(fpLog) fprintf(fpLog,"Resuming after %d repetitions\n",nthRep);
+    for(n=0; n < nthRep; n++) RFsynth(z,rfs,mask);
   }
 
   // Start the simulation loop
-  printf("\n\nStarting Simulation over %d Repetitions\n",nRepetitions);
+  printf("\n\nStarting Simulation over %d Repetitions (batches of %d)\n",nRepetitions,nBatch);
   if(fpLog) fprintf(fpLog,"\n\nStarting Simulation over %d Repetitions\n",nRepetitions);
   mytimer.reset() ;
-  for(nthRep = 0; nthRep < nRepetitions; nthRep++){
-    msecTime = mytimer.milliseconds() ;
+  while(nthRep < nRepetitions){
+    msecTime = msecPrev + mytimer.milliseconds() ;
     printf("%5d %7.2f ",nthRep,(msecTime/1000.0)/60);
     fflush(stdout);
     if(fpLog) {
       fprintf(fpLog,"%5d %7.1f ",nthRep,(msecTime/1000.0)/60);
       fflush(fpLog);
     }
-    // Synthesize an unsmoothed z map
-    RFsynth(z,rfs,mask); 
+    nb = MIN(nBatch, nRepetitions-nthRep);
+    if(zbatch->nframes != nb){
+      MRIfree(&zbatch);
+      zbatch = MRIallocSequence(surf->nvertices, 1,1, MRI_FLOAT, nb);
+    }
+    // Synthesize the unsmoothed z maps, one realization at a time so
+    // that the random numbers do not depend on the batch size
+    for(n=0; n < nb; n++){
+      RFsynth(z,rfs,mask);
+      memcpy(&MRIFseq_vox(zbatch,0,0,0,n), &MRIFseq_vox(z,0,0,0,0), surf->nvertices*sizeof(float));
+    }
     nSmoothsPrev = 0;
-    
+
     // Loop through FWHMs
     for(nthFWHM=0; nthFWHM < nFWHMList; nthFWHM++){
       printf("%d ",nthFWHM);
@@ -418,78 +448,25 @@ int main(int argc, char *argv[]) {
       }
       nSmoothsDelta = nSmoothsList[nthFWHM] - nSmoothsPrev;
       nSmoothsPrev = nSmoothsList[nthFWHM];
-      // Incrementally smooth z
-      MRISsmoothMRIFastFrame(surf, z, 0, nSmoothsDelta, mask);
-      // Rescale
-      RFrescale(z,rfs,mask,z);
-      // Slightly tortured way to get the right p-values because
-      //   RFstat2P() computes one-sided, but I handle sidedness
-      //   during thresholding.
-      // First, use zabs to get a two-sided pval bet 0 and 0.5
-      zabs = MRIabs(z,zabs);
-      p = RFstat2P(zabs,rfs,mask,0,p);
-      // Next, mult pvals by 2 to get two-sided bet 0 and 1
-      MRIscalarMul(p,p,2.0);
-      sig = MRIlog10(p,NULL,sig,1); // sig = -log10(p)
-
-      for(nthSign = 0; nthSign < nSignList; nthSign++){
-	csd = csdList[nthFWHM][0][nthSign]; // just need csd->threshsign
-
-	// If test is not ABS then apply the sign
-	if(csd->threshsign != 0) MRIsetSign(sig,z,0);
-
-	// Get the max stats
-	sigmax = MRIframeMax(sig,0,mask,csd->threshsign,
-			     &cmax,&rmax,&smax);
-	zmax = MRIgetVoxVal(z,cmax,rmax,smax,0);
-	if(csd->threshsign == 0){
-	  zmax = fabs(zmax);
-	  sigmax = fabs(sigmax);
-	}
-	// Mask
-	if(mask) {
-	  //MRImask(sig,mask,sig,0.0,0.0); // a little slow
-	  for(k=0; k < nmaskout; k++) MRIsetVoxVal(sig, maskoutvtxno[k],0,0,0, 0.0);
-	}
-
-	// Copy sig to vertexval
-	//MRIScopyMRI(surf, sig, 0, "val"); // MRIScopyMRI() is a little slow
-	ppVal = ppVal0;
-	ppSig = ppSig0;
-	for(k=0; k < surf->nvertices; k++) *(*ppVal++) = *(*ppSig++);
-
-	for(nthThresh = 0; nthThresh < nThreshList; nthThresh++){
-	  csd = csdList[nthFWHM][nthThresh][nthSign];
-
-	  // Surface clustering
-	  // Set the threshold
-	  if(csd->threshsign == 0) threshadj = csd->thresh;
-	  else threshadj = csd->thresh - log10(2.0); // one-sided test
-	  // Compute clusters
-	  SurfClustList = sclustMapSurfClusters(surf,threshadj,-1,csd->threshsign,
-						0,&nClusters,NULL,NULL);
-	  // Actual area of cluster with max area
-	  csize  = sclustMaxClusterArea(SurfClustList, nClusters);
-	  // Number of vertices of cluster with max number of vertices. 
-	  // Note: this may be a different cluster from above!
-	  csizen = sclustMaxClusterCount(SurfClustList, nClusters);
-	  cweightvtx = sclustMaxClusterWeightVtx(SurfClustList, nClusters, csd->threshsign);
-	  // Area of this cluster based on average vertex area. This just scales
-	  // the number of vertices.
-	  csizeavg = csizen * avgvtxarea;
-	  if(UseAvgVtxArea) csize = csizeavg;
-	  // Store results
-	  csd->nClusters[nthRep] = nClusters;
-	  csd->MaxClusterSize[nthRep] = csize;
-	  csd->MaxClusterSizeVtx[nthRep] = csizen;
-	  csd->MaxClusterWeightVtx[nthRep] = cweightvtx;
-	  csd->MaxSig[nthRep] = sigmax;
-	  csd->MaxStat[nthRep] = zmax;
-	} // Sign
-      } // Thresh
+      // Incrementally smooth all realizations
+      MRISsmoothOpApply(smoothop, zbatch, nSmoothsDelta, zbatch);
+      // Rescale, threshold and cluster each realization
+      ROMP_PF_begin
+      #ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(shown_reproducible)
+      #endif
+      for(int nthFrame=0; nthFrame < nb; nthFrame++){
+	ROMP_PFLB_begin
+	SimFrame(zbatch, nthFrame, nthFWHM, nthRep+nthFrame, rfs, avgvtxarea);
+	ROMP_PFLB_end
+      }
+      ROMP_PF_end
     } // FWHM
+    nthRep += nb;
     printf("\n");
     if(fpLog) fprintf(fpLog,"\n");
+    msecTime = msecPrev + mytimer.milliseconds() ;
+    if(CheckpointFile) WriteCheckpoint(CheckpointFile);
     if(SaveEachIter || fio_FileExistsReadable(SaveFile)) SaveOutput();
     if(fio_FileExistsReadable(StopFile)) {
       printf("Found stop file %s\n",StopFile);
@@ -501,7 +478,7 @@ int main(int argc, char *argv[]) {
 
   SaveOutput();
 
-  msecTime = mytimer.milliseconds() ;
+  msecTime = msecPrev + mytimer.milliseconds() ;
   printf("Total Sim Time %g min (%g per rep)\n",
 	 msecTime/(1000*60.0),(msecTime/(1000*60.0))/nthRep);
   if(fpLog) fprintf(fpLog,"Total Sim Time %g min (%g per rep)\n",
@@ -591,6 +568,26 @@ static int parse_commandline(int argc, char **argv) {
     else if (!strcasecmp(option, "--save-iter")) {
       SaveEachIter = 1;
     } 
+    else if (!strcasecmp(option, "--checkpoint")) {
+      if(nargc < 1) CMDargNErr(option,1);
+      CheckpointFile = pargv[0];
+      nargsused = 1;
+    } 
+    else if (!strcasecmp(option, "--resume")) Resume = 1;
+    else if (!strcasecmp(option, "--batch")) {
+      if(nargc < 1) CMDargNErr(option,1);
+      sscanf(pargv[0],"%d",&nBatch);
+      nargsused = 1;
+    } 
+    else if(!strcasecmp(option, "--threads") || !strcasecmp(option, "--nthreads") ){
+      if(nargc < 1) CMDargNErr(option,1);
+      int nthreads=1;
+      sscanf(pargv[0],"%d",&nthreads);
+      #ifdef _OPENMP
+      omp_set_num_threads(nthreads);
+      #endif
+      nargsused = 1;
+    } 
     else if (!strcasecmp(option, "--no-save-iter")) {
       SaveEachIter = 0;
     } 
@@ -711,7 +708,11 @@ static void print_usage(void) {
   printf("   --done DoneFile : will create DoneFile when finished\n");
   printf("   --stop stopfile : default is ourdir/mri_mcsim.stop \n");
   printf("   --save savefile : default is ourdir/mri_mcsim.save \n");
-  printf("   --save-iter : save output after each iteration \n");
+  printf("   --save-iter : save output after each iteration (batch)\n");
+  printf("   --checkpoint ckptfile : save the state after each batch (default outdir/base.ckpt with --resume)\n");
+  printf("   --resume : continue the run saved in the checkpoint, if it exists\n");
+  printf("   --batch nbatch : number of realizations simulated together (default %d)\n",nBatch);
+  printf("   --threads nthreads\n");
   printf("   --sd SUBJECTS_DIR\n");
   printf("   --debug     turn on debugging\n");
   printf("   --checkopts don't run anything, just check options and exit\n");
@@ -832,6 +833,14 @@ static void check_options(void) {
     sprintf(tmpstr,"%s/mri_mcsim.save",OutTop);
     SaveFile = strcpyalloc(tmpstr);
   }
+  if(Resume && CheckpointFile == NULL) {
+    sprintf(tmpstr,"%s/%s.ckpt",OutTop,csdbase);
+    CheckpointFile = strcpyalloc(tmpstr);
+  }
+  if(nBatch < 1) {
+    printf("ERROR: batch size must be at least 1\n");
+    exit(1);
+  }
 
   return;
 }
@@ -858,6 +867,9 @@ static void dump_options(FILE *fp) {
   fprintf(fp,"UseAvgVtxArea %d\n",UseAvgVtxArea);
   fprintf(fp,"SaveFile %s\n",SaveFile);
   fprintf(fp,"StopFile %s\n",StopFile);
+  if(CheckpointFile) fprintf(fp,"CheckpointFile %s\n",CheckpointFile);
+  fprintf(fp,"Resume %d\n",Resume);
+  fprintf(fp,"nBatch %d\n",nBatch);
   fprintf(fp,"UFSS %s\n",getenv("USE_FAST_SURF_SMOOTHER"));
   fflush(fp);
   return;
@@ -906,3 +918,253 @@ int SaveOutput(void)
   return(0);
 }
 
+
+/*---------------------------------------------------------------
+  SimFrame() - processes one realization (a frame of zbatch that has
+  been smoothed to the nthFWHM level): rescales it in place, converts
+  it to a signed -log10(p) map and stores the max stats and the max
+  cluster stats for each sign and threshold as the rep-th entry of
+  the CSDs. This follows exactly what RFrescale(), RFstat2P(),
+  MRIlog10(), MRIsetSign(), MRIframeMax() and sclustMapSurfClusters()
+  did to a single realization, but only touches this frame and the
+  rep-th CSD entries so the frames can be processed in parallel.
+  ---------------------------------------------------------------*/
+static void SimFrame(MRI *zbatch, int frame, int nthFWHM, int rep, RFS *rfs, double avgvtxarea)
+{
+  int k, nv, nthSign, nthThresh, kmax, nhits, nClusters, csizen;
+  double v, sum, sumsq, gmean, gstddev, vmax, sigmax, zmax, threshadj, csize;
+  float *z, *sig, p, cweightvtx;
+  long nsum;
+  CSD *csd;
+
+  nv = surf->nvertices;
+  z = &MRIFseq_vox(zbatch,0,0,0,frame);
+  sig = (float *) calloc(nv,sizeof(float));
+
+  // Rescale to the expected mean and stddev
+  nsum = 0;
+  sum = 0;
+  sumsq = 0;
+  for(k=0; k < nv; k++){
+    if(!MaskInt[k]) continue;
+    v = z[k];
+    sum += v;
+    sumsq += (v*v);
+    nsum++;
+  }
+  gmean = sum/nsum;
+  gstddev = sqrt(sumsq/nsum - gmean*gmean);
+  for(k=0; k < nv; k++){
+    if(!MaskInt[k]) continue;
+    v = z[k];
+    z[k] = (v - gmean) * (rfs->stddev / gstddev) + rfs->mean;
+  }
+
+  // Two-sided p (0 outside of the mask), then sig = -log10(p)
+  for(k=0; k < nv; k++){
+    p = 0;
+    if(MaskInt[k]) p = RFstat2PVal(rfs,fabs(z[k]));
+    p = p * 2.0f;
+    if(p == 0) sig[k] = 10000000000.0;
+    else       sig[k] = -log10((double)p);
+  }
+
+  for(nthSign = 0; nthSign < nSignList; nthSign++){
+    csd = csdList[nthFWHM][0][nthSign]; // just need csd->threshsign
+    int threshsign = csd->threshsign;
+
+    // If test is not ABS then apply the sign
+    if(threshsign != 0){
+      for(k=0; k < nv; k++){
+	if(z[k] < 0.0) sig[k] = -1.0 * fabs(sig[k]);
+	if(z[k] > 0.0) sig[k] = +1.0 * fabs(sig[k]);
+      }
+    }
+
+    // Get the max stats
+    nhits = -1;
+    vmax = 0;
+    kmax = 0;
+    for(k=0; k < nv; k++){
+      if(!MaskHalf[k]) continue;
+      nhits++;
+      v = sig[k];
+      if(nhits == 0 ||
+	 (threshsign ==  0 && fabs(vmax) < fabs(v)) ||
+	 (threshsign == +1 && vmax < v) ||
+	 (threshsign == -1 && vmax > v)){
+	vmax = v;
+	kmax = k;
+      }
+    }
+    sigmax = vmax;
+    zmax = z[kmax];
+    if(threshsign == 0){
+      zmax = fabs(zmax);
+      sigmax = fabs(sigmax);
+    }
+    // Mask
+    if(mask) for(k=0; k < nmaskout; k++) sig[maskoutvtxno[k]] = 0.0;
+
+    for(nthThresh = 0; nthThresh < nThreshList; nthThresh++){
+      csd = csdList[nthFWHM][nthThresh][nthSign];
+      if(csd->threshsign == 0) threshadj = csd->thresh;
+      else threshadj = csd->thresh - log10(2.0); // one-sided test
+      // Max cluster area, max number of vertices (may be a different
+      // cluster) and max weight
+      sclustMaxClusterStats(surf, sig, threshadj, -1, csd->threshsign,
+			    &nClusters, &csize, &csizen, &cweightvtx);
+      // Area based on average vertex area. This just scales the
+      // number of vertices.
+      if(UseAvgVtxArea) csize = csizen * avgvtxarea;
+      csd->nClusters[rep] = nClusters;
+      csd->MaxClusterSize[rep] = csize;
+      csd->MaxClusterSizeVtx[rep] = csizen;
+      csd->MaxClusterWeightVtx[rep] = cweightvtx;
+      csd->MaxSig[rep] = sigmax;
+      csd->MaxStat[rep] = zmax;
+    }
+  }
+  free(sig);
+}
+
+/*---------------------------------------------------------------
+  WriteCheckpoint() - saves the state of the simulation (settings,
+  number of repetitions done and the CSD data so far) so that an
+  interrupted run can be continued with --resume. The file is written
+  to a temporary name and then renamed so that an interruption while
+  writing does not leave a broken checkpoint.
+  ---------------------------------------------------------------*/
+#define MCSIM_CKPT_MAGIC "mri_mcsim checkpoint 1"
+static int WriteCheckpoint(const char *fname)
+{
+  int nthSign, nthFWHM, nthThresh, nv = surf->nvertices;
+  char tmpfname[2000];
+  FILE *fp;
+  CSD *csd;
+
+  sprintf(tmpfname,"%s.tmp",fname);
+  fp = fopen(tmpfname,"wb");
+  if(fp == NULL){
+    printf("ERROR: could not open checkpoint %s\n",tmpfname);
+    return(1);
+  }
+  fwrite(MCSIM_CKPT_MAGIC,sizeof(char),strlen(MCSIM_CKPT_MAGIC)+1,fp);
+  fwrite(&SynthSeed,sizeof(int),1,fp);
+  fwrite(&nRepetitions,sizeof(int),1,fp);
+  fwrite(&nv,sizeof(int),1,fp);
+  fwrite(&nmask,sizeof(int),1,fp);
+  fwrite(&nFWHMList,sizeof(int),1,fp);
+  fwrite(&nThreshList,sizeof(int),1,fp);
+  fwrite(&nSignList,sizeof(int),1,fp);
+  fwrite(FWHMList,sizeof(double),nFWHMList,fp);
+  fwrite(ThreshList,sizeof(double),nThreshList,fp);
+  fwrite(&nthRep,sizeof(int),1,fp);
+  fwrite(&msecTime,sizeof(int),1,fp);
+  for(nthFWHM=0; nthFWHM < nFWHMList; nthFWHM++){
+    for(nthThresh = 0; nthThresh < nThreshList; nthThresh++){
+      for(nthSign = 0; nthSign < nSignList; nthSign++){
+	csd = csdList[nthFWHM][nthThresh][nthSign];
+	fwrite(csd->nClusters,sizeof(int),nthRep,fp);
+	fwrite(csd->MaxClusterSize,sizeof(double),nthRep,fp);
+	fwrite(csd->MaxClusterSizeVtx,sizeof(double),nthRep,fp);
+	fwrite(csd->MaxClusterWeightVtx,sizeof(double),nthRep,fp);
+	fwrite(csd->MaxSig,sizeof(double),nthRep,fp);
+	fwrite(csd->MaxStat,sizeof(double),nthRep,fp);
+      }
+    }
+  }
+  if(fclose(fp) != 0 || rename(tmpfname,fname) != 0){
+    printf("ERROR: could not write checkpoint %s\n",fname);
+    return(1);
+  }
+  return(0);
+}
+
+/*---------------------------------------------------------------
+  ReadCheckpoint() - reads a checkpoint written by WriteCheckpoint().
+  If LoadData=0, only gets the seed (which must be known before the
+  random number generator is set up). Otherwise, checks that the run
+  has the same settings, loads the CSD data and sets nthRep to the
+  number of repetitions already done.
+  ---------------------------------------------------------------*/
+static int ReadCheckpoint(const char *fname, int LoadData)
+{
+  int nthSign, nthFWHM, nthThresh, seed, nreps, nv, nm, nf, nt, ns, nrepsdone, msec, bad;
+  double fwhmlist[100], threshlist[100];
+  char magic[100];
+  FILE *fp;
+  CSD *csd;
+
+  fp = fopen(fname,"rb");
+  if(fp == NULL){
+    printf("ERROR: could not open checkpoint %s\n",fname);
+    return(1);
+  }
+  bad = 0;
+  if(fread(magic,sizeof(char),strlen(MCSIM_CKPT_MAGIC)+1,fp) != strlen(MCSIM_CKPT_MAGIC)+1 ||
+     strcmp(magic,MCSIM_CKPT_MAGIC)) bad = 1;
+  if(!bad){
+    bad |= (fread(&seed,sizeof(int),1,fp) != 1);
+    bad |= (fread(&nreps,sizeof(int),1,fp) != 1);
+    bad |= (fread(&nv,sizeof(int),1,fp) != 1);
+    bad |= (fread(&nm,sizeof(int),1,fp) != 1);
+    bad |= (fread(&nf,sizeof(int),1,fp) != 1);
+    bad |= (fread(&nt,sizeof(int),1,fp) != 1);
+    bad |= (fread(&ns,sizeof(int),1,fp) != 1);
+  }
+  if(bad || nf < 0 || nf > 100 || nt < 0 || nt > 100){
+    printf("ERROR: %s is not an mri_mcsim checkpoint\n",fname);
+    fclose(fp);
+    return(1);
+  }
+  bad |= (fread(fwhmlist,sizeof(double),nf,fp) != (size_t)nf);
+  bad |= (fread(threshlist,sizeof(double),nt,fp) != (size_t)nt);
+  bad |= (fread(&nrepsdone,sizeof(int),1,fp) != 1);
+  bad |= (fread(&msec,sizeof(int),1,fp) != 1);
+  if(bad){
+    printf("ERROR: reading checkpoint %s\n",fname);
+    fclose(fp);
+    return(1);
+  }
+
+  if(!LoadData){
+    if(SynthSeed >= 0 && SynthSeed != seed){
+      printf("ERROR: seed %d does not match the seed %d of checkpoint %s\n",SynthSeed,seed,fname);
+      fclose(fp);
+      return(1);
+    }
+    SynthSeed = seed;
+    fclose(fp);
+    return(0);
+  }
+
+  if(nreps != nRepetitions || nv != surf->nvertices || nm != nmask ||
+     nf != nFWHMList || nt != nThreshList || ns != nSignList ||
+     memcmp(fwhmlist,FWHMList,nf*sizeof(double)) || memcmp(threshlist,ThreshList,nt*sizeof(double))){
+    printf("ERROR: checkpoint %s was made with different settings\n",fname);
+    fclose(fp);
+    return(1);
+  }
+  for(nthFWHM=0; nthFWHM < nFWHMList; nthFWHM++){
+    for(nthThresh = 0; nthThresh < nThreshList; nthThresh++){
+      for(nthSign = 0; nthSign < nSignList; nthSign++){
+	csd = csdList[nthFWHM][nthThresh][nthSign];
+	bad |= (fread(csd->nClusters,sizeof(int),nrepsdone,fp) != (size_t)nrepsdone);
+	bad |= (fread(csd->MaxClusterSize,sizeof(double),nrepsdone,fp) != (size_t)nrepsdone);
+	bad |= (fread(csd->MaxClusterSizeVtx,sizeof(double),nrepsdone,fp) != (size_t)nrepsdone);
+	bad |= (fread(csd->MaxClusterWeightVtx,sizeof(double),nrepsdone,fp) != (size_t)nrepsdone);
+	bad |= (fread(csd->MaxSig,sizeof(double),nrepsdone,fp) != (size_t)nrepsdone);
+	bad |= (fread(csd->MaxStat,sizeof(double),nrepsdone,fp) != (size_t)nrepsdone);
+      }
+    }
+  }
+  fclose(fp);
+  if(bad){
+    printf("ERROR: checkpoint %s is truncated\n",fname);
+    return(1);
+  }
+  nthRep = nrepsdone;
+  msecPrev = msec;
+  return(0);
+}
@@ -42,6 +42,7 @@
 #include <math.h>
 #include <string.h>
 #include <sys/time.h>
+#include <vector>
 
 #include "icosahedron.h"
 #include "MRIio_old.h"
@@ -61,6 +62,8 @@
 #include "fmriutils.h"
 #include "proto.h" // nint
 #include "cmdargs.h"
+#include "vol2surfmat.h"
+#include "romp_support.h"
 
 #ifndef FZERO
 #define FZERO(f)     (fabs(f) < 0.0000001F)
@@ -190,6 +193,8 @@ MATRIX *Mtrans = NULL;
 char *vsmfile = NULL;
 MRI *vsm = NULL;
 int UseOld = 1;
+int UseSampleMat = 1;
+char *SampleMatCache = NULL;
 MRI *MRIvol2surf(MRI *SrcVol, MATRIX *Rtk, MRI_SURFACE *TrgSurf, 
 		 MRI *vsm, int InterpMethod, MRI *SrcHitVol, 
 		 float ProjFrac, int ProjType, int nskip);
@@ -493,6 +498,51 @@ int main(int argc, char **argv) {
                                   mri_wm, mri_gm, mri_csf) ;
     MatrixFree(&Qsrc) ; MatrixFree(&QFWDsrc) ;
   }
+  else if (UseSampleMat && !GetProjMax &&
+           (interpmethod == SAMPLE_NEAREST || interpmethod == SAMPLE_TRILINEAR))
+  {
+    // The geometry is the same for every frame, so compute the sparse
+    // vertex-by-voxel sampling matrix once and apply it to all frames.
+    // This reproduces the per-frame loop below (old or new code path).
+    std::vector<float> projfrac;
+    for (ProjFrac=ProjFracMin; 
+         ProjFrac <= ProjFracMax; 
+         ProjFrac += ProjFracDelta) projfrac.push_back(ProjFrac);
+    VOL2SURF_SAMPLING vs;
+    vs.InterpMethod = interpmethod;
+    vs.nproj = projfrac.size();
+    vs.ProjFrac = &projfrac[0];
+    if (UseOld) {
+      vs.float2int = float2int;
+      vs.ProjDist = ProjDistFlag;
+      vs.SkipRipped = 0;
+    }
+    else {
+      // MRIvol2surfVSM() is passed ProjDistFlag as its ProjType, where 0
+      // means distance
+      vs.float2int = FLT2INT_ROUND;
+      vs.ProjDist = !ProjDistFlag;
+      vs.SkipRipped = 1;
+    }
+    MATRIX *QFWDsrc = ComputeQFWD(Qsrc,Fsrc,Wsrc,Dsrc,NULL);
+    printf("Computing sampling matrix (%d depths)\n",vs.nproj);
+    MRI_VOL2SURF_MAT *v2smat = MRIvol2surfMatLoadOrBuild(SampleMatCache, SrcVol, QFWDsrc, Surf,
+                                                         UseOld ? NULL : vsm, &vs);
+    MatrixFree(&QFWDsrc);
+    if (v2smat == NULL) {
+      printf("ERROR: computing sampling matrix\n");
+      exit(1);
+    }
+    printf("Sampling %d frames\n",SrcVol->nframes);
+    SurfVals = MRIvol2surfMatApply(v2smat, SrcVol, NULL);
+    if (SurfVals == NULL) {
+      printf("ERROR: mapping volume to source\n");
+      exit(1);
+    }
+    // the per-frame code leaves the hits of the last depth in SrcHitVol
+    MRIvol2surfMatHits(v2smat, SrcHitVol, vs.nproj-1);
+    MRIvol2surfMatFree(&v2smat);
+  }
   else
   {
     nproj = 0;
@@ -1036,6 +1086,23 @@ static int parse_commandline(int argc, char **argv) {
     else if (!strcmp(option, "--use-new")) {
       UseOld = 0;
     } 
+    else if (!strcmp(option, "--no-sample-matrix")) {
+      UseSampleMat = 0;
+    } 
+    else if (!strcmp(option, "--sample-cache")) {
+      if (nargc < 1) argnerr(option,1);
+      SampleMatCache = pargv[0];
+      nargsused = 1;
+    } 
+    else if(!strcasecmp(option, "--threads") || !strcasecmp(option, "--nthreads") ){
+      if(nargc < 1) argnerr(option,1);
+      int nthreads=1;
+      sscanf(pargv[0],"%d",&nthreads);
+      #ifdef _OPENMP
+      omp_set_num_threads(nthreads);
+      #endif
+      nargsused = 1;
+    } 
     else if (!strcmp(option, "--vsm")) {
       if (nargc < 1) argnerr(option,1);
       vsmfile = pargv[0];
@@ -1289,6 +1356,11 @@ static void print_usage(void) {
   printf("   --srchit_type  source hit volume format \n");
   printf("   --nvox nvoxfile : write number of voxels intersecting surface\n");
   printf("\n");
+  printf(" Options for sampling\n");
+  printf("   --sample-cache file : save/reuse the vertex-by-voxel sampling matrix\n");
+  printf("   --no-sample-matrix : sample one frame at a time (slow for 4D data)\n");
+  printf("   --threads nthreads : number of threads used to sample\n");
+  printf("\n");
   printf(" Other Options\n");
   printf("   --reshape : so dims fit in nifti or analyze\n");
   printf("   --noreshape : do not reshape (default)\n");
@@ -1458,6 +1530,15 @@ static void print_help(void) {
     "    between min and max at a spacing of delta. The samples are then averaged\n"
     "    together. The idea here is to average along the normal.\n"
     "\n"
+    "  --sample-cache file\n"
+    "\n"
+    "    Nearest and trilinear sampling (without --projfrac-max/--projdist-max)\n"
+    "    compute a sparse vertex-by-voxel sampling matrix once and apply it to\n"
+    "    all frames, which is much faster for long 4D runs. With --sample-cache,\n"
+    "    the matrix is saved to file and reused by later runs with the same\n"
+    "    surface, registration, voxel grid and projection options (it is rebuilt\n"
+    "    automatically if any of these changed). --no-sample-matrix turns this off.\n"
+    "\n"
     "  --o output path : location to store the data (see below)\n"
     "  --out_type format of output (see below)\n"
     "\n"
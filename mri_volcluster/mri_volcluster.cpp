@@ -135,7 +135,7 @@ float distthresh =   0.0;
 int   allowdiag  = 0;
 int sig2pmax = 0; // convert max value from -log10(p) to p
 
-MRI *vol, *HitMap, *outvol, *maskvol, *binmask;
+MRI *vol, *outvol, *maskvol, *binmask;
 VOLCLUSTER **ClusterList, **ClusterList2;
 MATRIX *CRS2MNI, *CRS2FSA, *FSA2Func;
 LABEL *label;
@@ -192,9 +192,9 @@ char *pointset = NULL;
 /*--------------------- MAIN -----------------------------------*/
 /*--------------------------------------------------------------*/
 int main(int argc, char **argv) {
-  int nhits, *hitcol, *hitrow, *hitslc,nargs;
+  int nhits, nargs;
   int col, row, slc;
-  int nthhit, n, m, nclusters, nprunedclusters;
+  int n, m, nclusters, nprunedclusters;
   float x,y,z,val,pval;
   char *stem;
   FILE *fp;
@@ -358,56 +358,17 @@ int main(int argc, char **argv) {
   }
 
 
-  /* Initialize the hit map - this is a map of voxels that have been
-     accounted for as either outside of a the threshold range or
-     belonging to a cluster. The initialization is for thresholding */
-  HitMap = clustInitHitMap(vol, frame, threshminadj, threshmaxadj, threshsign,
-                           &nhits, &hitcol, &hitrow, &hitslc,
-                           binmask, maskframe);
-  if (HitMap == NULL) {
-    printf("ERROR: initializing hit map\n");
-    if(nhits == 0){
-      printf("  No voxels were found that met the threshold criteria");      
-      if(binmask) printf(" within the mask");      
-      printf(".\n");
-    }
-    exit(1);
-  }
-  //MRIwriteType(HitMap,"hitmap",BSHORT_FILE);
-
-  printf("INFO: Found %d voxels in threhold range\n",nhits);
-
-  /* Allocate an array of clusters equal to the number of hits -- this
-     is the maximum number of clusters possible */
-  ClusterList = clustAllocClusterList(nhits);
+  /* Label the voxels in the threshold range and grow the clusters */
+  ClusterList = clustLabelClusters(vol, frame, threshminadj, threshmaxadj, threshsign,
+                                   binmask, maskframe, allowdiag, CRS2MNI, &nclusters);
   if (ClusterList == NULL) {
-    fprintf(stderr,"ERROR: could not alloc %d clusters\n",nhits);
+    printf("ERROR: labeling clusters\n");
     exit(1);
   }
+  nhits = 0;
+  for (n = 0; n < nclusters; n++) nhits += ClusterList[n]->nmembers;
 
-  nclusters = 0;
-  for (nthhit = 0; nthhit < nhits; nthhit ++) {
-
-    /* Determine whether this hit is still valid. It may
-       not be if it was assigned to the cluster of a
-       previous hit */
-    col = hitcol[nthhit];
-    row = hitrow[nthhit];
-    slc = hitslc[nthhit];
-    if (MRIgetVoxVal(HitMap,col,row,slc,0)) continue;
-
-    /* Grow cluster using this hit as a seed */
-    ClusterList[nclusters] = clustGrow(col,row,slc,HitMap,allowdiag);
-
-    /* Determine the member with the maximum value */
-    clustMaxMember(ClusterList[nclusters], vol, frame, threshsign);
-
-    //clustComputeXYZ(ClusterList[nclusters],CRS2FSA); /* for FSA coords */
-    clustComputeTal(ClusterList[nclusters],CRS2MNI); /*"true" Tal coords */
-
-    /* increment the number of clusters */
-    nclusters ++;
-  }
+  printf("INFO: Found %d voxels in threhold range\n",nhits);
 
   printf("INFO: Found %d clusters that meet threshold criteria\n",
          nclusters);
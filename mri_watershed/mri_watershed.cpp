@@ -318,16 +318,23 @@ typedef struct
 
   Cell *** Basin;
 
-  Coord** Table[256];
+  /*voxels sorted by intensity: the voxels of intensity val are
+    Sorted[bucket[val]] ... Sorted[bucket[val+1]-1], in scan order*/
+  Coord* Sorted;
+  unsigned long bucket[257];
 
   unsigned char intbasin[256];
   unsigned long tabdim[256];
-  unsigned long sqrdim[256];
   unsigned long count[256];
 
   Coord* T1Table;
   long T1nbr;
 
+  /*world to voxel matrices (3x4) of mri_src and mri_orig, looked up
+    once per FitShape so that the forces can be computed in parallel*/
+  float src_w2v[12];
+  float orig_w2v[12];
+
   int decision;
   float scale;
 
@@ -347,6 +354,15 @@ static int old_type ;
 int CopyOnly = 0;
 char *rusage_file=NULL;
 
+/*wall-clock time spent in each stage of MRIstripSkull, printed at the end*/
+#define MAX_STAGES 32
+static int nstages = 0;
+static const char *stage_name[MAX_STAGES];
+static double stage_sec[MAX_STAGES];
+static Timer stage_timer;
+static void StageDone(const char *name);
+static void PrintStageTimes(void);
+
 #ifndef __OPTIMIZE__
 // this routine is slow and should be used only for diagnostics
 static int calcBrainSize(const MRI* mri_src, const MRIS *mris);
@@ -373,7 +389,6 @@ BasinCell* CreateBasinCell(int val, unsigned long size,
 int Decision(STRIP_PARMS *parms,  MRI_variables *MRI_var);
 void FindMainWmComponent(MRI_variables *MRI_var);
 int CharSorting(MRI_variables *MRI_var);
-int sqroot(int r);
 int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var);
 Cell* FindBasin(Cell *cell);
 int Lookat(int,int,int,unsigned char,int*,Cell**,int*,Cell* adtab[27],
@@ -415,6 +430,9 @@ void calcForce2(double &force0, double &force1, double &force,
                 const double &sd,
                 const double &nx, const double &ny, const double &nz,
                 MRI_variables *mri_var, STRIP_PARMS *parms, int kv);
+static void cacheWorldToVoxel(MRI *mri, float *m);
+static void WorldToVoxel(const float *m, double x, double y, double z,
+                         double *px, double *py, double *pz);
 // pass a function pointer for force calculation
 void FitShape(MRI_variables *MRI_var,
               STRIP_PARMS *parms,
@@ -1400,6 +1418,7 @@ static MRI_variables* init_variables(MRI *mri_with_skull)
   v->mri_orig=mri_with_skull;
 
   v->T1Table=NULL;
+  v->Sorted=NULL;
   v->T1nbr=0;
 
   v->Imax = 0;
@@ -1584,6 +1603,9 @@ MRI *MRIstripSkull(MRI *mri_with_skull,
     Error("\nThe type of the input file is not 0 : UCHAR\n");
   }
 
+  nstages=0;
+  stage_timer.reset();
+
   // cache the original input
   mri_tp=MRIclone(mri_with_skull,NULL);
   mri_tp=MRIcopy(mri_with_skull,NULL);
@@ -1593,6 +1615,7 @@ MRI *MRIstripSkull(MRI *mri_with_skull,
   {
     printf("Weighting the input with atlas information before watershed\n");
     MRI_weight_atlas(mri_tp, parms->transform, parms );
+    StageDone("atlas preweighting");
   }
 
   if (!mri_without_skull)
@@ -1683,6 +1706,7 @@ MRI *MRIstripSkull(MRI *mri_with_skull,
     {
       printf("Weighting the input with prior template \n");
       MRI_weight_atlas(MRI_var->mri_src, parms->transform, parms );
+      StageDone("template preweighting");
     }
 
 
@@ -1698,6 +1722,7 @@ MRI *MRIstripSkull(MRI *mri_with_skull,
 
     MRI_var->brain_size=MRISpeelBrain(0,MRI_var->mri_src,MRI_var->mris,0);
     // mri_src is modified (0 outside of the surface).
+    StageDone("brain peeling");
     vol_elt
     =MRI_var->mri_src->xsize*MRI_var->mri_src->ysize*
      MRI_var->mri_src->zsize;
@@ -1791,7 +1816,7 @@ MRI *MRIstripSkull(MRI *mri_with_skull,
     {
       label_voxels(parms,MRI_var,mri_with_skull);
     }
-
+    StageDone("skull and scalp surfaces");
   }
   /*save the volume with the surfaces written in it*/
   /*used to visualize the surfaces -> debuging */
@@ -1805,12 +1830,44 @@ MRI *MRIstripSkull(MRI *mri_with_skull,
     mri_without_skull=MRIcopy(MRI_var->mri_src,NULL);
   }
 
-
+  PrintStageTimes();
 
   MRIVfree(MRI_var);
   return mri_without_skull;
 }
 
+/*-----------------------------------------------------
+  FUNCTION StageDone
+
+  Description: records the wall-clock time since the previous
+  stage ended under the name of the stage that just ended
+  ------------------------------------------------------*/
+static void StageDone(const char *name)
+{
+  if (nstages<MAX_STAGES)
+  {
+    stage_name[nstages]=name;
+    stage_sec[nstages]=stage_timer.seconds();
+    nstages++;
+  }
+  stage_timer.reset();
+}
+
+static void PrintStageTimes(void)
+{
+  int n;
+  double total=0;
+
+  fprintf(stdout,"\nTiming of the skull stripping stages:");
+  for (n=0; n<nstages; n++)
+  {
+    fprintf(stdout,"\n      %-28s %8.2f sec",stage_name[n],stage_sec[n]);
+    total+=stage_sec[n];
+  }
+  fprintf(stdout,"\n      %-28s %8.2f sec\n","total",total);
+  fflush(stdout);
+}
+
 
 /******************************************************
  ******************************************************
@@ -1839,6 +1896,7 @@ int Watershed(STRIP_PARMS *parms,MRI_variables *MRI_var)
   if (!parms->noT1analysis && !parms->preweight)
   {
     AnalyzeT1Volume(parms,MRI_var);
+    StageDone("T1 analysis");
   }
 
   Allocation(MRI_var);
@@ -1846,20 +1904,24 @@ int Watershed(STRIP_PARMS *parms,MRI_variables *MRI_var)
   {
     return -1;
   }
+  StageDone("intensity analysis");
 
   fprintf(stdout,"\n      preflooding height equal to %d percent",
           parms->hpf) ;
 
   CharSorting(MRI_var);
   fprintf(stdout,"\ndone.");
+  StageDone("sorting");
 
   fprintf(stdout,"\nAnalyze...\n");
   Analyze(parms,MRI_var);
   fprintf(stdout,"\ndone.");
+  StageDone("flooding");
 
   fprintf(stdout,"\nPostAnalyze...");
   PostAnalyze(parms,MRI_var);
   fprintf(stdout,"done.\n");
+  StageDone("basin merging");
   fflush(stdout);
 
   return 0;
@@ -1880,20 +1942,41 @@ void AnalyzeT1Volume(STRIP_PARMS *parms,MRI_variables *MRI_var)
   }
 
   /*detect if we are in a T1 volume*/
-  for (k=2; k<MRI_var->depth-2; k++)
-    for (j=2; j<MRI_var->height-2; j++)
+#ifdef HAVE_OPENMP
+  #pragma omp parallel private(i,j,k,pb)
+#endif
+  {
+    long local_number[20];
+
+    for (k=0; k<20; k++)
     {
-      pb=&MRIvox(MRI_var->mri_src,0,j,k);
-      pb+=2;
-      for (i=2; i<MRI_var->width-2; i++)
+      local_number[k]=0;
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for (k=2; k<MRI_var->depth-2; k++)
+      for (j=2; j<MRI_var->height-2; j++)
       {
-        if (((*pb)>99) && ((*pb)<120))
+        pb=&MRIvox(MRI_var->mri_src,0,j,k);
+        pb+=2;
+        for (i=2; i<MRI_var->width-2; i++)
         {
-          T1number[(*pb)-100]++;
+          if (((*pb)>99) && ((*pb)<120))
+          {
+            local_number[(*pb)-100]++;
+          }
+          pb++;
         }
-        pb++;
       }
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
+    for (k=0; k<20; k++)
+    {
+      T1number[k]+=local_number[k];
     }
+  }
 
   /*look if intensity=110 > average around*/
   average=0;
@@ -2030,7 +2113,6 @@ void Allocation(MRI_variables *MRI_var)
   for (k=0; k<256; k++)
   {
     MRI_var->tabdim[k]=0;
-    MRI_var->sqrdim[k]=0;
     MRI_var->count[k]=0;
     MRI_var->intbasin[k]=k;
     MRI_var->gmnumber[k]=0;
@@ -2055,22 +2137,43 @@ int calCSFIntensity(MRI_variables *MRI_var)
   }
 
   n=0; // counts non-zero grey voxels
-  // create a histogram
-  for (k=2; k<MRI_var->depth-2; k++)
-    for (j=2; j<MRI_var->height-2; j++)
+  // create a histogram (per thread, the counts are exact in any order)
+#ifdef HAVE_OPENMP
+  #pragma omp parallel private(i,j,k,pb) reduction(+:n)
+#endif
+  {
+    long local_hist[256];
+
+    for (k=0; k<256; k++)
     {
-      pb=&MRIvox(MRI_var->mri_src,0,j,k);
-      pb+=2;
-      for (i=2; i<MRI_var->width-2; i++)
+      local_hist[k]=0;
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for (k=2; k<MRI_var->depth-2; k++)
+      for (j=2; j<MRI_var->height-2; j++)
       {
-        if (*pb) // non-zeo
+        pb=&MRIvox(MRI_var->mri_src,0,j,k);
+        pb+=2;
+        for (i=2; i<MRI_var->width-2; i++)
         {
-          n++;
-          intensity_percent[*pb]++;
+          if (*pb) // non-zeo
+          {
+            n++;
+            local_hist[*pb]++;
+          }
+          pb++;
         }
-        pb++;
       }
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
+    for (k=0; k<256; k++)
+    {
+      intensity_percent[k]+=local_hist[k];
     }
+  }
 
   DebugCurve(intensity_percent, 256, "\nHistogram of grey values\n");
 
@@ -2111,46 +2214,72 @@ int calCOGMAX( MRI_variables *MRI_var,
 
   n=0; // keeps track of non-zero voxels
   m=0; // keeps track of the center of gravity voxel
-  MRI_var->xCOG = MRI_var->yCOG = MRI_var->zCOG = 0;
+  // the coordinate sums are integers, so they are exact in any order
+  double xCOG = 0, yCOG = 0, zCOG = 0;
   int maxGrey =0;
-  for (k=2; k<MRI_var->depth-2; k++)
-    for (j=2; j<MRI_var->height-2; j++)
+#ifdef HAVE_OPENMP
+  #pragma omp parallel private(i,j,k,pb) \
+    reduction(+:n,m,xCOG,yCOG,zCOG) reduction(max:maxGrey)
+#endif
+  {
+    long local_hist[256];
+
+    for (k=0; k<256; k++)
     {
-      pb=&MRIvox(MRI_var->mri_src,0,j,k);
-      pb+=2;
-      for (i=2; i<MRI_var->width-2; i++)
+      local_hist[k]=0;
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for (k=2; k<MRI_var->depth-2; k++)
+      for (j=2; j<MRI_var->height-2; j++)
       {
-        if (*pb>MRI_var->CSF_intensity)
+        pb=&MRIvox(MRI_var->mri_src,0,j,k);
+        pb+=2;
+        for (i=2; i<MRI_var->width-2; i++)
         {
-          n++;
-          intensity_percent[*pb]++;
-          if (!T1) // not T1 volume
+          if (*pb>MRI_var->CSF_intensity)
           {
-            MRI_var->xCOG+=i;
-            MRI_var->yCOG+=j;
-            MRI_var->zCOG+=k;
-            m++;
-          }
-          else
-          {
-            // this is done to avoid COG becoming too low
-            // due to the large neck area
-            if (*pb == 110) // T1 volume
+            n++;
+            local_hist[*pb]++;
+            if (!T1) // not T1 volume
             {
-              MRI_var->xCOG+=i;
-              MRI_var->yCOG+=j;
-              MRI_var->zCOG+=k;
+              xCOG+=i;
+              yCOG+=j;
+              zCOG+=k;
               m++;
             }
+            else
+            {
+              // this is done to avoid COG becoming too low
+              // due to the large neck area
+              if (*pb == 110) // T1 volume
+              {
+                xCOG+=i;
+                yCOG+=j;
+                zCOG+=k;
+                m++;
+              }
+            }
+            if (*pb > maxGrey)
+            {
+              maxGrey = *pb;
+            }
           }
-          if (*pb > maxGrey)
-          {
-            maxGrey = *pb;
-          }
+          pb++;
         }
-        pb++;
       }
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
+    for (k=0; k<256; k++)
+    {
+      intensity_percent[k]+=local_hist[k];
     }
+  }
+  MRI_var->xCOG = xCOG;
+  MRI_var->yCOG = yCOG;
+  MRI_var->zCOG = zCOG;
   if (m<=100)
   {
     if (!T1) // not T1 volume
@@ -2198,30 +2327,59 @@ int calBrainRadius(MRI_variables *MRI_var)
 
   m=0;
   MRI_var->rad_Brain=0;
-  for (k=2; k<MRI_var->depth-2; k++)
-    for (j=2; j<MRI_var->height-2; j++)
+  // sums per slice, added up in slice order so that the result does
+  // not depend on the number of threads
+  double *slice_rad=(double*)calloc(MAX(MRI_var->depth,1),sizeof(double));
+#ifdef HAVE_OPENMP
+  #pragma omp parallel private(i,j,k,pb) reduction(+:m)
+#endif
+  {
+    unsigned long local_hist[256];
+
+    for (k=0; k<256; k++)
     {
-      pb=&MRIvox(MRI_var->mri_src,0,j,k);
-      pb+=2;
-      for (i=2; i<MRI_var->width-2; i++)
+      local_hist[k]=0;
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for (k=2; k<MRI_var->depth-2; k++)
+      for (j=2; j<MRI_var->height-2; j++)
       {
-        if ((*pb)>=MRI_var->Imax)
-        {
-          *pb=MRI_var->Imax-1;
-        }
-        if (*pb)      /*don't care about 0 intensity voxel*/
-        {
-          MRI_var->tabdim[*pb]++;  // histogram of non-zero voxels
-        }
-        if (*pb>MRI_var->CSF_intensity)
+        pb=&MRIvox(MRI_var->mri_src,0,j,k);
+        pb+=2;
+        for (i=2; i<MRI_var->width-2; i++)
         {
-          m++;
-          MRI_var->rad_Brain+=SQR(i-MRI_var->xCOG)+
-                              SQR(j-MRI_var->yCOG)+SQR(k-MRI_var->zCOG);
+          if ((*pb)>=MRI_var->Imax)
+          {
+            *pb=MRI_var->Imax-1;
+          }
+          if (*pb)      /*don't care about 0 intensity voxel*/
+          {
+            local_hist[*pb]++;  // histogram of non-zero voxels
+          }
+          if (*pb>MRI_var->CSF_intensity)
+          {
+            m++;
+            slice_rad[k]+=SQR(i-MRI_var->xCOG)+
+                          SQR(j-MRI_var->yCOG)+SQR(k-MRI_var->zCOG);
+          }
+          pb++;
         }
-        pb++;
       }
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
+    for (k=0; k<256; k++)
+    {
+      MRI_var->tabdim[k]+=local_hist[k];
     }
+  }
+  for (k=2; k<MRI_var->depth-2; k++)
+  {
+    MRI_var->rad_Brain+=slice_rad[k];
+  }
+  free(slice_rad);
 
   if (m==0)
   {
@@ -2363,6 +2521,10 @@ int Pre_CharSorting(STRIP_PARMS *parms,MRI_variables *MRI_var)
     intensity_percent[k]=0;
   }
 
+  // every voxel only writes its own cube cells
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for private(i,j,u,v,n,pbc,mean,var) schedule(static)
+#endif
   for (k=zmin; k<zmax; k++)
     for (j=ymin; j<ymax; j++)
     {
@@ -3305,7 +3467,6 @@ int Decision(STRIP_PARMS *parms,  MRI_variables *MRI_var)
     for (k=0; k<256; k++)
     {
       MRI_var->tabdim[k]=0;
-      MRI_var->sqrdim[k]=0;
       MRI_var->count[k]=0;
       MRI_var->intbasin[k]=k;
       MRI_var->gmnumber[k]=0;
@@ -3324,78 +3485,76 @@ int Decision(STRIP_PARMS *parms,  MRI_variables *MRI_var)
   ------------------------------------------------------*/
 int CharSorting(MRI_variables *MRI_var)
 {
-  int i,j,k,u,v;
-  int l;
-  ldiv_t ld;
+  int i,j,k,val,nslices;
+  unsigned long n,(*slice_count)[256];
   BUFTYPE *pb;
-  unsigned char val;
 
-  /*allocating an 256 table of Coord** in order to process the Sorting*/
-
-  for (k=1; k<MRI_var->Imax+1; k++)
+  /*counting sort: histogram of every slice, then every slice fills its
+    own part of each bucket, which keeps the voxels of a bucket in scan
+    order (the order the flooding processes them in)*/
+  nslices=MRI_var->depth-4;
+  slice_count=(unsigned long (*)[256])calloc(MAX(nslices,1),
+              sizeof(*slice_count));
+  if (!slice_count)
   {
-    l=sqroot(MRI_var->tabdim[k]); // sqrt of the population at grey=k
-    MRI_var->sqrdim[k]=l;
-    MRI_var->Table[k]=(Coord**)malloc(l*sizeof(Coord*));
-    // each Table is a 2d array of Coord
-    if (!MRI_var->Table[k])
-    {
-      Error("Allocation first Table Echec");
-    }
-    // array is l x l
-    for (u=0; u<l; u++)
-    {
-      MRI_var->Table[k][u]=(Coord*)calloc(l,sizeof(Coord));
-      if (!MRI_var->Table[k][u])
-      {
-        Error("Allocation second Table Echec");
-      }
-    }
+    Error("Allocation of the sorting histogram failed");
   }
 
-  /*Sorting itself*/
-  // each Table[k] (k=grey value) is a 2D array.  each element of 2D array has
-  // the coordinate of a voxel.
-  // filling 2d array with quot and rem of count
-  // why 2d array?  Maybe this programmer thought that the length of column is
-  // too big to fit in the linear array.  Unnecessary
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for private(i,j,pb) schedule(static)
+#endif
   for (k=2; k<MRI_var->depth-2; k++)
     for (j=2; j<MRI_var->height-2; j++)
     {
-      pb=&MRIvox(MRI_var->mri_src,0,j,k);
-      pb+=2;
-      for (i=2; i<MRI_var->width-2; i++)
-      {
-        val=*pb++;
-        if (val)
+      pb=&MRIvox(MRI_var->mri_src,2,j,k);
+      for (i=2; i<MRI_var->width-2; i++, pb++)
+        if (*pb)
         {
-          l=MRI_var->count[val]++;
-          // count[] is a histogram of non-zero grey values
-          ld=ldiv(l,MRI_var->sqrdim[val]);
-          u=ld.quot;
-          v=ld.rem;
-          MRI_var->Table[val][u][v][0]=i;
-          MRI_var->Table[val][u][v][1]=j;
-          MRI_var->Table[val][u][v][2]=k;
+          slice_count[k-2][*pb]++;
         }
-      }
     }
-  return 0;
-}
 
-/*sqrt routine*/
-int sqroot(int r)
-{
-  int i;
-  i=(int)sqrt(r);
-  if (i*i<r)
+  // turn the counts into the offset of every slice in every bucket
+  n=0;
+  for (val=0; val<256; val++)
   {
-    return (i+1);
+    MRI_var->bucket[val]=n;
+    MRI_var->count[val]=0;
+    for (k=0; k<nslices; k++)
+    {
+      unsigned long c=slice_count[k][val];
+      slice_count[k][val]=n;
+      n+=c;
+      MRI_var->count[val]+=c;
+    }
   }
-  else
+  MRI_var->bucket[256]=n;
+
+  MRI_var->Sorted=(Coord*)malloc(MAX(n,1)*sizeof(Coord));
+  if (!MRI_var->Sorted)
   {
-    return i;
+    Error("Allocation of the sorted voxels failed");
   }
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for private(i,j,pb) schedule(static)
+#endif
+  for (k=2; k<MRI_var->depth-2; k++)
+    for (j=2; j<MRI_var->height-2; j++)
+    {
+      pb=&MRIvox(MRI_var->mri_src,2,j,k);
+      for (i=2; i<MRI_var->width-2; i++, pb++)
+        if (*pb)
+        {
+          Coord *crd=&MRI_var->Sorted[slice_count[k-2][*pb]++];
+          (*crd)[0]=i;
+          (*crd)[1]=j;
+          (*crd)[2]=k;
+        }
+    }
+
+  free(slice_count);
+  return 0;
 }
 
 /*******************************ANALYZE****************************/
@@ -3403,40 +3562,20 @@ int sqroot(int r)
 /*routine that analyzes all the voxels sorted in an descending order*/
 int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var)
 {
-  int pos;
-  int u,v,n,d;
-  int l;
-  ldiv_t ld;
+  int pos,n;
+  unsigned long l;
   double vol_elt;
 
   MRI_var->basinnumber=0;
   MRI_var->basinsize=0;
 
-  n=MRI_var->sqrdim[MRI_var->Imax]; // the sqrt of the population at Imax
-  for (u=0; u<n; u++)
-  {
-    free(MRI_var->Table[MRI_var->Imax][u]);
-  }
-  free(MRI_var->Table[MRI_var->Imax]);
-
+  // flood from the brightest intensity (below Imax) down
   for (pos=MRI_var->Imax-1; pos>0; pos--)
   {
-    l=0;
-    d=MRI_var->tabdim[pos];  // the population at pos
-    n=MRI_var->sqrdim[pos];  // the sqrt of the d
-    while (l<d)
+    for (l=MRI_var->bucket[pos]; l<MRI_var->bucket[pos+1]; l++)
     {
-      ld=ldiv(l,n);
-      u=ld.quot;
-      v=ld.rem;
-      Test(MRI_var->Table[pos][u][v],parms,MRI_var);
-      l++;
+      Test(MRI_var->Sorted[l],parms,MRI_var);
     }
-    for (u=0; u<n; u++)
-    {
-      free(MRI_var->Table[pos][u]);
-    }
-    free(MRI_var->Table[pos]);
 
     if (Gdiag & DIAG_SHOW)
     {
@@ -3445,6 +3584,8 @@ int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var)
               MRI_var->basinnumber,MRI_var->basinsize);
     }
   }
+  free(MRI_var->Sorted);
+  MRI_var->Sorted=NULL;
 
   MRI_var->main_basin_size+=((BasinCell*)MRI_var->Basin
                              [MRI_var->k_global_min]
@@ -3482,15 +3623,25 @@ int Analyze(STRIP_PARMS *parms,MRI_variables *MRI_var)
   return 0;
 }
 
-/*looking at a voxel, finds the corresponding basin*/
+/*looking at a voxel, finds the corresponding basin.
+  The nodes on the way are relinked directly to the basin so that
+  chains of merged basins do not have to be walked again*/
 Cell* FindBasin(Cell *cell)
 {
-  cell= (Cell *) cell->next;
-  while (cell->type==1)
+  Cell *basin, *next;
+
+  basin= (Cell *) cell->next;
+  while (basin->type==1)
   {
-    cell=(Cell *) cell->next;
+    basin=(Cell *) basin->next;
   }
-  return cell;
+  while (cell->type==1 && cell->next!=basin)
+  {
+    next=(Cell *) cell->next;
+    cell->next=basin;
+    cell=next;
+  }
+  return basin;
 }
 
 /*main routine for the merging*/
@@ -4539,6 +4690,7 @@ void Template_Deformation(STRIP_PARMS *parms,MRI_variables *MRI_var)
   // using smaller brain radius to expand to the surface
   // MRISshrink1(MRI_var);
   FitShape(MRI_var, parms, 5, 150, calcForce1);
+  StageDone("template fit");
   // MRISwrite(MRI_var->mris, "surface1");
 #ifndef __OPTIMIZE__
   brainsize = calcBrainSize(MRI_var->mri_src, MRI_var->mris);
@@ -4570,6 +4722,7 @@ void Template_Deformation(STRIP_PARMS *parms,MRI_variables *MRI_var)
     shrinkstep(MRI_var);
     fprintf(stdout,"\n      highly tesselated surface with %d vertices"
             ,MRI_var->mris->nvertices);
+    StageDone("local intensity analysis");
 
     if (parms->template_deformation==3)
       /*use the result of the first template smoothing*/
@@ -4591,6 +4744,7 @@ void Template_Deformation(STRIP_PARMS *parms,MRI_variables *MRI_var)
         MRIScomputeCloserLabel(parms, MRI_var);
       }
       FitShape(MRI_var, parms, 1, 100, calcForce2);
+      StageDone("surface matching");
 
 
       // MRISwrite(MRI_var->mris, "surface2");
@@ -4642,6 +4796,8 @@ void Template_Deformation(STRIP_PARMS *parms,MRI_variables *MRI_var)
                       DIST_MODE);
     }
 
+    StageDone("atlas validation");
+
     fprintf(stdout,
             "\n\n********FINAL ITERATIVE TEMPLATE DEFORMATION********");
     /*Compute local intensity values*/
@@ -4654,6 +4810,7 @@ void Template_Deformation(STRIP_PARMS *parms,MRI_variables *MRI_var)
 
     ////////////////////////////////////////////////////////////////////
     MRISFineSegmentation(MRI_var);
+    StageDone("fine segmentation");
     // MRISwrite(MRI_var->mris, "surface3");
 #ifndef __OPTIMIZE__
     brainsize = calcBrainSize(MRI_var->mri_src, MRI_var->mris);
@@ -4663,6 +4820,7 @@ void Template_Deformation(STRIP_PARMS *parms,MRI_variables *MRI_var)
     ////////////////////////////////////////////////////////////////////
     MRI_var->dark_iter=parms->dark_iter;
     MRISgoToClosestDarkestPoint(MRI_var);
+    StageDone("darkest point search");
     // MRISwrite(MRI_var->mris, "surface4");
 #ifndef __OPTIMIZE__
     brainsize = calcBrainSize(MRI_var->mri_src, MRI_var->mris);
@@ -10588,8 +10746,8 @@ void calcForce1(double &fST, double &fSN, double &fN,
   for (h=-noutside; h<0; h++) // up to 15 voxels inside
   {
     // look at outside side voxels (h < 0) of the current position
-    myWorldToVoxel(mri_var->mri_src,(x-nx*h),
-                   (y-ny*h),(z-nz*h),&tx,&ty,&tz);
+    WorldToVoxel(mri_var->src_w2v,(x-nx*h),
+                 (y-ny*h),(z-nz*h),&tx,&ty,&tz);
     kt=(int)(tz+0.5);
     jt=(int)(ty+0.5);
     it=(int)(tx+0.5);
@@ -10609,8 +10767,8 @@ void calcForce1(double &fST, double &fSN, double &fN,
   for (h=1; h<ninside; h++) // 10 voxels outside
   {
     // look at inside voxes (h > 0) of the current position
-    myWorldToVoxel(mri_var->mri_src,
-                   (x-nx*h),(y-ny*h),(z-nz*h),&tx,&ty,&tz);
+    WorldToVoxel(mri_var->src_w2v,
+                 (x-nx*h),(y-ny*h),(z-nz*h),&tx,&ty,&tz);
     kt=(int)(tz+0.5);
     jt=(int)(ty+0.5);
     it=(int)(tx+0.5);
@@ -10682,9 +10840,9 @@ void calcForce2(double &force0, double &force1, double &force,
     for (a=-1; a<2; a++)
       for (b=-1; b<2; b++)
       {
-        myWorldToVoxel(MRI_var->mri_orig,(x-nx*h+n1[0]*a+n2[0]*b),
-                       (y-ny*h+n1[1]*a+n2[1]*b),
-                       (z-nz*h+n1[2]*a+n2[2]*b),&tx,&ty,&tz);
+        WorldToVoxel(MRI_var->orig_w2v,(x-nx*h+n1[0]*a+n2[0]*b),
+                     (y-ny*h+n1[1]*a+n2[1]*b),
+                     (z-nz*h+n1[2]*a+n2[2]*b),&tx,&ty,&tz);
         kt=(int)(tz+0.5);
         jt=(int)(ty+0.5);
         it=(int)(tx+0.5);
@@ -10841,9 +10999,7 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
                MRI_variables *mri_var,  STRIP_PARMS *parms, int kv)
              )
 {
-  float x,y,z,sx,sy,sz,sd,sxn,syn,szn,sxt,syt,szt,nc;
-  double fN,fST,fSN;
-  float d,dx,dy,dz,nx,ny,nz;
+  double fN;
   int iter,k,m,n;
 
   int it,jt, niter;
@@ -10860,7 +11016,7 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
   char fname[500];
 #endif
 
-  double lm,d10m[3],d10,f1m,f2m,dm,dbuff;
+  double lm,d10,f1m,f2m,dm,*vstats;
   float ***dist;
   float cout,cout_prec,coutbuff,varbuff,mean_sd[10],mean_dist[10];
 
@@ -10868,6 +11024,13 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
   mris=MRI_var->mris;
   MRIScomputeNormals(mris);
 
+  cacheWorldToVoxel(MRI_var->mri_src, MRI_var->src_w2v);
+  if (MRI_var->mri_orig)
+  {
+    cacheWorldToVoxel(MRI_var->mri_orig, MRI_var->orig_w2v);
+  }
+  vstats = (double *) calloc(5*mris->nvertices, sizeof(double));
+
   //////////////////////////////////////////////////////////////
   // initialize vars
   dist = (float ***) malloc( mris->nvertices*sizeof(float**) );
@@ -10926,10 +11089,21 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
     MRISwrite(mris,fname);
 #endif
 
+    // the vertices only read the positions of the previous iteration
+    // (tx,ty,tz), so they can be moved in parallel. The statistics are
+    // summed up afterwards in vertex order.
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
     for (k=0; k<mris->nvertices; k++)
     {
       VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[k];
       VERTEX                * const v  = &mris->vertices         [k];
+      float x,y,z,sx,sy,sz,sd,sxn,syn,szn,sxt,syt,szt,nc;
+      double fN,fST,fSN;
+      float d,dx,dy,dz,nx,ny,nz;
+      double d10m[3],dbuff;
+      int m,n;
       // vertex position
       x = v->tx;
       y = v->ty;
@@ -10959,7 +11133,7 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
       sd = sd/n;
 
       // cache
-      lm+=sd;
+      vstats[5*k]=sd;
 
       // inner product of S and N
       nc = sx*nx+sy*ny+sz*nz;
@@ -10981,8 +11155,8 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
       // force calculation
       calcForce(fST,fSN,fN, x,y,z, sx,sy,sz,sd, nx,ny,nz, MRI_var, parms, k);
 
-      f1m+=fSN;
-      f2m+=fN;
+      vstats[5*k+1]=fSN;
+      vstats[5*k+2]=fN;
 
       ///////////////////////////////////////////////////////////////
       // keep tangential vector smaller < 1.0
@@ -11024,7 +11198,7 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
       // calculate the size of the movement
       d=sqrt(dx*dx+dy*dy+dz*dz);
 
-      dm+=d;
+      vstats[5*k+3]=d;
 
       /////////////////////////////////////////////
       dist[k][iter%4][0]=x;
@@ -11047,7 +11221,7 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
           SQR(dist[k][n][1]-d10m[1])+
           SQR(dist[k][n][2]-d10m[2]);
 
-      d10+=dbuff/4;
+      vstats[5*k+4]=dbuff/4;
 
       ////////////////////////////////////////////////////////////
       // now move vertex by (dx, dy, dz)
@@ -11057,6 +11231,15 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
         v->z + dz);
     }
 
+    for (k=0; k<mris->nvertices; k++)
+    {
+      lm+=vstats[5*k];
+      f1m+=vstats[5*k+1];
+      f2m+=vstats[5*k+2];
+      dm+=vstats[5*k+3];
+      d10+=vstats[5*k+4];
+    }
+
     lm /=mris->nvertices;
     f1m /=mris->nvertices;
     f2m /=mris->nvertices;
@@ -11159,9 +11342,54 @@ void FitShape(MRI_variables *MRI_var,  STRIP_PARMS *parms,
     free(dist[it]);
   }
   free(dist);
+  free(vstats);
   fflush(stdout);
 }
 
+/*looks up the world to voxel matrix that myWorldToVoxel uses for mri*/
+static void cacheWorldToVoxel(MRI *mri, float *m)
+{
+  MATRIX *m_w2v;
+  double x,y,z;
+  int r,c;
+
+  if (myWorldToVoxel==MRIsurfaceRASToVoxel)
+  {
+    m_w2v=voxelFromSurfaceRAS_(mri);
+  }
+  else
+  {
+    myWorldToVoxel(mri,0,0,0,&x,&y,&z);  // makes sure r_to_i__ is cached
+    m_w2v=MatrixCopy(mri->r_to_i__,NULL);
+  }
+  for (r=0; r<3; r++)
+    for (c=0; c<4; c++)
+    {
+      m[4*r+c]=*MATRIX_RELT(m_w2v,r+1,c+1);
+    }
+  MatrixFree(&m_w2v);
+}
+
+/*thread safe equivalent of myWorldToVoxel for a matrix looked up with
+  cacheWorldToVoxel (same float arithmetic as MatrixMultiply)*/
+static void WorldToVoxel(const float *m, double x, double y, double z,
+                         double *px, double *py, double *pz)
+{
+  float xf=x,yf=y,zf=z,val;
+  int r;
+  double *p[3]= {px,py,pz};
+
+  for (r=0; r<3; r++)
+  {
+    val=0;
+    val+=m[4*r]*xf;
+    val+=m[4*r+1]*yf;
+    val+=m[4*r+2]*zf;
+    val+=m[4*r+3]*1.0f;
+    *p[r]=val;
+  }
+}
+
 template <typename T> void DebugCurve(const T *percent,
                                       const int max, const char *msg)
 {
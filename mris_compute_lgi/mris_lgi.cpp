@@ -0,0 +1,211 @@
+/**
+ * @brief computes the local gyrification index of a pial surface
+ *
+ * Compiled replacement for the MATLAB stages of mris_compute_lgi
+ * (find_corresponding_center_FSformat.m, make_roi_paths.m,
+ * mri_path2label --confillx and compute_lgi.m). Takes the pial surface and
+ * its smoothed outer surface and writes the lGI of every pial vertex.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+#include "macros.h"
+#include "error.h"
+#include "diag.h"
+#include "proto.h"
+#include "mrisurf.h"
+#include "mrislgi.h"
+#include "version.h"
+
+#include "romp_support.h"
+
+int main(int argc, char *argv[]) ;
+
+static int  get_option(int argc, char *argv[]) ;
+static void usage_exit(void) ;
+static void print_usage(void) ;
+static void print_help(void) ;
+static void print_version(void) ;
+
+const char *Progname ;
+
+static double radius = LGI_DEFAULT_RADIUS ;
+static int stepsize = LGI_DEFAULT_STEPSIZE ;
+static char *outer_lgi_name = NULL ;
+
+int
+main(int argc, char *argv[])
+{
+  char          *pial_name, *outer_name, *out_name ;
+  int           nargs, vno ;
+  MRI_SURFACE   *mris_pial, *mris_outer ;
+  float         *pial_lgi, *outer_lgi = NULL ;
+
+  nargs = handleVersionOption(argc, argv, "mris_lgi");
+  if (nargs && argc - nargs == 1)
+    exit (0);
+  argc -= nargs;
+
+  Progname = argv[0] ;
+  ErrorInit(NULL, NULL, NULL) ;
+  DiagInit(NULL, NULL, NULL) ;
+
+  for ( ; argc > 1 && ISOPTION(*argv[1]) ; argc--, argv++) {
+    nargs = get_option(argc, argv) ;
+    argc -= nargs ;
+    argv += nargs ;
+  }
+
+  if (argc < 4)
+    usage_exit() ;
+  pial_name = argv[1] ;
+  outer_name = argv[2] ;
+  out_name = argv[3] ;
+
+  mris_pial = MRISread(pial_name) ;
+  if (!mris_pial)
+    ErrorExit(ERROR_NOFILE, "%s: could not read surface file %s",
+              Progname, pial_name) ;
+  mris_outer = MRISread(outer_name) ;
+  if (!mris_outer)
+    ErrorExit(ERROR_NOFILE, "%s: could not read surface file %s",
+              Progname, outer_name) ;
+  MRIScomputeMetricProperties(mris_outer) ;
+
+  pial_lgi = (float *)calloc(mris_pial->nvertices, sizeof(float)) ;
+  if (outer_lgi_name)
+    outer_lgi = (float *)calloc(mris_outer->nvertices, sizeof(float)) ;
+  if (!pial_lgi || (outer_lgi_name && !outer_lgi))
+    ErrorExit(ERROR_NOMEMORY, "%s: could not allocate lGI arrays", Progname) ;
+
+  if (MRIScomputeLGI(mris_pial, mris_outer, radius, stepsize, pial_lgi, outer_lgi) != NO_ERROR)
+    ErrorExit(Gerror, "%s: lGI computation failed", Progname) ;
+
+  for (vno = 0 ; vno < mris_pial->nvertices ; vno++)
+    mris_pial->vertices[vno].curv = pial_lgi[vno] ;
+  printf("writing lGI to %s\n", out_name) ;
+  if (MRISwriteCurvature(mris_pial, out_name) != NO_ERROR)
+    ErrorExit(ERROR_BADFILE, "%s: could not write %s", Progname, out_name) ;
+
+  if (outer_lgi_name) {
+    for (vno = 0 ; vno < mris_outer->nvertices ; vno++)
+      mris_outer->vertices[vno].curv = outer_lgi[vno] ;
+    printf("writing outer surface lGI to %s\n", outer_lgi_name) ;
+    if (MRISwriteCurvature(mris_outer, outer_lgi_name) != NO_ERROR)
+      ErrorExit(ERROR_BADFILE, "%s: could not write %s", Progname, outer_lgi_name) ;
+    free(outer_lgi) ;
+  }
+
+  free(pial_lgi) ;
+  MRISfree(&mris_outer) ;
+  MRISfree(&mris_pial) ;
+  exit(0) ;
+  return(0) ;  /* for ansi */
+}
+
+/*----------------------------------------------------------------------
+            Parameters:
+
+           Description:
+----------------------------------------------------------------------*/
+static int
+get_option(int argc, char *argv[]) {
+  int  nargs = 0 ;
+  char *option ;
+
+  option = argv[1] + 1 ;            /* past '-' */
+  if (!stricmp(option, "-help"))
+    print_usage() ;
+  else if (!stricmp(option, "-version"))
+    print_version() ;
+  else if (!stricmp(option, "radius")) {
+    radius = atof(argv[2]) ;
+    printf("using regions of radius %2.1f mm\n", radius) ;
+    nargs = 1 ;
+  }
+  else if (!stricmp(option, "step")) {
+    stepsize = atoi(argv[2]) ;
+    printf("computing a region every %d vertices\n", stepsize) ;
+    nargs = 1 ;
+  }
+  else if (!stricmp(option, "outer_lgi")) {
+    outer_lgi_name = argv[2] ;
+    nargs = 1 ;
+  }
+  else if (!stricmp(option, "threads")) {
+#ifdef HAVE_OPENMP
+    omp_set_num_threads(atoi(argv[2])) ;
+#else
+    fprintf(stderr, "Warning - built without openmp support\n") ;
+#endif
+    nargs = 1 ;
+  }
+  else switch (toupper(*option)) {
+  case 'V':
+    Gdiag_no = atoi(argv[2]) ;
+    nargs = 1 ;
+    break ;
+  case '?':
+  case 'U':
+    print_usage() ;
+    exit(1) ;
+    break ;
+  default:
+    fprintf(stderr, "unknown option %s\n", argv[1]) ;
+    exit(1) ;
+    break ;
+  }
+
+  return(nargs) ;
+}
+
+static void
+usage_exit(void) {
+  print_usage() ;
+  exit(1) ;
+}
+
+static void
+print_usage(void) {
+  fprintf(stderr,
+    "usage: %s [options] <pial surface> <outer smoothed surface> <output lGI>\n", Progname) ;
+  print_help() ;
+}
+
+static void
+print_help(void) {
+  fprintf(stderr,
+    "\nComputes the local gyrification index (Schaer et al., IEEE TMI 2007) of every\n"
+    "vertex of the pial surface, using the smoothed outer surface made by\n"
+    "mris_compute_lgi as the hull. The regions are computed in parallel.\n") ;
+  fprintf(stderr, "\nvalid options are:\n\n") ;
+  fprintf(stderr, "  -radius <mm>      radius of the outer surface regions (default %2.1f)\n",
+          LGI_DEFAULT_RADIUS) ;
+  fprintf(stderr, "  -step <n>         compute a region every <n> outer vertices (default %d)\n",
+          LGI_DEFAULT_STEPSIZE) ;
+  fprintf(stderr, "  -outer_lgi <file> also write the lGI of the region centers on the outer surface\n") ;
+  fprintf(stderr, "  -threads <n>      use <n> threads\n") ;
+  exit(1) ;
+}
+
+static void
+print_version(void) {
+  fprintf(stderr, "%s\n", getVersion().c_str()) ;
+  exit(1) ;
+}
@@ -980,14 +980,16 @@ double DHiters2fwhm(MRIS *surf, int vtxno, int niters, char *outfile)
   double f, fn, areasum, fwhmRet;
   double fwhm[1000], fwhmv[1000], fn2sum[1000], fwhmdng;
   FILE *fp;
+  MRIS_SMOOTH_OP *op;
 
   mri  = MRIalloc(surf->nvertices,1,1,MRI_FLOAT);
   MRIsetVoxVal(mri,vtxno,0,0,0, 100);
+  op = MRISsmoothOpBuild(surf, NULL); // build once, smooth 1 step per iter
   XtX = 0;
   Xty = 0;
   vXty = 0;
   for(k = 0; k < niters; k++){
-    MRISsmoothMRI(surf, mri, 1, NULL, mri);
+    MRISsmoothOpApply(op, mri, 1, mri);
     f = MRIgetVoxVal(mri,vtxno,0,0,0); // = max
     nhits = 0; // number of vertices over max/2
     areasum = 0.0; // area of vertices over max/2
@@ -1010,6 +1012,7 @@ double DHiters2fwhm(MRIS *surf, int vtxno, int niters, char *outfile)
       vXty += (fwhmv[k]*sqrt((double)(k+1)));
     }
   }
+  MRISsmoothOpFree(&op);
   fwhmRet = fwhm[k-1];
 
   // Fit
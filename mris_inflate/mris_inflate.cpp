@@ -40,6 +40,7 @@
 #include "mri.h"
 #include "macros.h"
 #include "version.h"
+#include "mrisurf_multigrid.h"
 
 
 int main(int argc, char *argv[]) ;
@@ -68,6 +69,7 @@ static int SaveSulc = 1;
 static int compute_sulc_mm = 0 ;
 static int scale_brain = 1 ;
 static const char *sulc_name = "sulc" ;
+static int multigrid_levels = 0 ;
 char *rusage_file=NULL;
 
 int
@@ -134,6 +136,9 @@ main(int argc, char *argv[])
   {
     print_help() ;
   }
+  if (multigrid_levels > 0 && (!FZERO(parms.l_sphere) || parms.explode_flag))
+    ErrorExit(ERROR_BADPARM, "%s: -multigrid cannot be combined with -sphere or -explode",
+              Progname) ;
 
   in_fname = argv[1] ;
   out_fname = argv[2] ;
@@ -204,7 +209,12 @@ main(int argc, char *argv[])
       MRISaverageCurvatures(mris, curvature_avgs) ;
       MRIScurvToD(mris) ;  // for writing curvature in mrisWriteSnapshot
     }
-    MRISinflateBrain(mris, &parms) ;
+    if (multigrid_levels > 0)
+      MRISinflateBrainMultigrid(mris, &parms, multigrid_levels) ;
+    else
+      MRISinflateBrain(mris, &parms) ;
+    if (!parms.explode_flag)
+      MRISprintDistortion(mris, stdout, "inflated surface") ;
 #else
     parms.n_averages = 32 ;
     parms.niterations = 30 ;
@@ -394,6 +404,16 @@ get_option(int argc, char *argv[])
   {
     SaveSulc=0;
   }
+  else if (!stricmp(option, "multigrid"))
+  {
+    if (argc < 2)
+    {
+      print_usage() ;
+    }
+    multigrid_levels = atoi(argv[2]) ;
+    nargs = 1 ;
+    fprintf(stderr, "inflating on %d coarser levels first\n", multigrid_levels) ;
+  }
   else if (!stricmp(option, "spring"))
   {
     if (argc < 2)
@@ -33,6 +33,7 @@
 #include "mri.h"
 #include "mrisurf.h"
 #include "mrisurf_project.h"
+#include "mrisurf_multigrid.h"
 
 #include "romp_support.h"
 #include "error.h"
@@ -101,6 +102,7 @@ static char *xform_fname = NULL ;
 static char *vol_fname = NULL ;
 
 static int remove_negative = 1 ;
+static int multigrid_levels = 0 ;
 char *rusage_file=NULL;
 
 int
@@ -164,6 +166,8 @@ main(int argc, char *argv[])
   {
     usage_exit() ;
   }
+  if (multigrid_levels > 0 && quick)
+    ErrorExit(ERROR_BADPARM, "%s: -multigrid cannot be combined with -q", Progname) ;
 
   parms.base_dt = base_dt_scale * parms.dt ;
   in_surf_fname = argv[1] ;
@@ -400,7 +404,11 @@ main(int argc, char *argv[])
   }
   else
   {
-    MRISunfold(mris, &parms, max_passes) ;
+    if (multigrid_levels > 0)
+      MRISunfoldMultigrid(mris, &parms, max_passes, multigrid_levels) ;
+    else
+      MRISunfold(mris, &parms, max_passes) ;
+    MRISprintDistortion(mris, stdout, "spherical surface") ;
   }
   if (remove_negative)
   {
@@ -726,6 +734,12 @@ get_option(int argc, char *argv[])
     nargs = 1 ;
     fprintf(stderr, "dt_decrease=%2.3f\n", parms.dt_decrease) ;
   }
+  else if (!stricmp(option, "multigrid"))
+  {
+    multigrid_levels = atoi(argv[2]) ;
+    nargs = 1 ;
+    fprintf(stderr, "unfolding on %d coarser levels first\n", multigrid_levels) ;
+  }
   else if (!stricmp(option, "seed"))
   {
     setRandomSeed(atol(argv[2])) ;
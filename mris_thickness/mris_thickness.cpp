@@ -65,6 +65,7 @@ static char sdir[STRLEN] = "" ;
 static int fmin_thick = 0 ;
 static float laplace_res = 0.5 ;
 static int laplace_thick = 0 ;
+static int closest_point_thick = 0 ;
 static INTEGRATION_PARMS parms ;
 
 static char *long_fname = NULL ;
@@ -416,6 +417,8 @@ main(int argc, char *argv[]) {
   }
   else if (write_vertices) {
     MRISfindClosestOrigVertices(mris, nbhd_size) ;
+  } else if (closest_point_thick) {
+    MRISmeasureCorticalThicknessClosestPoint(mris, max_thick) ;
   } else {
     MRISmeasureCorticalThickness(mris, nbhd_size, max_thick) ;
   }
@@ -553,6 +556,9 @@ get_option(int argc, char *argv[]) {
   } else if (!stricmp(option, "new") || !stricmp(option, "fmin") || !stricmp(option, "variational")) {
     fmin_thick = 1 ;
     fprintf(stderr,  "using variational thickness measurement\n") ;
+  } else if (!stricmp(option, "closest_point")) {
+    closest_point_thick = 1 ;
+    fprintf(stderr,  "measuring thickness to the closest point of the opposite surface\n") ;
   } else if (!stricmp(option, "laplace") || !stricmp(option, "laplacian")) {
     laplace_thick = 1 ;
     laplace_res = atof(argv[2]) ;
@@ -642,6 +648,9 @@ print_help(void) {
           "<thickness file>.\n") ;
   fprintf(stderr, "\nvalid options are:\n\n") ;
   fprintf(stderr, "-max <max>\t use <max> to threshold thickness (default=5mm)\n") ;
+  fprintf(stderr, "-closest_point\t average the distances from each white vertex to the closest point of the\n"
+                  "\t\t pial surface and from each pial vertex to the closest point of the white surface,\n"
+                  "\t\t instead of to the closest vertex within the -n neighborhood\n") ;
   fprintf(stderr, "-fill_holes <cortex label> <fsaverage cortex label> fill in thickness in holes in the cortex label\n");
   printf("\n");
   printf("-thickness-from-seg surf label seg.mgz dmaxmm (eg, 6) ddeltamm (eg, .01) output.mgz\n");
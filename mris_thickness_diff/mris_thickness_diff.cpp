@@ -29,6 +29,7 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <vector>
 #include "macros.h"
 #include "error.h"
 #include "diag.h"
@@ -37,10 +38,12 @@
 #include "mri.h"
 #include "macros.h"
 #include "mrishash.h"
+#include "mrisurf_closest.h"
 #include "mri_identify.h"
 #include "annotation.h"
 #include "icosahedron.h"
 #include "version.h"
+#include "romp_support.h"
 
 #define MAX_DATA_NUMBERS 200
 #define DEBUG 0
@@ -124,12 +127,6 @@ static MRI *mri_dst = 0;
 static int invert = 0 ;
 static char *xform_fname = NULL;
 
-double v_to_f_distance(VERTEX *P0,
-                       MRI_SURFACE *mri_surf,
-                       int face_number,
-                       int debug,
-                       double *sopt,
-                       double *topt);
 
 
 int main(int argc, char *argv[])
@@ -958,171 +955,6 @@ static int get_option(int argc, char *argv[])
 }
 
 
-double v_to_f_distance(VERTEX *P0,
-                       MRI_SURFACE *mri_surf,
-                       int face_number,
-                       int debug,
-                       double *sopt,
-                       double *topt)
-{
-  /* Compute the distance from point P0 to a face of the surface mesh */
-  /* (sopt, topt) determines the closest point inside the triangle from P0 */
-
-  double a, b, c, d, e, f, det, s, t, invDet;
-  double numer, denom, tmp0, tmp1;
-  VERTEX *V1, *V2, *V3;
-  FACE *face;
-
-  struct { float x,y,z; } E0, E1, D;
-
-  face = &mri_surf->faces[face_number];
-  V1 = &mri_surf->vertices[face->v[0]];
-  V2 = &mri_surf->vertices[face->v[1]];
-  V3 = &mri_surf->vertices[face->v[2]];
-
-  E0.x = V2->x - V1->x;
-  E0.y = V2->y - V1->y;
-  E0.z = V2->z - V1->z;
-  E1.x = V3->x - V1->x;
-  E1.y = V3->y - V1->y;
-  E1.z = V3->z - V1->z;
-  D.x = V1->x - P0->x;
-  D.y = V1->y - P0->y;
-  D.z = V1->z - P0->z;
-
-  a = E0.x *E0.x + E0.y * E0.y + E0.z *E0.z;
-  b = E0.x *E1.x + E0.y * E1.y + E0.z *E1.z;
-  c = E1.x *E1.x + E1.y * E1.y + E1.z *E1.z;
-  d = E0.x *D.x + E0.y * D.y + E0.z *D.z;
-  e = E1.x *D.x + E1.y * D.y + E1.z *D.z;
-  f = D.x *D.x + D.y * D.y + D.z *D.z;
-
-  det = a*c - b*b;
-  s = b*e - c*d;
-  t = b*d - a*e;
-
-  if (debug) printf("det = %g\n", det);
-  if (s + t <= det)
-  {
-    if (s < 0)
-    {
-      if (t<0)
-      {
-        /* Region 4 */
-        if ( d < 0)
-        { /* Minimum on edge t = 0 */
-          s = (-d >= a ? 1 : -d/a);
-          t = 0;
-        }
-        else if (e < 0)
-        { /* Minimum on edge s = 0 */
-          t = (-e >= c ? 1 : -e/c);
-          s = 0;
-        }
-        else
-        {
-          s = 0;
-          t = 0;
-        }
-        if (debug)
-          printf("region 4,  d= %g, e = %g, s =%g, t =%g\n", d, e, s, t);
-      }
-      else
-      {
-        /* Region 3 */
-        s = 0;
-        t = ( e >= 0 ? 0 : (-e >= c ? 1 : (-e/c)));
-        if (debug) printf("region 3, s =%g, t =%g\n", s, t);
-      }
-    }
-    else if (t < 0)
-    {
-      /* Region 5 */
-      t = 0;
-      s = (d >= 0 ? 0 :(-d >= a ? 1 : (-d/a)));
-      if (debug) printf("region 5, s =%g, t =%g\n", s, t);
-    }
-    else
-    {
-      /* Region 0 */
-      invDet = 1/det;
-      s *= invDet;
-      t *= invDet;
-      if (debug) printf("region 0, s =%g, t =%g\n", s, t);
-    }
-  }
-  else
-  {
-    if ( s < 0 )
-    {
-      /* Region 2 */
-      tmp0 = b + d;
-      tmp1 = c + e;
-      if (tmp1 > tmp0)
-      {
-        numer = tmp1 - tmp0;
-        denom = a - b - b +c;
-        s = (numer >= denom ? 1 : numer/denom);
-        t = 1-s;
-      }
-      else
-      {
-        s = 0;
-        /* t = (e >= 0 ? 0 : (-e >= c ? 0 > = c + e = tmp1) */
-        t = (tmp1 <= 0 ? 1 : (e >= 0 ? 0 : -e/c));
-      }
-      if (debug) printf("region 2, s =%g, t =%g\n", s, t);
-    }
-    else if ( t < 0)
-    {
-      /* Region 6 */
-      tmp0 = b + e;
-      tmp1 = a + d;
-      if (tmp1 > tmp0)
-      { /* Minimum at line s + t = 1 */
-        numer = tmp1 - tmp0; /* Positive */
-        denom = a + c - b -b;
-        t = (numer >= denom ? 1 : (numer/denom));
-        s = 1 - t;
-      }
-      else
-      { /* Minimum at line t = 0 */
-        s = (tmp1 <= 0 ? 1 : (d >= 0 ? 0 : -d/a));
-        t = 0;
-      }
-      if (debug) printf("region 6, s =%g, t =%g\n", s, t);
-    }
-    else
-    {
-      /* Region 1 */
-      numer = c + e - b - d;
-      if (numer <= 0)
-      {
-        s = 0;
-      }
-      else
-      {
-        denom = a + c - b - b; /* denom is positive */
-        s = (numer >= denom ? 1 : (numer/denom));
-      }
-      t = 1-s;
-      if (debug) printf("region 1, s =%g, t =%g\n", s, t);
-    }
-  }
-
-  if ( s < 0  || s > 1 || t < 0 || t > 1)
-  {
-    printf("Error in computing s and t \n");
-  }
-
-  *sopt = s;
-  *topt = t;
-  /* return (sqrt(a*s*s + 2*b*s*t + c*t*t + 2*d*s + 2*e*t + f)); */
-  /* The square-root will be taken later to save time */
-  return (a*s*s + 2*b*s*t + c*t*t + 2*d*s + 2*e*t + f);
-}
-
-
 MRI *ComputeDifferenceNew(MRI_SURFACE *Mesh1,
                           MRI *mri_data1,
                           MRI_SURFACE *Mesh2,
@@ -1130,19 +962,13 @@ MRI *ComputeDifferenceNew(MRI_SURFACE *Mesh1,
                           MRI *mri_res)
 {
   /* This one will do a more accurate interpolation */
-  int index, k, facenumber, closestface, nnindex;
-  VERTEX *vertex;
-  double sumcurv, sumweight, weight;
-  VERTEX *V1, *V2, *V3;
-  FACE *face;
-  double value, distance, tmps, tmpt;
-  double total_distance, tmp_distance;
-  double max_distance, std_dist;
-  float dmin;
-  MHT *SrcHash;
+  double max_distance, total_distance, std_dist;
+  MRIS_FACE_GRID *grid;
 	MRI *mri_resampled = MRIclone(mri_data1, NULL);
 
-  SrcHash = MHTcreateVertexTable_Resolution(Mesh2, CURRENT_VERTICES,16);
+  /* the closest point of Mesh2 to each vertex of Mesh1 is searched
+     in all the faces, not only in those of the closest vertex */
+  grid = MRISfaceGridAlloc(Mesh2, CURRENT_VERTICES, 0);
 
   max_distance = 0;
 
@@ -1153,73 +979,39 @@ MRI *ComputeDifferenceNew(MRI_SURFACE *Mesh1,
   total_distance = 0.0;
   std_dist = 0;
 
-  for (index = 0; index < Mesh1->nvertices; index++)
-  {
-    if (Mesh1->vertices[index].border == 1) continue;
-    if (Mesh1->vertices[index].marked != 1) continue;
-    vertex = &Mesh1->vertices[index];
-    nnindex = MHTfindClosestVertexNo2(SrcHash,Mesh2,Mesh1,vertex,&dmin);
+  // distance of each vertex (-1 if skipped), summed in vertex order below
+  // so the statistics do not depend on the number of threads
+  std::vector<double> vdist(Mesh1->nvertices, -1.0);
 
-    /* nnIndex gives the closest vertex on
-       mris_template to the vertex #index of mris 
-       sanity-check it: */
-    if (nnindex >= Mesh2->nvertices)
-    {
-      printf("\nERROR: ComputeDifferenceNew: MHTfindClosestVertexNo "
-             "vidx %d returned nnindex=%d, which is >= nvertices=%d\n", 
-             index,nnindex, Mesh2->nvertices);
-      exit(1);
-    }
-    if (nnindex < 0)
-    {
-      printf("\nERROR: ComputeDifferenceNew: MHTfindClosestVertexNo "
-             "vidx %d returned nnindex=%d, which is invalid\n", index, nnindex);
-      exit(1);
-    }
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(guided)
+#endif
+  for (int index = 0; index < Mesh1->nvertices; index++)
+  {
+    ROMP_PFLB_begin
+    if (Mesh1->vertices[index].border == 1) ROMP_PFLB_continue;
+    if (Mesh1->vertices[index].marked != 1) ROMP_PFLB_continue;
+    VERTEX const *vertex = &Mesh1->vertices[index];
+    double distance;
+    int closestface = MRISfaceGridClosestPoint(grid, vertex->x, vertex->y, vertex->z, 1e10, &distance, NULL);
 
-    /* Now need to find the closest face in order
-       to perform linear interpolation,
-       but first, a sanity-check: */
-    if (Mesh2->vertices_topology[nnindex].num <= 0) 
+    if (closestface < 0)
     {
-      printf("\nERROR: ComputeDifferenceNew: \n"
-             "(Mesh2->vertices[nnindex].num=%d <= 0)\n", 
-             Mesh2->vertices_topology[nnindex].num);
+      printf("\nERROR: ComputeDifferenceNew: no face of the second surface "
+             "found for vidx %d\n", index);
       exit(1);
     }
-    distance = 1e30;
-    closestface = 0;
-    for (k=0; k < Mesh2->vertices_topology[nnindex].num; k++)
-    {
-
-      facenumber =  Mesh2->vertices_topology[nnindex].f[k]; /* index of the k-th face */
-      if (facenumber < 0 || facenumber >= Mesh2->nfaces) continue;
-      value = v_to_f_distance(vertex, Mesh2, facenumber, 0, &tmps, &tmpt);
-      /* Here it would be better to compute the correct distance together
-			   with the closest point and then use barycentric coordinates below (mr) */
-
-      if (distance > value)
-      {
-        distance = value;
-        closestface = facenumber;
-      }
-    }
 
-    if (compute_distance)
-    {
-      tmp_distance =  sqrt(distance);
-      if (max_distance < tmp_distance) max_distance = tmp_distance;
-      total_distance += (tmp_distance);
-      std_dist += distance;
-    }
+    vdist[index] = distance;
 
-    face = &Mesh2->faces[closestface];
-    V1 = &Mesh2->vertices[face->v[0]];
-    V2 = &Mesh2->vertices[face->v[1]];
-    V3 = &Mesh2->vertices[face->v[2]];
-    sumcurv = 0.0;
-    sumweight = 0.0;
-    weight = 1.0/(1e-20 +
+    FACE const *face = &Mesh2->faces[closestface];
+    VERTEX const *V1 = &Mesh2->vertices[face->v[0]];
+    VERTEX const *V2 = &Mesh2->vertices[face->v[1]];
+    VERTEX const *V3 = &Mesh2->vertices[face->v[2]];
+    double sumcurv = 0.0;
+    double sumweight = 0.0;
+    double weight = 1.0/(1e-20 +
                   (V1->x - vertex->x)*(V1->x - vertex->x) +
                   (V1->y - vertex->y)*(V1->y - vertex->y) +
                   (V1->z - vertex->z)*(V1->z - vertex->z));
@@ -1245,7 +1037,7 @@ MRI *ComputeDifferenceNew(MRI_SURFACE *Mesh1,
     MRIsetVoxVal(mri_resampled,index, 0, 0, 0, sumcurv);
 		
 		
-    value =  sumcurv -
+    double value =  sumcurv -
              MRIgetVoxVal(mri_data1,index,0,0,0);
 
     if (percentage)
@@ -1254,10 +1046,20 @@ MRI *ComputeDifferenceNew(MRI_SURFACE *Mesh1,
     }
 
     MRIsetVoxVal(mri_res,index, 0, 0, 0, value);
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
+  MRISfaceGridFree(&grid);
 
   if (compute_distance)
   {
+    for (int index = 0; index < Mesh1->nvertices; index++)
+    {
+      if (vdist[index] < 0) continue;
+      if (max_distance < vdist[index]) max_distance = vdist[index];
+      total_distance += vdist[index];
+      std_dist += vdist[index]*vdist[index];
+    }
     std_dist /= (Mesh1->nvertices + 1e-30);
     total_distance /= (Mesh1->nvertices + 1e-30);
     std_dist = sqrt(std_dist - total_distance* total_distance);
@@ -4,7 +4,8 @@
  * Uses the 4 surfaces of a scan to construct a mask volume showing the
  * position of each voxel with respect to the surfaces - GM, WM, LH or RH.
  *
- * Uses the MRISOBBTree algorithm
+ * The voxels inside each surface are found by scanline parity
+ * (MRISfillInteriors), for all the surfaces in one pass.
  */
 /*
  * Original Author: Krish Subramaniam
@@ -28,7 +29,6 @@
 #include <cstdio>
 #include <vector>
 
-#include "MRISOBBTree.h"
 #include "MRISdistancefield.h"
 #include "fastmarching.h"
 #include "cmd_line_interface.h"
@@ -53,8 +53,6 @@
 ;
 const char *Progname;
 
-typedef Math::Point<int> Pointd;
-
 // static function declarations
 // forward declaration
 struct IoParams;
@@ -100,10 +98,11 @@ LoadInputFiles(const IoParams& params,
 
 MRI* ComputeSurfaceDistanceFunction
 (MRIS* mris, //input surface
+ MRI* interiors, int bit, //bit of the voxels inside mris
  MRI* mriInOut, //output MRI structure
  float resolution);
 
-MRI* CreateHemiMask(MRI* dpial, MRI* dwhite,
+MRI* CreateHemiMask(MRI* interiors, int bitPial, int bitWhite,
                     const unsigned char lblWhite,
                     const unsigned char lblRibbon,
                     const unsigned char lblBackground);
@@ -240,6 +239,26 @@ main(int ac, char* av[])
   MRI* maskLeftHemi=NULL;
   MRI* maskRightHemi=NULL;
 
+  // find the voxels inside each of the surfaces, all in one pass. Bit
+  // bitLeftWhite of a voxel of interiors is set if it is inside the left
+  // white surface, etc.
+  MRIS* surfs[4];
+  int nsurfs = 0;
+  int bitLeftWhite = -1, bitLeftPial = -1, bitRightWhite = -1, bitRightPial = -1;
+  if (params.DoLH){
+    bitLeftWhite = nsurfs; surfs[nsurfs++] = surfLeftWhite;
+    bitLeftPial  = nsurfs; surfs[nsurfs++] = surfLeftPial;
+  }
+  if (params.DoRH){
+    bitRightWhite = nsurfs; surfs[nsurfs++] = surfRightWhite;
+    bitRightPial  = nsurfs; surfs[nsurfs++] = surfRightPial;
+  }
+  std::cout << "finding the voxels inside the surfaces \n" ;
+  MRI* interiors = MRIcloneDifferentType(mriTemplate, MRI_UCHAR);
+  MRISfillInteriors(surfs, nsurfs, interiors);
+
+  // the masks only need the interiors, the hemis only go on to compute
+  // the signed distances if they are to be saved
 #ifdef _OPENMP
   if (params.bParallel){
     printf("Running hemis in parallel\n");
@@ -260,105 +279,99 @@ main(int ac, char* av[])
       /*  Process LEFT hemisphere */
       printf("Processing left hemi\n"); fflush(stdout);
       
-      //---------------------
-      // proces white surface - convert to voxel-space
-      //
-      // allocate distance
-      MRI* dLeftWhite = MRIalloc( mriTemplate->width,
-				  mriTemplate->height,
-				  mriTemplate->depth,
-				  MRI_FLOAT );
-      MRIcopyHeader(mriTemplate, dLeftWhite);
-      
-      // Computes the signed distance to given surface. Sign indicates
-      // whether it is on the inside or outside. params.capValue -
-      // saturation/clip value for distance.
-      std::cout << "computing distance to left white surface \n" ;
-      ComputeSurfaceDistanceFunction(surfLeftWhite,
-				     dLeftWhite,
-				     params.capValue);
-      // if the option is there, output distance
       if ( params.bSaveDistance )
-	MRIwrite
-	  ( dLeftWhite,
-	    const_cast<char*>( (outputPath / "lh.dwhite." +
-				params.outRoot + ".mgz").c_str() )
-	    );
-      
-      //-----------------------
-      // process pial surface
-      MRI* dLeftPial = MRIalloc( mriTemplate->width,
-				 mriTemplate->height,
-				 mriTemplate->depth,
-				 MRI_FLOAT);
-      MRIcopyHeader(mriTemplate,dLeftPial);
-      std::cout << "computing distance to left pial surface \n" ;
-      ComputeSurfaceDistanceFunction(surfLeftPial,
-				     dLeftPial,
-				     params.capValue);
-      if ( params.bSaveDistance )
-	MRIwrite
-	  ( dLeftPial,
-	    const_cast<char*>( (outputPath / "lh.dpial." +
-				params.outRoot + ".mgz").c_str() )
-	    );
+      {
+        // Computes the signed distance to given surface. Sign indicates
+        // whether it is on the inside or outside. params.capValue -
+        // saturation/clip value for distance.
+        MRI* dLeftWhite = MRIalloc( mriTemplate->width,
+                                    mriTemplate->height,
+                                    mriTemplate->depth,
+                                    MRI_FLOAT );
+        MRIcopyHeader(mriTemplate, dLeftWhite);
+        std::cout << "computing distance to left white surface \n" ;
+        ComputeSurfaceDistanceFunction(surfLeftWhite,
+                                       interiors, bitLeftWhite,
+                                       dLeftWhite,
+                                       params.capValue);
+        MRIwrite
+          ( dLeftWhite,
+            const_cast<char*>( (outputPath / "lh.dwhite." +
+                                params.outRoot + ".mgz").c_str() )
+            );
+        MRIfree(&dLeftWhite);
+
+        MRI* dLeftPial = MRIalloc( mriTemplate->width,
+                                   mriTemplate->height,
+                                   mriTemplate->depth,
+                                   MRI_FLOAT);
+        MRIcopyHeader(mriTemplate,dLeftPial);
+        std::cout << "computing distance to left pial surface \n" ;
+        ComputeSurfaceDistanceFunction(surfLeftPial,
+                                       interiors, bitLeftPial,
+                                       dLeftPial,
+                                       params.capValue);
+        MRIwrite
+          ( dLeftPial,
+            const_cast<char*>( (outputPath / "lh.dpial." +
+                                params.outRoot + ".mgz").c_str() )
+            );
+        MRIfree(&dLeftPial);
+      }
       
-      // combine them and create a mask for the left hemi. Must be
-      // outside of white and inside pial. Creates labels for WM and Ribbon.
-      maskLeftHemi   = CreateHemiMask(dLeftPial,dLeftWhite,
+      // create a mask for the left hemi. Must be outside of white and
+      // inside pial. Creates labels for WM and Ribbon.
+      maskLeftHemi   = CreateHemiMask(interiors, bitLeftPial, bitLeftWhite,
 				      params.labelLeftWhite,
 				      params.labelLeftRibbon,
 				      params.labelBackground);
-      // no need for the hemi distances anymore
-      MRIfree(&dLeftWhite);
-      MRIfree(&dLeftPial);
     }
 
     if(hemi == 1 && params.DoRH){
       /* Process RIGHT hemi  */
       printf("Processing right hemi\n"); fflush(stdout);
       
-      //-------------------
-      // process white
-      MRI* dRightWhite = MRIalloc( mriTemplate->width,
-				   mriTemplate->height,
-				   mriTemplate->depth,
-				   MRI_FLOAT);
-      MRIcopyHeader(mriTemplate, dRightWhite);
-      std::cout << "computing distance to right white surface \n" ;
-      ComputeSurfaceDistanceFunction( surfRightWhite,
-				      dRightWhite,
-				      params.capValue);
       if ( params.bSaveDistance )
-	MRIwrite
-	  ( dRightWhite,
-	    const_cast<char*>( (outputPath / "rh.dwhite." +
-				params.outRoot + ".mgz").c_str() )
-	    );
-      
-      //--------------------
-      // process pial
-      MRI* dRightPial = MRIalloc( mriTemplate->width,
-				  mriTemplate->height,
-				  mriTemplate->depth,
-				  MRI_FLOAT);
-      MRIcopyHeader(mriTemplate, dRightPial);
-      std::cout << "computing distance to right pial surface \n" ;
-      ComputeSurfaceDistanceFunction(surfRightPial,
-				     dRightPial,
-				     params.capValue);
-      if(params.bSaveDistance )
-	MRIwrite( dRightPial,const_cast<char*>( (outputPath/"rh.dpial."+params.outRoot + ".mgz").c_str() ));
+      {
+        MRI* dRightWhite = MRIalloc( mriTemplate->width,
+                                     mriTemplate->height,
+                                     mriTemplate->depth,
+                                     MRI_FLOAT);
+        MRIcopyHeader(mriTemplate, dRightWhite);
+        std::cout << "computing distance to right white surface \n" ;
+        ComputeSurfaceDistanceFunction( surfRightWhite,
+                                        interiors, bitRightWhite,
+                                        dRightWhite,
+                                        params.capValue);
+        MRIwrite
+          ( dRightWhite,
+            const_cast<char*>( (outputPath / "rh.dwhite." +
+                                params.outRoot + ".mgz").c_str() )
+            );
+        MRIfree(&dRightWhite);
+
+        MRI* dRightPial = MRIalloc( mriTemplate->width,
+                                    mriTemplate->height,
+                                    mriTemplate->depth,
+                                    MRI_FLOAT);
+        MRIcopyHeader(mriTemplate, dRightPial);
+        std::cout << "computing distance to right pial surface \n" ;
+        ComputeSurfaceDistanceFunction(surfRightPial,
+                                       interiors, bitRightPial,
+                                       dRightPial,
+                                       params.capValue);
+        MRIwrite( dRightPial,const_cast<char*>( (outputPath/"rh.dpial."+params.outRoot + ".mgz").c_str() ));
+        MRIfree(&dRightPial);
+      }
+
       // compute hemi mask
-      maskRightHemi = CreateHemiMask(dRightPial, dRightWhite,
+      maskRightHemi = CreateHemiMask(interiors, bitRightPial, bitRightWhite,
 				     params.labelRightWhite,
 				     params.labelRightRibbon,
 				     params.labelBackground);
-      // no need for the hemi distances anymore
-      MRIfree(&dRightWhite);
-      MRIfree(&dRightPial);
     }
   }
+  MRIfree(&interiors);
   
   /*  finally combine the two created masks -- need to resolve overlap  */
 
@@ -636,183 +649,77 @@ LoadInputFiles(const IoParams& params,
 
 MRI*
 ComputeSurfaceDistanceFunction(MRIS* mris,
+                               MRI* interiors,
+                               int bit,
                                MRI* mri_distfield,
                                float thickness)
 {
-  int res;
-  MRI *mri_visited, *_mridist;
-  _mridist  = MRIclone(mri_distfield, NULL);
-  mri_visited  = MRIcloneDifferentType(mri_distfield, MRI_INT);
-
   // Convert surface vertices to vox space
   Math::ConvertSurfaceRASToVoxel(mris, mri_distfield);
 
   // Find the distance field
-  MRISDistanceField *distfield = new MRISDistanceField(mris, _mridist);
+  MRISDistanceField *distfield = new MRISDistanceField(mris, mri_distfield);
   distfield->SetMaxDistance(thickness);
-  distfield->Generate(); //mri_dist now has the distancefield
+  distfield->Generate(); //mri_distfield now has the distancefield
 
-  // Construct the OBB Tree
-  MRISOBBTree* OBBTree = new MRISOBBTree(mris);
-  OBBTree->ConstructTree();
-
-  std::queue<Pointd* > ptsqueue;
-  // iterate through all the volume points
-  // and apply sign
-  for(int i=0; i< mri_distfield->width; i++)
+  // apply the sign - positive inside the surface
+  for(int k=0; k< mri_distfield->depth; k++)
   {
-    //std::cerr << i <<" ";
     for(int j=0; j< mri_distfield->height; j++)
     {
-      for(int k=0; k< mri_distfield->depth; k++)
+      for(int i=0; i< mri_distfield->width; i++)
       {
-        if ( MRIIvox(mri_visited, i, j, k ))
-        {
-          continue;
-        }
-        res = OBBTree->PointInclusionTest(i, j, k);
-        Pointd *pt = new Pointd;
-        pt->v[0] = i;
-        pt->v[1] = j;
-        pt->v[2] = k;
-        ptsqueue.push( pt );
-
-        // First serve all the points in the queue before going to the next voxel
-        while ( !ptsqueue.empty() )
+        if ( !((MRIvox(interiors, i, j, k) >> bit) & 1) )
         {
-          // serve the front and pop it
-          Pointd *p = ptsqueue.front();
-          const int x = p->v[0];
-          const int y = p->v[1];
-          const int z = p->v[2];
-          delete p;
-          ptsqueue.pop();
-
-          if ( MRIIvox(mri_visited, x, y, z) )
-          {
-            continue;
-          }
-          MRIIvox(mri_visited, x, y, z) =  res;
-          const float dist = MRIFvox(_mridist, x, y, z);
-          MRIFvox(_mridist, x, y, z) =  dist*res;
-
-          // mark its 6 neighbors if distance > 1 ( triangle inequality )
-          if ( dist > 1 )
-          {
-            // left neighbor in x
-            if ( x>0 && !MRIIvox(mri_visited, x-1, y, z))
-            {
-              Pointd *ptemp = new Pointd;
-              ptemp->v[0]   = x - 1;
-              ptemp->v[1]   = y;
-              ptemp->v[2]   = z;
-              ptsqueue.push(ptemp);
-            }
-            // bottom neighbor in y
-            if ( y>0 && !MRIIvox(mri_visited, x, y-1, z))
-            {
-              Pointd *ptemp = new Pointd;
-              ptemp->v[0]   = x;
-              ptemp->v[1]   = y - 1;
-              ptemp->v[2]   = z;
-              ptsqueue.push(ptemp);
-            }
-            // front neighbor in z
-            if ( z>0 && !MRIIvox(mri_visited, x, y, z-1))
-            {
-              Pointd *ptemp = new Pointd;
-              ptemp->v[0]   = x;
-              ptemp->v[1]   = y;
-              ptemp->v[2]   = z - 1;
-              ptsqueue.push(ptemp);
-            }
-            // right neighbor in x
-            if ( x<mri_visited->width-1 && !MRIIvox(mri_visited, x+1, y, z))
-            {
-              Pointd *ptemp = new Pointd;
-              ptemp->v[0]   = x + 1;
-              ptemp->v[1]   = y;
-              ptemp->v[2]   = z;
-              ptsqueue.push(ptemp);
-            }
-            // top neighbor in y
-            if ( y<mri_visited->height-1 && !MRIIvox(mri_visited, x, y+1, z))
-            {
-              Pointd *ptemp = new Pointd;
-              ptemp->v[0]   = x;
-              ptemp->v[1]   = y + 1;
-              ptemp->v[2]   = z;
-              ptsqueue.push(ptemp);
-            }
-            // back neighbor in z
-            if ( z<mri_visited->depth-1 && !MRIIvox(mri_visited, x, y, z+1))
-            {
-              Pointd *ptemp = new Pointd;
-              ptemp->v[0]   = x;
-              ptemp->v[1]   = y;
-              ptemp->v[2]   = z + 1;
-              ptsqueue.push(ptemp);
-            }
-          }
+          MRIFvox(mri_distfield, i, j, k) = -MRIFvox(mri_distfield, i, j, k);
         }
       }
     }
   }
-  for(int i=0; i< mri_distfield->width; i++)
-  {
-    for(int j=0; j< mri_distfield->height; j++)
-    {
-      for(int k=0; k< mri_distfield->depth; k++)
-      {
-        MRIFvox(mri_distfield, i, j, k) = MRIFvox(_mridist, i, j, k);
-      }
-    }
-  }
 
-  MRIfree(&mri_visited);
-  MRIfree(&_mridist);
-  delete OBBTree;
   delete distfield;
   return(mri_distfield);
 }
 
 MRI*
-CreateHemiMask(MRI* dpial,
-               MRI* dwhite,
+CreateHemiMask(MRI* interiors,
+               int bitPial,
+               int bitWhite,
                const unsigned char lblWhite,
                const unsigned char lblRibbon,
                const unsigned char lblBackground)
 {
   // allocate return volume
-  MRI* mri = MRIalloc(dpial->width,
-                      dpial->height,
-                      dpial->depth,
+  MRI* mri = MRIalloc(interiors->width,
+                      interiors->height,
+                      interiors->depth,
                       MRI_UCHAR);
 
-  for (unsigned int z(0), depth(dpial->depth);
-       z<depth; ++z)
-    for (unsigned int y(0), height(dpial->height);
-         y<height; ++y)
-      for (unsigned int x(0), width(dpial->width);
-           x<width; ++x)
+  #ifdef HAVE_OPENMP
+  #pragma omp parallel for
+  #endif
+  for (int z=0; z<interiors->depth; ++z)
+    for (int y=0; y<interiors->height; ++y)
+      for (int x=0; x<interiors->width; ++x)
       {
-        if (x == (unsigned int)Gx &&
-            y == (unsigned int)Gy &&
-            z == (unsigned int)Gz)
+        if (x == Gx &&
+            y == Gy &&
+            z == Gz)
         {
           DiagBreak() ;
         }
-        if ( MRIFvox(dwhite,x,y,z) > 0 )
+        const unsigned char inside = MRIvox(interiors,x,y,z);
+        if ( (inside >> bitWhite) & 1 )
         {
-          MRIsetVoxVal(mri, x,y,z,0, lblWhite);
+          MRIvox(mri, x,y,z) = lblWhite;
         }
-        else if ( MRIFvox(dpial,x,y,z) > 0 )
+        else if ( (inside >> bitPial) & 1 )
         {
-          MRIsetVoxVal(mri, x,y,z,0, lblRibbon);
+          MRIvox(mri, x,y,z) = lblRibbon;
         }
         else
         {
-          MRIsetVoxVal(mri,x,y,z,0, lblBackground);
+          MRIvox(mri, x,y,z) = lblBackground;
         }
       } // next x,y,z
 
@@ -831,18 +738,16 @@ MRI* CombineMasks(MRI* maskOne,
                       maskOne->height,
                       maskOne->depth,
                       MRI_UCHAR);
-  unsigned char voxOne,voxTwo;
-
   unsigned int overlap = 0;
-  for (unsigned int z(0), depth(maskOne->depth);
-       z<depth; ++z)
-    for (unsigned int y(0), height(maskOne->height);
-         y<height; ++y)
-      for (unsigned int x(0), width(maskOne->width);
-           x<width; ++x)
+  #ifdef HAVE_OPENMP
+  #pragma omp parallel for reduction(+:overlap)
+  #endif
+  for (int z=0; z<maskOne->depth; ++z)
+    for (int y=0; y<maskOne->height; ++y)
+      for (int x=0; x<maskOne->width; ++x)
       {
-        voxOne = MRIvox(maskOne,x,y,z);
-        voxTwo = MRIvox(maskTwo,x,y,z);
+        const unsigned char voxOne = MRIvox(maskOne,x,y,z);
+        const unsigned char voxTwo = MRIvox(maskTwo,x,y,z);
         if ( voxOne!=lblBackground && voxTwo!=lblBackground )
         {
           // overlap
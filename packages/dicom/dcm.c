@@ -1372,6 +1372,59 @@ DCM_GetElementSize(DCM_OBJECT ** callerObject, DCM_TAG tag,
 }
 
 
+/* DCM_GetElementFileOffset
+**
+** Purpose:
+**  Return the position in the file of the value of one data element
+**  whose data were left in the file when the object was opened (the
+**  pixel data). This lets a caller read the header of a file without
+**  touching the pixel data.
+**
+** Parameter Dictionary:
+**  object    Pointer to caller's ACR object
+**  tag       Tag of the data element of interest
+**  rtnOffset Pointer to caller variable to hold the file offset
+**
+** Return Values:
+**
+**  DCM_NORMAL
+**  DCM_NULLOBJECT
+**  DCM_ILLEGALOBJECT
+**  DCM_ELEMENTNOTFOUND
+**
+** Algorithm:
+**  The element must exist and its data must not have been read into
+**  memory; otherwise DCM_ELEMENTNOTFOUND is returned.
+*/
+
+CONDITION
+DCM_GetElementFileOffset(DCM_OBJECT ** callerObject, DCM_TAG tag,
+                         long * rtnOffset) {
+  PRIVATE_OBJECT
+  ** object;
+  PRV_ELEMENT_ITEM
+  * elementItem;
+  CONDITION
+  cond;
+
+  object = (PRIVATE_OBJECT **) callerObject;
+  cond = checkObject(object, "DCM_GetElementFileOffset");
+  if (cond != DCM_NORMAL)
+    return cond;
+
+  elementItem = locateElement(object, tag);
+  if (elementItem == NULL || (*object)->fd == -1 ||
+      elementItem->element.d.ot != NULL)
+    return COND_PushCondition(DCM_ELEMENTNOTFOUND,
+                              DCM_Message(DCM_ELEMENTNOTFOUND),
+                              DCM_TAG_GROUP(tag), DCM_TAG_ELEMENT(tag),
+                              "DCM_GetElementFileOffset");
+
+  *rtnOffset = (long) elementItem->dataOffset;
+  return DCM_NORMAL;
+}
+
+
 /* DCM_ScanParseObject
 **
 ** Purpose:
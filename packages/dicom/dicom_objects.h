@@ -282,6 +282,9 @@ extern "C"
   DCM_GetElementSize(DCM_OBJECT ** obj, DCM_TAG tag,
                      U32 * retlen);
   CONDITION
+  DCM_GetElementFileOffset(DCM_OBJECT ** obj, DCM_TAG tag,
+                           long * offset);
+  CONDITION
   DCM_GetElementValueOffset(DCM_OBJECT **obj, DCM_ELEMENT *element,
                             unsigned long offset);
   typedef
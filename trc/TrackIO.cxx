@@ -58,6 +58,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "TrackIO.h"
+#include <sys/mman.h>
 
 ///// CTrackIO reference //////////////////
 const char* error_message[] = 
@@ -400,6 +401,165 @@ int CTrackReader::GetNumberOfTracks()
 
 ///////////////////////////////////////////////
 
+///// CTrackMappedReader reference //////////////////
+
+CTrackMappedReader::CTrackMappedReader()
+{
+	m_pMap = NULL;
+	m_nMapSize = 0;
+}
+
+bool CTrackMappedReader::Open(const char* filename, TRACK_HEADER* header)
+{
+	Close();
+	if (!CTrackReader::Open(filename, header))
+		return false;
+
+	// the header reader leaves the file at the first track
+	long nPos = ftell(m_pFile);
+	if (m_nSize > 0)
+		m_pMap = (char*)mmap(NULL, m_nSize, PROT_READ, MAP_PRIVATE, fileno(m_pFile), 0);
+	if (!m_pMap || m_pMap == (char*)MAP_FAILED)
+	{
+		m_pMap = NULL;
+		m_nErrorCode = TE_CAN_NOT_READ;
+		Close();
+		return false;
+	}
+	m_nMapSize = m_nSize;
+
+	// one pass over the point counts. a track that runs past the end of the
+	// file is dropped, as GetNextTrackData() would fail on it
+	const long nPointSize = sizeof(float)*(3+m_header.n_scalars);
+	while (nPos + (long)sizeof(int) <= m_nMapSize)
+	{
+		int n;
+		memcpy(&n, m_pMap+nPos, sizeof(int));
+		if (m_bByteSwap)
+			SWAP_INT(n);
+		long nNext = nPos + sizeof(int) + n*nPointSize + sizeof(float)*m_header.n_properties;
+		if (n < 0 || nNext > m_nMapSize)
+			break;
+		m_nOffsets.push_back(nPos);
+		m_nCounts.push_back(n);
+		nPos = nNext;
+	}
+
+	m_header.n_count = m_nOffsets.size();
+	if (header)
+		header->n_count = m_header.n_count;
+
+	return true;
+}
+
+bool CTrackMappedReader::Close()
+{
+	if (m_pMap)
+	{
+		munmap(m_pMap, m_nMapSize);
+		m_pMap = NULL;
+	}
+	m_nMapSize = 0;
+	m_nOffsets.clear();
+	m_nCounts.clear();
+
+	return CTrackIO::Close();
+}
+
+int CTrackMappedReader::GetPointCount(int ntrack) const
+{
+	if (ntrack < 0 || ntrack >= (int)m_nCounts.size())
+		return 0;
+	return m_nCounts[ntrack];
+}
+
+// Same buffers as GetNextTrackData(...), which have to be pre-allocated.
+bool CTrackMappedReader::GetTrackData(int ntrack, float* pt_data, float* scalars, float* properties) const
+{
+	if (!m_pMap || ntrack < 0 || ntrack >= (int)m_nOffsets.size())
+		return false;
+
+	const int nCount = m_nCounts[ntrack];
+	const int nScalars = m_header.n_scalars;
+	const char* p = m_pMap + m_nOffsets[ntrack] + sizeof(int);
+
+	if (nScalars == 0)
+		memcpy(pt_data, p, sizeof(float)*3*nCount);
+	else
+	{
+		for (int i = 0; i < nCount; i++)
+		{
+			memcpy(pt_data+i*3, p + i*sizeof(float)*(3+nScalars), sizeof(float)*3);
+			if (scalars)
+				memcpy(scalars+i*nScalars, p + (i*(3+nScalars)+3)*sizeof(float), sizeof(float)*nScalars);
+		}
+	}
+	if (m_header.n_properties && properties)
+		memcpy(properties, p + sizeof(float)*nCount*(3+nScalars), sizeof(float)*m_header.n_properties);
+
+	if (m_bByteSwap)
+	{
+		SWAP_FLOAT(pt_data, nCount*3);
+		if (nScalars && scalars)
+			SWAP_FLOAT(scalars, nCount*nScalars);
+		if (m_header.n_properties && properties)
+			SWAP_FLOAT(properties, m_header.n_properties);
+	}
+
+	return true;
+}
+
+// Reads tracks nfirst .. nfirst+ntracks-1 into one vector each, in parallel.
+// Successive calls walk a file in chunks that fit in memory. Returns the
+// number of tracks read.
+int CTrackMappedReader::ReadTracks(int nfirst, int ntracks, std::vector< std::vector<float> >& pts,
+	std::vector< std::vector<float> >* scalars, std::vector< std::vector<float> >* properties) const
+{
+	if (nfirst < 0)
+		nfirst = 0;
+	if (nfirst + ntracks > (int)m_nOffsets.size())
+		ntracks = (int)m_nOffsets.size() - nfirst;
+	if (ntracks <= 0)
+	{
+		pts.clear();
+		return 0;
+	}
+
+	pts.resize(ntracks);
+	if (scalars)
+		scalars->resize(ntracks);
+	if (properties)
+		properties->resize(ntracks);
+
+#ifdef HAVE_OPENMP
+	#pragma omp parallel for schedule(guided)
+#endif
+	for (int i = 0; i < ntracks; i++)
+	{
+		const int nCount = m_nCounts[nfirst+i];
+		pts[i].resize(nCount*3);
+		float* s = NULL;
+		float* prop = NULL;
+		if (scalars)
+		{
+			(*scalars)[i].resize(nCount*m_header.n_scalars);
+			if (m_header.n_scalars)
+				s = &(*scalars)[i][0];
+		}
+		if (properties)
+		{
+			(*properties)[i].resize(m_header.n_properties);
+			if (m_header.n_properties)
+				prop = &(*properties)[i][0];
+		}
+		GetTrackData(nfirst+i, nCount ? &pts[i][0] : NULL, s, prop);
+	}
+
+	return ntracks;
+}
+
+///////////////////////////////////////////////
+
 ///// CTrackReader reference //////////////////
 
 // One of the Initializers must be called before WriteNextTrackData()
@@ -503,6 +663,90 @@ bool CTrackWriter::WriteNextTrack(int ncount, float* pts, float* scalars, float*
 }
 
 
+// Writes a whole set of tracks. Each chunk of tracks is packed into one buffer
+// in parallel and written with a single call, instead of one call per point.
+// scalars and properties, if given, hold one vector per track.
+bool CTrackWriter::WriteTracks(const std::vector< std::vector<float> >& pts,
+	const std::vector< std::vector<float> >* scalars,
+	const std::vector< std::vector<float> >* properties)
+{
+	if (!m_pFile)
+	{
+		m_nErrorCode = TE_NOT_INITIALIZED;
+		return false;
+	}
+	m_nErrorCode = TE_NO_ERROR;
+
+	const int nScalars = m_header.n_scalars;
+	const int nProperties = m_header.n_properties;
+	const long nChunkSize = 1 << 22;	// floats
+	std::vector<float> buffer;
+	std::vector<long> start;
+
+	int nfirst = 0;
+	const int ntracks = (int)pts.size();
+	while (nfirst < ntracks && !m_nErrorCode)
+	{
+		// offset of each track of this chunk in the buffer
+		start.clear();
+		start.push_back(0);
+		int nlast = nfirst;
+		while (nlast < ntracks && (nlast == nfirst || start.back() < nChunkSize))
+		{
+			start.push_back(start.back() + 1 + (pts[nlast].size()/3)*(3+nScalars) + nProperties);
+			nlast++;
+		}
+		buffer.resize(start.back());
+
+#ifdef HAVE_OPENMP
+		#pragma omp parallel for schedule(guided)
+#endif
+		for (int i = nfirst; i < nlast; i++)
+		{
+			float* p = &buffer[start[i-nfirst]];
+			const int nCount = pts[i].size()/3;
+			// scalars or properties missing at the end of a track (or for the
+			// whole track) are written as 0
+			const float* s = NULL;
+			const float* prop = NULL;
+			long nsvalid = 0, npvalid = 0;
+			if (nScalars && scalars && i < (int)scalars->size() && !(*scalars)[i].empty())
+			{
+				s = &(*scalars)[i][0];
+				nsvalid = (*scalars)[i].size();
+			}
+			if (nProperties && properties && i < (int)properties->size() && !(*properties)[i].empty())
+			{
+				prop = &(*properties)[i][0];
+				npvalid = (*properties)[i].size();
+			}
+
+			memcpy(p, &nCount, sizeof(int));
+			p++;
+			for (int j = 0; j < nCount; j++)
+			{
+				memcpy(p, &pts[i][j*3], sizeof(float)*3);
+				p += 3;
+				for (int k = 0; k < nScalars; k++)
+				{
+					long n = (long)j*nScalars+k;
+					*p++ = n < nsvalid ? s[n] : 0;
+				}
+			}
+			for (int k = 0; k < nProperties; k++)
+				*p++ = k < npvalid ? prop[k] : 0;
+		}
+
+		if (fwrite(&buffer[0], sizeof(float)*buffer.size(), 1, m_pFile) != 1)
+			m_nErrorCode = TE_CAN_NOT_WRITE;
+		else
+			m_header.n_count += nlast - nfirst;
+		nfirst = nlast;
+	}
+
+	return m_nErrorCode == TE_NO_ERROR;
+}
+
 bool CTrackWriter::UpdateHeader(TRACK_HEADER header)
 {
 	if (!m_pFile)
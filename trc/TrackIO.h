@@ -55,6 +55,18 @@
 //
 //			reader.Close();
 //
+//			Tracks of a memory mapped file can also be read by index -
+//
+//			CTrackMappedReader reader;
+//			if (!reader.Open("foo.trk", &header))
+//				...
+//			for (int i = 0; i < reader.GetNumberOfTracks(); i++)
+//			{
+//				float* pts = new float[reader.GetPointCount(i)*3];
+//				reader.GetTrackData(i, pts);
+//				...
+//			}
+//
 ///////////////////////////////////////////////////////////////////////////////
 
 #ifndef _TrackIO_H_
@@ -220,6 +232,32 @@ protected:
 	bool			m_bAllowOldFormat;
 };
 
+// Reads a track file through a memory map. Open() walks the file once and
+// records where each track starts, so that any track can then be read by
+// index. The map and the index are not changed by GetTrackData() or
+// ReadTracks(), which can be called from several threads at once.
+class CTrackMappedReader : public CTrackReader
+{
+public:
+	CTrackMappedReader();
+	virtual ~CTrackMappedReader() { Close(); }
+
+	bool Open(const char* filename, TRACK_HEADER* header = NULL);
+	virtual bool Close();
+	int  GetNumberOfTracks() { return (int)m_nOffsets.size(); }
+	int  GetPointCount(int ntrack) const;
+	bool GetTrackData(int ntrack, float* pt_data, float* scalars = NULL, float* properties = NULL) const;
+	int  ReadTracks(int nfirst, int ntracks, std::vector< std::vector<float> >& pts,
+		std::vector< std::vector<float> >* scalars = NULL,
+		std::vector< std::vector<float> >* properties = NULL) const;
+
+protected:
+	char*	m_pMap;
+	long	m_nMapSize;
+	std::vector<long>	m_nOffsets;		// offset of the point count of each track
+	std::vector<int>	m_nCounts;		// number of points of each track
+};
+
 class CTrackWriter : public CTrackIO
 {
 public:
@@ -230,6 +268,9 @@ public:
 	bool Initialize(const char* filename, TRACK_HEADER header);
 	bool WriteNextTrack(int ncount, float* data);
 	bool WriteNextTrack(int ncount, float* pts, float* scalars, float* properties);
+	bool WriteTracks(const std::vector< std::vector<float> >& pts,
+		const std::vector< std::vector<float> >* scalars = NULL,
+		const std::vector< std::vector<float> >* properties = NULL);
 	bool UpdateHeader(TRACK_HEADER header);
 
 	virtual bool Close();
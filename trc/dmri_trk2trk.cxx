@@ -90,7 +90,6 @@ int main(int argc, char **argv) {
   int nargs, cputime;
   char outorient[4];
   string fname;
-  vector<float> point(3), fillstep(3, 0);
   vector< vector<float> > streamlines, overlays, properties;
   MATRIX *outv2r;
   MRI *inref = 0, *outref = 0, *outvol = 0;
@@ -217,7 +216,7 @@ int main(int argc, char **argv) {
 
   for (unsigned int itract = 0; itract < nTract; itract++) {
     int npts, nstr = 0;
-    CTrackReader trkreader;
+    CTrackMappedReader trkreader;
     TRACK_HEADER trkheadin;
 
     cout << "Processing input file " << itract+1 << " of " << nTract
@@ -245,64 +244,67 @@ int main(int argc, char **argv) {
         exit(1);
       }
 
-      while (trkreader.GetNextPointCount(&npts)) {
-        const int veclen  = npts * 3,
-                  overlen = npts * trkheadin.n_scalars;
-        float *iraw, *rawpts  = new float[veclen],
-                     *scalars = new float[overlen],
-                     *props   = new float[trkheadin.n_properties];
-        vector<float> newpts(veclen);
+      // Pick the streamlines to keep from the point counts in the index,
+      // then read and convert them in parallel
+      const int ntrk = trkreader.GetNumberOfTracks();
+      vector<int> selected;
 
-        // Read a streamline from input file
-        trkreader.GetNextTrackData(npts, rawpts, scalars, props);
+      for (nstr = 0; nstr < ntrk; nstr++) {
+        npts = trkreader.GetPointCount(nstr);
 
         if ( ((doNth || doEvery) && nstr != strNum) ||
              (lengthMin > -1 && npts <= lengthMin) ||
-             (lengthMax > -1 && npts >= lengthMax) ) {
-          delete[] rawpts;
-          delete[] scalars;
-          delete[] props;
-          nstr++;
+             (lengthMax > -1 && npts >= lengthMax) )
           continue;
-        }
 
         if (doEvery && nstr == strNum)
           strNum += everyNum;
 
-        iraw = rawpts;
+        selected.push_back(nstr);
+      }
 
-        // Divide by input voxel size and make 0-based to get voxel coords
-        for (vector<float>::iterator ipt = newpts.begin(); ipt < newpts.end();
-                                                           ipt += 3)
-          for (int k = 0; k < 3; k++) {
-            ipt[k] = *iraw / trkheadin.voxel_size[k] - .5;
-            iraw++;
-          }
+      const int nsel = (int) selected.size(),
+                kstr0 = (int) streamlines.size(),
+                kover0 = (int) overlays.size(),
+                kprop0 = (int) properties.size();
 
-        delete[] rawpts;
-        streamlines.push_back(newpts);
+      streamlines.resize(kstr0 + nsel);
 
-        // Store scalar overlays of input streamlines
-        if (overlen > 0) {
-          vector<float> newscalars(overlen);
+      // Store scalar overlays and properties of input streamlines
+      if (trkheadin.n_scalars > 0)
+        overlays.resize(kover0 + nsel);
 
-          copy(scalars, scalars+overlen, newscalars.begin());
+      if (trkheadin.n_properties > 0)
+        properties.resize(kprop0 + nsel);
 
-          delete[] scalars;
-          overlays.push_back(newscalars);
-        }
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for schedule(guided)
+#endif
+      for (int ksel = 0; ksel < nsel; ksel++) {
+        const int nptsel = trkreader.GetPointCount(selected[ksel]);
+        vector<float> &newpts = streamlines[kstr0 + ksel];
+        float *scalars = NULL, *props = NULL;
 
-        // Store properties of input streamlines
-        if (trkheadin.n_properties > 0) {
-          vector<float> newprops(trkheadin.n_properties);
+        newpts.resize(nptsel * 3);
 
-          copy(props, props+trkheadin.n_properties, newprops.begin());
+        if (trkheadin.n_scalars > 0) {
+          overlays[kover0 + ksel].resize(nptsel * trkheadin.n_scalars);
+          scalars = overlays[kover0 + ksel].data();
+        }
 
-          delete[] props;
-          properties.push_back(newprops);
+        if (trkheadin.n_properties > 0) {
+          properties[kprop0 + ksel].resize(trkheadin.n_properties);
+          props = properties[kprop0 + ksel].data();
         }
 
-        nstr++;
+        // Read a streamline from input file
+        trkreader.GetTrackData(selected[ksel], newpts.data(), scalars, props);
+
+        // Divide by input voxel size and make 0-based to get voxel coords
+        for (vector<float>::iterator ipt = newpts.begin(); ipt < newpts.end();
+                                                           ipt += 3)
+          for (int k = 0; k < 3; k++)
+            ipt[k] = ipt[k] / trkheadin.voxel_size[k] - .5;
       }
     }
     else if (!inAscList.empty()) {	// Read streamlines from text file
@@ -359,8 +361,13 @@ int main(int argc, char **argv) {
     nstr = streamlines.size();
 
     // Apply transformations
+    // (the transforms only read their matrices and morph volumes, so each
+    // thread can map its own streamlines)
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(guided)
+#endif
     for (int kstr = nstr-1; kstr >= 0; kstr--) {
-      vector<float> newpts;
+      vector<float> newpts, point(3), fillstep(3, 0);
 
       for (vector<float>::iterator ipt = streamlines[kstr].begin();
                                    ipt < streamlines[kstr].end(); ipt += 3) {
@@ -752,11 +759,16 @@ int main(int argc, char **argv) {
 
       MRIclear(outvol);
 
-      for (vector< vector<float> >::const_iterator istr = streamlines.begin();
-                                                   istr < streamlines.end();
-                                                   istr++)
-        for (vector<float>::const_iterator ipt = istr->begin();
-                                           ipt < istr->end(); ipt += 3) {
+      // Count streamline points per voxel, one streamline per thread
+      vector<int> nhits(outvol->width * outvol->height * outvol->depth, 0);
+
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for schedule(guided)
+#endif
+      for (int kstr = 0; kstr < (int) streamlines.size(); kstr++)
+        for (vector<float>::const_iterator ipt = streamlines[kstr].begin();
+                                           ipt < streamlines[kstr].end();
+                                           ipt += 3) {
           int ix = (int) round(ipt[0]),
               iy = (int) round(ipt[1]),
               iz = (int) round(ipt[2]);
@@ -768,10 +780,21 @@ int main(int argc, char **argv) {
           if (iz < 0)			iz = 0;
           if (iz >= outvol->depth)	iz = outvol->depth-1;
 
-          MRIsetVoxVal(outvol, ix, iy, iz, 0,
-                       MRIgetVoxVal(outvol, ix, iy, iz, 0) + 1);
+#ifdef HAVE_OPENMP
+          #pragma omp atomic
+#endif
+          nhits[ix + outvol->width * (iy + outvol->height * iz)]++;
         }
 
+      for (int iz = 0; iz < outvol->depth; iz++)
+        for (int iy = 0; iy < outvol->height; iy++)
+          for (int ix = 0; ix < outvol->width; ix++) {
+            const int nhit = nhits[ix + outvol->width * (iy + outvol->height * iz)];
+
+            if (nhit > 0)
+              MRIsetVoxVal(outvol, ix, iy, iz, 0, nhit);
+          }
+
       MRIwrite(outvol, fname.c_str());
     }
 
@@ -812,8 +835,6 @@ int main(int argc, char **argv) {
     if (!outTrkList.empty()) {
       CTrackWriter trkwriter;
       TRACK_HEADER trkheadout;
-      vector< vector<float> >::iterator iover = overlays.begin(),
-                                        iprop = properties.begin();
 
       // Set output .trk header
       if (inTrkList.empty()) {
@@ -895,40 +916,20 @@ int main(int argc, char **argv) {
         exit(1);
       }
 
-      for (vector< vector<float> >::iterator istr = streamlines.begin();
-                                             istr < streamlines.end(); istr++) {
-        // Make .5-based and multiply back by output voxel size
-        for (vector<float>::iterator ipt = istr->begin(); ipt < istr->end();
-                                                          ipt += 3)
+      // Make .5-based and multiply back by output voxel size
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for schedule(guided)
+#endif
+      for (int kstr = 0; kstr < (int) streamlines.size(); kstr++)
+        for (vector<float>::iterator ipt = streamlines[kstr].begin();
+                                     ipt < streamlines[kstr].end(); ipt += 3)
           for (int k = 0; k < 3; k++)
             ipt[k] = (ipt[k] + .5) * trkheadout.voxel_size[k];
 
-        if (overlays.empty()) {
-          if (properties.empty())
-            trkwriter.WriteNextTrack(istr->size()/3, &(istr->at(0)));
-          else {
-            // Transfer properties from input to output streamlines
-            trkwriter.WriteNextTrack(istr->size()/3, &(istr->at(0)),
-                                     NULL, &(iprop->at(0)));
-            iprop++;
-          }
-        }
-        else {
-          if (properties.empty()) {
-            // Transfer scalar overlays from input to output streamlines
-            trkwriter.WriteNextTrack(istr->size()/3, &(istr->at(0)),
-                                     &(iover->at(0)), NULL);
-            iover++;
-          }
-          else {
-            // Transfer overlays & properties from input to output streamlines
-            trkwriter.WriteNextTrack(istr->size()/3, &(istr->at(0)),
-                                     &(iover->at(0)), &(iprop->at(0)));
-            iover++;
-            iprop++;
-          }
-        }
-      }
+      // Transfer scalar overlays & properties from input to output streamlines
+      trkwriter.WriteTracks(streamlines,
+                            overlays.empty() ? NULL : &overlays,
+                            properties.empty() ? NULL : &properties);
 
       trkwriter.Close();
     }
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/timeb.h>
 #include <sys/types.h>
@@ -34,6 +35,10 @@ void *malloc(size_t size);
 
 #include <math.h>
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "mri.h"
 
 #include "diag.h"
@@ -53,8 +58,15 @@ void *malloc(size_t size);
 static int DCMPrintCond(CONDITION cond);
 void *ReadDICOMImage2(int nfiles, DICOMInfo **aDicomInfo, int startIndex);
 
-static BOOL IsTagPresent[NUMBEROFTAGS];
-static int sliceDirCosPresent;
+// The parse state below is per thread so that ScanSiemensDCMDir() and
+// DICOMRead2() can read the headers of several files at once.
+static thread_local BOOL IsTagPresent[NUMBEROFTAGS];
+
+// DICOM object held open by dcmHoldObject() (one per thread)
+static thread_local DCM_OBJECT *HeldObject = NULL;
+static thread_local char HeldObjectFile[1024] = "";
+static thread_local int HeldObjectCount = 0;
+static thread_local int sliceDirCosPresent;
 static const char *jpegCompressed_UID = "1.2.840.10008.1.2.4";
 static const char *rllEncoded_UID = "1.2.840.10008.1.2.5";
 
@@ -107,7 +119,7 @@ MRI *sdcmLoadVolume(const char *dcmfile, int LoadVolume, int nthonly)
   FSENV *env;
   std::string tmpfilestdout, cmd, tmpfile, FileNameUse;
   int IsCompressed, IsDWI;
-  extern int sliceDirCosPresent;  // set when no ascii header
+  extern thread_local int sliceDirCosPresent;  // set when no ascii header
 
   xs = ys = zs = xe = ye = ze = d = 0.; /* to avoid compiler warnings */
   slice = 0;
@@ -636,7 +648,7 @@ MRI *sdcmLoadVolumeAutoScale(const char *dcmfile, int LoadVolume, int nthonly)
   // int nthdir;
   DTI *dti;
   int TryDTI = 1, DoDTI = 1;
-  extern int sliceDirCosPresent;  // set when no ascii header
+  extern thread_local int sliceDirCosPresent;  // set when no ascii header
 
   xs = ys = zs = xe = ye = ze = d = 0.; /* to avoid compiler warnings */
   slice = 0;
@@ -1164,6 +1176,38 @@ MATRIX *sdcmAutoAlignMatrix(const char *dcmfile)
 DCM_ELEMENT *GetElementFromFile(const char *dicomfile, long grpid, long elid)
 {
   DCM_OBJECT *object = 0;
+  DCM_ELEMENT *element;
+  int held;
+
+  held = (HeldObject != NULL && strcmp(dicomfile, HeldObjectFile) == 0);
+  if (held) {
+    object = HeldObject;
+  }
+  else {
+    object = GetObjectFromFile(dicomfile, 0);
+    if (object == NULL) {
+      exit(1);
+    }
+  }
+
+  element = GetElementFromObject(&object, grpid, elid);
+  if (!held) {
+    DCM_CloseObject(&object);
+  }
+  if (element == NULL) {
+    return (NULL);
+  }
+
+  COND_PopCondition(1); /********************************/
+
+  return (element);
+}
+/*---------------------------------------------------------------
+  GetElementFromObject() - gets an element from an already opened
+  DICOM object. Returns NULL if the element is not there.
+  ---------------------------------------------------------------*/
+DCM_ELEMENT *GetElementFromObject(DCM_OBJECT **object, long grpid, long elid)
+{
   CONDITION cond;
   DCM_ELEMENT *element;
   DCM_TAG tag;
@@ -1172,32 +1216,82 @@ DCM_ELEMENT *GetElementFromFile(const char *dicomfile, long grpid, long elid)
 
   element = (DCM_ELEMENT *)calloc(1, sizeof(DCM_ELEMENT));
 
-  object = GetObjectFromFile(dicomfile, 0);
-  if (object == NULL) {
-    exit(1);
-  }
-
   tag = DCM_MAKETAG(grpid, elid);
-  cond = DCM_GetElement(&object, tag, element);
+  cond = DCM_GetElement(object, tag, element);
   if (cond != DCM_NORMAL) {
-    DCM_CloseObject(&object);
     free(element);
     return (NULL);
   }
   AllocElementData(element);
-  cond = DCM_GetElementValue(&object, element, &rtnLength, &Ctx);
+  cond = DCM_GetElementValue(object, element, &rtnLength, &Ctx);
   /* Does Ctx have to be freed? */
   if (cond != DCM_NORMAL) {
-    DCM_CloseObject(&object);
     FreeElementData(element);
     free(element);
     return (NULL);
   }
-  DCM_CloseObject(&object);
+  return (element);
+}
+/*---------------------------------------------------------------
+  dcmHoldObject() - opens a DICOM file and keeps the object open
+  until dcmReleaseObject() is called. While it is held, IsDICOM(),
+  GetElementFromFile() and all the dcmXXX(dcmfile)/sdcmXXX(dcmfile)
+  helpers that go through it use the held object instead of opening
+  and parsing the file again. Holds on the same file nest. Returns
+  NULL (quietly) if the file cannot be opened as DICOM. Only one file
+  can be held at a time.
+  ---------------------------------------------------------------*/
+DCM_OBJECT *dcmHoldObject(const char *dcmfile)
+{
+  CONDITION cond;
+  DCM_OBJECT *object = 0;
+  unsigned long opts[4] = {DCM_PART10FILE, DCM_ORDERLITTLEENDIAN, DCM_ORDERBIGENDIAN, DCM_FORMATCONVERSION};
+  int n;
 
-  COND_PopCondition(1); /********************************/
+  if (HeldObject != NULL) {
+    if (strcmp(dcmfile, HeldObjectFile) == 0) {
+      HeldObjectCount++;
+      return (HeldObject);
+    }
+    printf("ERROR: dcmHoldObject(): %s is already held, cannot hold %s\n", HeldObjectFile, dcmfile);
+    return (NULL);
+  }
+  if (strlen(dcmfile) >= sizeof(HeldObjectFile) || fio_IsDirectory(dcmfile)) {
+    return (NULL);
+  }
 
-  return (element);
+  // Same cascade as IsDICOM()/GetObjectFromFile()
+  COND_PopCondition(1);
+  cond = DCM_ILLEGALOPTION;
+  for (n = 0; n < 4 && cond != DCM_NORMAL; n++) {
+    if (n > 0) DCM_CloseObject(&object);
+    cond = DCM_OpenFile(dcmfile, opts[n] | DCM_ACCEPTVRMISMATCH, &object);
+  }
+  COND_PopCondition(1);
+  if (cond != DCM_NORMAL) {
+    DCM_CloseObject(&object);
+    return (NULL);
+  }
+
+  HeldObject = object;
+  HeldObjectCount = 1;
+  strcpy(HeldObjectFile, dcmfile);
+  return (HeldObject);
+}
+/*---------------------------------------------------------------
+  dcmReleaseObject() - releases a hold from dcmHoldObject(). The
+  object is closed when the last hold is released.
+  ---------------------------------------------------------------*/
+int dcmReleaseObject(void)
+{
+  if (HeldObject == NULL) return (0);
+  HeldObjectCount--;
+  if (HeldObjectCount > 0) return (0);
+  DCM_CloseObject(&HeldObject);
+  HeldObject = NULL;
+  HeldObjectFile[0] = '\0';
+  COND_PopCondition(1);
+  return (0);
 }
 /*---------------------------------------------------------------
   GetObjectFromFile() - gets an object from a DICOM file. Returns
@@ -1519,21 +1613,71 @@ int IsSiemensDICOM(const char *dcmfile)
   return (1);
 }
 
+/*-----------------------------------------------------------------
+  dcmHeaderBytes() - if dcmfile is held (see dcmHoldObject()), returns
+  the number of bytes in front of the pixel data. Returns -1 (meaning
+  the whole file) if the file is not held or has no pixel data.
+  -----------------------------------------------------------------*/
+static long long dcmHeaderBytes(const char *dcmfile)
+{
+  long offset = 0;
+
+  if (HeldObject == NULL || strcmp(dcmfile, HeldObjectFile) != 0) return (-1);
+  if (DCM_GetElementFileOffset(&HeldObject, DCM_PXLPIXELDATA, &offset) != DCM_NORMAL) {
+    COND_PopCondition(1);
+    return (-1);
+  }
+  return (offset);
+}
+
+/*-----------------------------------------------------------------
+  dcmPrintableStrings() - returns the runs of at least 4 printable
+  characters (including tabs) in the first maxbytes bytes of a file
+  (the whole file if maxbytes < 0), one per string, like the unix
+  "strings" command. Returns 0 on success.
+  -----------------------------------------------------------------*/
+static int dcmPrintableStrings(const char *fname, std::vector<std::string> &strlist, long long maxbytes)
+{
+  FILE *fp;
+  std::vector<char> chunk(1 << 20);
+  std::string run;
+  size_t n, i;
+
+  fp = fopen(fname, "rb");
+  if (fp == NULL) return (1);
+  strlist.clear();
+  while (maxbytes != 0 && (n = fread(chunk.data(), 1, chunk.size(), fp)) > 0) {
+    if (maxbytes > 0) {
+      if ((long long)n > maxbytes) n = maxbytes;
+      maxbytes -= n;
+    }
+    for (i = 0; i < n; i++) {
+      unsigned char c = chunk[i];
+      if ((c >= 0x20 && c < 0x7f) || c == '\t') {
+        run.push_back(c);
+        continue;
+      }
+      if (run.size() >= 4) strlist.push_back(run);
+      run.clear();
+    }
+  }
+  if (run.size() >= 4) strlist.push_back(run);
+  fclose(fp);
+  return (0);
+}
+
 /* The original SiemensQsciiTag() is too slow         */
 /* make sure that returned value be freed if non-null */
 char *SiemensAsciiTagEx(const char *dcmfile, const char *TagString, int cleanup)
 {
-  static char filename[1024] = "";
-  static char **lists = 0;
-  static int count = 0;
-  static int startOfAscii = 0;
-  static int MAX_ASCIILIST = 512;
-  static int INCREMENT = 64;
-
-  int k;
-  FILE *fp;
+  static thread_local char filename[1024] = "";
+  static thread_local char **lists = 0;
+  static thread_local int count = 0;
+  static thread_local int startOfAscii = 0;
+  static thread_local int MAX_ASCIILIST = 512;
+  static const int INCREMENT = 64;
+
   char buf[1024];
-  char command[1024 + 32];
   char *plist = 0;
   char VariableName[512];
   char *VariableValue = 0;
@@ -1541,16 +1685,6 @@ char *SiemensAsciiTagEx(const char *dcmfile, const char *TagString, int cleanup)
   int newSize;
   char **newlists = 0;
 
-// Use this when debugging (gdb) because it will not fork
-// return(SiemensAsciiTag(dcmfile, TagString, cleanup));
-
-#ifdef Darwin
-  // This routine calls the unix "strings" command which operates
-  // differently on mac vs linux, so use the old, slow version of this
-  // routine if it is a mac.
-  return (SiemensAsciiTag(dcmfile, TagString, cleanup));
-#endif
-
   if (getenv("USE_SIEMENSASCIITAG")) return (SiemensAsciiTag(dcmfile, TagString, cleanup));
 
   // cleanup section.  Make sure to set cleanup =1 at the final call
@@ -1577,19 +1711,8 @@ char *SiemensAsciiTagEx(const char *dcmfile, const char *TagString, int cleanup)
     }
     // initialized to be zero
 
-    // Copy dcmfile to filename. If dcmfilename has parentheses then
-    // the unix strings command below will fail. The code below puts
-    // backslashes in front of any parens
-    memset(&filename[0], 0, 1024);
-    k = 0;
-    for (unsigned int i = 0; i < strlen(dcmfile); i++) {
-      if (dcmfile[i] == '(' || dcmfile[i] == ')' || dcmfile[i] == '[' || dcmfile[i] == ']') {
-        filename[k] = 92;  // 92 is ascii dec for backslash
-        k++;
-      }
-      filename[k] = dcmfile[i];
-      k++;
-    }
+    // Copy dcmfile to filename (no shell escaping needed any more)
+    snprintf(filename, sizeof(filename), "%s", dcmfile);
 
     // free allocated list of strings
     for (int i = 0; i < count; ++i) {
@@ -1599,21 +1722,21 @@ char *SiemensAsciiTagEx(const char *dcmfile, const char *TagString, int cleanup)
       }
     }
     // now build up string lists ///////////////////////////////////
+    // This used to run the unix "strings" command through popen(),
+    // which forks once per file. The printable runs are now extracted
+    // in-process the same way (see dcmPrintableStrings()). The ASCII
+    // header is in the Siemens CSA elements, so when the file is held
+    // the pixel data at the end of the file are not read at all.
     startOfAscii = 0;
-    strcpy(command, "strings ");
-    strcat(command, filename);
-    // Note: popen creates a fork, which can be a problem in gdb
-    if ((fp = popen(command, "r")) == NULL) {
-      fprintf(stderr, "could not open pipe for %s\n", filename);
+    std::vector<std::string> strlist;
+    if (dcmPrintableStrings(dcmfile, strlist, dcmHeaderBytes(dcmfile)) != 0) {
+      fprintf(stderr, "could not read %s\n", dcmfile);
       return 0;
     }
     count = 0;
-    while (fgets(buf, 1024, fp)) {
-      // replace CR with null
-      char *p = strrchr(buf, '\n');
-      if (p) {
-        *p = '\0';
-      }
+    for (const std::string &str : strlist) {
+      // same truncation as the fgets() of the strings output
+      snprintf(buf, sizeof(buf), "%s", str.c_str());
 
       // check the region
       //      if (strncmp(buf, "### ASCCONV BEGIN ###", 21)==0)
@@ -1657,7 +1780,6 @@ char *SiemensAsciiTagEx(const char *dcmfile, const char *TagString, int cleanup)
         }
       }
     }
-    pclose(fp);
   }
   // build up string lists available
   // search the tag
@@ -2333,21 +2455,19 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
   double xr, xa, xs, yr, ya, ys, zr, za, zs;
   int DoDWI;
 
+  // Open the file once; the dcmXXX(dcmfile) helpers below use the
+  // held object instead of re-opening the file
+  object = dcmHoldObject(dcmfile);
+  if (object == NULL) {
+    return (NULL);
+  }
   if (!IsSiemensDICOM(dcmfile)) {
+    dcmReleaseObject();
     return (NULL);
   }
 
   sdcmfi = (SDCMFILEINFO *)calloc(1, sizeof(SDCMFILEINFO));
 
-  fflush(stdout);
-  fflush(stderr);
-  object = GetObjectFromFile(dcmfile, 0);
-  fflush(stdout);
-  fflush(stderr);
-  if (object == NULL) {
-    exit(1);
-  }
-
   l = strlen(dcmfile);
   sdcmfi->FileName = (char *)calloc(l + 1, sizeof(char));
   memmove(sdcmfi->FileName, dcmfile, l);
@@ -2634,6 +2754,8 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
       printf("ERROR: GetSDCMFileInfo(): dcmGetDWIParams() %d\n", err);
       printf("DICOM File: %s\n", dcmfile);
       printf("break %s:%d\n", __FILE__, __LINE__);
+      SiemensAsciiTagEx(dcmfile, (char *)0, 1);
+      dcmReleaseObject();
       return (NULL);
     }
     if (Gdiag_no > 0)
@@ -2653,7 +2775,7 @@ SDCMFILEINFO *GetSDCMFileInfo(const char *dcmfile)
   // cleanup Ascii storage
   SiemensAsciiTagEx(dcmfile, (char *)0, 1);
 
-  cond = DCM_CloseObject(&object);
+  dcmReleaseObject();
 
   /* Clear the condition stack to prevent overflow */
   COND_PopCondition(1);
@@ -2826,10 +2948,229 @@ char *sdcmExtractNumarisVer(const char *e_18_1020, int *Maj, int *Min, int *MinM
 
   return (ver);
 }
+/*--------------------------------------------------------------------
+  Scan cache for ScanSiemensDCMDir(). When FS_DICOM_SCAN_CACHE is set,
+  the SDCMFILEINFO of every file that has been parsed is kept in a
+  cache file so that scanning the same directory again only parses
+  new or modified files (keyed by file name, size and mtime).
+  FS_DICOM_SCAN_CACHE is either a directory in which the cache files
+  are kept (named by a hash of the DICOM directory path), or "sidecar"
+  to keep the cache as .fs_sdcmscan in the DICOM directory itself.
+  The cache is written in native byte order; a cache written with a
+  different layout or different FS_NO_SLICE_SCALE_FACTOR/FS_LOAD_DWI
+  settings is ignored.
+  ------------------------------------------------------------------*/
+#define SDCM_SCAN_CACHE_MAGIC "FSSDCMSCAN"
+#define SDCM_SCAN_CACHE_VERSION 1
+#define SDCM_SCAN_BATCH 64
+#define SDCM_SCAN_SIDECAR ".fs_sdcmscan"
+
+typedef struct
+{
+  long long size;
+  long long mtime;
+  int IsSiemens;
+  SDCMFILEINFO *sdfi;  // NULL if not a Siemens DICOM file
+} SDCM_SCAN_CACHE_ENTRY;
+typedef std::map<std::string, SDCM_SCAN_CACHE_ENTRY> SDCM_SCAN_CACHE;
+
+static char *SDCMFILEINFO::*const sdfiStringFields[] = {&SDCMFILEINFO::FileName,
+                                                        &SDCMFILEINFO::PatientName,
+                                                        &SDCMFILEINFO::StudyDate,
+                                                        &SDCMFILEINFO::StudyTime,
+                                                        &SDCMFILEINFO::SeriesTime,
+                                                        &SDCMFILEINFO::AcquisitionTime,
+                                                        &SDCMFILEINFO::PulseSequence,
+                                                        &SDCMFILEINFO::ProtocolName,
+                                                        &SDCMFILEINFO::PhEncDir,
+                                                        &SDCMFILEINFO::NumarisVer,
+                                                        &SDCMFILEINFO::ScannerModel,
+                                                        &SDCMFILEINFO::TransferSyntaxUID};
+static const int nsdfiStringFields = sizeof(sdfiStringFields) / sizeof(sdfiStringFields[0]);
+
+static std::string sdcmScanCacheSettings(void)
+{
+  char tmpstr[100];
+  const char *pc = getenv("FS_LOAD_DWI");
+  sprintf(tmpstr,
+          "%d %d %d",
+          (int)sizeof(SDCMFILEINFO),
+          getenv("FS_NO_SLICE_SCALE_FACTOR") != NULL,
+          pc == NULL || strcmp(pc, "0") != 0);
+  return (std::string(tmpstr));
+}
+
+static std::string sdcmScanCacheFile(const char *dcmdir)
+{
+  const char *cachedir = getenv("FS_DICOM_SCAN_CACHE");
+  char tmpstr[2000], *rp;
+  unsigned long long h = 1469598103934665603ULL;
+
+  if (cachedir == NULL || strlen(cachedir) == 0) return (std::string());
+  if (strcmp(cachedir, "sidecar") == 0) return (std::string(dcmdir) + "/" SDCM_SCAN_SIDECAR);
+
+  // name the cache after the absolute path of the dicom dir (FNV-1a)
+  rp = realpath(dcmdir, NULL);
+  const char *key = (rp != NULL) ? rp : dcmdir;
+  for (const char *pc = key; *pc; pc++) {
+    h ^= (unsigned char)*pc;
+    h *= 1099511628211ULL;
+  }
+  if (rp) free(rp);
+  snprintf(tmpstr, sizeof(tmpstr), "%s/sdcmscan.%016llx", cachedir, h);
+  return (std::string(tmpstr));
+}
+
+static int sdcmScanCacheWriteString(FILE *fp, const char *str)
+{
+  int len = (str == NULL) ? -1 : strlen(str);
+  if (fwrite(&len, sizeof(int), 1, fp) != 1) return (1);
+  if (len > 0 && fwrite(str, 1, len, fp) != (size_t)len) return (1);
+  return (0);
+}
+
+static int sdcmScanCacheReadString(FILE *fp, char **pstr)
+{
+  int len;
+  *pstr = NULL;
+  if (fread(&len, sizeof(int), 1, fp) != 1 || len < -1 || len > 100000) return (1);
+  if (len < 0) return (0);
+  *pstr = (char *)calloc(len + 1, sizeof(char));
+  if (len > 0 && fread(*pstr, 1, len, fp) != (size_t)len) return (1);
+  return (0);
+}
+
+static SDCMFILEINFO *sdfiCopy(const SDCMFILEINFO *src)
+{
+  SDCMFILEINFO *dst = (SDCMFILEINFO *)calloc(1, sizeof(SDCMFILEINFO));
+  memmove(dst, src, sizeof(SDCMFILEINFO));
+  for (int n = 0; n < nsdfiStringFields; n++)
+    if (src->*sdfiStringFields[n] != NULL) dst->*sdfiStringFields[n] = strcpyalloc(src->*sdfiStringFields[n]);
+  return (dst);
+}
+
+static void sdcmScanCacheClear(SDCM_SCAN_CACHE &cache)
+{
+  for (auto &it : cache) {
+    if (it.second.sdfi == NULL) continue;
+    // FreeSDCMFileInfo() does not free all the strings
+    for (int n = 0; n < nsdfiStringFields; n++) free(it.second.sdfi->*sdfiStringFields[n]);
+    free(it.second.sdfi);
+  }
+  cache.clear();
+}
+
+static int sdcmScanCacheRead(const std::string &cachefile, SDCM_SCAN_CACHE &cache)
+{
+  FILE *fp;
+  char magic[sizeof(SDCM_SCAN_CACHE_MAGIC)], *str = NULL;
+  int version, nentries, err = 0;
+
+  fp = fopen(cachefile.c_str(), "rb");
+  if (fp == NULL) return (1);
+  if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, SDCM_SCAN_CACHE_MAGIC, sizeof(magic)) != 0 ||
+      fread(&version, sizeof(int), 1, fp) != 1 || version != SDCM_SCAN_CACHE_VERSION ||
+      sdcmScanCacheReadString(fp, &str) || str == NULL || sdcmScanCacheSettings() != str ||
+      fread(&nentries, sizeof(int), 1, fp) != 1) {
+    free(str);
+    fclose(fp);
+    return (1);
+  }
+  free(str);
+
+  for (int n = 0; n < nentries && !err; n++) {
+    SDCM_SCAN_CACHE_ENTRY e;
+    char *name = NULL;
+    memset(&e, 0, sizeof(e));
+    err = sdcmScanCacheReadString(fp, &name) || name == NULL || fread(&e.size, sizeof(long long), 1, fp) != 1 ||
+          fread(&e.mtime, sizeof(long long), 1, fp) != 1 || fread(&e.IsSiemens, sizeof(int), 1, fp) != 1;
+    if (!err && e.IsSiemens) {
+      e.sdfi = (SDCMFILEINFO *)calloc(1, sizeof(SDCMFILEINFO));
+      err = (fread(e.sdfi, sizeof(SDCMFILEINFO), 1, fp) != 1);
+      for (int k = 0; k < nsdfiStringFields; k++) e.sdfi->*sdfiStringFields[k] = NULL;
+      for (int k = 0; k < nsdfiStringFields && !err; k++) err = sdcmScanCacheReadString(fp, &(e.sdfi->*sdfiStringFields[k]));
+    }
+    if (name != NULL) cache[name] = e;
+    free(name);
+  }
+  fclose(fp);
+  if (err) {
+    printf("WARNING: DICOM scan cache %s is corrupt, ignoring\n", cachefile.c_str());
+    sdcmScanCacheClear(cache);
+    return (1);
+  }
+  return (0);
+}
+
+static int sdcmScanCacheWrite(const std::string &cachefile, const SDCM_SCAN_CACHE &cache)
+{
+  FILE *fp;
+  char tmpfile[2100];
+  int version = SDCM_SCAN_CACHE_VERSION, nentries = cache.size(), err;
+
+  // write to a temp file and rename so that a concurrent scan never
+  // sees a partial cache
+  snprintf(tmpfile, sizeof(tmpfile), "%s.%d", cachefile.c_str(), (int)getpid());
+  fp = fopen(tmpfile, "wb");
+  if (fp == NULL) {
+    printf("WARNING: could not write DICOM scan cache %s\n", cachefile.c_str());
+    return (1);
+  }
+  err = fwrite(SDCM_SCAN_CACHE_MAGIC, sizeof(SDCM_SCAN_CACHE_MAGIC), 1, fp) != 1 ||
+        fwrite(&version, sizeof(int), 1, fp) != 1 ||
+        sdcmScanCacheWriteString(fp, sdcmScanCacheSettings().c_str()) ||
+        fwrite(&nentries, sizeof(int), 1, fp) != 1;
+  for (auto it = cache.begin(); it != cache.end() && !err; ++it) {
+    const SDCM_SCAN_CACHE_ENTRY &e = it->second;
+    err = sdcmScanCacheWriteString(fp, it->first.c_str()) || fwrite(&e.size, sizeof(long long), 1, fp) != 1 ||
+          fwrite(&e.mtime, sizeof(long long), 1, fp) != 1 || fwrite(&e.IsSiemens, sizeof(int), 1, fp) != 1;
+    if (!err && e.IsSiemens) {
+      err = (fwrite(e.sdfi, sizeof(SDCMFILEINFO), 1, fp) != 1);
+      for (int k = 0; k < nsdfiStringFields && !err; k++) err = sdcmScanCacheWriteString(fp, e.sdfi->*sdfiStringFields[k]);
+    }
+  }
+  if (fclose(fp) != 0) err = 1;
+  if (err || rename(tmpfile, cachefile.c_str()) != 0) {
+    printf("WARNING: could not write DICOM scan cache %s\n", cachefile.c_str());
+    unlink(tmpfile);
+    return (1);
+  }
+  return (0);
+}
+
+/*--------------------------------------------------------------------
+  sdcmScanFile() - opens dcmfile once for both the Siemens check and
+  the header info and fills the scan cache entry e. Only the header is
+  read (see dcmHeaderBytes()). Returns 1 if the file is Siemens DICOM
+  but its info could not be read, 0 otherwise. Safe to call for
+  different files from several threads at once.
+  ------------------------------------------------------------------*/
+static int sdcmScanFile(const char *dcmfile, SDCM_SCAN_CACHE_ENTRY &e)
+{
+  int err = 0;
+
+  e.IsSiemens = 0;
+  e.sdfi = NULL;
+  if (dcmHoldObject(dcmfile) == NULL) return (0);
+  if (IsSiemensDICOM(dcmfile)) {
+    e.sdfi = GetSDCMFileInfo(dcmfile);
+    if (e.sdfi == NULL)
+      err = 1;
+    else
+      e.IsSiemens = 1;
+  }
+  dcmReleaseObject();
+  return (err);
+}
+
 /*--------------------------------------------------------------------
   ScanSiemensDCMDir() - similar to ScanDir but returns only files that
   are Siemens DICOM Files. It also returns a pointer to an array of
-  SDCMFILEINFO structures.
+  SDCMFILEINFO structures. Each file is opened once (see
+  dcmHoldObject()) and only its header is read, the headers are parsed
+  in parallel in batches of SDCM_SCAN_BATCH, and files that have not
+  changed since the last scan are taken from the scan cache if
+  FS_DICOM_SCAN_CACHE is set.
 
   Author: Douglas Greve.
   Date: 09/10/2001
@@ -2837,12 +3178,13 @@ char *sdcmExtractNumarisVer(const char *e_18_1020, int *Maj, int *Min, int *MinM
 SDCMFILEINFO **ScanSiemensDCMDir(const char *PathName, int *NSDCMFiles)
 {
   struct dirent **NameList;
-  int i, pathlength;
-  int NFiles;
-  char tmpstr[1000];
+  int i, i0, i1, pathlength;
+  int NFiles, nparsed, ncached;
   SDCMFILEINFO **sdcmfi_list;
   int pct, sumpct;
   FILE *fp;
+  std::string cachefile;
+  SDCM_SCAN_CACHE cache, newcache;
 
   char *pname = (char *)calloc(strlen(PathName) + 1, sizeof(char));
   strcpy(pname, PathName);
@@ -2869,24 +3211,41 @@ SDCMFILEINFO **ScanSiemensDCMDir(const char *PathName, int *NSDCMFiles)
   }
   fprintf(stderr, "INFO: Found %d files in %s\n", NFiles, pname);
 
-  /* Count the number of Siemens DICOM Files */
-  fprintf(stderr, "INFO: counting Siemens Files\n");
-  (*NSDCMFiles) = 0;
+  std::vector<std::string> FileNames(NFiles);
+  std::vector<long long> fsize(NFiles), fmtime(NFiles);
+  std::vector<char> isreg(NFiles), fetch(NFiles);
+  for (i = 0; i < NFiles; i++) FileNames[i] = std::string(pname) + "/" + NameList[i]->d_name;
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for schedule(dynamic, 64)
+#endif
   for (i = 0; i < NFiles; i++) {
-    sprintf(tmpstr, "%s/%s", pname, NameList[i]->d_name);
-    if (IsSiemensDICOM(tmpstr)) {
-      (*NSDCMFiles)++;
-    }
+    struct stat st;
+    isreg[i] = (stat(FileNames[i].c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+                strcmp(NameList[i]->d_name, SDCM_SCAN_SIDECAR) != 0);
+    fsize[i] = isreg[i] ? (long long)st.st_size : 0;
+    fmtime[i] = isreg[i] ? (long long)st.st_mtime : 0;
   }
 
-  fprintf(stderr, "INFO: found %d Siemens Files\n", *NSDCMFiles);
-
-  if (*NSDCMFiles == 0) {
-    free(pname);
-    return (NULL);
+  cachefile = sdcmScanCacheFile(pname);
+  if (!cachefile.empty()) {
+    if (sdcmScanCacheRead(cachefile, cache) == 0)
+      fprintf(stderr, "INFO: using DICOM scan cache %s (%d entries)\n", cachefile.c_str(), (int)cache.size());
+  }
+  ncached = 0;
+  for (i = 0; i < NFiles; i++) {
+    auto it = cache.find(NameList[i]->d_name);
+    if (it != cache.end() && (!isreg[i] || it->second.size != fsize[i] || it->second.mtime != fmtime[i])) {
+      if (it->second.sdfi) {
+        for (int n = 0; n < nsdfiStringFields; n++) free(it->second.sdfi->*sdfiStringFields[n]);
+        free(it->second.sdfi);
+      }
+      cache.erase(it);
+      it = cache.end();
+    }
+    fetch[i] = (isreg[i] && it == cache.end());
+    if (!fetch[i] && isreg[i]) ncached++;
   }
-
-  sdcmfi_list = (SDCMFILEINFO **)calloc(*NSDCMFiles, sizeof(SDCMFILEINFO *));
 
   fprintf(stderr, "INFO: scanning info from Siemens Files\n");
 
@@ -2894,35 +3253,70 @@ SDCMFILEINFO **ScanSiemensDCMDir(const char *PathName, int *NSDCMFiles)
     fprintf(stderr, "INFO: status file is %s\n", SDCMStatusFile);
   }
 
+  std::vector<SDCMFILEINFO *> sdfi_vector;
   fprintf(stderr, "%2d ", 0);
   sumpct = 0;
-  (*NSDCMFiles) = 0;
-  for (i = 0; i < NFiles; i++) {
-    // fprintf(stderr,"%4d ",i);
-    pct = rint(100 * (i + 1) / NFiles) - sumpct;
-    if (pct >= 2) {
-      sumpct += pct;
-      fprintf(stderr, "%3d ", sumpct);
-      fflush(stderr);
-      if (SDCMStatusFile != NULL) {
-        fp = fopen(SDCMStatusFile, "w");
-        if (fp != NULL) {
-          fprintf(fp, "%3d\n", sumpct);
-          fclose(fp);
+  nparsed = 0;
+  for (i0 = 0; i0 < NFiles; i0 += SDCM_SCAN_BATCH) {
+    i1 = MIN(i0 + SDCM_SCAN_BATCH, NFiles);
+
+    // parse the headers of the batch in parallel, then merge in order
+    std::vector<SDCM_SCAN_CACHE_ENTRY> parsed(i1 - i0);
+    std::vector<char> failed(i1 - i0, 0);
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int k = i0; k < i1; k++) {
+      if (!fetch[k]) continue;
+      parsed[k - i0].size = fsize[k];
+      parsed[k - i0].mtime = fmtime[k];
+      failed[k - i0] = sdcmScanFile(FileNames[k].c_str(), parsed[k - i0]);
+    }
+
+    for (i = i0; i < i1; i++) {
+      // fprintf(stderr,"%4d ",i);
+      pct = rint(100 * (i + 1) / NFiles) - sumpct;
+      if (pct >= 2) {
+        sumpct += pct;
+        fprintf(stderr, "%3d ", sumpct);
+        fflush(stderr);
+        if (SDCMStatusFile != NULL) {
+          fp = fopen(SDCMStatusFile, "w");
+          if (fp != NULL) {
+            fprintf(fp, "%3d\n", sumpct);
+            fclose(fp);
+          }
         }
       }
-    }
+      if (!isreg[i]) continue;
 
-    sprintf(tmpstr, "%s/%s", pname, NameList[i]->d_name);
-    if (IsSiemensDICOM(tmpstr)) {
-      sdcmfi_list[*NSDCMFiles] = GetSDCMFileInfo(tmpstr);
-      if (sdcmfi_list[*NSDCMFiles] == NULL) {
-        return (NULL);
+      const char *dcmfile = FileNames[i].c_str();
+      SDCM_SCAN_CACHE_ENTRY e;
+      if (!fetch[i]) {
+        e = cache[NameList[i]->d_name];
+        cache.erase(NameList[i]->d_name);
+      }
+      else {
+        if (failed[i - i0]) return (NULL);
+        e = parsed[i - i0];
+        nparsed++;
+      }
+      if (e.IsSiemens) {
+        SDCMFILEINFO *sdfi = sdfiCopy(e.sdfi);
+        free(sdfi->FileName);
+        sdfi->FileName = strcpyalloc(dcmfile);
+        sdfi_vector.push_back(sdfi);
       }
-      (*NSDCMFiles)++;
+      newcache[NameList[i]->d_name] = e;
     }
   }
   fprintf(stderr, "\n");
+  fprintf(stderr, "INFO: found %d Siemens Files (%d parsed, %d from cache)\n", (int)sdfi_vector.size(), nparsed, ncached);
+
+  // entries of files no longer in the directory are dropped
+  if (!cachefile.empty() && (nparsed > 0 || !cache.empty())) sdcmScanCacheWrite(cachefile, newcache);
+  sdcmScanCacheClear(cache);
+  sdcmScanCacheClear(newcache);
 
   // free memory
   while (NFiles--) {
@@ -2932,6 +3326,13 @@ SDCMFILEINFO **ScanSiemensDCMDir(const char *PathName, int *NSDCMFiles)
 
   free(pname);
 
+  *NSDCMFiles = sdfi_vector.size();
+  if (*NSDCMFiles == 0) {
+    return (NULL);
+  }
+  sdcmfi_list = (SDCMFILEINFO **)calloc(*NSDCMFiles, sizeof(SDCMFILEINFO *));
+  for (i = 0; i < *NSDCMFiles; i++) sdcmfi_list[i] = sdfi_vector[i];
+
   return (sdcmfi_list);
 }
 /*--------------------------------------------------------------------
@@ -5289,14 +5690,19 @@ int IsDICOM(const char *fname)
   FILE *fp;
   CONDITION cond;
   DCM_OBJECT *object = 0;
-  static int yes = 0;           // statically initialized
-  static char file[1024] = "";  // statically initialized
+  static thread_local int yes = 0;           // statically initialized
+  static thread_local char file[1024] = "";  // statically initialized
 
   d = 0;
   if (getenv("FS_DICOM_DEBUG")) {
     d = 1;
   }
 
+  // a file held open by dcmHoldObject() has already been opened as dicom
+  if (d == 0 && HeldObject != NULL && !strcmp(fname, HeldObjectFile)) {
+    return (1);
+  }
+
   // use the cached value if the fname is the same as privious one
   if (d == 0 && !strcmp(fname, file)) {
     return yes;  // used before
@@ -5531,7 +5937,7 @@ int alphasort(const void *a, const void *b)
 MRI *DICOMRead2(const char *dcmfile, int LoadVolume)
 {
   char **FileNames, *dcmdir;
-  DICOMInfo RefDCMInfo, TmpDCMInfo, **dcminfo;
+  DICOMInfo RefDCMInfo, **dcminfo;
   int nfiles, nframes, nslices, r, c, s, f, err;
   int ndcmfiles, nthfile, mritype = 0, IsDWI, IsPhilipsDWI;
   unsigned short *v16 = NULL;
@@ -5574,38 +5980,33 @@ MRI *DICOMRead2(const char *dcmfile, int LoadVolume)
   }
   printf("Found %d files, checking for dicoms\n", nfiles);
 
-  // Go thru each of those to determine which ones are dicom
-  // and belong to the same series.
-  ndcmfiles = 0;
-  for (nthfile = 0; nthfile < nfiles; nthfile++) {
-    // printf("%d %s\n",nthfile,FileNames[nthfile]);
-    if (!IsDICOM(FileNames[nthfile])) {
+  // Go thru each file once to determine which ones are dicom and
+  // belong to the same series, and load their info. The headers are
+  // parsed in parallel (the pixel data are not read), and the files
+  // are kept in directory order.
+  std::vector<DICOMInfo *> fileinfo(nfiles, (DICOMInfo *)NULL);
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (int k = 0; k < nfiles; k++) {
+    // printf("%d %s\n",k,FileNames[k]);
+    if (!IsDICOM(FileNames[k])) {
       continue;
     }
-    GetDICOMInfo(FileNames[nthfile], &TmpDCMInfo, FALSE, 1);
-    if (TmpDCMInfo.SeriesNumber != RefDCMInfo.SeriesNumber) {
+    DICOMInfo *info = (DICOMInfo *)calloc(1, sizeof(DICOMInfo));
+    GetDICOMInfo(FileNames[k], info, FALSE, 1);
+    if (info->SeriesNumber != RefDCMInfo.SeriesNumber) {
+      free(info);
       continue;
     }
-    ndcmfiles++;
+    fileinfo[k] = info;
   }
-  printf("Found %d dicom files in series.\n", ndcmfiles);
-
-  // Go thru each dicom, make sure it belongs to series, load info
-  dcminfo = (DICOMInfo **)calloc(ndcmfiles, sizeof(DICOMInfo *));
+  dcminfo = (DICOMInfo **)calloc(nfiles, sizeof(DICOMInfo *));
   ndcmfiles = 0;
   for (nthfile = 0; nthfile < nfiles; nthfile++) {
-    // printf("%d %s\n",nthfile,FileNames[nthfile]);
-    if (!IsDICOM(FileNames[nthfile])) {
-      continue;
-    }
-    GetDICOMInfo(FileNames[nthfile], &TmpDCMInfo, FALSE, 1);
-    if (TmpDCMInfo.SeriesNumber != RefDCMInfo.SeriesNumber) {
-      continue;
-    }
-    dcminfo[ndcmfiles] = (DICOMInfo *)calloc(1, sizeof(DICOMInfo));
-    memmove(dcminfo[ndcmfiles], &TmpDCMInfo, sizeof(DICOMInfo));
-    ndcmfiles++;
+    if (fileinfo[nthfile] != NULL) dcminfo[ndcmfiles++] = fileinfo[nthfile];
   }
+  printf("Found %d dicom files in series.\n", ndcmfiles);
 
   // Sort twice, 1st NOT using slice direction, 2nd using slice direction
   // First sort will not use it because Vs=0 from GetDICOMInfo()
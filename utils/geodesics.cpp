@@ -2,11 +2,12 @@
 // for calculating geodesics on a polyhedral surface
 //
 
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <algorithm>  
 #include <iomanip>
 #include <iostream>
-#include <map>
 #include <stack>
 #include <vector>
 
@@ -16,9 +17,7 @@
 #include "mrisurf.h"
 #include "timer.h"
 
-#ifdef _OPENMP
 #include "romp_support.h"
-#endif
 
 // Vertex
 struct Vertex
@@ -42,17 +41,478 @@ struct Triangle
   float angle[3];
   int vert[3];
   int neighbor[3];
-  bool inChain;
 };
 
-static int getIndex(int *arr, int vid);
+static int getIndex(const int *arr, int vid);
 static float distanceBetween(int v1, int v2, MRIS *surf);
 static int findNeighbor(int faceidx, int v1, int v2, MRIS *surf);
 static Vertex extendedPoint(Vertex A, Vertex B, float dA, float dB, float dAB);
-static std::pair< int, int > makeKey(int a, int b);
 static void progressBar(float progress);
 
-Geodesics *computeGeodesics(MRIS *surf, float maxdist)
+// per-thread work space. Everything that is indexed by face or vertex is
+// only reset where it was touched, so the cost of a source vertex depends
+// on the size of its neighborhood and not on the size of the surface.
+struct GeoScratch
+{
+  std::vector< char > inChain;  // per face
+  std::vector< int > chain;
+  std::stack< StackItem > stack;
+  std::vector< float > dist;  // per vertex, GEO_UNSEEN if not in the neighborhood
+  std::vector< int > list;    // vertices in the neighborhood, in the order found
+  std::vector< std::pair< int, float > > row;
+};
+
+#define GEO_UNSEEN -2.0f  // not in the neighborhood of the source
+#define GEO_NOPATH -1.0f  // in the neighborhood, but no distance yet
+#define GEO_BLOCK 256     // source vertices per parallel work item
+#define GEO_RELAX_PASSES 1  // relaxation passes after the fill pass
+
+static void geoScratchInit(std::vector< GeoScratch > &scratch, MRIS *surf)
+{
+  scratch.resize(omp_get_max_threads());
+  for (unsigned int t = 0; t < scratch.size(); t++) {
+    scratch[t].inChain.assign(surf->nfaces, 0);
+    scratch[t].dist.assign(surf->nvertices, GEO_UNSEEN);
+  }
+}
+
+static GeoScratch &geoThreadScratch(std::vector< GeoScratch > &scratch)
+{
+#ifdef HAVE_OPENMP
+  return scratch[omp_get_thread_num()];
+#else
+  return scratch[0];
+#endif
+}
+
+// add v to the neighborhood of the source
+static inline void geoAddVertex(GeoScratch &sc, int v)
+{
+  if (sc.dist[v] == GEO_UNSEEN) {
+    sc.dist[v] = GEO_NOPATH;
+    sc.list.push_back(v);
+  }
+}
+
+// add v to the neighborhood of the source at distance d (the shortest wins)
+static inline void geoAddPath(GeoScratch &sc, int v, float d)
+{
+  geoAddVertex(sc, v);
+  if (sc.dist[v] < 0.0 || d < sc.dist[v]) sc.dist[v] = d;
+}
+
+// move the neighborhood of the source (except the source itself) into
+// the row sorted by vertex number, and reset the work space
+static void geoFlushRow(GeoScratch &sc, int source, bool keepNoPath)
+{
+  sc.row.clear();
+  for (unsigned int n = 0; n < sc.list.size(); n++) {
+    int v = sc.list[n];
+    if (v != source && (keepNoPath || sc.dist[v] >= 0.0)) sc.row.push_back(std::make_pair(v, sc.dist[v]));
+    sc.dist[v] = GEO_UNSEEN;
+  }
+  sc.list.clear();
+  std::sort(sc.row.begin(), sc.row.end());
+}
+
+/*
+  Builds a table with one row per vertex. rowfn(k, sc) must leave the row
+  of vertex k in sc.row. Rows are computed in parallel in blocks of
+  GEO_BLOCK vertices and then packed in vertex order, so the result does
+  not depend on the number of threads.
+*/
+template < class RowFunction >
+static GeodesicsCSR *geoBuildTable(int nvertices, std::vector< GeoScratch > &scratch, RowFunction rowfn)
+{
+  int nblocks = (nvertices + GEO_BLOCK - 1) / GEO_BLOCK, ndone = 0;
+  std::vector< std::vector< int > > blockv(nblocks);
+  std::vector< std::vector< float > > blockd(nblocks);
+  GeodesicsCSR *csr;
+
+  csr = (GeodesicsCSR *)calloc(1, sizeof(GeodesicsCSR));
+  csr->nvertices = nvertices;
+  csr->offset = (long long *)calloc(nvertices + 1, sizeof(long long));
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+  for (int b = 0; b < nblocks; b++) {
+    ROMP_PFLB_begin
+    GeoScratch &sc = geoThreadScratch(scratch);
+    int kmax = std::min(nvertices, (b + 1) * GEO_BLOCK);
+    for (int k = b * GEO_BLOCK; k < kmax; k++) {
+      rowfn(k, sc);
+      csr->offset[k + 1] = sc.row.size();
+      for (unsigned int n = 0; n < sc.row.size(); n++) {
+        blockv[b].push_back(sc.row[n].first);
+        blockd[b].push_back(sc.row[n].second);
+      }
+    }
+#ifdef HAVE_OPENMP
+    #pragma omp critical
+#endif
+    {
+      ndone += kmax - b * GEO_BLOCK;
+      progressBar((float)ndone / nvertices);
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+  progressBar(1.0);
+  std::cout << std::endl;
+
+  for (int k = 0; k < nvertices; k++) csr->offset[k + 1] += csr->offset[k];
+  csr->nnbrs = csr->offset[nvertices];
+  csr->v = (int *)calloc(std::max(csr->nnbrs, 1LL), sizeof(int));
+  csr->dist = (float *)calloc(std::max(csr->nnbrs, 1LL), sizeof(float));
+  if (csr->v == NULL || csr->dist == NULL) {
+    std::cerr << "error: could not allocate " << csr->nnbrs << " geodesics\n";
+    exit(1);
+  }
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int b = 0; b < nblocks; b++) {
+    ROMP_PFLB_begin
+    long long o = csr->offset[b * GEO_BLOCK];
+    if (!blockv[b].empty()) {
+      memcpy(&csr->v[o], &blockv[b][0], blockv[b].size() * sizeof(int));
+      memcpy(&csr->dist[o], &blockd[b][0], blockd[b].size() * sizeof(float));
+    }
+    std::vector< int >().swap(blockv[b]);
+    std::vector< float >().swap(blockd[b]);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  return csr;
+}
+
+// position of vertex v in the (sorted) row of vertex k, or -1
+static inline long long geoFind(const GeodesicsCSR *csr, int k, int v)
+{
+  const int *first = csr->v + csr->offset[k], *last = csr->v + csr->offset[k + 1];
+  const int *p = std::lower_bound(first, last, v);
+  if (p == last || *p != v) return -1;
+  return p - csr->v;
+}
+
+// make the table symmetric by union: every pair (k,v) with a distance is
+// also recorded as (v,k), and the entry for (k,v) becomes the shorter of
+// (k,v) and (v,k), where GEO_NOPATH counts as missing. GEO_NOPATH entries
+// only mark the neighborhood of their source and are not mirrored.
+static void geoSymmetrize(GeodesicsCSR *csr)
+{
+  int nvertices = csr->nvertices;
+  std::vector< char > mirror(csr->nnbrs, 0);
+
+  // pairs that are missing from the other end
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, GEO_BLOCK)
+#endif
+  for (int k = 0; k < nvertices; k++) {
+    ROMP_PFLB_begin
+    for (long long e = csr->offset[k]; e < csr->offset[k + 1]; e++)
+      mirror[e] = (csr->dist[e] >= 0.0 && geoFind(csr, csr->v[e], k) < 0);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // transpose of the missing pairs; filling it in order of k keeps each
+  // of its rows sorted
+  std::vector< long long > xoffset(nvertices + 1, 0);
+  for (long long e = 0; e < csr->nnbrs; e++)
+    if (mirror[e]) xoffset[csr->v[e] + 1]++;
+  for (int k = 0; k < nvertices; k++) xoffset[k + 1] += xoffset[k];
+  std::vector< int > xv(xoffset[nvertices]);
+  std::vector< float > xdist(xoffset[nvertices]);
+  std::vector< long long > xfill(xoffset.begin(), xoffset.end() - 1);
+  for (int k = 0; k < nvertices; k++)
+    for (long long e = csr->offset[k]; e < csr->offset[k + 1]; e++)
+      if (mirror[e]) {
+        xv[xfill[csr->v[e]]] = k;
+        xdist[xfill[csr->v[e]]++] = csr->dist[e];
+      }
+
+  long long *offset = (long long *)calloc(nvertices + 1, sizeof(long long));
+  for (int k = 0; k < nvertices; k++)
+    offset[k + 1] = offset[k] + (csr->offset[k + 1] - csr->offset[k]) + (xoffset[k + 1] - xoffset[k]);
+  long long nnbrs = offset[nvertices];
+  int *v = (int *)calloc(std::max(nnbrs, 1LL), sizeof(int));
+  float *dist = (float *)calloc(std::max(nnbrs, 1LL), sizeof(float));
+  if (v == NULL || dist == NULL) {
+    std::cerr << "error: could not allocate " << nnbrs << " geodesics\n";
+    exit(1);
+  }
+
+  // merge each row with its mirrored pairs
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, GEO_BLOCK)
+#endif
+  for (int k = 0; k < nvertices; k++) {
+    ROMP_PFLB_begin
+    long long e = csr->offset[k], x = xoffset[k], o = offset[k];
+    while (e < csr->offset[k + 1] || x < xoffset[k + 1]) {
+      if (x == xoffset[k + 1] || (e < csr->offset[k + 1] && csr->v[e] < xv[x])) {
+        long long f = geoFind(csr, csr->v[e], k);
+        float a = csr->dist[e], b = f < 0 ? GEO_NOPATH : csr->dist[f];
+        v[o] = csr->v[e];
+        if (a < 0.0)
+          dist[o] = b;
+        else if (b < 0.0)
+          dist[o] = a;
+        else
+          dist[o] = std::min(a, b);
+        e++;
+      }
+      else {
+        v[o] = xv[x];
+        dist[o] = xdist[x];
+        x++;
+      }
+      o++;
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  free(csr->offset);
+  free(csr->v);
+  free(csr->dist);
+  csr->offset = offset;
+  csr->v = v;
+  csr->dist = dist;
+  csr->nnbrs = nnbrs;
+}
+
+/*
+  Line-of-sight (LOS) pass for one source vertex: unfold chains of
+  triangles around the source into the plane and record every vertex
+  within maxdist that the chains reach, with the straight-line distance
+  when the vertex is visible from the source.
+*/
+static void geoSourceLOS(int vertexID,
+                         MRIS *surf,
+                         const std::vector< Triangle > &triangles,
+                         float maxdist,
+                         GeoScratch &sc)
+{
+  int idxlookup[] = {0, 2, 1, 0};  // fast lookup table to find remaining index
+                                   // can be removed... there's an easier way
+  std::vector< int > &chain = sc.chain;
+  std::stack< StackItem > &stack = sc.stack;
+  const Triangle *triangle;
+  StackItem stackitem;
+  Vertex A, B, C, D;
+  int iA, iB, iC, iD;
+  int current_idx;
+  float min_angle, max_angle, current_angle, distance;
+
+  VERTEX_TOPOLOGY const * const basevertex = &surf->vertices_topology[vertexID];
+  // begin chain with each face that neighbors the current base vertex:
+  for (int i = 0; i < basevertex->num; i++) {
+    // clear triangle chain:
+    for (unsigned int c = 0; c < chain.size(); c++) sc.inChain[chain[c]] = 0;
+    chain.clear();
+    // set up initial triangle in plane:
+    current_idx = basevertex->f[i];
+    triangle = &triangles[current_idx];
+    // formally add to chain:
+    chain.push_back(current_idx);
+    sc.inChain[current_idx] = 1;
+    // get vertex indices in relation to their
+    // placement in the face's vertex array:
+    iC = getIndex(triangle->vert, vertexID);
+    iA = (iC + 1) % 3;
+    iB = (iC + 2) % 3;
+    // compute min and max fov angles:
+    min_angle = 0.0;
+    max_angle = triangle->angle[iC];
+    // compute vertex A along x axis:
+    A.x = triangle->length[iB];
+    A.y = 0.0;
+    A.id = triangle->vert[iA];
+    // compute vertex B in positive y (no need for this to be pre-computed):
+    B.x = triangle->length[iA] * cos(max_angle);
+    B.y = triangle->length[iA] * sin(max_angle);
+    B.id = triangle->vert[iB];
+    // reset vertex C (base vertex which represents the origin):
+    C.x = 0.0;
+    C.y = 0.0;
+    C.id = triangle->vert[iC];
+    // formally consider the distances from C to A and B as geodesics:
+    geoAddPath(sc, A.id, triangle->length[iB]);
+    geoAddPath(sc, B.id, triangle->length[iA]);
+    // chain initialiaztion complete. get next triangle
+    // and begin building chain:
+    current_idx = triangle->neighbor[iC];
+    // ------ build triangle chain ------
+    while (true) {
+      // check if the current triangle is valid or if it
+      // already exists in the chain:
+      if ((current_idx < 0) || (sc.inChain[current_idx])) {
+        // move on to next base triangle if the stack is empty:
+        if (stack.empty()) break;
+        // if not, just revert to the last stack item:
+        else {
+          stackitem = stack.top();
+          A = stackitem.a;
+          B = stackitem.b;
+          C = stackitem.c;
+          min_angle = stackitem.mina;
+          max_angle = stackitem.maxa;
+          current_idx = stackitem.idx;
+          triangle = &triangles[current_idx];
+          // trim the chain back to the current triangle:
+          while ((chain.back() != current_idx) && (chain.size() > 0)) {
+            sc.inChain[chain.back()] = 0;
+            chain.pop_back();
+          }
+          stack.pop();
+        }
+      }
+      // triangle is valid, so add it to the chain:
+      else {
+        triangle = &triangles[current_idx];
+        chain.push_back(current_idx);
+        sc.inChain[current_idx] = 1;
+        // find appropriate vertex indices for new triangle:
+        iA = getIndex(triangle->vert, A.id);  // this can be optimized
+        iB = getIndex(triangle->vert, B.id);
+        iD = idxlookup[iA + iB];
+        // calculate the planar position of the extended vertex D:
+        D = extendedPoint(A, B, triangle->length[iB], triangle->length[iA], triangle->length[iD]);
+        D.id = triangle->vert[iD];
+        // calculate the angle that the vector D makes with x-axis:
+        current_angle = atan2(D.y, D.x);
+        // now calculate the distance to the origin:
+        distance = sqrt(D.x * D.x + D.y * D.y);
+        if (distance > maxdist) {
+          current_idx = -1;  // this forces the next triangle invalid
+          continue;
+        }
+        geoAddVertex(sc, D.id);
+        // check if angle is visible within the fov:
+        if ((current_angle < min_angle)) {
+          C = A;
+          A = D;
+        }
+        else if ((current_angle > max_angle)) {
+          C = B;
+          B = D;
+        }
+        else if (((current_angle <= max_angle) && (current_angle >= min_angle))) {
+          // keep the geodesic if shorter than the previous distance:
+          geoAddPath(sc, D.id, distance);
+          // push triangle to the stack:
+          stackitem.a = A;
+          stackitem.b = D;
+          stackitem.c = B;
+          stackitem.idx = current_idx;
+          stackitem.mina = min_angle;
+          stackitem.maxa = current_angle;
+          stack.push(stackitem);
+          C = A;
+          A = D;
+          min_angle = current_angle;
+        }
+        // this is used to find bugs within the surface (so far I've only
+        // seen problems in the fsaverage surface)
+        else {
+          current_idx = -1;
+          continue;
+        }
+      }
+      // get the next triangle and repeat:
+      iC = getIndex(triangle->vert, C.id);
+      current_idx = triangle->neighbor[iC];
+    }
+  }
+  for (unsigned int c = 0; c < chain.size(); c++) sc.inChain[chain[c]] = 0;
+  chain.clear();
+  geoFlushRow(sc, vertexID, true);
+}
+
+/*
+  Second pass for one source vertex k: vertices that the chains reached
+  but could not see get the shortest two-leg path k -> vj -> vi through
+  a vertex vj of the neighborhood, using the LOS table. Their surface
+  neighbors that the chains missed are added to the neighborhood and
+  handled the same way.
+*/
+static void geoSourceFill(int k, MRIS *surf, const GeodesicsCSR *los, float maxdist, GeoScratch &sc)
+{
+  for (long long e = los->offset[k]; e < los->offset[k + 1]; e++) {
+    sc.dist[los->v[e]] = los->dist[e];
+    sc.list.push_back(los->v[e]);
+  }
+  for (unsigned int i = 0; i < sc.list.size(); i++) {
+    int vi = sc.list[i];
+    float best = GEO_NOPATH;
+    if (vi == k || sc.dist[vi] >= 0.0) continue;
+    // the LOS table is symmetric (see geoSymmetrize()), so the row of vi
+    // holds every vj with a distance to vi, whichever end recorded it
+    for (long long e = los->offset[vi]; e < los->offset[vi + 1]; e++) {
+      int vj = los->v[e];
+      float distance;
+      if (vj == k || los->dist[e] < 0.0 || sc.dist[vj] < 0.0) continue;
+      distance = sc.dist[vj] + los->dist[e];
+      if (distance < maxdist && (best < 0.0 || distance < best)) best = distance;
+    }
+    if (best < 0.0) continue;
+    sc.dist[vi] = best;
+    // search for vertices that are within distance limits
+    // but weren't discovered by the triangle chain
+    if (best + 0.5 < maxdist) {
+      VERTEX_TOPOLOGY const * const vt = &surf->vertices_topology[vi];
+      for (int side = 0; side < vt->vnum; side++) geoAddVertex(sc, vt->v[side]);
+    }
+  }
+  geoFlushRow(sc, k, false);
+}
+
+/*
+  Relaxation pass for one source vertex k: the distances that did not come
+  from the LOS pass are shortened through the paths of the previous pass,
+  k -> vj -> vi, which joins paths found from different sources.
+*/
+static void geoSourceRelax(int k, const GeodesicsCSR *los, const GeodesicsCSR *prev, GeoScratch &sc)
+{
+  for (long long e = prev->offset[k]; e < prev->offset[k + 1]; e++) {
+    sc.dist[prev->v[e]] = prev->dist[e];
+    sc.list.push_back(prev->v[e]);
+  }
+  for (unsigned int i = 0; i < sc.list.size(); i++) {
+    int vi = sc.list[i];
+    long long f = geoFind(los, k, vi);
+    if (f >= 0 && los->dist[f] >= 0.0) continue;
+    for (long long e = prev->offset[vi]; e < prev->offset[vi + 1]; e++) {
+      int vj = prev->v[e];
+      float distance;
+      if (vj == k || sc.dist[vj] < 0.0) continue;
+      distance = sc.dist[vj] + prev->dist[e];
+      if (distance < sc.dist[vi]) sc.dist[vi] = distance;
+    }
+  }
+  geoFlushRow(sc, k, false);
+}
+
+/*!
+\fn GeodesicsCSR *computeGeodesicsCSR(MRIS *surf, float maxdist)
+\brief Geodesic distances from every vertex to the vertices within maxdist.
+Each source vertex is independent: the triangle chains around it are
+unfolded into the plane (LOS pass), the tables from both ends of each pair
+are combined, and the vertices that were reached but not seen get a
+two-leg path. Sources are processed in parallel with per-thread work
+space, and the result is a flat CSR table. Face angles and vertex
+neighbor distances must be current (MRIScomputeMetricProperties).
+*/
+GeodesicsCSR *computeGeodesicsCSR(MRIS *surf, float maxdist)
 {
   int msec;
   Timer mytimer;
@@ -60,284 +520,112 @@ Geodesics *computeGeodesics(MRIS *surf, float maxdist)
   fflush(stdout);
 
   // pre-compute and set-up required values to build triangle chain:
-  FACE *face;
-  Triangle *triangle;
   std::vector< Triangle > triangles(surf->nfaces);
-  int idx1, idx2;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
   for (int nf = 0; nf < surf->nfaces; nf++) {
-    face = &surf->faces[nf];
-    triangle = &triangles[nf];
+    ROMP_PFLB_begin
+    FACE *face = &surf->faces[nf];
+    Triangle *triangle = &triangles[nf];
     for (int ns = 0; ns < 3; ns++) {
-      idx1 = (ns + 1) % 3;
-      idx2 = (ns + 2) % 3;
+      int idx1 = (ns + 1) % 3;
+      int idx2 = (ns + 2) % 3;
       triangle->length[ns] = distanceBetween(face->v[idx1], face->v[idx2], surf);
       triangle->neighbor[ns] = findNeighbor(nf, face->v[idx1], face->v[idx2], surf);
       triangle->vert[ns] = face->v[ns];
       triangle->angle[ns] = face->angle[ns];
     }
-    triangle->inChain = false;
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
+  std::vector< GeoScratch > scratch;
+  geoScratchInit(scratch, surf);
 
   msec = mytimer.milliseconds();
   printf("precompute t = %g min\n", msec / (1000.0 * 60));
   fflush(stdout);
 
+  // ------ STEP 1 ------
+  // compute each geodesic using the LOS algorithm. this will not account
+  // for every path.
   std::cout << "computing geodesics within distance of " << maxdist << " mm\n";
   fflush(stdout);
-  std::vector< std::vector< int > > nearestverts(surf->nvertices);
-  int idxlookup[] = {0, 2, 1, 0};  // fast lookup table to find remaining index
-                                   // can be removed... there's an easier way
-  std::map< std::pair< int, int >, float > pathmap;
-  // private vars:
-  std::vector< int > chain;
-  std::stack< StackItem > stack;
-  std::vector< bool > isnearest(surf->nvertices);
-  std::map< std::pair< int, int >, float >::iterator edge;
-  StackItem stackitem;
-  Vertex A, B, C, D;
-  int iA, iB, iC, iD;
-  int current_idx;
-  float min_angle, max_angle, current_angle, distance;
-
-  // ------ STEP 1 ------
-  // compute each geodesic using the LOS algorithm. each geodesics is added
-  // to the pathmap, but this will not account for every path.
-  for (int vertexID = 0; vertexID < surf->nvertices; vertexID++) {
-    VERTEX_TOPOLOGY const * const basevertex = &surf->vertices_topology[vertexID];
-    // begin chain with each face that neighbors the current base vertex:
-    for (int i = 0; i < basevertex->num; i++) {
-      // clear triangle chain and surrounding vertices index:
-      for (unsigned int c = 0; c < chain.size(); c++) triangles[chain[c]].inChain = false;
-      chain.clear();
-      for (unsigned int c = 0; c < isnearest.size(); c++) isnearest[c] = false;
-      // set up initial triangle in plane:
-      current_idx = basevertex->f[i];
-      triangle = &triangles[current_idx];
-      // formally add to chain:
-      chain.push_back(current_idx);
-      triangle->inChain = true;
-      // get vertex indices in relation to their
-      // placement in the face's vertex array:
-      iC = getIndex(triangle->vert, vertexID);
-      iA = (iC + 1) % 3;
-      iB = (iC + 2) % 3;
-      // compute min and max fov angles:
-      min_angle = 0.0;
-      max_angle = triangle->angle[iC];
-      // compute vertex A along x axis:
-      A.x = triangle->length[iB];
-      A.y = 0.0;
-      A.id = triangle->vert[iA];
-      // compute vertex B in positive y (no need for this to be pre-computed):
-      B.x = triangle->length[iA] * cos(max_angle);
-      B.y = triangle->length[iA] * sin(max_angle);
-      B.id = triangle->vert[iB];
-      // reset vertex C (base vertex which represents the origin):
-      C.x = 0.0;
-      C.y = 0.0;
-      C.id = triangle->vert[iC];
-      // formally consider the distance from C to A as a geodesic:
-      nearestverts[vertexID].push_back(A.id);
-      isnearest[A.id] = true;
-      edge = pathmap.find(makeKey(vertexID, A.id));
-      if (edge != pathmap.end())
-        edge->second = triangle->length[iB];
-      else
-        pathmap.insert(make_pair(makeKey(vertexID, A.id), triangle->length[iB]));
-      // formally consider the distance from C to B as a geodesic:
-      nearestverts[vertexID].push_back(B.id);
-      isnearest[B.id] = true;
-      edge = pathmap.find(makeKey(vertexID, B.id));
-      if (edge != pathmap.end())
-        edge->second = triangle->length[iA];
-      else
-        pathmap.insert(make_pair(makeKey(vertexID, B.id), triangle->length[iA]));
-      // chain initialiaztion complete. get next triangle
-      // and begin building chain:
-      current_idx = triangle->neighbor[iC];
-      // ------ build triangle chain ------
-      while (true) {
-        // check if the current triangle is valid or if it
-        // already exists in the chain:
-        if ((current_idx < 0) || (triangles[current_idx].inChain)) {
-          // move on to next base triangle if the stack is empty:
-          if (stack.empty()) break;
-          // if not, just revert to the last stack item:
-          else {
-            stackitem = stack.top();
-            A = stackitem.a;
-            B = stackitem.b;
-            C = stackitem.c;
-            min_angle = stackitem.mina;
-            max_angle = stackitem.maxa;
-            current_idx = stackitem.idx;
-            triangle = &triangles[current_idx];
-            // trim the chain back to the current triangle:
-            while ((chain.back() != current_idx) && (chain.size() > 0)) {
-              triangles[chain.back()].inChain = false;
-              chain.pop_back();
-            }
-            stack.pop();
-          }
-        }
-        // triangle is valid, so add it to the chain:
-        else {
-          triangle = &triangles[current_idx];
-          chain.push_back(current_idx);
-          triangle->inChain = true;
-          // find appropriate vertex indices for new triangle:
-          iA = getIndex(triangle->vert, A.id);  // this can be optimized
-          iB = getIndex(triangle->vert, B.id);
-          iD = idxlookup[iA + iB];
-          // calculate the planar position of the extended vertex D:
-          D = extendedPoint(A, B, triangle->length[iB], triangle->length[iA], triangle->length[iD]);
-          D.id = triangle->vert[iD];
-          // calculate the angle that the vector D makes with x-axis:
-          current_angle = atan2(D.y, D.x);
-          // now calculate the distance to the origin:
-          distance = sqrt(D.x * D.x + D.y * D.y);
-          if (distance > maxdist) {
-            current_idx = -1;  // this forces the next triangle invalid
-            continue;
-          }
-          // potentially use the geodesics matrix here...
-          if (!isnearest[D.id]) {
-            nearestverts[vertexID].push_back(D.id);
-            isnearest[D.id] = true;
-          }
-          // check if angle is visible within the fov:
-          if ((current_angle < min_angle)) {
-            C = A;
-            A = D;
-          }
-          else if ((current_angle > max_angle)) {
-            C = B;
-            B = D;
-          }
-          else if (((current_angle <= max_angle) && (current_angle >= min_angle))) {
-            // add geodesic to path map if shorter than the previous distance:
-            edge = pathmap.find(makeKey(vertexID, D.id));
-            if (edge != pathmap.end()) {
-              if ((distance < edge->second) || (edge->second < 0.0)) edge->second = distance;
-            }
-            else {
-              pathmap.insert(make_pair(makeKey(vertexID, D.id), distance));
-            }
-            // push triangle to the stack:
-            stackitem.a = A;
-            stackitem.b = D;
-            stackitem.c = B;
-            stackitem.idx = current_idx;
-            stackitem.mina = min_angle;
-            stackitem.maxa = current_angle;
-            stack.push(stackitem);
-            C = A;
-            A = D;
-            min_angle = current_angle;
-          }
-          // this is used to find bugs within the surface (so far I've only
-          // seen problems in the fsaverage surface)
-          else {
-            // std::cout << "nan\n";
-            // fflush(stdout);
-            current_idx = -1;
-            continue;
-          }
-        }
-        // get the next triangle and repeat:
-        iC = getIndex(triangle->vert, C.id);
-        current_idx = triangle->neighbor[iC];
-      }
-    }
-    if (vertexID % 1000 == 0) progressBar((float)vertexID / surf->nvertices);
-  }
-  progressBar(1.0);
-  std::cout << std::endl;
+  GeodesicsCSR *los = geoBuildTable(surf->nvertices, scratch, [&](int k, GeoScratch &sc) {
+    geoSourceLOS(k, surf, triangles, maxdist, sc);
+  });
+  geoSymmetrize(los);
   msec = mytimer.milliseconds();
-  printf("step 1 t = %g min\n", msec / (1000.0 * 60));
+  printf("step 1 t = %g min, %lld pairs\n", msec / (1000.0 * 60), los->nnbrs);
   fflush(stdout);
 
+  // ------ STEP 2 ------
+  // compute the shortest paths to the vertices the LOS pass could not see
   std::cout << "computing shortest paths and non-geodesics\n";
   fflush(stdout);
-  Geodesics *geo = (Geodesics *)calloc(surf->nvertices, sizeof(Geodesics));
-  // ------ STEP 2 ------
-  // compute the shortest paths between each vertex (within given limit)
-  int vi, vj;
-  for (int k = 0; k < surf->nvertices; k++) {
-    // set up nearest vertices reference:
-    for (unsigned int d = 0; d < nearestverts[k].size(); d++) {
-      isnearest[nearestverts[k][d]] == true;
-    }
-    for (unsigned int i = 0; i < nearestverts[k].size(); i++) {
-      vi = nearestverts[k][i];
-      edge = pathmap.find(makeKey(k, vi));
-      if ((vi == k) || (edge != pathmap.end())) continue;
-
-      for (unsigned int j = 0; j < nearestverts[k].size(); j++) {
-        vj = nearestverts[k][j];
-        if ((vi == vj) || (vj == k)) continue;
-        // retrieve distance from k to i:
-        edge = pathmap.find(makeKey(k, vj));
-        if (edge == pathmap.end()) continue;
-        distance = edge->second;
-        // retrieve distance from j to k:
-        edge = pathmap.find(makeKey(vj, vi));
-        if (edge == pathmap.end()) continue;
-        distance += edge->second;
-        // retrieve distance from i to j:
-        edge = pathmap.find(makeKey(k, vi));
-        if ((edge == pathmap.end()) && (distance < maxdist))
-          pathmap.insert(make_pair(makeKey(k, vi), distance));
-        else if (distance < edge->second)
-          edge->second = distance;
-      }
-      // search for vertices that are within distance limits
-      // but weren't discovered by the triangle chain
-      edge = pathmap.find(makeKey(k, vi));
-      if (edge != pathmap.end()) {
-        for (int side = 0; side < surf->vertices_topology[vi].vnum; side++) {
-          if (!isnearest[surf->vertices_topology[vi].v[side]]) {
-            distance = edge->second + 0.5;
-            if (distance < maxdist) {
-              isnearest[surf->vertices_topology[vi].v[side]] = true;
-              nearestverts[k].push_back(surf->vertices_topology[vi].v[side]);
-            }
-          }
-        }
-      }
-    }
-    geo[k].vnum = 0;
-    // geo[k].v = (int*) calloc(nearestverts[k].size(), sizeof(int));
-    // geo[k].dist = (float*) calloc(nearestverts[k].size(), sizeof(float));
-    for (unsigned int d = 0; d < nearestverts[k].size(); d++) {
-      edge = pathmap.find(makeKey(k, nearestverts[k][d]));
-      if (edge != pathmap.end()) {
-        geo[k].v[geo[k].vnum] = nearestverts[k][d];
-        geo[k].dist[geo[k].vnum] = edge->second;
-        geo[k].vnum += 1;
-        if (geo[k].vnum > MAX_GEODESICS) {
-          std::cerr << "error: too many neighbors, try a smaller max distance\n";
-          fflush(stdout);
-          exit(1);
-        }
-      }
-      isnearest[nearestverts[k][d]] == false;
-    }
-
-    if (k % 100 == 0) {
-      progressBar((float)k / surf->nvertices);
-    }
+  GeodesicsCSR *geo = geoBuildTable(surf->nvertices, scratch, [&](int k, GeoScratch &sc) {
+    geoSourceFill(k, surf, los, maxdist, sc);
+  });
+  geoSymmetrize(geo);
+  for (int pass = 0; pass < GEO_RELAX_PASSES; pass++) {
+    GeodesicsCSR *prev = geo;
+    geo = geoBuildTable(surf->nvertices, scratch, [&](int k, GeoScratch &sc) {
+      geoSourceRelax(k, los, prev, sc);
+    });
+    geodesicsCSRFree(&prev);
+    geoSymmetrize(geo);
   }
-  progressBar(1.0);
-  std::cout << std::endl;
+  geodesicsCSRFree(&los);
 
   msec = mytimer.milliseconds();
-  printf("t = %g min\n", msec / (1000.0 * 60));
+  printf("t = %g min, %lld geodesics\n", msec / (1000.0 * 60), geo->nnbrs);
   fflush(stdout);
 
   return geo;
 }
 
+Geodesics *computeGeodesics(MRIS *surf, float maxdist)
+{
+  GeodesicsCSR *csr = computeGeodesicsCSR(surf, maxdist);
+  Geodesics *geo = geodesicsCSRToGeodesics(csr);
+  geodesicsCSRFree(&csr);
+  return geo;
+}
+
+/*!
+\fn Geodesics *geodesicsCSRToGeodesics(GeodesicsCSR *csr)
+\brief Copies a CSR table into the fixed-size per-vertex Geodesics
+structures used by the older functions.
+*/
+Geodesics *geodesicsCSRToGeodesics(GeodesicsCSR *csr)
+{
+  Geodesics *geo = (Geodesics *)calloc(csr->nvertices, sizeof(Geodesics));
+  for (int k = 0; k < csr->nvertices; k++) {
+    long long vnum = csr->offset[k + 1] - csr->offset[k];
+    if (vnum > MAX_GEODESICS) {
+      std::cerr << "error: too many neighbors, try a smaller max distance\n";
+      fflush(stdout);
+      exit(1);
+    }
+    geo[k].vnum = vnum;
+    memcpy(geo[k].v, &csr->v[csr->offset[k]], vnum * sizeof(int));
+    memcpy(geo[k].dist, &csr->dist[csr->offset[k]], vnum * sizeof(float));
+  }
+  return geo;
+}
+
+void geodesicsCSRFree(GeodesicsCSR **pcsr)
+{
+  GeodesicsCSR *csr = *pcsr;
+  if (csr == NULL) return;
+  free(csr->offset);
+  free(csr->v);
+  free(csr->dist);
+  free(csr);
+  *pcsr = NULL;
+}
+
 void geodesicsWrite(Geodesics *geo, int nvertices, char *fname)
 {
   int vtxno;
@@ -459,7 +747,7 @@ int geodesicsUniquify(Geodesics *geod)
   return (nunique);
 }
 
-static int getIndex(int *arr, int vid)
+static int getIndex(const int *arr, int vid)
 {
   int idx = std::distance(arr, std::find(arr, arr + 3, vid));
   // this can be removed:
@@ -505,14 +793,6 @@ static Vertex extendedPoint(Vertex A, Vertex B, float dA, float dB, float dAB)
   return D;
 }
 
-static std::pair< int, int > makeKey(int a, int b)
-{
-  if (a < b)
-    return std::pair< int, int >(a, b);
-  else
-    return std::pair< int, int >(b, a);
-}
-
 static void progressBar(float progress)
 {
   if (!isatty(fileno(stdout))) return;
@@ -530,7 +810,8 @@ static void progressBar(float progress)
 }
 
 
-MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex, MRI *out)
+// GeoSmooth() for either neighborhood representation (geod or csr)
+static MRI *geoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, GeodesicsCSR *csr, MRI *volindex, MRI *out)
 {
   int vtxno;
   double gvar, gstd, gf;
@@ -559,15 +840,31 @@ MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex
 #endif
   for(vtxno = 0; vtxno < surf->nvertices; vtxno++){
     ROMP_PFLB_begin
-    int nthnbr,nbrvtxno,frame;
+    int nthnbr,nbrvtxno,frame,vnum,nunique;
+    const int *vlist;
+    const float *dlist;
     double ksum, *sum, d, vkern;
-    Geodesics *vtxgeod;
+    VTXVOLINDEX *vvi=NULL, *uvvi=NULL;
     if(vtxno % 10000 == 0) printf("vtxno %d\n",vtxno);
     if(surf->vertices[vtxno].ripflag) continue;
 
+    if(csr){
+      vnum  = csr->offset[vtxno+1] - csr->offset[vtxno];
+      vlist = &csr->v[csr->offset[vtxno]];
+      dlist = &csr->dist[csr->offset[vtxno]];
+    }
+    else {
+      vnum  = geod[vtxno].vnum;
+      vlist = geod[vtxno].v;
+      dlist = geod[vtxno].dist;
+    }
+
     // Remove replicate neighbors that have the same volume vertex no
-    if(volindex) vtxgeod = VtxVolPruneGeod(geod, vtxno, volindex);
-    else         vtxgeod = &geod[vtxno];
+    if(volindex && vnum > 0){
+      vvi = VtxVolIndexPackList(vnum, vlist, dlist, volindex);
+      uvvi = VtxVolIndexUnique(vvi, vnum, &nunique);
+      vnum = nunique;
+    }
 
     // Set up init using self
     //vkern = surf->vertices[vtxno].area/gf; // scale by the area
@@ -577,10 +874,10 @@ MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex
     for(frame = 0; frame < src->nframes; frame++)
       sum[frame] = (vkern*MRIgetVoxVal(src,vtxno,0,0,frame));
 
-    for(nthnbr = 0 ; nthnbr < vtxgeod->vnum; nthnbr++) {
-      nbrvtxno = vtxgeod->v[nthnbr];
+    for(nthnbr = 0 ; nthnbr < vnum; nthnbr++) {
+      nbrvtxno = uvvi ? uvvi[nthnbr].vtxno : vlist[nthnbr];
       if(surf->vertices[nbrvtxno].ripflag) continue;
-      d = vtxgeod->dist[nthnbr];
+      d = uvvi ? uvvi[nthnbr].dist : dlist[nthnbr];
       //vkern = surf->vertices[nbrvtxno].area*exp(-(d*d)/(2*gvar))/gf; // scale by the area
       vkern = exp(-(d*d)/(2*gvar))/gf; 
       ksum += vkern;
@@ -591,9 +888,10 @@ MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex
     for(frame = 0; frame < src->nframes; frame++)
       MRIsetVoxVal(out,vtxno,0,0,frame,(sum[frame]/ksum));
     surf->vertices[vtxno].valbak = ksum;
-    surf->vertices[vtxno].val2bak = vtxgeod->vnum;
+    surf->vertices[vtxno].val2bak = vnum;
     free(sum);
-    if(volindex) free(vtxgeod);
+    free(vvi);
+    free(uvvi);
     ROMP_PFLB_end
   } // vtxno
   ROMP_PF_end
@@ -601,6 +899,16 @@ MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex
   return(out);
 }
 
+MRI *GeoSmooth(MRI *src, double fwhm, MRIS *surf, Geodesics *geod, MRI *volindex, MRI *out)
+{
+  return(geoSmooth(src, fwhm, surf, geod, NULL, volindex, out));
+}
+
+MRI *GeoSmoothCSR(MRI *src, double fwhm, MRIS *surf, GeodesicsCSR *geod, MRI *volindex, MRI *out)
+{
+  return(geoSmooth(src, fwhm, surf, NULL, geod, volindex, out));
+}
+
 int GeoCount(Geodesics *geod, int nvertices)
 {
   int c=0,cmax=0,vtxno;
@@ -737,6 +1045,109 @@ Geodesics* geodesicsReadV2(char* fname, int *pnvertices)
   return(geo);
 }
 
+/*!
+\fn int geodesicsCSRWriteV2(GeodesicsCSR *csr, char *fname)
+\brief Writes a CSR table in the format of geodesicsWriteV2(). The
+neighbor and distance arrays are already packed, so they are written
+directly without another copy.
+*/
+int geodesicsCSRWriteV2(GeodesicsCSR *csr, char *fname)
+{
+  int vtxno, *vnum;
+  FILE *fp;
+
+  if (csr->nnbrs > INT_MAX) {
+    printf("ERROR: geodesicsCSRWriteV2(): %lld geodesics do not fit the V2 format\n", csr->nnbrs);
+    return(1);
+  }
+  printf(" GeoCount %lld\n", csr->nnbrs);
+
+  fp = fopen(fname, "wb");
+  if (fp == NULL) {
+    printf("ERROR: could not open %s for writing\n", fname);
+    return(1);
+  }
+  fprintf(fp,"FreeSurferGeodesics-V2\n");
+  fprintf(fp,"%d\n",-1);
+  fprintf(fp,"%d\n",csr->nvertices);
+  fprintf(fp,"%d\n",(int)csr->nnbrs);
+
+  vnum = (int *) calloc(sizeof(int),csr->nvertices);
+  for(vtxno = 0; vtxno < csr->nvertices; vtxno++) vnum[vtxno] = csr->offset[vtxno+1] - csr->offset[vtxno];
+  fwrite(vnum,sizeof(int), csr->nvertices, fp);
+  free(vnum);
+  fwrite(csr->v,sizeof(int), csr->nnbrs, fp);
+  fwrite(csr->dist,sizeof(float), csr->nnbrs, fp);
+
+  if (fclose(fp)) {
+    printf("ERROR: could not write %s\n", fname);
+    return(1);
+  }
+  return(0);
+}
+
+/*!
+\fn GeodesicsCSR *geodesicsCSRReadV2(char *fname)
+\brief Reads a file written by geodesicsWriteV2() or geodesicsCSRWriteV2()
+into a CSR table.
+*/
+GeodesicsCSR *geodesicsCSRReadV2(char *fname)
+{
+  int magic, nvertices, nnbrstot, vtxno, *vnum;
+  char tmpstr[1000];
+  FILE *fp;
+  GeodesicsCSR *csr;
+
+  fp = fopen(fname, "rb");
+  if (fp == NULL) {
+    printf("ERROR: could not open %s\n", fname);
+    return(NULL);
+  }
+  if(fscanf(fp,"%s",tmpstr) != 1 || strcmp(tmpstr,"FreeSurferGeodesics-V2")){
+    fclose(fp);
+    printf("ERROR: %s not a geodesics file\n",fname);
+    return(NULL);
+  }
+  if(fscanf(fp,"%d",&magic) != 1 || magic != -1){
+    fclose(fp);
+    printf("ERROR: %s wrong endian\n",fname);
+    return(NULL);
+  }
+  if(fscanf(fp,"%d",&nvertices) != 1 || fscanf(fp,"%d",&nnbrstot) != 1){
+    fclose(fp);
+    printf("ERROR: could not read %s\n",fname);
+    return(NULL);
+  }
+  fgetc(fp); // swallow the new line
+  printf("    geodesicsCSRReadV2(): %s nvertices = %d, ngeodesics = %d\n",fname,nvertices,nnbrstot);
+
+  csr = (GeodesicsCSR *) calloc(1, sizeof(GeodesicsCSR));
+  csr->nvertices = nvertices;
+  csr->nnbrs = nnbrstot;
+  csr->offset = (long long *) calloc(nvertices+1, sizeof(long long));
+  csr->v = (int *) calloc(std::max(nnbrstot,1), sizeof(int));
+  csr->dist = (float *) calloc(std::max(nnbrstot,1), sizeof(float));
+  vnum = (int *) calloc(std::max(nvertices,1), sizeof(int));
+  if(fread(vnum,sizeof(int),nvertices,fp) != (size_t)nvertices ||
+     fread(csr->v,sizeof(int),nnbrstot,fp) != (size_t)nnbrstot ||
+     fread(csr->dist,sizeof(float),nnbrstot,fp) != (size_t)nnbrstot){
+    printf("ERROR: %s failed fread\n",fname);
+    free(vnum);
+    fclose(fp);
+    geodesicsCSRFree(&csr);
+    return(NULL);
+  }
+  fclose(fp);
+  for(vtxno = 0; vtxno < nvertices; vtxno++) csr->offset[vtxno+1] = csr->offset[vtxno] + vnum[vtxno];
+  free(vnum);
+  if(csr->offset[nvertices] != csr->nnbrs){
+    printf("ERROR: %s is inconsistent\n",fname);
+    geodesicsCSRFree(&csr);
+    return(NULL);
+  }
+  return(csr);
+}
+
 // distance along the sphere between two  vertices
 double MRISsphereDist(MRIS *sphere, VERTEX *vtx1, VERTEX *vtx2)
 {
@@ -864,22 +1275,23 @@ VTXVOLINDEX *VtxVolIndexUnique(VTXVOLINDEX *vvi, int nlist, int *nunique)
 }
 
 VTXVOLINDEX *VtxVolIndexPack(Geodesics *geod, int vtxno, MRI *volindex)
+{
+  return(VtxVolIndexPackList(geod[vtxno].vnum, geod[vtxno].v, geod[vtxno].dist, volindex));
+}
+
+VTXVOLINDEX *VtxVolIndexPackList(int vnum, const int *v, const float *dist, MRI *volindex)
 {
   int nthnbr,nbrvtxno;
   VTXVOLINDEX *vvi;
-  //Geodesics *geodvtx = &geod[vtxno];
 
-  vvi = (VTXVOLINDEX *) calloc(sizeof(VTXVOLINDEX),geod[vtxno].vnum);
+  vvi = (VTXVOLINDEX *) calloc(sizeof(VTXVOLINDEX),vnum);
 
-  for(nthnbr = 0 ; nthnbr < geod[vtxno].vnum; nthnbr++) {
-    nbrvtxno = geod[vtxno].v[nthnbr];
+  for(nthnbr = 0 ; nthnbr < vnum; nthnbr++) {
+    nbrvtxno = v[nthnbr];
     vvi[nthnbr].vtxno = nbrvtxno;
-    vvi[nthnbr].dist = geod[vtxno].dist[nthnbr];
+    vvi[nthnbr].dist = dist[nthnbr];
     vvi[nthnbr].volindex = MRIgetVoxVal(volindex,nbrvtxno,0,0,0);
   }
-  //vvi[nthnbr].vtxno = vtxno;
-  //vvi[nthnbr].dist = 0;
-
 
   return(vvi);
 }
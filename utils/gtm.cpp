@@ -869,6 +869,8 @@ int GTMfree(GTM **pGTM)
   // MRIfree(&gtm->gtmseg);
   MRIfree(&gtm->mask);
   MatrixFree(&gtm->X);
+  GTMsparseXfree(&gtm->Xs);
+  GTMsparseXfree(&gtm->X0s);
   MatrixFree(&gtm->y);
   MatrixFree(&gtm->XtX);
   MatrixFree(&gtm->iXtX);
@@ -981,14 +983,17 @@ int GTMnPad(GTM *gtm)
   \brief Solves the GTM using a GLM. X must already have been created.
   Computes Xt, XtX, iXtX, beta, yhat, res, dof, rvar, kurtosis, and skew.
   Also will rescale if rescaling. Returns 1 and computes condition
-  number if matrix cannot be inverted. Otherwise returns 0.
+  number if matrix cannot be inverted. Otherwise returns 0. With a
+  sparse X (gtm->UseSparseX), XtX and Xty are assembled from the sparse
+  columns and all frames are solved at once with a Cholesky
+  factorization of XtX, so the dense X is never formed.
 */
 int GTMsolve(GTM *gtm)
 {
   int n, f;
   double sum;
 
-  if (gtm->X == NULL) {
+  if (!GTMhaveX(gtm)) {
     printf("ERROR: GTMsolve(): must build design matrix first\n");
     exit(1);
   }
@@ -996,26 +1001,45 @@ int GTMsolve(GTM *gtm)
   if (!gtm->Optimizing) printf("Computing  XtX ... ");
   fflush(stdout);
   Timer timer;
-  gtm->XtX = MatrixMtM(gtm->X, gtm->XtX);
+  if (gtm->UseSparseX)
+    gtm->XtX = GTMsparseAtB(gtm->Xs, gtm->Xs, gtm->XtX);
+  else
+    gtm->XtX = MatrixMtM(gtm->X, gtm->XtX);
   if (!gtm->Optimizing) printf(" %4.1f sec\n", timer.seconds());
   fflush(stdout);
 
-  gtm->iXtX = MatrixInverse(gtm->XtX, gtm->iXtX);
-  if (gtm->iXtX == NULL) {
-    if (gtm->Optimizing) return (1);
-    gtm->XtXcond = MatrixConditionNumber(gtm->XtX);
-    printf("ERROR: matrix cannot be inverted, cond=%g\n", gtm->XtXcond);
-    return (1);
+  if (gtm->UseSparseX) {
+    gtm->Xty = GTMsparseAtY(gtm->Xs, gtm->y, gtm->Xty);
+    if (gtm->beta == NULL) gtm->beta = MatrixAlloc(gtm->nsegs, gtm->y->cols, MATRIX_REAL);
+    if (gtm->iXtX == NULL) gtm->iXtX = MatrixAlloc(gtm->nsegs, gtm->nsegs, MATRIX_REAL);
+    if (GTMcholeskySolve(gtm->XtX, gtm->Xty, gtm->beta, gtm->iXtX)) {
+      if (gtm->Optimizing) return (1);
+      gtm->XtXcond = MatrixConditionNumber(gtm->XtX);
+      printf("ERROR: matrix cannot be inverted, cond=%g\n", gtm->XtXcond);
+      return (1);
+    }
+  }
+  else {
+    gtm->iXtX = MatrixInverse(gtm->XtX, gtm->iXtX);
+    if (gtm->iXtX == NULL) {
+      if (gtm->Optimizing) return (1);
+      gtm->XtXcond = MatrixConditionNumber(gtm->XtX);
+      printf("ERROR: matrix cannot be inverted, cond=%g\n", gtm->XtXcond);
+      return (1);
+    }
+    gtm->Xty = MatrixAtB(gtm->X, gtm->y, gtm->Xty);
+    gtm->beta = MatrixMultiplyD(gtm->iXtX, gtm->Xty, gtm->beta);
   }
-  gtm->Xty = MatrixAtB(gtm->X, gtm->y, gtm->Xty);
-  gtm->beta = MatrixMultiplyD(gtm->iXtX, gtm->Xty, gtm->beta);
   if (gtm->rescale) GTMrescale(gtm);
   GTMrefTAC(gtm);
   if (gtm->DoSteadyState) GTMsteadyState(gtm);
 
-  gtm->yhat = MatrixMultiplyD(gtm->X, gtm->beta, gtm->yhat);
+  if (gtm->UseSparseX)
+    gtm->yhat = GTMsparseMultiply(gtm->Xs, gtm->beta, gtm->yhat);
+  else
+    gtm->yhat = MatrixMultiplyD(gtm->X, gtm->beta, gtm->yhat);
   gtm->res = MatrixSubtract(gtm->y, gtm->yhat, gtm->res);
-  gtm->dof = gtm->X->rows - gtm->X->cols;
+  gtm->dof = gtm->nmask - gtm->nsegs;
   if (gtm->rvar == NULL) gtm->rvar = MatrixAlloc(1, gtm->res->cols, MATRIX_REAL);
   if (gtm->rvarUnscaled == NULL) gtm->rvarUnscaled = MatrixAlloc(1, gtm->res->cols, MATRIX_REAL);
   for (f = 0; f < gtm->res->cols; f++) {
@@ -1571,28 +1595,30 @@ MRI *GTMmgxpvc(GTM *gtm, int Target)
   }
 
   // Compute the estimate of the image without the target
-  yNotTarg = MatrixMultiplyD(gtm->X, betaNotTarg, NULL);
+  if (gtm->UseSparseX)
+    yNotTarg = GTMsparseMultiply(gtm->Xs, betaNotTarg, NULL);
+  else
+    yNotTarg = MatrixMultiplyD(gtm->X, betaNotTarg, NULL);
   // Subtract to resdiualize the PET wrt the non-target tissue
   ydiff = MatrixSubtract(gtm->y, yNotTarg, NULL);
 
-  // Scale by the fraction of target tissue type in voxel
-  for (r = 0; r < gtm->X->rows; r++) {
-    sum = 0;
-    for (nthseg = 0; nthseg < gtm->nsegs; nthseg++) {
-      segid = gtm->segidlist[nthseg];
-      tt = gtm->ctGTMSeg->entries[segid]->TissueType;
-      cte = gtm->ctGTMSeg->ctabTissueType->entries[tt];
-      if(Target == 1){ // asking for cortex
+  // Determine which segs are in the target tissue type(s)
+  int *IsTarg = (int *)calloc(sizeof(int), gtm->nsegs);
+  for (nthseg = 0; nthseg < gtm->nsegs; nthseg++) {
+    segid = gtm->segidlist[nthseg];
+    tt = gtm->ctGTMSeg->entries[segid]->TissueType;
+    cte = gtm->ctGTMSeg->ctabTissueType->entries[tt];
+    if(Target == 1){ // asking for cortex
 	if(strcmp("cortex",cte->name)!=0 &&
 	   strcmp("cortex-lh",cte->name)!=0 &&
 	   strcmp("cortex-rh",cte->name)!=0) continue; // but this is not cortex
-      }
-      if(Target == 2){ // asking for subcort
+    }
+    if(Target == 2){ // asking for subcort
 	if(strcmp("subcort_gm",cte->name)!=0 && 
 	   strcmp("subcort_gm-lh",cte->name)!=0 &&
 	   strcmp("subcort_gm-rh",cte->name)!=0) continue; // but this is not subcort
-      }
-      if(Target == 3){ // asking for any GM
+    }
+    if(Target == 3){ // asking for any GM
 	if(strcmp("cortex",cte->name)!=0 &&
 	   strcmp("cortex-lh",cte->name)!=0 &&
 	   strcmp("cortex-rh",cte->name)!=0 &&
@@ -1600,16 +1626,35 @@ MRI *GTMmgxpvc(GTM *gtm, int Target)
 	   strcmp("subcort_gm-lh",cte->name)!=0 &&
 	   strcmp("subcort_gm-rh",cte->name)!=0 &&
 	   strcmp("subcort_gm-mid",cte->name)!=0) continue; // but this is not GM
-      }
-      if(Target == 4 && strcmp("cortex-lh",cte->name)!=0) continue;
-      if(Target == 5 && strcmp("cortex-rh",cte->name)!=0) continue;
-      if(Target == 6 && strcmp("subcort_gm-lh",cte->name)!=0) continue;
-      if(Target == 7 && strcmp("subcort_gm-rh",cte->name)!=0) continue;
-      if(Target == 8 && strcmp("subcort_gm-mid",cte->name)!=0) continue;
+    }
+    if(Target == 4 && strcmp("cortex-lh",cte->name)!=0) continue;
+    if(Target == 5 && strcmp("cortex-rh",cte->name)!=0) continue;
+    if(Target == 6 && strcmp("subcort_gm-lh",cte->name)!=0) continue;
+    if(Target == 7 && strcmp("subcort_gm-rh",cte->name)!=0) continue;
+    if(Target == 8 && strcmp("subcort_gm-mid",cte->name)!=0) continue;
+
+    // otherwise
+    IsTarg[nthseg] = 1;
+  }
 
-      // otherwise
-      sum += gtm->X->rptr[r+1][nthseg+1];
+  // Scale by the fraction of target tissue type in voxel
+  double *TargSum = (double *)calloc(sizeof(double), gtm->nmask);
+  if (gtm->UseSparseX) {
+    for (nthseg = 0; nthseg < gtm->nsegs; nthseg++) {
+      if (!IsTarg[nthseg]) continue;
+      for (int k = 0; k < gtm->Xs->nnz[nthseg]; k++) TargSum[gtm->Xs->rowno[nthseg][k]] += gtm->Xs->val[nthseg][k];
+    }
+  }
+  else {
+    for (r = 0; r < gtm->X->rows; r++) {
+      sum = 0;
+      for (nthseg = 0; nthseg < gtm->nsegs; nthseg++)
+        if (IsTarg[nthseg]) sum += gtm->X->rptr[r + 1][nthseg + 1];
+      TargSum[r] = sum;
     }
+  }
+  for (r = 0; r < gtm->nmask; r++) {
+    sum = TargSum[r];
     if (sum < gtm->mgx_gmthresh)
       for (f = 0; f < gtm->nframes; f++) ydiff->rptr[r + 1][f + 1] = 0;
     else
@@ -1618,7 +1663,8 @@ MRI *GTMmgxpvc(GTM *gtm, int Target)
 
   mgx = GTMmat2vol(gtm, ydiff, NULL);
 
-
+  free(IsTarg);
+  free(TargSum);
   MatrixFree(&betaNotTarg);
   MatrixFree(&yNotTarg);
   MatrixFree(&ydiff);
@@ -1655,9 +1701,25 @@ int GTMmgpvc(GTM *gtm)
 
   // WM PVF
   wmpvf = fMRIframe(gtm->ttpvf, 2, NULL);
-  // Smooth WM PVF by PSF
-  wmpvfpsf = MRIgaussianSmoothNI(wmpvf, gtm->cStd, gtm->rStd, gtm->sStd, NULL);
-  if (gtm->UseMBrad) {
+  if (gtm->UseSparseX && gtm->DoVoxFracCor) {
+    // The columns of X are the seg PVFs already smoothed by the PSF
+    // (including motion blur), so the smoothed WM PVF is just the sum
+    // of the WM columns. Only needed inside the mask.
+    MATRIX *wmcol = MatrixAlloc(gtm->nmask, 1, MATRIX_REAL);
+    int nthseg, k, segid;
+    for (nthseg = 0; nthseg < gtm->nsegs; nthseg++) {
+      segid = gtm->segidlist[nthseg];
+      if (gtm->ctGTMSeg->entries[segid]->TissueType != 3) continue;  // frame 2 of ttpvf
+      for (k = 0; k < gtm->Xs->nnz[nthseg]; k++) wmcol->rptr[gtm->Xs->rowno[nthseg][k] + 1][1] += gtm->Xs->val[nthseg][k];
+    }
+    wmpvfpsf = GTMmat2vol(gtm, wmcol, NULL);
+    MatrixFree(&wmcol);
+  }
+  else {
+    // Smooth WM PVF by PSF
+    wmpvfpsf = MRIgaussianSmoothNI(wmpvf, gtm->cStd, gtm->rStd, gtm->sStd, NULL);
+  }
+  if (gtm->UseMBrad && !(gtm->UseSparseX && gtm->DoVoxFracCor)) {
     MB2D *mb;
     MRI *mritmp;
     mb = MB2Dcopy(gtm->mbrad, 0, NULL);
@@ -1668,7 +1730,7 @@ int GTMmgpvc(GTM *gtm)
     wmpvfpsf = mritmp;
     MB2Dfree(&mb);
   }
-  if (gtm->UseMBtan) {
+  if (gtm->UseMBtan && !(gtm->UseSparseX && gtm->DoVoxFracCor)) {
     MB2D *mb;
     MRI *mritmp;
     mb = MB2Dcopy(gtm->mbtan, 0, NULL);
@@ -1840,7 +1902,10 @@ int GTMsynth(GTM *gtm, int NoiseSeed, int nReps)
     MRIcopyHeader(gtm->yvol, gtm->ysynth);
     MRIcopyPulseParameters(gtm->yvol, gtm->ysynth);
   }
-  yhat = MatrixMultiply(gtm->X0, gtm->beta, NULL);
+  if (gtm->UseSparseX)
+    yhat = GTMsparseMultiply(gtm->X0s, gtm->beta, NULL);
+  else
+    yhat = MatrixMultiply(gtm->X0, gtm->beta, NULL);
   GTMmat2vol(gtm, yhat, gtm->ysynth);
   MatrixFree(&yhat);
 
@@ -1914,17 +1979,376 @@ int GTMcheckX(MATRIX *X)
   printf("GTMcheckX: count=%d, dmax=%g\n", count, dmax);
   return (count);
 }
+/*------------------------------------------------------------------*/
+/*
+  \fn GTM_SPARSE_X *GTMsparseXalloc(int rows, int cols)
+  \brief Allocates a sparse design matrix with no entries. The
+  columns are filled in by GTMbuildX().
+ */
+GTM_SPARSE_X *GTMsparseXalloc(int rows, int cols)
+{
+  GTM_SPARSE_X *Xs;
+  Xs = (GTM_SPARSE_X *)calloc(sizeof(GTM_SPARSE_X), 1);
+  Xs->rows = rows;
+  Xs->cols = cols;
+  Xs->nnz = (int *)calloc(sizeof(int), cols);
+  Xs->rowno = (int **)calloc(sizeof(int *), cols);
+  Xs->val = (float **)calloc(sizeof(float *), cols);
+  return (Xs);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn int GTMsparseXfree(GTM_SPARSE_X **pXs)
+  \brief Frees a sparse design matrix. Ok to pass a NULL matrix.
+ */
+int GTMsparseXfree(GTM_SPARSE_X **pXs)
+{
+  GTM_SPARSE_X *Xs = *pXs;
+  int n;
+  if (Xs == NULL) return (0);
+  for (n = 0; n < Xs->cols; n++) {
+    if (Xs->rowno[n]) free(Xs->rowno[n]);
+    if (Xs->val[n]) free(Xs->val[n]);
+  }
+  free(Xs->nnz);
+  free(Xs->rowno);
+  free(Xs->val);
+  free(Xs);
+  *pXs = NULL;
+  return (0);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn MATRIX *GTMsparseXtoDense(GTM_SPARSE_X *Xs, MATRIX *X)
+  \brief Expands a sparse design matrix into a dense one, eg, to
+  save it to a file. This needs as much memory as the dense X.
+ */
+MATRIX *GTMsparseXtoDense(GTM_SPARSE_X *Xs, MATRIX *X)
+{
+  int n, k;
+  if (X == NULL) {
+    X = MatrixAlloc(Xs->rows, Xs->cols, MATRIX_REAL);
+    if (X == NULL) {
+      printf("ERROR: GTMsparseXtoDense(): could not alloc %d %d\n", Xs->rows, Xs->cols);
+      return (NULL);
+    }
+  }
+  else
+    MatrixClear(X);
+  for (n = 0; n < Xs->cols; n++)
+    for (k = 0; k < Xs->nnz[n]; k++) X->rptr[Xs->rowno[n][k] + 1][n + 1] = Xs->val[n][k];
+  return (X);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn MATRIX *GTMsparseAtB(GTM_SPARSE_X *A, GTM_SPARSE_X *B, MATRIX *AtB)
+  \brief Computes A'*B for two sparse matrices with the same rows. If
+  A==B then only the upper triangle is computed and then copied to the
+  lower. Each column of A is scattered into a dense vector so that each
+  product only costs the entries of the column of B that fall in the
+  row range of the column of A. Pairs of columns whose row ranges do
+  not overlap (segs that are far apart) are skipped.
+ */
+MATRIX *GTMsparseAtB(GTM_SPARSE_X *A, GTM_SPARSE_X *B, MATRIX *AtB)
+{
+  int acol, nthreads, n;
+  double **scatter;
+
+  if (A->rows != B->rows) {
+    printf("ERROR: GTMsparseAtB(): dim mismatch: %d %d\n", A->rows, B->rows);
+    return (NULL);
+  }
+  if (AtB == NULL) {
+    AtB = MatrixAlloc(A->cols, B->cols, MATRIX_REAL);
+    if (AtB == NULL) {
+      printf("ERROR: GTMsparseAtB(): could not alloc %d %d\n", A->cols, B->cols);
+      return (NULL);
+    }
+  }
+  if (AtB->rows != A->cols || AtB->cols != B->cols) {
+    printf("ERROR: GTMsparseAtB(): output dim mismatch: %d %d\n", AtB->rows, AtB->cols);
+    return (NULL);
+  }
+
+  // one dense scatter vector per thread, allocated on first use
+  nthreads = omp_get_max_threads();
+  scatter = (double **)calloc(sizeof(double *), nthreads);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+  for (acol = 0; acol < A->cols; acol++) {
+    ROMP_PFLB_begin
+
+    int bcol, k, kstart, lo, hi, rmin, rmax, row;
+    int const *arow = A->rowno[acol];
+    float const *aval = A->val[acol];
+    double *s, sum;
+
+    for (bcol = (A == B ? acol : 0); bcol < B->cols; bcol++) {
+      AtB->rptr[acol + 1][bcol + 1] = 0;
+      if (A == B) AtB->rptr[bcol + 1][acol + 1] = 0;
+    }
+    if (A->nnz[acol] == 0) ROMP_PFLB_continue;
+
+    int const tid = omp_get_thread_num();
+    if (scatter[tid] == NULL) scatter[tid] = (double *)calloc(sizeof(double), A->rows);
+    s = scatter[tid];
+    for (k = 0; k < A->nnz[acol]; k++) s[arow[k]] = aval[k];
+    rmin = arow[0];
+    rmax = arow[A->nnz[acol] - 1];
+
+    for (bcol = (A == B ? acol : 0); bcol < B->cols; bcol++) {
+      int const *brow = B->rowno[bcol];
+      float const *bval = B->val[bcol];
+      if (B->nnz[bcol] == 0) continue;
+      if (brow[0] > rmax || brow[B->nnz[bcol] - 1] < rmin) continue;
+      // find the first entry of bcol at or after rmin
+      lo = 0;
+      hi = B->nnz[bcol];
+      while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (brow[mid] < rmin)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      kstart = lo;
+      sum = 0;
+      for (k = kstart; k < B->nnz[bcol]; k++) {
+        row = brow[k];
+        if (row > rmax) break;
+        sum += s[row] * bval[k];
+      }
+      AtB->rptr[acol + 1][bcol + 1] = sum;
+      if (A == B) AtB->rptr[bcol + 1][acol + 1] = sum;
+    }
+    for (k = 0; k < A->nnz[acol]; k++) s[arow[k]] = 0;
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  for (n = 0; n < nthreads; n++)
+    if (scatter[n]) free(scatter[n]);
+  free(scatter);
+  return (AtB);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn MATRIX *GTMsparseAtY(GTM_SPARSE_X *A, MATRIX *y, MATRIX *Aty)
+  \brief Computes A'*y where y is dense (eg, nmask-by-nframes). All
+  frames are done in one pass over the entries of A.
+ */
+MATRIX *GTMsparseAtY(GTM_SPARSE_X *A, MATRIX *y, MATRIX *Aty)
+{
+  int acol;
+
+  if (A->rows != y->rows) {
+    printf("ERROR: GTMsparseAtY(): dim mismatch: %d %d\n", A->rows, y->rows);
+    return (NULL);
+  }
+  if (Aty == NULL) {
+    Aty = MatrixAlloc(A->cols, y->cols, MATRIX_REAL);
+    if (Aty == NULL) {
+      printf("ERROR: GTMsparseAtY(): could not alloc %d %d\n", A->cols, y->cols);
+      return (NULL);
+    }
+  }
+  if (Aty->rows != A->cols || Aty->cols != y->cols) {
+    printf("ERROR: GTMsparseAtY(): output dim mismatch: %d %d\n", Aty->rows, Aty->cols);
+    return (NULL);
+  }
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (acol = 0; acol < A->cols; acol++) {
+    ROMP_PFLB_begin
+
+    int k, f;
+    double *sum = (double *)calloc(sizeof(double), y->cols);
+    for (k = 0; k < A->nnz[acol]; k++) {
+      float const *yrow = y->rptr[A->rowno[acol][k] + 1];
+      double const v = A->val[acol][k];
+      for (f = 0; f < y->cols; f++) sum[f] += v * yrow[f + 1];
+    }
+    for (f = 0; f < y->cols; f++) Aty->rptr[acol + 1][f + 1] = sum[f];
+    free(sum);
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  return (Aty);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn MATRIX *GTMsparseMultiply(GTM_SPARSE_X *A, MATRIX *beta, MATRIX *yhat)
+  \brief Computes yhat = A*beta where beta is dense (eg, nsegs-by-nframes).
+ */
+MATRIX *GTMsparseMultiply(GTM_SPARSE_X *A, MATRIX *beta, MATRIX *yhat)
+{
+  int acol, k, f;
+
+  if (A->cols != beta->rows) {
+    printf("ERROR: GTMsparseMultiply(): dim mismatch: %d %d\n", A->cols, beta->rows);
+    return (NULL);
+  }
+  if (yhat == NULL) {
+    yhat = MatrixAlloc(A->rows, beta->cols, MATRIX_REAL);
+    if (yhat == NULL) {
+      printf("ERROR: GTMsparseMultiply(): could not alloc %d %d\n", A->rows, beta->cols);
+      return (NULL);
+    }
+  }
+  else
+    MatrixClear(yhat);
+  if (yhat->rows != A->rows || yhat->cols != beta->cols) {
+    printf("ERROR: GTMsparseMultiply(): output dim mismatch: %d %d\n", yhat->rows, yhat->cols);
+    return (NULL);
+  }
+
+  for (acol = 0; acol < A->cols; acol++) {
+    float const *b = beta->rptr[acol + 1];
+    for (k = 0; k < A->nnz[acol]; k++) {
+      float *yrow = yhat->rptr[A->rowno[acol][k] + 1];
+      float const v = A->val[acol][k];
+      for (f = 1; f <= beta->cols; f++) yrow[f] += v * b[f];
+    }
+  }
+  return (yhat);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn int GTMcholeskySolve(MATRIX *XtX, MATRIX *Xty, MATRIX *beta, MATRIX *iXtX)
+  \brief Solves XtX*beta = Xty for all the columns (frames) of Xty with
+  a Cholesky factorization of XtX, and computes inv(XtX) into iXtX if
+  it is non-NULL. beta must be allocated to the size of Xty. Returns 1
+  if XtX is not positive definite (eg, a seg has no voxels or two
+  segs are indistinguishable), otherwise 0.
+ */
+int GTMcholeskySolve(MATRIX *XtX, MATRIX *Xty, MATRIX *beta, MATRIX *iXtX)
+{
+  int n = XtX->rows, i, j, k, f, nrhs;
+  double *L, *b, d;
+
+  L = (double *)calloc(sizeof(double), (size_t)n * n);
+  for (j = 0; j < n; j++) {
+    d = XtX->rptr[j + 1][j + 1];
+    for (k = 0; k < j; k++) d -= L[j * n + k] * L[j * n + k];
+    if (!(d > DBL_EPSILON * fabs(XtX->rptr[j + 1][j + 1]))) {
+      free(L);
+      return (1);
+    }
+    L[j * n + j] = sqrt(d);
+    for (i = j + 1; i < n; i++) {
+      d = XtX->rptr[i + 1][j + 1];
+      for (k = 0; k < j; k++) d -= L[i * n + k] * L[j * n + k];
+      L[i * n + j] = d / L[j * n + j];
+    }
+  }
+
+  // Each right-hand side is a frame of Xty or a column of the identity
+  b = (double *)calloc(sizeof(double), n);
+  nrhs = Xty->cols + (iXtX ? n : 0);
+  for (f = 0; f < nrhs; f++) {
+    for (i = 0; i < n; i++) {
+      if (f < Xty->cols)
+        b[i] = Xty->rptr[i + 1][f + 1];
+      else
+        b[i] = (i == f - Xty->cols);
+    }
+    for (i = 0; i < n; i++) {  // L*z = b
+      d = b[i];
+      for (k = 0; k < i; k++) d -= L[i * n + k] * b[k];
+      b[i] = d / L[i * n + i];
+    }
+    for (i = n - 1; i >= 0; i--) {  // L'*x = z
+      d = b[i];
+      for (k = i + 1; k < n; k++) d -= L[k * n + i] * b[k];
+      b[i] = d / L[i * n + i];
+    }
+    for (i = 0; i < n; i++) {
+      if (f < Xty->cols)
+        beta->rptr[i + 1][f + 1] = b[i];
+      else
+        iXtX->rptr[i + 1][f - Xty->cols + 1] = b[i];
+    }
+  }
+  free(b);
+  free(L);
+  return (0);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn int GTMhaveX(GTM *gtm)
+  \brief Returns 1 if the design matrix has been built, either dense
+  or sparse, 0 otherwise.
+ */
+int GTMhaveX(GTM *gtm)
+{
+  if (gtm->UseSparseX) return (gtm->Xs != NULL);
+  return (gtm->X != NULL);
+}
+/*------------------------------------------------------------------*/
+/*
+  \fn int *GTMrowSegNo(GTM *gtm)
+  \brief Returns an array with the nthseg of the gtmseg at each row of X
+  (ie, each voxel in the mask in GTMvol2mat() order), -1 if segid=0
+  or not in the segidlist. Used to go from a sparse column back to
+  the seg of each voxel. Caller must free.
+ */
+int *GTMrowSegNo(GTM *gtm)
+{
+  int *rowseg, k, c, r, s, segid, nthseg;
+
+  rowseg = (int *)calloc(sizeof(int), gtm->nmask);
+  k = 0;
+  for (s = 0; s < gtm->yvol->depth; s++) {  // crs order is important here!
+    for (c = 0; c < gtm->yvol->width; c++) {
+      for (r = 0; r < gtm->yvol->height; r++) {
+        if (gtm->mask && MRIgetVoxVal(gtm->mask, c, r, s, 0) < 0.5) continue;
+        segid = MRIgetVoxVal(gtm->gtmseg, c, r, s, 0);
+        rowseg[k] = -1;
+        if (segid != 0) {
+          for (nthseg = 0; nthseg < gtm->nsegs; nthseg++)
+            if (gtm->segidlist[nthseg] == segid) break;
+          if (nthseg < gtm->nsegs) rowseg[k] = nthseg;
+        }
+        k++;
+      }
+    }
+  }
+  return (rowseg);
+}
 /*------------------------------------------------------------------------------*/
 /*
   \fn int GTMbuildX(GTM *gtm)
   \brief Builds the GTM design matrix both with (X) and without (X0) PSF.  If
-  gtm->DoVoxFracCor=1 then corrects for volume fraction effect.
+  gtm->DoVoxFracCor=1 then corrects for volume fraction effect. If
+  gtm->UseSparseX=1, then the sparse Xs and X0s are built instead of X
+  and X0. Only the entries inside the padded bounding box of each seg
+  are kept, so Xs needs far less memory than X when there are many
+  small segs. The entries are exactly those of the dense X.
 */
 int GTMbuildX(GTM *gtm)
 {
   int nthseg, err;
 
-  if (gtm->X == NULL || gtm->X->rows != gtm->nmask || gtm->X->cols != gtm->nsegs) {
+  if (gtm->UseSparseX) {
+    if (gtm->Xs == NULL || gtm->Xs->rows != gtm->nmask || gtm->Xs->cols != gtm->nsegs) {
+      GTMsparseXfree(&gtm->Xs);
+      gtm->Xs = GTMsparseXalloc(gtm->nmask, gtm->nsegs);
+    }
+    if (!gtm->Optimizing && (gtm->X0s == NULL || gtm->X0s->rows != gtm->nmask || gtm->X0s->cols != gtm->nsegs)) {
+      GTMsparseXfree(&gtm->X0s);
+      gtm->X0s = GTMsparseXalloc(gtm->nmask, gtm->nsegs);
+    }
+  }
+  else if (gtm->X == NULL || gtm->X->rows != gtm->nmask || gtm->X->cols != gtm->nsegs) {
     // Alloc or realloc X
     if (gtm->X) MatrixFree(&gtm->X);
     gtm->X = MatrixAlloc(gtm->nmask, gtm->nsegs, MATRIX_REAL);
@@ -1933,7 +2357,7 @@ int GTMbuildX(GTM *gtm)
       return (1);
     }
   }
-  if (gtm->X0 == NULL || gtm->X0->rows != gtm->nmask || gtm->X0->cols != gtm->nsegs) {
+  if (!gtm->UseSparseX && (gtm->X0 == NULL || gtm->X0->rows != gtm->nmask || gtm->X0->cols != gtm->nsegs)) {
     if (gtm->X0) MatrixFree(&gtm->X0);
     gtm->X0 = MatrixAlloc(gtm->nmask, gtm->nsegs, MATRIX_REAL);
     if (gtm->X0 == NULL) {
@@ -1941,7 +2365,7 @@ int GTMbuildX(GTM *gtm)
       return (1);
     }
   }
-  gtm->dof = gtm->X->rows - gtm->X->cols;
+  gtm->dof = gtm->nmask - gtm->nsegs;
 
   Timer timer;
 
@@ -2007,6 +2431,22 @@ int GTMbuildX(GTM *gtm)
     }
     // Fill X, creating X in this order makes it consistent with matlab
     // Note: y must be ordered in the same way. See GTMvol2mat()
+    GTM_SPARSE_X *Xs = gtm->Xs, *X0s = gtm->Optimizing ? NULL : gtm->X0s;
+    int nmax = 0, nnz = 0, nnz0 = 0;
+    if (gtm->UseSparseX) {
+      // The bounding box bounds the number of entries, shrink when done
+      nmax = region->dx * region->dy * region->dz;
+      if (Xs->rowno[nthseg]) free(Xs->rowno[nthseg]);
+      if (Xs->val[nthseg]) free(Xs->val[nthseg]);
+      Xs->rowno[nthseg] = (int *)calloc(sizeof(int), nmax);
+      Xs->val[nthseg] = (float *)calloc(sizeof(float), nmax);
+      if (X0s) {
+        if (X0s->rowno[nthseg]) free(X0s->rowno[nthseg]);
+        if (X0s->val[nthseg]) free(X0s->val[nthseg]);
+        X0s->rowno[nthseg] = (int *)calloc(sizeof(int), nmax);
+        X0s->val[nthseg] = (float *)calloc(sizeof(float), nmax);
+      }
+    }
     k = 0;
     for (s = 0; s < gtm->yvol->depth; s++) {
       for (c = 0; c < gtm->yvol->width; c++) {
@@ -2016,6 +2456,24 @@ int GTMbuildX(GTM *gtm)
           if (c < region->x || c >= region->x + region->dx) continue;
           if (r < region->y || r >= region->y + region->dy) continue;
           if (s < region->z || s >= region->z + region->dz) continue;
+          if (gtm->UseSparseX) {
+            float v;
+            if (X0s) {
+              v = MRIgetVoxVal(nthsegpvfbb, c - region->x, r - region->y, s - region->z, 0);
+              if (v != 0) {
+                X0s->rowno[nthseg][nnz0] = k - 1;
+                X0s->val[nthseg][nnz0] = v;
+                nnz0++;
+              }
+            }
+            v = MRIgetVoxVal(nthsegpvfbbsm, c - region->x, r - region->y, s - region->z, 0);
+            if (v != 0) {
+              Xs->rowno[nthseg][nnz] = k - 1;
+              Xs->val[nthseg][nnz] = v;
+              nnz++;
+            }
+            continue;
+          }
           // do not use k+1 here because it has already been incr above
           if (!gtm->Optimizing)
             gtm->X0->rptr[k][nthseg + 1] = MRIgetVoxVal(nthsegpvfbb, c - region->x, r - region->y, s - region->z, 0);
@@ -2024,6 +2482,16 @@ int GTMbuildX(GTM *gtm)
         }
       }
     }
+    if (gtm->UseSparseX) {
+      Xs->nnz[nthseg] = nnz;
+      Xs->rowno[nthseg] = (int *)realloc(Xs->rowno[nthseg], sizeof(int) * MAX(nnz, 1));
+      Xs->val[nthseg] = (float *)realloc(Xs->val[nthseg], sizeof(float) * MAX(nnz, 1));
+      if (X0s) {
+        X0s->nnz[nthseg] = nnz0;
+        X0s->rowno[nthseg] = (int *)realloc(X0s->rowno[nthseg], sizeof(int) * MAX(nnz0, 1));
+        X0s->val[nthseg] = (float *)realloc(X0s->val[nthseg], sizeof(float) * MAX(nnz0, 1));
+      }
+    }
     MRIfree(&nthsegpvf);
     MRIfree(&nthsegpvfbb);
     MRIfree(&nthsegpvfbbsm);
@@ -2033,8 +2501,17 @@ int GTMbuildX(GTM *gtm)
   ROMP_PF_end
   
   if (!gtm->Optimizing) printf(" Build time %6.4f, err = %d\n", timer.seconds(), err);
+  if (gtm->UseSparseX && !gtm->Optimizing && gtm->Xs) {
+    double nnz = 0;
+    for (nthseg = 0; nthseg < gtm->nsegs; nthseg++) nnz += gtm->Xs->nnz[nthseg];
+    printf(" Sparse X: %g entries, %5.2f%% of %d x %d\n", nnz, 100.0 * nnz / ((double)gtm->nmask * gtm->nsegs),
+           gtm->nmask, gtm->nsegs);
+  }
   fflush(stdout);
-  if (err) gtm->X = NULL;
+  if (err) {
+    gtm->X = NULL;
+    GTMsparseXfree(&gtm->Xs);
+  }
 
   return (0);
 }
@@ -2856,25 +3333,42 @@ int GTMttPercent(GTM *gtm)
   if (gtm->ttpct != NULL) MatrixFree(&gtm->ttpct);
   gtm->ttpct = MatrixAlloc(gtm->nsegs, nTT, MATRIX_REAL);
 
-  // Must be done in same order as GTMbuildX()
-  k = 0;
-  for (s = 0; s < gtm->yvol->depth; s++) {
-    for (c = 0; c < gtm->yvol->width; c++) {
-      for (r = 0; r < gtm->yvol->height; r++) {
-        if (gtm->mask && MRIgetVoxVal(gtm->mask, c, r, s, 0) < 0.5) continue;
-        segid = MRIgetVoxVal(gtm->gtmseg, c, r, s, 0);
-        k++;  // have to do this here
-        if (segid == 0) continue;
-        for (nthseg = 0; nthseg < gtm->nsegs; nthseg++)
-          if (segid == gtm->segidlist[nthseg]) break;
-        for (mthseg = 0; mthseg < gtm->nsegs; mthseg++) {
-          mthsegid = gtm->segidlist[mthseg];
-          tt = gtm->ctGTMSeg->entries[mthsegid]->TissueType;
-          // printf("k=%d, segid = %d, nthseg = %d, mthsegid = %d, mthseg = %d, tt=%d\n",
-          // k,segid,nthseg,mthsegid,mthseg,tt);
-          fflush(stdout);
-          gtm->ttpct->rptr[nthseg + 1][tt] +=  // not tt+1
-              (gtm->X->rptr[k][mthseg + 1] * gtm->beta->rptr[mthseg + 1][1]);
+  if (gtm->UseSparseX) {
+    // Go down each sparse column instead of across each row of X
+    int *rowseg = GTMrowSegNo(gtm);
+    for (mthseg = 0; mthseg < gtm->nsegs; mthseg++) {
+      mthsegid = gtm->segidlist[mthseg];
+      tt = gtm->ctGTMSeg->entries[mthsegid]->TissueType;
+      for (k = 0; k < gtm->Xs->nnz[mthseg]; k++) {
+        nthseg = rowseg[gtm->Xs->rowno[mthseg][k]];
+        if (nthseg < 0) continue;
+        gtm->ttpct->rptr[nthseg + 1][tt] +=  // not tt+1
+            (gtm->Xs->val[mthseg][k] * gtm->beta->rptr[mthseg + 1][1]);
+      }
+    }
+    free(rowseg);
+  }
+  else {
+    // Must be done in same order as GTMbuildX()
+    k = 0;
+    for (s = 0; s < gtm->yvol->depth; s++) {
+      for (c = 0; c < gtm->yvol->width; c++) {
+        for (r = 0; r < gtm->yvol->height; r++) {
+          if (gtm->mask && MRIgetVoxVal(gtm->mask, c, r, s, 0) < 0.5) continue;
+          segid = MRIgetVoxVal(gtm->gtmseg, c, r, s, 0);
+          k++;  // have to do this here
+          if (segid == 0) continue;
+          for (nthseg = 0; nthseg < gtm->nsegs; nthseg++)
+            if (segid == gtm->segidlist[nthseg]) break;
+          for (mthseg = 0; mthseg < gtm->nsegs; mthseg++) {
+            mthsegid = gtm->segidlist[mthseg];
+            tt = gtm->ctGTMSeg->entries[mthsegid]->TissueType;
+            // printf("k=%d, segid = %d, nthseg = %d, mthsegid = %d, mthseg = %d, tt=%d\n",
+            // k,segid,nthseg,mthsegid,mthseg,tt);
+            fflush(stdout);
+            gtm->ttpct->rptr[nthseg + 1][tt] +=  // not tt+1
+                (gtm->X->rptr[k][mthseg + 1] * gtm->beta->rptr[mthseg + 1][1]);
+          }
         }
       }
     }
@@ -25,6 +25,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
+#include <vector>
 #ifdef _POSIX_MAPPED_FILES
 #include <sys/mman.h>
 #endif
@@ -146,6 +148,232 @@ static void noteMatrixAlloced(const char* file, int line, int rows, int cols) {
  */
 int MatrixIsSymmetric(MATRIX *matrix);
 
+
+/*
+  Optional BLAS/LAPACK backend (utils built with HAVE_MATRIX_BLAS, which
+  the top-level MATRIX_BLAS cmake option turns on; it is off by default
+  because the results then depend on the BLAS the build links against).
+
+  MatrixAlloc lays the elements out as one dense row-major block, which
+  the Fortran routines see as the column-major transpose. Large real
+  products go to ?gemm/?syrk on that block directly; inverses and SVDs
+  go through a column-major double copy, which costs O(n^2) next to
+  their O(n^3). Everything below the threshold stays on the loops, so
+  the 3x3 and 4x4 transforms give exactly the results they always did.
+*/
+#define MATRIX_BLAS_DEFAULT_MIN  (32.0 * 32.0 * 32.0)  // multiply-adds
+
+#ifdef HAVE_MATRIX_BLAS
+extern "C" {
+void sgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k,
+            const float *alpha, const float *a, const int *lda, const float *b, const int *ldb,
+            const float *beta, float *c, const int *ldc);
+void dgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k,
+            const double *alpha, const double *a, const int *lda, const double *b, const int *ldb,
+            const double *beta, double *c, const int *ldc);
+void dsyrk_(const char *uplo, const char *trans, const int *n, const int *k,
+            const double *alpha, const double *a, const int *lda,
+            const double *beta, double *c, const int *ldc);
+void dgetrf_(const int *m, const int *n, double *a, const int *lda, int *ipiv, int *info);
+void dgetri_(const int *n, double *a, const int *lda, const int *ipiv,
+             double *work, const int *lwork, int *info);
+void dgesvd_(const char *jobu, const char *jobvt, const int *m, const int *n, double *a, const int *lda,
+             double *s, double *u, const int *ldu, double *vt, const int *ldvt,
+             double *work, const int *lwork, int *info);
+}
+#endif
+
+static double &matrixBlasMin()
+{
+  static double min_madds = getenv("FREESURFER_MatrixBlasMin") ?
+                            atof(getenv("FREESURFER_MatrixBlasMin")) : MATRIX_BLAS_DEFAULT_MIN;
+  return min_madds;
+}
+
+int MatrixBlasAvailable(void)
+{
+#ifdef HAVE_MATRIX_BLAS
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+double MatrixBlasThreshold(double min_madds)
+{
+  double const old = matrixBlasMin();
+  matrixBlasMin() = min_madds;
+  return old;
+}
+
+#ifdef HAVE_MATRIX_BLAS
+
+// the strided views below rely on the layout MatrixAlloc gives every real matrix
+static bool matrixIsDenseReal(const MATRIX *m)
+{
+  return m->type == MATRIX_REAL && m->rows > 0 && m->cols > 0 && m->rptr[1] == m->data - 1 &&
+         m->rptr[m->rows] == m->data + (m->rows - 1) * m->cols - 1;
+}
+
+static bool matrixUseBlas(double madds, const MATRIX *m1, const MATRIX *m2, const MATRIX *m3)
+{
+  double const min_madds = matrixBlasMin();
+  return min_madds >= 0 && madds >= min_madds && matrixIsDenseReal(m1) && (!m2 || matrixIsDenseReal(m2)) &&
+         matrixIsDenseReal(m3);
+}
+
+// row-major m3 = m1*m2 is column-major m3' = m2'*m1'
+static void matrixMultiplyBlas(const MATRIX *m1, const MATRIX *m2, MATRIX *m3)
+{
+  int const m = m3->cols, n = m3->rows, k = m1->cols;
+  float const alpha = 1, beta = 0;
+  sgemm_("N", "N", &m, &n, &k, &alpha, m2->data, &m, m1->data, &k, &beta, m3->data, &m);
+}
+
+static void matrixCopyToDouble(const MATRIX *m, std::vector<double> &d)
+{
+  d.assign(m->data, m->data + (size_t)m->rows * m->cols);
+}
+
+static void matrixCopyFromDouble(const std::vector<double> &d, MATRIX *m)
+{
+  std::copy(d.begin(), d.end(), m->data);
+}
+
+// as above, but accumulating in double like MatrixMultiplyD
+static void matrixMultiplyDBlas(const MATRIX *m1, const MATRIX *m2, MATRIX *m3)
+{
+  int const m = m3->cols, n = m3->rows, k = m1->cols;
+  double const alpha = 1, beta = 0;
+  std::vector<double> a, b, c((size_t)n * m);
+  matrixCopyToDouble(m1, a);
+  matrixCopyToDouble(m2, b);
+  dgemm_("N", "N", &m, &n, &k, &alpha, b.data(), &m, a.data(), &k, &beta, c.data(), &m);
+  matrixCopyFromDouble(c, m3);
+}
+
+// row-major mout = A'*B is column-major mout' = B'*A
+static void matrixAtBBlas(const MATRIX *A, const MATRIX *B, MATRIX *mout)
+{
+  int const m = B->cols, n = A->cols, k = A->rows;
+  double const alpha = 1, beta = 0;
+  std::vector<double> a, b, c((size_t)n * m);
+  matrixCopyToDouble(A, a);
+  matrixCopyToDouble(B, b);
+  dgemm_("N", "T", &m, &n, &k, &alpha, b.data(), &m, a.data(), &n, &beta, c.data(), &m);
+  matrixCopyFromDouble(c, mout);
+}
+
+// row-major mout = M'*M is column-major M'*M'' with M' cols x rows, one triangle then mirrored
+static void matrixMtMBlas(const MATRIX *M, MATRIX *mout)
+{
+  int const n = M->cols, k = M->rows;
+  double const alpha = 1, beta = 0;
+  std::vector<double> a, c((size_t)n * n);
+  matrixCopyToDouble(M, a);
+  dsyrk_("U", "N", &n, &k, &alpha, a.data(), &n, &beta, c.data(), &n);
+  for (int c1 = 0; c1 < n; c1++)
+    for (int c2 = c1; c2 < n; c2++)
+      mout->rptr[c1 + 1][c2 + 1] = mout->rptr[c2 + 1][c1 + 1] = c[c1 + (size_t)c2 * n];
+}
+
+// the inverse of the transpose is the transpose of the inverse, so no reordering is needed
+static int matrixInverseBlas(const MATRIX *mIn, MATRIX *mOut)
+{
+  int const n = mIn->rows;
+  int info = 0, lwork = -1;
+  double wkopt;
+  std::vector<double> a;
+  std::vector<int> ipiv(n);
+  matrixCopyToDouble(mIn, a);
+  dgetrf_(&n, &n, a.data(), &n, ipiv.data(), &info);
+  if (info != 0) return ERROR_BADPARM;  // singular
+  dgetri_(&n, a.data(), &n, ipiv.data(), &wkopt, &lwork, &info);
+  lwork = (int)wkopt;
+  std::vector<double> work(lwork);
+  dgetri_(&n, a.data(), &n, ipiv.data(), work.data(), &lwork, &info);
+  if (info != 0) return ERROR_BADPARM;
+  matrixCopyFromDouble(a, mOut);
+  return NO_ERROR;
+}
+
+// same contract as OpenSvdcmp: ioA becomes U, and W and V are written densely
+static int matrixSvdcmpBlas(MATRIX *ioA, VECTOR *oW, MATRIX *oV)
+{
+  int const rows = ioA->rows, cols = ioA->cols;
+  int info = 0, lwork = -1;
+  double wkopt;
+  std::vector<double> a((size_t)rows * cols), s(cols), u((size_t)rows * cols), vt((size_t)cols * cols);
+  for (int r = 0; r < rows; r++)
+    for (int c = 0; c < cols; c++) a[r + (size_t)c * rows] = ioA->rptr[r + 1][c + 1];
+  dgesvd_("S", "S", &rows, &cols, a.data(), &rows, s.data(), u.data(), &rows, vt.data(), &cols,
+          &wkopt, &lwork, &info);
+  lwork = (int)wkopt;
+  std::vector<double> work(lwork);
+  dgesvd_("S", "S", &rows, &cols, a.data(), &rows, s.data(), u.data(), &rows, vt.data(), &cols,
+          work.data(), &lwork, &info);
+  if (info != 0) return ERROR_BADPARM;
+  for (int r = 0; r < rows; r++)
+    for (int c = 0; c < cols; c++) ioA->data[r * cols + c] = u[r + (size_t)c * rows];
+  for (int c = 0; c < cols; c++) oW->data[c] = s[c];
+  for (int r = 0; r < cols; r++)
+    for (int c = 0; c < cols; c++) oV->data[r * cols + c] = vt[c + (size_t)r * cols];
+  return NO_ERROR;
+}
+
+#endif
+
+static int matrixSvdcmp(MATRIX *ioA, VECTOR *oW, MATRIX *oV)
+{
+#ifdef HAVE_MATRIX_BLAS
+  if (ioA->rows >= ioA->cols && matrixUseBlas((double)ioA->rows * ioA->cols * ioA->cols, ioA, NULL, oV))
+    return matrixSvdcmpBlas(ioA, oW, oV);
+#endif
+  return OpenSvdcmp(ioA, oW, oV);
+}
+
+
+/*
+  The 3x3 and 4x4 products (and their application to a point) are so
+  common that they get fixed-size kernels. They sum in the same order as
+  the general loops, so the results are identical, and they go through a
+  local buffer so an aliased m3 does not need a temporary MATRIX.
+*/
+template <typename Acc, int R, int K, int C>
+static void matrixMultiplyFixed(const MATRIX *m1, const MATRIX *m2, MATRIX *m3)
+{
+  float out[R][C];
+  for (int row = 0; row < R; row++) {
+    const float *r1 = &m1->rptr[row + 1][1];
+    for (int col = 0; col < C; col++) {
+      Acc val = 0;
+      for (int i = 0; i < K; i++) val += (Acc)r1[i] * m2->rptr[i + 1][col + 1];
+      out[row][col] = val;
+    }
+  }
+  for (int row = 0; row < R; row++)
+    for (int col = 0; col < C; col++) m3->rptr[row + 1][col + 1] = out[row][col];
+}
+
+template <typename Acc>
+static bool matrixMultiplySmall(const MATRIX *m1, const MATRIX *m2, MATRIX *m3)
+{
+  if (m1->type != MATRIX_REAL || m2->type != MATRIX_REAL || m3->type != MATRIX_REAL) return false;
+  if (m1->rows != m1->cols) return false;
+
+  if (m1->rows == 3 && m2->cols == 3)
+    matrixMultiplyFixed<Acc, 3, 3, 3>(m1, m2, m3);
+  else if (m1->rows == 3 && m2->cols == 1)
+    matrixMultiplyFixed<Acc, 3, 3, 1>(m1, m2, m3);
+  else if (m1->rows == 4 && m2->cols == 4)
+    matrixMultiplyFixed<Acc, 4, 4, 4>(m1, m2, m3);
+  else if (m1->rows == 4 && m2->cols == 1)
+    matrixMultiplyFixed<Acc, 4, 4, 1>(m1, m2, m3);
+  else
+    return false;
+  return true;
+}
+
 MATRIX *MatrixCopy(const MATRIX *mIn, MATRIX *mOut)
 {
   int row, rows, cols, col;
@@ -252,15 +480,18 @@ MATRIX *MatrixInverse(const MATRIX *mIn, MATRIX *mOut)
     MatrixFree(&mImag);
   }
   else {
-    mTmp = MatrixCopy(mIn, NULL);
-
-    // a = mTmp->rptr;
-    // y = mOut->rptr;
+    // both inverters work on their own copy of mIn, so there is no temp matrix
+    // to allocate, which matters for the 3x3 and 4x4 inverses done in loops
+    mTmp = NULL;
 
-    isError = OpenLUMatrixInverse(mTmp, mOut);
+#ifdef HAVE_MATRIX_BLAS
+    if (rows > 4 && matrixUseBlas((double)rows * rows * rows, mIn, NULL, mOut))
+      isError = matrixInverseBlas(mIn, mOut);
+    else
+#endif
+      isError = OpenLUMatrixInverse((MATRIX *)mIn, mOut);
 
     if (isError < 0) {
-      MatrixFree(&mTmp);
       if (alloced) {
         MatrixFree(&mOut);
       }
@@ -627,6 +858,8 @@ MATRIX *MatrixMultiplyD(const MATRIX *m1, const MATRIX *m2, MATRIX *m3)
                  m3->cols));
   }
 
+  if (matrixMultiplySmall<double>(m1, m2, m3)) return (m3);
+
   if (m3 == m2) {
     m_tmp1 = MatrixCopy(m2, NULL);
     m2 = m_tmp1;
@@ -640,6 +873,11 @@ MATRIX *MatrixMultiplyD(const MATRIX *m1, const MATRIX *m2, MATRIX *m3)
   rows = m3->rows;
   m1_cols = m1->cols;
 
+#ifdef HAVE_MATRIX_BLAS
+  if (matrixUseBlas((double)rows * cols * m1_cols, m1, m2, m3))
+    matrixMultiplyDBlas(m1, m2, m3);
+  else
+#endif
   /* twitzel modified here */
   if ((m1->type == MATRIX_REAL) && (m2->type == MATRIX_REAL)) {
     for (row = 1; row <= rows; row++) {
@@ -747,6 +985,8 @@ MATRIX *MatrixMultiply_wkr(const MATRIX *m1, const MATRIX *m2, MATRIX *m3, const
                  m3->cols));
   }
 
+  if (matrixMultiplySmall<float>(m1, m2, m3)) return (m3);
+
   if (m3 == m2) {
     m_tmp1 = MatrixCopy(m2, NULL);
     m2 = m_tmp1;
@@ -760,6 +1000,11 @@ MATRIX *MatrixMultiply_wkr(const MATRIX *m1, const MATRIX *m2, MATRIX *m3, const
   rows = m3->rows;
   m1_cols = m1->cols;
 
+#ifdef HAVE_MATRIX_BLAS
+  if (matrixUseBlas((double)rows * cols * m1_cols, m1, m2, m3))
+    matrixMultiplyBlas(m1, m2, m3);
+  else
+#endif
   /* twitzel modified here */
   if ((m1->type == MATRIX_REAL) && (m2->type == MATRIX_REAL)) {
     for (row = 1; row <= rows; row++) {
@@ -1772,7 +2017,7 @@ MATRIX *MatrixSVD(MATRIX *mA, VECTOR *v_z, MATRIX *mV)
   // svd(mA->rptr, mV->rptr, v_z->data, mA->rows, mA->cols) ;
 
   if (mV == NULL) mV = MatrixAlloc(mA->rows, mA->rows, MATRIX_REAL);
-  OpenSvdcmp(mA, v_z, mV);
+  matrixSvdcmp(mA, v_z, mV);
 
   return (mV);
 }
@@ -1795,7 +2040,7 @@ float MatrixSVDEigenValues(MATRIX *m, float *evalues)
   memset(evalues, 0, nevalues * sizeof(evalues[0]));
 
   /* calculate condition # of matrix */
-  if (OpenSvdcmp(m_U, v_w, m_V) != NO_ERROR) return (Gerror);
+  if (matrixSvdcmp(m_U, v_w, m_V) != NO_ERROR) return (Gerror);
 
   eigen_values = (EVALUE *)calloc((UINT)nevalues, sizeof(EIGEN_VALUE));
   for (i = 0; i < nevalues; i++) {
@@ -1852,7 +2097,7 @@ MATRIX *MatrixSVDInverse(MATRIX *m, MATRIX *m_inverse)
   MatrixBuffer v_w_buffer; 
   MATRIX* v_w = MatrixAlloc2(1, cols, MATRIX_REAL, &v_w_buffer);
 
-  if (OpenSvdcmp(m_U, v_w, m_V) != NO_ERROR) {
+  if (matrixSvdcmp(m_U, v_w, m_V) != NO_ERROR) {
     MatrixFree(&m_U);
     MatrixFree(&m_V);
     MatrixFree(&v_w);
@@ -2409,7 +2654,7 @@ int MatrixSingular(MATRIX *m)
   m_V = MatrixAlloc(cols, cols, MATRIX_REAL);
 
   /* calculate condition # of matrix */
-  if (OpenSvdcmp(m_U, v_w, m_V) != NO_ERROR) return (Gerror);
+  if (matrixSvdcmp(m_U, v_w, m_V) != NO_ERROR) return (Gerror);
 
   wmax = 0.0f;
   wmin = wmax = RVECTOR_ELT(v_w, 1);
@@ -2467,7 +2712,7 @@ float MatrixConditionNumber(MATRIX *m)
   m_V = MatrixAlloc(cols, cols, MATRIX_REAL);
 
   /* calculate condition # of matrix */
-  OpenSvdcmp(m_U, v_w, m_V);
+  matrixSvdcmp(m_U, v_w, m_V);
   wmax = 0.0f;
   wmin = wmax = RVECTOR_ELT(v_w, 1);
   for (row = 2; row <= rows; row++) {
@@ -3596,7 +3841,7 @@ MATRIX *MatrixSVDPseudoInverse(MATRIX *m, MATRIX *m_pseudo_inv)
     v_S = VectorAlloc(cols, MATRIX_REAL);
 
     if (MatrixIsZero(m)) return (NULL);
-    OpenSvdcmp(m_U, v_S, m_V);
+    matrixSvdcmp(m_U, v_S, m_V);
 
     for (r = 1; r <= v_S->rows; r++)
       if (VECTOR_ELT(v_S, r) / VECTOR_ELT(v_S, 1) < 1e-4) break;
@@ -4210,12 +4455,17 @@ MATRIX *MatrixMtM(MATRIX *m, MATRIX *mout)
   rows = m->rows;
   cols = m->cols;
 
-  if (ntot == 0) {
-    // create a lookup table that maps n to c1 and c2
-    if (ntot != ((cols * cols) + cols) / 2) {
-      if (c1list) free(c1list);
-      if (c2list) free(c2list);
-    }
+#ifdef HAVE_MATRIX_BLAS
+  if (matrixUseBlas((double)rows * cols * cols / 2, m, NULL, mout)) {
+    matrixMtMBlas(m, mout);
+    return (mout);
+  }
+#endif
+
+  if (ntot != ((cols * cols) + cols) / 2) {
+    // create a lookup table that maps n to c1 and c2 (again if cols changed)
+    if (c1list) free(c1list);
+    if (c2list) free(c2list);
     ntot = ((cols * cols) + cols) / 2;
     if (Gdiag_no > 0) printf("MatrixMtM: Alloc rows=%d cols=%d ntot=%d\n", rows, cols, ntot);
     c1list = (int *)calloc(sizeof(int), ntot);
@@ -4383,6 +4633,13 @@ MATRIX *MatrixAtB(MATRIX *A, MATRIX *B, MATRIX *mout)
     }
   }
 
+#ifdef HAVE_MATRIX_BLAS
+  if (matrixUseBlas((double)A->rows * A->cols * B->cols, A, B, mout)) {
+    matrixAtBBlas(A, B, mout);
+    return (mout);
+  }
+#endif
+
   ROMP_PF_begin
 #ifdef HAVE_OPENMP
   #pragma omp parallel for if_ROMP(experimental)
@@ -4492,7 +4749,7 @@ MATRIX *MatrixColNullSpace(MATRIX *M, int *err)
   u = MatrixCopy(M2, NULL);  // It's done in-place so make a copy
   s = RVectorAlloc(M2->cols, MATRIX_REAL);
   v = MatrixAlloc(M2->cols, M2->cols, MATRIX_REAL);
-  OpenSvdcmp(u, s, v);
+  matrixSvdcmp(u, s, v);
 
   // Determine dimension
   if (fabs(s->rptr[1][1]) > .00000001) {
@@ -9420,6 +9420,219 @@ int MRIsampleSeqVolume(const MRI *mri, double x, double y, double z, float *valv
   return (NO_ERROR);
 }
 
+/*------------------------------------------------------------------
+  Sampling stencils. Resampling a 4D volume with MRIsampleSeqVolume()
+  or MRIsampleVolumeFrameType() redoes the bounds checks, the
+  neighbor indices and the weights for every frame, and dispatches on
+  the voxel type for every sample. MRIsampleStencil*() do that work
+  once per location and MRIsampleStencilFrames() then applies it to all
+  frames with a loop specialized for the storage type. The results are
+  identical to the per-frame functions they replace.
+  -------------------------------------------------------------------*/
+
+/* stencil for the voxel (c,r,s), which must be inside the volume */
+int MRIsampleStencilVoxel(const MRI *mri, int c, int r, int s, MRI_SAMPLE_STENCIL *st)
+{
+  st->nvox = 1;
+  st->c[0] = c;
+  st->r[0] = r;
+  st->s[0] = s;
+  st->w[0] = 1.0;
+  return (NO_ERROR);
+}
+
+/* trilinear stencil with the same bounds handling and weights as MRIsampleSeqVolume() */
+int MRIsampleStencilSeq(const MRI *mri, double x, double y, double z, MRI_SAMPLE_STENCIL *st)
+{
+  int xm, xp, ym, yp, zm, zp, width, height, depth;
+  double xmd, ymd, zmd, xpd, ypd, zpd; /* d's are distances */
+
+  if (MRIindexNotInVolume(mri, x, y, z) == 1) {
+    /* unambiguously out of bounds */
+    st->nvox = 0;
+    return (NO_ERROR);
+  }
+
+  width = mri->width;
+  height = mri->height;
+  depth = mri->depth;
+
+  if (x >= width) x = width - 1.0;
+  if (y >= height) y = height - 1.0;
+  if (z >= depth) z = depth - 1.0;
+  if (x < 0.0) x = 0.0;
+  if (y < 0.0) y = 0.0;
+  if (z < 0.0) z = 0.0;
+
+  xm = MAX((int)x, 0);
+  xp = MIN(width - 1, xm + 1);
+  ym = MAX((int)y, 0);
+  yp = MIN(height - 1, ym + 1);
+  zm = MAX((int)z, 0);
+  zp = MIN(depth - 1, zm + 1);
+
+  xmd = x - (float)xm;
+  ymd = y - (float)ym;
+  zmd = z - (float)zm;
+  xpd = (1.0f - xmd);
+  ypd = (1.0f - ymd);
+  zpd = (1.0f - zmd);
+
+  st->nvox = 8;
+  st->c[0] = xm, st->r[0] = ym, st->s[0] = zm, st->w[0] = xpd * ypd * zpd;
+  st->c[1] = xm, st->r[1] = ym, st->s[1] = zp, st->w[1] = xpd * ypd * zmd;
+  st->c[2] = xm, st->r[2] = yp, st->s[2] = zm, st->w[2] = xpd * ymd * zpd;
+  st->c[3] = xm, st->r[3] = yp, st->s[3] = zp, st->w[3] = xpd * ymd * zmd;
+  st->c[4] = xp, st->r[4] = ym, st->s[4] = zm, st->w[4] = xmd * ypd * zpd;
+  st->c[5] = xp, st->r[5] = ym, st->s[5] = zp, st->w[5] = xmd * ypd * zmd;
+  st->c[6] = xp, st->r[6] = yp, st->s[6] = zm, st->w[6] = xmd * ymd * zpd;
+  st->c[7] = xp, st->r[7] = yp, st->s[7] = zp, st->w[7] = xmd * ymd * zmd;
+  return (NO_ERROR);
+}
+
+/* stencil equivalent to MRIsampleVolumeFrameType() with SAMPLE_NEAREST or SAMPLE_TRILINEAR */
+int MRIsampleStencilType(const MRI *mri, double x, double y, double z, int type, MRI_SAMPLE_STENCIL *st)
+{
+  int xv, yv, zv;
+
+  if (FEQUAL((int)x, x) && FEQUAL((int)y, y) && FEQUAL((int)z, z)) type = SAMPLE_NEAREST;
+
+  switch (type) {
+    case SAMPLE_NEAREST:
+      break;
+    case SAMPLE_TRILINEAR:
+      return (MRIsampleStencilSeq(mri, x, y, z, st));
+    default:
+      st->nvox = 0;
+      ErrorReturn(ERROR_UNSUPPORTED,
+                  (ERROR_UNSUPPORTED, "MRIsampleStencilType(%d): unsupported interpolation type", type));
+  }
+
+  if (MRIindexNotInVolume(mri, x, y, z) == 1) {
+    st->nvox = 0;
+    return (NO_ERROR);
+  }
+
+  xv = nint(x);
+  yv = nint(y);
+  zv = nint(z);
+  if (xv < 0) xv = 0;
+  if (xv >= mri->width) xv = mri->width - 1;
+  if (yv < 0) yv = 0;
+  if (yv >= mri->height) yv = mri->height - 1;
+  if (zv < 0) zv = 0;
+  if (zv >= mri->depth) zv = mri->depth - 1;
+  return (MRIsampleStencilVoxel(mri, xv, yv, zv, st));
+}
+
+template <class T>
+static inline const T *stencilVoxPtr(const MRI *mri, int c, int r, int s, int f)
+{
+  if (mri->ischunked)
+    return ((const T *)mri->chunk + c + r * mri->vox_per_row + s * mri->vox_per_slice + f * mri->vox_per_vol);
+  return ((const T *)mri->slices[s + f * mri->depth][r] + c);
+}
+
+template <class T>
+static void sampleStencilFramesT(const MRI *mri, const MRI_SAMPLE_STENCIL *st, float *valvect, int firstframe, int lastframe)
+{
+  int f, k;
+  const T *p[8];
+  size_t o, stride;
+
+  if (!mri->ischunked) {
+    for (f = firstframe; f <= lastframe; f++) {
+      for (k = 0; k < st->nvox; k++) p[k] = stencilVoxPtr<T>(mri, st->c[k], st->r[k], st->s[k], f);
+      if (st->nvox == 1)
+        valvect[f] = (float)*p[0];
+      else
+        valvect[f] = st->w[0] * (double)*p[0] + st->w[1] * (double)*p[1] + st->w[2] * (double)*p[2] +
+                     st->w[3] * (double)*p[3] + st->w[4] * (double)*p[4] + st->w[5] * (double)*p[5] +
+                     st->w[6] * (double)*p[6] + st->w[7] * (double)*p[7];
+    }
+    return;
+  }
+
+  // the frames of a chunked volume are vox_per_vol apart
+  for (k = 0; k < st->nvox; k++) p[k] = stencilVoxPtr<T>(mri, st->c[k], st->r[k], st->s[k], 0);
+  stride = mri->vox_per_vol;
+  if (st->nvox == 1) {
+    for (f = firstframe, o = f * stride; f <= lastframe; f++, o += stride) valvect[f] = (float)p[0][o];
+    return;
+  }
+  const double w0 = st->w[0], w1 = st->w[1], w2 = st->w[2], w3 = st->w[3];
+  const double w4 = st->w[4], w5 = st->w[5], w6 = st->w[6], w7 = st->w[7];
+  for (f = firstframe, o = f * stride; f <= lastframe; f++, o += stride)
+    valvect[f] = w0 * (double)p[0][o] + w1 * (double)p[1][o] + w2 * (double)p[2][o] + w3 * (double)p[3][o] +
+                 w4 * (double)p[4][o] + w5 * (double)p[5][o] + w6 * (double)p[6][o] + w7 * (double)p[7][o];
+}
+
+/* applies st to frames firstframe..lastframe of mri, valvect is indexed by frame */
+int MRIsampleStencilFrames(const MRI *mri, const MRI_SAMPLE_STENCIL *st, float *valvect, int firstframe, int lastframe)
+{
+  int f;
+
+  if (st->nvox == 0) {
+    for (f = firstframe; f <= lastframe; f++) valvect[f] = mri->outside_val;
+    return (NO_ERROR);
+  }
+
+  switch (mri->type) {
+    case MRI_UCHAR:
+      sampleStencilFramesT<unsigned char>(mri, st, valvect, firstframe, lastframe);
+      break;
+    case MRI_SHORT:
+      sampleStencilFramesT<short>(mri, st, valvect, firstframe, lastframe);
+      break;
+    case MRI_RGB:
+    case MRI_INT:
+      sampleStencilFramesT<int>(mri, st, valvect, firstframe, lastframe);
+      break;
+    case MRI_LONG:
+      sampleStencilFramesT<long>(mri, st, valvect, firstframe, lastframe);
+      break;
+    case MRI_FLOAT:
+      sampleStencilFramesT<float>(mri, st, valvect, firstframe, lastframe);
+      break;
+    default:
+      ErrorReturn(ERROR_UNSUPPORTED, (ERROR_UNSUPPORTED, "MRIsampleStencilFrames: unsupported type %d", mri->type));
+  }
+  return (NO_ERROR);
+}
+
+/* MRIsetVoxVal() for frames firstframe..lastframe of voxel (c,r,s), valvect is indexed by frame */
+int MRIsetVoxValFrames(MRI *mri, int c, int r, int s, const float *valvect, int firstframe, int lastframe)
+{
+  int f;
+  float v;
+
+  switch (mri->type) {
+    case MRI_FLOAT:
+      for (f = firstframe; f <= lastframe; f++) MRIFseq_vox(mri, c, r, s, f) = valvect[f];
+      break;
+    case MRI_UCHAR:
+      for (f = firstframe; f <= lastframe; f++) {
+        v = valvect[f];
+        if (v < UCHAR_MIN) v = UCHAR_MIN;
+        if (v > UCHAR_MAX) v = UCHAR_MAX;
+        MRIseq_vox(mri, c, r, s, f) = nint(v);
+      }
+      break;
+    case MRI_SHORT:
+      for (f = firstframe; f <= lastframe; f++) {
+        v = valvect[f];
+        if (v < SHORT_MIN) v = SHORT_MIN;
+        if (v > SHORT_MAX) v = SHORT_MAX;
+        MRISseq_vox(mri, c, r, s, f) = nint(v);
+      }
+      break;
+    default:
+      for (f = firstframe; f <= lastframe; f++) MRIsetVoxVal(mri, c, r, s, f, valvect[f]);
+      break;
+  }
+  return (NO_ERROR);
+}
+
 // testing - LZ
 int MRIsampleSeqVolumeType(
     MRI *mri, double x, double y, double z, float *valvect, int firstframe, int lastframe, int type)
@@ -10917,10 +11130,8 @@ MRI *MRIlinearTransform(MRI *mri_src, MRI *mri_dst, MATRIX *mA)
   ------------------------------------------------------------------*/
 MRI *MRIlinearTransformInterp(MRI *mri_src, MRI *mri_dst, MATRIX *mA, int InterpMethod)
 {
-  int y1, y2, y3, width, height, depth, frame;
-  VECTOR *v_X, *v_Y; /* original and transformed coordinate systems */
-  MATRIX *mAinv;     /* inverse of mA */
-  double val, x1, x2, x3;
+  int y3, width, height, depth;
+  MATRIX *mAinv; /* inverse of mA */
 
   if (InterpMethod != SAMPLE_NEAREST && InterpMethod != SAMPLE_TRILINEAR && InterpMethod != SAMPLE_CUBIC_BSPLINE) {
     printf(
@@ -10948,47 +11159,64 @@ MRI *MRIlinearTransformInterp(MRI *mri_src, MRI *mri_dst, MATRIX *mA, int Interp
   width = mri_dst->width;
   height = mri_dst->height;
   depth = mri_dst->depth;
-  v_X = VectorAlloc(4, MATRIX_REAL); /* input (src) coordinates */
-  v_Y = VectorAlloc(4, MATRIX_REAL); /* transformed (dst) coordinates */
 
-  v_Y->rptr[4][1] = 1.0f;
+  // The source coordinates are mAinv*[y1 y2 y3 1]', accumulated in float
+  // in the same order as MatrixMultiply(). For nearest and trilinear the
+  // neighbors and weights are found once per voxel and applied to all
+  // frames.
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
   for (y3 = 0; y3 < depth; y3++) {
-    V3_Z(v_Y) = y3;
+    ROMP_PFLB_begin
+    int y1, y2, frame, k;
+    float X[3];
+    double val, x1, x2, x3;
+    float *valvect = (float *)calloc(mri_src->nframes, sizeof(float));
+    MRI_SAMPLE_STENCIL stencil;
+
     for (y2 = 0; y2 < height; y2++) {
-      V3_Y(v_Y) = y2;
       for (y1 = 0; y1 < width; y1++) {
-        V3_X(v_Y) = y1;
-        MatrixMultiply(mAinv, v_Y, v_X);
-
-        x1 = V3_X(v_X);
-        x2 = V3_Y(v_X);
-        x3 = V3_Z(v_X);
+        for (k = 0; k < 3; k++) {
+          X[k] = 0.0f;
+          X[k] += mAinv->rptr[k + 1][1] * (float)y1;
+          X[k] += mAinv->rptr[k + 1][2] * (float)y2;
+          X[k] += mAinv->rptr[k + 1][3] * (float)y3;
+          X[k] += mAinv->rptr[k + 1][4] * 1.0f;
+        }
+        x1 = X[0];
+        x2 = X[1];
+        x3 = X[2];
 
         if (nint(y1) == Gx && nint(y2) == Gy && nint(y3) == Gz) DiagBreak();
         if (nint(x1) == Gx && nint(x2) == Gy && nint(x3) == Gz) {
           DiagBreak();
         }
 
-        // MRIsampleVolume(mri_src, x1, x2, x3, &val);
-        for (frame = 0; frame < mri_src->nframes; frame++) {
-          if (InterpMethod == SAMPLE_CUBIC_BSPLINE)
+        if (InterpMethod == SAMPLE_CUBIC_BSPLINE) {
+          for (frame = 0; frame < mri_src->nframes; frame++) {
             // recommended to externally call this and keep mri_coeff
             // if image is resampled often (e.g. in registration algo)
             MRIsampleBSpline(bspline, x1, x2, x3, frame, &val);
-          else
-            MRIsampleVolumeFrameType(mri_src, x1, x2, x3, frame, InterpMethod, &val);
-
+            // will clip the val according to mri_dst type:
+            MRIsetVoxVal(mri_dst, y1, y2, y3, frame, val);
+          }
+        }
+        else if (MRIsampleStencilType(mri_src, x1, x2, x3, InterpMethod, &stencil) == NO_ERROR) {
+          MRIsampleStencilFrames(mri_src, &stencil, valvect, 0, mri_src->nframes - 1);
           // will clip the val according to mri_dst type:
-          MRIsetVoxVal(mri_dst, y1, y2, y3, frame, val);
-
+          MRIsetVoxValFrames(mri_dst, y1, y2, y3, valvect, 0, mri_src->nframes - 1);
         }
       }
     }
+    free(valvect);
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
+
   if (bspline) MRIfreeBSpline(&bspline);
-  MatrixFree(&v_X);
   MatrixFree(&mAinv);
-  MatrixFree(&v_Y);
 
   mri_dst->ras_good_flag = 1;
 
@@ -670,7 +670,7 @@ MRI *MRIreshape1d(MRI *src, MRI *trg)
   ---------------------------------------------------------------*/
 int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
 {
-  int ct, show_progress_thread;
+  int st, show_progress_thread;
   int tid = 0;
   float *valvects[_MAX_FS_THREADS];
   int sinchw;
@@ -751,13 +751,14 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
 #ifdef HAVE_OPENMP
   #pragma omp parallel for if_ROMP(assume_reproducible) shared(show_progress_thread, targ, bspline, src, Vt2s, InterpCode)
 #endif
-  for (ct = 0; ct < targ->width; ct++) {
+  for (st = 0; st < targ->depth; st++) {
     ROMP_PFLB_begin
     
-    int rt, st, f;
+    int rt, ct, f;
     int ics, irs, iss;
     float fcs, frs, fss, *valvect;
     double rval;
+    MRI_SAMPLE_STENCIL stencil;
 
 #ifdef HAVE_OPENMP
     int tid = omp_get_thread_num();
@@ -766,8 +767,9 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
     valvect = valvects[0];
 #endif
 
+    // x is innermost so that the target is written in memory order
     for (rt = 0; rt < targ->height; rt++) {
-      for (st = 0; st < targ->depth; st++) {
+      for (ct = 0; ct < targ->width; ct++) {
         /* Column in source corresponding to CRS in Target */
         fcs = Vt2s->rptr[1][1] * ct + Vt2s->rptr[1][2] * rt + Vt2s->rptr[1][3] * st + Vt2s->rptr[1][4];
         ics = nintfunc(fcs);
@@ -783,15 +785,19 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
         iss = nintfunc(fss);
         if (iss < 0 || iss >= src->depth) continue;
 
-        /* Assign output volume values */
-        if (InterpCode == SAMPLE_TRILINEAR)
-          MRIsampleSeqVolume(src, fcs, frs, fss, valvect, 0, src->nframes - 1);
+        /* Assign output volume values. Nearest and trilinear work out
+           the neighbors and weights once and apply them to all frames */
+        if (InterpCode == SAMPLE_TRILINEAR) {
+          MRIsampleStencilSeq(src, fcs, frs, fss, &stencil);
+          MRIsampleStencilFrames(src, &stencil, valvect, 0, src->nframes - 1);
+        }
+        else if (InterpCode == SAMPLE_NEAREST) {
+          MRIsampleStencilVoxel(src, ics, irs, iss, &stencil);
+          MRIsampleStencilFrames(src, &stencil, valvect, 0, src->nframes - 1);
+        }
         else {
           for (f = 0; f < src->nframes; f++) {
             switch (InterpCode) {
-              case SAMPLE_NEAREST:
-                valvect[f] = MRIgetVoxVal(src, ics, irs, iss, f);
-                break;
               case SAMPLE_CUBIC_BSPLINE:
                 MRIsampleBSpline(bspline, fcs, frs, fss, f, &rval);
                 valvect[f] = rval;
@@ -807,11 +813,11 @@ int MRIvol2Vol(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param)
           }
         }
 
-        for (f = 0; f < src->nframes; f++) MRIsetVoxVal(targ, ct, rt, st, f, valvect[f]);
+        MRIsetVoxValFrames(targ, ct, rt, st, valvect, 0, src->nframes - 1);
 
       } /* target col */
     }   /* target row */
-    if (tid == show_progress_thread) exec_progress_callback(ct, targ->width, 0, 1);
+    if (tid == show_progress_thread) exec_progress_callback(st, targ->depth, 0, 1);
     ROMP_PFLB_end
   } /* target slice */
   ROMP_PF_end
@@ -2891,14 +2897,9 @@ MRI *MRIhalfCosBias(MRI *in, double alpha, MRI *out)
 
 int MRIvol2VolVSM(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param, MRI *vsm)
 {
-  int ct, rt, st, f;
-  int ics, irs, iss, cvsm, rvsm;
-  float fcs, frs, fss;
-  float *valvect, drvsm;
+  int ct;
   int sinchw;
-  double rval, v;
   MATRIX *V2Rsrc = NULL, *invV2Rsrc = NULL, *V2Rtarg = NULL;
-  MATRIX *crsT = NULL, *crsS = NULL;
   int FreeMats = 0;
 
   if (DIAG_VERBOSE_ON) printf("Using MRIvol2VolVSM\n");
@@ -2925,26 +2926,42 @@ int MRIvol2VolVSM(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param
   }
 
   sinchw = nint(param);
-  valvect = (float *)calloc(sizeof(float), src->nframes);
-
   MRI_BSPLINE *bspline = NULL;
   if (InterpCode == SAMPLE_CUBIC_BSPLINE) bspline = MRItoBSpline(src, NULL, 3);
 
-  crsT = MatrixAlloc(4, 1, MATRIX_REAL);
-  crsT->rptr[4][1] = 1;
-  crsS = MatrixAlloc(4, 1, MATRIX_REAL);
+  // The source CRS is Vt2s*[ct rt st 1]', accumulated in float in the same
+  // order as MatrixMultiply(). The ct and rt terms come first, so they are
+  // summed once per (ct,rt) and only the st terms are added per voxel.
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
   for (ct = 0; ct < targ->width; ct++) {
+    ROMP_PFLB_begin
+    int rt, st, f, k;
+    int ics, irs, iss, cvsm, rvsm;
+    float fcs, frs, fss, drvsm, part[3];
+    double rval, v;
+    float *valvect = (float *)calloc(sizeof(float), src->nframes);
+    MRI_SAMPLE_STENCIL stencil;
+
     for (rt = 0; rt < targ->height; rt++) {
+      for (k = 0; k < 3; k++) {
+        part[k] = 0.0f;
+        part[k] += Vt2s->rptr[k + 1][1] * (float)ct;
+        part[k] += Vt2s->rptr[k + 1][2] * (float)rt;
+      }
       for (st = 0; st < targ->depth; st++) {
         // Compute CRS in VSM space
-        crsT->rptr[1][1] = ct;
-        crsT->rptr[2][1] = rt;
-        crsT->rptr[3][1] = st;
-        crsS = MatrixMultiply(Vt2s, crsT, crsS);
-
-        fcs = crsS->rptr[1][1];
-        frs = crsS->rptr[2][1];
-        fss = crsS->rptr[3][1];
+        fcs = part[0];
+        fcs += Vt2s->rptr[1][3] * (float)st;
+        fcs += Vt2s->rptr[1][4] * 1.0f;
+        frs = part[1];
+        frs += Vt2s->rptr[2][3] * (float)st;
+        frs += Vt2s->rptr[2][4] * 1.0f;
+        fss = part[2];
+        fss += Vt2s->rptr[3][3] * (float)st;
+        fss += Vt2s->rptr[3][4] * 1.0f;
         ics = nint(fcs);
         irs = nint(frs);
         iss = nint(fss);
@@ -2977,15 +2994,19 @@ int MRIvol2VolVSM(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param
           if (irs < 0 || irs >= src->height) continue;
         }
 
-        /* Assign output volume values */
-        if (InterpCode == SAMPLE_TRILINEAR)
-          MRIsampleSeqVolume(src, fcs, frs, fss, valvect, 0, src->nframes - 1);
+        /* Assign output volume values. Nearest and trilinear work out
+           the neighbors and weights once and apply them to all frames */
+        if (InterpCode == SAMPLE_TRILINEAR) {
+          MRIsampleStencilSeq(src, fcs, frs, fss, &stencil);
+          MRIsampleStencilFrames(src, &stencil, valvect, 0, src->nframes - 1);
+        }
+        else if (InterpCode == SAMPLE_NEAREST) {
+          MRIsampleStencilVoxel(src, ics, irs, iss, &stencil);
+          MRIsampleStencilFrames(src, &stencil, valvect, 0, src->nframes - 1);
+        }
         else {
           for (f = 0; f < src->nframes; f++) {
             switch (InterpCode) {
-              case SAMPLE_NEAREST:
-                valvect[f] = MRIgetVoxVal(src, ics, irs, iss, f);
-                break;
               case SAMPLE_CUBIC_BSPLINE:
                 MRIsampleBSpline(bspline, fcs, frs, fss, f, &rval);
                 valvect[f] = rval;
@@ -3001,15 +3022,15 @@ int MRIvol2VolVSM(MRI *src, MRI *targ, MATRIX *Vt2s, int InterpCode, float param
           }
         }
 
-        for (f = 0; f < src->nframes; f++) MRIsetVoxVal(targ, ct, rt, st, f, valvect[f]);
+        MRIsetVoxValFrames(targ, ct, rt, st, valvect, 0, src->nframes - 1);
 
       } /* target col */
     }   /* target row */
+    free(valvect);
+    ROMP_PFLB_end
   }     /* target slice */
+  ROMP_PF_end
 
-  free(valvect);
-  MatrixFree(&crsS);
-  MatrixFree(&crsT);
   if (bspline) MRIfreeBSpline(&bspline);
   if (FreeMats) {
     MatrixFree(&V2Rsrc);
@@ -0,0 +1,621 @@
+/**
+ * @brief bricked, multi-resolution volume files for out-of-core access
+ *
+ * See mribrick.h for a description of the layout. The file starts with a
+ * fixed-size big-endian header, followed by the bricks of level 0, level 1,
+ * etc. Every brick holds brick_size^3 voxels for each frame (frame-major),
+ * zero-padded at the volume edges, so the position of any brick in the file
+ * follows directly from its level and brick index.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "diag.h"
+#include "error.h"
+#include "fio.h"
+#include "machine.h"
+#include "matrix.h"
+#include "mri.h"
+#include "mribrick.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+typedef std::shared_ptr<std::vector<char> > BrickData;
+
+// LRU cache of bricks read from disk, bounded by MRI_BRICK_PYRAMID::max_bytes
+struct BrickCache
+{
+  typedef std::list<long long> LruList;
+  std::mutex mutex;
+  LruList lru;  // most recently used brick first
+  std::unordered_map<long long, std::pair<BrickData, LruList::iterator> > bricks;
+  size_t bytes = 0;
+};
+
+static int brickTypeSupported(int type)
+{
+  return (type == MRI_UCHAR || type == MRI_SHORT || type == MRI_INT || type == MRI_LONG || type == MRI_FLOAT);
+}
+
+static size_t brickBytes(const MRI_BRICK_PYRAMID *bp)
+{
+  return (size_t)bp->brick_size * bp->brick_size * bp->brick_size * bp->nframes * MRIsizeof(bp->type);
+}
+
+static long long brickKey(int level, long long index) { return ((long long)level << 56) | index; }
+
+// fill in the dimensions, brick counts and file offsets of every level
+static void brickComputeLevels(MRI_BRICK_PYRAMID *bp, int width, int height, int depth)
+{
+  long long offset = BRICK_PYRAMID_HEADER_BYTES;
+  for (int l = 0; l < bp->nlevels; l++) {
+    BRICK_LEVEL *lv = &bp->level[l];
+    lv->width = width;
+    lv->height = height;
+    lv->depth = depth;
+    lv->nbx = (width + bp->brick_size - 1) / bp->brick_size;
+    lv->nby = (height + bp->brick_size - 1) / bp->brick_size;
+    lv->nbz = (depth + bp->brick_size - 1) / bp->brick_size;
+    lv->offset = offset;
+    offset += (long long)lv->nbx * lv->nby * lv->nbz * brickBytes(bp);
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+    depth = (depth + 1) / 2;
+  }
+}
+
+// number of levels needed until the whole volume fits in a single brick
+static int brickDefaultLevels(int width, int height, int depth, int brick_size)
+{
+  int nlevels = 1;
+  while ((width > brick_size || height > brick_size || depth > brick_size) && nlevels < BRICK_PYRAMID_MAX_LEVELS) {
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+    depth = (depth + 1) / 2;
+    nlevels++;
+  }
+  return nlevels;
+}
+
+// swap the voxels of a brick buffer between host and big-endian (file) order
+static void brickSwapBuffer(char *buf, size_t nbytes, int type)
+{
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+  size_t bpv = MRIsizeof(type);
+  switch (bpv) {
+    case 2:
+      ByteSwap2(buf, nbytes / bpv);
+      break;
+    case 4:
+      ByteSwap4(buf, nbytes / bpv);
+      break;
+    case 8:
+      ByteSwap8(buf, nbytes / bpv);
+      break;
+  }
+#endif
+}
+
+/*!
+  \fn static MATRIX *brickLevelVox2RAS(MATRIX *V0, int level, MATRIX *m)
+  \brief vox2ras of a downsampled level given the level-0 vox2ras. Voxel
+  i of level L covers level-0 voxels [i*F, (i+1)*F-1] with F = 2^L, so its
+  center sits at level-0 index i*F + (F-1)/2.
+*/
+static MATRIX *brickLevelVox2RAS(MATRIX *V0, int level, MATRIX *m)
+{
+  double F = (double)(1 << level);
+  MATRIX *S = MatrixIdentity(4, NULL);
+  for (int i = 1; i <= 3; i++) {
+    S->rptr[i][i] = F;
+    S->rptr[i][4] = (F - 1.0) / 2.0;
+  }
+  m = MatrixMultiply(V0, S, m);
+  MatrixFree(&S);
+  return (m);
+}
+
+/*!
+  \fn static MRI *brickDownsample2(MRI *src, int nearest)
+  \brief Halves the resolution of src in every direction. Odd dimensions
+  are rounded up and the partial blocks on the edge are averaged over the
+  voxels that exist. With nearest != 0 the first voxel of each 2x2x2
+  block is kept instead, which is what segmentations need.
+*/
+static MRI *brickDownsample2(MRI *src, int nearest)
+{
+  int width = (src->width + 1) / 2, height = (src->height + 1) / 2, depth = (src->depth + 1) / 2;
+
+  MRI *dst = MRIallocSequence(width, height, depth, src->type, src->nframes);
+  if (!dst) ErrorReturn(NULL, (ERROR_NOMEMORY, "brickDownsample2: could not alloc %dx%dx%d", width, height, depth));
+  MRIcopyHeader(src, dst);
+  dst->xsize = src->xsize * 2;
+  dst->ysize = src->ysize * 2;
+  dst->zsize = src->zsize * 2;
+  dst->thick = src->thick * 2;
+  dst->ps = src->ps * 2;
+  MATRIX *V0 = MRIxfmCRS2XYZ(src, 0);
+  MATRIX *V1 = brickLevelVox2RAS(V0, 1, NULL);
+  MRIsetVox2RASFromMatrix(dst, V1);
+  MRIreInitCache(dst);
+  MatrixFree(&V0);
+  MatrixFree(&V1);
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int z = 0; z < depth; z++) {
+    for (int f = 0; f < src->nframes; f++) {
+      for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+          if (nearest) {
+            MRIsetVoxVal(dst, x, y, z, f, MRIgetVoxVal(src, 2 * x, 2 * y, 2 * z, f));
+            continue;
+          }
+          double sum = 0;
+          int n = 0;
+          for (int z1 = 2 * z; z1 <= 2 * z + 1 && z1 < src->depth; z1++)
+            for (int y1 = 2 * y; y1 <= 2 * y + 1 && y1 < src->height; y1++)
+              for (int x1 = 2 * x; x1 <= 2 * x + 1 && x1 < src->width; x1++) {
+                sum += MRIgetVoxVal(src, x1, y1, z1, f);
+                n++;
+              }
+          if (src->type == MRI_FLOAT)
+            MRIsetVoxVal(dst, x, y, z, f, sum / n);
+          else
+            MRIsetVoxVal(dst, x, y, z, f, nint(sum / n));
+        }
+      }
+    }
+  }
+  return (dst);
+}
+
+// copy brick (bx,by,bz) of mri into buf, zero-padding outside the volume
+static void brickGather(MRI *mri, int brick_size, int bx, int by, int bz, char *buf)
+{
+  size_t bpv = MRIsizeof(mri->type);
+  int x0 = bx * brick_size, y0 = by * brick_size, z0 = bz * brick_size;
+  int nx = MIN(brick_size, mri->width - x0);
+
+  memset(buf, 0, (size_t)brick_size * brick_size * brick_size * mri->nframes * bpv);
+  for (int f = 0; f < mri->nframes; f++) {
+    for (int z = z0; z < MIN(z0 + brick_size, mri->depth); z++) {
+      for (int y = y0; y < MIN(y0 + brick_size, mri->height); y++) {
+        size_t boff = ((((size_t)f * brick_size + (z - z0)) * brick_size + (y - y0)) * brick_size) * bpv;
+        char *row = (char *)mri->slices[z + f * mri->depth][y];
+        memcpy(buf + boff, row + x0 * bpv, nx * bpv);
+      }
+    }
+  }
+}
+
+static int brickWriteHeader(FILE *fp, MRI *mri, int brick_size, int nlevels)
+{
+  char magic[8];
+  memset(magic, 0, sizeof(magic));
+  memcpy(magic, BRICK_PYRAMID_MAGIC, strlen(BRICK_PYRAMID_MAGIC));
+  fwrite(magic, sizeof(magic), 1, fp);
+  fwriteInt(BRICK_PYRAMID_VERSION, fp);
+  fwriteInt(mri->width, fp);
+  fwriteInt(mri->height, fp);
+  fwriteInt(mri->depth, fp);
+  fwriteInt(mri->nframes, fp);
+  fwriteInt(mri->type, fp);
+  fwriteInt(brick_size, fp);
+  fwriteInt(nlevels, fp);
+  fwriteFloat(mri->xsize, fp);
+  fwriteFloat(mri->ysize, fp);
+  fwriteFloat(mri->zsize, fp);
+  MATRIX *V0 = MRIxfmCRS2XYZ(mri, 0);
+  for (int r = 1; r <= 3; r++)
+    for (int c = 1; c <= 4; c++) fwriteDouble(V0->rptr[r][c], fp);
+  MatrixFree(&V0);
+  fwriteFloat(mri->tr, fp);
+  fwriteFloat(mri->flip_angle, fp);
+  fwriteFloat(mri->te, fp);
+  fwriteFloat(mri->ti, fp);
+
+  long pos = ftell(fp);
+  std::vector<char> pad(BRICK_PYRAMID_HEADER_BYTES - pos, 0);
+  if (fwrite(pad.data(), 1, pad.size(), fp) != pad.size()) return (ERROR_BADFILE);
+  return (NO_ERROR);
+}
+
+/*!
+  \fn int MRIwriteBrickPyramid(MRI *mri, const char *fname, int brick_size, int nlevels, int nearest)
+  \brief Writes mri as a brick pyramid. brick_size <= 0 selects
+  BRICK_PYRAMID_DEFAULT_SIZE and nlevels <= 0 adds levels until the
+  coarsest one fits in a single brick. Use nearest != 0 for segmentations
+  so the coarse levels keep valid labels.
+*/
+int MRIwriteBrickPyramid(MRI *mri, const char *fname, int brick_size, int nlevels, int nearest)
+{
+  if (!brickTypeSupported(mri->type))
+    ErrorReturn(ERROR_UNSUPPORTED, (ERROR_UNSUPPORTED, "MRIwriteBrickPyramid: unsupported type %d", mri->type));
+  if (brick_size <= 0) brick_size = BRICK_PYRAMID_DEFAULT_SIZE;
+  if (nlevels <= 0) nlevels = brickDefaultLevels(mri->width, mri->height, mri->depth, brick_size);
+  nlevels = MIN(nlevels, BRICK_PYRAMID_MAX_LEVELS);
+
+  FILE *fp = fopen(fname, "wb");
+  if (!fp) ErrorReturn(ERROR_NOFILE, (ERROR_NOFILE, "MRIwriteBrickPyramid: could not open %s for writing", fname));
+
+  MRI_BRICK_PYRAMID bp;
+  memset(&bp, 0, sizeof(bp));
+  bp.type = mri->type;
+  bp.nframes = mri->nframes;
+  bp.brick_size = brick_size;
+  bp.nlevels = nlevels;
+  brickComputeLevels(&bp, mri->width, mri->height, mri->depth);
+
+  if (brickWriteHeader(fp, mri, brick_size, nlevels) != NO_ERROR) {
+    fclose(fp);
+    ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "MRIwriteBrickPyramid: could not write header to %s", fname));
+  }
+
+  std::vector<char> buf(brickBytes(&bp));
+  MRI *mri_level = mri;
+  int error = NO_ERROR;
+  for (int l = 0; l < nlevels && error == NO_ERROR; l++) {
+    BRICK_LEVEL *lv = &bp.level[l];
+    if (Gdiag & DIAG_SHOW)
+      printf("  level %d: %dx%dx%d, %d bricks\n", l, lv->width, lv->height, lv->depth, lv->nbx * lv->nby * lv->nbz);
+    for (int bz = 0; bz < lv->nbz && error == NO_ERROR; bz++)
+      for (int by = 0; by < lv->nby && error == NO_ERROR; by++)
+        for (int bx = 0; bx < lv->nbx; bx++) {
+          brickGather(mri_level, brick_size, bx, by, bz, buf.data());
+          brickSwapBuffer(buf.data(), buf.size(), bp.type);
+          if (fwrite(buf.data(), 1, buf.size(), fp) != buf.size()) {
+            error = ERROR_BADFILE;
+            break;
+          }
+        }
+
+    if (l + 1 < nlevels && error == NO_ERROR) {
+      MRI *mri_next = brickDownsample2(mri_level, nearest);
+      if (mri_level != mri) MRIfree(&mri_level);
+      mri_level = mri_next;
+      if (!mri_level) error = ERROR_NOMEMORY;
+    }
+  }
+  if (mri_level && mri_level != mri) MRIfree(&mri_level);
+  fclose(fp);
+
+  if (error != NO_ERROR) ErrorReturn(error, (error, "MRIwriteBrickPyramid: failed writing %s", fname));
+  return (NO_ERROR);
+}
+
+/*!
+  \fn int MRIisBrickPyramid(const char *fname)
+  \brief Returns 1 if fname starts with the brick pyramid magic
+*/
+int MRIisBrickPyramid(const char *fname)
+{
+  char magic[8];
+  FILE *fp = fopen(fname, "rb");
+  if (!fp) return (0);
+  int n = fread(magic, sizeof(magic), 1, fp);
+  fclose(fp);
+  return (n == 1 && strncmp(magic, BRICK_PYRAMID_MAGIC, strlen(BRICK_PYRAMID_MAGIC)) == 0);
+}
+
+/*!
+  \fn MRI_BRICK_PYRAMID *MRIbrickPyramidOpen(const char *fname, size_t max_bytes)
+  \brief Opens a brick pyramid for reading. No voxel data is read until a
+  level or region is requested. max_bytes bounds the brick cache.
+*/
+MRI_BRICK_PYRAMID *MRIbrickPyramidOpen(const char *fname, size_t max_bytes)
+{
+  FILE *fp = fopen(fname, "rb");
+  if (!fp) ErrorReturn(NULL, (ERROR_NOFILE, "MRIbrickPyramidOpen: could not open %s", fname));
+
+  char magic[8];
+  if (fread(magic, sizeof(magic), 1, fp) != 1 || strncmp(magic, BRICK_PYRAMID_MAGIC, strlen(BRICK_PYRAMID_MAGIC))) {
+    fclose(fp);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIbrickPyramidOpen: %s is not a brick pyramid", fname));
+  }
+  int version = freadInt(fp);
+  if (version != BRICK_PYRAMID_VERSION) {
+    fclose(fp);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIbrickPyramidOpen: %s has unsupported version %d", fname, version));
+  }
+
+  MRI_BRICK_PYRAMID *bp = (MRI_BRICK_PYRAMID *)calloc(1, sizeof(MRI_BRICK_PYRAMID));
+  int width = freadInt(fp);
+  int height = freadInt(fp);
+  int depth = freadInt(fp);
+  bp->nframes = freadInt(fp);
+  bp->type = freadInt(fp);
+  bp->brick_size = freadInt(fp);
+  bp->nlevels = freadInt(fp);
+  if (width <= 0 || height <= 0 || depth <= 0 || bp->nframes <= 0 || !brickTypeSupported(bp->type) ||
+      bp->brick_size <= 0 || bp->nlevels <= 0 || bp->nlevels > BRICK_PYRAMID_MAX_LEVELS) {
+    fclose(fp);
+    free(bp);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIbrickPyramidOpen: corrupt header in %s", fname));
+  }
+
+  MRI *mri = MRIallocHeader(width, height, depth, bp->type, bp->nframes);
+  mri->xsize = freadFloat(fp);
+  mri->ysize = freadFloat(fp);
+  mri->zsize = freadFloat(fp);
+  MATRIX *V0 = MatrixIdentity(4, NULL);
+  for (int r = 1; r <= 3; r++)
+    for (int c = 1; c <= 4; c++) V0->rptr[r][c] = freadDouble(fp);
+  MRIsetVox2RASFromMatrix(mri, V0);
+  MRIreInitCache(mri);
+  MatrixFree(&V0);
+  mri->tr = freadFloat(fp);
+  mri->flip_angle = freadFloat(fp);
+  mri->te = freadFloat(fp);
+  mri->ti = freadFloat(fp);
+  mri->thick = mri->zsize;
+  mri->ps = mri->xsize;
+  fclose(fp);
+
+  bp->fd = open(fname, O_RDONLY);
+  if (bp->fd < 0) {
+    MRIfree(&mri);
+    free(bp);
+    ErrorReturn(NULL, (ERROR_NOFILE, "MRIbrickPyramidOpen: could not open %s", fname));
+  }
+  strncpy(bp->fname, fname, STRLEN - 1);
+  bp->mri_header = mri;
+  bp->max_bytes = max_bytes;
+  bp->cache = new BrickCache;
+  brickComputeLevels(bp, width, height, depth);
+
+  return (bp);
+}
+
+int MRIbrickPyramidClose(MRI_BRICK_PYRAMID **pbp)
+{
+  MRI_BRICK_PYRAMID *bp = *pbp;
+  if (!bp) return (NO_ERROR);
+  if (bp->fd >= 0) close(bp->fd);
+  if (bp->mri_header) MRIfree(&bp->mri_header);
+  delete (BrickCache *)bp->cache;
+  free(bp);
+  *pbp = NULL;
+  return (NO_ERROR);
+}
+
+// drop least recently used bricks until the cache fits in the budget
+static void brickCacheEvict(MRI_BRICK_PYRAMID *bp, BrickCache *cache)
+{
+  while (cache->bytes > bp->max_bytes && cache->lru.size() > 1) {
+    long long key = cache->lru.back();
+    cache->lru.pop_back();
+    auto it = cache->bricks.find(key);
+    cache->bytes -= it->second.first->size();
+    cache->bricks.erase(it);
+  }
+}
+
+int MRIbrickPyramidSetMemoryBudget(MRI_BRICK_PYRAMID *bp, size_t max_bytes)
+{
+  BrickCache *cache = (BrickCache *)bp->cache;
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  bp->max_bytes = max_bytes;
+  brickCacheEvict(bp, cache);
+  return (NO_ERROR);
+}
+
+size_t MRIbrickPyramidCachedBytes(MRI_BRICK_PYRAMID *bp)
+{
+  BrickCache *cache = (BrickCache *)bp->cache;
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  return (cache->bytes);
+}
+
+/*!
+  \fn static BrickData brickFetch(MRI_BRICK_PYRAMID *bp, int level, long long index, int use_cache)
+  \brief Returns the host-order voxels of one brick, from the cache if it
+  is there. The file is read with pread() outside the cache lock so
+  several threads can stream bricks at once.
+*/
+static BrickData brickFetch(MRI_BRICK_PYRAMID *bp, int level, long long index, int use_cache)
+{
+  BrickCache *cache = (BrickCache *)bp->cache;
+  long long key = brickKey(level, index);
+  if (use_cache) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    auto it = cache->bricks.find(key);
+    if (it != cache->bricks.end()) {
+      cache->lru.splice(cache->lru.begin(), cache->lru, it->second.second);
+      return (it->second.first);
+    }
+  }
+
+  size_t nbytes = brickBytes(bp);
+  BrickData data = std::make_shared<std::vector<char> >(nbytes);
+  off_t offset = bp->level[level].offset + index * (off_t)nbytes;
+  size_t nread = 0;
+  while (nread < nbytes) {
+    ssize_t n = pread(bp->fd, data->data() + nread, nbytes - nread, offset + nread);
+    if (n <= 0) {
+      ErrorPrintf(ERROR_BADFILE, "brickFetch: could not read brick %lld of level %d from %s", index, level, bp->fname);
+      return (BrickData());
+    }
+    nread += n;
+  }
+  brickSwapBuffer(data->data(), nbytes, bp->type);
+
+  if (use_cache) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    auto it = cache->bricks.find(key);
+    if (it != cache->bricks.end())  // another thread got there first
+      return (it->second.first);
+    cache->lru.push_front(key);
+    cache->bricks[key] = std::make_pair(data, cache->lru.begin());
+    cache->bytes += nbytes;
+    brickCacheEvict(bp, cache);
+  }
+  return (data);
+}
+
+size_t MRIbrickPyramidLevelBytes(MRI_BRICK_PYRAMID *bp, int level)
+{
+  BRICK_LEVEL *lv = &bp->level[level];
+  return ((size_t)lv->width * lv->height * lv->depth * bp->nframes * MRIsizeof(bp->type));
+}
+
+/*!
+  \fn int MRIbrickPyramidLevelForBudget(MRI_BRICK_PYRAMID *bp, size_t max_bytes)
+  \brief Returns the finest level whose whole volume fits in max_bytes,
+  or the coarsest level if none does.
+*/
+int MRIbrickPyramidLevelForBudget(MRI_BRICK_PYRAMID *bp, size_t max_bytes)
+{
+  for (int l = 0; l < bp->nlevels; l++)
+    if (MRIbrickPyramidLevelBytes(bp, l) <= max_bytes) return (l);
+  return (bp->nlevels - 1);
+}
+
+MATRIX *MRIbrickPyramidLevelVox2RAS(MRI_BRICK_PYRAMID *bp, int level, MATRIX *m)
+{
+  MATRIX *V0 = MRIxfmCRS2XYZ(bp->mri_header, 0);
+  m = brickLevelVox2RAS(V0, level, m);
+  MatrixFree(&V0);
+  return (m);
+}
+
+/*!
+  \fn MRI *MRIbrickPyramidLevelHeader(MRI_BRICK_PYRAMID *bp, int level)
+  \brief Header-only MRI carrying the geometry of the given level
+*/
+MRI *MRIbrickPyramidLevelHeader(MRI_BRICK_PYRAMID *bp, int level)
+{
+  if (level < 0 || level >= bp->nlevels)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIbrickPyramidLevelHeader: level %d out of range", level));
+  BRICK_LEVEL *lv = &bp->level[level];
+  MRI *mri = MRIallocHeader(lv->width, lv->height, lv->depth, bp->type, bp->nframes);
+  MRIcopyHeader(bp->mri_header, mri);
+  double F = (double)(1 << level);
+  mri->xsize = bp->mri_header->xsize * F;
+  mri->ysize = bp->mri_header->ysize * F;
+  mri->zsize = bp->mri_header->zsize * F;
+  mri->thick = bp->mri_header->thick * F;
+  mri->ps = bp->mri_header->ps * F;
+  MATRIX *V = MRIbrickPyramidLevelVox2RAS(bp, level, NULL);
+  MRIsetVox2RASFromMatrix(mri, V);
+  MRIreInitCache(mri);
+  MatrixFree(&V);
+  return (mri);
+}
+
+static MRI *brickReadRegion(MRI_BRICK_PYRAMID *bp, int level, int x0, int y0, int z0,
+                            int width, int height, int depth, int use_cache)
+{
+  if (level < 0 || level >= bp->nlevels)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIbrickPyramidReadRegion: level %d out of range", level));
+  BRICK_LEVEL *lv = &bp->level[level];
+  if (x0 < 0 || y0 < 0 || z0 < 0 || width <= 0 || height <= 0 || depth <= 0 ||
+      x0 + width > lv->width || y0 + height > lv->height || z0 + depth > lv->depth)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIbrickPyramidReadRegion: region (%d,%d,%d)+(%d,%d,%d) outside level %d",
+                       x0, y0, z0, width, height, depth, level));
+
+  MRI *mri = MRIallocSequence(width, height, depth, bp->type, bp->nframes);
+  if (!mri) ErrorReturn(NULL, (ERROR_NOMEMORY, "MRIbrickPyramidReadRegion: could not alloc region"));
+  MRI *mri_level = MRIbrickPyramidLevelHeader(bp, level);
+  MRIcopyHeader(mri_level, mri);
+  MRIfree(&mri_level);
+  MATRIX *V = MRIbrickPyramidLevelVox2RAS(bp, level, NULL);
+  MATRIX *T = MatrixIdentity(4, NULL);
+  T->rptr[1][4] = x0;
+  T->rptr[2][4] = y0;
+  T->rptr[3][4] = z0;
+  MATRIX *VT = MatrixMultiply(V, T, NULL);
+  MRIsetVox2RASFromMatrix(mri, VT);
+  MRIreInitCache(mri);
+  MatrixFree(&V);
+  MatrixFree(&T);
+  MatrixFree(&VT);
+
+  int bs = bp->brick_size;
+  int bx0 = x0 / bs, bx1 = (x0 + width - 1) / bs;
+  int by0 = y0 / bs, by1 = (y0 + height - 1) / bs;
+  int bz0 = z0 / bs, bz1 = (z0 + depth - 1) / bs;
+  int nbx = bx1 - bx0 + 1, nby = by1 - by0 + 1, nbricks = nbx * nby * (bz1 - bz0 + 1);
+  size_t bpv = MRIsizeof(bp->type);
+  int error = 0;
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for schedule(dynamic) reduction(+ : error)
+#endif
+  for (int b = 0; b < nbricks; b++) {
+    int bx = bx0 + b % nbx, by = by0 + (b / nbx) % nby, bz = bz0 + b / (nbx * nby);
+    long long index = ((long long)bz * lv->nby + by) * lv->nbx + bx;
+    BrickData data = brickFetch(bp, level, index, use_cache);
+    if (!data) {
+      error++;
+      continue;
+    }
+    // intersection of this brick with the region, in level coordinates
+    int xs = MAX(x0, bx * bs), xe = MIN(x0 + width, (bx + 1) * bs);
+    int ys = MAX(y0, by * bs), ye = MIN(y0 + height, (by + 1) * bs);
+    int zs = MAX(z0, bz * bs), ze = MIN(z0 + depth, (bz + 1) * bs);
+    for (int f = 0; f < bp->nframes; f++) {
+      for (int z = zs; z < ze; z++) {
+        for (int y = ys; y < ye; y++) {
+          size_t boff = ((((size_t)f * bs + (z - bz * bs)) * bs + (y - by * bs)) * bs + (xs - bx * bs)) * bpv;
+          char *row = (char *)mri->slices[(z - z0) + f * depth][y - y0];
+          memcpy(row + (xs - x0) * bpv, data->data() + boff, (xe - xs) * bpv);
+        }
+      }
+    }
+  }
+
+  if (error) {
+    MRIfree(&mri);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIbrickPyramidReadRegion: failed to read %d bricks from %s", error, bp->fname));
+  }
+  return (mri);
+}
+
+/*!
+  \fn MRI *MRIbrickPyramidReadRegion(MRI_BRICK_PYRAMID *bp, int level, int x0, int y0, int z0, int width, int height, int depth)
+  \brief Reads a sub-volume of the given level through the brick cache.
+  The returned MRI has the geometry of the region, so it can be resampled
+  directly with MRIvol2Vol() and friends.
+*/
+MRI *MRIbrickPyramidReadRegion(MRI_BRICK_PYRAMID *bp, int level,
+                               int x0, int y0, int z0, int width, int height, int depth)
+{
+  return (brickReadRegion(bp, level, x0, y0, z0, width, height, depth, 1));
+}
+
+/*!
+  \fn MRI *MRIbrickPyramidReadLevel(MRI_BRICK_PYRAMID *bp, int level)
+  \brief Reads a whole level. The bricks bypass the cache so that loading
+  an overview level does not evict the bricks being streamed.
+*/
+MRI *MRIbrickPyramidReadLevel(MRI_BRICK_PYRAMID *bp, int level)
+{
+  if (level < 0 || level >= bp->nlevels)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIbrickPyramidReadLevel: level %d out of range", level));
+  BRICK_LEVEL *lv = &bp->level[level];
+  return (brickReadRegion(bp, level, 0, 0, 0, lv->width, lv->height, lv->depth, 0));
+}
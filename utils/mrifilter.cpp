@@ -54,11 +54,23 @@
 /*#define DEBUG_POINT(x,y,z)  (((x==7&&y==9) || (x==9&&y==7)) &&((z)==15))*/
 #define DEBUG_POINT(x, y, z) (((x == 21) && (y == 14)) && ((z) == 7))
 
+// upper bound on the intermediate volume MRIconvolveGaussian() allocates per batch of frames
+#define CONVOLVE_GAUSSIAN_BATCH_BYTES (256L * 1024L * 1024L)
+
+// how source indices outside the volume along the convolution axis are handled
+#define CONV1D_CLAMP 0    // repeat the edge voxel, like mri->xi/yi/zi
+#define CONV1D_OUTSIDE 1  // use mri->outside_val
+
+// number of rows smoothed together along the columns by MRIgaussianSmoothNI()
+#define GAUSSIAN_SMOOTH_TILE 8
+
 /*-----------------------------------------------------
                     STATIC PROTOTYPES
 -------------------------------------------------------*/
 
 static int compare_sort_array(const void *pc1, const void *pc2);
+static MRI *mriConvolve1dFrames(
+    MRI *mri_src, MRI *mri_dst, const float *k, int len, int axis, int src_frame, int dst_frame, int nframes, int border);
 
 /*-----------------------------------------------------
                     GLOBAL FUNCTIONS
@@ -2558,33 +2570,36 @@ MRI *MRIstdNonzero(MRI *mri_src, MRI *mri_dst, MRI *mri_mean, int wsize)
   return (mri_dst);
 }
 
+/*-----------------------------------------------------
+  convolveGaussianPass() - one separable pass of MRIconvolveGaussian()
+  over nframes frames. Like MRIconvolve1d(), an axis of length 1 is
+  copied rather than convolved.
+------------------------------------------------------*/
+static void convolveGaussianPass(
+    MRI *mri_src, MRI *mri_dst, float *kernel, int klen, int axis, int src_frame, int dst_frame, int nframes)
+{
+  int f;
+
+  if ((axis == MRI_WIDTH && mri_src->width == 1) || (axis == MRI_HEIGHT && mri_src->height == 1) ||
+      (axis == MRI_DEPTH && mri_src->depth == 1)) {
+    for (f = 0; f < nframes; f++) MRIcopyFrame(mri_src, mri_dst, src_frame + f, dst_frame + f);
+    return;
+  }
+  mriConvolve1dFrames(mri_src, mri_dst, kernel, klen, axis, src_frame, dst_frame, nframes, CONV1D_CLAMP);
+}
+
 /*-----------------------------------------------------
 MRIconvolveGaussian() - see also MRIgaussianSmooth();
 ------------------------------------------------------*/
 MRI *MRIconvolveGaussian(MRI *mri_src, MRI *mri_dst, MRI *mri_gaussian)
 {
-  // int width, height, depth;
-  int klen;
-  int frame;
+  int klen, frame, nbatch, nb, f;
   MRI *mtmp1, *mri_tmp;
   float *kernel;
-
-#if 0
-  static unsigned int nCalls = 0;
-  char fname[STRLEN];
-
-  snprintf( fname, STRLEN-1, "mrigauss%05u.mgz", nCalls );
-  fname[STRLEN-1] = '\0';
-  MRIwrite( mri_src, fname );
-
-  nCalls++;
-#endif
+  size_t frame_bytes;
 
   kernel = &MRIFvox(mri_gaussian, 0, 0, 0);
   klen = mri_gaussian->width;
-  // width = mri_src->width;
-  // height = mri_src->height;
-  // depth = mri_src->depth;
 
   if (!mri_dst) {
     mri_dst = MRIclone(mri_src, NULL);
@@ -2602,22 +2617,30 @@ MRI *MRIconvolveGaussian(MRI *mri_src, MRI *mri_dst, MRI *mri_gaussian)
     mri_tmp = NULL;
   }
 
+  // the three passes are run on batches of frames so that 4D volumes are
+  // smoothed with one parallel loop per pass instead of one per frame.
+  // The intermediate volume keeps the source type, as it always has.
+  frame_bytes = (size_t)mri_src->width * mri_src->height * mri_src->depth * MRIsizeof(mri_src->type);
+  nbatch = (int)(CONVOLVE_GAUSSIAN_BATCH_BYTES / MAX(frame_bytes, 1));
+  nbatch = MAX(1, MIN(nbatch, mri_src->nframes));
+  mtmp1 = MRIallocSequence(mri_src->width, mri_src->height, mri_src->depth, mri_src->type, nbatch);
+  MRIcopyHeader(mri_src, mtmp1);
+
   int nstart = global_progress_range[0];
   int nend = global_progress_range[1];
   int nstep = (nstart - nend) / mri_src->nframes;
-  mtmp1 = NULL;
-  for (frame = 0; frame < mri_src->nframes; frame++) {
-    global_progress_range[1] = global_progress_range[0] + nstep / 3;
-    mtmp1 = MRIcopyFrame(mri_src, mtmp1, frame, 0);
-    MRIconvolve1d(mri_src, mtmp1, kernel, klen, MRI_WIDTH, frame, 0);
-    global_progress_range[0] += nstep / 3;
-    global_progress_range[1] += nstep / 3;
-    MRIconvolve1d(mtmp1, mri_dst, kernel, klen, MRI_HEIGHT, 0, frame);
-    global_progress_range[0] += nstep / 3;
-    global_progress_range[1] += nstep / 3;
-    MRIconvolve1d(mri_dst, mtmp1, kernel, klen, MRI_DEPTH, frame, 0);
-
-    MRIcopyFrame(mtmp1, mri_dst, 0, frame); /* convert it back to UCHAR */
+  for (frame = 0; frame < mri_src->nframes; frame += nbatch) {
+    nb = MIN(nbatch, mri_src->nframes - frame);
+    global_progress_range[1] = global_progress_range[0] + nb * nstep / 3;
+    convolveGaussianPass(mri_src, mtmp1, kernel, klen, MRI_WIDTH, frame, 0, nb);
+    global_progress_range[0] += nb * nstep / 3;
+    global_progress_range[1] += nb * nstep / 3;
+    convolveGaussianPass(mtmp1, mri_dst, kernel, klen, MRI_HEIGHT, 0, frame, nb);
+    global_progress_range[0] += nb * nstep / 3;
+    global_progress_range[1] += nb * nstep / 3;
+    convolveGaussianPass(mri_dst, mtmp1, kernel, klen, MRI_DEPTH, frame, 0, nb);
+
+    for (f = 0; f < nb; f++) MRIcopyFrame(mtmp1, mri_dst, f, frame + f); /* convert it back to UCHAR */
     global_progress_range[0] = global_progress_range[1];
   }
 
@@ -2996,317 +3019,181 @@ MRI *MRIreduceByte(MRI *mri_src, MRI *mri_dst)
 }
 
 /*-----------------------------------------------------
-        Parameters:
-
-        Returns value:
-
-        Description
-
+  Separable convolution engine behind MRIconvolve1d() and its typed
+  variants. Every output voxel is accumulated over the kernel taps in
+  the same order as a plain per-voxel loop (total = 0, then
+  total += k[i] * src for i = 0..len-1), so the result does not depend
+  on the number of threads. The inner loops all run along x, which is
+  contiguous in memory: for MRI_WIDTH each row is first copied into a
+  padded buffer so that every tap is a shifted load, for MRI_HEIGHT and
+  MRI_DEPTH every tap adds a whole source row. The parallel loop is over
+  (slice, frame) pairs so that all frames of a 4D volume go in one pass.
 ------------------------------------------------------*/
-MRI *MRIconvolve1d(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
-{
-  int width, height, depth;
-  int x = 0, y = 0, z = 0, halflen, *xi, *yi, *zi;
-  int i = 0;
-  BUFTYPE *inBase = NULL;
-  float *ki = NULL, total = 0, *inBase_f = NULL, *foutPix = NULL, val = 0;
 
-  width = mri_src->width;
-  height = mri_src->height;
-  depth = mri_src->depth;
-
-  // if dimension in convolve direction is 1, skip convolving:
-  if ((axis == MRI_WIDTH && width == 1) || (axis == MRI_HEIGHT && height == 1) || (axis == MRI_DEPTH && depth == 1)) {
-    mri_dst = MRIcopy(mri_src, mri_dst);
-    return mri_dst;
+/* tbl[x+i] is the source index used by tap i of output x, or -1 for outside_val */
+static int *conv1dIndexTable(int n, int len, int border)
+{
+  int i, p, halflen = len / 2;
+  int *tbl;
+
+  tbl = (int *)calloc(n + len, sizeof(int));
+  if (!tbl) ErrorExit(ERROR_NOMEMORY, "conv1dIndexTable: could not allocate %d indices", n + len);
+  for (i = 0; i < n + len; i++) {
+    p = i - halflen;
+    if (p < 0)
+      tbl[i] = (border == CONV1D_CLAMP) ? 0 : -1;
+    else if (p >= n)
+      tbl[i] = (border == CONV1D_CLAMP) ? n - 1 : -1;
+    else
+      tbl[i] = p;
   }
+  return (tbl);
+}
 
-  if (!mri_dst) {
-    mri_dst = MRIalloc(width, height, depth, MRI_FLOAT);
-  }
+/* returns row (y,z,f) of mri as floats, converting into scratch if mri is not float */
+static const float *conv1dSrcRow(MRI *mri, int y, int z, int f, float *scratch)
+{
+  int x, width = mri->width;
 
-  if (mri_dst->type == MRI_UCHAR) {
-    return (MRIconvolve1dByte(mri_src, mri_dst, k, len, axis, src_frame, dst_frame));
-  }
-  else if (mri_dst->type == MRI_SHORT) {
-    return (MRIconvolve1dShort(mri_src, mri_dst, k, len, axis, src_frame, dst_frame));
-  }
-  else if (mri_dst->type == MRI_INT) {
-    return (MRIconvolve1dInt(mri_src, mri_dst, k, len, axis, src_frame, dst_frame));
+  switch (mri->type) {
+    case MRI_FLOAT:
+      return (&MRIFseq_vox(mri, 0, y, z, f));
+    case MRI_UCHAR: {
+      BUFTYPE *p = &MRIseq_vox(mri, 0, y, z, f);
+      for (x = 0; x < width; x++) scratch[x] = (float)p[x];
+      break;
+    }
+    case MRI_SHORT: {
+      short *p = &MRISseq_vox(mri, 0, y, z, f);
+      for (x = 0; x < width; x++) scratch[x] = (float)p[x];
+      break;
+    }
+    case MRI_INT: {
+      int *p = &MRIIseq_vox(mri, 0, y, z, f);
+      for (x = 0; x < width; x++) scratch[x] = (float)p[x];
+      break;
+    }
+    default:
+      for (x = 0; x < width; x++) scratch[x] = MRIgetVoxVal(mri, x, y, z, f);
+      break;
   }
+  return (scratch);
+}
 
-  if (mri_dst->type != MRI_FLOAT)
-    ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1d: unsupported dst pixel format %d", mri_dst->type));
-
-  halflen = len / 2;
-
-  xi = mri_src->xi;
-  yi = mri_src->yi;
-  zi = mri_src->zi;
-
-  switch (mri_src->type) {
-    case MRI_UCHAR:
-      switch (axis) {
-        case MRI_WIDTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(experimental) firstprivate(y, x, inBase, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_src, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              inBase = &MRIseq_vox(mri_src, 0, y, z, src_frame);
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  total += *ki++ * (float)(*(inBase + xi[x + i - halflen]));
-                }
-
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-	  
-          break;
-        case MRI_HEIGHT:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(experimental) firstprivate(y, x, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                if (x == Gx && y == Gy && z == Gz) {
-                  DiagBreak();
-                }
-                total = 0.0f;
+/* stores a row of float results into (y,z,f) of mri, rounding for integer types */
+static void conv1dDstRow(MRI *mri, int y, int z, int f, const float *row)
+{
+  int x, width = mri->width;
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * (float)(MRIseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame));
+  switch (mri->type) {
+    case MRI_FLOAT:
+      memmove(&MRIFseq_vox(mri, 0, y, z, f), row, width * sizeof(float));
+      break;
+    case MRI_UCHAR: {
+      BUFTYPE *p = &MRIseq_vox(mri, 0, y, z, f);
+      for (x = 0; x < width; x++) p[x] = (BUFTYPE)nint(row[x]);
+      break;
+    }
+    case MRI_SHORT: {
+      short *p = &MRISseq_vox(mri, 0, y, z, f);
+      for (x = 0; x < width; x++) p[x] = (short)nint(row[x]);
+      break;
+    }
+    case MRI_INT: {
+      int *p = &MRIIseq_vox(mri, 0, y, z, f);
+      for (x = 0; x < width; x++) p[x] = (int)nint(row[x]);
+      break;
+    }
+    default:
+      for (x = 0; x < width; x++) MRIsetVoxVal(mri, x, y, z, f, row[x]);
+      break;
+  }
+}
 
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-        case MRI_DEPTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(experimental) firstprivate(y, x, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
+/* convolves nframes frames of mri_src starting at src_frame into mri_dst starting at dst_frame */
+static MRI *mriConvolve1dFrames(
+    MRI *mri_src, MRI *mri_dst, const float *k, int len, int axis, int src_frame, int dst_frame, int nframes, int border)
+{
+  int width, height, depth, n, nunits, unit, *tbl;
+  float outside;
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * (float)(MRIseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame));
+  width = mri_src->width;
+  height = mri_src->height;
+  depth = mri_src->depth;
+  outside = mri_src->outside_val;
 
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-      }
+  switch (axis) {
+    case MRI_WIDTH:
+      n = width;
       break;
-    case MRI_FLOAT:
-      switch (axis) {
-        case MRI_WIDTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(y, x, inBase_f, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              inBase_f = &MRIFseq_vox(mri_src, 0, y, z, src_frame);
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                if (Gx == x && Gy == y && Gz == z) {
-                  DiagBreak();
-                }
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  total += *ki++ * (*(inBase_f + xi[x + i - halflen]));
-                }
+    case MRI_HEIGHT:
+      n = height;
+      break;
+    case MRI_DEPTH:
+      n = depth;
+      break;
+    default:
+      ErrorReturn(NULL, (ERROR_BADPARM, "MRIconvolve1d: unknown axis %d", axis));
+  }
+  tbl = conv1dIndexTable(n, len, border);
 
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-        case MRI_HEIGHT:
-          ROMP_PF_begin
+  nunits = depth * nframes;
+  ROMP_PF_begin
 #ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(y, x, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(static, 1)
 #endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                if (x == Gx && y == Gy && z == Gz) {
-                  DiagBreak();
-                }
-
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * MRIFseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame);
+  for (unit = 0; unit < nunits; unit++) {
+    ROMP_PFLB_begin
+    int x, y, i, z = unit % depth, f = unit / depth;
+    float ki, *acc, *scratch, *pad = NULL;
+    const float *row;
 
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-        case MRI_DEPTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(assume_reproducible) firstprivate(y, x, foutPix, ki, i, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
+    acc = (float *)calloc(width, sizeof(float));
+    scratch = (float *)calloc(width, sizeof(float));
+    if (axis == MRI_WIDTH) pad = (float *)calloc(width + len, sizeof(float));
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * MRIFseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame);
+    for (y = 0; y < height; y++) {
+      for (x = 0; x < width; x++) acc[x] = 0.0f;
 
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
-      }
-      break;
-    default:
       switch (axis) {
         case MRI_WIDTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(experimental) firstprivate(y, x, foutPix, ki, i, val, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  val = MRIgetVoxVal(mri_src, x + i - halflen, y, z, src_frame);
-                  total += *ki++ * val;
-                }
-
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    
-	    ROMP_PFLB_end
+          row = conv1dSrcRow(mri_src, y, z, src_frame + f, scratch);
+          for (x = 0; x < width + len - 1; x++) pad[x] = tbl[x] < 0 ? outside : row[tbl[x]];
+          for (i = 0; i < len; i++) {
+            const float *p = pad + i;
+            ki = k[i];
+            for (x = 0; x < width; x++) acc[x] += ki * p[x];
           }
-	  ROMP_PF_end
           break;
         case MRI_HEIGHT:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(experimental) firstprivate(y, x, foutPix, ki, i, val, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                if (x == Gx && y == Gy && z == Gz) {
-                  DiagBreak();
-                }
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  val = MRIgetVoxVal(mri_src, x, y + i - halflen, z, src_frame);
-                  total += *ki++ * val;
-                }
-                *foutPix++ = total;
-              }
-            }
-            exec_progress_callback(z, depth, 0, 1);
-	    
-	    ROMP_PFLB_end
-          }
-	  ROMP_PF_end
-          break;
         case MRI_DEPTH:
-          ROMP_PF_begin
-#ifdef HAVE_OPENMP
-	  #pragma omp parallel for if_ROMP(experimental) firstprivate(y, x, foutPix, ki, i, val, total) \
-    shared(depth, height, width, len, halflen, mri_dst, src_frame, dst_frame, xi, yi, zi) schedule(static, 1)
-#endif
-          for (z = 0; z < depth; z++) {
-	    ROMP_PFLB_begin
-	    
-            for (y = 0; y < height; y++) {
-              foutPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  val = MRIgetVoxVal(mri_src, x, y, z + i - halflen, src_frame);
-                  total += *ki++ * val;
-                }
-                *foutPix++ = total;
-              }
+          for (i = 0; i < len; i++) {
+            int si = (axis == MRI_HEIGHT) ? tbl[y + i] : tbl[z + i];
+            ki = k[i];
+            if (si < 0) {
+              for (x = 0; x < width; x++) acc[x] += ki * outside;
+              continue;
             }
-            exec_progress_callback(z, depth, 0, 1);
-	    ROMP_PFLB_end
+            if (axis == MRI_HEIGHT)
+              row = conv1dSrcRow(mri_src, si, z, src_frame + f, scratch);
+            else
+              row = conv1dSrcRow(mri_src, y, si, src_frame + f, scratch);
+            for (x = 0; x < width; x++) acc[x] += ki * row[x];
           }
-	  ROMP_PF_end
           break;
       }
-      break;
+      conv1dDstRow(mri_dst, y, z, dst_frame + f, acc);
+    }
+    exec_progress_callback(z, depth, f, nframes);
+
+    free(acc);
+    free(scratch);
+    if (pad) free(pad);
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
+  free(tbl);
   return (mri_dst);
 }
 
@@ -3316,141 +3203,72 @@ MRI *MRIconvolve1d(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int
         Returns value:
 
         Description
-
+          Convolves frame src_frame of mri_src with the kernel k
+          along axis and stores the result in frame dst_frame of
+          mri_dst. Integer destinations are rounded to the nearest
+          integer.
 ------------------------------------------------------*/
-MRI *MRIconvolve1dByte(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
+MRI *MRIconvolve1d(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
 {
-  int x, y, z, width, height, halflen, depth, *xi, *yi, *zi;
-  int i;
-  BUFTYPE *inBase;
-  BUFTYPE *inBase_f, *outPix;
-  float *ki, total;
+  int width, height, depth, border;
 
   width = mri_src->width;
   height = mri_src->height;
   depth = mri_src->depth;
 
-  if (!mri_dst) {
-    mri_dst = MRIalloc(width, height, depth, MRI_UCHAR);
+  // if dimension in convolve direction is 1, skip convolving:
+  if ((axis == MRI_WIDTH && width == 1) || (axis == MRI_HEIGHT && height == 1) || (axis == MRI_DEPTH && depth == 1)) {
+    mri_dst = MRIcopy(mri_src, mri_dst);
+    return mri_dst;
   }
 
-  if (mri_dst->type != MRI_UCHAR)
-    ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1dByte: unsupported dst pixel format %d", mri_dst->type));
-
-  halflen = len / 2;
-
-  xi = mri_src->xi;
-  yi = mri_src->yi;
-  zi = mri_src->zi;
-
-  switch (mri_src->type) {
-    case MRI_UCHAR:
-      switch (axis) {
-        case MRI_WIDTH:
-          for (z = 0; z < depth; z++) {
-            for (y = 0; y < height; y++) {
-              inBase = &MRIseq_vox(mri_src, 0, y, z, src_frame);
-              outPix = &MRIseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  total += *ki++ * (float)(*(inBase + xi[x + i - halflen]));
-                }
+  if (!mri_dst) {
+    mri_dst = MRIalloc(width, height, depth, MRI_FLOAT);
+  }
 
-                *outPix++ = (BUFTYPE)nint(total);
-              }
-            }
-          }
-          break;
-        case MRI_HEIGHT:
-          for (z = 0; z < depth; z++) {
-            for (y = 0; y < height; y++) {
-              outPix = &MRIseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
+  if (mri_dst->type == MRI_UCHAR) {
+    return (MRIconvolve1dByte(mri_src, mri_dst, k, len, axis, src_frame, dst_frame));
+  }
+  else if (mri_dst->type == MRI_SHORT) {
+    return (MRIconvolve1dShort(mri_src, mri_dst, k, len, axis, src_frame, dst_frame));
+  }
+  else if (mri_dst->type == MRI_INT) {
+    return (MRIconvolve1dInt(mri_src, mri_dst, k, len, axis, src_frame, dst_frame));
+  }
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * (float)(MRIseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame));
+  if (mri_dst->type != MRI_FLOAT)
+    ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1d: unsupported dst pixel format %d", mri_dst->type));
 
-                *outPix++ = (BUFTYPE)nint(total);
-              }
-            }
-          }
-          break;
-        case MRI_DEPTH:
-          for (z = 0; z < depth; z++) {
-            for (y = 0; y < height; y++) {
-              outPix = &MRIseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
+  // uchar and float sources repeat the edge voxel, other types see outside_val
+  if (mri_src->type == MRI_UCHAR || mri_src->type == MRI_FLOAT)
+    border = CONV1D_CLAMP;
+  else
+    border = CONV1D_OUTSIDE;
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * (float)(MRIseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame));
+  return (mriConvolve1dFrames(mri_src, mri_dst, k, len, axis, src_frame, dst_frame, 1, border));
+}
 
-                *outPix++ = (BUFTYPE)nint(total);
-              }
-            }
-          }
-          break;
-      }
-      break;
-    case MRI_FLOAT:
-      switch (axis) {
-        case MRI_WIDTH:
-          for (z = 0; z < depth; z++) {
-            for (y = 0; y < height; y++) {
-              inBase_f = &MRIseq_vox(mri_src, 0, y, z, src_frame);
-              outPix = &MRIseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
-
-                for (ki = k, i = 0; i < len; i++) {
-                  total += *ki++ * (*(inBase_f + xi[x + i - halflen]));
-                }
+/*-----------------------------------------------------
+        Parameters:
 
-                *outPix++ = (BUFTYPE)nint(total);
-              }
-            }
-          }
-          break;
-        case MRI_HEIGHT:
-          for (z = 0; z < depth; z++) {
-            for (y = 0; y < height; y++) {
-              outPix = &MRIseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
+        Returns value:
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * MRIseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame);
+        Description
 
-                *outPix++ = (BUFTYPE)nint(total);
-              }
-            }
-          }
-          break;
-        case MRI_DEPTH:
-          for (z = 0; z < depth; z++) {
-            for (y = 0; y < height; y++) {
-              outPix = &MRIseq_vox(mri_dst, 0, y, z, dst_frame);
-              for (x = 0; x < width; x++) {
-                total = 0.0f;
+------------------------------------------------------*/
+MRI *MRIconvolve1dByte(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
+{
+  if (!mri_dst) {
+    mri_dst = MRIalloc(mri_src->width, mri_src->height, mri_src->depth, MRI_UCHAR);
+  }
 
-                for (ki = k, i = 0; i < len; i++)
-                  total += *ki++ * MRIseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame);
+  if (mri_dst->type != MRI_UCHAR)
+    ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1dByte: unsupported dst pixel format %d", mri_dst->type));
 
-                *outPix++ = (BUFTYPE)nint(total);
-              }
-            }
-          }
-          break;
-      }
-      break;
-    default:
-      ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1d: unsupported pixel format %d", mri_src->type));
-  }
+  if (mri_src->type != MRI_UCHAR && mri_src->type != MRI_FLOAT)
+    ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1d: unsupported pixel format %d", mri_src->type));
 
-  return (mri_dst);
+  return (mriConvolve1dFrames(mri_src, mri_dst, k, len, axis, src_frame, dst_frame, 1, CONV1D_CLAMP));
 }
 
 /*-----------------------------------------------------
@@ -3463,80 +3281,14 @@ MRI *MRIconvolve1dByte(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis,
 ------------------------------------------------------*/
 MRI *MRIconvolve1dShort(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
 {
-  int x, y, z, width, height, halflen, depth, *xi, *yi, *zi;
-  int i;
-  short *inBase;
-  short *outPix;
-  float *ki, total;
-
-  width = mri_src->width;
-  height = mri_src->height;
-  depth = mri_src->depth;
-
   if (!mri_dst) {
-    mri_dst = MRIalloc(width, height, depth, MRI_SHORT);
+    mri_dst = MRIalloc(mri_src->width, mri_src->height, mri_src->depth, MRI_SHORT);
   }
 
   if (mri_dst->type != MRI_SHORT)
     ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1dShort: unsupported dst pixel format %d", mri_dst->type));
 
-  halflen = len / 2;
-
-  xi = mri_src->xi;
-  yi = mri_src->yi;
-  zi = mri_src->zi;
-
-  switch (axis) {
-    case MRI_WIDTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          inBase = &MRISseq_vox(mri_src, 0, y, z, src_frame);
-          outPix = &MRISseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++) {
-              total += *ki++ * (float)(*(inBase + xi[x + i - halflen]));
-            }
-
-            *outPix++ = (short)nint(total);
-          }
-        }
-      }
-      break;
-    case MRI_HEIGHT:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRISseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRISseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame));
-
-            *outPix++ = (short)nint(total);
-          }
-        }
-      }
-      break;
-    case MRI_DEPTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRISseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRISseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame));
-
-            *outPix++ = (short)nint(total);
-          }
-        }
-      }
-      break;
-  }
-
-  return (mri_dst);
+  return (mriConvolve1dFrames(mri_src, mri_dst, k, len, axis, src_frame, dst_frame, 1, CONV1D_CLAMP));
 }
 
 /*-----------------------------------------------------
@@ -3549,80 +3301,14 @@ MRI *MRIconvolve1dShort(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis,
 ------------------------------------------------------*/
 MRI *MRIconvolve1dInt(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
 {
-  int x, y, z, width, height, halflen, depth, *xi, *yi, *zi;
-  int i;
-  int *inBase;
-  int *outPix;
-  float *ki, total;
-
-  width = mri_src->width;
-  height = mri_src->height;
-  depth = mri_src->depth;
-
   if (!mri_dst) {
-    mri_dst = MRIalloc(width, height, depth, MRI_INT);
+    mri_dst = MRIalloc(mri_src->width, mri_src->height, mri_src->depth, MRI_INT);
   }
 
   if (mri_dst->type != MRI_INT)
     ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1dInt: unsupported dst pixel format %d", mri_dst->type));
 
-  halflen = len / 2;
-
-  xi = mri_src->xi;
-  yi = mri_src->yi;
-  zi = mri_src->zi;
-
-  switch (axis) {
-    case MRI_WIDTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          inBase = &MRIIseq_vox(mri_src, 0, y, z, src_frame);
-          outPix = &MRIIseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++) {
-              total += *ki++ * (float)(*(inBase + xi[x + i - halflen]));
-            }
-
-            *outPix++ = (int)nint(total);
-          }
-        }
-      }
-      break;
-    case MRI_HEIGHT:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRIIseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRIIseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame));
-
-            *outPix++ = (int)nint(total);
-          }
-        }
-      }
-      break;
-    case MRI_DEPTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRIIseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRIIseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame));
-
-            *outPix++ = (int)nint(total);
-          }
-        }
-      }
-      break;
-  }
-
-  return (mri_dst);
+  return (mriConvolve1dFrames(mri_src, mri_dst, k, len, axis, src_frame, dst_frame, 1, CONV1D_CLAMP));
 }
 
 /*-----------------------------------------------------
@@ -3635,80 +3321,14 @@ MRI *MRIconvolve1dInt(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, i
 ------------------------------------------------------*/
 MRI *MRIconvolve1dFloat(MRI *mri_src, MRI *mri_dst, float *k, int len, int axis, int src_frame, int dst_frame)
 {
-  int x, y, z, width, height, halflen, depth, *xi, *yi, *zi;
-  int i;
-  float *inBase;
-  float *outPix;
-  float *ki, total;
-
-  width = mri_src->width;
-  height = mri_src->height;
-  depth = mri_src->depth;
-
   if (!mri_dst) {
-    mri_dst = MRIalloc(width, height, depth, MRI_FLOAT);
+    mri_dst = MRIalloc(mri_src->width, mri_src->height, mri_src->depth, MRI_FLOAT);
   }
 
   if (mri_dst->type != MRI_FLOAT)
     ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIconvolve1dFloat: unsupported dst pixel format %d", mri_dst->type));
 
-  halflen = len / 2;
-
-  xi = mri_src->xi;
-  yi = mri_src->yi;
-  zi = mri_src->zi;
-
-  switch (axis) {
-    case MRI_WIDTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          inBase = &MRIFseq_vox(mri_src, 0, y, z, src_frame);
-          outPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++) {
-              total += *ki++ * (float)(*(inBase + xi[x + i - halflen]));
-            }
-
-            *outPix++ = total;
-          }
-        }
-      }
-      break;
-    case MRI_HEIGHT:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRIFseq_vox(mri_src, x, yi[y + i - halflen], z, src_frame));
-
-            *outPix++ = total;
-          }
-        }
-      }
-      break;
-    case MRI_DEPTH:
-      for (z = 0; z < depth; z++) {
-        for (y = 0; y < height; y++) {
-          outPix = &MRIFseq_vox(mri_dst, 0, y, z, dst_frame);
-          for (x = 0; x < width; x++) {
-            total = 0.0f;
-
-            for (ki = k, i = 0; i < len; i++)
-              total += *ki++ * (float)(MRIFseq_vox(mri_src, x, y, zi[z + i - halflen], src_frame));
-
-            *outPix++ = total;
-          }
-        }
-      }
-      break;
-  }
-
-  return (mri_dst);
+  return (mriConvolve1dFrames(mri_src, mri_dst, k, len, axis, src_frame, dst_frame, 1, CONV1D_CLAMP));
 }
 
 /*-----------------------------------------------------
@@ -6506,6 +6126,65 @@ MRI *MRI_fft_highpass(MRI *src, MRI *dst, int percent)
   MRIfree(&src_fft);
   return (dst);
 }
+/*---------------------------------------------------------------------
+  gaussianMatrixBand() - first and last non-zero column of each row of
+  the dense kernel matrix built by GaussianMatrix(). Far from the
+  diagonal the kernel underflows to exactly 0, and adding those +/-0
+  products to a float sum that starts at +0 cannot change it, so
+  skipping them gives the same result as MatrixMultiply() on finite
+  data.
+  -------------------------------------------------------------------*/
+static void gaussianMatrixBand(MATRIX *G, int *lo, int *hi)
+{
+  int r, c;
+
+  for (r = 0; r < G->rows; r++) {
+    lo[r] = G->cols;
+    hi[r] = -1;
+    for (c = 0; c < G->cols; c++) {
+      if (G->rptr[r + 1][c + 1] != 0.0f) {
+        if (c < lo[r]) lo[r] = c;
+        hi[r] = c;
+      }
+    }
+  }
+}
+
+/*---------------------------------------------------------------------
+  gaussianSmoothLanes() - applies the kernel matrix G to nlanes
+  interleaved lines at once: out[r*nlanes+j] = sum_c G[r][c] *
+  in[c*nlanes+j]. Each sum is accumulated in float in increasing c,
+  exactly as MatrixMultiply() does for a single line, while the inner
+  loop runs over the lanes.
+  -------------------------------------------------------------------*/
+static void gaussianSmoothLanes(MATRIX *G, const int *lo, const int *hi, const float *in, float *out, int nlanes)
+{
+  int r, c, j;
+  float g, *o;
+  const float *p;
+
+  for (r = 0; r < G->rows; r++) {
+    o = out + (size_t)r * nlanes;
+    for (j = 0; j < nlanes; j++) o[j] = 0.0f;
+    for (c = lo[r]; c <= hi[r]; c++) {
+      g = G->rptr[r + 1][c + 1];
+      p = in + (size_t)c * nlanes;
+      for (j = 0; j < nlanes; j++) o[j] += g * p[j];
+    }
+  }
+}
+
+/* copies a row of floats into (r,s,f) of mri with MRIsetVoxVal() semantics */
+static void gaussianSmoothSetRow(MRI *mri, int r, int s, int f, const float *row)
+{
+  int c;
+
+  if (mri->type == MRI_FLOAT)
+    memmove(&MRIFseq_vox(mri, 0, r, s, f), row, mri->width * sizeof(float));
+  else
+    for (c = 0; c < mri->width; c++) MRIsetVoxVal(mri, c, r, s, f, row[c]);
+}
+
 /*---------------------------------------------------------------------
   MRIgaussianSmoothNI() - performs non-isotropic gaussian spatial
   smoothing.  The standard deviation of the gaussian is std.  The mean
@@ -6555,33 +6234,46 @@ MRI *MRIgaussianSmoothNI(MRI *src, double cstd, double rstd, double sstd, MRI *t
 
   /* -----------------Smooth the columns -----------------------------*/
   if (cstd > 0) {
+    int *lo, *hi, nunits, unit;
     G = GaussianMatrix(src->width, cstd / src->xsize, 1, NULL);
+    lo = (int *)calloc(src->width, sizeof(int));
+    hi = (int *)calloc(src->width, sizeof(int));
+    gaussianMatrixBand(G, lo, hi);
+    // each (slice,frame) is done in tiles of rows that are transposed so
+    // that the lanes of the inner loop are neighboring rows
+    nunits = src->depth * src->nframes;
     ROMP_PF_begin
 #ifdef HAVE_OPENMP
-    #pragma omp parallel for if_ROMP(experimental)
+    #pragma omp parallel for if_ROMP(shown_reproducible)
 #endif
-    for (r = 0; r < src->height; r++) {
+    for (unit = 0; unit < nunits; unit++) {
       ROMP_PFLB_begin
-      int s, f, c;
-      MATRIX *v = MatrixAlloc(src->width, 1, MATRIX_REAL);
-      MATRIX *vg = MatrixAlloc(src->width, 1, MATRIX_REAL);
-      if (Gdiag_no > 0 && DIAG_VERBOSE_ON) {
-        printf("%d ", r);
-        if (r % 10 == 9) printf("\n");
-      }
-      for (s = 0; s < src->depth; s++) {
-        for (f = 0; f < src->nframes; f++) {
-          for (c = 0; c < src->width; c++) v->rptr[c + 1][1] = MRIgetVoxVal(targ, c, r, s, f);
-          MatrixMultiply(G, v, vg);
-          for (c = 0; c < src->width; c++) MRIsetVoxVal(targ, c, r, s, f, vg->rptr[c + 1][1]);
+      int s = unit % src->depth, f = unit / src->depth, r0, nt, r, c, j;
+      const float *row;
+      float *in = (float *)calloc((size_t)src->width * GAUSSIAN_SMOOTH_TILE, sizeof(float));
+      float *out = (float *)calloc((size_t)src->width * GAUSSIAN_SMOOTH_TILE, sizeof(float));
+      float *line = (float *)calloc(src->width, sizeof(float));
+      for (r0 = 0; r0 < src->height; r0 += GAUSSIAN_SMOOTH_TILE) {
+        nt = MIN(GAUSSIAN_SMOOTH_TILE, src->height - r0);
+        for (j = 0; j < nt; j++) {
+          row = conv1dSrcRow(targ, r0 + j, s, f, line);
+          for (c = 0; c < src->width; c++) in[c * GAUSSIAN_SMOOTH_TILE + j] = row[c];
+        }
+        gaussianSmoothLanes(G, lo, hi, in, out, GAUSSIAN_SMOOTH_TILE);
+        for (j = 0; j < nt; j++) {
+          r = r0 + j;
+          for (c = 0; c < src->width; c++) line[c] = out[c * GAUSSIAN_SMOOTH_TILE + j];
+          gaussianSmoothSetRow(targ, r, s, f, line);
         }
       }
-      MatrixFree(&v);
-      MatrixFree(&vg);
+      free(in);
+      free(out);
+      free(line);
       ROMP_PFLB_end
     }
     ROMP_PF_end
-    if (Gdiag_no > 0 && DIAG_VERBOSE_ON) printf("\n");
+    free(lo);
+    free(hi);
     // This is for scaling
     vc = MatrixAlloc(src->width, 1, MATRIX_REAL);
     if (src->width > 1)
@@ -6593,37 +6285,34 @@ MRI *MRIgaussianSmoothNI(MRI *src, double cstd, double rstd, double sstd, MRI *t
 
   /* -----------------Smooth the rows -----------------------------*/
   if (rstd > 0) {
+    int *lo, *hi, nunits, unit;
     if (Gdiag_no > 0 && DIAG_VERBOSE_ON) printf("Smoothing rows\n");
     G = GaussianMatrix(src->height, (double)rstd / src->ysize, 1, NULL);
+    lo = (int *)calloc(src->height, sizeof(int));
+    hi = (int *)calloc(src->height, sizeof(int));
+    gaussianMatrixBand(G, lo, hi);
+    // a whole (slice,frame) at a time, the lanes are the columns
+    nunits = src->depth * src->nframes;
     ROMP_PF_begin
 #ifdef HAVE_OPENMP
-    #pragma omp parallel for if_ROMP(experimental)
+    #pragma omp parallel for if_ROMP(shown_reproducible)
 #endif
-    for (c = 0; c < src->width; c++) {
+    for (unit = 0; unit < nunits; unit++) {
       ROMP_PFLB_begin
-      
-      int s, f, r;
-      MATRIX *v = MatrixAlloc(src->height, 1, MATRIX_REAL);
-      MATRIX *vg = MatrixAlloc(src->height, 1, MATRIX_REAL);
-      if (Gdiag_no > 0) {
-        printf("%d ", c);
-        if (c % 10 == 9) printf("\n");
-      }
-      for (s = 0; s < src->depth; s++) {
-        for (f = 0; f < src->nframes; f++) {
-          for (r = 0; r < src->height; r++) v->rptr[r + 1][1] = MRIgetVoxVal(targ, c, r, s, f);
-          MatrixMultiply(G, v, vg);
-          for (r = 0; r < src->height; r++) MRIsetVoxVal(targ, c, r, s, f, vg->rptr[r + 1][1]);
-        }
-      }
-      MatrixFree(&v);
-      MatrixFree(&vg);
-      
+      int s = unit % src->depth, f = unit / src->depth, r;
+      size_t w = src->width;
+      float *in = (float *)calloc(w * src->height, sizeof(float));
+      float *out = (float *)calloc(w * src->height, sizeof(float));
+      for (r = 0; r < src->height; r++) memmove(in + r * w, conv1dSrcRow(targ, r, s, f, in + r * w), w * sizeof(float));
+      gaussianSmoothLanes(G, lo, hi, in, out, src->width);
+      for (r = 0; r < src->height; r++) gaussianSmoothSetRow(targ, r, s, f, out + r * w);
+      free(in);
+      free(out);
       ROMP_PFLB_end
     }
     ROMP_PF_end
-    
-    if (Gdiag_no > 0) printf("\n");
+    free(lo);
+    free(hi);
 
     // This is for scaling
     vr = MatrixAlloc(src->height, 1, MATRIX_REAL);
@@ -6636,37 +6325,35 @@ MRI *MRIgaussianSmoothNI(MRI *src, double cstd, double rstd, double sstd, MRI *t
 
   /* Smooth the slices */
   if (sstd > 0) {
+    int *lo, *hi, nunits, unit;
     // printf("Smoothing slices by std=%g\n",sstd);
     G = GaussianMatrix(src->depth, sstd / src->zsize, 1, NULL);
+    lo = (int *)calloc(src->depth, sizeof(int));
+    hi = (int *)calloc(src->depth, sizeof(int));
+    gaussianMatrixBand(G, lo, hi);
+    // a whole (row,frame) plane at a time, the lanes are the columns
+    nunits = src->height * src->nframes;
     ROMP_PF_begin
 #ifdef HAVE_OPENMP
-    #pragma omp parallel for if_ROMP(experimental)
+    #pragma omp parallel for if_ROMP(shown_reproducible)
 #endif
-    for (c = 0; c < src->width; c++) {
+    for (unit = 0; unit < nunits; unit++) {
       ROMP_PFLB_begin
-      
-      int r, f, s;
-      MATRIX *v = MatrixAlloc(src->depth, 1, MATRIX_REAL);
-      MATRIX *vg = MatrixAlloc(src->depth, 1, MATRIX_REAL);
-      if (Gdiag_no > 0) {
-        printf("%d ", c);
-        if (c % 10 == 9) printf("\n");
-      }
-      for (r = 0; r < src->height; r++) {
-        for (f = 0; f < src->nframes; f++) {
-          for (s = 0; s < src->depth; s++) v->rptr[s + 1][1] = MRIgetVoxVal(targ, c, r, s, f);
-          MatrixMultiply(G, v, vg);
-          for (s = 0; s < src->depth; s++) MRIsetVoxVal(targ, c, r, s, f, vg->rptr[s + 1][1]);
-        }
-      }
-      MatrixFree(&v);
-      MatrixFree(&vg);
-      
+      int r = unit % src->height, f = unit / src->height, s;
+      size_t w = src->width;
+      float *in = (float *)calloc(w * src->depth, sizeof(float));
+      float *out = (float *)calloc(w * src->depth, sizeof(float));
+      for (s = 0; s < src->depth; s++) memmove(in + s * w, conv1dSrcRow(targ, r, s, f, in + s * w), w * sizeof(float));
+      gaussianSmoothLanes(G, lo, hi, in, out, src->width);
+      for (s = 0; s < src->depth; s++) gaussianSmoothSetRow(targ, r, s, f, out + s * w);
+      free(in);
+      free(out);
       ROMP_PFLB_end
     }
     ROMP_PF_end
-    
-    if (Gdiag_no > 0) printf("\n");
+    free(lo);
+    free(hi);
+
     // This is for scaling
     vs = MatrixAlloc(src->depth, 1, MATRIX_REAL);
     if (src->depth > 1)
@@ -6722,25 +6409,32 @@ MRI *MRIgaussianSmoothNI(MRI *src, double cstd, double rstd, double sstd, MRI *t
 
 // Divide by the sum of the kernel so that a smoothed delta function
 // will sum to one and so that a constant input yields const output.
-  ROMP_PF_begin
+  {
+    int nunits = src->depth * src->nframes, unit;
+    ROMP_PF_begin
 #ifdef HAVE_OPENMP
-  #pragma omp parallel for if_ROMP(experimental)
+    #pragma omp parallel for if_ROMP(shown_reproducible)
 #endif
-  for (c = 0; c < src->width; c++) {
-    ROMP_PFLB_begin
-    int r, s, f;
-    double val;
-    for (r = 0; r < src->height; r++) {
-      for (s = 0; s < src->depth; s++) {
-        for (f = 0; f < src->nframes; f++) {
-          val = MRIgetVoxVal(targ, c, r, s, f);
-          MRIsetVoxVal(targ, c, r, s, f, val / scale);
+    for (unit = 0; unit < nunits; unit++) {
+      ROMP_PFLB_begin
+      int s = unit % src->depth, f = unit / src->depth, r, c;
+      double val;
+      for (r = 0; r < src->height; r++) {
+        if (targ->type == MRI_FLOAT) {
+          float *p = &MRIFseq_vox(targ, 0, r, s, f);
+          for (c = 0; c < src->width; c++) p[c] = (double)p[c] / scale;
+        }
+        else {
+          for (c = 0; c < src->width; c++) {
+            val = MRIgetVoxVal(targ, c, r, s, f);
+            MRIsetVoxVal(targ, c, r, s, f, val / scale);
+          }
         }
       }
+      ROMP_PFLB_end
     }
-    ROMP_PFLB_end
+    ROMP_PF_end
   }
-  ROMP_PF_end
 
   if (vc) MatrixFree(&vc);
   if (vr) MatrixFree(&vr);
@@ -20,6 +20,8 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <vector>
 #include "cma.h"
 #include "diag.h"
 #include "fsenv.h"
@@ -28,6 +30,7 @@
 #include "mrisurf.h"
 #include "mrisurf_metricProperties.h"
 #include "region.h"
+#include "romp_support.h"
 #include "timer.h"
 
 #define IMGSIZE 256
@@ -1482,52 +1485,67 @@ MRI *MRISmakeBoundingVolume(MRIS *mris, double resolution)
 }
 
 
+/*!
+  \brief Allocates the float volume that MRISfillInterior() and
+  MRISfillInteriorParity() fill when they are not given one: the bounding
+  box of the surface at the given resolution.
+*/
+static MRI *mrisAllocInteriorVolume(MRI_SURFACE *mris, double resolution)
+{
+  // not sure this will work
+  // ATH: it doesn't when the surface source geometry differs
+  // from resolution or when geometry is not LIA. In the future,
+  // this whole section should be replaced by MRISmakeBoundingVolume(),
+  // which just needs to be tested more first
+  int width = ceil((mris->xhi - mris->xlo) / resolution);
+  int height = ceil((mris->yhi - mris->ylo) / resolution);
+  int depth = ceil((mris->zhi - mris->zlo) / resolution);
+  MRI *mri_dst = MRIalloc(width, height, depth, MRI_FLOAT);
+  MRIsetResolution(mri_dst, resolution, resolution, resolution);
+  MATRIX *m_vox2ras = MatrixIdentity(4, NULL);
+  *MATRIX_RELT(m_vox2ras, 1, 1) = resolution;
+  *MATRIX_RELT(m_vox2ras, 2, 2) = resolution;
+  *MATRIX_RELT(m_vox2ras, 3, 3) = resolution;
+  *MATRIX_RELT(m_vox2ras, 1, 4) = mris->xlo + mris->vg.c_r;
+  *MATRIX_RELT(m_vox2ras, 2, 4) = mris->ylo + mris->vg.c_a;
+  *MATRIX_RELT(m_vox2ras, 3, 4) = mris->zlo + mris->vg.c_s;
+  MRIsetVoxelToRasXform(mri_dst, m_vox2ras);
+  MatrixFree(&m_vox2ras);
+  return (mri_dst);
+}
+
+
 /*!
 \fn MRI *MRISfillInterior(MRI_SURFACE *mris, double resolution, MRI *mri_dst)
 \brief Fills in the interior of a surface by creating a "watertight"
 shell and filling everything outside of the shell. This is much faster
 but slightly less accurate than a ray-tracing algorithm.  See also
-MRISfillInteriorOld() and MRISfillInteriorRibbonTest().
+MRISfillInteriorOld() and MRISfillInteriorRibbonTest(). Setting
+FREESURFER_FILL_INTERIOR_PARITY uses MRISfillInteriorParity() instead.
 \param mris - input surface
 \param resolution - only used if mri_dst is NULL
 \param mri_dst - output
 */
 MRI *MRISfillInterior(MRI_SURFACE *mris, double resolution, MRI *mri_dst)
 {
-  int col, row, slc, fno, numu, numv, u, v, nhits, width, height, depth;
+  int col, row, slc, fno, numu, numv, u, v, nhits;
   double x0, y0, z0, x1, y1, z1, x2, y2, z2, d0, d1, d2, dmax;
   double px0, py0, pz0, px1, py1, pz1, px, py, pz;
   double fcol, frow, fslc, dcol, drow, dslc, val, val2;
   double vx, vy, vz, vlen, ux, uy, uz, cosa;
   VERTEX *v_0, *v_1, *v_2;
   FACE *f;
-  MATRIX *crs, *xyz = NULL, *vox2sras = NULL, *m_vox2ras;
+  MATRIX *crs, *xyz = NULL, *vox2sras = NULL;
   MRI *mri_cosa, *mri_vlen, *mri_shell, *shellbb, *outsidebb;
   MRI_REGION *region;
   Timer start;
 
+  static bool const useParity = getenv("FREESURFER_FILL_INTERIOR_PARITY") != NULL;
+  if (useParity) return (MRISfillInteriorParity(mris, resolution, mri_dst));
+
   MRIScomputeMetricProperties(mris);
 
-  if (!mri_dst) {
-    // not sure this will work
-    // ATH: it doesn't when the surface source geometry differs
-    // from resolution or when geometry is not LIA. In the future,
-    // this whole section should be replaced by MRISmakeBoundingVolume(),
-    // which just needs to be tested more first
-    width = ceil((mris->xhi - mris->xlo) / resolution);
-    height = ceil((mris->yhi - mris->ylo) / resolution);
-    depth = ceil((mris->zhi - mris->zlo) / resolution);
-    mri_dst = MRIalloc(width, height, depth, MRI_FLOAT);
-    MRIsetResolution(mri_dst, resolution, resolution, resolution);
-    m_vox2ras = MatrixIdentity(4, NULL);
-    *MATRIX_RELT(m_vox2ras, 1, 1) = resolution;
-    *MATRIX_RELT(m_vox2ras, 2, 2) = resolution;
-    *MATRIX_RELT(m_vox2ras, 3, 3) = resolution;
-    *MATRIX_RELT(m_vox2ras, 1, 4) = mris->xlo + mris->vg.c_r;
-    *MATRIX_RELT(m_vox2ras, 2, 4) = mris->ylo + mris->vg.c_a;
-    *MATRIX_RELT(m_vox2ras, 3, 4) = mris->zlo + mris->vg.c_s;
-    MRIsetVoxelToRasXform(mri_dst, m_vox2ras);
-  }
+  if (!mri_dst) mri_dst = mrisAllocInteriorVolume(mris, resolution);
   MRIclear(mri_dst);
 
   dcol = mri_dst->xsize;
@@ -1719,6 +1737,258 @@ MRI *MRISfillInterior(MRI_SURFACE *mris, double resolution, MRI *mri_dst)
   return (mri_dst);
 }
 
+
+/*
+  The scanline voxelizer of MRISfillInteriors(). A surface is carried into
+  the voxel coordinates of the output volume and its faces are bucketed by
+  the slices whose centers their z range spans, so that each slice only
+  looks at the faces that can cross it.
+*/
+typedef struct
+{
+  std::vector<double> xyz;          // vertex positions in voxel coordinates
+  std::vector<int>    slice_start;  // faces of slice k: slice_faces[slice_start[k] .. slice_start[k+1]-1]
+  std::vector<int>    slice_faces;
+} SCANLINE_SURFACE;
+
+static void scanlineSurfaceInit(SCANLINE_SURFACE *ss, MRI_SURFACE *mris, MRI *mri)
+{
+  int const depth = mri->depth;
+
+  ss->xyz.resize(3 * mris->nvertices);
+  MRIS_SurfRAS2VoxelMap *map = MRIS_makeRAS2VoxelMap(mri, mris);
+  double m[3][4];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 4; j++) m[i][j] = map->sras2vox->rptr[i + 1][j + 1];
+  MRIS_freeRAS2VoxelMap(&map);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
+    VERTEX const *v = &mris->vertices[vno];
+    for (int i = 0; i < 3; i++) ss->xyz[3 * vno + i] = m[i][0] * v->x + m[i][1] * v->y + m[i][2] * v->z + m[i][3];
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // slices k0..k1 of each face, counted and then placed
+  std::vector<int> krange(2 * mris->nfaces);
+  ss->slice_start.assign(depth + 1, 0);
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    FACE const *f = &mris->faces[fno];
+    double zlo = ss->xyz[3 * f->v[0] + 2], zhi = zlo;
+    for (int n = 1; n < VERTICES_PER_FACE; n++) {
+      double const z = ss->xyz[3 * f->v[n] + 2];
+      if (z < zlo) zlo = z;
+      if (z > zhi) zhi = z;
+    }
+    int k0 = (int)ceil(zlo), k1 = (int)floor(zhi);
+    if (k0 < 0) k0 = 0;
+    if (k1 > depth - 1) k1 = depth - 1;
+    krange[2 * fno] = k0;
+    krange[2 * fno + 1] = k1;
+    for (int k = k0; k <= k1; k++) ss->slice_start[k + 1]++;
+  }
+  for (int k = 0; k < depth; k++) ss->slice_start[k + 1] += ss->slice_start[k];
+  ss->slice_faces.resize(ss->slice_start[depth]);
+  std::vector<int> next(ss->slice_start.begin(), ss->slice_start.end() - 1);
+  for (int fno = 0; fno < mris->nfaces; fno++)
+    for (int k = krange[2 * fno]; k <= krange[2 * fno + 1]; k++) ss->slice_faces[next[k]++] = fno;
+}
+
+/*
+  Twice the signed area of the triangle (a, b, p) projected onto the y-z
+  plane. It is always evaluated from the lower-numbered vertex, so the two
+  faces sharing an edge get exactly opposite values and a row through the
+  edge is inside at most one of them.
+*/
+static double scanlineEdge(const double *xyz, int a, int b, double y, double z)
+{
+  bool const swap = b < a;
+  const double *p = &xyz[3 * (swap ? b : a)], *q = &xyz[3 * (swap ? a : b)];
+  double const e = (q[1] - p[1]) * (z - p[2]) - (q[2] - p[2]) * (y - p[1]);
+  return (swap ? -e : e);
+}
+
+/*
+  Whether a row exactly on the edge a->b of a face with the given
+  orientation belongs to the face. The rule only depends on the direction
+  of the edge in the projected counterclockwise face, so of two faces on
+  either side of an edge exactly one takes the row, and two faces folded
+  over a silhouette edge take it both or neither.
+*/
+static bool scanlineEdgeOwnsRow(const double *xyz, int a, int b, double orientation)
+{
+  double const dy = orientation * (xyz[3 * b + 1] - xyz[3 * a + 1]);
+  double const dz = orientation * (xyz[3 * b + 2] - xyz[3 * a + 2]);
+  return (dz > 0 || (dz == 0 && dy < 0));
+}
+
+/*
+  Adds the x of every crossing of face fno with the rows (y = j, z = k)
+  of slice k to hits, as (j, x) pairs.
+*/
+static void scanlineFaceCrossings(MRI_SURFACE *mris,
+                                  const double *xyz,
+                                  int fno,
+                                  int k,
+                                  int height,
+                                  std::vector<std::pair<int, double> > &hits)
+{
+  FACE const *f = &mris->faces[fno];
+  int const a = f->v[0], b = f->v[1], c = f->v[2];
+  const double *A = &xyz[3 * a], *B = &xyz[3 * b], *C = &xyz[3 * c];
+
+  double const area = scanlineEdge(xyz, a, b, C[1], C[2]);
+  if (area == 0) return;  // edge on to the rows, its neighbors have the crossings
+  double const orientation = area > 0 ? 1 : -1;
+  bool const own_bc = scanlineEdgeOwnsRow(xyz, b, c, orientation);
+  bool const own_ca = scanlineEdgeOwnsRow(xyz, c, a, orientation);
+  bool const own_ab = scanlineEdgeOwnsRow(xyz, a, b, orientation);
+
+  double ylo = MIN(A[1], MIN(B[1], C[1])), yhi = MAX(A[1], MAX(B[1], C[1]));
+  int j0 = (int)ceil(ylo), j1 = (int)floor(yhi);
+  if (j0 < 0) j0 = 0;
+  if (j1 > height - 1) j1 = height - 1;
+  for (int j = j0; j <= j1; j++) {
+    double const wa = orientation * scanlineEdge(xyz, b, c, j, k);
+    if (wa < 0 || (wa == 0 && !own_bc)) continue;
+    double const wb = orientation * scanlineEdge(xyz, c, a, j, k);
+    if (wb < 0 || (wb == 0 && !own_ca)) continue;
+    double const wc = orientation * scanlineEdge(xyz, a, b, j, k);
+    if (wc < 0 || (wc == 0 && !own_ab)) continue;
+    double const w = wa + wb + wc;
+    if (w <= 0) continue;
+    hits.push_back(std::make_pair(j, (wa * A[0] + wb * B[0] + wc * C[0]) / w));
+  }
+}
+
+
+/*!
+  \fn int MRISfillInteriors(MRI_SURFACE **surfs, int nsurfs, MRI *mri_bits)
+  \brief Voxelizes the interiors of several closed surfaces in one pass.
+  Bit s of a voxel of mri_bits is set when the voxel center is inside
+  surfs[s], the test the ray casting of the OBB tree in mris_volmask
+  makes. mri_bits gives the output geometry, which can be any resolution,
+  and must be MRI_UCHAR (up to 8 surfaces), MRI_SHORT (15) or MRI_INT (31).
+
+  Each slice is done on its own thread. The faces crossing the slice give
+  the x at which they cross each row of voxel centers (a per-slice edge
+  table), these are sorted and the voxels between the first and second,
+  third and fourth, ... crossing of a row are inside. A row through an
+  edge or vertex of the surface is assigned to the faces by a top-left
+  rule, so it crosses a closed surface an even number of times.
+*/
+int MRISfillInteriors(MRI_SURFACE **surfs, int nsurfs, MRI *mri_bits)
+{
+  int const width = mri_bits->width, height = mri_bits->height, depth = mri_bits->depth;
+  int const max_surfs = mri_bits->type == MRI_UCHAR ? 8 : mri_bits->type == MRI_SHORT ? 15 : 31;
+  Timer start;
+
+  if (mri_bits->type != MRI_UCHAR && mri_bits->type != MRI_SHORT && mri_bits->type != MRI_INT)
+    ErrorReturn(ERROR_UNSUPPORTED,
+                (ERROR_UNSUPPORTED, "MRISfillInteriors: unsupported output type %d", mri_bits->type));
+  if (nsurfs > max_surfs)
+    ErrorReturn(ERROR_BADPARM,
+                (ERROR_BADPARM, "MRISfillInteriors: %d surfaces do not fit in type %d", nsurfs, mri_bits->type));
+
+  std::vector<SCANLINE_SURFACE> ss(nsurfs);
+  for (int s = 0; s < nsurfs; s++) scanlineSurfaceInit(&ss[s], surfs[s], mri_bits);
+
+  int nodd = 0;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1) reduction(+ : nodd)
+#endif
+  for (int k = 0; k < depth; k++) {
+    ROMP_PFLB_begin
+    std::vector<int> bits(width * height, 0);
+    std::vector<std::pair<int, double> > hits;
+
+    for (int s = 0; s < nsurfs; s++) {
+      SCANLINE_SURFACE const &sk = ss[s];
+      hits.clear();
+      for (int n = sk.slice_start[k]; n < sk.slice_start[k + 1]; n++)
+        scanlineFaceCrossings(surfs[s], &sk.xyz[0], sk.slice_faces[n], k, height, hits);
+      std::sort(hits.begin(), hits.end());
+
+      // the voxels i with an odd number of crossings x < i are inside
+      int const bit = 1 << s;
+      size_t n0 = 0;
+      while (n0 < hits.size()) {
+        int const j = hits[n0].first;
+        size_t n1 = n0;
+        while (n1 < hits.size() && hits[n1].first == j) n1++;
+        if ((n1 - n0) % 2) nodd++;
+        for (size_t n = n0; n + 1 < n1; n += 2) {
+          int i0 = (int)floor(hits[n].second) + 1, i1 = (int)floor(hits[n + 1].second);
+          if (i0 < 0) i0 = 0;
+          if (i1 > width - 1) i1 = width - 1;
+          for (int i = i0; i <= i1; i++) bits[j * width + i] |= bit;
+        }
+        n0 = n1;
+      }
+    }
+
+    for (int j = 0; j < height; j++) {
+      int const *row = &bits[j * width];
+      switch (mri_bits->type) {
+        case MRI_UCHAR:
+          for (int i = 0; i < width; i++) MRIvox(mri_bits, i, j, k) = row[i];
+          break;
+        case MRI_SHORT:
+          for (int i = 0; i < width; i++) MRISvox(mri_bits, i, j, k) = row[i];
+          break;
+        default:
+          for (int i = 0; i < width; i++) MRIIvox(mri_bits, i, j, k) = row[i];
+          break;
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  if (nodd > 0)
+    printf("MRISfillInteriors: %d rows crossed a surface an odd number of times - is it closed?\n", nodd);
+  if (Gdiag_no > 0) printf("  MRISfillInteriors t = %g\n", start.seconds());
+
+  return (NO_ERROR);
+}
+
+
+/*!
+  \fn MRI *MRISfillInteriorParity(MRI_SURFACE *mris, double resolution, MRI *mri_dst)
+  \brief MRISfillInterior() by scanline parity (see MRISfillInteriors()):
+  the voxels of mri_dst whose centers are inside the surface are set to 1,
+  the others to 0.
+  \param mris - input surface
+  \param resolution - only used if mri_dst is NULL
+  \param mri_dst - output
+*/
+MRI *MRISfillInteriorParity(MRI_SURFACE *mris, double resolution, MRI *mri_dst)
+{
+  MRIScomputeMetricProperties(mris);
+
+  if (!mri_dst) mri_dst = mrisAllocInteriorVolume(mris, resolution);
+
+  if (mri_dst->type == MRI_UCHAR || mri_dst->type == MRI_SHORT || mri_dst->type == MRI_INT) {
+    MRISfillInteriors(&mris, 1, mri_dst);
+    return (mri_dst);
+  }
+
+  MRI *mri_bits = MRIcloneDifferentType(mri_dst, MRI_UCHAR);
+  MRISfillInteriors(&mris, 1, mri_bits);
+  for (int k = 0; k < mri_dst->depth; k++)
+    for (int j = 0; j < mri_dst->height; j++)
+      for (int i = 0; i < mri_dst->width; i++) MRIsetVoxVal(mri_dst, i, j, k, 0, MRIvox(mri_bits, i, j, k));
+  MRIfree(&mri_bits);
+
+  return (mri_dst);
+}
+
 /*!
 \fn int MRISfillInteriorRibbonTest(char *subject, int UseNew, FILE *fp)
 \brief Runs a test on MRISfillInterior() by comparing its results to
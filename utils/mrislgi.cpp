@@ -0,0 +1,486 @@
+/**
+ * @brief local gyrification index (lGI) of a pial surface
+ *
+ * See mrislgi.h. This follows the MATLAB implementation that mris_compute_lgi
+ * used to run (make_roi_paths.m, mri_path2label --confillx and compute_lgi.m)
+ * step by step. Each hull region only touches the neighborhood of its center,
+ * so the regions are computed independently, one per thread, and merged in
+ * vertex order afterwards.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "diag.h"
+#include "error.h"
+#include "macros.h"
+#include "mrishash.h"
+#include "mrislgi.h"
+#include "mrisurf.h"
+#include "timer.h"
+
+#include "romp_support.h"
+
+#define LGI_PATH_STEP  7      // every LGI_PATH_STEP-th perimeter vertex is carried to the pial surface
+#define LGI_MAX        9.0    // larger ratios mean the pial region was filled on the wrong side
+#define LGI_CHUNK      256    // hull regions that are computed before they are merged
+
+#define LGI_OK         0
+#define LGI_NOPATH     1      // the perimeter could not be closed on the pial surface
+#define LGI_ABERRANT   2      // the ratio is too high even for the inverted pial region
+
+// per-thread work space. Arrays indexed by vertex or face hold the stamp of
+// the last region (or path segment) that set them, so nothing has to be
+// cleared between regions.
+struct LgiScratch
+{
+  int stamp;
+  std::vector< int > sphereStamp;    // hull vertex, inSphere is valid
+  std::vector< char > inSphere;
+  std::vector< int > hullFaceStamp;  // hull face is in the region
+  std::vector< int > perimStamp;     // hull vertex is on the perimeter
+  std::vector< int > labelStamp;     // pial vertex is in the region
+  std::vector< int > pathStamp;      // pial vertex is on the perimeter path
+  std::vector< int > pialFaceStamp;  // pial face has been counted
+  std::vector< int > distStamp;      // pial vertex, dist and pred are valid (negated once settled)
+  std::vector< float > dist;
+  std::vector< int > pred;
+  std::vector< std::pair< float, int > > heap;
+  std::vector< int > faces, perim, proj, order, remaining;
+};
+
+struct LgiRegion
+{
+  int status;
+  double lgi;
+  std::vector< int > vno;       // pial vertices in the region
+  std::vector< float > weight;  // and their weights
+};
+
+static void lgiScratchInit(std::vector< LgiScratch > &scratch, MRIS *pial, MRIS *outer)
+{
+  scratch.resize(omp_get_max_threads());
+  for (unsigned int t = 0; t < scratch.size(); t++) {
+    LgiScratch &sc = scratch[t];
+    sc.stamp = 0;
+    sc.sphereStamp.assign(outer->nvertices, 0);
+    sc.inSphere.assign(outer->nvertices, 0);
+    sc.hullFaceStamp.assign(outer->nfaces, 0);
+    sc.perimStamp.assign(outer->nvertices, 0);
+    sc.labelStamp.assign(pial->nvertices, 0);
+    sc.pathStamp.assign(pial->nvertices, 0);
+    sc.pialFaceStamp.assign(pial->nfaces, 0);
+    sc.distStamp.assign(pial->nvertices, 0);
+    sc.dist.assign(pial->nvertices, 0);
+    sc.pred.assign(pial->nvertices, -1);
+  }
+}
+
+static LgiScratch &lgiThreadScratch(std::vector< LgiScratch > &scratch)
+{
+#ifdef HAVE_OPENMP
+  return scratch[omp_get_thread_num()];
+#else
+  return scratch[0];
+#endif
+}
+
+static double lgiFaceArea(MRIS *mris, int fno)
+{
+  FACE const *f = &mris->faces[fno];
+  VERTEX const *v0 = &mris->vertices[f->v[0]], *v1 = &mris->vertices[f->v[1]], *v2 = &mris->vertices[f->v[2]];
+  double ax = v1->x - v0->x, ay = v1->y - v0->y, az = v1->z - v0->z;
+  double bx = v2->x - v0->x, by = v2->y - v0->y, bz = v2->z - v0->z;
+  double cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+  return (0.5 * sqrt(cx * cx + cy * cy + cz * cz));
+}
+
+// the "sphere" of isVertexInRadius.m: all three axis-aligned projections
+// of the offset are within the radius
+static inline bool lgiInSphere(MRIS *outer, LgiScratch &sc, int stamp, int vno, VERTEX const *c, double r2)
+{
+  if (sc.sphereStamp[vno] != stamp) {
+    VERTEX const *v = &outer->vertices[vno];
+    double dx = v->x - c->x, dy = v->y - c->y, dz = v->z - c->z;
+    sc.inSphere[vno] = (dx * dx + dy * dy <= r2) && (dy * dy + dz * dz <= r2) && (dx * dx + dz * dz <= r2);
+    sc.sphereStamp[vno] = stamp;
+  }
+  return (sc.inSphere[vno]);
+}
+
+/*
+  Region of the hull around vertex center: the faces that have a vertex
+  inside the sphere and are connected to the center through shared
+  vertices (getVerticesAndFacesInSphere.m and MakeGeodesicOuterROI.m).
+  Leaves the perimeter (the vertices of the region outside the sphere) in
+  sc.perim in ascending order and returns the area of the region.
+*/
+static double lgiHullRegion(MRIS *outer, const double *faceArea, int center, double radius, LgiScratch &sc, int stamp)
+{
+  VERTEX const *c = &outer->vertices[center];
+  double r2 = radius * radius, area = 0;
+
+  sc.faces.clear();
+  sc.perim.clear();
+  VERTEX_TOPOLOGY const *vt = &outer->vertices_topology[center];
+  for (int n = 0; n < vt->num; n++) {
+    if (sc.hullFaceStamp[vt->f[n]] == stamp) continue;
+    sc.hullFaceStamp[vt->f[n]] = stamp;
+    sc.faces.push_back(vt->f[n]);
+  }
+
+  for (unsigned int k = 0; k < sc.faces.size(); k++) {
+    FACE const *face = &outer->faces[sc.faces[k]];
+    area += faceArea[sc.faces[k]];
+    for (int i = 0; i < VERTICES_PER_FACE; i++) {
+      int vno = face->v[i];
+      if (!lgiInSphere(outer, sc, stamp, vno, c, r2) && sc.perimStamp[vno] != stamp) {
+        sc.perimStamp[vno] = stamp;
+        sc.perim.push_back(vno);
+      }
+      VERTEX_TOPOLOGY const *nt = &outer->vertices_topology[vno];
+      for (int n = 0; n < nt->num; n++) {
+        int fno = nt->f[n];
+        if (sc.hullFaceStamp[fno] == stamp) continue;
+        FACE const *nf = &outer->faces[fno];
+        if (lgiInSphere(outer, sc, stamp, nf->v[0], c, r2) || lgiInSphere(outer, sc, stamp, nf->v[1], c, r2) ||
+            lgiInSphere(outer, sc, stamp, nf->v[2], c, r2)) {
+          sc.hullFaceStamp[fno] = stamp;
+          sc.faces.push_back(fno);
+        }
+      }
+    }
+  }
+  std::sort(sc.perim.begin(), sc.perim.end());
+  return (area);
+}
+
+// index of the vertex in list that is closest to vertex vno (the first one on ties)
+static int lgiClosest(MRIS *pial, const std::vector< int > &list, int vno)
+{
+  VERTEX const *v = &pial->vertices[vno];
+  double dmin = 0;
+  int kmin = -1;
+
+  for (unsigned int k = 0; k < list.size(); k++) {
+    VERTEX const *u = &pial->vertices[list[k]];
+    double d = SQR(u->x - v->x) + SQR(u->y - v->y) + SQR(u->z - v->z);
+    if (kmin < 0 || d < dmin) {
+      dmin = d;
+      kmin = k;
+    }
+  }
+  return (kmin);
+}
+
+/*
+  Carries every step-th perimeter vertex to the closest pial vertex
+  (SearchProjectionOnPial.m) and orders them into a loop by walking to the
+  closest remaining vertex (reorganize_verticeslist.m). Every start vertex
+  is tried before the perimeter is subsampled more coarsely. Leaves the
+  closed loop in sc.order and returns 0 if none was found.
+*/
+static int lgiOrderPerimeter(MRIS *pial, const int *closest, LgiScratch &sc)
+{
+  for (int step = LGI_PATH_STEP; step <= (int)sc.perim.size(); step++) {
+    sc.proj.clear();
+    for (unsigned int t = 0; t < sc.perim.size(); t += step) sc.proj.push_back(closest[sc.perim[t]]);
+    std::sort(sc.proj.begin(), sc.proj.end());
+    sc.proj.erase(std::unique(sc.proj.begin(), sc.proj.end()), sc.proj.end());
+
+    int n = sc.proj.size();
+    if (n < 3) break;
+
+    for (int start = 0; start < n - 1; start++) {
+      sc.order.assign(1, sc.proj[start]);
+      sc.remaining = sc.proj;
+      sc.remaining.erase(sc.remaining.begin() + start);
+
+      // take two steps before the start vertex can be found again
+      for (int z = 0; z < 2; z++) {
+        int k = lgiClosest(pial, sc.remaining, sc.order.back());
+        sc.order.push_back(sc.remaining[k]);
+        sc.remaining.erase(sc.remaining.begin() + k);
+      }
+      sc.remaining.push_back(sc.proj[start]);
+      for (int z = 2; z < n; z++) {
+        int k = lgiClosest(pial, sc.remaining, sc.order.back());
+        sc.order.push_back(sc.remaining[k]);
+        if (sc.remaining[k] == sc.proj[start]) break;
+        sc.remaining.erase(sc.remaining.begin() + k);
+      }
+      if ((int)sc.order.size() == n + 1) return (1);
+    }
+  }
+  return (0);
+}
+
+static inline void lgiAddToLabel(LgiScratch &sc, LgiRegion &region, int vno, int stamp)
+{
+  if (sc.labelStamp[vno] == stamp) return;
+  sc.labelStamp[vno] = stamp;
+  region.vno.push_back(vno);
+}
+
+/*
+  Shortest path along the edges of the pial surface from src to dst
+  (MRISfindPath). Uses A* with the straight-line distance to dst as the
+  estimate, so only a narrow band around the path is searched. The
+  vertices on the path are marked in sc.pathStamp and added to the region.
+*/
+static int lgiConnect(MRIS *pial, LgiScratch &sc, LgiRegion &region, int src, int dst, int stamp)
+{
+  int dstamp = ++sc.stamp;
+  VERTEX const *t = &pial->vertices[dst];
+
+  sc.heap.clear();
+  sc.distStamp[src] = dstamp;
+  sc.dist[src] = 0;
+  sc.pred[src] = -1;
+  sc.heap.push_back(std::make_pair(0.0f, src));
+  while (!sc.heap.empty()) {
+    std::pop_heap(sc.heap.begin(), sc.heap.end(), std::greater< std::pair< float, int > >());
+    int vno = sc.heap.back().second;
+    sc.heap.pop_back();
+    if (sc.distStamp[vno] == -dstamp) continue;  // already settled
+    sc.distStamp[vno] = -dstamp;
+    if (vno == dst) break;
+
+    VERTEX_TOPOLOGY const *vt = &pial->vertices_topology[vno];
+    VERTEX const *v = &pial->vertices[vno];
+    float d = sc.dist[vno];
+    for (int n = 0; n < vt->vnum; n++) {
+      int uno = vt->v[n];
+      if (sc.distStamp[uno] == -dstamp) continue;
+      VERTEX const *u = &pial->vertices[uno];
+      float du = d + sqrt(SQR(u->x - v->x) + SQR(u->y - v->y) + SQR(u->z - v->z));
+      if (sc.distStamp[uno] == dstamp && du >= sc.dist[uno]) continue;
+      sc.distStamp[uno] = dstamp;
+      sc.dist[uno] = du;
+      sc.pred[uno] = vno;
+      float h = sqrt(SQR(t->x - u->x) + SQR(t->y - u->y) + SQR(t->z - u->z));
+      sc.heap.push_back(std::make_pair(du + h, uno));
+      std::push_heap(sc.heap.begin(), sc.heap.end(), std::greater< std::pair< float, int > >());
+    }
+  }
+  if (sc.distStamp[dst] != -dstamp) return (0);
+
+  for (int vno = dst; vno >= 0; vno = sc.pred[vno]) {
+    sc.pathStamp[vno] = stamp;
+    lgiAddToLabel(sc, region, vno, stamp);
+  }
+  return (1);
+}
+
+/*
+  Computes the lGI of the hull region around vertex center and the pial
+  vertices it is spread over, with their weights (compute_lgi.m).
+*/
+static void lgiRegion(MRIS *pial,
+                      MRIS *outer,
+                      const int *closest,
+                      const double *pialFaceArea,
+                      const double *hullFaceArea,
+                      double pialArea,
+                      int center,
+                      double radius,
+                      LgiScratch &sc,
+                      LgiRegion &region)
+{
+  int stamp = ++sc.stamp;
+
+  region.status = LGI_OK;
+  region.lgi = 0;
+  region.vno.clear();
+  region.weight.clear();
+
+  double hullArea = lgiHullRegion(outer, hullFaceArea, center, radius, sc, stamp);
+
+  // close the perimeter into a path on the pial surface
+  if (!lgiOrderPerimeter(pial, closest, sc)) {
+    region.status = LGI_NOPATH;
+    return;
+  }
+  for (unsigned int k = 0; k + 1 < sc.order.size(); k++) {
+    if (!lgiConnect(pial, sc, region, sc.order[k + 1], sc.order[k], stamp)) {
+      region.status = LGI_NOPATH;
+      region.vno.clear();
+      return;
+    }
+  }
+
+  // fill the inside of the path, starting at the pial vertex closest to the center
+  int seed = closest[center];
+  if (sc.pathStamp[seed] != stamp) {
+    unsigned int first = region.vno.size();
+    lgiAddToLabel(sc, region, seed, stamp);
+    for (unsigned int k = first; k < region.vno.size(); k++) {
+      VERTEX_TOPOLOGY const *vt = &pial->vertices_topology[region.vno[k]];
+      for (int n = 0; n < vt->vnum; n++) lgiAddToLabel(sc, region, vt->v[n], stamp);
+    }
+  }
+
+  // area of all the faces that touch the region
+  double area = 0;
+  for (unsigned int k = 0; k < region.vno.size(); k++) {
+    VERTEX_TOPOLOGY const *vt = &pial->vertices_topology[region.vno[k]];
+    for (int n = 0; n < vt->num; n++) {
+      if (sc.pialFaceStamp[vt->f[n]] == stamp) continue;
+      sc.pialFaceStamp[vt->f[n]] = stamp;
+      area += pialFaceArea[vt->f[n]];
+    }
+  }
+  region.lgi = area / hullArea;
+
+  // the fill probably went around the outside of the path, use the
+  // complement. The weights below still go to the original region, as
+  // compute_lgi.m does.
+  if (region.lgi > LGI_MAX) {
+    area = pialArea - area;
+    if (area < hullArea) {
+      region.status = LGI_ABERRANT;
+      return;
+    }
+    region.lgi = area / hullArea;
+    if (region.lgi > LGI_MAX) {
+      region.status = LGI_ABERRANT;
+      return;
+    }
+  }
+
+  // weight by the distance to the axis along the hull normal at the center
+  VERTEX const *c = &outer->vertices[center];
+  double nx = c->nx, ny = c->ny, nz = c->nz, len = sqrt(nx * nx + ny * ny + nz * nz);
+  if (len > 0) {
+    nx /= len;
+    ny /= len;
+    nz /= len;
+  }
+  region.weight.resize(region.vno.size());
+  for (unsigned int k = 0; k < region.vno.size(); k++) {
+    VERTEX const *v = &pial->vertices[region.vno[k]];
+    double dx = v->x - c->x, dy = v->y - c->y, dz = v->z - c->z;
+    double along = dx * nx + dy * ny + dz * nz;
+    double d = sqrt(MAX(0.0, dx * dx + dy * dy + dz * dz - along * along));
+    region.weight[k] = 1.0 / (d + 1.0);
+  }
+}
+
+/*!
+  \fn int MRIScomputeLGI(MRI_SURFACE *pial, MRI_SURFACE *outer, double radius, int stepsize,
+                         float *pial_lgi, float *outer_lgi)
+  \brief Computes the local gyrification index of pial using the hull
+  surface outer (the smoothed outer surface made by mris_compute_lgi).
+  A region of the given radius is taken around every stepsize-th hull
+  vertex. pial_lgi (pial->nvertices) gets the lGI of every pial vertex,
+  0 where no region reached. If outer_lgi is not NULL it gets the lGI of
+  every hull vertex that a region was centered on, 0 elsewhere. The hull
+  normals must be current. Regions are computed in parallel and the result
+  does not depend on the number of threads. Fails if a region gives an
+  aberrant lGI, which is usually caused by topological defects in pial.
+*/
+int MRIScomputeLGI(MRIS *pial, MRIS *outer, double radius, int stepsize, float *pial_lgi, float *outer_lgi)
+{
+  Timer timer;
+
+  if (stepsize < 1 || radius <= 0)
+    ErrorReturn(ERROR_BADPARM,
+                (ERROR_BADPARM, "MRIScomputeLGI: invalid radius %g or step size %d", radius, stepsize));
+
+  std::vector< double > pialFaceArea(pial->nfaces), hullFaceArea(outer->nfaces);
+  double pialArea = 0;
+  for (int fno = 0; fno < pial->nfaces; fno++) {
+    pialFaceArea[fno] = lgiFaceArea(pial, fno);
+    pialArea += pialFaceArea[fno];
+  }
+  for (int fno = 0; fno < outer->nfaces; fno++) hullFaceArea[fno] = lgiFaceArea(outer, fno);
+
+  // closest pial vertex to every hull vertex (mesh_vertex_nearest.m)
+  std::vector< int > closest(outer->nvertices);
+  MRIS_HASH_TABLE *mht = MHTcreateVertexTable_Resolution(pial, CURRENT_VERTICES, 4.0);
+  for (int vno = 0; vno < outer->nvertices; vno++) {
+    VERTEX const *v = &outer->vertices[vno];
+    closest[vno] = MHTfindVnoOfClosestVertexInTable(mht, pial, v->x, v->y, v->z, 1);
+  }
+  MHTfree(&mht);
+
+  std::vector< int > centers;
+  for (int vno = 0; vno < outer->nvertices; vno += stepsize) centers.push_back(vno);
+  int ncenters = centers.size();
+  printf("computing lGI in %d regions of radius %g mm\n", ncenters, radius);
+
+  std::vector< LgiScratch > scratch;
+  lgiScratchInit(scratch, pial, outer);
+  std::vector< LgiRegion > regions(std::min(ncenters, LGI_CHUNK));
+  std::vector< double > wsum(pial->nvertices, 0.0), rsum(pial->nvertices, 0.0);
+  if (outer_lgi) memset(outer_lgi, 0, outer->nvertices * sizeof(float));
+
+  int nskipped = 0;
+  for (int c0 = 0; c0 < ncenters; c0 += LGI_CHUNK) {
+    int nc = std::min(LGI_CHUNK, ncenters - c0);
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(dynamic, 1)
+#endif
+    for (int c = 0; c < nc; c++) {
+      ROMP_PFLB_begin
+      lgiRegion(pial, outer, &closest[0], &pialFaceArea[0], &hullFaceArea[0], pialArea, centers[c0 + c], radius,
+                lgiThreadScratch(scratch), regions[c]);
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    // merge in vertex order so the sums do not depend on the threads
+    for (int c = 0; c < nc; c++) {
+      LgiRegion &region = regions[c];
+      int center = centers[c0 + c];
+      if (region.status == LGI_ABERRANT)
+        ErrorReturn(ERROR_BADPARM,
+                    (ERROR_BADPARM,
+                     "MRIScomputeLGI: lGI value for vertex %d is aberrantly high (lGI=%g). "
+                     "This may be caused by topological defects, check mris_euler_number on the pial surface.",
+                     center, region.lgi));
+      if (region.status == LGI_NOPATH) {
+        printf("WARNING: could not close the pial path of the region at vertex %d, skipping it\n", center);
+        nskipped++;
+        continue;
+      }
+      if (Gdiag & DIAG_VERBOSE_ON) printf("lGI for vertex number %d of the outer mesh is %g\n", center, region.lgi);
+      if (outer_lgi) outer_lgi[center] = region.lgi;
+      for (unsigned int k = 0; k < region.vno.size(); k++) {
+        wsum[region.vno[k]] += region.weight[k];
+        rsum[region.vno[k]] += region.weight[k] * region.lgi;
+      }
+    }
+    printf("  %d of %d regions done\n", c0 + nc, ncenters);
+    fflush(stdout);
+  }
+
+  double mean = 0;
+  for (int vno = 0; vno < pial->nvertices; vno++) {
+    pial_lgi[vno] = (wsum[vno] > 0) ? rsum[vno] / wsum[vno] : 0.0;
+    mean += pial_lgi[vno];
+  }
+  if (pial->nvertices > 0) mean /= pial->nvertices;
+  printf("average lGI over the hemisphere %g (%d regions skipped), took %2.1f sec\n", mean, nskipped, timer.seconds());
+
+  return (NO_ERROR);
+}
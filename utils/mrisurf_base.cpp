@@ -18,6 +18,7 @@
  */
 #include "mrisurf_base.h"
 #include "mrisurf_metricProperties.h"
+#include "mrisurf_MRIS_MP.h"
 
 
 int mris_sort_compare_float(const void *pc1, const void *pc2)
@@ -410,8 +411,14 @@ void MRISfreeDistOrigs(MRIS* mris)
 }
 
 void MRISfreeDistsButNotOrig(MRIS_MP* mris)
+  // The buffers are kept in v_dist_buffer so computing the distances again does not have to malloc them
 {
-  cheapAssert(!"MRISfreeDistsButNotOrig(MRIS_MP* mris) NYI");  
+  mris->dist_nsize = 0;
+  if (!mris->v_dist) return;
+  int vno;
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    mris->v_dist[vno] = NULL;
+  }
 }
 void MRISfreeDistsButNotOrig(MRISPV* mris)
 {
@@ -0,0 +1,360 @@
+/**
+ * @brief exact closest-point queries against a surface
+ *
+ * See mrisurf_closest.h. The faces are stored in the cells their bounding
+ * boxes overlap (compressed rows: the faces of cell n are
+ * cell_faces[cell_start[n] .. cell_start[n+1]-1]). A query searches the
+ * rings of cells around the cell of the probe outwards and stops when no
+ * cell of the next ring can be closer than the best face found.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <math.h>
+
+#include <vector>
+
+#include "mrisurf_closest.h"
+
+#include "diag.h"
+#include "error.h"
+#include "romp_support.h"
+
+#define FACE_GRID_MAX_DIM  512  // cells along an axis, the cells are made bigger beyond that
+
+struct MRIS_FACE_GRID
+{
+  std::vector<double> xyz;        // vertex positions
+  std::vector<int>    face_v;     // the 3 vertices of each face
+  std::vector<double> face_ball;  // centroid and radius of a ball around each face
+  double              origin[3];  // corner of cell (0,0,0)
+  double              cell_size;
+  int                 dims[3];
+  std::vector<int>    cell_start;
+  std::vector<int>    cell_faces;
+};
+
+
+MRIS_FACE_GRID *MRISfaceGridAlloc(MRI_SURFACE *mris, int which, double cell_size)
+{
+  MRIS_FACE_GRID *grid = new MRIS_FACE_GRID;
+
+  grid->xyz.resize(3 * mris->nvertices);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    double *p = &grid->xyz[3 * vno];
+    MRISvertexCoord2XYZ_double(&mris->vertices[vno], which, &p[0], &p[1], &p[2]);
+  }
+
+  // the faces that take part, their bounding box and average edge length
+  grid->face_v.resize(3 * mris->nfaces, -1);
+  std::vector<int> fnos;
+  double lo[3] = {1e10, 1e10, 1e10}, hi[3] = {-1e10, -1e10, -1e10}, edge_sum = 0;
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    FACE const *face = &mris->faces[fno];
+    if (face->ripflag) continue;
+    int n;
+    for (n = 0; n < VERTICES_PER_FACE; n++)
+      if (mris->vertices[face->v[n]].ripflag) break;
+    if (n < VERTICES_PER_FACE) continue;
+
+    fnos.push_back(fno);
+    for (n = 0; n < VERTICES_PER_FACE; n++) {
+      grid->face_v[3 * fno + n] = face->v[n];
+      double const *p = &grid->xyz[3 * face->v[n]], *q = &grid->xyz[3 * face->v[(n + 1) % VERTICES_PER_FACE]];
+      edge_sum += sqrt(SQR(q[0] - p[0]) + SQR(q[1] - p[1]) + SQR(q[2] - p[2]));
+      for (int a = 0; a < 3; a++) {
+        if (p[a] < lo[a]) lo[a] = p[a];
+        if (p[a] > hi[a]) hi[a] = p[a];
+      }
+    }
+  }
+
+  grid->face_ball.resize(4 * mris->nfaces, 0);
+  for (int fno : fnos) {
+    double *ball = &grid->face_ball[4 * fno];
+    for (int n = 0; n < VERTICES_PER_FACE; n++)
+      for (int a = 0; a < 3; a++) ball[a] += grid->xyz[3 * grid->face_v[3 * fno + n] + a] / VERTICES_PER_FACE;
+    for (int n = 0; n < VERTICES_PER_FACE; n++) {
+      double const *p = &grid->xyz[3 * grid->face_v[3 * fno + n]];
+      ball[3] = MAX(ball[3], sqrt(SQR(p[0] - ball[0]) + SQR(p[1] - ball[1]) + SQR(p[2] - ball[2])));
+    }
+  }
+
+  if (fnos.empty()) {
+    grid->cell_size = 1;
+    grid->dims[0] = grid->dims[1] = grid->dims[2] = 0;
+    grid->origin[0] = grid->origin[1] = grid->origin[2] = 0;
+    grid->cell_start.assign(1, 0);
+    return (grid);
+  }
+
+  if (cell_size <= 0) cell_size = 2 * edge_sum / (VERTICES_PER_FACE * fnos.size());
+  if (cell_size <= 0) cell_size = 1;
+  for (int a = 0; a < 3; a++)
+    if ((hi[a] - lo[a]) / cell_size > FACE_GRID_MAX_DIM - 1) cell_size = (hi[a] - lo[a]) / (FACE_GRID_MAX_DIM - 1);
+  grid->cell_size = cell_size;
+  for (int a = 0; a < 3; a++) {
+    grid->origin[a] = lo[a];
+    grid->dims[a] = (int)floor((hi[a] - lo[a]) / cell_size) + 1;
+    if (grid->dims[a] > FACE_GRID_MAX_DIM) grid->dims[a] = FACE_GRID_MAX_DIM;
+  }
+
+  // each face goes into the cells its bounding box overlaps, counted and then placed
+  int const ncells = grid->dims[0] * grid->dims[1] * grid->dims[2];
+  std::vector<int> ranges(6 * mris->nfaces);
+  grid->cell_start.assign(ncells + 1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    std::vector<int> next;
+    if (pass == 1) {
+      for (int n = 0; n < ncells; n++) grid->cell_start[n + 1] += grid->cell_start[n];
+      grid->cell_faces.resize(grid->cell_start[ncells]);
+      next.assign(grid->cell_start.begin(), grid->cell_start.end() - 1);
+    }
+    for (int fno : fnos) {
+      int *r = &ranges[6 * fno];
+      if (pass == 0) {
+        for (int a = 0; a < 3; a++) {
+          double flo = 1e10, fhi = -1e10;
+          for (int n = 0; n < VERTICES_PER_FACE; n++) {
+            double const x = grid->xyz[3 * grid->face_v[3 * fno + n] + a];
+            if (x < flo) flo = x;
+            if (x > fhi) fhi = x;
+          }
+          r[2 * a] = MAX(0, (int)floor((flo - lo[a]) / cell_size));
+          r[2 * a + 1] = MIN(grid->dims[a] - 1, (int)floor((fhi - lo[a]) / cell_size));
+        }
+      }
+      for (int k = r[4]; k <= r[5]; k++)
+        for (int j = r[2]; j <= r[3]; j++)
+          for (int i = r[0]; i <= r[1]; i++) {
+            int const cell = (k * grid->dims[1] + j) * grid->dims[0] + i;
+            if (pass == 0)
+              grid->cell_start[cell + 1]++;
+            else
+              grid->cell_faces[next[cell]++] = fno;
+          }
+    }
+  }
+
+  if (Gdiag & DIAG_SHOW)
+    printf("face grid: %d faces in %d x %d x %d cells of %2.2f mm\n",
+           (int)fnos.size(), grid->dims[0], grid->dims[1], grid->dims[2], cell_size);
+
+  return (grid);
+}
+
+
+void MRISfaceGridFree(MRIS_FACE_GRID **pgrid)
+{
+  delete *pgrid;
+  *pgrid = NULL;
+}
+
+
+static double faceGridDot(const double *u, const double *v) { return (u[0] * v[0] + u[1] * v[1] + u[2] * v[2]); }
+
+/*
+  The squared distance from p to the triangle (a, b, c) and the barycentric
+  coordinates of the closest point, found by the Voronoi region of the
+  triangle p is in (Ericson, Real-Time Collision Detection, 5.1.5).
+*/
+static double faceGridTriangleDist2(const double *a, const double *b, const double *c, const double *p, double bary[3])
+{
+  double ab[3], ac[3], ap[3];
+  for (int i = 0; i < 3; i++) {
+    ab[i] = b[i] - a[i];
+    ac[i] = c[i] - a[i];
+    ap[i] = p[i] - a[i];
+  }
+  double const d1 = faceGridDot(ab, ap), d2 = faceGridDot(ac, ap);
+  double u, v, w;  // of a, b and c
+
+  if (d1 <= 0 && d2 <= 0) {
+    u = 1, v = 0, w = 0;
+  }
+  else {
+    double bp[3], cp[3];
+    for (int i = 0; i < 3; i++) {
+      bp[i] = p[i] - b[i];
+      cp[i] = p[i] - c[i];
+    }
+    double const d3 = faceGridDot(ab, bp), d4 = faceGridDot(ac, bp);
+    double const d5 = faceGridDot(ab, cp), d6 = faceGridDot(ac, cp);
+    double const vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+    if (d3 >= 0 && d4 <= d3) {
+      u = 0, v = 1, w = 0;
+    }
+    else if (d6 >= 0 && d5 <= d6) {
+      u = 0, v = 0, w = 1;
+    }
+    else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+      v = d1 / (d1 - d3);
+      u = 1 - v, w = 0;
+    }
+    else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+      w = d2 / (d2 - d6);
+      u = 1 - w, v = 0;
+    }
+    else if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+      w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+      u = 0, v = 1 - w;
+    }
+    else {
+      double const denom = va + vb + vc;
+      v = vb / denom;
+      w = vc / denom;
+      u = 1 - v - w;
+    }
+  }
+
+  bary[0] = u;
+  bary[1] = v;
+  bary[2] = w;
+  double d = 0;
+  for (int i = 0; i < 3; i++) d += SQR(u * a[i] + v * b[i] + w * c[i] - p[i]);
+  return (d);
+}
+
+
+/*
+  The faces of cell (i, j, k) that are closer than *pbest2 (squared)
+  replace the best one.
+*/
+static void faceGridSearchCell(MRIS_FACE_GRID const *grid, int i, int j, int k, const double *p,
+                               double *pbest2, int *pbest_fno, double best_bary[3])
+{
+  // the cell can't hold anything closer than its box
+  double box2 = 0;
+  int const ijk[3] = {i, j, k};
+  for (int a = 0; a < 3; a++) {
+    double const lo = grid->origin[a] + ijk[a] * grid->cell_size, hi = lo + grid->cell_size;
+    if (p[a] < lo) box2 += SQR(lo - p[a]);
+    else if (p[a] > hi) box2 += SQR(p[a] - hi);
+  }
+  if (box2 >= *pbest2) return;
+
+  int const cell = (k * grid->dims[1] + j) * grid->dims[0] + i;
+  for (int n = grid->cell_start[cell]; n < grid->cell_start[cell + 1]; n++) {
+    int const fno = grid->cell_faces[n];
+    double const *ball = &grid->face_ball[4 * fno];
+    double const center_dist = sqrt(SQR(p[0] - ball[0]) + SQR(p[1] - ball[1]) + SQR(p[2] - ball[2])) - ball[3];
+    if (center_dist > 0 && center_dist * center_dist >= *pbest2) continue;
+    int const *fv = &grid->face_v[3 * fno];
+    double bary[3];
+    double const d2 = faceGridTriangleDist2(&grid->xyz[3 * fv[0]], &grid->xyz[3 * fv[1]], &grid->xyz[3 * fv[2]], p, bary);
+    if (d2 < *pbest2) {
+      *pbest2 = d2;
+      *pbest_fno = fno;
+      for (int a = 0; a < 3; a++) best_bary[a] = bary[a];
+    }
+  }
+}
+
+
+int MRISfaceGridClosestPoint(MRIS_FACE_GRID const *grid,
+                             double x, double y, double z,
+                             double max_dist,
+                             double *pdist,
+                             double bary[3])
+{
+  double const p[3] = {x, y, z};
+  double const h = grid->cell_size;
+  double best2 = max_dist * max_dist, best_bary[3] = {0, 0, 0};
+  int best_fno = -1;
+
+  int c[3];
+  for (int a = 0; a < 3; a++) c[a] = (int)floor((p[a] - grid->origin[a]) / h);
+
+  for (int r = 0; grid->dims[0] > 0; r++) {
+    if (r > 0) {
+      // everything not searched yet is outside the cells c-(r-1) .. c+(r-1)
+      double bound = 1e10;
+      bool covered = true;
+      for (int a = 0; a < 3; a++) {
+        double const lo = grid->origin[a] + (c[a] - r + 1) * h, hi = grid->origin[a] + (c[a] + r) * h;
+        bound = MIN(bound, MIN(p[a] - lo, hi - p[a]));
+        if (c[a] - r + 1 > 0 || c[a] + r - 1 < grid->dims[a] - 1) covered = false;
+      }
+      if (covered || (bound > 0 && bound * bound >= best2)) break;
+    }
+
+    // the cells of ring r (Chebyshev distance r from c) inside the grid
+    int const k0 = MAX(0, c[2] - r), k1 = MIN(grid->dims[2] - 1, c[2] + r);
+    int const j0 = MAX(0, c[1] - r), j1 = MIN(grid->dims[1] - 1, c[1] + r);
+    int const i0 = MAX(0, c[0] - r), i1 = MIN(grid->dims[0] - 1, c[0] + r);
+    for (int k = k0; k <= k1; k++)
+      for (int j = j0; j <= j1; j++) {
+        bool const kj_shell = abs(k - c[2]) == r || abs(j - c[1]) == r;
+        if (kj_shell) {
+          for (int i = i0; i <= i1; i++) faceGridSearchCell(grid, i, j, k, p, &best2, &best_fno, best_bary);
+        }
+        else {
+          if (c[0] - r >= 0 && c[0] - r < grid->dims[0])
+            faceGridSearchCell(grid, c[0] - r, j, k, p, &best2, &best_fno, best_bary);
+          if (r > 0 && c[0] + r >= 0 && c[0] + r < grid->dims[0])
+            faceGridSearchCell(grid, c[0] + r, j, k, p, &best2, &best_fno, best_bary);
+        }
+      }
+  }
+
+  *pdist = best_fno >= 0 ? sqrt(best2) : max_dist;
+  if (bary)
+    for (int a = 0; a < 3; a++) bary[a] = best_bary[a];
+  return (best_fno);
+}
+
+
+int MRISmeasureDistancesToSurface(MRI_SURFACE *mris_src, int which_src,
+                                  MRI_SURFACE *mris_dst, int which_dst,
+                                  double max_dist,
+                                  float *dists,
+                                  int *fnos)
+{
+  MRIS_FACE_GRID *grid = MRISfaceGridAlloc(mris_dst, which_dst, 0);
+  int nmissing = 0;
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(guided) reduction(+ : nmissing)
+#endif
+  for (int vno = 0; vno < mris_src->nvertices; vno++) {
+    ROMP_PFLB_begin
+    VERTEX const *v = &mris_src->vertices[vno];
+    int fno = -1;
+    double dist = 0;
+    if (!v->ripflag) {
+      double x, y, z;
+      MRISvertexCoord2XYZ_double(v, which_src, &x, &y, &z);
+      double search_dist = max_dist;
+      if (mris_src == mris_dst) {
+        // two positions of the same surface: the vertex's own counterpart
+        // is on the other surface, so nothing farther has to be searched
+        double xd, yd, zd;
+        MRISvertexCoord2XYZ_double(v, which_dst, &xd, &yd, &zd);
+        double const counterpart_dist = sqrt(SQR(xd - x) + SQR(yd - y) + SQR(zd - z)) * (1 + 1e-6) + 1e-6;
+        if (counterpart_dist < search_dist) search_dist = counterpart_dist;
+      }
+      fno = MRISfaceGridClosestPoint(grid, x, y, z, search_dist, &dist, NULL);
+      if (fno < 0 && search_dist < max_dist)  // all the faces of the counterpart are ripped
+        fno = MRISfaceGridClosestPoint(grid, x, y, z, max_dist, &dist, NULL);
+      if (fno < 0) nmissing++;
+    }
+    dists[vno] = dist;
+    if (fnos) fnos[vno] = fno;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  MRISfaceGridFree(&grid);
+  return (nmissing);
+}
@@ -1492,6 +1492,247 @@ void mrisComputeTangentialSpringTerm(MRIS *mris, double l_spring)
 }
 
 
+/*-----------------------------------------------------
+  The spring, Laplacian, normalized spring, normal spring and tangential
+  spring terms all start from the same sum over the 1-hop neighbours, so
+  one pass over the vertices computes all of the enabled ones. Each term
+  is added to dx/dy/dz the same way its own mrisCompute...Term adds it.
+  The normalized spring term still needs a second pass to remove the
+  average normal component.
+  ------------------------------------------------------*/
+static void mrisComputeSpringTermsFused(
+    MRIS *mris, double l_spring, double l_spring_norm, double l_nspring, double l_tspring, double l_lap)
+{
+  float dist_scale_init;
+#if METRIC_SCALE
+  if (mris->patch) {
+    dist_scale_init = 1.0;
+  }
+  else {
+    dist_scale_init = sqrt(mris->orig_area / mris->total_area);
+  }
+#else
+  dist_scale_init = 1.0;
+#endif
+  const float dist_scale = dist_scale_init;
+
+  // per-vertex contributions to the average normal component, summed
+  // serially below so the result does not depend on the thread count
+  double *dots = NULL;
+  if (!FZERO(l_spring_norm)) {
+    dots = (double *)calloc(mris->nvertices, sizeof(double));
+  }
+
+  int vno;
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
+
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX                * const v  = &mris->vertices         [vno];
+    if (v->ripflag) {
+      ROMP_PFLB_continue;
+    }
+    if (vno == Gdiag_no) {
+      DiagBreak();
+    }
+
+    // the spring, tangential spring and Laplacian terms leave these alone
+    bool const border = v->border && !v->neg;
+    bool const do_lap = !FZERO(l_lap) && !border;
+
+    float const x = v->x, y = v->y, z = v->z;
+    float const vx = v->x - v->t2x, vy = v->y - v->t2y, vz = v->z - v->t2z;
+
+    float sx = 0.0, sy = 0.0, sz = 0.0;
+    float lx = 0.0, ly = 0.0, lz = 0.0;
+    int n = 0;
+    int m;
+    for (m = 0; m < vt->vnum; m++) {
+      VERTEX const * const vn = &mris->vertices[vt->v[m]];
+      if (vn->ripflag) continue;
+
+      sx += vn->x - x;
+      sy += vn->y - y;
+      sz += vn->z - z;
+      if (do_lap) {
+        float const vnx = vn->x - vn->t2x, vny = vn->y - vn->t2y, vnz = vn->z - vn->t2z;
+        lx += (vnx - vx);
+        ly += (vny - vy);
+        lz += (vnz - vz);
+      }
+      n++;
+    }
+
+    float const dx0 = v->dx, dy0 = v->dy, dz0 = v->dz;
+
+    if (!FZERO(l_spring) && !border) {
+      float tx = sx, ty = sy, tz = sz;
+      if (n > 0) {
+        tx = dist_scale * tx / n;
+        ty = dist_scale * ty / n;
+        tz = dist_scale * tz / n;
+      }
+      tx *= l_spring;
+      ty *= l_spring;
+      tz *= l_spring;
+      v->dx += tx;
+      v->dy += ty;
+      v->dz += tz;
+    }
+
+    if (do_lap) {
+      if (n > 0) {
+        lx = lx * l_lap / n;
+        ly = ly * l_lap / n;
+        lz = lz * l_lap / n;
+      }
+      v->dx += lx;
+      v->dy += ly;
+      v->dz += lz;
+    }
+
+    if (!FZERO(l_spring_norm) && n > 0) {
+      float const multiplier = dist_scale / n;
+      float const tx = sx * multiplier, ty = sy * multiplier, tz = sz * multiplier;
+      dots[vno] = l_spring_norm * (v->nx * tx + v->ny * ty + v->nz * tz);
+      v->dx += l_spring_norm * tx;
+      v->dy += l_spring_norm * ty;
+      v->dz += l_spring_norm * tz;
+    }
+
+    if (!FZERO(l_nspring) || (!FZERO(l_tspring) && !border)) {
+      float ax = sx, ay = sy, az = sz;
+      if (n > 0) {
+        ax /= n;
+        ay /= n;
+        az /= n;
+      }
+      float const nx = v->nx, ny = v->ny, nz = v->nz;
+
+      // project onto normal
+      float const nc = ax * nx + ay * ny + az * nz;
+
+      if (!FZERO(l_nspring)) {
+        float const dx = l_nspring * nc * nx, dy = l_nspring * nc * ny, dz = l_nspring * nc * nz;
+        v->dx += dx;
+        v->dy += dy;
+        v->dz += dz;
+      }
+      if (!FZERO(l_tspring) && !border) {
+        float const dx = l_tspring * (ax - nc * nx), dy = l_tspring * (ay - nc * ny), dz = l_tspring * (az - nc * nz);
+        v->dx += dx;
+        v->dy += dy;
+        v->dz += dz;
+      }
+    }
+
+    if (vno == Gdiag_no)
+      fprintf(stdout, "v %d spring terms:        (%2.3f, %2.3f, %2.3f)\n", vno, v->dx - dx0, v->dy - dy0, v->dz - dz0);
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  if (FZERO(l_spring_norm)) {
+    return;
+  }
+
+  double dot_total = 0.0;
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    dot_total += dots[vno];
+  }
+  free(dots);
+
+  float const dot_avg = dot_total / (double)MRISvalidVertices(mris);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
+
+    VERTEX *v = &mris->vertices[vno];
+    if (v->ripflag) {
+      continue;
+    }
+
+    v->dx -= dot_avg * v->nx;
+    v->dy -= dot_avg * v->ny;
+    v->dz -= dot_avg * v->nz;
+
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+}
+
+
+/*-----------------------------------------------------
+  Adds the spring, Laplacian, normalized spring, normal spring and
+  tangential spring terms in one pass. Same result as calling
+  mrisComputeSpringTerm, mrisComputeLaplacianTerm,
+  mrisComputeNormalizedSpringTerm, mrisComputeNormalSpringTerm and
+  mrisComputeTangentialSpringTerm with these weights, which is checked
+  when FREESURFER_checkFusedTerms is set in the environment.
+  ------------------------------------------------------*/
+int mrisComputeSpringTerms(
+    MRIS *mris, double l_spring, double l_spring_norm, double l_nspring, double l_tspring, double l_lap)
+{
+  if (FZERO(l_spring) && FZERO(l_spring_norm) && FZERO(l_nspring) && FZERO(l_tspring) && FZERO(l_lap)) {
+    return (NO_ERROR);
+  }
+
+  if (!mrisCheckFusedTerms()) {
+    mrisComputeSpringTermsFused(mris, l_spring, l_spring_norm, l_nspring, l_tspring, l_lap);
+    return (NO_ERROR);
+  }
+
+  int const nvertices = mris->nvertices;
+  float *before = (float *)malloc(3 * nvertices * sizeof(float));
+  float *fused  = (float *)malloc(3 * nvertices * sizeof(float));
+  int vno;
+  for (vno = 0; vno < nvertices; vno++) {
+    VERTEX const * const v = &mris->vertices[vno];
+    before[3*vno] = v->dx; before[3*vno+1] = v->dy; before[3*vno+2] = v->dz;
+  }
+
+  mrisComputeSpringTermsFused(mris, l_spring, l_spring_norm, l_nspring, l_tspring, l_lap);
+  for (vno = 0; vno < nvertices; vno++) {
+    VERTEX * const v = &mris->vertices[vno];
+    fused[3*vno] = v->dx; fused[3*vno+1] = v->dy; fused[3*vno+2] = v->dz;
+    v->dx = before[3*vno]; v->dy = before[3*vno+1]; v->dz = before[3*vno+2];
+  }
+
+  mrisComputeSpringTerm          (mris, l_spring);
+  mrisComputeLaplacianTerm       (mris, l_lap);
+  mrisComputeNormalizedSpringTerm(mris, l_spring_norm);
+  mrisComputeNormalSpringTerm    (mris, l_nspring);
+  mrisComputeTangentialSpringTerm(mris, l_tspring);
+
+  double max_diff = 0.0;
+  int max_vno = -1;
+  for (vno = 0; vno < nvertices; vno++) {
+    VERTEX * const v = &mris->vertices[vno];
+    double const diff = MAX(MAX(fabs(v->dx - fused[3*vno]), fabs(v->dy - fused[3*vno+1])), fabs(v->dz - fused[3*vno+2]));
+    if (diff > max_diff) {
+      max_diff = diff;
+      max_vno = vno;
+    }
+    v->dx = fused[3*vno]; v->dy = fused[3*vno+1]; v->dz = fused[3*vno+2];
+  }
+  fprintf(stdout, "%s:%d fused spring terms differ from the single terms by at most %g (vertex %d)\n",
+          __FILE__, __LINE__, max_diff, max_vno);
+
+  free(fused);
+  free(before);
+  return (NO_ERROR);
+}
+
+
 int mrisComputeNonlinearTangentialSpringTerm(MRI_SURFACE *mris, double l_spring, double min_dist)
 {
   int vno, m, n;
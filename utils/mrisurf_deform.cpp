@@ -307,8 +307,12 @@ public:
   
   bool canDo(int mris_status) { 
     switch (mris_status) {
-    //case MRIS_PARAMETERIZED_SPHERE: return true;
+    case MRIS_PARAMETERIZED_SPHERE: return true;
     case MRIS_SPHERE:               return true;
+    // the MRIS projector does nothing for these
+    case MRIS_SURFACE:              return true;
+    case MRIS_PATCH:                return true;
+    case MRIS_UNORIENTED_SPHERE:    return true;
     default:;
     }
     static int shown = 0;
@@ -322,10 +326,13 @@ public:
   
   void project(MRIS_MP* mris_mp) {
     switch (mris_mp->status) {
+      case MRIS_PARAMETERIZED_SPHERE:
       case MRIS_SPHERE:   MRISprojectOntoSphere(mris_mp, mris_mp->radius);  break;
-      default: break;
+      case MRIS_SURFACE:
+      case MRIS_PATCH:
+      case MRIS_UNORIENTED_SPHERE: break;
+      default: cheapAssert(!"mrisProjectSurface(MRIS_MP*) can not do this status");
     }
-    cheapAssert(false);
   }
   
 };
@@ -958,26 +965,59 @@ int MRISapplyGradient(MRIS* mris, double dt)
 
 
 struct MRIScomputeSSE_asThoughGradientApplied_ctx::Impl {
-  Impl() : inited(false), dx(nullptr), dy(nullptr), dz(nullptr) {}
+  Impl() : inited(false), canDoMP(false), dx(nullptr), dy(nullptr), dz(nullptr), best(nullptr), best_dt(0.0), best_sse(0.0) {}
   ~Impl() 
   {
+    // The copies share the inputs of orig, so they must go first
+    //
+    for (auto mp : scratch) { MRISMP_dtr(mp); delete mp; }
+    if (best) { MRISMP_dtr(best); delete best; }
+    if (inited) MRISMP_dtr(&orig);
     freeAndNULL(dx); freeAndNULL(dy); freeAndNULL(dz);
   }
   
   bool inited;
-  MRIS_MP curr, orig;
+  bool canDoMP;
+  MRIS_MP orig;
   float *dx, *dy, *dz;
+
+  std::vector<MRIS_MP*> scratch;        // reused for the probes
+  MRIS_MP* best;                        // the probe with the lowest sse so far, kept for MRISapplyGradient_asEvaluated
+  double   best_dt, best_sse;
   
-  void init(MRIS* mris) {
+  void init(MRIS* mris, INTEGRATION_PARMS* parms) {
     cheapAssert(!inited);
-    
-    MRISMP_ctr(&orig);
-    MRISMP_ctr(&curr);
+    inited = true;
 
+    // The probes compute the face angles for their positions, but the MRIS path sees the angles
+    // already in the MRIS (MRIScomputeMetricProperties does not write them back), so the angle
+    // terms would not give the same sse; leave them to the MRIS path
+    //
+    canDoMP = mrisProjectSurface_CanDo(mris->status) 
+           && MRIScomputeSSE_canDo((MRIS_MP*)nullptr, parms)
+           && FZERO(parms->l_angle) && FZERO(parms->l_pangle)
+           && (mris->dist_alloced_flags & 1);
+    if ((mris->status == MRIS_SPHERE || mris->status == MRIS_PARAMETERIZED_SPHERE) && FZERO(mris->radius)) canDoMP = false;
+    for (int vno = 0; canDoMP && vno < mris->nvertices; vno++) {
+      if (!mris->vertices[vno].dist) canDoMP = false;
+    }
+    if (!canDoMP) return;
+
+    MRISMP_ctr(&orig);
     MRISmemalignNFloats(mris->nvertices, &dx, &dy, &dz);
-    MRISMP_load(&orig, mris, true, dx,dy,dz);               // needs to load the outputs because those are inputs to ProjectSurface
-      
-    inited = true;
+    MRISMP_load(&orig, mris, true, dx,dy,dz);               // loads the dist so the copies get their own dist buffers
+    orig.v_dx = dx; orig.v_dy = dy; orig.v_dz = dz;         // not in the lists, so MRISMP_dtr leaves them alone
+  }
+
+  MRIS_MP* getScratch() {
+    if (scratch.empty()) {
+      MRIS_MP* mp = new MRIS_MP;
+      MRISMP_ctr(mp);
+      return mp;
+    }
+    MRIS_MP* mp = scratch.back();
+    scratch.pop_back();
+    return mp;
   }
 };
 
@@ -992,55 +1032,125 @@ MRIScomputeSSE_asThoughGradientApplied_ctx::~MRIScomputeSSE_asThoughGradientAppl
   delete _impl;
 }
 
-double MRIScomputeSSE_asThoughGradientApplied(
+
+static double MRIScomputeSSE_asThoughGradientApplied_old(
   MRIS*              mris, 
   double             delta_t, 
+  INTEGRATION_PARMS* parms)
+{
+  MRISapplyGradient(mris, delta_t);
+  mrisProjectSurface(mris);
+  MRIScomputeMetricProperties(mris);
+  double const sse = MRIScomputeSSE(mris, parms);
+
+  MRISrestoreOldPositions(mris);
+  return sse;
+}
+
+
+void MRIScomputeSSE_asThoughGradientApplied(
+  MRIS*              mris, 
+  int                n,
+  double const *     delta_t, 
+  double *           sse,
   INTEGRATION_PARMS* parms,
   MRIScomputeSSE_asThoughGradientApplied_ctx& ctx)
 {
-  bool const canUseNewBehaviour = mrisProjectSurface_CanDo(mris->status) && MRIScomputeSSE_canDo((MRIS_MP*)nullptr,parms);
+  auto & ctxImpl = *ctx._impl;
+  if (!ctxImpl.inited) ctxImpl.init(mris, parms);
 
-  bool useOldBehaviour = !!getenv("FREESURFER_OLD_MRIScomputeSSE_asThoughGradientApplied");
-  bool useNewBehaviour = !!getenv("FREESURFER_NEW_MRIScomputeSSE_asThoughGradientApplied") || !useOldBehaviour;
+  static bool const useOldBehaviour = !!getenv("FREESURFER_OLD_MRIScomputeSSE_asThoughGradientApplied");
+  static bool const useNewBehaviour = !!getenv("FREESURFER_NEW_MRIScomputeSSE_asThoughGradientApplied") || !useOldBehaviour;
 
-  useNewBehaviour = false;
-  
-  if (!canUseNewBehaviour) {
-    useNewBehaviour = false;
-    useOldBehaviour = true;
+  if (!ctxImpl.canDoMP || !useNewBehaviour) {
+    for (int i = 0; i < n; i++) sse[i] = MRIScomputeSSE_asThoughGradientApplied_old(mris, delta_t[i], parms);
+    return;
   }
-  
-  double new_result = 0.0;
-  if (useNewBehaviour) {
-    auto & ctxImpl = *ctx._impl;
-    
-    if (!ctxImpl.inited) ctxImpl.init(mris);
-    
-    MRISMP_copy(&ctxImpl.curr, &ctxImpl.orig, 
-      false,  // needs to copy the outputs because those are inputs to ProjectSurface
-      true);  // no need to copy v_x[*] etc. because they are obtained by the translate_along_vertex_dxdydxz below
 
-    MRIStranslate_along_vertex_dxdydz(&ctxImpl.orig, &ctxImpl.curr, delta_t);
-    mrisProjectSurface(&ctxImpl.curr);
-    MRIScomputeMetricProperties(&ctxImpl.curr);
-    new_result = MRIScomputeSSE(&ctxImpl.curr, parms);
+  // Each probe moves its own copy of the surface, so the probes are independent and can be done in parallel
+  // The copies are made serially because the first ones may take their dist buffers from the underlying MRIS
+  //
+  std::vector<MRIS_MP*> probes(n);
+  for (int i = 0; i < n; i++) {
+    probes[i] = ctxImpl.getScratch();
+    MRISMP_copy(probes[i], &ctxImpl.orig, false, false);
   }
 
-  double old_result = 0.0;
-  if (useOldBehaviour) {
-    MRISapplyGradient(mris, delta_t);
-    mrisProjectSurface(mris);
-    MRIScomputeMetricProperties(mris);
-    old_result = MRIScomputeSSE(mris, parms);
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP2(n > 1, assume_reproducible)
+#endif
+  for (int i = 0; i < n; i++) {
+    ROMP_PFLB_begin
+    MRIS_MP* const curr = probes[i];
+    MRIStranslate_along_vertex_dxdydz(curr, &ctxImpl.orig, delta_t[i]);
+    mrisProjectSurface(curr);
+    MRIScomputeMetricProperties(curr);
+    sse[i] = MRIScomputeSSE(curr, parms);
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // Keep the lowest, so the caller does not have to recompute it if it chooses it
+  //
+  for (int i = 0; i < n; i++) {
+    if (!ctxImpl.best || sse[i] < ctxImpl.best_sse) {
+      std::swap(ctxImpl.best, probes[i]);
+      ctxImpl.best_dt  = delta_t[i];
+      ctxImpl.best_sse = sse[i];
+    }
+    if (probes[i]) ctxImpl.scratch.push_back(probes[i]);
+  }
 
-    MRISrestoreOldPositions(mris);
+  if (useOldBehaviour) {
+    for (int i = 0; i < n; i++) {
+      double const old_sse = MRIScomputeSSE_asThoughGradientApplied_old(mris, delta_t[i], parms);
+      if (fabs(old_sse - sse[i]) > 1e-6 * std::max(1.0, fabs(old_sse))) {
+        fprintf(stdout, "%s:%d MRIScomputeSSE_asThoughGradientApplied dt:%g old sse:%g new sse:%g\n", 
+          __FILE__, __LINE__, delta_t[i], old_sse, sse[i]);
+      }
+    }
   }
-  
-  if (useOldBehaviour && useNewBehaviour && (old_result != new_result)) {
-    cheapAssert(false);
+}
+
+
+double MRIScomputeSSE_asThoughGradientApplied(
+  MRIS*              mris, 
+  double             delta_t, 
+  INTEGRATION_PARMS* parms,
+  MRIScomputeSSE_asThoughGradientApplied_ctx& ctx)
+{
+  double sse;
+  MRIScomputeSSE_asThoughGradientApplied(mris, 1, &delta_t, &sse, parms, ctx);
+  return sse;
+}
+
+
+bool MRISapplyGradient_asEvaluated(
+  MRIS*              mris, 
+  double             delta_t, 
+  MRIScomputeSSE_asThoughGradientApplied_ctx& ctx,
+  double*            sse)
+{
+  auto & ctxImpl = *ctx._impl;
+  if (!ctxImpl.best || ctxImpl.best_dt != delta_t) return false;
+
+  // Same as MRISapplyGradient followed by mrisProjectSurface and MRIScomputeMetricProperties
+  //
+  MRISstoreCurrentPositions(mris);
+  MRISfreeDistsButNotOrig(mris);
+  MRISMP_unload(mris, ctxImpl.best, false);
+
+  // MRISMP_unload leaves the face angles alone, so they would be those of the surface before
+  // the step; the probe has them for the new positions, use those
+  //
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    if (ctxImpl.best->f_ripflag[fno]) continue;
+    copyAnglesPerTriangle(mris->faces[fno].angle, ctxImpl.best->f_angle[fno]);
   }
-  
-  return useOldBehaviour ? old_result : new_result;
+
+  *sse = ctxImpl.best_sse;
+  return true;
 }
 
 /*-----------------------------------------------------
@@ -1899,18 +2009,15 @@ int mrisComputePositioningGradients(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
   MRISaverageGradients(mris, avgs);
 
   /* smoothness terms */
-  mrisComputeSpringTerm(mris, parms->l_spring);
-  mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
+  mrisComputeSpringTerms(mris, parms->l_spring, parms->l_spring_norm, parms->l_nspring, parms->l_tspring, 0.0);
   mrisComputeRepulsiveTerm(mris, parms->l_repulse, mht_v_current, mht_f_current);
   mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
   mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
   mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-  mrisComputeNormalSpringTerm(mris, parms->l_nspring);
   mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
   /*    mrisComputeAverageNormalTerm(mris, avgs, parms->l_nspring) ;*/
   /*    mrisComputeCurvatureTerm(mris, parms->l_curv) ;*/
   mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-  mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
   mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
 
   if (mht_v_orig) {
@@ -3014,7 +3121,7 @@ MRIS *MRISextractMainComponent(MRI_SURFACE *mris, int do_not_extract, int verbos
 {
   MRIS *mris_out;
 
-  int n, vn0, vn1, vn2, p, count, max_c, max_nbr, found, ncpt;
+  int n, vn0, vn1, vn2, p, count, max_c, max_nbr, ncpt;
   int nv, ne, nf, nX, tX, tv, te, tf;
   float cx, cy, cz;
 
@@ -3027,6 +3134,12 @@ MRIS *MRISextractMainComponent(MRI_SURFACE *mris, int do_not_extract, int verbos
   if (verbose) {
     fprintf(WHICH_OUTPUT, "\ncounting number of connected components...");
   }
+  /* label the components breadth-first, numbered in the order of their
+     first vertex */
+  int *queue = (int *)malloc(MAX(mris->nvertices, 1) * sizeof(int));
+  if (queue == NULL) {
+    ErrorExit(ERROR_NOMEMORY, "MRISextractMainComponent: could not allocate queue");
+  }
   for (count = 0, vn0 = 0; vn0 < mris->nvertices; vn0++) {
     VERTEX                * const v  = &mris->vertices         [vn0];
     if (v->marked) {
@@ -3034,60 +3147,59 @@ MRIS *MRISextractMainComponent(MRI_SURFACE *mris, int do_not_extract, int verbos
     }
     count++;
     v->marked = count;
-    found = 1;
+    queue[0] = vn0;
+    int head = 0;
     ncpt = 1;
-    while (found) {
-      found = 0;
-      for (vn1 = 0; vn1 < mris->nvertices; vn1++) {
-        VERTEX_TOPOLOGY const * const vp1t = &mris->vertices_topology[vn1];
-        VERTEX                * const vp1  = &mris->vertices         [vn1];
-        if (vp1->marked) {
+    while (head < ncpt) {
+      VERTEX_TOPOLOGY const * const vp1t = &mris->vertices_topology[queue[head++]];
+      for (p = 0; p < vp1t->vnum; p++) {
+        vn2 = vp1t->v[p];
+        VERTEX * const vp2 = &mris->vertices[vn2];
+        if (vp2->marked) {
           continue;
         }
-        /* check neighbors */
-        for (p = 0; p < vp1t->vnum; p++) {
-          vn2 = vp1t->v[p];
-          VERTEX * const vp2 = &mris->vertices[vn2];
-          if (vp2->marked == count) {
-            vp1->marked = count;
-            found = 1;
-            ncpt++;
-            break;
-          }
-        }
+        vp2->marked = count;
+        queue[ncpt++] = vn2;
       }
     }
     if (max_nbr < ncpt) {
       max_c = count;
       max_nbr = ncpt;
     }
-    /* computing Euler Number of component */
-    ne = 0;
-    nv = 0;
-    cx = cy = cz = 0.0f;
-    for (vn1 = 0; vn1 < mris->nvertices; vn1++) {
-      VERTEX_TOPOLOGY const * const vp1t = &mris->vertices_topology[vn1];
-      VERTEX                * const vp1  = &mris->vertices         [vn1];
-      if (vp1->marked != count) {
-        continue;
-      }
-      ne += vp1t->vnum;
-      nv++;
-      cx += vp1->x;
-      cy += vp1->y;
-      cz += vp1->z;
-    }
-    cx /= nv;  // center of gravity
-    cy /= nv;
-    cz /= nv;
-    ne /= 2;  // half the number of edges
-    /* now counting faces */
-    nf = 0;
-    for (vn1 = 0; vn1 < mris->nfaces; vn1++) {
-      if (mris->vertices[mris->faces[vn1].v[0]].marked == count) {
-        nf++;
-      }
-    }
+  }
+  free(queue);
+
+  /* Euler number and center of gravity of each component, summed in
+     vertex order */
+  int *cnv = (int *)calloc(count + 1, sizeof(int));
+  int *cne = (int *)calloc(count + 1, sizeof(int));
+  int *cnf = (int *)calloc(count + 1, sizeof(int));
+  float *ccx = (float *)calloc(count + 1, sizeof(float));
+  float *ccy = (float *)calloc(count + 1, sizeof(float));
+  float *ccz = (float *)calloc(count + 1, sizeof(float));
+  if (!cnv || !cne || !cnf || !ccx || !ccy || !ccz) {
+    ErrorExit(ERROR_NOMEMORY, "MRISextractMainComponent: could not allocate %d components", count);
+  }
+  for (vn1 = 0; vn1 < mris->nvertices; vn1++) {
+    VERTEX_TOPOLOGY const * const vp1t = &mris->vertices_topology[vn1];
+    VERTEX          const * const vp1  = &mris->vertices         [vn1];
+    int const c = vp1->marked;
+    cne[c] += vp1t->vnum;
+    cnv[c]++;
+    ccx[c] += vp1->x;
+    ccy[c] += vp1->y;
+    ccz[c] += vp1->z;
+  }
+  for (vn1 = 0; vn1 < mris->nfaces; vn1++) {
+    cnf[mris->vertices[mris->faces[vn1].v[0]].marked]++;
+  }
+  for (n = 1; n <= count; n++) {
+    nv = cnv[n];
+    cx = ccx[n] / nv;  // center of gravity
+    cy = ccy[n] / nv;
+    cz = ccz[n] / nv;
+    ne = cne[n] / 2;  // half the number of edges
+    nf = cnf[n];
     nX = nv - ne + nf;
     tX += nX;
     tv += nv;
@@ -3096,8 +3208,8 @@ MRIS *MRISextractMainComponent(MRI_SURFACE *mris, int do_not_extract, int verbos
     if (verbose)
       fprintf(stderr,
               "\n   %d voxel in cpt #%d: X=%d [v=%d,e=%d,f=%d] located at (%f, %f, %f)",
-              ncpt,
-              count,
+              nv,
+              n,
               nX,
               nv,
               ne,
@@ -3106,6 +3218,12 @@ MRIS *MRISextractMainComponent(MRI_SURFACE *mris, int do_not_extract, int verbos
               cy,
               cz);
   }
+  free(cnv);
+  free(cne);
+  free(cnf);
+  free(ccx);
+  free(ccy);
+  free(ccz);
   if (verbose) {
     fprintf(stderr, "\nFor the whole surface: X=%d [v=%d,e=%d,f=%d]", tX, tv, te, tf);
   }
@@ -5599,7 +5717,7 @@ double MRISshrinkFace(MRIS *surf, int faceno, double newareafraction)
   VERTEX_TOPOLOGY *vt;
   for(n=0; n < 3; n++){
     vt = &(surf->vertices_topology[f->v[n]]);
-    for(nthface = 0; nthface < vt->vnum; nthface++){
+    for(nthface = 0; nthface < vt->num; nthface++){
       facenolist[nfacenolist] = vt->f[nthface];
       nfacenolist++;
     }
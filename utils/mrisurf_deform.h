@@ -93,3 +93,22 @@ double MRIScomputeSSE_asThoughGradientApplied(
     INTEGRATION_PARMS* parms,
     MRIScomputeSSE_asThoughGradientApplied_ctx& ctx);     
 
+// Evaluates several steps at once, in parallel when the MRIS_MP code can compute the sse
+//
+void MRIScomputeSSE_asThoughGradientApplied(
+    MRIS*              mris, 
+    int                n,
+    double const *     delta_t, 
+    double *           sse,
+    INTEGRATION_PARMS* parms,
+    MRIScomputeSSE_asThoughGradientApplied_ctx& ctx);     
+
+// Does MRISapplyGradient, mrisProjectSurface and MRIScomputeMetricProperties by using the surface
+// already made for the lowest sse evaluated with this ctx.  Returns false, doing nothing, if delta_t is not that one
+//
+bool MRISapplyGradient_asEvaluated(
+    MRIS*              mris, 
+    double             delta_t, 
+    MRIScomputeSSE_asThoughGradientApplied_ctx& ctx,
+    double*            sse);
+
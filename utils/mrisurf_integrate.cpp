@@ -24,7 +24,7 @@
 
 
 static int mrisIntegrationEpoch     (MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_avgs);
-static double mrisLineMinimize      (MRI_SURFACE *mris, INTEGRATION_PARMS *parms);
+static double mrisLineMinimize      (MRI_SURFACE *mris, INTEGRATION_PARMS *parms, bool *projected = NULL);
 static double mrisLineMinimizeSearch(MRI_SURFACE *mris, INTEGRATION_PARMS *parms);
 
 /*-----------------------------------------------------*/
@@ -587,14 +587,13 @@ int MRISintegrate(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_averages)
 
     mrisComputeLaplacianTerm(mris, parms->l_lap);
     MRISaverageGradients(mris, n_averages);
-    mrisComputeSpringTerm(mris, parms->l_spring);
+    mrisComputeSpringTerms(mris, parms->l_spring, 0.0, 0.0, parms->l_tspring, 0.0);
     mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
     mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
     mrisComputeThicknessNormalTerm(mris, parms->l_thick_normal, parms);
     mrisComputeThicknessSpringTerm(mris, parms->l_thick_spring, parms);
     mrisComputeAshburnerTriangleTerm(mris, parms->l_ashburner_triangle, parms);
 
-    mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
     mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
     mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
     mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
@@ -613,13 +612,14 @@ int MRISintegrate(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_averages)
       MRIfree(&mri);
     }
 
+    bool projected = false;   /* set if the step has already been projected and its metric properties computed */
     switch (parms->integration_type) {
       case INTEGRATE_LM_SEARCH:
         delta_t = mrisLineMinimizeSearch(mris, parms);
         break;
       default:
       case INTEGRATE_LINE_MINIMIZE:
-        delta_t = mrisLineMinimize(mris, parms);
+        delta_t = mrisLineMinimize(mris, parms, &projected);
         break;
       case INTEGRATE_MOMENTUM:
         delta_t = MRISmomentumTimeStep(mris, parms->momentum, parms->dt, tol, parms->n_averages);
@@ -692,8 +692,10 @@ int MRISintegrate(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int n_averages)
       fprintf(stdout, "rotating brain by (%2.1f, %2.1f, %2.1f)\n", alpha, beta, gamma);
     }
 
-    mrisProjectSurface(mris);
-    MRIScomputeMetricProperties(mris);
+    if (!projected) {
+      mrisProjectSurface(mris);
+      MRIScomputeMetricProperties(mris);
+    }
     if (parms->remove_neg && mris->neg_area > 0) {
       INTEGRATION_PARMS p;
       //      printf("removing overlap with smoothing\n") ;
@@ -1683,8 +1685,10 @@ int MRISvectorRegister(MRI_SURFACE *mris,
   sampled points, including the predicted one.
   ------------------------------------------------------*/
 #define MAX_ENTRIES 100
-static double mrisLineMinimize(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
+static double mrisLineMinimize(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, bool *projected)
 {
+  if (projected) *projected = false;
+
   FILE *fp = NULL;
   if ((Gdiag & DIAG_WRITE) && DIAG_VERBOSE_ON) {
     char fname[STRLEN];
@@ -1743,8 +1747,9 @@ static double mrisLineMinimize(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
 
   double dt_in[MAX_ENTRIES], sse_out[MAX_ENTRIES];
   int N = 0;
+
+  MRIScomputeSSE_asThoughGradientApplied_ctx sseCtx;
   {
-    MRIScomputeSSE_asThoughGradientApplied_ctx sseCtx;
 
     double const starting_sse = MRIScomputeSSE(mris, parms);
 
@@ -1774,16 +1779,21 @@ static double mrisLineMinimize(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
     double min_delta = 0.0f; /* to get rid of compiler warning */
 
     /* pick starting step size */
+    /* the candidates are independent, so evaluate them together */
     double delta_t;
-    for (delta_t = min_dt; delta_t < max_dt; delta_t *= 10.0) {
-      double sse = MRIScomputeSSE_asThoughGradientApplied(mris, delta_t, parms, sseCtx);
-      
-      if (sse <= min_sse) /* new minimum found */
+    double start_dt[MAX_ENTRIES], start_sse[MAX_ENTRIES];
+    int nstart = 0;
+    for (delta_t = min_dt; delta_t < max_dt && nstart < MAX_ENTRIES; delta_t *= 10.0) {
+      start_dt[nstart++] = delta_t;
+    }
+    MRIScomputeSSE_asThoughGradientApplied(mris, nstart, start_dt, start_sse, parms, sseCtx);
+
+    for (int i = 0; i < nstart; i++) {
+      if (start_sse[i] <= min_sse) /* new minimum found */
       {
-        min_sse   = sse;
-        min_delta = delta_t;
+        min_sse   = start_sse[i];
+        min_delta = start_dt[i];
       }
-
     }
 
     if (FZERO(min_delta)) /* dt=0 is min starting point, look mag smaller */
@@ -1814,8 +1824,11 @@ static double mrisLineMinimize(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
     double const dt0 = min_delta - (min_delta / 2);
     double const dt2 = min_delta + (min_delta / 2);
   
-    double sse0 = MRIScomputeSSE_asThoughGradientApplied(mris, dt0, parms, sseCtx);
-    double sse2 = MRIScomputeSSE_asThoughGradientApplied(mris, dt2, parms, sseCtx);
+    double const bracket_dt[2] = { dt0, dt2 };
+    double bracket_sse[2];
+    MRIScomputeSSE_asThoughGradientApplied(mris, 2, bracket_dt, bracket_sse, parms, sseCtx);
+    double const sse0 = bracket_sse[0];
+    double const sse2 = bracket_sse[1];
 
     /* now fit a quadratic form to these values */
 
@@ -1951,6 +1964,12 @@ static double mrisLineMinimize(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
   else if (parms->flags & IPFLAG_MAXIMIZE_SPHERICAL_POSITIVE_AREA) {
     mrisApplyGradientPositiveAreaMaximizing(mris, dt_in[min_i]);
   }
+  else if (projected && mris->status != MRIS_PLANE) {
+    /* reuse the projected surface made when this dt was evaluated */
+    double sse;
+    *projected = MRISapplyGradient_asEvaluated(mris, dt_in[min_i], sseCtx, &sse);
+    if (!*projected) MRISapplyGradient(mris, dt_in[min_i]);
+  }
   else {
     MRISapplyGradient(mris, dt_in[min_i]);
   }
@@ -2030,33 +2049,34 @@ static double mrisLineMinimizeSearch(MRI_SURFACE *mris, INTEGRATION_PARMS *parms
   double min_sse = starting_sse;
 
   /* pick starting step size */
+  /* the candidates are independent, so evaluate them together */
   double min_delta = 0.0f; /* to get rid of compiler warning */
-  for (double delta_t = min_dt; delta_t < max_dt; delta_t *= 10.0) {
+  {
+    MRIScomputeSSE_asThoughGradientApplied_ctx sseCtx;
 
-    MRISapplyGradient(mris, delta_t);
-    mrisProjectSurface(mris);
-    MRIScomputeMetricProperties(mris);
-    double sse = MRIScomputeSSE(mris, parms);
-    MRISrestoreOldPositions(mris);
+    double start_dt[MAX_ENTRIES], start_sse[MAX_ENTRIES];
+    int nstart = 0;
+    for (double delta_t = min_dt; delta_t < max_dt && nstart < MAX_ENTRIES; delta_t *= 10.0) {
+      start_dt[nstart++] = delta_t;
+    }
+    MRIScomputeSSE_asThoughGradientApplied(mris, nstart, start_dt, start_sse, parms, sseCtx);
 
-    if (sse <= min_sse) /* new minimum found */
-    {
-      min_sse = sse;
-      min_delta = delta_t;
+    for (int i = 0; i < nstart; i++) {
+      if (start_sse[i] <= min_sse) /* new minimum found */
+      {
+        min_sse = start_sse[i];
+        min_delta = start_dt[i];
+      }
     }
-  }
 
-  if (FZERO(min_delta)) /* dt=0 is min starting point, look mag smaller */
-  {
-    min_delta = min_dt / 10.0; /* start at smallest step */
+    if (FZERO(min_delta)) /* dt=0 is min starting point, look mag smaller */
+    {
+      min_delta = min_dt / 10.0; /* start at smallest step */
 
-    MRISapplyGradient(mris, min_delta);
-    mrisProjectSurface(mris);
-    MRIScomputeMetricProperties(mris);
-    double sse = MRIScomputeSSE(mris, parms);
-    MRISrestoreOldPositions(mris);
+      double sse = MRIScomputeSSE_asThoughGradientApplied(mris, min_delta, parms, sseCtx);
 
-    min_sse = sse; 
+      min_sse = sse; 
+    }
   }
 
 
@@ -2807,7 +2827,8 @@ int MRISinflateBrain(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
       useOldBehaviour = false;
     }
   }
-  if (!useOldBehaviour) {
+  if (!useOldBehaviour && !parms->start_t) {
+    // a continuation (start_t > 0) keeps the reference distances of the run it continues
     MRISsetOriginalXYZfromXYZ(mris);
     mrisComputeOriginalVertexDistances(mris);
   }
@@ -2851,14 +2872,10 @@ int MRISinflateBrain(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
       mrisComputeExpansionTerm(mris, parms->l_expand);
 
       MRISaverageGradients(mris, n_averages);
-      mrisComputeNormalSpringTerm(mris, parms->l_nspring);
+      mrisComputeSpringTerms(mris, parms->l_spring, parms->l_spring_norm, parms->l_nspring, parms->l_tspring, parms->l_lap);
       mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-      mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
       mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
       mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
-      mrisComputeSpringTerm(mris, parms->l_spring);
-      mrisComputeLaplacianTerm(mris, parms->l_lap);
-      mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
       
       double delta_t;
       switch (parms->integration_type) {
@@ -3031,13 +3048,11 @@ int MRISinflateToSphere(MRI_SURFACE *mris, INTEGRATION_PARMS *parms)
       mrisComputeRepulsiveRatioTerm(mris, parms->l_repulse_ratio, mht_v_current);
       mrisComputeConvexityTerm(mris, parms->l_convex);
 
-      mrisComputeLaplacianTerm(mris, parms->l_lap);
+      mrisComputeSpringTerms(mris, 0.0, 0.0, 0.0, parms->l_tspring, parms->l_lap);
       mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-      mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
       mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
       MRISaverageGradients(mris, n_averages);
-      mrisComputeSpringTerm(mris, parms->l_spring);
-      mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
+      mrisComputeSpringTerms(mris, parms->l_spring, parms->l_spring_norm, 0.0, 0.0, 0.0);
       switch (parms->integration_type) {
         case INTEGRATE_LM_SEARCH:
           delta_t = mrisLineMinimizeSearch(mris, parms);
@@ -14,6 +14,9 @@
  * Reporting: freesurfer@nmr.mgh.harvard.edu
  *
  */
+#include <algorithm>
+#include <vector>
+
 #include "mrisurf_metricProperties.h"
 
 #include "mrisurf_MRIS.h"
@@ -29,6 +32,7 @@
 #include "surfgrad.h"
 
 #include "mrisurf_base.h"
+#include "mrisurf_closest.h"
 
 
 static int int_compare(const void* lhs_ptr, const void* rhs_ptr) {
@@ -1872,6 +1876,468 @@ int MRIScomputeMetricProperties(MRIS *mris)
   return NO_ERROR;
 }
 
+
+// The steps of MRIScomputeMetricPropertiesIncremental, each doing for a few faces or vertices
+// what the full computation does for all of them
+//
+static void mrisSortUnique(std::vector<int> &list)
+{
+  std::sort(list.begin(), list.end());
+  list.erase(std::unique(list.begin(), list.end()), list.end());
+}
+
+// 0 if the faces are not oriented, 1 if oriented outward like an
+// ellipsoid, 2 if oriented along +z like a plane (see mrisOrientSurface)
+static int mrisMetricOrientation(MRIS const *mris)
+{
+  switch (mris->status) {
+    case MRIS_RIGID_BODY:
+    case MRIS_PARAMETERIZED_SPHERE:
+    case MRIS_SPHERE:
+    case MRIS_ELLIPSOID:
+    case MRIS_SPHERICAL_PATCH:
+      return 1;
+    case MRIS_PLANE:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// sums[0] the area counted in total_area, [1] the unsigned area, [2] and [3] neg_area and neg_orig_area
+static void mrisSumFaceAreas(MRIS *mris, std::vector<int> const &fnos, int orientation, double sums[4])
+{
+  sums[0] = sums[1] = sums[2] = sums[3] = 0.0;
+  for (int fno : fnos) {
+    FACE const * const face = &mris->faces[fno];
+    if (face->ripflag) continue;
+    sums[1] += fabs(face->area);
+    if (!orientation || face->area >= 0.0f) {
+      sums[0] += face->area;
+    }
+    else {
+      sums[2] += -face->area;
+      sums[3] += getFaceNorm(mris, fno)->orig_area;
+    }
+  }
+}
+
+// sum and sum of squares of the distances to the immediate neighbors, as in MRIScomputeAvgInterVertexDist
+static void mrisSumNeighborDistances(MRIS *mris, std::vector<int> const &vnos, double sums[2])
+{
+  sums[0] = sums[1] = 0.0;
+  for (int vno : vnos) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v  = &mris->vertices         [vno];
+    if (v->ripflag) continue;
+    for (int m = 0; m < vt->vnum; m++) {
+      if (mris->vertices[vt->v[m]].ripflag) continue;
+      double const d = v->dist[m];
+      sums[0] += d;
+      sums[1] += d * d;
+    }
+  }
+}
+
+// area, normal and angles of one face, as in MRIScomputeTriangleProperties and mrisOrientSurface
+static void mrisComputeFaceMetricProperties(MRIS *mris, int fno, int orientation)
+{
+  FACE * const face = &mris->faces[fno];
+  VERTEX const * const v0 = &mris->vertices[face->v[0]];
+  VERTEX const * const v1 = &mris->vertices[face->v[1]];
+  VERTEX const * const v2 = &mris->vertices[face->v[2]];
+
+  float const ax = v1->x - v0->x, ay = v1->y - v0->y, az = v1->z - v0->z;
+  float const bx = v2->x - v0->x, by = v2->y - v0->y, bz = v2->z - v0->z;
+  float nx = ay * bz - az * by;
+  float ny = az * bx - ax * bz;
+  float nz = ax * by - ay * bx;
+  float const len = sqrt(nx * nx + ny * ny + nz * nz);
+  float const scale = FZERO(len) ? 1.0f : 1.0f / len;
+  nx *= scale;
+  ny *= scale;
+  nz *= scale;
+  face->area = len * 0.5f;
+
+  for (int ano = 0; ano < ANGLES_PER_TRIANGLE; ano++) {
+    VERTEX const *vo, *va, *vb;
+    switch (ano) {
+      default:
+      case 0: vo = v0; va = v2; vb = v1; break;
+      case 1: vo = v1; va = v0; vb = v2; break;
+      case 2: vo = v2; va = v1; vb = v0; break;
+    }
+    float const ex = va->x - vo->x, ey = va->y - vo->y, ez = va->z - vo->z;
+    float const fx = vb->x - vo->x, fy = vb->y - vo->y, fz = vb->z - vo->z;
+    float const cross = nx * (fy * ez - fz * ey) + ny * (fz * ex - fx * ez) + nz * (fx * ey - fy * ex);
+    float const dot   = ex * fx + ey * fy + ez * fz;
+    face->angle[ano] = fastApproxAtan2f(cross, dot);
+  }
+
+  bool flip = false;
+  if (orientation == 1) {
+    float const dot = (v0->x + v1->x + v2->x) * nx + (v0->y + v1->y + v2->y) * ny + (v0->z + v1->z + v2->z) * nz;
+    flip = (dot < 0.0f);
+  }
+  else if (orientation == 2) {
+    flip = (nz < 0.0f);
+  }
+  if (flip) {
+    face->area *= -1.0f;
+    nx = -nx;
+    ny = -ny;
+    nz = -nz;
+    for (int ano = 0; ano < ANGLES_PER_TRIANGLE; ano++) face->angle[ano] *= -1.0f;
+  }
+  setFaceNorm(mris, fno, nx, ny, nz);
+}
+
+// normal and area of one vertex, as in MRIScomputeNormals, MRIScomputeTriangleProperties and
+// mrisOrientPlane. Returns false if the normal is degenerate.
+static bool mrisComputeVertexNormalAndArea(MRIS *mris, int vno, int orientation)
+{
+  VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+  VERTEX                * const v  = &mris->vertices         [vno];
+
+  float snorm[3] = {0, 0, 0};
+  float area = 0, unsigned_area = 0;
+  int count = 0;
+  for (int n = 0; n < vt->num; n++) {
+    FACE const * const face = &mris->faces[vt->f[n]];
+    if (face->ripflag) continue;
+    count++;
+    float norm[3];
+    mrisNormalFace(mris, vt->f[n], (int)vt->n[n], norm);
+    snorm[0] += norm[0];
+    snorm[1] += norm[1];
+    snorm[2] += norm[2];
+    area          += (orientation == 2) ? face->area : fabs(face->area);
+    unsigned_area += fabs(face->area);
+  }
+  if (count && !(mrisNormalize(snorm) > 0.0)) return false;
+
+  float const fix = fix_vertex_area ? 3.0 : 2.0;
+  if (v->origarea < 0) v->origarea = unsigned_area / fix;
+  v->area = area / fix;
+  v->nx = snorm[0];
+  v->ny = snorm[1];
+  v->nz = snorm[2];
+  if (orientation == 2) {
+    v->neg = (v->nz < 0);
+    if (v->neg) v->nz *= -1;
+  }
+  return true;
+}
+
+// distances from vno to its v[] neighbors, as in mrisComputeVertexDistances
+static void mrisComputeVertexDistancesAt(MRIS *mris, int vno, MRIS_Status_DistanceFormula formula)
+{
+  VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+  VERTEX                * const v  = &mris->vertices         [vno];
+
+  MRISmakeDist(mris, vno);
+  float * const dist = v->dist;
+
+  if (formula == MRIS_Status_DistanceFormula_0) {
+    for (int n = 0; n < vt->vtotal; n++) {
+      VERTEX const * const vn = &mris->vertices[vt->v[n]];
+      float const xd = v->x - vn->x, yd = v->y - vn->y, zd = v->z - vn->z;
+      dist[n] = sqrt(xd * xd + yd * yd + zd * zd);
+    }
+    return;
+  }
+
+  // arc length on the sphere through v
+  XYZ xyz, xyzn;
+  float radius, length;
+  XYZ_NORMALIZED_LOAD(&xyz, &radius, v->x, v->y, v->z);
+  for (int n = 0; n < vt->vtotal; n++) {
+    VERTEX const * const vn = &mris->vertices[vt->v[n]];
+    float d = 0.0;
+    if (!vn->ripflag) {
+      XYZ_NORMALIZED_LOAD(&xyzn, &length, vn->x, vn->y, vn->z);
+      if (!FZERO(length)) d = fabs(XYZApproxAngle_knownLength(&xyz, vn->x, vn->y, vn->z, length)) * radius;
+    }
+    dist[n] = d;
+  }
+}
+
+// What the incremental update keeps between calls: the number of neighbor pairs
+// MRIScomputeAvgInterVertexDist sums over, which only the topology and the ripped
+// vertices change, and the positions the properties were last computed for, so the
+// bounding box can be updated from the moved vertices alone
+//
+struct MRIS_INCREMENTAL_METRIC {
+  double N;
+  std::vector<float> x, y, z;
+};
+
+static void mrisIncrementalMetricSavePositions(MRIS *mris, MRIS_INCREMENTAL_METRIC *im)
+{
+  im->x.resize(mris->nvertices);
+  im->y.resize(mris->nvertices);
+  im->z.resize(mris->nvertices);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX const * const v = &mris->vertices[vno];
+    im->x[vno] = v->x;
+    im->y[vno] = v->y;
+    im->z[vno] = v->z;
+  }
+}
+
+/*-----------------------------------------------------------------
+  MRISallocIncrementalMetric() - the state for
+  MRIScomputeMetricPropertiesIncremental(). The metric properties must
+  be current, and the topology and the ripped vertices must not change
+  while it is in use. Free it with MRISfreeIncrementalMetric().
+  -----------------------------------------------------------------*/
+MRIS_INCREMENTAL_METRIC *MRISallocIncrementalMetric(MRIS *mris)
+{
+  MRIS_INCREMENTAL_METRIC * const im = new MRIS_INCREMENTAL_METRIC;
+
+  im->N = 0;
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    if (mris->vertices[vno].ripflag) continue;
+    for (int m = 0; m < vt->vnum; m++) {
+      if (!mris->vertices[vt->v[m]].ripflag) im->N += 1;
+    }
+  }
+  mrisIncrementalMetricSavePositions(mris, im);
+
+  return im;
+}
+
+void MRISfreeIncrementalMetric(MRIS_INCREMENTAL_METRIC **pim)
+{
+  delete *pim;
+  *pim = NULL;
+}
+
+static int mrisComputeMetricPropertiesNotIncremental(MRIS *mris, MRIS_INCREMENTAL_METRIC *im)
+{
+  int const result = MRIScomputeMetricProperties(mris);
+  mrisIncrementalMetricSavePositions(mris, im);
+  return result;
+}
+
+// as mrisComputeSurfaceDimensions, but only looks at the moved vertices unless one of them
+// was on a side of the box and moved inward, in which case that side is searched for again
+static void mrisUpdateSurfaceDimensions(MRIS *mris, MRIS_INCREMENTAL_METRIC *im, const int *vnos, int nvnos)
+{
+  float const lo0[3] = {mris->xlo, mris->ylo, mris->zlo};
+  float const hi0[3] = {mris->xhi, mris->yhi, mris->zhi};
+  float lo[3] = {lo0[0], lo0[1], lo0[2]};
+  float hi[3] = {hi0[0], hi0[1], hi0[2]};
+  bool rescan[3] = {false, false, false};
+
+  for (int i = 0; i < nvnos; i++) {
+    int const vno = vnos[i];
+    VERTEX * const v = &mris->vertices[vno];
+    float const oldp[3] = {im->x[vno], im->y[vno], im->z[vno]};
+    float const newp[3] = {v->x, v->y, v->z};
+    for (int k = 0; k < 3; k++) {
+      if ((oldp[k] == lo0[k] && newp[k] > lo0[k]) || (oldp[k] == hi0[k] && newp[k] < hi0[k])) rescan[k] = true;
+      if (newp[k] < lo[k]) lo[k] = newp[k];
+      if (newp[k] > hi[k]) hi[k] = newp[k];
+    }
+    im->x[vno] = v->x;
+    im->y[vno] = v->y;
+    im->z[vno] = v->z;
+  }
+
+  for (int k = 0; k < 3; k++) {
+    if (!rescan[k]) continue;
+    lo[k] = 10000;
+    hi[k] = -10000;
+    for (int vno = 0; vno < mris->nvertices; vno++) {
+      VERTEX const * const v = &mris->vertices[vno];
+      float const p = (k == 0) ? v->x : (k == 1) ? v->y : v->z;
+      if (p > hi[k]) hi[k] = p;
+      if (p < lo[k]) lo[k] = p;
+    }
+  }
+
+  mris->xlo = lo[0];
+  mris->xhi = hi[0];
+  mris->ylo = lo[1];
+  mris->yhi = hi[1];
+  mris->zlo = lo[2];
+  mris->zhi = hi[2];
+
+  mris->xctr = 0.5f * (float)((double)lo[0] + (double)hi[0]);
+  mris->yctr = 0.5f * (float)((double)lo[1] + (double)hi[1]);
+  mris->zctr = 0.5f * (float)((double)lo[2] + (double)hi[2]);
+}
+
+static bool mrisMetricPropertyDiffers(double incremental, double full)
+{
+  return fabs(incremental - full) > 1e-3 * (1.0 + fabs(full));
+}
+
+// recomputes a copy of the surface and reports where the incremental update disagrees with it
+static void mrisCheckMetricPropertiesIncremental(MRIS *mris)
+{
+  MRIS *full = MRISclone(mris);
+  MRIScomputeMetricProperties(full);
+  MRIScomputeTriangleProperties(full);  // the face angles
+
+  int nfaces = 0, nvertices = 0, ndists = 0, ntotals = 0;
+
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    FACE const * const f0 = &mris->faces[fno];
+    FACE const * const f1 = &full->faces[fno];
+    if (f0->ripflag) continue;
+    FaceNormCacheEntry const * const n0 = getFaceNorm(mris, fno);
+    FaceNormCacheEntry const * const n1 = getFaceNorm(full, fno);
+    double const vals0[7] = {f0->area, n0->nx, n0->ny, n0->nz, f0->angle[0], f0->angle[1], f0->angle[2]};
+    double const vals1[7] = {f1->area, n1->nx, n1->ny, n1->nz, f1->angle[0], f1->angle[1], f1->angle[2]};
+    for (int i = 0; i < 7; i++) {
+      if (mrisMetricPropertyDiffers(vals0[i], vals1[i])) {
+        if (nfaces++ < 10) fprintf(stdout, "%s:%d face %d value %d: incremental %g != %g\n", __FILE__, __LINE__, fno, i, vals0[i], vals1[i]);
+        break;
+      }
+    }
+  }
+
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v0 = &mris->vertices[vno];
+    VERTEX          const * const v1 = &full->vertices[vno];
+    if (v0->ripflag) continue;
+    double const vals0[4] = {v0->area, v0->nx, v0->ny, v0->nz};
+    double const vals1[4] = {v1->area, v1->nx, v1->ny, v1->nz};
+    for (int i = 0; i < 4; i++) {
+      if (mrisMetricPropertyDiffers(vals0[i], vals1[i])) {
+        if (nvertices++ < 10) fprintf(stdout, "%s:%d vertex %d value %d: incremental %g != %g\n", __FILE__, __LINE__, vno, i, vals0[i], vals1[i]);
+        break;
+      }
+    }
+    for (int n = 0; n < vt->vtotal; n++) {
+      if (mrisMetricPropertyDiffers(v0->dist[n], v1->dist[n]) && ndists++ < 10)
+        fprintf(stdout, "%s:%d vertex %d dist %d: incremental %g != %g\n", __FILE__, __LINE__, vno, n, v0->dist[n], v1->dist[n]);
+    }
+  }
+
+  double const totals0[] = {mris->total_area, mris->neg_area, mris->neg_orig_area, mris->avg_vertex_area,
+                            mris->avg_vertex_dist, mris->std_vertex_dist,
+                            mris->xlo, mris->xhi, mris->ylo, mris->yhi, mris->zlo, mris->zhi,
+                            mris->xctr, mris->yctr, mris->zctr};
+  double const totals1[] = {full->total_area, full->neg_area, full->neg_orig_area, full->avg_vertex_area,
+                            full->avg_vertex_dist, full->std_vertex_dist,
+                            full->xlo, full->xhi, full->ylo, full->yhi, full->zlo, full->zhi,
+                            full->xctr, full->yctr, full->zctr};
+  for (unsigned int i = 0; i < sizeof(totals0) / sizeof(totals0[0]); i++) {
+    if (mrisMetricPropertyDiffers(totals0[i], totals1[i])) {
+      ntotals++;
+      fprintf(stdout, "%s:%d total %d: incremental %g != %g\n", __FILE__, __LINE__, i, totals0[i], totals1[i]);
+    }
+  }
+
+  MRISfree(&full);
+
+  if (nfaces || nvertices || ndists || ntotals)
+    fprintf(stdout, "%s:%d MRIScomputeMetricPropertiesIncremental differs in %d faces, %d vertices, %d distances, %d totals\n",
+            __FILE__, __LINE__, nfaces, nvertices, ndists, ntotals);
+}
+
+/*-----------------------------------------------------------------
+  MRIScomputeMetricPropertiesIncremental() - updates the metric
+  properties after only the nvnos vertices in vnos have moved, instead
+  of recomputing the whole surface. The areas, normals and angles of
+  the faces of the moved vertices, the normals and areas of the
+  vertices of those faces and the distances to and from the moved
+  vertices are recomputed. total_area, neg_area, neg_orig_area,
+  avg_vertex_area, the inter-vertex distance statistics and the
+  bounding box are patched by the difference. The distance update
+  assumes ring neighborhoods, i.e. a moved vertex is in the v[] list of
+  every vertex that has it in its own. The properties must have been
+  current before the move, and im must come from
+  MRISallocIncrementalMetric() on this surface.
+
+  Falls back to MRIScomputeMetricProperties() when the distances are
+  not current, when a large part of the surface moved, or when a
+  vertex normal degenerates (the full computation jitters such
+  vertices apart).
+  With FREESURFER_CHECK_MRIScomputeMetricPropertiesIncremental set, a
+  copy of the surface is recomputed afterwards and every difference is
+  reported.
+  -----------------------------------------------------------------*/
+#define MAX_INCREMENTAL_FRACTION 0.1  // of the vertices, above which the full computation is faster
+
+int MRIScomputeMetricPropertiesIncremental(MRIS *mris, MRIS_INCREMENTAL_METRIC *im, const int *vnos, int nvnos)
+{
+  if (nvnos <= 0) return (NO_ERROR);
+
+  if (mris->dist_nsize != mris->nsize || nvnos > MAX_INCREMENTAL_FRACTION * mris->nvertices)
+    return mrisComputeMetricPropertiesNotIncremental(mris, im);
+
+  int const orientation = mrisMetricOrientation(mris);
+
+  // the faces of the moved vertices, the vertices of those faces (whose normals and areas change)
+  // and the moved vertices with their neighborhoods (whose distances change)
+  std::vector<int> fnos, avnos, dvnos;
+  for (int i = 0; i < nvnos; i++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vnos[i]];
+    fnos.insert(fnos.end(), vt->f, vt->f + vt->num);
+    dvnos.push_back(vnos[i]);
+    dvnos.insert(dvnos.end(), vt->v, vt->v + vt->vtotal);
+  }
+  mrisSortUnique(fnos);
+  for (int fno : fnos) {
+    FACE const * const face = &mris->faces[fno];
+    for (int n = 0; n < VERTICES_PER_FACE; n++) avnos.push_back(face->v[n]);
+  }
+  mrisSortUnique(avnos);
+  mrisSortUnique(dvnos);
+
+  double old_areas[4], old_dists[2];
+  mrisSumFaceAreas(mris, fnos, orientation, old_areas);
+  mrisSumNeighborDistances(mris, dvnos, old_dists);
+
+  for (int fno : fnos) {
+    if (!mris->faces[fno].ripflag) mrisComputeFaceMetricProperties(mris, fno, orientation);
+  }
+  for (int vno : avnos) {
+    if (mris->vertices[vno].ripflag) continue;
+    if (!mrisComputeVertexNormalAndArea(mris, vno, orientation)) return mrisComputeMetricPropertiesNotIncremental(mris, im);
+  }
+  MRIS_Status_DistanceFormula const formula = MRIS_Status_distanceFormula(mris->status);
+  for (int vno : dvnos) {
+    if (!mris->vertices[vno].ripflag) mrisComputeVertexDistancesAt(mris, vno, formula);
+  }
+
+  double new_areas[4], new_dists[2];
+  mrisSumFaceAreas(mris, fnos, orientation, new_areas);
+  mrisSumNeighborDistances(mris, dvnos, new_dists);
+
+  // the sphere statuses keep their analytic total_area
+  if (mris->status != MRIS_PARAMETERIZED_SPHERE && mris->status != MRIS_RIGID_BODY && mris->status != MRIS_SPHERE)
+    mris->total_area += new_areas[0] - old_areas[0];
+  if (orientation) {
+    mris->neg_area      += new_areas[2] - old_areas[2];
+    mris->neg_orig_area += new_areas[3] - old_areas[3];
+  }
+  mris->avg_vertex_area += (new_areas[1] - old_areas[1]) / mris->nvertices;
+
+  // recover the sums behind the distance mean and std, and patch them
+  double const N = im->N;
+  if (N > 1) {
+    double const avg  = mris->avg_vertex_dist, std = mris->std_vertex_dist;
+    double const sum  = avg * N + new_dists[0] - old_dists[0];
+    double const sum2 = std * std * (N - 1) + avg * avg * N + new_dists[1] - old_dists[1];
+    double const new_avg = sum / N;
+    mrisSetAvgInterVertexDist(mris, new_avg);
+    mris->std_vertex_dist = sqrt(MAX(0.0, N * (sum2 / N - new_avg * new_avg) / (N - 1)));
+  }
+
+  mrisUpdateSurfaceDimensions(mris, im, vnos, nvnos);
+
+  if (getenv("FREESURFER_CHECK_MRIScomputeMetricPropertiesIncremental")) mrisCheckMetricPropertiesIncremental(mris);
+
+  return (NO_ERROR);
+}
+
 // Convenience functions
 //
 int load_orig_triangle_vertices(MRIS *mris, int fno, double U0[3], double U1[3], double U2[3])
@@ -6737,14 +7203,91 @@ int MRIShistoThresholdCurvature(MRIS *mris, float thresh_pct)
 }
 
 
+/*
+  Scratch space of one thread for mrisThicknessNeighborhood().
+*/
+typedef struct
+{
+  std::vector<int> vlist;   // the neighborhood, the center first
+  std::vector<int> ring;    // link distance of each vlist entry from the center
+  std::vector<int> marked;  // per vertex, all 0 between calls
+} THICKNESS_NBHD;
+
+/*
+  Puts the unripped vertices within nbhd_size links of vno into
+  nbhd->vlist, vno first, in the order the closest vertex searches below
+  have always visited them, and returns how many there are. The marks are
+  kept in nbhd instead of v->marked, so that every thread can search its
+  own vertices. The serial searches skipped vertices that the caller had
+  left marked (eg by MRISremoveIntersections()) and cleared the marks as
+  they went, so their callers now clear the marks first: the results are
+  those of the serial searches on a surface without marks, and the marks
+  are left cleared as before.
+*/
+static int mrisThicknessNeighborhood(MRIS *mris, int vno, int nbhd_size, THICKNESS_NBHD *nbhd)
+{
+  std::vector<int> &vlist = nbhd->vlist, &ring = nbhd->ring, &marked = nbhd->marked;
+
+  if (marked.empty()) marked.assign(mris->nvertices, 0);
+  vlist.clear();
+  ring.clear();
+  vlist.push_back(vno);
+  ring.push_back(0);
+  marked[vno] = 1;
+
+  int vtotal = 1;
+  for (int ns = 1; ns <= nbhd_size; ns++) {
+    for (int i = 0; i < vtotal; i++) {
+      int const vn = vlist[i];
+      if (mris->vertices[vn].ripflag) {
+        continue;
+      }
+      if (marked[vn] && marked[vn] < ns - 1) {
+        continue;
+      }
+      VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vn];
+      for (int n = 0; n < vnt->vnum; n++) {
+        int const vn2 = vnt->v[n];
+        if (mris->vertices[vn2].ripflag || marked[vn2]) /* already processed */
+        {
+          continue;
+        }
+        vlist.push_back(vn2);
+        ring.push_back(ns);
+        marked[vn2] = ns;
+      }
+    }
+    vtotal = vlist.size();
+  }
+
+  for (int n = 0; n < vtotal; n++) {
+    marked[vlist[n]] = 0;
+  }
+  return (vtotal);
+}
+
+static void mrisPrintNbhdCounts(std::vector<int> const &min_ns, int nbhd_size)
+{
+  std::vector<int> nbr_count(nbhd_size + 1, 0);
+  for (size_t n = 0; n < min_ns.size(); n++) {
+    if (min_ns[n] >= 0) {
+      nbr_count[min_ns[n]]++;
+    }
+  }
+  for (int n = 0; n <= nbhd_size; n++) {
+    fprintf(stdout, "%d vertices at %d distance\n", nbr_count[n], n);
+  }
+}
+
+
 /*-----------------------------------------------------
   Parameters:
 
   Returns value:
 
   Description
-  Compute the cortical thickness at each vertex by measuring the
-  distance from it to the pial surface.
+  Find the closest pial vertex to each white vertex within nbhd_size
+  links, and put its number into v->curv.
 
   This routine assumes that the white matter surface is stored in
   ORIGINAL_VERTICES, and that the current vertex positions reflect
@@ -6753,90 +7296,61 @@ int MRIShistoThresholdCurvature(MRIS *mris, float thresh_pct)
 
 int MRISfindClosestOrigVertices(MRIS *mris, int nbhd_size)
 {
-  int vno, n, vlist[100000], vtotal, ns, i, vnum, nbr_count[100], min_n, min_vno;
-  float dx, dy, dz, dist, min_dist, nx, ny, nz, dot;
+  std::vector<int> min_ns(mris->nvertices, -1);
+  std::vector<THICKNESS_NBHD> nbhds(omp_get_max_threads());
 
-  memset(nbr_count, 0, 100 * sizeof(int));
+  MRISclearMarks(mris);  // see mrisThicknessNeighborhood()
 
   /* current vertex positions are gray matter, orig are white matter */
-  for (vno = 0; vno < mris->nvertices; vno++) {
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(guided)
+#endif
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
     VERTEX * const v = &mris->vertices[vno];
     if (v->ripflag) {
-      continue;
+      ROMP_PFLB_continue;
     }
-    nx = v->nx;
-    ny = v->ny;
-    nz = v->nz;
     if (vno == Gdiag_no) {
       DiagBreak();
     }
-    dx = v->x - v->origx;
-    dy = v->y - v->origy;
-    dz = v->z - v->origz;
-    min_dist = sqrt(dx * dx + dy * dy + dz * dz);
-    v->marked = 1;
-    vtotal = 1;
-    vlist[0] = vno;
-    min_n = 0;
-    min_vno = vno;
-    for (ns = 1; ns <= nbhd_size; ns++) {
-      vnum = 0; /* will be # of new neighbors added to list */
-      for (i = 0; i < vtotal; i++) {
-        VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vlist[i]];
-        VERTEX          const * const vn  = &mris->vertices         [vlist[i]];
-        if (vn->ripflag) {
-          continue;
-        }
-        if (vn->marked && vn->marked < ns - 1) {
-          continue;
-        }
-        for (n = 0; n < vnt->vnum; n++) {
-          VERTEX * const vn2 = &mris->vertices[vnt->v[n]];
-          if (vn2->ripflag || vn2->marked) /* already processed */
-          {
-            continue;
-          }
-          vlist[vtotal + vnum++] = vnt->v[n];
-          vn2->marked = ns;
-          dx = vn2->x - v->origx;
-          dy = vn2->y - v->origy;
-          dz = vn2->z - v->origz;
-          dot = dx * nx + dy * ny + dz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dot = vn2->nx * nx + vn2->ny * ny + vn2->nz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dist = sqrt(dx * dx + dy * dy + dz * dz);
-          if (dist < min_dist) {
-            min_n = ns;
-            min_dist = dist;
-            if (min_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, vnt->v[n], dist);
-            min_vno = vnt->v[n];
-          }
-        }
+    THICKNESS_NBHD * const nbhd = &nbhds[omp_get_thread_num()];
+    int const nlist = mrisThicknessNeighborhood(mris, vno, nbhd_size, nbhd);
+
+    float const nx = v->nx, ny = v->ny, nz = v->nz;
+    float dx = v->x - v->origx, dy = v->y - v->origy, dz = v->z - v->origz;
+    float min_dist = sqrt(dx * dx + dy * dy + dz * dz);
+    int min_n = 0, min_vno = vno;
+    for (int n = 1; n < nlist; n++) {
+      VERTEX const * const vn2 = &mris->vertices[nbhd->vlist[n]];
+      dx = vn2->x - v->origx;
+      dy = vn2->y - v->origy;
+      dz = vn2->z - v->origz;
+      if (dx * nx + dy * ny + dz * nz < 0) /* must be outwards from surface */
+      {
+        continue;
       }
-      vtotal += vnum;
-    }
-
-    nbr_count[min_n]++;
-    for (n = 0; n < vtotal; n++) {
-      VERTEX * const vn = &mris->vertices[vlist[n]];
-      if (vn->ripflag) {
+      if (vn2->nx * nx + vn2->ny * ny + vn2->nz * nz < 0) /* must be outwards from surface */
+      {
         continue;
       }
-      vn->marked = 0;
+      float const dist = sqrt(dx * dx + dy * dy + dz * dz);
+      if (dist < min_dist) {
+        min_n = nbhd->ring[n];
+        min_dist = dist;
+        if (min_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, nbhd->vlist[n], dist);
+        min_vno = nbhd->vlist[n];
+      }
     }
+
+    min_ns[vno] = min_n;
     v->curv = min_vno;  // BLETCH
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
-  for (n = 0; n <= nbhd_size; n++) {
-    fprintf(stdout, "%d vertices at %d distance\n", nbr_count[n], n);
-  }
+  mrisPrintNbhdCounts(min_ns, nbhd_size);
   return (NO_ERROR);
 }
 /*
@@ -6845,299 +7359,222 @@ int MRISfindClosestOrigVertices(MRIS *mris, int nbhd_size)
 */
 int MRISfindClosestPialVerticesCanonicalCoords(MRIS *mris, int nbhd_size)
 {
-  int vno, n, vlist[100000], vtotal, ns, i, vnum, nbr_count[100], min_n, min_vno;
-  float dx, dy, dz, dist, min_dist, nx, ny, nz, dot;
+  std::vector<int> min_ns(mris->nvertices, -1);
+  std::vector<THICKNESS_NBHD> nbhds(omp_get_max_threads());
 
-  memset(nbr_count, 0, 100 * sizeof(int));
+  MRISclearMarks(mris);  // see mrisThicknessNeighborhood()
 
-  for (vno = 0; vno < mris->nvertices; vno++) {
-    VERTEX * const v  = &mris->vertices         [vno];
+  // only the white and pial coordinates are searched, so v->[xyz] can be set as we go
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(guided)
+#endif
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
+    VERTEX * const v = &mris->vertices[vno];
     if (v->ripflag) {
-      continue;
+      ROMP_PFLB_continue;
     }
-    nx = v->wnx;
-    ny = v->wny;
-    nz = v->wnz;
     if (vno == Gdiag_no) {
       DiagBreak();
     }
-    dx = v->pialx - v->whitex;
-    dy = v->pialy - v->whitey;
-    dz = v->pialz - v->whitez;
-    min_dist = sqrt(dx * dx + dy * dy + dz * dz);
-    v->marked = 1;
-    vtotal = 1;
-    vlist[0] = vno;
-    min_n = 0;
-    min_vno = vno;
-    for (ns = 1; ns <= nbhd_size; ns++) {
-      vnum = 0; /* will be # of new neighbors added to list */
-      for (i = 0; i < vtotal; i++) {
-        VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vlist[i]];
-        VERTEX          const * const vn  = &mris->vertices         [vlist[i]];
-        if (vn->ripflag) {
-          continue;
-        }
-        if (vn->marked && vn->marked < ns - 1) {
-          continue;
-        }
-        for (n = 0; n < vnt->vnum; n++) {
-          VERTEX * const vn2 = &mris->vertices[vnt->v[n]];
-          if (vn2->ripflag || vn2->marked) /* already processed */
-          {
-            continue;
-          }
-          vlist[vtotal + vnum++] = vnt->v[n];
-          vn2->marked = ns;
-          dx = vn2->pialx - v->whitex;
-          dy = vn2->pialy - v->whitey;
-          dz = vn2->pialz - v->whitez;
-          dot = dx * nx + dy * ny + dz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dot = vn2->wnx * nx + vn2->wny * ny + vn2->wnz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dist = sqrt(dx * dx + dy * dy + dz * dz);
-          if (dist < min_dist) {
-            min_n = ns;
-            min_dist = dist;
-            if (min_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, vnt->v[n], dist);
-            min_vno = vnt->v[n];
-          }
-        }
+    THICKNESS_NBHD * const nbhd = &nbhds[omp_get_thread_num()];
+    int const nlist = mrisThicknessNeighborhood(mris, vno, nbhd_size, nbhd);
+
+    float const nx = v->wnx, ny = v->wny, nz = v->wnz;
+    float dx = v->pialx - v->whitex, dy = v->pialy - v->whitey, dz = v->pialz - v->whitez;
+    float min_dist = sqrt(dx * dx + dy * dy + dz * dz);
+    int min_n = 0, min_vno = vno;
+    for (int n = 1; n < nlist; n++) {
+      VERTEX const * const vn2 = &mris->vertices[nbhd->vlist[n]];
+      dx = vn2->pialx - v->whitex;
+      dy = vn2->pialy - v->whitey;
+      dz = vn2->pialz - v->whitez;
+      if (dx * nx + dy * ny + dz * nz < 0) /* must be outwards from surface */
+      {
+        continue;
       }
-      vtotal += vnum;
-    }
-
-    nbr_count[min_n]++;
-    for (n = 0; n < vtotal; n++) {
-      VERTEX * const vn = &mris->vertices[vlist[n]];
-      if (vn->ripflag) {
+      if (vn2->wnx * nx + vn2->wny * ny + vn2->wnz * nz < 0) /* must be outwards from surface */
+      {
         continue;
       }
-      vn->marked = 0;
+      float const dist = sqrt(dx * dx + dy * dy + dz * dz);
+      if (dist < min_dist) {
+        min_n = nbhd->ring[n];
+        min_dist = dist;
+        if (min_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, nbhd->vlist[n], dist);
+        min_vno = nbhd->vlist[n];
+      }
     }
+
+    min_ns[vno] = min_n;
     v->curv = min_vno;                  // BLETCH
     v->x = mris->vertices[min_vno].cx;
     v->y = mris->vertices[min_vno].cy;
     v->z = mris->vertices[min_vno].cz;
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
-  for (n = 0; n <= nbhd_size; n++) {
-    fprintf(stdout, "%d vertices at %d distance\n", nbr_count[n], n);
-  }
+  mrisPrintNbhdCounts(min_ns, nbhd_size);
   return (NO_ERROR);
 }
 
 
+/*-----------------------------------------------------
+  Parameters:
+
+  Returns value:
+
+  Description
+  Compute the cortical thickness at each vertex as the mean of the
+  distance from the white vertex to the closest pial vertex and from
+  the pial vertex to the closest white vertex, both searched within
+  nbhd_size links and limited to max_thick. The two searches share one
+  walk of the neighborhood, and the vertices are done in parallel.
+
+  This routine assumes that the white matter surface is stored in
+  ORIGINAL_VERTICES, and that the current vertex positions reflect
+  the pial surface.
+  ------------------------------------------------------*/
 int MRISmeasureCorticalThickness(MRIS *mris, int nbhd_size, float max_thick)
 {
-  int vno, n, vlist[100000], vtotal, ns, i, vnum, nbr_count[100], min_n, nwg_bad, ngw_bad;
-  float dx, dy, dz, dist, min_dist, nx, ny, nz, dot;
+  int nwg_bad = 0, ngw_bad = 0;
+  std::vector<int> min_ns(2 * mris->nvertices, -1);
+  std::vector<THICKNESS_NBHD> nbhds(omp_get_max_threads());
 
-  memset(nbr_count, 0, 100 * sizeof(int));
-  nwg_bad = ngw_bad = 0;
+  MRISclearMarks(mris);  // see mrisThicknessNeighborhood()
 
   /* current vertex positions are gray matter, orig are white matter */
-  for (vno = 0; vno < mris->nvertices; vno++) {
-    if (!(vno % 25000)) {
-      fprintf(stdout, "%d of %d vertices processed\n", vno, mris->nvertices);
-    }
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible) schedule(guided) reduction(+ : nwg_bad, ngw_bad)
+#endif
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
     VERTEX * const v = &mris->vertices[vno];
     if (v->ripflag) {
       v->curv = 0;
-      continue;
+      ROMP_PFLB_continue;
     }
     if (vno == Gdiag_no) {
       DiagBreak();
     }
-    nx = v->nx;
-    ny = v->ny;
-    nz = v->nz;
-    if (vno == Gdiag_no) {
-      DiagBreak();
-    }
-    dx = v->x - v->origx;
-    dy = v->y - v->origy;
-    dz = v->z - v->origz;
-    min_dist = sqrt(dx * dx + dy * dy + dz * dz);
-    v->marked = 1;
-    vtotal = 1;
-    vlist[0] = vno;
-    min_n = 0;
-    for (ns = 1; ns <= nbhd_size; ns++) {
-      vnum = 0; /* will be # of new neighbors added to list */
-      for (i = 0; i < vtotal; i++) {
-        VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vlist[i]];
-        VERTEX          const * const vn  = &mris->vertices         [vlist[i]];
-        if (vn->ripflag) {
-          continue;
-        }
-        if (vn->marked && vn->marked < ns - 1) {
-          continue;
-        }
-        for (n = 0; n < vnt->vnum; n++) {
-          VERTEX * const vn2 = &mris->vertices[vnt->v[n]];
-          if (vn2->ripflag || vn2->marked) /* already processed */
-          {
-            continue;
-          }
-          vlist[vtotal + vnum++] = vnt->v[n];
-          vn2->marked = ns;
-          dx = vn2->x - v->origx;
-          dy = vn2->y - v->origy;
-          dz = vn2->z - v->origz;
-          dot = dx * nx + dy * ny + dz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dot = vn2->nx * nx + vn2->ny * ny + vn2->nz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dist = sqrt(dx * dx + dy * dy + dz * dz);
-	  if(Gdiag_no == vno) {
-	    printf("vno=%d A %3d %6d (%g,%g,%g) (%g,%g,%g) %g %g\n",vno,n,vnt->v[n],v->origx,v->origy,v->origz,v->x,v->y,v->z,dist,min_dist);
-	  }
-          if (dist < min_dist) {
-            min_n = ns;
-            min_dist = dist;
-            if (min_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, vnt->v[n], dist);
-          }
-        }
-      }
-      vtotal += vnum;
-    }
-
-    nbr_count[min_n]++;
-    for (n = 0; n < vtotal; n++) {
-      VERTEX * const vn = &mris->vertices[vlist[n]];
-      if (vn->ripflag) {
+    THICKNESS_NBHD * const nbhd = &nbhds[omp_get_thread_num()];
+    int const nlist = mrisThicknessNeighborhood(mris, vno, nbhd_size, nbhd);
+
+    // white->gray (wg) is from this white vertex to the pial neighbors,
+    // gray->white (gw) from this pial vertex to the white neighbors
+    float const nx = v->nx, ny = v->ny, nz = v->nz;
+    float dx = v->x - v->origx, dy = v->y - v->origy, dz = v->z - v->origz;
+    float wg_dist = sqrt(dx * dx + dy * dy + dz * dz), gw_dist = wg_dist;
+    int wg_n = 0, gw_n = 0;
+    for (int n = 1; n < nlist; n++) {
+      VERTEX const * const vn2 = &mris->vertices[nbhd->vlist[n]];
+      if (vn2->nx * nx + vn2->ny * ny + vn2->nz * nz < 0) /* must be outwards from surface */
+      {
         continue;
       }
-      vn->marked = 0;
-    }
-    if (min_dist > max_thick) {
-      nwg_bad++;
-      min_dist = max_thick;
-    }
-    if (min_dist < 0) {
-      DiagBreak();
-    }
-    v->curv = min_dist;
-  }
 
-  for (vno = 0; vno < mris->nvertices; vno++) {
-    if (!(vno % 25000)) {
-      fprintf(stdout, "%d of %d vertices processed\n", vno, mris->nvertices);
-    }
-    VERTEX * const v = &mris->vertices[vno];
-    if (vno == Gdiag_no) {
-      DiagBreak();
-    }
-    if (v->ripflag) {
-      continue;
-    }
-    nx = v->nx;
-    ny = v->ny;
-    nz = v->nz;
-    if (vno == Gdiag_no) {
-      DiagBreak();
-    }
-    dx = v->x - v->origx;
-    dy = v->y - v->origy;
-    dz = v->z - v->origz;
-    min_dist = sqrt(dx * dx + dy * dy + dz * dz);
-    v->marked = 1;
-    vtotal = 1;
-    vlist[0] = vno;
-    min_n = 0;
-    for (ns = 1; ns <= nbhd_size; ns++) {
-      vnum = 0; /* will be # of new neighbors added to list */
-      for (i = 0; i < vtotal; i++) {
-        VERTEX_TOPOLOGY const * const vnt = &mris->vertices_topology[vlist[i]];
-        VERTEX          const * const vn  = &mris->vertices         [vlist[i]];
-        if (vn->ripflag) {
-          continue;
+      dx = vn2->x - v->origx;
+      dy = vn2->y - v->origy;
+      dz = vn2->z - v->origz;
+      if (dx * nx + dy * ny + dz * nz >= 0) /* must be outwards from surface */
+      {
+        float const dist = sqrt(dx * dx + dy * dy + dz * dz);
+        if (Gdiag_no == vno) {
+          printf("vno=%d A %3d %6d (%g,%g,%g) (%g,%g,%g) %g %g\n", vno, n, nbhd->vlist[n],
+                 v->origx, v->origy, v->origz, v->x, v->y, v->z, dist, wg_dist);
         }
-        if (vn->marked && vn->marked < ns - 1) {
-          continue;
+        if (dist < wg_dist) {
+          wg_n = nbhd->ring[n];
+          wg_dist = dist;
+          if (wg_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, nbhd->vlist[n], dist);
         }
-        for (n = 0; n < vnt->vnum; n++) {
-          VERTEX * const vn2 = &mris->vertices[vnt->v[n]];
-          if (vn2->ripflag || vn2->marked) /* already processed */
-          {
-            continue;
-          }
-          vlist[vtotal + vnum++] = vnt->v[n];
-          vn2->marked = ns;
-          dx = v->x - vn2->origx;
-          dy = v->y - vn2->origy;
-          dz = v->z - vn2->origz;
-          dot = dx * nx + dy * ny + dz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dot = vn2->nx * nx + vn2->ny * ny + vn2->nz * nz;
-          if (dot < 0) /* must be outwards from surface */
-          {
-            continue;
-          }
-          dist = sqrt(dx * dx + dy * dy + dz * dz);
-	  if(Gdiag_no == vno) {
-	    printf("vno=%d B %3d %6d (%g,%g,%g) (%g,%g,%g) %g %g\n",vno,n,vnt->v[n],vn2->origx,vn2->origy,vn2->origz,v->x,v->y,v->z,dist,min_dist);
-	  }
-          if (dist < min_dist) {
-            min_n = ns;
-            min_dist = dist;
-            if (min_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, vnt->v[n], dist);
-          }
+      }
+
+      dx = v->x - vn2->origx;
+      dy = v->y - vn2->origy;
+      dz = v->z - vn2->origz;
+      if (dx * nx + dy * ny + dz * nz >= 0) /* must be outwards from surface */
+      {
+        float const dist = sqrt(dx * dx + dy * dy + dz * dz);
+        if (Gdiag_no == vno) {
+          printf("vno=%d B %3d %6d (%g,%g,%g) (%g,%g,%g) %g %g\n", vno, n, nbhd->vlist[n],
+                 vn2->origx, vn2->origy, vn2->origz, v->x, v->y, v->z, dist, gw_dist);
+        }
+        if (dist < gw_dist) {
+          gw_n = nbhd->ring[n];
+          gw_dist = dist;
+          if (gw_n == nbhd_size && DIAG_VERBOSE_ON) fprintf(stdout, "%d --> %d = %2.3f\n", vno, nbhd->vlist[n], dist);
         }
       }
-      vtotal += vnum;
     }
 
-    nbr_count[min_n]++;
-    for (n = 0; n < vtotal; n++) {
-      VERTEX * const vn = &mris->vertices[vlist[n]];
-      if (vn->ripflag) {
-        continue;
-      }
-      vn->marked = 0;
+    min_ns[2 * vno] = wg_n;
+    min_ns[2 * vno + 1] = gw_n;
+    if (DIAG_VERBOSE_ON && fabs(wg_dist - gw_dist) > 4.0)
+      fprintf(stdout, "v %d, white->gray=%2.2f, gray->white=%2.2f\n", vno, wg_dist, gw_dist);
+    if (wg_dist > max_thick) {
+      nwg_bad++;
+      wg_dist = max_thick;
     }
-    if (DIAG_VERBOSE_ON && fabs(v->curv - min_dist) > 4.0)
-      fprintf(stdout, "v %d, white->gray=%2.2f, gray->white=%2.2f\n", vno, v->curv, min_dist);
-    if (min_dist > max_thick) {
-      min_dist = max_thick;
+    if (gw_dist > max_thick) {
       ngw_bad++;
+      gw_dist = max_thick;
     }
-    if (min_dist < 0) {
-      DiagBreak();
-    }
-    v->curv = (v->curv + min_dist) / 2;
-    if (v->curv < 0) {
-      DiagBreak();
+    v->curv = (wg_dist + gw_dist) / 2;
+    if (Gdiag_no == vno) {
+      printf("vno = %d, final measurment %g\n", vno, v->curv);
     }
-    if(Gdiag_no == vno) 
-      printf("vno = %d, final measurment %g\n",vno,v->curv);
+    ROMP_PFLB_end
   }
+  ROMP_PF_end
 
   fprintf(stdout, "thickness calculation complete, %d:%d truncations.\n", nwg_bad, ngw_bad);
-  for (n = 0; n <= nbhd_size; n++) {
-    fprintf(stdout, "%d vertices at %d distance\n", nbr_count[n], n);
-  }
+  mrisPrintNbhdCounts(min_ns, nbhd_size);
   return (NO_ERROR);
 }
 
 
+/*-----------------------------------------------------
+  Parameters:
+
+  Returns value:
+
+  Description
+  Compute the cortical thickness at each vertex as the mean of the
+  exact distance from the white vertex to the closest point of the pial
+  surface and from the pial vertex to the closest point of the white
+  surface (see mrisurf_closest.h), each limited to max_thick. Unlike
+  MRISmeasureCorticalThickness() the whole opposite surface is searched
+  and the closest point can be inside a face. Returns the number of
+  distances that were truncated.
+
+  This routine assumes that the white matter surface is stored in
+  ORIGINAL_VERTICES, and that the current vertex positions reflect
+  the pial surface.
+  ------------------------------------------------------*/
+int MRISmeasureCorticalThicknessClosestPoint(MRIS *mris, float max_thick)
+{
+  std::vector<float> wg_dists(mris->nvertices), gw_dists(mris->nvertices);
+
+  int const nwg_bad = MRISmeasureDistancesToSurface(mris, ORIGINAL_VERTICES, mris, CURRENT_VERTICES, max_thick, &wg_dists[0], NULL);
+  int const ngw_bad = MRISmeasureDistancesToSurface(mris, CURRENT_VERTICES, mris, ORIGINAL_VERTICES, max_thick, &gw_dists[0], NULL);
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX * const v = &mris->vertices[vno];
+    v->curv = v->ripflag ? 0 : (wg_dists[vno] + gw_dists[vno]) / 2;
+    if (vno == Gdiag_no) {
+      printf("vno = %d, white->gray=%2.3f, gray->white=%2.3f, final measurment %g\n",
+             vno, wg_dists[vno], gw_dists[vno], v->curv);
+    }
+  }
+
+  fprintf(stdout, "thickness calculation complete, %d:%d truncations.\n", nwg_bad, ngw_bad);
+  return (nwg_bad + ngw_bad);
+}
+
+
 /*-----------------------------------------------------
   Parameters:
 
@@ -8414,20 +8851,53 @@ int MRISwhiteVertexToVoxel(MRIS *mris, VERTEX *v, MRI *mri, double *pxv, double
 /*
   on calling, the white, pial and spherical locations must all be loaded, where the current coordinates (v->[xyz])
   indicate the correspondence between white and pial, and the canonical spherical ones v->c[xyz] have the ?h.sphere in
-  them.
+  them. With mht NULL the pial point is interpolated in the face of the sphere closest to v->[xyz] (see
+  mrisurf_closest.h) and the vertices are done in parallel, otherwise it is sampled with
+  MRISsampleFaceCoordsCanonical() in the given face table.
 */
 int MRISmeasureThicknessFromCorrespondence(MRIS *mris, MHT *mht, float max_thick)
 {
-  int vno, alloced;
+  int vno;
   VERTEX *v;
   float xw, yw, zw, dx, dy, dz, xp, yp, zp;
 
   if (mht == NULL) {
-    mht = MHTcreateFaceTable_Resolution(mris, CANONICAL_VERTICES, 1.0);  // to lookup closest face
-    alloced = 1;
+    MRIS_FACE_GRID *grid = MRISfaceGridAlloc(mris, CANONICAL_VERTICES, 0);
+
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) schedule(guided)
+#endif
+    for (int vno = 0; vno < mris->nvertices; vno++) {
+      ROMP_PFLB_begin
+      VERTEX * const v = &mris->vertices[vno];
+      if (v->ripflag) {
+        v->curv = 0;
+        ROMP_PFLB_continue;
+      }
+      if (vno == Gdiag_no) DiagBreak();
+      double dist, bary[3];
+      int const fno = MRISfaceGridClosestPoint(grid, v->x, v->y, v->z, 1e10, &dist, bary);
+      if (fno < 0) {
+        v->curv = 0;
+        ROMP_PFLB_continue;
+      }
+      FACE const * const face = &mris->faces[fno];
+      double xp = 0, yp = 0, zp = 0;
+      for (int n = 0; n < VERTICES_PER_FACE; n++) {
+        VERTEX const * const vn = &mris->vertices[face->v[n]];
+        xp += bary[n] * vn->pialx;
+        yp += bary[n] * vn->pialy;
+        zp += bary[n] * vn->pialz;
+      }
+      v->curv = MIN(max_thick, sqrt(SQR(xp - v->whitex) + SQR(yp - v->whitey) + SQR(zp - v->whitez)));
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+
+    MRISfaceGridFree(&grid);
+    return (NO_ERROR);
   }
-  else
-    alloced = 0;
 
   for (vno = 0; vno < mris->nvertices; vno++) {
     v = &mris->vertices[vno];
@@ -8444,8 +8914,6 @@ int MRISmeasureThicknessFromCorrespondence(MRIS *mris, MHT *mht, float max_thick
     v->curv = MIN(max_thick, sqrt(dx * dx + dy * dy + dz * dz));
   }
 
-  if (alloced) MHTfree(&mht);
-
   return (NO_ERROR);
 }
 
@@ -17,29 +17,40 @@ void MRISMP_ctr(MRIS_MP* mp) {
 }
 
 void MRISMP_dtr(MRIS_MP* mp) {
+  // A copy made by MRISMP_copy shares the inputs of its in_src, so it must not free them
+  //
+  cheapAssert(mp->in_ref_count == 0);
+  bool const owns_inputs = !mp->in_src;
+  if (mp->in_src) mp->in_src->in_ref_count--;
+
   // Faces
   //
 #define SEP
 #define ELTX(C,T,N) ELT(C,T,N)
 #define ELT(C,T,N) freeAndNULL(mp->f_##N);
-  MRIS_MP__LIST_F_IN SEP MRIS_MP__LIST_F_OUT
+  if (owns_inputs) { MRIS_MP__LIST_F_IN }
+  MRIS_MP__LIST_F_OUT
 #undef ELT
 #undef ELTX
 #undef SEP
 
   // Vertices
   //
-  if (mp->v_dist) {
+  // Each v_dist[vno] is either NULL or the same buffer as v_dist_buffer[vno], 
+  // which MRISfreeDistsButNotOrig keeps for reuse
+  //
+  if (mp->v_dist_buffer) {
     int vno;
     for (vno = 0; vno < mp->nvertices; vno++) {
-      freeAndNULL(mp->v_dist[vno]);
+      freeAndNULL(mp->v_dist_buffer[vno]);
     }
   }
     
 #define SEP
 #define ELTX(C,T,N) ELT(C,T,N)
 #define ELT(C,T,N) freeAndNULL(mp->v_##N);
-  MRIS_MP__LIST_V_IN SEP MRIS_MP__LIST_V_IN_OUT SEP MRIS_MP__LIST_V_OUT
+  if (owns_inputs) { MRIS_MP__LIST_V_IN }
+  MRIS_MP__LIST_V_IN_OUT SEP MRIS_MP__LIST_V_OUT
 #undef ELT
 #undef ELTX
 #undef SEP
@@ -48,7 +59,7 @@ void MRISMP_dtr(MRIS_MP* mp) {
 
   // MRIS
   //
-  {
+  if (owns_inputs) {
     // hack because mrisurf doesn't have a FACE_TOPOLOGY yet
     // When fixing, fix the dtr also!
     //
@@ -122,6 +133,8 @@ void MRISMP_copy(MRIS_MP* dst, MRIS_MP* src,
 #undef ELTX
 #undef SEP
 
+  bool const dst_is_fresh = !dst->v_dist_capacity;
+
 #define SEP
 #define ELTX(C,T,N) ELT(C,T,N)
 #define ELT(C,T,N) T* v_##N = (T*)realloc((void*)dst->v_##N, dst->nvertices*sizeof(T)); dst->v_##N = v_##N;
@@ -130,6 +143,8 @@ void MRISMP_copy(MRIS_MP* dst, MRIS_MP* src,
 #undef ELTX
 #undef SEP
 
+  if (dst_is_fresh) bzero(v_dist_capacity, dst->nvertices*sizeof(*v_dist_capacity));   // dst has no dist buffers of its own yet
+
   if (dst->status != MRIS_PLANE) { freeAndNULL(dst->v_neg); v_neg = NULL; }
 
   int vno;
@@ -28,6 +28,8 @@
 
 #include "mrisurf_base.h"
 
+#include <vector>
+
 int CBVfindFirstPeakD1 = 0;
 int CBVfindFirstPeakD2 = 0;
 CBV_OPTIONS CBVO;
@@ -613,7 +615,7 @@ int MRISpositionSurface(MRI_SURFACE *mris, MRI *mri_brain, MRI *mri_smooth, INTE
     mrisAverageSignedGradients(mris, avgs);
     /*mrisUpdateSulcalGradients(mris, parms) ;*/
     /* smoothness terms */
-    mrisComputeSpringTerm(mris, parms->l_spring);
+    mrisComputeSpringTerms(mris, parms->l_spring, parms->l_spring_norm, parms->l_nspring, parms->l_tspring, 0.0);
     if(parms->l_hinge > 0 || parms->l_spring_nzr > 0){
       if(mris->edges == NULL){
 	printf("First pass, creating edges\n");
@@ -636,17 +638,14 @@ int MRISpositionSurface(MRI_SURFACE *mris, MRI *mri_brain, MRI *mri_smooth, INTE
       printf("#@%% hinge cost weight=%g, cost = %g\n",parms->l_hinge,hingecost);
 
     }
-    mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
     mrisComputeRepulsiveTerm(mris, parms->l_repulse, mht_v_current, mht_f_current);
     mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
     mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
     mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-    mrisComputeNormalSpringTerm(mris, parms->l_nspring);
     mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
     /*mrisComputeAverageNormalTerm(mris, avgs, parms->l_nspring) ;*/
     /*mrisComputeCurvatureTerm(mris, parms->l_curv) ;*/
     mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-    mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
     mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
     mrisComputeMaxSpringTerm(mris, parms->l_max_spring);
     mrisComputeAngleAreaTerms(mris, parms);
@@ -967,17 +966,13 @@ int MRISpositionSurface_mef(
     /*                mrisUpdateSulcalGradients(mris, parms) ;*/
 
     /* smoothness terms */
-    mrisComputeSpringTerm(mris, parms->l_spring);
-    mrisComputeLaplacianTerm(mris, parms->l_lap);
-    mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
+    mrisComputeSpringTerms(mris, parms->l_spring, parms->l_spring_norm, parms->l_nspring, parms->l_tspring, parms->l_lap);
     mrisComputeRepulsiveTerm(mris, parms->l_repulse, mht_v_current, mht_f_current);
     mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
     mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
     mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-    mrisComputeNormalSpringTerm(mris, parms->l_nspring);
     mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
     mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-    mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
     mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
 
     do {
@@ -1620,6 +1615,418 @@ int CBV_OPTIONS::ReadAltBorderLowLabel(void)
   return(0);
 }
 
+/*
+  Volume sampling for MRIScomputeBorderValues_new().
+
+  The border search calls MRIsampleVolume() and MRIsampleVolumeDerivativeScale()
+  at every step along every normal, and the derivative alone samples the
+  volume up to two dozen times, each time recomputing its gaussian weights.
+  BorderSampler gives the search the same numbers more cheaply:
+  - the voxel type is fixed when the sampler is built and the contiguous
+    buffer is read directly, instead of a type switch and row pointers per
+    sample,
+  - the derivative taps (distances, weights, their totals) are worked out
+    once per sigma, and each derivative gathers its taps as one batch,
+  - the surface RAS to voxel transform is a local 3x4 float matrix, instead
+    of MatrixMultiply() on per-thread VECTORs.
+  Each of these evaluates the same expressions in the same order as the
+  mri.cpp functions, so the results are identical. MRIreplaceValues() is no
+  longer needed either: the 255s of a UCHAR volume are read as 0 by the
+  derivative. Volumes that cannot be read directly (not chunked, or LONG)
+  go through the mri.cpp functions as before, as does everything when
+  FREESURFER_BorderValues_old is set.
+*/
+namespace {
+
+class BorderVolume
+{
+public:
+  BorderVolume() {}
+  // outside_val is what MRIsampleVolume() returns outside the volume
+  BorderVolume(MRI *mri, bool direct, double outside_val, bool zero255);
+
+  static bool canRead(const MRI *mri);
+  bool direct() const { return data != NULL; }
+
+  // MRIsampleVolume(mri, x, y, z, &val)
+  double sample(double x, double y, double z) const;
+  // the same for n points
+  void sample(int n, const double *x, const double *y, const double *z, double *val) const;
+
+  MRI *mri = NULL;
+
+private:
+  template <typename T, bool Zero255> static double value(T val);
+  template <typename T, bool Zero255> double voxel(int x, int y, int z) const;
+  template <typename T, bool Zero255> double sampleT(double x, double y, double z) const;
+  template <typename T, bool Zero255> void sampleN(int n, const double *x, const double *y, const double *z, double *val) const;
+  int notInVolume(double col, double row, double slice) const;
+
+  const void *data = NULL;
+  int type = 0;
+  bool zero255 = false;
+  int width = 0, height = 0, depth = 0;
+  size_t vox_per_row = 0, vox_per_slice = 0;
+  double outside_val = 0;
+};
+
+bool BorderVolume::canRead(const MRI *mri)
+{
+  if (!mri->ischunked || !mri->chunk) return false;
+  return mri->type == MRI_UCHAR || mri->type == MRI_SHORT || mri->type == MRI_INT || mri->type == MRI_FLOAT;
+}
+
+BorderVolume::BorderVolume(MRI *mri, bool direct, double outside_val, bool zero255)
+  : mri(mri), type(mri->type), zero255(zero255 && mri->type == MRI_UCHAR),
+    width(mri->width), height(mri->height), depth(mri->depth),
+    vox_per_row(mri->vox_per_row), vox_per_slice(mri->vox_per_slice), outside_val(outside_val)
+{
+  if (direct && canRead(mri)) data = mri->chunk;
+}
+
+// MRIindexNotInVolume()
+inline int BorderVolume::notInVolume(double col, double row, double slice) const
+{
+  if (col >= 0 && col <= width - 1 && row >= 0 && row <= height - 1 && slice >= 0 && slice <= depth - 1) return (0);
+
+  float nicol, nirow, nislice;
+  nicol = rint(col);
+  nirow = rint(row);
+  nislice = rint(slice);
+  if (nicol >= 0 && nicol < width && nirow >= 0 && nirow < height && nislice >= 0 && nislice < depth) return (-1);
+
+  return (1);
+}
+
+template <typename T, bool Zero255>
+inline double BorderVolume::value(T val)
+{
+  if (Zero255 && val == 255) val = 0;
+  return (double)val;
+}
+
+template <typename T, bool Zero255>
+inline double BorderVolume::voxel(int x, int y, int z) const
+{
+  return value<T, Zero255>(((const T *)data)[x + y * vox_per_row + z * vox_per_slice]);
+}
+
+template <typename T, bool Zero255>
+inline double BorderVolume::sampleT(double x, double y, double z) const
+{
+  if (FEQUAL((int)x, x) && FEQUAL((int)y, y) && FEQUAL((int)z, z)) {
+    // MRIsampleVolumeType(..., SAMPLE_NEAREST)
+    if (notInVolume(x, y, z) == 1) return outside_val;
+    int xv = nint(x), yv = nint(y), zv = nint(z);
+    if (xv < 0) xv = 0;
+    if (xv >= width) xv = width - 1;
+    if (yv < 0) yv = 0;
+    if (yv >= height) yv = height - 1;
+    if (zv < 0) zv = 0;
+    if (zv >= depth) zv = depth - 1;
+    return (float)voxel<T, Zero255>(xv, yv, zv);
+  }
+
+  if (notInVolume(x, y, z) == 1) return outside_val;
+
+  if (x >= width) x = width - 1.0;
+  if (y >= height) y = height - 1.0;
+  if (z >= depth) z = depth - 1.0;
+  if (x < 0.0) x = 0.0;
+  if (y < 0.0) y = 0.0;
+  if (z < 0.0) z = 0.0;
+
+  int const xm = MAX((int)x, 0);
+  int const xp = MIN(width - 1, xm + 1);
+  int const ym = MAX((int)y, 0);
+  int const yp = MIN(height - 1, ym + 1);
+  int const zm = MAX((int)z, 0);
+  int const zp = MIN(depth - 1, zm + 1);
+
+  double const xmd = x - (float)xm;
+  double const ymd = y - (float)ym;
+  double const zmd = z - (float)zm;
+  double const xpd = (1.0f - xmd);
+  double const ypd = (1.0f - ymd);
+  double const zpd = (1.0f - zmd);
+
+  const T *p = (const T *)data + xm + ym * vox_per_row + zm * vox_per_slice;
+  size_t const dx = xp - xm, dy = (yp - ym) * vox_per_row, dz = (zp - zm) * vox_per_slice;
+
+  return xpd * ypd * zpd * value<T, Zero255>(p[0])       + xpd * ypd * zmd * value<T, Zero255>(p[dz]) +
+         xpd * ymd * zpd * value<T, Zero255>(p[dy])      + xpd * ymd * zmd * value<T, Zero255>(p[dy + dz]) +
+         xmd * ypd * zpd * value<T, Zero255>(p[dx])      + xmd * ypd * zmd * value<T, Zero255>(p[dx + dz]) +
+         xmd * ymd * zpd * value<T, Zero255>(p[dx + dy]) + xmd * ymd * zmd * value<T, Zero255>(p[dx + dy + dz]);
+}
+
+template <typename T, bool Zero255>
+void BorderVolume::sampleN(int n, const double *x, const double *y, const double *z, double *val) const
+{
+  for (int i = 0; i < n; i++) val[i] = sampleT<T, Zero255>(x[i], y[i], z[i]);
+}
+
+double BorderVolume::sample(double x, double y, double z) const
+{
+  if (data) switch (type) {
+    case MRI_UCHAR:
+      return zero255 ? sampleT<unsigned char, true>(x, y, z) : sampleT<unsigned char, false>(x, y, z);
+    case MRI_SHORT:
+      return sampleT<short, false>(x, y, z);
+    case MRI_INT:
+      return sampleT<int, false>(x, y, z);
+    case MRI_FLOAT:
+      return sampleT<float, false>(x, y, z);
+  }
+  double val;
+  MRIsampleVolume(mri, x, y, z, &val);
+  return val;
+}
+
+void BorderVolume::sample(int n, const double *x, const double *y, const double *z, double *val) const
+{
+  if (data) switch (type) {
+    case MRI_UCHAR:
+      if (zero255)
+        sampleN<unsigned char, true>(n, x, y, z, val);
+      else
+        sampleN<unsigned char, false>(n, x, y, z, val);
+      return;
+    case MRI_SHORT:
+      sampleN<short, false>(n, x, y, z, val);
+      return;
+    case MRI_INT:
+      sampleN<int, false>(n, x, y, z, val);
+      return;
+    case MRI_FLOAT:
+      sampleN<float, false>(n, x, y, z, val);
+      return;
+  }
+  for (int i = 0; i < n; i++) MRIsampleVolume(mri, x[i], y[i], z[i], &val[i]);
+}
+
+
+class BorderSampler
+{
+public:
+  BorderSampler(MRIS *mris, MRI *mri_brain, MRI *mri_mask, double sigma);
+  ~BorderSampler();
+
+  bool direct() const { return brain.direct(); }
+
+  // MRIS_useRAS2VoxelMap()
+  void toVoxel(double x, double y, double z, double *xw, double *yw, double *zw) const
+  {
+    float const r = x, a = y, s = z;
+    float v[3];
+    for (int i = 0; i < 3; i++) {
+      float val = 0;
+      val += m[i][0] * r;
+      val += m[i][1] * a;
+      val += m[i][2] * s;
+      val += m[i][3] * 1.0f;
+      v[i] = val;
+    }
+    *xw = v[0];
+    *yw = v[1];
+    *zw = v[2];
+  }
+
+  // MRIsampleVolume(mri_brain, ...) and MRIsampleVolume(mri_mask, ...)
+  double value(double xw, double yw, double zw) const { return brain.sample(xw, yw, zw); }
+  double mask (double xw, double yw, double zw) const { return maskvol.sample(xw, yw, zw); }
+
+  // MRIsampleVolumeDerivativeScale(mri_tmp, ...), mri_tmp being mri_brain with the 255s replaced by 0
+  double derivative(double x, double y, double z, double dx, double dy, double dz, double sigma) const;
+
+private:
+  struct Kernel {
+    double sigma;
+    std::vector<double> dist, k;
+    double ktotal, len;
+  };
+  static void makeKernel(double sigma, Kernel &kernel);
+
+  MRIS_SurfRAS2VoxelMap *sras2v_map;
+  float m[3][4];
+  MRI *mri_tmp = NULL;  // only made when the volume is not read directly
+  BorderVolume brain, deriv, maskvol;
+  std::vector<Kernel> kernels;
+};
+
+BorderSampler::BorderSampler(MRIS *mris, MRI *mri_brain, MRI *mri_mask, double sigma)
+{
+  sras2v_map = MRIS_makeRAS2VoxelMap(mri_brain, mris);
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 4; j++) m[i][j] = sras2v_map->sras2vox->rptr[i + 1][j + 1];
+
+  bool const direct = BorderVolume::canRead(mri_brain) && !getenv("FREESURFER_BorderValues_old");
+  brain = BorderVolume(mri_brain, direct, mri_brain->outside_val, false);
+  if (direct) {
+    // a volume made by MRIreplaceValues() or MRIcopy() has outside_val 0
+    deriv = BorderVolume(mri_brain, true, 0.0, true);
+  }
+  else {
+    if (mri_brain->type == MRI_UCHAR) {
+      printf("Replacing 255s with 0s\n");
+      mri_tmp = MRIreplaceValues(mri_brain, NULL, 255, 0);
+    } else {
+      mri_tmp = MRIcopy(mri_brain, NULL);
+    }
+    deriv = BorderVolume(mri_tmp, false, 0.0, false);
+  }
+  if (mri_mask) maskvol = BorderVolume(mri_mask, direct, mri_mask->outside_val, false);
+
+  // the sigmas the search can use, see the current_sigma loop
+  for (double s = sigma; s <= 10 * sigma; s *= 2) {
+    kernels.push_back(Kernel());
+    makeKernel(s, kernels.back());
+  }
+}
+
+BorderSampler::~BorderSampler()
+{
+  MRIS_freeRAS2VoxelMap(&sras2v_map);
+  if (mri_tmp) MRIfree(&mri_tmp);
+}
+
+// the taps of MRIsampleVolumeDerivativeScale()
+void BorderSampler::makeKernel(double sigma, Kernel &kernel)
+{
+  kernel.sigma = sigma;
+  kernel.ktotal = 0.0;
+  kernel.len = 0.0;
+  double const step_size = MAX(.25, sigma / 5.0);
+  for (double dist = step_size; dist <= MAX(2 * sigma, step_size); dist += step_size) {
+    double k;
+    if (FZERO(sigma))
+      k = 1.0;
+    else
+      k = exp(-dist * dist / (2 * sigma * sigma));
+    kernel.ktotal += k;
+    kernel.len += dist;
+    kernel.dist.push_back(dist);
+    kernel.k.push_back(k);
+    if (FZERO(step_size)) break;
+  }
+}
+
+double BorderSampler::derivative(double x, double y, double z, double dx, double dy, double dz, double sigma) const
+{
+  if (!deriv.direct()) {
+    double mag;
+    MRIsampleVolumeDerivativeScale(deriv.mri, x, y, z, dx, dy, dz, &mag, sigma);
+    return mag;
+  }
+
+  Kernel local;
+  const Kernel *kernel = NULL;
+  for (size_t i = 0; i < kernels.size(); i++)
+    if (kernels[i].sigma == sigma) kernel = &kernels[i];
+  if (!kernel) {
+    makeKernel(sigma, local);
+    kernel = &local;
+  }
+
+  int const width = deriv.mri->width, height = deriv.mri->height, depth = deriv.mri->depth;
+  if (x >= width) x = width - 1.0;
+  if (y >= height) y = height - 1.0;
+  if (z >= depth) z = depth - 1.0;
+  if (x < 0.0) x = 0.0;
+  if (y < 0.0) y = 0.0;
+  if (z < 0.0) z = 0.0;
+
+  // the + and - taps of a batch go in one gather
+  int const batch = 16;
+  double xs[2 * batch], ys[2 * batch], zs[2 * batch], val[2 * batch];
+  double vp1 = 0.0, vm1 = 0.0;
+  int const ntaps = kernel->dist.size();
+  for (int first = 0; first < ntaps; first += batch) {
+    int const n = MIN(batch, ntaps - first);
+    for (int i = 0; i < n; i++) {
+      double const dist = kernel->dist[first + i];
+      xs[i] = x + dist * dx;
+      ys[i] = y + dist * dy;
+      zs[i] = z + dist * dz;
+      xs[n + i] = x - dist * dx;
+      ys[n + i] = y - dist * dy;
+      zs[n + i] = z - dist * dz;
+    }
+    deriv.sample(2 * n, xs, ys, zs, val);
+    for (int i = 0; i < n; i++) {
+      double const k = kernel->k[first + i];
+      vp1 += k * val[i];
+      vm1 += k * val[n + i];
+    }
+  }
+  vm1 /= (double)kernel->ktotal;
+  vp1 /= (double)kernel->ktotal;
+  double const len = kernel->len / (double)kernel->ktotal;
+  return (vp1 - vm1) / (2.0 * len);
+}
+
+
+/*
+  The samples along one vertex normal. The target search steps STEP_SIZE
+  at a time but also looks STEP_SIZE to either side, and once the voxel
+  transform has rounded the coordinates to float those are nearly always
+  the points of the previous steps. The last few results are kept and
+  handed back when the same voxel coordinates come up again.
+*/
+class BorderRay
+{
+public:
+  BorderRay(const BorderSampler &sampler, double nx, double ny, double nz)
+    : sampler(sampler), nx(nx), ny(ny), nz(nz) {}
+
+  double value(double xw, double yw, double zw)
+  {
+    double val;
+    if (values.find(xw, yw, zw, 0, &val)) return val;
+    val = sampler.value(xw, yw, zw);
+    values.add(xw, yw, zw, 0, val);
+    return val;
+  }
+
+  double derivative(double xw, double yw, double zw, double sigma)
+  {
+    double mag;
+    if (derivatives.find(xw, yw, zw, sigma, &mag)) return mag;
+    mag = sampler.derivative(xw, yw, zw, nx, ny, nz, sigma);
+    derivatives.add(xw, yw, zw, sigma, mag);
+    return mag;
+  }
+
+private:
+  struct Cache {
+    enum { SIZE = 4 };
+    double xw[SIZE], yw[SIZE], zw[SIZE], sigma[SIZE], val[SIZE];
+    int n = 0, next = 0;
+
+    bool find(double x, double y, double z, double s, double *pval) const
+    {
+      for (int i = 0; i < n; i++)
+        if (xw[i] == x && yw[i] == y && zw[i] == z && sigma[i] == s) {
+          *pval = val[i];
+          return true;
+        }
+      return false;
+    }
+    void add(double x, double y, double z, double s, double v)
+    {
+      xw[next] = x; yw[next] = y; zw[next] = z; sigma[next] = s; val[next] = v;
+      next = (next + 1) % SIZE;
+      if (n < SIZE) n++;
+    }
+  };
+
+  const BorderSampler &sampler;
+  double const nx, ny, nz;
+  Cache values, derivatives;
+};
+
+}  // namespace
+
+
 /*!
   \fn int MRIScomputeBorderValues_new()
   \brief Computes the distance along the normal to the point of the maximum
@@ -1736,20 +2143,23 @@ static int MRIScomputeBorderValues_new(
 	   vgdiag->x,vgdiag->y,vgdiag->z,vgdiag->nx,vgdiag->ny,vgdiag->nz);
   }
 
-  MRI *mri_tmp;
-  if (mri_brain->type == MRI_UCHAR) {
-    printf("Replacing 255s with 0s\n");
-    mri_tmp = MRIreplaceValues(mri_brain, NULL, 255, 0);
-  } else {
-    mri_tmp = MRIcopy(mri_brain, NULL);
-  }
+  // Maps the surface points to voxels and samples the volumes
+  //
+  BorderSampler const sampler(mris, mri_brain, mri_mask, sigma);
 
   MRISclearMarks(mris); /* for soap bubble smoothing later */
 
-  // Various double sums which are not used to compute future results
-  // so the instability is not important
+  // Various double sums which are not used to compute future results.
+  // Each vertex keeps its own part and they are added up in vertex order
+  // after the loop, so the report does not depend on the threads.
   //
   double mean_dist = 0, mean_in = 0, mean_out = 0, mean_border = 0;
+  struct BorderSums { double dist = 0, in = 0, out = 0, border = 0; };
+  std::vector<BorderSums> vertex_sums(MAX(vno_stop - vno_start, 0));
+
+  // Time spent in each stage of the search, summed over the threads
+  //
+  long bracket_ns = 0, target_ns = 0, peak_ns = 0;
 
   // Various counters that are used after the parallel loop
   //
@@ -1759,18 +2169,14 @@ static int MRIScomputeBorderValues_new(
   int n_sigma_increases = 0;
   int nFirstPeakD1 = 0;
 
-  // Prepare to map all the surface points to voxels
-  //
-  MRIS_SurfRAS2VoxelMap* sras2v_map = 
-    MRIS_makeRAS2VoxelMap(mri_brain, mris);
-  
   int vno,nripped=0;
+  double const setup_sec = mytimer.seconds();
 
   // Loop over all the vertices
   ROMP_PF_begin
 #ifdef HAVE_OPENMP
-  #pragma omp parallel for if_ROMP(assume_reproducible) \
-    reduction(+:mean_dist,mean_in,mean_out,mean_border) \
+  #pragma omp parallel for if_ROMP(shown_reproducible) schedule(guided) \
+    reduction(+:bracket_ns,target_ns,peak_ns) \
     reduction(+:total_vertices,ngrad_max,ngrad,nmin,nmissing,nout,nin,nfound,nalways_missing,num_changed) \
     reduction(+:n_sigma_increases,nripped,nFirstPeakD1)
 #endif
@@ -1795,6 +2201,9 @@ static int MRIScomputeBorderValues_new(
     if (vno == Gdiag_no)
       DiagBreak();
 
+    Timer stage_timer;
+    BorderSums &vertex_sum = vertex_sums[vno - vno_start];
+
     if(CBVO.AltBorderLowMask){
       int m = MRIgetVoxVal(CBVO.AltBorderLowMask,vno,0,0,0);
       if(m>0.5){
@@ -1814,11 +2223,11 @@ static int MRIScomputeBorderValues_new(
       x = v->x;
       y = v->y;
       z = v->z;
-      MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
+      sampler.toVoxel(x, y, z, &xw, &yw, &zw);
       x = v->x + v->nx;
       y = v->y + v->ny;
       z = v->z + v->nz;
-      MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw1, &yw1, &zw1);
+      sampler.toVoxel(x, y, z, &xw1, &yw1, &zw1);
     
       // Note: these nx,ny,nz are in VOXEL space whereas v->{nx,ny,nz} are in TKR mm space
       nx = xw1 - xw;
@@ -1830,6 +2239,7 @@ static int MRIScomputeBorderValues_new(
       ny /= dist;
       nz /= dist;
     }
+    BorderRay ray(sampler, nx, ny, nz);
     
     /*
       find the distance in the directions parallel and anti-parallel to
@@ -1868,14 +2278,14 @@ static int MRIScomputeBorderValues_new(
         double const x = v->x + v->nx * dist;
         double const y = v->y + v->ny * dist;
         double const z = v->z + v->nz * dist;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
 
 	// Compute derivative of the intensity along the normal. The
-	// normal (nx,ny,nz) always points outward. mri_tmp is mri_brain.
-	// It may be a copy if mri_brain is UCHAR. nx,ny,nz are in voxel space
-        MRIsampleVolumeDerivativeScale(mri_tmp, xw, yw, zw, nx, ny, nz, &mag, current_sigma);   // expensive
+	// normal (nx,ny,nz) always points outward. The derivative is of
+	// mri_brain with any UCHAR 255s read as 0. nx,ny,nz are in voxel space
+        mag = ray.derivative(xw, yw, zw, current_sigma);   // expensive
         if(vno == Gdiag_no) {
-	  MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+	  val = ray.value(xw, yw, zw);
 	  printf("vno=%d #SB# %6.4f  %6.4f %7.4f %7.4f\n",vno,current_sigma,dist,val,mag);
 	}
         if (mag >= 0.0) {
@@ -1884,7 +2294,7 @@ static int MRIScomputeBorderValues_new(
           break;
         }
         
-        MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+        val = ray.value(xw, yw, zw);
         if (val > border_hi) {
           // More intense than the expected range of WM. border_hi is
           // 1std above the mean of WM.
@@ -1892,7 +2302,7 @@ static int MRIScomputeBorderValues_new(
           break;
         }
         if (mri_mask) {
-          MRIsampleVolume(mri_mask, xw, yw, zw, &val);
+          val = sampler.mask(xw, yw, zw);
           if (val > thresh) {
             //Out side of mask, so break
             if(vno == Gdiag_no) printf("vno=%d  outside of mask, breaking inward loop %g\n",vno,mag);
@@ -1923,11 +2333,11 @@ static int MRIScomputeBorderValues_new(
         double const x = v->x + v->nx * dist;
         double const y = v->y + v->ny * dist;
         double const z = v->z + v->nz * dist;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolumeDerivativeScale(mri_tmp, xw, yw, zw, nx, ny, nz, &mag, current_sigma);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        mag = ray.derivative(xw, yw, zw, current_sigma);
 
         if(vno == Gdiag_no){
-	  MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+	  val = ray.value(xw, yw, zw);
 	  printf("vno=%d #SB# %6.4f  %6.4f %7.4f %7.4f\n",vno,current_sigma,dist,val,mag);
 	}
         if(mag >= 0.0){
@@ -1935,14 +2345,14 @@ static int MRIScomputeBorderValues_new(
           break;
 	}
 
-        MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+        val = ray.value(xw, yw, zw);
         if (val < border_low){
 	  // Less intense than GM. border_low is the global mean (or mode) of GM
           if(vno == Gdiag_no) printf("vno=%d Less intense than expected, val = %g < border_low=%g, breaking outward loop\n",vno,val,border_low);
           break; 
 	}
         if (mri_mask) {
-          MRIsampleVolume(mri_mask, xw, yw, zw, &val);
+          val = sampler.mask(xw, yw, zw);
           if (val > thresh) {
             if(vno == Gdiag_no) printf("vno=%d Outside of mask, breaking outward loop %g\n",vno,mag);
             break;
@@ -1974,6 +2384,8 @@ static int MRIScomputeBorderValues_new(
       if(vno == Gdiag_no) printf("vno=%d resetting sigma\n",vno);
       current_sigma = sigma; // reset sigma to the input value
     }
+    bracket_ns += stage_timer.nanoseconds();
+    stage_timer.reset();
 
     FILE *fp = NULL;
     if (vno == Gdiag_no) {
@@ -2017,8 +2429,8 @@ static int MRIScomputeBorderValues_new(
         double const y = v->y + v->ny * dist;
         double const z = v->z + v->nz * dist;
         double xw, yw, zw;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        val = ray.value(xw, yw, zw);
       }
 
       // These are only used with CBVfindFirstPeakD{1,2}
@@ -2033,8 +2445,8 @@ static int MRIScomputeBorderValues_new(
         double const y = v->y + v->ny * (dist - STEP_SIZE);
         double const z = v->z + v->nz * (dist - STEP_SIZE);
         double xw,yw,zw;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolume(mri_brain, xw, yw, zw, &previous_val);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        previous_val = ray.value(xw, yw, zw);
       }
 
       if (previous_val < inside_hi && previous_val >= border_low) {
@@ -2055,8 +2467,8 @@ static int MRIScomputeBorderValues_new(
         x = v->x + v->nx * dist;
         y = v->y + v->ny * dist;
         z = v->z + v->nz * dist;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        val = ray.value(xw, yw, zw);
 
         if(val < min_val) {
 	  // Keep track of the minimum intensity along the normal
@@ -2068,22 +2480,22 @@ static int MRIScomputeBorderValues_new(
         x = v->x + v->nx * (dist + STEP_SIZE);
         y = v->y + v->ny * (dist + STEP_SIZE);
         z = v->z + v->nz * (dist + STEP_SIZE);
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolumeDerivativeScale(mri_tmp, xw, yw, zw, nx, ny, nz, &next_mag, sigma);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        next_mag = ray.derivative(xw, yw, zw, sigma);
 
 	// Sample the intensity gradient at dist - STEP_SIZE along the normal
         x = v->x + v->nx * (dist - STEP_SIZE);
         y = v->y + v->ny * (dist - STEP_SIZE);
         z = v->z + v->nz * (dist - STEP_SIZE);
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolumeDerivativeScale(mri_tmp, xw, yw, zw, nx, ny, nz, &previous_mag, sigma);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        previous_mag = ray.derivative(xw, yw, zw, sigma);
 
 	// Sample the intensity gradient at dist along the normal. Use xw,yw,zw below
         x = v->x + v->nx * dist;
         y = v->y + v->ny * dist;
         z = v->z + v->nz * dist;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-        MRIsampleVolumeDerivativeScale(mri_tmp, xw, yw, zw, nx, ny, nz, &mag, sigma);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+        mag = ray.derivative(xw, yw, zw, sigma);
         
 	if (vno == Gdiag_no) printf("vno=%d  val = %g   prev = %g   next =%g\n",vno,val,previous_val,next_val);
         if ((which == GRAY_WHITE) &&  
@@ -2124,10 +2536,10 @@ static int MRIScomputeBorderValues_new(
           double const x = v->x + v->nx * (dist + STEP_SIZE);
           double const y = v->y + v->ny * (dist + STEP_SIZE);
           double const z = v->z + v->nz * (dist + STEP_SIZE);
-          MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
+          sampler.toVoxel(x, y, z, &xw, &yw, &zw);
           
           //double next_val; // define with loop scope
-          MRIsampleVolume(mri_brain, xw, yw, zw, &next_val);
+          next_val = ray.value(xw, yw, zw);
 	  // border_hi = max_gray_at_csf_border = meanGM-1stdGM (eg, 65.89)
           if (next_val < border_low){
             next_mag = 0;
@@ -2152,8 +2564,8 @@ static int MRIScomputeBorderValues_new(
           double const x = v->x + v->nx * (dist + 1);
           double const y = v->y + v->ny * (dist + 1);
           double const z = v->z + v->nz * (dist + 1);
-          MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-          MRIsampleVolume(mri_brain, xw, yw, zw, &next_val);
+          sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+          next_val = ray.value(xw, yw, zw);
           /*If a gradmax has not been found yet (or this one is
             greater than the current max) and the "next_val" is in the
             right range, set the gradmax to that at this point.*/
@@ -2210,8 +2622,8 @@ static int MRIScomputeBorderValues_new(
             double const x = v->x + v->nx * (dist + 1);
             double const y = v->y + v->ny * (dist + 1);
             double const z = v->z + v->nz * (dist + 1);
-            MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
-            MRIsampleVolume(mri_brain, xw, yw, zw, &next_val);
+            sampler.toVoxel(x, y, z, &xw, &yw, &zw);
+            next_val = ray.value(xw, yw, zw);
             if (next_val >= outside_low && next_val <= border_hi && next_val < outside_hi) {
 	      if(Gdiag_no==vno) printf("  ... and next_val @ 1mm is in range, so keeping this distance as a candidate\n");
               max_mag_dist = dist;
@@ -2227,6 +2639,8 @@ static int MRIScomputeBorderValues_new(
 
     } // for dist
     // =====================================================================
+    target_ns += stage_timer.nanoseconds();
+    stage_timer.reset();
 
     if (vno == Gdiag_no) {
       fclose(fp);
@@ -2411,9 +2825,9 @@ static int MRIScomputeBorderValues_new(
         double const y = v->y + v->ny * outlen;
         double const z = v->z + v->nz * outlen;
         double xw,yw,zw;
-        MRIS_useRAS2VoxelMap(sras2v_map, mri_brain,x, y, z, &xw, &yw, &zw);
+        sampler.toVoxel(x, y, z, &xw, &yw, &zw);
         double val;
-        MRIsampleVolume(mri_brain, xw, yw, zw, &val);
+        val = ray.value(xw, yw, zw);
         if ((val < outside_hi /*border_low*/) || (val > border_hi)) {
 	  // if it gets here, then it is not all gray
 	  // border_hi < val < outside_hi
@@ -2447,20 +2861,20 @@ static int MRIScomputeBorderValues_new(
       if (max_mag_dist > 0) {
         nout++;
         nfound++;
-        mean_out += max_mag_dist;
+        vertex_sum.out += max_mag_dist;
       }
       else {
         nin++;
         nfound++;
-        mean_in += -max_mag_dist;
+        vertex_sum.in += -max_mag_dist;
       }
 
       if (max_mag_val < border_low) {
         max_mag_val = border_low;
       }
 
-      mean_dist += max_mag_dist;
-      mean_border += max_mag_val;
+      vertex_sum.dist += max_mag_dist;
+      vertex_sum.border += max_mag_val;
       total_vertices++;
 
       // Set vertex values
@@ -2482,7 +2896,7 @@ static int MRIScomputeBorderValues_new(
         }
         v->val = min_val;
         v->marked = 1;
-        mean_border += min_val;
+        vertex_sum.border += min_val;
         total_vertices++;
       }
       else {
@@ -2512,12 +2926,20 @@ static int MRIScomputeBorderValues_new(
 	     local_max_found ? "local max" : max_mag_val > 0 ? "grad" : "min");
 
     if(CBVO.LocalMaxFound) MRIsetVoxVal(CBVO.LocalMaxFound,vno,0,0,0, local_max_found);
+    peak_ns += stage_timer.nanoseconds();
 
     ROMP_PFLB_end
   } // end loop over vertices
   //=============================vertex ======================						  
   ROMP_PF_end
 
+  for (size_t i = 0; i < vertex_sums.size(); i++) {
+    mean_dist   += vertex_sums[i].dist;
+    mean_in     += vertex_sums[i].in;
+    mean_out    += vertex_sums[i].out;
+    mean_border += vertex_sums[i].border;
+  }
+
   printf("#SI# sigma=%g had to be increased for %d vertices, nripped=%d\n",sigma,n_sigma_increases,nripped);
   mean_dist   /= (float)(total_vertices - nmissing);
   mean_border /= (float)total_vertices;
@@ -2534,7 +2956,7 @@ static int MRIScomputeBorderValues_new(
   // This is an extremely hacky way to print to both stdout and log_fp
   FILE* fp = stdout;
   int pass;
-  // NONREPRODUCIBLE NUMBERS NOT USED FOR ANYTHING 
+  // NUMBERS NOT USED FOR ANYTHING
   for (pass = 0; fp && (pass < 2); pass++, fp = log_fp) {
     fprintf(fp, "mean border=%2.1f, %d (%d) missing vertices, mean dist %2.1f "
       "[%2.1f (%%%2.1f)->%2.1f (%%%2.1f))]\n",
@@ -2549,13 +2971,15 @@ static int MRIScomputeBorderValues_new(
   }
   printf("nFirstPeakD1 %d\n",nFirstPeakD1);
 
-  MRIS_freeRAS2VoxelMap(&sras2v_map);
   if(Gdiag_no > 0){
     vgdiag = &mris->vertices[Gdiag_no];
     printf("#CBV# vno=%d  v->val=%g v->d=%g v->marked=%d, v->ripflag=%d\n",
       Gdiag_no,vgdiag->val,vgdiag->d,vgdiag->marked,vgdiag->ripflag);
   }
   msec = mytimer.milliseconds() ;
+  printf("MRIScomputeBorderValues_new() stages: setup %4.2f s, bracket %4.2f s, target %4.2f s, peak %4.2f s%s\n",
+         setup_sec, bracket_ns * 1e-9, target_ns * 1e-9, peak_ns * 1e-9,
+         sampler.direct() ? "" : " (sampled through MRIsampleVolume)");
   printf("MRIScomputeBorderValues_new() finished in %6.4f min\n",(float)msec/(60*1000.0f)); fflush(stdout);
   printf("\n\n");
   return (NO_ERROR);
@@ -5355,169 +5779,214 @@ MRI *MRISsmoothMRI(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *BinMask, MRI *Ta
   return (Targ);
 }
 /*-------------------------------------------------------------------
-  MRISsmoothMRIFast() - faster version of MRISsmoothMRI(). Smooths
-  values on the surface when the surface values are stored in an
-  MRI_VOLUME structure with the number of spatial voxels equal to the
-  number of nvertices on the surface. Can handle multiple frames. Can
-  be performed in-place. If Targ is NULL, it will automatically
-  allocate a new MRI structure. Note that the input MRI struct does
-  not have to have any particular configuration of cols, rows, and
-  slices as long as the product equals nvertices.  Does not smooth
-  data from ripped vertices into unripped vertices (but does go the
-  other way). Same for mask. The mask is inclusive, so voxels with
-  mask=1 are included. If mask is NULL, it is ignored. Gives identical
-  results as MRISsmoothMRI(); see MRISsmoothMRIFastCheck().
+  MRISsmoothOpBuild() - builds the one-step nearest-neighbor averaging
+  operator used by MRISsmoothMRIFast() as a sparse (CSR) matrix. Row
+  vno lists the vertices averaged into vno: vno itself first, then its
+  neighbors that are not ripped and are in the (inclusive) mask. Rows
+  of vertices outside of the mask are empty (they are set to 0). Build
+  it once and pass it to MRISsmoothOpApply() when smoothing the same
+  surface many times.
   -------------------------------------------------------------------*/
-MRI *MRISsmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask, MRI *Targ)
+MRIS_SMOOTH_OP *MRISsmoothOpBuild(MRIS *Surf, MRI *IncMask)
 {
-  int nnbrs, nthstep, frame, vno, nthnbr, num, nvox, nbrvno, reshape;
-  MRI *SrcTmp, *mritmp, *IncMaskTmp = NULL;
-  int msecTime;
-  int *nNbrs, *nNbrs0, *rip, *rip0, nNbrsMax;
-  float **pF, **pF0, *tF, *tF0, sumF;
-  VERTEX *v, *vn;
+  int vno, nthnbr, nbrvno, nvox;
+  std::vector<char> inmask(Surf->nvertices, 1);
 
-  if (Gdiag_no > 0) printf("MRISsmoothMRIFast()\n");
+  if (IncMask) {
+    nvox = IncMask->width * IncMask->height * IncMask->depth;
+    if (nvox != Surf->nvertices) {
+      printf("ERROR: MRISsmoothOpBuild(): Surf/Mask dimension mismatch\n");
+      return (NULL);
+    }
+    // voxel order of the mask does not have to be nvertices x 1 x 1
+    vno = 0;
+    for (int s = 0; s < IncMask->depth; s++)
+      for (int r = 0; r < IncMask->height; r++)
+        for (int c = 0; c < IncMask->width; c++) inmask[vno++] = (MRIgetVoxVal(IncMask, c, r, s, 0) >= 0.5);
+  }
+
+  MRIS_SMOOTH_OP *op = (MRIS_SMOOTH_OP *)calloc(1, sizeof(MRIS_SMOOTH_OP));
+  op->nvertices = Surf->nvertices;
+  op->rowptr = (int *)calloc(Surf->nvertices + 1, sizeof(int));
+  for (vno = 0; vno < Surf->nvertices; vno++) {
+    int num = 0;
+    if (inmask[vno]) {
+      num = 1;
+      VERTEX_TOPOLOGY const * const vt = &Surf->vertices_topology[vno];
+      for (nthnbr = 0; nthnbr < vt->vnum; nthnbr++) {
+        nbrvno = vt->v[nthnbr];
+        if (Surf->vertices[nbrvno].ripflag || !inmask[nbrvno]) continue;
+        num++;
+      }
+    }
+    op->rowptr[vno + 1] = op->rowptr[vno] + num;
+  }
+  op->col = (int *)calloc(op->rowptr[Surf->nvertices] + 1, sizeof(int));
+  for (vno = 0; vno < Surf->nvertices; vno++) {
+    if (!inmask[vno]) continue;
+    int k = op->rowptr[vno];
+    op->col[k++] = vno;
+    VERTEX_TOPOLOGY const * const vt = &Surf->vertices_topology[vno];
+    for (nthnbr = 0; nthnbr < vt->vnum; nthnbr++) {
+      nbrvno = vt->v[nthnbr];
+      if (Surf->vertices[nbrvno].ripflag || !inmask[nbrvno]) continue;
+      op->col[k++] = nbrvno;
+    }
+  }
+  return (op);
+}
+
+int MRISsmoothOpFree(MRIS_SMOOTH_OP **pop)
+{
+  MRIS_SMOOTH_OP *op = *pop;
+  if (op == NULL) return (0);
+  free(op->rowptr);
+  free(op->col);
+  free(op);
+  *pop = NULL;
+  return (0);
+}
+
+/*-------------------------------------------------------------------
+  MRISsmoothOpApply() - applies nSmoothSteps of the averaging operator
+  to all frames of Src. Frames are processed in blocks stored vertex by
+  frame, so each step is one threaded pass over the operator for the
+  whole block. The sums are accumulated in the same order as the
+  original pointer-based smoother, so results are identical. Src can
+  have any col/row/slice shape with nvertices voxels. Can be done
+  in-place. Targ must be MRI_FLOAT, it is allocated if NULL.
+  -------------------------------------------------------------------*/
+MRI *MRISsmoothOpApply(MRIS_SMOOTH_OP *op, MRI *Src, int nSmoothSteps, MRI *Targ)
+{
+  int nvox, nblock, frame0;
+  const int maxblock = 32;
 
   nvox = Src->width * Src->height * Src->depth;
-  if (Surf->nvertices != nvox) {
-    printf("ERROR: MRISsmoothMRIFast(): Surf/Src dimension mismatch\n");
+  if (op->nvertices != nvox) {
+    printf("ERROR: MRISsmoothOpApply(): Surf/Src dimension mismatch\n");
     return (NULL);
   }
-  if (IncMask) {
-    if (IncMask->width * IncMask->height * IncMask->depth != nvox) {
-      printf("ERROR: MRISsmoothMRIFast(): Surf/Mask dimension mismatch\n");
+  if (Targ == NULL) {
+    Targ = MRIallocSequence(Src->width, Src->height, Src->depth, MRI_FLOAT, Src->nframes);
+    if (Targ == NULL) {
+      printf("ERROR: MRISsmoothOpApply(): could not alloc\n");
       return (NULL);
     }
-    if (IncMask->width != nvox)
-      IncMaskTmp = mri_reshape(IncMask, nvox, 1, 1, IncMask->nframes);
-    else
-      IncMaskTmp = MRIcopy(IncMask, NULL);
-  }
-  // Reshape the source if needed
-  if (Src->width != nvox) {
-    if (Gdiag_no > 0) printf("MRISsmoothMRIFast(): reshaping\n");
-    SrcTmp = mri_reshape(Src, nvox, 1, 1, Src->nframes);
-    reshape = 1;
+    MRIcopyHeader(Src, Targ);
   }
   else {
-    reshape = 0;
-    SrcTmp = MRIcopy(Src, NULL);
-  }
-  if (Targ != NULL) {
     if (MRIdimMismatch(Src, Targ, 1)) {
-      printf("ERROR: MRISsmoothFast(): output dimension mismatch\n");
+      printf("ERROR: MRISsmoothOpApply(): output dimension mismatch\n");
       return (NULL);
     }
     if (Targ->type != MRI_FLOAT) {
-      printf("ERROR: MRISsmoothFast(): structure passed is not MRI_FLOAT\n");
+      printf("ERROR: MRISsmoothOpApply(): structure passed is not MRI_FLOAT\n");
       return (NULL);
     }
   }
 
-  // Alloc arrays. If there are ripped vertices, then only rip
-  // needs nvertices elements
-  nNbrsMax = 12;  // Should measure this, but overalloc does not hurt
-  pF = (float **)calloc(Surf->nvertices * nNbrsMax, sizeof(float *));
-  tF = (float *)calloc(Surf->nvertices, sizeof(float));
-  nNbrs = (int *)calloc(Surf->nvertices, sizeof(int));
-  rip = (int *)calloc(Surf->nvertices, sizeof(int));
-
-  pF0 = pF;
-  tF0 = tF;
-  rip0 = rip;
-  nNbrs0 = nNbrs;
-
   Timer mytimer;
-
-  // Loop through frames
-  for (frame = 0; frame < Src->nframes; frame++) {
-    // Set up pointers for this frame
-    pF = pF0;
-    rip = rip0;
-    nNbrs = nNbrs0;
-    for (vno = 0; vno < Surf->nvertices; vno++) {
-      v = &Surf->vertices[vno];
-      if (IncMaskTmp && MRIgetVoxVal(IncMaskTmp, vno, 0, 0, 0) < 0.5) {
-        // Mask is inclusive, so look for out of mask
-        // should exclude rips here too? Original does not.
-        rip[vno] = 1;
-        MRIFseq_vox(SrcTmp, vno, 0, 0, frame) = 0;
-        continue;
-      }
-      rip[vno] = 0;
-      *pF++ = (float *)(&(MRIFseq_vox(SrcTmp, vno, 0, 0, frame)));
-      nnbrs = Surf->vertices_topology[vno].vnum;
-      num = 1;
-      for (nthnbr = 0; nthnbr < nnbrs; nthnbr++) {
-        nbrvno = Surf->vertices_topology[vno].v[nthnbr];
-        vn = &Surf->vertices[nbrvno];
-        if (vn->ripflag) {
-          continue;
-        }
-        if (IncMaskTmp && MRIgetVoxVal(IncMaskTmp, nbrvno, 0, 0, 0) < 0.5) {
-          continue;
+  nblock = MIN(Src->nframes, maxblock);
+  std::vector<float> X((size_t)nvox * nblock), Y((size_t)nvox * nblock);
+
+  for (frame0 = 0; frame0 < Src->nframes; frame0 += nblock) {
+    int nf = MIN(nblock, Src->nframes - frame0);
+
+    // pack, vertex order is column-major like the rest of the surface code
+    int vno = 0;
+    for (int s = 0; s < Src->depth; s++) {
+      for (int r = 0; r < Src->height; r++) {
+        for (int c = 0; c < Src->width; c++) {
+          float *x = &X[(size_t)vno * nf];
+          if (op->rowptr[vno] == op->rowptr[vno + 1])
+            for (int f = 0; f < nf; f++) x[f] = 0;
+          else
+            for (int f = 0; f < nf; f++) x[f] = MRIgetVoxVal(Src, c, r, s, frame0 + f);
+          vno++;
         }
-        *pF++ = (float *)(&(MRIFseq_vox(SrcTmp, nbrvno, 0, 0, frame)));
-        num++;
       }
-      *nNbrs++ = num;  // num takes into account all rips/masks
     }
 
-    // Step through the iterations
-    for (nthstep = 0; nthstep < nSmoothSteps; nthstep++) {
-      // Init pointers for this iteration
-      pF = pF0;
-      rip = rip0;
-      tF = tF0;
-      nNbrs = nNbrs0;
-      // Loop through vertices, average nearest neighbors
-      for (vno = 0; vno < Surf->nvertices; vno++) {
-        if (*rip++) {
+    for (int nthstep = 0; nthstep < nSmoothSteps; nthstep++) {
+      float *Xp = &X[0], *Yp = &Y[0];
+      ROMP_PF_begin
+#ifdef HAVE_OPENMP
+      #pragma omp parallel for if_ROMP(assume_reproducible) schedule(static, 1024)
+#endif
+      for (int vno = 0; vno < nvox; vno++) {
+        ROMP_PFLB_begin
+        float *y = &Yp[(size_t)vno * nf];
+        int k0 = op->rowptr[vno], k1 = op->rowptr[vno + 1];
+        if (k0 == k1) {
+          for (int f = 0; f < nf; f++) y[f] = 0;
           continue;
         }
-        sumF = *(*pF++);
-        for (nthnbr = 0; nthnbr < (*nNbrs) - 1; nthnbr++) {
-          sumF += *(*pF++);
+        const float *x = &Xp[(size_t)op->col[k0] * nf];
+        for (int f = 0; f < nf; f++) y[f] = x[f];
+        for (int k = k0 + 1; k < k1; k++) {
+          x = &Xp[(size_t)op->col[k] * nf];
+          for (int f = 0; f < nf; f++) y[f] += x[f];
         }
-        *tF++ = sumF / (*nNbrs);
-        nNbrs++;
+        int num = k1 - k0;
+        for (int f = 0; f < nf; f++) y[f] /= num;
+        ROMP_PFLB_end
       }
-      // Load up for the next step
-      rip = rip0;
-      tF = tF0;
-      for (vno = 0; vno < Surf->nvertices; vno++) {
-        if (*rip++) {
-          continue;
+      ROMP_PF_end
+      X.swap(Y);
+    }
+
+    vno = 0;
+    for (int s = 0; s < Src->depth; s++) {
+      for (int r = 0; r < Src->height; r++) {
+        for (int c = 0; c < Src->width; c++) {
+          const float *x = &X[(size_t)vno * nf];
+          for (int f = 0; f < nf; f++) MRIFseq_vox(Targ, c, r, s, frame0 + f) = x[f];
+          vno++;
         }
-        MRIsetVoxVal(SrcTmp, vno, 0, 0, frame, *tF++);
       }
     }
-
-  } /* end loop over frame */
-
-  // Copy to the output
-  if (reshape) {
-    if (Gdiag_no > 0) printf("MRISsmoothFast() reshaping again\n");
-    mritmp = mri_reshape(SrcTmp, Src->width, Src->height, Src->depth, Src->nframes);
-    Targ = MRIcopy(mritmp, Targ);
-    MRIfree(&mritmp);
   }
-  else
-    Targ = MRIcopy(SrcTmp, Targ);
 
-  msecTime = mytimer.milliseconds();
   if (Gdiag_no > 0) {
-    printf("MRISsmoothFast() nsteps = %d, tsec = %g\n", nSmoothSteps, msecTime / 1000.0);
+    printf("MRISsmoothOpApply() nsteps = %d, nframes = %d, tsec = %g\n",
+           nSmoothSteps, Src->nframes, mytimer.milliseconds() / 1000.0);
     fflush(stdout);
   }
+  return (Targ);
+}
 
-  MRIfree(&SrcTmp);
-  if (IncMaskTmp) MRIfree(&IncMaskTmp);
-  free(pF0);
-  free(tF0);
-  free(rip0);
-  free(nNbrs0);
+/*-------------------------------------------------------------------
+  MRISsmoothMRIFast() - faster version of MRISsmoothMRI(). Smooths
+  values on the surface when the surface values are stored in an
+  MRI_VOLUME structure with the number of spatial voxels equal to the
+  number of nvertices on the surface. Can handle multiple frames. Can
+  be performed in-place. If Targ is NULL, it will automatically
+  allocate a new MRI structure. Note that the input MRI struct does
+  not have to have any particular configuration of cols, rows, and
+  slices as long as the product equals nvertices.  Does not smooth
+  data from ripped vertices into unripped vertices (but does go the
+  other way). Same for mask. The mask is inclusive, so voxels with
+  mask=1 are included. If mask is NULL, it is ignored. Gives identical
+  results as MRISsmoothMRI(); see MRISsmoothMRIFastCheck(). Builds the
+  sparse averaging operator and applies it to blocks of frames, see
+  MRISsmoothOpBuild() and MRISsmoothOpApply().
+  -------------------------------------------------------------------*/
+MRI *MRISsmoothMRIFast(MRIS *Surf, MRI *Src, int nSmoothSteps, MRI *IncMask, MRI *Targ)
+{
+  int nvox;
+
+  if (Gdiag_no > 0) printf("MRISsmoothMRIFast()\n");
+
+  nvox = Src->width * Src->height * Src->depth;
+  if (Surf->nvertices != nvox) {
+    printf("ERROR: MRISsmoothMRIFast(): Surf/Src dimension mismatch\n");
+    return (NULL);
+  }
+
+  MRIS_SMOOTH_OP *op = MRISsmoothOpBuild(Surf, IncMask);
+  if (op == NULL) return (NULL);
+  Targ = MRISsmoothOpApply(op, Src, nSmoothSteps, Targ);
+  MRISsmoothOpFree(&op);
 
   return (Targ);
 }
@@ -0,0 +1,563 @@
+/**
+ * @brief coarse-to-fine (multigrid) inflation and spherical mapping
+ *
+ * See mrisurf_multigrid.h. The decimation is a greedy half-edge collapse:
+ * the shortest edges go first, and a collapse is only done if it keeps the
+ * mesh a closed manifold of the same genus (the link condition), keeps the
+ * valences moderate and flips none of the faces around the removed vertex.
+ * The removed vertex is merged into the one that is kept, so every coarse
+ * vertex sits exactly on a vertex of the finer mesh.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "mrisurf_multigrid.h"
+
+#include "mrisurf_base.h"
+#include "mrisurf_project.h"
+#include "timer.h"
+
+#include "romp_support.h"
+
+#define MG_DECIMATION    4      // vertices of a level over vertices of the next coarser one
+#define MG_MAX_VALENCE   12     // collapses that would leave a busier vertex are skipped
+#define MG_MIN_FLIP_COS  0.2    // smallest cosine between a face normal before and after a collapse
+#define MG_PROLONG_ITER  500    // harmonic interpolation sweeps
+#define MG_PROLONG_TOL   1e-4   // stop when no value moves more than this times the avg edge length
+#define MG_UNTANGLE_ITER 500    // most local smoothing steps against the folds of a prolongated sphere
+
+// the triangle mesh the collapses edit. Vertex positions never change, a
+// removed vertex points to the vertex it was merged into.
+struct McMesh
+{
+  std::vector< double > xyz;             // 3 per vertex
+  std::vector< int > fv;                 // 3 per face
+  std::vector< char > faceAlive;
+  std::vector< std::vector< int > > vf;  // faces of each vertex, dead ones are pruned lazily
+  std::vector< int > parent;             // -1 for vertices that are kept
+  std::vector< int > weight;             // # of fine vertices merged into each vertex
+};
+
+struct McEdge
+{
+  double len2;
+  int v0, v1;
+  bool operator<(McEdge const &e) const
+  {
+    // priority_queue pops the largest, so the shortest edge has to compare largest
+    if (len2 != e.len2) return len2 > e.len2;
+    if (v0 != e.v0) return v0 > e.v0;
+    return v1 > e.v1;
+  }
+};
+
+static double mcLen2(McMesh const &m, int v0, int v1)
+{
+  double const *p0 = &m.xyz[3 * v0], *p1 = &m.xyz[3 * v1];
+  return SQR(p1[0] - p0[0]) + SQR(p1[1] - p0[1]) + SQR(p1[2] - p0[2]);
+}
+
+static void mcPruneFaces(McMesh &m, int vno)
+{
+  std::vector< int > &f = m.vf[vno];
+  f.erase(std::remove_if(f.begin(), f.end(), [&m](int fno) { return !m.faceAlive[fno]; }), f.end());
+}
+
+// the 1-ring of vno, in no particular order
+static void mcNeighbors(McMesh &m, int vno, std::vector< int > &nbrs)
+{
+  mcPruneFaces(m, vno);
+  nbrs.clear();
+  for (int fno : m.vf[vno])
+    for (int k = 0; k < 3; k++) {
+      int const vn = m.fv[3 * fno + k];
+      if (vn != vno && std::find(nbrs.begin(), nbrs.end(), vn) == nbrs.end()) nbrs.push_back(vn);
+    }
+}
+
+static void mcNormal(double const *p0, double const *p1, double const *p2, double *n)
+{
+  double const ax = p1[0] - p0[0], ay = p1[1] - p0[1], az = p1[2] - p0[2];
+  double const bx = p2[0] - p0[0], by = p2[1] - p0[1], bz = p2[2] - p0[2];
+  n[0] = ay * bz - az * by;
+  n[1] = az * bx - ax * bz;
+  n[2] = ax * by - ay * bx;
+}
+
+// can vertex a be merged into its neighbor b?
+static bool mcCanCollapse(McMesh &m, int a, int b, std::vector< int > &na, std::vector< int > &nb, std::vector< int > &nc)
+{
+  mcNeighbors(m, a, na);
+  mcNeighbors(m, b, nb);
+
+  // link condition: the edge is in exactly two faces and a and b share no other neighbor,
+  // and neither of the two opposite vertices is left with fewer than 3 neighbors
+  int common = 0;
+  for (int vn : na) {
+    if (std::find(nb.begin(), nb.end(), vn) == nb.end()) continue;
+    if (++common > 2) return false;
+    mcNeighbors(m, vn, nc);
+    if (nc.size() <= 3) return false;
+  }
+  if (common != 2) return false;
+  if (na.size() + nb.size() - 4 > MG_MAX_VALENCE) return false;
+
+  // the faces of a that survive must not flip or degenerate when a moves to b
+  double const *pb = &m.xyz[3 * b];
+  for (int fno : m.vf[a]) {
+    int const *f = &m.fv[3 * fno];
+    if (f[0] == b || f[1] == b || f[2] == b) continue;
+    double const *p[3], *q[3];
+    for (int k = 0; k < 3; k++) {
+      p[k] = &m.xyz[3 * f[k]];
+      q[k] = f[k] == a ? pb : p[k];
+    }
+    double n0[3], n1[3];
+    mcNormal(p[0], p[1], p[2], n0);
+    mcNormal(q[0], q[1], q[2], n1);
+    double const len0 = sqrt(SQR(n0[0]) + SQR(n0[1]) + SQR(n0[2]));
+    double const len1 = sqrt(SQR(n1[0]) + SQR(n1[1]) + SQR(n1[2]));
+    if (FZERO(len1) || n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] < MG_MIN_FLIP_COS * len0 * len1) return false;
+  }
+  return true;
+}
+
+static void mcCollapse(McMesh &m, int a, int b)
+{
+  for (int fno : m.vf[a]) {
+    if (!m.faceAlive[fno]) continue;
+    int *f = &m.fv[3 * fno];
+    if (f[0] == b || f[1] == b || f[2] == b) {
+      m.faceAlive[fno] = 0;
+      continue;
+    }
+    for (int k = 0; k < 3; k++)
+      if (f[k] == a) f[k] = b;
+    m.vf[b].push_back(fno);
+  }
+  m.vf[a].clear();
+  m.parent[a] = b;
+  m.weight[b] += m.weight[a];
+  mcPruneFaces(m, b);
+}
+
+
+MRI_SURFACE *MRISdecimateByEdgeCollapse(MRI_SURFACE *mris, int target_nvertices, int which,
+                                        int *coarse_to_fine, int *fine_to_coarse)
+{
+  if (which != CURRENT_VERTICES && which != ORIGINAL_VERTICES)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRISdecimateByEdgeCollapse: unsupported vertex set %d", which));
+  if (mris->patch || MRIScountRipped(mris))
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRISdecimateByEdgeCollapse: needs a closed surface without ripped vertices"));
+
+  int const nvertices = mris->nvertices, nfaces = mris->nfaces;
+  McMesh m;
+  m.xyz.resize(3 * nvertices);
+  for (int vno = 0; vno < nvertices; vno++) {
+    VERTEX const *v = &mris->vertices[vno];
+    m.xyz[3 * vno + 0] = which == CURRENT_VERTICES ? v->x : v->origx;
+    m.xyz[3 * vno + 1] = which == CURRENT_VERTICES ? v->y : v->origy;
+    m.xyz[3 * vno + 2] = which == CURRENT_VERTICES ? v->z : v->origz;
+  }
+  m.fv.resize(3 * nfaces);
+  m.faceAlive.assign(nfaces, 1);
+  m.vf.resize(nvertices);
+  for (int fno = 0; fno < nfaces; fno++)
+    for (int k = 0; k < 3; k++) {
+      m.fv[3 * fno + k] = mris->faces[fno].v[k];
+      m.vf[mris->faces[fno].v[k]].push_back(fno);
+    }
+  m.parent.assign(nvertices, -1);
+  m.weight.assign(nvertices, 1);
+
+  std::priority_queue< McEdge > edges;
+  for (int vno = 0; vno < nvertices; vno++) {
+    VERTEX_TOPOLOGY const *vt = &mris->vertices_topology[vno];
+    for (int n = 0; n < vt->vnum; n++)
+      if (vt->v[n] > vno) edges.push({mcLen2(m, vno, vt->v[n]), vno, vt->v[n]});
+  }
+
+  int nalive = nvertices;
+  std::vector< int > na, nb, nc;
+  while (nalive > target_nvertices && !edges.empty()) {
+    McEdge const e = edges.top();
+    edges.pop();
+    if (m.parent[e.v0] >= 0 || m.parent[e.v1] >= 0) continue;
+
+    // merge the vertex that stands for fewer fine vertices into the other one
+    int a = e.v0, b = e.v1;
+    if (m.weight[b] < m.weight[a]) std::swap(a, b);
+    if (!mcCanCollapse(m, a, b, na, nb, nc)) {
+      std::swap(a, b);
+      if (!mcCanCollapse(m, a, b, na, nb, nc)) continue;
+    }
+    mcCollapse(m, a, b);
+    nalive--;
+
+    mcNeighbors(m, b, nb);
+    for (int vn : nb) edges.push({mcLen2(m, b, vn), std::min(b, vn), std::max(b, vn)});
+  }
+
+  // number the kept vertices in their fine order
+  std::vector< int > cno_of(nvertices, -1), fine_vno;
+  for (int vno = 0; vno < nvertices; vno++)
+    if (m.parent[vno] < 0) {
+      cno_of[vno] = fine_vno.size();
+      fine_vno.push_back(vno);
+    }
+  int ncfaces = 0;
+  for (int fno = 0; fno < nfaces; fno++) ncfaces += m.faceAlive[fno];
+
+  MRI_SURFACE *coarse = MRISalloc(fine_vno.size(), ncfaces);
+  MRIScopyMetadata(mris, coarse);
+  coarse->useRealRAS = mris->useRealRAS;
+  coarse->radius = mris->radius;
+  coarse->origxyz_status = mris->origxyz_status;
+  for (int cno = 0; cno < coarse->nvertices; cno++) {
+    VERTEX const *v = &mris->vertices[fine_vno[cno]];
+    MRISsetXYZ(coarse, cno, v->x, v->y, v->z);
+    MRISsetOriginalXYZ(coarse, cno, v->origx, v->origy, v->origz);
+  }
+
+  setFaceAttachmentDeferred(coarse, true);
+  for (int fno = 0, cfno = 0; fno < nfaces; fno++) {
+    if (!m.faceAlive[fno]) continue;
+    int const *f = &m.fv[3 * fno];
+    mrisAttachFaceToVertices(coarse, cfno++, cno_of[f[0]], cno_of[f[1]], cno_of[f[2]]);
+  }
+  setFaceAttachmentDeferred(coarse, false);
+  mrisCompleteTopology(coarse);
+  MRISsetNeighborhoodSizeAndDist(coarse, 3);  // as MRISread does
+  MRISresetNeighborhoodSize(coarse, 1);
+  MRIScomputeMetricProperties(coarse);
+
+  if (coarse_to_fine) std::copy(fine_vno.begin(), fine_vno.end(), coarse_to_fine);
+  if (fine_to_coarse)
+    for (int vno = 0; vno < nvertices; vno++) {
+      int root = vno;
+      while (m.parent[root] >= 0) root = m.parent[root];
+      fine_to_coarse[vno] = cno_of[root];
+    }
+
+  return (coarse);
+}
+
+
+// one level of the hierarchy and how it maps onto the next finer one
+struct MgLevel
+{
+  MRI_SURFACE *mris;
+  std::vector< int > coarse_to_fine;  // level vertex -> finer vertex
+  std::vector< int > fine_to_coarse;  // finer vertex -> level vertex it was merged into
+};
+
+static void mgBuildHierarchy(MRI_SURFACE *mris, int nlevels, int which, std::vector< MgLevel > &levels)
+{
+  levels.resize(1);
+  levels[0].mris = mris;
+  for (int l = 1; l <= nlevels; l++) {
+    MRI_SURFACE *finer = levels[l - 1].mris;
+    int const target = finer->nvertices / MG_DECIMATION;
+    if (target < MULTIGRID_MIN_VERTICES) break;
+
+    Timer timer;
+    MgLevel level;
+    level.coarse_to_fine.resize(finer->nvertices);
+    level.fine_to_coarse.resize(finer->nvertices);
+    level.mris = MRISdecimateByEdgeCollapse(finer, target, which, level.coarse_to_fine.data(), level.fine_to_coarse.data());
+    if (!level.mris) break;
+    level.coarse_to_fine.resize(level.mris->nvertices);
+    printf("multigrid level %d: %d vertices, %d faces (%2.1f s)\n", l, level.mris->nvertices, level.mris->nfaces,
+           timer.seconds());
+    levels.push_back(level);
+  }
+  if ((int)levels.size() <= nlevels)
+    printf("multigrid: surface too small for %d levels, using %d\n", nlevels, (int)levels.size() - 1);
+}
+
+static void mgFreeHierarchy(std::vector< MgLevel > &levels)
+{
+  for (unsigned int l = 1; l < levels.size(); l++) MRISfree(&levels[l].mris);
+  levels.resize(1);
+}
+
+// Fills the vals (nfields per vertex of fine) of the vertices that are not
+// on the coarse level with the harmonic interpolation of the values of the
+// ones that are: each becomes the average of its neighbors. Starts from the
+// value of the coarse vertex each one was merged into.
+static void mgInterpolate(MRI_SURFACE *fine, MgLevel const &level, std::vector< float > &vals, int nfields, double tol)
+{
+  int const nvertices = fine->nvertices;
+  std::vector< char > fixed(nvertices, 0);
+  for (int fvno : level.coarse_to_fine) fixed[fvno] = 1;
+  for (int vno = 0; vno < nvertices; vno++) {
+    if (fixed[vno]) continue;
+    int const src = level.coarse_to_fine[level.fine_to_coarse[vno]];
+    for (int k = 0; k < nfields; k++) vals[nfields * vno + k] = vals[nfields * src + k];
+  }
+
+  std::vector< float > next(vals);
+  int iter;
+  for (iter = 0; iter < MG_PROLONG_ITER; iter++) {
+    double max_change = 0;
+    int vno;
+    ROMP_PF_begin
+#ifdef HAVE_OPENMP
+    #pragma omp parallel for if_ROMP(assume_reproducible) reduction(max:max_change)
+#endif
+    for (vno = 0; vno < nvertices; vno++) {
+      ROMP_PFLB_begin
+      if (fixed[vno]) ROMP_PF_continue;
+      VERTEX_TOPOLOGY const *vt = &fine->vertices_topology[vno];
+      for (int k = 0; k < nfields; k++) {
+        double sum = 0;
+        for (int n = 0; n < vt->vnum; n++) sum += vals[nfields * vt->v[n] + k];
+        next[nfields * vno + k] = sum / vt->vnum;
+        max_change = MAX(max_change, fabs(next[nfields * vno + k] - vals[nfields * vno + k]));
+      }
+      ROMP_PFLB_end
+    }
+    ROMP_PF_end
+    vals.swap(next);
+    if (max_change < tol) break;
+  }
+  if (Gdiag & DIAG_SHOW) printf("multigrid: prolongation converged after %d sweeps\n", iter);
+}
+
+// INTEGRATION_PARMS for the solve on level l, logging to their own files
+static void mgLevelParms(INTEGRATION_PARMS *dst, INTEGRATION_PARMS const *parms, int l)
+{
+  INTEGRATION_PARMS_copy(dst, parms);
+  INTEGRATION_PARMS_setFp(dst, NULL);
+  int req = snprintf(dst->base_name, STRLEN, "%s.mg%d", parms->base_name, l);
+  if (req >= STRLEN) {
+    std::cerr << __FUNCTION__ << ": Truncation on line " << __LINE__ << std::endl;
+  }
+}
+
+// the gradient averaging on level l that covers the same distance on the
+// surface as base_averages on the full mesh (edges get twice as long per level)
+static int mgLevelAverages(int base_averages, int l, int refine)
+{
+  int n_averages = base_averages;
+  for (int i = 0; i < l + refine; i++) n_averages /= MG_DECIMATION;
+  return (n_averages);
+}
+
+
+// the positions of the level as the reference distances of its inflation
+static void mgSetReference(MRI_SURFACE *mris, int nsize)
+{
+  MRISsetNeighborhoodSizeAndDist(mris, nsize);
+  MRISsetOriginalXYZfromXYZ(mris);
+  mrisComputeOriginalVertexDistances(mris);
+  MRIScomputeMetricProperties(mris);
+}
+
+int MRISinflateBrainMultigrid(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int nlevels)
+{
+  std::vector< MgLevel > levels;
+  mgBuildHierarchy(mris, nlevels, CURRENT_VERTICES, levels);
+  int const ncoarse = levels.size() - 1;
+  if (ncoarse == 0) return (MRISinflateBrain(mris, parms));
+
+  int const base_averages = parms->n_averages;
+  int start_t = parms->start_t;
+  mgSetReference(levels[ncoarse].mris, mris->nsize);
+  MRISstoreMetricProperties(levels[ncoarse].mris);
+  levels[ncoarse].mris->orig_area = levels[ncoarse].mris->total_area;
+  for (int l = ncoarse; l >= 1; l--) {
+    MRI_SURFACE *coarse = levels[l].mris, *finer = levels[l - 1].mris;
+
+    INTEGRATION_PARMS level_parms;
+    mgLevelParms(&level_parms, parms, l);
+    level_parms.start_t = start_t;
+    level_parms.n_averages = mgLevelAverages(base_averages, l, l < ncoarse);
+    printf("multigrid level %d: inflating %d vertices from %d averages\n", l, coarse->nvertices, level_parms.n_averages);
+    MRISinflateBrain(coarse, &level_parms);
+    start_t = level_parms.start_t;
+    MRISprintDistortion(coarse, stdout, "multigrid level");
+
+    // The finer vertices go harmonically between the inflated coarse ones,
+    // which leaves none of the detail the coarse level could not smooth.
+    // Their sulc is the interpolated coarse one plus how far along the
+    // normal they moved onto the interpolation of the uninflated coarse mesh.
+    mgSetReference(finer, mris->nsize);
+    if (l > 1) {
+      MRISstoreMetricProperties(finer);
+      finer->orig_area = finer->total_area;
+    }
+    std::vector< float > vals(7 * finer->nvertices);
+    MgLevel const &level = levels[l];
+    for (int cno = 0; cno < coarse->nvertices; cno++) {
+      VERTEX const *vc = &coarse->vertices[cno];
+      VERTEX const *vf = &finer->vertices[level.coarse_to_fine[cno]];
+      float *val = &vals[7 * level.coarse_to_fine[cno]];
+      val[0] = vc->x;
+      val[1] = vc->y;
+      val[2] = vc->z;
+      val[3] = vf->x;
+      val[4] = vf->y;
+      val[5] = vf->z;
+      val[6] = vc->curv;
+    }
+    mgInterpolate(finer, level, vals, 7, MG_PROLONG_TOL * coarse->avg_vertex_dist);
+    for (int vno = 0; vno < finer->nvertices; vno++) {
+      VERTEX *v = &finer->vertices[vno];
+      float const *val = &vals[7 * vno];
+      v->curv = val[6] + (val[3] - v->x) * v->nx + (val[4] - v->y) * v->ny + (val[5] - v->z) * v->nz;
+      MRISsetXYZ(finer, vno, val[0], val[1], val[2]);
+    }
+    MRIScomputeMetricProperties(finer);
+  }
+
+  // the coarse levels did the steps with the most averaging. Continuing
+  // (start_t > 0) keeps the sulc and the reference distances set above.
+  parms->start_t = start_t;
+  parms->n_averages = mgLevelAverages(base_averages, 0, 1);
+  printf("multigrid level 0: inflating %d vertices from %d averages\n", mris->nvertices, parms->n_averages);
+  MRISinflateBrain(mris, parms);
+  parms->n_averages = base_averages;
+  mgFreeHierarchy(levels);
+
+  return (NO_ERROR);
+}
+
+
+MRI_SURFACE *MRISunfoldMultigrid(MRI_SURFACE *mris, INTEGRATION_PARMS *parms, int max_passes, int nlevels)
+{
+  // decimate the folded surface, whose distances and areas are the ones to keep
+  std::vector< MgLevel > levels;
+  mgBuildHierarchy(mris, nlevels, ORIGINAL_VERTICES, levels);
+  int const ncoarse = levels.size() - 1;
+  if (ncoarse == 0) return (MRISunfold(mris, parms, max_passes));
+
+  double fine_orig_area = 0;
+  for (int fno = 0; fno < mris->nfaces; fno++) fine_orig_area += getFaceOrigArea(mris, fno);
+
+  int const base_averages = parms->n_averages;
+  int start_t = parms->start_t;
+  for (int l = ncoarse; l >= 1; l--) {
+    MRI_SURFACE *coarse = levels[l].mris, *finer = levels[l - 1].mris;
+
+    // the original metric properties, as MRISreadOriginalProperties sets them
+    MRISsetNeighborhoodSize(coarse, mris->nsize);
+    MRISsaveVertexPositions(coarse, TMP_VERTICES);
+    MRISrestoreVertexPositions(coarse, ORIGINAL_VERTICES);
+    auto const status = coarse->status;
+    coarse->status = MRIS_PATCH;
+    MRIScomputeMetricProperties(coarse);
+    MRIScomputeTriangleProperties(coarse);
+    MRISstoreMetricProperties(coarse);
+    coarse->status = status;
+    MRISrestoreVertexPositions(coarse, TMP_VERTICES);
+    MRIScomputeMetricProperties(coarse);
+    MRIScomputeTriangleProperties(coarse);
+    double coarse_orig_area = 0;
+    for (int fno = 0; fno < coarse->nfaces; fno++) coarse_orig_area += getFaceOrigArea(coarse, fno);
+    coarse->orig_area = mris->orig_area * coarse_orig_area / fine_orig_area;
+
+    INTEGRATION_PARMS level_parms;
+    mgLevelParms(&level_parms, parms, l);
+    level_parms.start_t = start_t;
+    level_parms.n_averages = mgLevelAverages(base_averages, l, l < ncoarse);
+    if (level_parms.n_averages < parms->min_averages) level_parms.n_averages = parms->min_averages;
+    printf("multigrid level %d: unfolding %d vertices from %d averages\n", l, coarse->nvertices, level_parms.n_averages);
+    MRISunfold(coarse, &level_parms, max_passes);
+    start_t = level_parms.start_t;
+    MRISprintDistortion(coarse, stdout, "multigrid level");
+
+    // place the finer vertices harmonically between the coarse ones, which
+    // rarely folds them, and back onto the sphere
+    std::vector< float > vals(3 * finer->nvertices);
+    MgLevel const &level = levels[l];
+    for (int cno = 0; cno < coarse->nvertices; cno++) {
+      VERTEX const *vc = &coarse->vertices[cno];
+      float *val = &vals[3 * level.coarse_to_fine[cno]];
+      val[0] = vc->x;
+      val[1] = vc->y;
+      val[2] = vc->z;
+    }
+    mgInterpolate(finer, level, vals, 3, MG_PROLONG_TOL * coarse->avg_vertex_dist);
+    for (int vno = 0; vno < finer->nvertices; vno++)
+      MRISsetXYZ(finer, vno, vals[3 * vno + 0], vals[3 * vno + 1], vals[3 * vno + 2]);
+    MRISprojectOntoSphere(finer, finer, finer->radius);
+    MRIScomputeMetricProperties(finer);
+    printf("multigrid level %d: %d negative faces after prolongation\n", l - 1, MRIScountNegativeFaces(finer));
+
+    // The folds are few and small. Smoothing them out locally is much
+    // cheaper than the negative area removal MRISunfold would start with.
+    INTEGRATION_PARMS smooth_parms;
+    smooth_parms.niterations = MG_UNTANGLE_ITER;
+    MRISremoveOverlapWithSmoothing(finer, &smooth_parms);
+    printf("multigrid level %d: %d negative faces after smoothing\n", l - 1, MRIScountNegativeFaces(finer));
+  }
+  mgFreeHierarchy(levels);
+
+  parms->start_t = start_t;
+  parms->n_averages = mgLevelAverages(base_averages, 0, 1);
+  if (parms->n_averages < parms->min_averages) parms->n_averages = parms->min_averages;
+  printf("multigrid level 0: unfolding %d vertices from %d averages\n", mris->nvertices, parms->n_averages);
+  MRISunfold(mris, parms, max_passes);
+  parms->n_averages = base_averages;
+
+  return (mris);
+}
+
+
+int MRISprintDistortion(MRI_SURFACE *mris, FILE *fp, const char *label)
+{
+  double total_area = 0, total_orig_area = 0;
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    FACE const *f = &mris->faces[fno];
+    if (f->ripflag) continue;
+    total_area += fabs(f->area);
+    total_orig_area += getFaceOrigArea(mris, fno);
+  }
+  double const scale = total_area > 0 ? total_orig_area / total_area : 1;
+
+  double log_ratio = 0;
+  int nratios = 0;
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    FACE const *f = &mris->faces[fno];
+    float const orig_area = getFaceOrigArea(mris, fno);
+    if (f->ripflag || f->area <= 0 || orig_area <= 0) continue;
+    log_ratio += fabs(log(scale * f->area / orig_area));
+    nratios++;
+  }
+  if (nratios) log_ratio /= nratios;
+
+  // MRISunfold leaves the distances freed
+  bool have_dists = true;
+  for (int vno = 0; vno < mris->nvertices && have_dists; vno++) {
+    VERTEX const *v = &mris->vertices[vno];
+    if (!v->ripflag && mris->vertices_topology[vno].vtotal > 0 && (!v->dist || !v->dist_orig)) have_dists = false;
+  }
+
+  fprintf(fp, "%s distortion: %d vertices", label, mris->nvertices);
+  if (have_dists) fprintf(fp, ", distance error %%%2.2f", MRISpercentDistanceError(mris));
+  fprintf(fp, ", mean |log area ratio| %2.3f, %d negative faces", log_ratio, MRIScountNegativeFaces(mris));
+  if (mris->status != MRIS_SPHERE && mris->status != MRIS_PARAMETERIZED_SPHERE)
+    fprintf(fp, ", rms height %2.3f", MRISrmsTPHeight(mris));
+  fprintf(fp, "\n");
+  fflush(fp);
+
+  return (NO_ERROR);
+}
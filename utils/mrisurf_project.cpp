@@ -19,6 +19,7 @@
  */
 #include "mrisurf_project.h"
 #include "mrisurf_base.h"
+#include "mrisurf_MRIS_MP.h"
 
 /* project onto the sphere of radius DEFAULT_RADIUS */
 void mrisSphericalProjectXYZ(float xs, float ys, float zs, float *xd, float *yd, float *zd)
@@ -155,7 +156,37 @@ MRIS* MRISprojectOntoSphere(MRIS* mris, double r)
 
 MRIS_MP* MRISprojectOntoSphere(MRIS_MP* mris, double r)
 {
-  cheapAssert(false);
+  // Only done for surfaces that are already spheres, so unlike the MRIS version there is no centering to do.
+  // The MRIS version finishes by orienting the faces, but that is redone by the MRIScomputeMetricProperties
+  // that must follow this anyway, so it is not done here.
+  //
+  cheapAssert(mris->status == MRIS_SPHERE || mris->status == MRIS_PARAMETERIZED_SPHERE);
+  cheapAssert(!FZERO(r) && r == mris->radius);     // the radius of an MRIS_MP can not be changed
+
+  MRISfreeDistsButNotOrig(mris);
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(assume_reproducible)
+#endif
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    ROMP_PFLB_begin
+    if (mris->v_ripflag[vno]) ROMP_PF_continue;
+
+    double const x = mris->v_x[vno], x2 = x*x;
+    double const y = mris->v_y[vno], y2 = y*y;
+    double const z = mris->v_z[vno], z2 = z*z;
+
+    double const dist = sqrt(x2 + y2 + z2);
+    double const d = FZERO(dist) ? 0 : (1 - r / dist);
+
+    mris->v_x[vno] = x - d * x;
+    mris->v_y[vno] = y - d * y;
+    mris->v_z[vno] = z - d * z;
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
   return mris;
 }
 
@@ -201,6 +201,89 @@ struct SseTerms_DistortedSurfaces : public SseTermsBase {
         return sse_spring;
     }
 
+    // SpringEnergy, LaplacianEnergy and TangentialSpringEnergy all sweep the 1-hop neighbours of every vertex,
+    // so MRIScomputeSSE gets whichever of them are enabled from this one pass instead of one pass each.
+    // Each sum is computed exactly as the single term does it, only the partial sums are added in a different order.
+    //
+    void SpringEnergies(bool do_spring, bool do_lap, bool do_tspring, double* p_sse_spring, double* p_sse_lap, double* p_sse_tspring)
+    {
+        double sse_spring = 0.0, sse_lap = 0.0, sse_tspring = 0.0;
+
+        #define ROMP_VARIABLE       vno
+        #define ROMP_LO             vnoBegin
+        #define ROMP_HI             vnoEnd
+
+        #define ROMP_SUMREDUCTION0  sse_spring
+        #define ROMP_SUMREDUCTION1  sse_lap
+        #define ROMP_SUMREDUCTION2  sse_tspring
+
+        #define ROMP_FOR_LEVEL      ROMP_level_assume_reproducible
+
+#ifdef ROMP_SUPPORT_ENABLED
+        const int romp_for_line = __LINE__;
+#endif
+        #include "romp_for_begin.h"
+        ROMP_for_begin
+
+            #define sse_spring   ROMP_PARTIALSUM(0)
+            #define sse_lap      ROMP_PARTIALSUM(1)
+            #define sse_tspring  ROMP_PARTIALSUM(2)
+
+            auto const v = surface.vertices(vno);
+            if (v.ripflag()) ROMP_PF_continue;
+
+            float const x = v.x(), v_nx = v.nx();
+            float const y = v.y(), v_ny = v.ny();
+            float const z = v.z(), v_nz = v.nz();
+
+            double vx = 0.0, vy = 0.0, vz = 0.0;
+            if (do_lap) {
+                vx = v.x() - v.t2x(); vy = v.y() - v.t2y(); vz = v.z() - v.t2z();
+            }
+
+            double v_spring = 0.0, v_lap = 0.0, v_tspring = 0.0;
+            for (int n = 0; n < v.vnum(); n++) {
+                if (do_spring) {
+                    v_spring += square(v.dist(n));
+                }
+
+                auto const vn = v.v(n);
+
+                if (do_lap) {
+                    double const vnx = vn.x() - vn.t2x(), vny = vn.y() - vn.t2y(), vnz = vn.z() - vn.t2z();
+                    double const dx  = vnx - vx, dy = vny - vy, dz = vnz - vz;
+                    v_lap += square(dx) + square(dy) + square(dz);
+                }
+
+                if (do_tspring) {
+                    float dx = vn.x() - x;
+                    float dy = vn.y() - y;
+                    float dz = vn.z() - z;
+
+                    float const nc = dx * v_nx + dy * v_ny + dz * v_nz;
+                    dx -= nc * v_nx;
+                    dy -= nc * v_ny;
+                    dz -= nc * v_nz;
+
+                    float const dist_sq = square(dx) + square(dy) + square(dz);
+                    v_tspring += dist_sq;
+                }
+            }
+
+            sse_spring  += area_scale * v_spring;
+            sse_lap     += area_scale * v_lap;
+            sse_tspring += area_scale * v_tspring;
+
+            #undef sse_spring
+            #undef sse_lap
+            #undef sse_tspring
+        #include "romp_for_end.h"
+
+        *p_sse_spring  = sse_spring;
+        *p_sse_lap     = sse_lap;
+        *p_sse_tspring = sse_tspring;
+    }
+
     //========================================
     // Error terms that iterate over the vertices, but not their neighbours
     //
@@ -354,6 +437,19 @@ double SseTerms_MRIS::TangentialSpringEnergy()
     return SseTerms_Template_for_SurfaceFromMRIS::TangentialSpringEnergy();
 }
 
+void mrisComputeSpringEnergies(MRIS* mris, INTEGRATION_PARMS *parms, double *sse_spring, double *sse_lap, double *sse_tspring)
+{
+    SseTerms_MRIS sseTerms(mris, -1);
+    sseTerms.SpringEnergies(!DZERO(parms->l_spring), !DZERO(parms->l_lap), !DZERO(parms->l_tspring),
+                            sse_spring, sse_lap, sse_tspring);
+}
+
+bool mrisCheckFusedTerms()
+{
+    static bool const check = !!getenv("FREESURFER_checkFusedTerms");
+    return check;
+}
+
 // Error terms
 //
 
@@ -2681,30 +2777,31 @@ double vlst_loglikelihood2D(MRIS *mris, MRI *mri, int vno, double displacement,
 // These are in the order the original code computed them, so that side effects are not reordered
 // In older code the ashburner_triangle is computed but not used , here it is not computed at all
 
-// The ELTS terms have a working overloading of mrisCompute### that can take a SurfaceFromMRIS_MP::XYZPositionConsequences::Surface as their first parameter
-//      They are implemented below in template <class _Surface> struct SseTerms_DistortedSurfaces {...}
+// The ELTS terms are also computed by MRIScomputeSSE(MRIS_MP*), from the properties an MRIS_MP holds
 //
 // The ELTM terms have a working overloading of mrisCompute### that can take a MRIS* as their first parameter
 //      They also have an asserting overloading that can take a SurfaceFromMRIS_MP::XYZPositionConsequences::Surface as their first parameter
 //      which will not be called because MRIScomputeSSE_canDo(MRIS_MP* usedOnlyForOverloadingResolution, INTEGRATION_PARMS *parms) returns false for these
 //
+// The COND must be false whenever the term is zero, so MRIScomputeSSE_canDo(MRIS_MP*) can tell which of the ELTM terms are in use
+//
 #define SSE_TERMS \
-      ELTM(sse_area                  , parms->l_parea,                            true,    computed_area                                                                   ) \
-      ELTM(sse_neg_area              , parms->l_area,                             true,    computed_neg_area                                                               ) \
+      ELTS(sse_area                  , parms->l_parea,                            true,    computed_area                                                                   ) \
+      ELTS(sse_neg_area              , parms->l_area,                             true,    computed_neg_area                                                               ) \
       ELTM(sse_repulse               , 1.0,                     (parms->l_repulse > 0),    mrisComputeRepulsiveEnergy(mris, parms->l_repulse, mht_v_current, mht_f_current)) \
-      ELTM(sse_repulsive_ratio       , 1.0,                                       true,    mrisComputeRepulsiveRatioEnergy(mris, parms->l_repulse_ratio)                   ) \
-      ELTM(sse_tsmooth               , 1.0,                                       true,    mrisComputeThicknessSmoothnessEnergy(mris, parms->l_tsmooth, parms)             ) \
-      ELTM(sse_thick_min             , parms->l_thick_min,                        true,    mrisComputeThicknessMinimizationEnergy(mris, parms->l_thick_min, parms)         ) \
+      ELTM(sse_repulsive_ratio       , 1.0,                    !FZERO(parms->l_repulse_ratio),  mrisComputeRepulsiveRatioEnergy(mris, parms->l_repulse_ratio)              ) \
+      ELTM(sse_tsmooth               , 1.0,                    !FZERO(parms->l_tsmooth),   mrisComputeThicknessSmoothnessEnergy(mris, parms->l_tsmooth, parms)             ) \
+      ELTM(sse_thick_min             , parms->l_thick_min,     !FZERO(parms->l_thick_min), mrisComputeThicknessMinimizationEnergy(mris, parms->l_thick_min, parms)         ) \
       ELTM(sse_ashburner_triangle    , parms->l_ashburner_triangle,               false,   mrisComputeAshburnerTriangleEnergy(mris, parms->l_ashburner_triangle, parms)    ) \
-      ELTM(sse_thick_parallel        , parms->l_thick_parallel,                   true,    mrisComputeThicknessParallelEnergy(mris, parms->l_thick_parallel, parms)        ) \
-      ELTM(sse_thick_normal          , parms->l_thick_normal,                     true,    mrisComputeThicknessNormalEnergy(mris, parms->l_thick_normal, parms)            ) \
-      ELTM(sse_thick_spring          , parms->l_thick_spring,                     true,    mrisComputeThicknessSpringEnergy(mris, parms->l_thick_spring, parms)            ) \
-      ELTM(sse_nl_area               , parms->l_nlarea,        !FZERO(parms->l_nlarea),    mrisComputeNonlinearAreaSSE(mris)                                               ) \
+      ELTM(sse_thick_parallel        , parms->l_thick_parallel,!FZERO(parms->l_thick_parallel), mrisComputeThicknessParallelEnergy(mris, parms->l_thick_parallel, parms)   ) \
+      ELTM(sse_thick_normal          , parms->l_thick_normal,  !FZERO(parms->l_thick_normal),   mrisComputeThicknessNormalEnergy(mris, parms->l_thick_normal, parms)       ) \
+      ELTM(sse_thick_spring          , parms->l_thick_spring,  !FZERO(parms->l_thick_spring),   mrisComputeThicknessSpringEnergy(mris, parms->l_thick_spring, parms)       ) \
+      ELTS(sse_nl_area               , parms->l_nlarea,        !FZERO(parms->l_nlarea),    mrisComputeNonlinearAreaSSE(mris)                                               ) \
       ELTM(sse_nl_dist               , parms->l_nldist,        !DZERO(parms->l_nldist),    mrisComputeNonlinearDistanceSSE(mris)                                           ) \
-      ELTM(sse_dist                  , parms->l_dist,          !DZERO(parms->l_dist),      mrisComputeDistanceError(mris, parms)                                           ) \
-      ELTM(sse_spring                , parms->l_spring,        !DZERO(parms->l_spring),    mrisComputeSpringEnergy(mris)                                                   ) \
-      ELTM(sse_lap                   , parms->l_lap,           !DZERO(parms->l_lap),       mrisComputeLaplacianEnergy(mris)                                                ) \
-      ELTM(sse_tspring               , parms->l_tspring,       !DZERO(parms->l_tspring),   mrisComputeTangentialSpringEnergy(mris)                                         ) \
+      ELTS(sse_dist                  , parms->l_dist,          !DZERO(parms->l_dist),      mrisComputeDistanceError(mris, parms)                                           ) \
+      ELTS(sse_spring                , parms->l_spring,        !DZERO(parms->l_spring),    fused_spring                                                                    ) \
+      ELTM(sse_lap                   , parms->l_lap,           !DZERO(parms->l_lap),       fused_lap                                                                       ) \
+      ELTS(sse_tspring               , parms->l_tspring,       !DZERO(parms->l_tspring),   fused_tspring                                                                   ) \
       ELTM(sse_nlspring              , parms->l_nlspring,      !DZERO(parms->l_nlspring),  mrisComputeNonlinearSpringEnergy(mris, parms)                                   ) \
       ELTM(sse_curv                  , l_curv_scaled,          !DZERO(parms->l_curv),      mrisComputeQuadraticCurvatureSSE(mris, parms->l_curv)                           ) \
       ELTM(sse_corr                  , l_corr,                 !DZERO(l_corr),             mrisComputeCorrelationError(mris, parms, 1)                                     ) \
@@ -2868,12 +2965,32 @@ double MRIScomputeSSE_template(Surface surface, Some_MRIS* mris, INTEGRATION_PAR
   }
 
 
+  // sse_spring, sse_lap and sse_tspring come out of one sweep over the vertex neighbourhoods
+  //
+  double fused_spring = 0, fused_lap = 0, fused_tspring = 0;
+  if (!DZERO(parms->l_spring) || !DZERO(parms->l_lap) || !DZERO(parms->l_tspring)) {
+    mrisComputeSpringEnergies(mris, parms, &fused_spring, &fused_lap, &fused_tspring);
+  }
+
 #define ELTS(NAME, MULTIPLIER, COND, EXPR) double const NAME = (COND) ? (EXPR) : 0.0;
 #define ELTM(NAME, MULTIPLIER, COND, EXPR) double const NAME = (COND) ? (EXPR) : 0.0;
     SSE_TERMS
 #undef ELTM
 #undef ELTS
 
+  if (mrisCheckFusedTerms()) {
+    // compare the fused terms with the terms computed one at a time
+    #define ELT(NAME, COND, EXPR) \
+      if (COND) { double const single = (EXPR); \
+        if (fabs(single - NAME) > 1e-9 * std::max(1.0, fabs(single))) \
+          fprintf(stdout, "%s:%d fused %s %g differs from single term %g\n", __FILE__, __LINE__, #NAME, NAME, single); \
+      }
+    ELT(sse_spring,  !DZERO(parms->l_spring),  mrisComputeSpringEnergy(mris))
+    ELT(sse_lap,     !DZERO(parms->l_lap),     mrisComputeLaplacianEnergy(mris))
+    ELT(sse_tspring, !DZERO(parms->l_tspring), mrisComputeTangentialSpringEnergy(mris))
+    #undef ELT
+  }
+
   if (parms->l_thick_spring > 0 || parms->l_thick_min > 0 || parms->l_thick_parallel > 0 /* && DIAG_VERBOSE_ON*/)
     printf("min=%2.3f, parallel=%2.4f, normal=%2.4f, spring=%2.4f, ashburner=%2.3f, tsmooth=%2.3f\n",
            sse_thick_min            / (float)mris->nvertices,
@@ -2982,39 +3099,271 @@ double MRIScomputeSSE(MRIS* mris, INTEGRATION_PARMS *parms)
 }
 
 
-bool MRIScomputeSSE_canDo(MRIS_MP* usedOnlyForOverloadingResolution, INTEGRATION_PARMS *parms)
+// The MRIS_MP versions of the ELTS terms that SseTerms_DistortedSurfaces can not do for an MRIS_MP
+// They do the same arithmetic as the MRIS versions, but always sum reproducibly because they are run inside
+// the parallel line-search probes
+//
+void mrismp_ComputeFaceRelevantAngleAndArea(MRIS_MP* mris, INTEGRATION_PARMS *parms, double* p_relevant_angle, double* p_computed_neg_area, double* p_computed_area)
+{
+  double const area_scale =
+#if METRIC_SCALE
+    (mris->patch || mris->noscale) ? 1.0 : mris->orig_area / mris->total_area;
+#else
+    1.0;
+#endif
+
+  double relevant_angle = 0, computed_neg_area = 0, computed_area = 0;
+
+  #define ROMP_VARIABLE       fno
+  #define ROMP_LO             0
+  #define ROMP_HI             mris->nfaces
+    
+  #define ROMP_SUMREDUCTION0  relevant_angle
+  #define ROMP_SUMREDUCTION1  computed_neg_area
+  #define ROMP_SUMREDUCTION2  computed_area
+    
+  #define ROMP_FOR_LEVEL      ROMP_level_assume_reproducible
+    
+#ifdef ROMP_SUPPORT_ENABLED
+  const int romp_for_line = __LINE__;
+#endif
+  #include "romp_for_begin.h"
+  ROMP_for_begin
+    
+    #define relevant_angle    ROMP_PARTIALSUM(0)
+    #define computed_neg_area ROMP_PARTIALSUM(1)
+    #define computed_area     ROMP_PARTIALSUM(2)
+
+    if (mris->f_ripflag[fno]) ROMP_PF_continue;
+
+    {
+      float  const area  = mris->f_area[fno];
+      double const delta = (double)(area_scale * area - mris->f_norm_orig_area[fno]);
+#if ONLY_NEG_AREA_TERM
+      if (area < 0.0f) computed_neg_area += delta * delta;
+#endif
+      computed_area += delta * delta;
+    }
+      
+    for (int ano = 0; ano < ANGLES_PER_TRIANGLE; ano++) {
+      float const angle = mris->f_angle[fno][ano];
+      double delta = deltaAngle(angle, mris->f_orig_angle[fno][ano]);
+#if ONLY_NEG_AREA_TERM
+      if (angle >= 0.0f) delta = 0.0f;
+#endif
+      relevant_angle += delta * delta;
+    }
+      
+    if (!std::isfinite(computed_area) || !std::isfinite(relevant_angle)) {
+      ErrorExit(ERROR_BADPARM, "sse not finite at face %d!\n", fno);
+    }
+
+    #undef relevant_angle
+    #undef computed_neg_area
+    #undef computed_area
+
+  #include "romp_for_end.h"
+
+  *p_relevant_angle    = relevant_angle;
+  *p_computed_neg_area = computed_neg_area;
+  *p_computed_area     = computed_area;
+}
+
+
+static double mrismp_ComputeDistanceError(MRIS_MP* mris, INTEGRATION_PARMS *parms)
 {
-#if 1
-  return false;
+  // The MRIS version has already been run on the unmoved surface by the time a MRIS_MP is evaluated,
+  // so the checks for missing distances and zero dist_orig are not repeated here
+  //
+  double dist_scale;
+#if METRIC_SCALE
+  if (mris->patch) {
+    dist_scale = 1.0;
+  }
+  else if (mris->status == MRIS_PARAMETERIZED_SPHERE) {
+    dist_scale = sqrt(mris->orig_area / mris->total_area);
+  }
+  else
+    dist_scale = mris->neg_area < mris->total_area ? sqrt(mris->orig_area / (mris->total_area - mris->neg_area))
+                                                   : sqrt(mris->orig_area / mris->total_area);
 #else
+  dist_scale = 1.0;
+#endif
+
+  double sse_dist = 0.0;
+
+  #define ROMP_VARIABLE       vno 
+  #define ROMP_LO             0
+  #define ROMP_HI             mris->nvertices
+    
+  #define ROMP_SUMREDUCTION0  sse_dist
+    
+  #define ROMP_FOR_LEVEL      ROMP_level_assume_reproducible
+    
+#ifdef ROMP_SUPPORT_ENABLED
+  const int romp_for_line = __LINE__;
+#endif
+  #include "romp_for_begin.h"
+  ROMP_for_begin
+    
+    #define sse_dist ROMP_PARTIALSUM(0)
+
+    if (mris->v_ripflag[vno]) ROMP_PF_continue;
+
+#if NO_NEG_DISTANCE_TERM
+    if (mris->v_neg[vno]) ROMP_PF_continue;
+#endif
+
+    VERTEX_TOPOLOGY const * const vt        = &mris->vertices_topology[vno];
+    float           const * const dist      = mris->v_dist     [vno];
+    float           const * const dist_orig = mris->v_dist_orig[vno];
+
+    double v_sse = 0.0;
+    for (int n = 0; n < vt->vtotal; n++) {
+      if (mris->v_ripflag[vt->v[n]]) continue;
+
+#if NO_NEG_DISTANCE_TERM
+      if (mris->v_neg[vt->v[n]]) continue;
+#endif
+      float const dist_orig_n = !dist_orig ? 0.0 : dist_orig[n];
+      if (dist_orig_n >= UNFOUND_DIST) continue;
+
+      double delta = dist_scale * dist[n] - dist_orig_n;
+      if (parms->vsmoothness)
+        v_sse += (1.0 - parms->vsmoothness[vno]) * (delta * delta);
+      else
+        v_sse += delta * delta;
+    }
+
+    sse_dist += v_sse;
+
+    #undef sse_dist 
+  #include "romp_for_end.h"
+
+  return sse_dist;
+}
+
+
+static void mrismp_ComputeSpringEnergies(MRIS_MP* mris, double* p_sse_spring, double* p_sse_tspring, bool do_spring, bool do_tspring)
+{
+  double const area_scale = mris->patch ? 1.0 : (mris->orig_area / mris->total_area);
+
+  double sse_spring = 0.0, sse_tspring = 0.0;
+
+  #define ROMP_VARIABLE       vno
+  #define ROMP_LO             0
+  #define ROMP_HI             mris->nvertices
+
+  #define ROMP_SUMREDUCTION0  sse_spring
+  #define ROMP_SUMREDUCTION1  sse_tspring
+
+  #define ROMP_FOR_LEVEL      ROMP_level_assume_reproducible
+
+#ifdef ROMP_SUPPORT_ENABLED
+  const int romp_for_line = __LINE__;
+#endif
+  #include "romp_for_begin.h"
+  ROMP_for_begin
+
+    #define sse_spring   ROMP_PARTIALSUM(0)
+    #define sse_tspring  ROMP_PARTIALSUM(1)
+
+    if (mris->v_ripflag[vno]) ROMP_PF_continue;
+
+    VERTEX_TOPOLOGY const * const vt   = &mris->vertices_topology[vno];
+    float           const * const dist = mris->v_dist[vno];
+
+    float const x = mris->v_x[vno], v_nx = mris->v_nx[vno];
+    float const y = mris->v_y[vno], v_ny = mris->v_ny[vno];
+    float const z = mris->v_z[vno], v_nz = mris->v_nz[vno];
+
+    double v_spring = 0.0, v_tspring = 0.0;
+    for (int n = 0; n < vt->vnum; n++) {
+      if (do_spring) {
+        v_spring += square(dist[n]);
+      }
+
+      if (do_tspring) {
+        int const vno2 = vt->v[n];
+        float dx = mris->v_x[vno2] - x;
+        float dy = mris->v_y[vno2] - y;
+        float dz = mris->v_z[vno2] - z;
+
+        float const nc = dx * v_nx + dy * v_ny + dz * v_nz;
+        dx -= nc * v_nx;
+        dy -= nc * v_ny;
+        dz -= nc * v_nz;
+
+        float const dist_sq = square(dx) + square(dy) + square(dz);
+        v_tspring += dist_sq;
+      }
+    }
+
+    sse_spring  += area_scale * v_spring;
+    sse_tspring += area_scale * v_tspring;
+
+    #undef sse_spring
+    #undef sse_tspring
+  #include "romp_for_end.h"
+
+  *p_sse_spring  = sse_spring;
+  *p_sse_tspring = sse_tspring;
+}
+
+
+bool MRIScomputeSSE_canDo(MRIS_MP* usedOnlyForOverloadingResolution, INTEGRATION_PARMS *parms)
+{
   bool   const use_multiframes  = !!(parms->flags & IP_USE_MULTIFRAMES);
   double const l_corr           = (double)(parms->l_corr + parms->l_pcorr);
 
-  bool result = true;
+  // parms->dist_error would be written by each of the MRIS_MP being evaluated
+  //
+  if (gMRISexternalSSE || parms->dist_error) return false;
+
 #define ELTS(NAME, MULTIPLIER, COND, EXPR)
-#define ELTM(NAME, MULTIPLIER, COND, EXPR) \
-  if (COND) { static bool reported = false; \
-    if (!reported) { reported = true; fprintf(stdout, "%s:%d can't do %s %s\n", __FILE__,__LINE__,#NAME,#EXPR); } \
-    result = false; \
-  }
+#define ELTM(NAME, MULTIPLIER, COND, EXPR) if (COND) return false;
   SSE_TERMS
-  ELTM(sse_init,1.0,gMRISexternalSSE,)
 #undef ELTM
 #undef ELTS
 
-  return result;
-#endif
+  return true;
 }
 
 
-double MRIScomputeSSE(MRIS_MP* mris_mp, INTEGRATION_PARMS *parms)
+double MRIScomputeSSE(MRIS_MP* mris, INTEGRATION_PARMS *parms)
 {
-#if 1
-  return 0.0;
-#else
-  SurfaceFromMRIS_MP::XYZPositionConsequences::Surface surface(mris_mp);
-  return MRIScomputeSSE_template(surface,mris_mp,parms);    
-#endif
+  cheapAssert(MRIScomputeSSE_canDo(mris, parms));
+
+  double relevant_angle = 0, computed_neg_area = 0, computed_area = 0;
+  if (!FZERO(parms->l_angle) || !FZERO(parms->l_area) || (!FZERO(parms->l_parea))) {
+    mrismp_ComputeFaceRelevantAngleAndArea(mris, parms, &relevant_angle, &computed_neg_area, &computed_area);
+  }
+
+  double fused_spring = 0, fused_tspring = 0;
+  if (!DZERO(parms->l_spring) || !DZERO(parms->l_tspring)) {
+    mrismp_ComputeSpringEnergies(mris, &fused_spring, &fused_tspring, !DZERO(parms->l_spring), !DZERO(parms->l_tspring));
+  }
+
+  SseTerms_Template_for_SurfaceFromMRIS_MP sseTerms(SSE_Surface_types_MRIS_MP(mris), -1);
+
+  double const sse_nl_area = !FZERO(parms->l_nlarea) ? sseTerms.NonlinearAreaSSE()                : 0.0;
+  double const sse_dist    = !DZERO(parms->l_dist)   ? mrismp_ComputeDistanceError(mris, parms)    : 0.0;
+
+  // The ELTS terms in the SSE_TERMS order.  MRIScomputeSSE_canDo has checked all the ELTM terms are zero.
+  //
+  double const sse = 0.0
+    + parms->l_parea   * computed_area
+    + parms->l_area    * computed_neg_area
+    + parms->l_nlarea  * sse_nl_area
+    + parms->l_dist    * sse_dist
+    + parms->l_spring  * fused_spring
+    + parms->l_tspring * fused_tspring;
+
+  if (!devFinite(sse)) {
+    DiagBreak();
+  }
+
+  return sse;
 }
 
 #undef SSE_TERMS
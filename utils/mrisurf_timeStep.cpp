@@ -2346,19 +2346,15 @@ int MRISexpandSurface(MRI_SURFACE *mris, float distance, INTEGRATION_PARMS *parm
               }
             }
           }
-          mrisComputeSpringTerm(mris, parms->l_spring);
+          mrisComputeSpringTerms(mris, parms->l_spring, parms->l_spring_norm, parms->l_nspring, parms->l_tspring, parms->l_lap);
           mrisComputeConvexityTerm(mris, parms->l_convex);
-          mrisComputeLaplacianTerm(mris, parms->l_lap);
-          mrisComputeNormalizedSpringTerm(mris, parms->l_spring_norm);
           mrisComputeThicknessSmoothnessTerm(mris, parms->l_tsmooth, parms);
           mrisComputeThicknessMinimizationTerm(mris, parms->l_thick_min, parms);
           mrisComputeThicknessParallelTerm(mris, parms->l_thick_parallel, parms);
-          mrisComputeNormalSpringTerm(mris, parms->l_nspring);
           mrisComputeSurfaceNormalIntersectionTerm(mris, mht, parms->l_norm, 0.1);
           mrisComputeQuadraticCurvatureTerm(mris, parms->l_curv);
           mrisComputeMaxSpringTerm(mris, parms->l_max_spring);
           mrisComputeNonlinearSpringTerm(mris, parms->l_nlspring, parms);
-          mrisComputeTangentialSpringTerm(mris, parms->l_tspring);
           mrisComputeNonlinearTangentialSpringTerm(mris, parms->l_nltspring, parms->min_dist);
           mrisComputeAngleAreaTerms(mris, parms);
           MRISaverageGradients(mris, avgs);
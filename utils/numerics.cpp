@@ -1093,32 +1093,32 @@ int OpenLUMatrixInverse(MATRIX *iMatrix, MATRIX *oInverse)
   // NO_ERROR from error.h
   int errorCode = NO_ERROR;
 
-  vnl_matrix< float > vnlMatrix(iMatrix->data, iMatrix->rows, iMatrix->cols);
-
-  unsigned int r = vnlMatrix.rows();
-  if (r <= 4 && r == vnlMatrix.cols()) {
+  // the small fixed-size matrices are built straight from the data, so the
+  // 3x3 and 4x4 inverses done in loops do not allocate
+  unsigned int r = iMatrix->rows;
+  if (r <= 4 && (int)r == iMatrix->cols) {
     if (r == 1) {
-      if (vnlMatrix(0, 0) == 0.0)
+      if (iMatrix->data[0] == 0.0)
         errorCode = ERROR_BADPARM;
       else
-        oInverse->data[0] = 1.0 / vnlMatrix(0, 0);
+        oInverse->data[0] = 1.0 / iMatrix->data[0];
     }
     else if (r == 2) {
-      vnl_matrix_fixed< float, 2, 2 > m(vnlMatrix);
+      vnl_matrix_fixed< float, 2, 2 > m(iMatrix->data);
       if (vnl_det(m) == 0.0)
         errorCode = ERROR_BADPARM;
       else
         vnl_inverse(m).copy_out(oInverse->data);
     }
     else if (r == 3) {
-      vnl_matrix_fixed< float, 3, 3 > m(vnlMatrix);
+      vnl_matrix_fixed< float, 3, 3 > m(iMatrix->data);
       if (vnl_det(m) == 0.0)
         errorCode = ERROR_BADPARM;
       else
         vnl_inverse(m).copy_out(oInverse->data);
     }
     else {
-      vnl_matrix_fixed< float, 4, 4 > m(vnlMatrix);
+      vnl_matrix_fixed< float, 4, 4 > m(iMatrix->data);
       if (vnl_det(m) == 0.0)
         errorCode = ERROR_BADPARM;
       else
@@ -1128,6 +1128,8 @@ int OpenLUMatrixInverse(MATRIX *iMatrix, MATRIX *oInverse)
 
   else  // > 4x4 matrices
   {
+    vnl_matrix< float > vnlMatrix(iMatrix->data, iMatrix->rows, iMatrix->cols);
+
     // the svd matrix inversion failed a test case, whereas qr passes, so we're
     // going to use the qr generated inverse
     vnl_qr< float > vnlMatrixInverter(vnlMatrix);
@@ -1200,17 +1202,16 @@ float OpenMatrixDeterminant(MATRIX *iMatrix)
   float determinant = 0.0;
 
   if (iMatrix->rows == iMatrix->cols) {
-    vnl_matrix< float > vnlMatrix(iMatrix->data, iMatrix->rows, iMatrix->cols);
-    if (vnlMatrix.rows() == 1)
-      determinant = vnlMatrix(0, 0);
-    else if (vnlMatrix.rows() == 2)
-      determinant = vnl_det(vnl_matrix_fixed< float, 2, 2 >(vnlMatrix));
-    else if (vnlMatrix.rows() == 3)
-      determinant = vnl_det(vnl_matrix_fixed< float, 3, 3 >(vnlMatrix));
-    else if (vnlMatrix.rows() == 4)
-      determinant = vnl_det(vnl_matrix_fixed< float, 4, 4 >(vnlMatrix));
+    if (iMatrix->rows == 1)
+      determinant = iMatrix->data[0];
+    else if (iMatrix->rows == 2)
+      determinant = vnl_det(vnl_matrix_fixed< float, 2, 2 >(iMatrix->data));
+    else if (iMatrix->rows == 3)
+      determinant = vnl_det(vnl_matrix_fixed< float, 3, 3 >(iMatrix->data));
+    else if (iMatrix->rows == 4)
+      determinant = vnl_det(vnl_matrix_fixed< float, 4, 4 >(iMatrix->data));
     else
-      determinant = vnl_determinant< float >(vnlMatrix);
+      determinant = vnl_determinant< float >(vnl_matrix< float >(iMatrix->data, iMatrix->rows, iMatrix->cols));
   }
 
   return determinant;
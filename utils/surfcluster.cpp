@@ -41,6 +41,57 @@
 
 static int sclustCompare(const void *a, const void *b);
 
+/* ------------------------------------------------------------
+   sclustLabelVertices() - union-find labeling of the vertices whose
+   value is in range (val[vtx] if val is not NULL, otherwise the val
+   field of the vertex). On return parent[vtx] is -1 for vertices out
+   of range and -(n+2) for vertices in the nth cluster, where clusters
+   are numbered by their lowest vertex, ie, in the order in which a
+   seed scan over the vertices would find them. Returns the number of
+   clusters. Does not change the surface.
+   ------------------------------------------------------------ */
+static int sclustLabelVertices(const MRI_SURFACE *Surf, const float *val, float thmin, float thmax, int thsign,
+                               int *parent)
+{
+  int vtx, nbr, ncomp;
+
+  /* Vertices in range start out as their own root */
+  for (vtx = 0; vtx < Surf->nvertices; vtx++) {
+    float v = val ? val[vtx] : Surf->vertices[vtx].val;
+    parent[vtx] = clustValueInRange(v, thmin, thmax, thsign) ? vtx : -1;
+  }
+
+  /* Merge along the edges. The root is always the lowest vertex of
+     the cluster. */
+  for (vtx = 0; vtx < Surf->nvertices; vtx++) {
+    if (parent[vtx] < 0) continue;
+    VERTEX_TOPOLOGY const * const vt = &Surf->vertices_topology[vtx];
+    for (nbr = 0; nbr < vt->vnum; nbr++) {
+      int a = vtx, b = vt->v[nbr];
+      if (parent[b] < 0) continue;
+      while (parent[a] != a) a = parent[a] = parent[parent[a]];
+      while (parent[b] != b) b = parent[b] = parent[parent[b]];
+      if (a < b)
+        parent[b] = a;
+      else if (b < a)
+        parent[a] = b;
+    }
+  }
+
+  /* Number the clusters in vertex order. Parents precede their
+     children so they already hold -(n+2). */
+  ncomp = 0;
+  for (vtx = 0; vtx < Surf->nvertices; vtx++) {
+    int p = parent[vtx];
+    if (p == -1) continue;
+    if (p == vtx)
+      parent[vtx] = -(ncomp++ + 2);
+    else
+      parent[vtx] = parent[p];
+  }
+  return (ncomp);
+}
+
 /* ------------------------------------------------------------
    sclustMapSurfClusters() - grows a clusters on the surface.  The
    cluster is a list of contiguous vertices that that meet the
@@ -48,40 +99,53 @@ static int sclustCompare(const void *a, const void *b);
    point. Rather, the clusters are mapped using using the undefval
    element of the MRI_SURF structure. If a vertex meets the cluster
    criteria, then undefval is set to the cluster number.
+
+   The clusters are found with a union-find over the edges between
+   vertices in range rather than by growing each one from a seed
+   (sclustGrowSurfCluster()), which recurses once per vertex and
+   needs a pass over the surface per cluster to get its area. The
+   clusters, their numbering (by lowest vertex number, with the
+   clusters below minarea removed) and their areas are the same.
    ------------------------------------------------------------ */
 SCS *sclustMapSurfClusters(MRI_SURFACE *Surf, float thmin, float thmax, int thsign, 
 			   float minarea, int *nClusters, MATRIX *XFM, MRI *fwhmmap)
 {
   SCS *scs, *scs_sorted;
-  int vtx, vtx_inrange, vtx_clustno, CurrentClusterNo;
-  float vtx_val, ClusterArea;
-  int nVtxsInCluster;
+  int vtx, n, ncomp, CurrentClusterNo;
+  int *parent, *compno;
+  float *ClusterArea;
 
-  /* initialized all cluster numbers to 0 */
   for (vtx = 0; vtx < Surf->nvertices; vtx++) Surf->vertices[vtx].undefval = 0; /* overloads this elem of struct */
-
-  /* Go through each vertex looking for one that meets the threshold
-     criteria and has not been previously assigned to a cluster.
-     When found, grow it out. */
-  CurrentClusterNo = 1;
-  for (vtx = 0; vtx < Surf->nvertices; vtx++) {
-    vtx_val = Surf->vertices[vtx].val;
-    vtx_clustno = Surf->vertices[vtx].undefval;
-    vtx_inrange = clustValueInRange(vtx_val, thmin, thmax, thsign);
-
-    if (vtx_clustno == 0 && vtx_inrange) {
-      sclustGrowSurfCluster(CurrentClusterNo, vtx, Surf, thmin, thmax, thsign);
-      if (minarea > 0) {
-        /* If the cluster does not meet the area criteria, delete it */
-        ClusterArea = sclustSurfaceArea(CurrentClusterNo, Surf, &nVtxsInCluster);
-        if (ClusterArea < minarea) {
-          sclustZeroSurfaceClusterNo(CurrentClusterNo, Surf);
-          continue;
-        }
-      }
-      CurrentClusterNo++;
+  parent = (int *)calloc(Surf->nvertices + 1, sizeof(int));
+  ncomp = sclustLabelVertices(Surf, NULL, thmin, thmax, thsign, parent);
+
+  /* Remove the clusters that do not meet the area criteria. The area
+     is summed in vertex order as in sclustSurfaceArea() */
+  compno = (int *)calloc(ncomp + 1, sizeof(int));
+  ClusterArea = (float *)calloc(ncomp + 1, sizeof(float));
+  if (minarea > 0) {
+    for (vtx = 0; vtx < Surf->nvertices; vtx++) {
+      if (parent[vtx] == -1) continue;
+      if (!Surf->group_avg_vtxarea_loaded)
+        ClusterArea[-parent[vtx] - 2] += Surf->vertices[vtx].area;
+      else
+        ClusterArea[-parent[vtx] - 2] += Surf->vertices[vtx].group_avg_area;
+    }
+    if (Surf->group_avg_surface_area > 0 && !Surf->group_avg_vtxarea_loaded) {
+      for (n = 0; n < ncomp; n++) ClusterArea[n] *= (Surf->group_avg_surface_area / Surf->total_area);
     }
   }
+  CurrentClusterNo = 1;
+  for (n = 0; n < ncomp; n++) {
+    if (minarea > 0 && ClusterArea[n] < minarea) continue;
+    compno[n] = CurrentClusterNo++;
+  }
+  for (vtx = 0; vtx < Surf->nvertices; vtx++)
+    if (parent[vtx] != -1) Surf->vertices[vtx].undefval = compno[-parent[vtx] - 2];
+
+  free(parent);
+  free(compno);
+  free(ClusterArea);
 
   *nClusters = CurrentClusterNo - 1;
   if (*nClusters == 0) return (NULL);
@@ -781,6 +845,66 @@ float sclustMaxClusterWeightVtx(SURFCLUSTERSUM *scs, int nClusters, int thsign)
   return (maxw);
 }
 
+/*-------------------------------------------------------------------
+  sclustMaxClusterStats() - computes the number of clusters and the
+  maximum cluster area, vertex count and vertex weight for the values
+  in val (one per vertex). The results are the same as those of
+  sclustMapSurfClusters() (with minarea=0 and no fwhmmap) followed by
+  sclustMaxClusterArea(), sclustMaxClusterCount() and
+  sclustMaxClusterWeightVtx(), but the surface is not changed (val and
+  undefval are not used) so it can be called from several threads at
+  once, eg, to evaluate a batch of simulated fields.
+  -------------------------------------------------------------------*/
+int sclustMaxClusterStats(const MRI_SURFACE *Surf, const float *val, float thmin, float thmax, int thsign,
+                          int *nClusters, double *maxarea, int *maxcount, float *maxweightvtx)
+{
+  int vtx, n, ncomp, *parent;
+  int ClusterUseAvgVertexArea = 0;
+  double *weightvtx, avgvertexarea;
+  SCS *scs;
+
+  if (Surf->group_avg_vtxarea_loaded)
+    avgvertexarea = Surf->group_avg_surface_area / Surf->nvertices;
+  else
+    avgvertexarea = Surf->total_area / Surf->nvertices;
+  if (getenv("FS_CLUSTER_USE_AVG_VERTEX_AREA") != NULL)
+    sscanf(getenv("FS_CLUSTER_USE_AVG_VERTEX_AREA"), "%d", &ClusterUseAvgVertexArea);
+
+  parent = (int *)calloc(Surf->nvertices + 1, sizeof(int));
+  ncomp = sclustLabelVertices(Surf, val, thmin, thmax, thsign, parent);
+
+  // Same accumulation as SurfClusterSummary()
+  scs = (SCS *)calloc(ncomp + 1, sizeof(SCS));
+  weightvtx = (double *)calloc(ncomp + 1, sizeof(double));
+  for (vtx = 0; vtx < Surf->nvertices; vtx++) {
+    float vtxarea;
+    if (parent[vtx] == -1) continue;
+    n = -parent[vtx] - 2;
+    scs[n].nmembers++;
+    if (ClusterUseAvgVertexArea == 0) {
+      if (!Surf->group_avg_vtxarea_loaded)
+        vtxarea = Surf->vertices[vtx].area;
+      else
+        vtxarea = Surf->vertices[vtx].group_avg_area;
+    }
+    else
+      vtxarea = avgvertexarea;
+    scs[n].area += vtxarea;
+    weightvtx[n] += val[vtx];
+  }
+  for (n = 0; n < ncomp; n++) scs[n].weightvtx = weightvtx[n];
+
+  *nClusters = ncomp;
+  *maxarea = sclustMaxClusterArea(scs, ncomp);
+  *maxcount = sclustMaxClusterCount(scs, ncomp);
+  *maxweightvtx = sclustMaxClusterWeightVtx(scs, ncomp, thsign);
+
+  free(parent);
+  free(weightvtx);
+  free(scs);
+  return (0);
+}
+
 /*---------------------------------------------------------------*/
 SCS *sclustPruneByCWPval(SCS *ClusterList, int nclusters, double cwpvalthresh, int *nPruned, MRIS *surf)
 {
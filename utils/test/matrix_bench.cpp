@@ -0,0 +1,147 @@
+/**
+ * @brief times the loop and BLAS/LAPACK paths of the MATRIX operations
+ *
+ * For each size the same random inputs are run once with the backend off
+ * and once with it forced on, and the time per call and the largest
+ * difference between the two results are printed (for the SVD, between
+ * the singular values). The 4x4 line times the fixed-size kernels and the
+ * inverse the way the transform code calls them.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "matrix.h"
+#include "timer.h"
+
+const char *Progname = "matrix_bench";
+
+// largest absolute difference, without MatrixMaxAbsDiff's threshold report
+static double maxAbsDiff(MATRIX *m1, MATRIX *m2)
+{
+  double dmax = 0;
+  for (int r = 1; r <= m1->rows; r++)
+    for (int c = 1; c <= m1->cols; c++) dmax = fmax(dmax, fabs(m1->rptr[r][c] - m2->rptr[r][c]));
+  return dmax;
+}
+
+// a well conditioned n x n matrix, so the inverses can be compared
+static MATRIX *randomSquare(int n)
+{
+  MATRIX *m = MatrixDRand48ZeroMean(n, n, NULL);
+  for (int i = 1; i <= n; i++) m->rptr[i][i] += n;
+  return m;
+}
+
+enum Op { MULTIPLY, MULTIPLYD, ATB, MTM, INVERSE, SVD, NOPS };
+static const char *opNames[NOPS] = {"MatrixMultiply", "MatrixMultiplyD", "MatrixAtB", "MatrixMtM", "MatrixInverse", "MatrixSVD"};
+
+static MATRIX *runOp(int op, MATRIX *a, MATRIX *b, MATRIX *out)
+{
+  switch (op) {
+    case MULTIPLY:
+      return MatrixMultiply(a, b, out);
+    case MULTIPLYD:
+      return MatrixMultiplyD(a, b, out);
+    case ATB:
+      return MatrixAtB(a, b, out);
+    case MTM:
+      return MatrixMtM(a, out);
+    case INVERSE:
+      return MatrixInverse(a, out);
+    case SVD: {
+      // MatrixSVD overwrites its input with U, the singular values are the result
+      MATRIX *u = MatrixCopy(a, NULL);
+      MATRIX *v = MatrixSVD(u, out ? out : (out = RVectorAlloc(a->cols, MATRIX_REAL)), NULL);
+      MatrixFree(&u);
+      MatrixFree(&v);
+      return out;
+    }
+  }
+  return NULL;
+}
+
+// ms per call of op at the current threshold
+static double timeOp(int op, MATRIX *a, MATRIX *b, MATRIX **out, int reps)
+{
+  *out = runOp(op, a, b, *out);  // warm up and allocate the output
+  Timer timer;
+  for (int i = 0; i < reps; i++) runOp(op, a, b, *out);
+  return timer.nanoseconds() * 1e-6 / reps;
+}
+
+static void benchSize(int n, int reps)
+{
+  MATRIX *a = randomSquare(n);
+  MATRIX *b = randomSquare(n);
+
+  for (int op = 0; op < NOPS; op++) {
+    MATRIX *loop_out = NULL, *blas_out = NULL;
+    int op_reps = (op == SVD || op == INVERSE) ? (reps + 3) / 4 : reps;
+
+    MatrixBlasThreshold(-1);
+    double loop_ms = timeOp(op, a, b, &loop_out, op_reps);
+    MatrixBlasThreshold(0);
+    double blas_ms = timeOp(op, a, b, &blas_out, op_reps);
+
+    printf("%-16s %5d  loop %10.4f ms  blas %10.4f ms  speedup %6.2f  maxdiff %g\n",
+           opNames[op], n, loop_ms, blas_ms, loop_ms / blas_ms, maxAbsDiff(loop_out, blas_out));
+    MatrixFree(&loop_out);
+    MatrixFree(&blas_out);
+  }
+
+  MatrixFree(&a);
+  MatrixFree(&b);
+}
+
+// a point transform, an inverse and a product of 4x4s, into preallocated outputs
+static void benchSmall(int reps)
+{
+  MATRIX *m = MatrixAlloc(4, 4, MATRIX_REAL), *t = randomSquare(4), *inv = MatrixAlloc(4, 4, MATRIX_REAL);
+  VECTOR *v = VectorAlloc(4, MATRIX_REAL), *vout = VectorAlloc(4, MATRIX_REAL);
+  VECTOR_ELT(v, 4) = 1;
+
+  reps *= 1000;
+  Timer timer;
+  for (int i = 0; i < reps; i++) {
+    MatrixMultiply(t, v, vout);
+    MatrixInverse(t, inv);
+    MatrixMultiply(t, inv, m);
+  }
+  printf("4x4 transform   %7d  %10.4f us per point, product and inverse\n", reps, timer.nanoseconds() * 1e-3 / reps);
+
+  MatrixFree(&m);
+  MatrixFree(&t);
+  MatrixFree(&inv);
+  VectorFree(&v);
+  VectorFree(&vout);
+}
+
+int main(int argc, char *argv[])
+{
+  int max_size = argc > 1 ? atoi(argv[1]) : 512;
+  int reps = argc > 2 ? atoi(argv[2]) : 4;
+
+  if (!MatrixBlasAvailable()) printf("built without BLAS/LAPACK, both columns time the loops\n");
+
+  double const default_threshold = MatrixBlasThreshold(-1);
+  printf("default threshold %g multiply-adds\n", default_threshold);
+
+  benchSmall(reps);
+  for (int n = 16; n <= max_size; n *= 2) benchSize(n, reps);
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * @brief MRIScomputeMetricPropertiesIncremental tests
+ *
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include "mrisurf.h"
+#include "mrisurf_metricProperties.h"
+#include "icosahedron.h"
+#include "utils.h"
+#include <math.h>
+#include <stdio.h>
+
+#define CHECK(COND) if (!(COND)) { printf("%s failed at line %d\n", #COND, __LINE__); fails++; }
+
+const char *Progname = "metric_incremental_test";
+
+static bool differs(double incremental, double full)
+{
+  return fabs(incremental - full) > 1e-3 * (1.0 + fabs(full));
+}
+
+// Compares the incrementally updated properties of mris with those of a copy
+// that has them computed from scratch
+static int compareWithFull(MRIS *mris, const char *what)
+{
+  MRIS *full = MRISclone(mris);
+  MRIScomputeMetricProperties(full);
+  MRIScomputeTriangleProperties(full);  // the only one that sets the face angles
+
+  int nfaces = 0, nvertices = 0, ndists = 0, ntotals = 0;
+
+  for (int fno = 0; fno < mris->nfaces; fno++) {
+    FACE const * const f0 = &mris->faces[fno];
+    FACE const * const f1 = &full->faces[fno];
+    if (f0->ripflag) continue;
+    FaceNormCacheEntry const * const n0 = getFaceNorm(mris, fno);
+    FaceNormCacheEntry const * const n1 = getFaceNorm(full, fno);
+    if (differs(f0->area, f1->area) || differs(n0->nx, n1->nx) || differs(n0->ny, n1->ny) || differs(n0->nz, n1->nz) ||
+        differs(f0->angle[0], f1->angle[0]) || differs(f0->angle[1], f1->angle[1]) || differs(f0->angle[2], f1->angle[2])) {
+      if (nfaces++ < 5) printf("%s: face %d area %g != %g\n", what, fno, f0->area, f1->area);
+    }
+  }
+
+  for (int vno = 0; vno < mris->nvertices; vno++) {
+    VERTEX_TOPOLOGY const * const vt = &mris->vertices_topology[vno];
+    VERTEX          const * const v0 = &mris->vertices[vno];
+    VERTEX          const * const v1 = &full->vertices[vno];
+    if (v0->ripflag) continue;
+    if (differs(v0->area, v1->area) || differs(v0->nx, v1->nx) || differs(v0->ny, v1->ny) || differs(v0->nz, v1->nz)) {
+      if (nvertices++ < 5) printf("%s: vertex %d area %g != %g\n", what, vno, v0->area, v1->area);
+    }
+    for (int n = 0; n < vt->vtotal; n++) {
+      if (differs(v0->dist[n], v1->dist[n]) && ndists++ < 5)
+        printf("%s: vertex %d dist %d %g != %g\n", what, vno, n, v0->dist[n], v1->dist[n]);
+    }
+  }
+
+  double const totals0[] = {mris->total_area, mris->neg_area, mris->avg_vertex_area,
+                            mris->avg_vertex_dist, mris->std_vertex_dist,
+                            mris->xlo, mris->xhi, mris->ylo, mris->yhi, mris->zlo, mris->zhi,
+                            mris->xctr, mris->yctr, mris->zctr};
+  double const totals1[] = {full->total_area, full->neg_area, full->avg_vertex_area,
+                            full->avg_vertex_dist, full->std_vertex_dist,
+                            full->xlo, full->xhi, full->ylo, full->yhi, full->zlo, full->zhi,
+                            full->xctr, full->yctr, full->zctr};
+  for (unsigned int i = 0; i < sizeof(totals0) / sizeof(totals0[0]); i++) {
+    if (differs(totals0[i], totals1[i])) {
+      ntotals++;
+      printf("%s: total %d %g != %g\n", what, i, totals0[i], totals1[i]);
+    }
+  }
+
+  MRISfree(&full);
+
+  int fails = 0;
+  CHECK(nfaces == 0);
+  CHECK(nvertices == 0);
+  CHECK(ndists == 0);
+  CHECK(ntotals == 0);
+  return fails;
+}
+
+// Moves a few vertices at a time, as a local repair or smoothing does
+static int testLocalMoves(MRIS const *ico, MRIS_Status status, int nripped)
+{
+  int fails = 0;
+
+  MRIS *mris = MRISclone(ico);
+  mris->status = status;
+  MRISsetNeighborhoodSizeAndDist(mris, 2);
+  for (int vno = 0; vno < nripped; vno++) mris->vertices[97 * vno].ripflag = 1;
+  MRISsetRipInFacesWithRippedVertices(mris);
+  MRIScomputeMetricProperties(mris);
+  MRIScomputeTriangleProperties(mris);  // for the face angles
+
+  MRIS_INCREMENTAL_METRIC *im = MRISallocIncrementalMetric(mris);
+
+  for (int step = 0; step < 20; step++) {
+    int vnos[2];
+    vnos[0] = (step * 977 + 13) % mris->nvertices;
+    vnos[1] = mris->vertices_topology[vnos[0]].v[0];
+    for (int i = 0; i < 2; i++) {
+      VERTEX * const v = &mris->vertices[vnos[i]];
+      v->x += 0.3 * sin(step + i);
+      v->y += 0.3 * cos(2 * step + i);
+      v->z += 0.2 * sin(3 * step - i);
+    }
+    MRIScomputeMetricPropertiesIncremental(mris, im, vnos, 2);
+    fails += compareWithFull(mris, "local move");
+  }
+
+  // pull the vertex on the +x side of the bounding box inward
+  int xmax = 0;
+  for (int vno = 1; vno < mris->nvertices; vno++)
+    if (mris->vertices[vno].x > mris->vertices[xmax].x) xmax = vno;
+  mris->vertices[xmax].x -= 5;
+  MRIScomputeMetricPropertiesIncremental(mris, im, &xmax, 1);
+  fails += compareWithFull(mris, "bounding box");
+
+  MRISfreeIncrementalMetric(&im);
+  CHECK(im == NULL);
+  MRISfree(&mris);
+
+  return fails;
+}
+
+int main(int argc, char *argv[])
+{
+  int fails = 0;
+
+  // outward facing, with a radius of 100. Each ic2562_make_surface() call flips
+  // the winding of the next one, so make it only once.
+  MRIS *ico = ic2562_make_surface(0, 0);
+  MRISreverseFaceOrder(ico);
+  for (int vno = 0; vno < ico->nvertices; vno++) {
+    VERTEX * const v = &ico->vertices[vno];
+    v->x *= 100;
+    v->y *= 100;
+    v->z *= 100;
+  }
+
+  fails += testLocalMoves(ico, MRIS_SURFACE, 0);
+  fails += testLocalMoves(ico, MRIS_SURFACE, 5);
+  fails += testLocalMoves(ico, MRIS_ELLIPSOID, 0);
+  fails += testLocalMoves(ico, MRIS_SPHERE, 0);
+
+  MRISfree(&ico);
+
+  if (fails) {
+    printf("%d failures\n", fails);
+    return 1;
+  }
+  return 0;
+}
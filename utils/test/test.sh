@@ -7,6 +7,7 @@ test_command extest
 test_command inftest
 test_command test_TriangleFile_readWrite
 test_command topology_test
+test_command metric_incremental_test
 test_command tiff_write_image
 test_command sc_test
 test_command sse_mathfun_test
@@ -0,0 +1,522 @@
+/**
+ * @brief sparse vertex-by-voxel sampling matrices for volume-to-surface mapping
+ *
+ * See vol2surfmat.h. The matrix is stored in compressed sparse row form,
+ * one row per vertex. Each row holds the voxels (and weights) that the
+ * vertex samples over all projection depths, already divided by the number
+ * of depths, so applying the matrix to a frame gives the same value as
+ * sampling every depth and averaging.
+ */
+/*
+ * Copyright © 2021 The General Hospital Corporation (Boston, MA) "MGH"
+ *
+ * Terms and conditions for use, reproduction, distribution and contribution
+ * are found in the 'FreeSurfer Software License Agreement' contained
+ * in the file 'LICENSE' found in the FreeSurfer distribution, and here:
+ *
+ * https://surfer.nmr.mgh.harvard.edu/fswiki/FreeSurferSoftwareLicense
+ *
+ * Reporting: freesurfer@nmr.mgh.harvard.edu
+ *
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "diag.h"
+#include "error.h"
+#include "fio.h"
+#include "macros.h"
+#include "matrix.h"
+#include "mri.h"
+#include "mri2.h"
+#include "resample.h"
+#include "timer.h"
+#include "vol2surfmat.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+typedef std::pair<int, float> V2S_ENTRY;  // voxel index, weight
+
+// FNV-1a, good enough to tell surfaces and registrations apart
+static unsigned long long v2sHash(unsigned long long h, const void *data, size_t nbytes)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t n = 0; n < nbytes; n++) {
+    h ^= p[n];
+    h *= 1099511628211ULL;
+  }
+  return (h);
+}
+
+/*!
+  \fn unsigned long long MRIvol2surfMatKey(const MRI *SrcVol, const MATRIX *ras2vox, const MRI_SURFACE *surf,
+                                           const MRI *vsm, const VOL2SURF_SAMPLING *vs)
+  \brief Hash of the voxel grid, the surface->voxel transform, the surface
+  coordinates (plus normals and thickness when projecting), the shift map
+  and the sampling options. Two matrices with the same key are the same.
+*/
+unsigned long long MRIvol2surfMatKey(const MRI *SrcVol, const MATRIX *ras2vox, const MRI_SURFACE *surf,
+                                     const MRI *vsm, const VOL2SURF_SAMPLING *vs)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  int dims[3] = {SrcVol->width, SrcVol->height, SrcVol->depth};
+  h = v2sHash(h, dims, sizeof(dims));
+  for (int r = 1; r <= 4; r++)
+    for (int c = 1; c <= 4; c++) h = v2sHash(h, &ras2vox->rptr[r][c], sizeof(float));
+
+  int opts[5] = {vs->InterpMethod, vs->float2int, vs->ProjDist, vs->SkipRipped, vs->nproj};
+  h = v2sHash(h, opts, sizeof(opts));
+  h = v2sHash(h, vs->ProjFrac, vs->nproj * sizeof(float));
+
+  int project = 0;
+  for (int p = 0; p < vs->nproj; p++)
+    if (vs->ProjFrac[p] != 0) project = 1;
+
+  h = v2sHash(h, &surf->nvertices, sizeof(int));
+  for (int vno = 0; vno < surf->nvertices; vno++) {
+    const VERTEX *v = &surf->vertices[vno];
+    float xyz[3] = {v->x, v->y, v->z};
+    h = v2sHash(h, xyz, sizeof(xyz));
+    if (project) {
+      float nxyz[4] = {v->nx, v->ny, v->nz, v->curv};
+      h = v2sHash(h, nxyz, sizeof(nxyz));
+    }
+    if (vs->SkipRipped) h = v2sHash(h, &v->ripflag, sizeof(v->ripflag));
+  }
+
+  if (vsm) {
+    for (int s = 0; s < vsm->depth; s++)
+      for (int r = 0; r < vsm->height; r++)
+        for (int c = 0; c < vsm->width; c++) {
+          float val = MRIgetVoxVal(vsm, c, r, s, 0);
+          h = v2sHash(h, &val, sizeof(float));
+        }
+  }
+  return (h);
+}
+
+/*
+  Finds the voxels sampled by one vertex at one depth. Follows the geometry
+  of vol2surf_linear() and MRIvol2surfVSM() exactly. Returns the index of
+  the nearest voxel or -1 if the sample falls outside of the volume.
+*/
+static int v2sSampleVertex(const MRI *SrcVol, const double *M, const MRI_SURFACE *surf, const MRI *vsm,
+                           const VOL2SURF_SAMPLING *vs, int vno, float ProjFrac, float w,
+                           std::vector<V2S_ENTRY> &row)
+{
+  const VERTEX *v = &surf->vertices[vno];
+  float Tx, Ty, Tz;
+  int icol, irow, islc;
+
+  if (ProjFrac != 0.0) {
+    if (vs->ProjDist)
+      ProjNormDist(&Tx, &Ty, &Tz, surf, vno, ProjFrac);
+    else
+      ProjNormFracThick(&Tx, &Ty, &Tz, surf, vno, ProjFrac);
+  }
+  else {
+    Tx = v->x;
+    Ty = v->y;
+    Tz = v->z;
+  }
+
+  float fcol = M[0] * Tx + M[1] * Ty + M[2] * Tz + M[3];
+  float frow = M[4] * Tx + M[5] * Ty + M[6] * Tz + M[7];
+  float fslc = M[8] * Tx + M[9] * Ty + M[10] * Tz + M[11];
+
+  switch (vs->float2int) {
+    case FLT2INT_FLOOR:
+      icol = (int)floor(fcol);
+      irow = (int)floor(frow);
+      islc = (int)floor(fslc);
+      break;
+    case FLT2INT_TKREG:
+      icol = (int)floor(fcol);
+      irow = (int)ceil(frow);
+      islc = (int)floor(fslc);
+      break;
+    default:
+      icol = nint(fcol);
+      irow = nint(frow);
+      islc = nint(fslc);
+      break;
+  }
+
+  if (irow < 0 || irow >= SrcVol->height || icol < 0 || icol >= SrcVol->width || islc < 0 || islc >= SrcVol->depth)
+    return (-1);
+
+  if (vsm) {
+    // shift along the rows, don't sample outside of the B0 mask
+    int cvsm = floor(fcol);
+    int rvsm = floor(frow);
+    if (cvsm < 0 || cvsm + 1 >= vsm->width) return (-1);
+    if (rvsm < 0 || rvsm + 1 >= vsm->height) return (-1);
+    if (fabs(MRIgetVoxVal(vsm, cvsm, rvsm, islc, 0)) < FLT_MIN) return (-1);
+    if (fabs(MRIgetVoxVal(vsm, cvsm + 1, rvsm, islc, 0)) < FLT_MIN) return (-1);
+    if (fabs(MRIgetVoxVal(vsm, cvsm, rvsm + 1, islc, 0)) < FLT_MIN) return (-1);
+    if (fabs(MRIgetVoxVal(vsm, cvsm + 1, rvsm + 1, islc, 0)) < FLT_MIN) return (-1);
+    float rshift;
+    MRIsampleSeqVolume(vsm, fcol, frow, fslc, &rshift, 0, 0);
+    if (rshift == 0) return (-1);
+    frow += rshift;
+    irow = nint(frow);
+    if (irow < 0 || irow >= SrcVol->height) return (-1);
+  }
+
+  int width = SrcVol->width, height = SrcVol->height, depth = SrcVol->depth;
+  int hit = icol + irow * width + islc * width * height;
+
+  if (vs->InterpMethod != SAMPLE_TRILINEAR) {
+    row.push_back(V2S_ENTRY(hit, w));
+    return (hit);
+  }
+
+  // same corner selection and clamping as MRIsampleSeqVolume(). Samples it
+  // would set to outside_val contribute nothing.
+  if (MRIindexNotInVolume(SrcVol, fcol, frow, fslc) == 1) return (hit);
+  double x = fcol, y = frow, z = fslc;
+  if (x >= width) x = width - 1.0;
+  if (y >= height) y = height - 1.0;
+  if (z >= depth) z = depth - 1.0;
+  if (x < 0.0) x = 0.0;
+  if (y < 0.0) y = 0.0;
+  if (z < 0.0) z = 0.0;
+  int xm = MAX((int)x, 0), xp = MIN(width - 1, xm + 1);
+  int ym = MAX((int)y, 0), yp = MIN(height - 1, ym + 1);
+  int zm = MAX((int)z, 0), zp = MIN(depth - 1, zm + 1);
+  double xmd = x - xm, ymd = y - ym, zmd = z - zm;
+  double xpd = 1.0 - xmd, ypd = 1.0 - ymd, zpd = 1.0 - zmd;
+  int xs[2] = {xm, xp}, ys[2] = {ym, yp}, zs[2] = {zm, zp};
+  double wx[2] = {xpd, xmd}, wy[2] = {ypd, ymd}, wz[2] = {zpd, zmd};
+  for (int k = 0; k < 2; k++)
+    for (int j = 0; j < 2; j++)
+      for (int i = 0; i < 2; i++) {
+        double cw = wx[i] * wy[j] * wz[k];
+        if (cw == 0) continue;
+        row.push_back(V2S_ENTRY(xs[i] + ys[j] * width + zs[k] * width * height, w * cw));
+      }
+  return (hit);
+}
+
+/*!
+  \fn MRI_VOL2SURF_MAT *MRIvol2surfMatBuild(const MRI *SrcVol, const MATRIX *ras2vox, const MRI_SURFACE *surf,
+                                            const MRI *vsm, const VOL2SURF_SAMPLING *vs)
+  \brief Builds the vertex-by-voxel sampling matrix. ras2vox maps surface
+  xyz to SrcVol col,row,slice (eg, inv(tkvox2ras)*register.dat). vsm is
+  an optional voxel shift map (as in MRIvol2surfVSM()). Only the geometry
+  of SrcVol is used.
+*/
+MRI_VOL2SURF_MAT *MRIvol2surfMatBuild(const MRI *SrcVol, const MATRIX *ras2vox, const MRI_SURFACE *surf,
+                                      const MRI *vsm, const VOL2SURF_SAMPLING *vs)
+{
+  if (vs->InterpMethod != SAMPLE_NEAREST && vs->InterpMethod != SAMPLE_TRILINEAR)
+    ErrorReturn(NULL,
+                (ERROR_UNSUPPORTED, "MRIvol2surfMatBuild: interpolation method %d not supported", vs->InterpMethod));
+  if (vs->nproj < 1) ErrorReturn(NULL, (ERROR_BADPARM, "MRIvol2surfMatBuild: no projection depths"));
+  if (vsm && MRIdimMismatch(vsm, SrcVol, 0))
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIvol2surfMatBuild: vsm dimension mismatch"));
+
+  Timer timer;
+  double M[12];
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 4; c++) M[r * 4 + c] = ras2vox->rptr[r + 1][c + 1];
+
+  MRI_VOL2SURF_MAT *m = (MRI_VOL2SURF_MAT *)calloc(1, sizeof(MRI_VOL2SURF_MAT));
+  m->nvertices = surf->nvertices;
+  m->width = SrcVol->width;
+  m->height = SrcVol->height;
+  m->depth = SrcVol->depth;
+  m->nproj = vs->nproj;
+  m->key = MRIvol2surfMatKey(SrcVol, ras2vox, surf, vsm, vs);
+  m->hitvox = (int *)calloc((size_t)m->nvertices * m->nproj, sizeof(int));
+  m->rowptr = (long long *)calloc(m->nvertices + 1, sizeof(long long));
+
+  std::vector<std::vector<V2S_ENTRY> > rows(m->nvertices);
+  float w = 1.0 / vs->nproj;
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for schedule(dynamic, 1024)
+#endif
+  for (int vno = 0; vno < m->nvertices; vno++) {
+    std::vector<V2S_ENTRY> &row = rows[vno];
+    int *hits = &m->hitvox[(size_t)vno * m->nproj];
+    if (vs->SkipRipped && surf->vertices[vno].ripflag) {
+      for (int p = 0; p < m->nproj; p++) hits[p] = -1;
+      continue;
+    }
+    for (int p = 0; p < m->nproj; p++)
+      hits[p] = v2sSampleVertex(SrcVol, M, surf, vsm, vs, vno, vs->ProjFrac[p], w, row);
+
+    // merge the voxels shared by several depths
+    std::sort(row.begin(), row.end());
+    size_t n = 0;
+    for (size_t k = 0; k < row.size(); k++) {
+      if (n > 0 && row[n - 1].first == row[k].first)
+        row[n - 1].second += row[k].second;
+      else
+        row[n++] = row[k];
+    }
+    row.resize(n);
+  }
+
+  for (int vno = 0; vno < m->nvertices; vno++) m->rowptr[vno + 1] = m->rowptr[vno] + rows[vno].size();
+  m->nnz = m->rowptr[m->nvertices];
+  m->col = (int *)calloc(m->nnz > 0 ? m->nnz : 1, sizeof(int));
+  m->weight = (float *)calloc(m->nnz > 0 ? m->nnz : 1, sizeof(float));
+  for (int vno = 0; vno < m->nvertices; vno++) {
+    long long k = m->rowptr[vno];
+    for (const V2S_ENTRY &e : rows[vno]) {
+      m->col[k] = e.first;
+      m->weight[k] = e.second;
+      k++;
+    }
+  }
+
+  if (Gdiag & DIAG_VERBOSE_ON)
+    printf("MRIvol2surfMatBuild: %d vertices, %d depths, %lld nonzeros, %g sec\n",
+           m->nvertices, m->nproj, m->nnz, timer.seconds());
+  return (m);
+}
+
+template <class T>
+static void v2sApplyType(const MRI_VOL2SURF_MAT *m, const MRI *SrcVol, MRI *TrgVol)
+{
+  int nframes = SrcVol->nframes;
+  int width = m->width, height = m->height, depth = m->depth;
+
+#ifdef HAVE_OPENMP
+  #pragma omp parallel
+#endif
+  {
+    std::vector<double> acc(nframes);
+#ifdef HAVE_OPENMP
+    #pragma omp for schedule(dynamic, 1024)
+#endif
+    for (int vno = 0; vno < m->nvertices; vno++) {
+      std::fill(acc.begin(), acc.end(), 0.0);
+      for (long long k = m->rowptr[vno]; k < m->rowptr[vno + 1]; k++) {
+        int index = m->col[k];
+        int c = index % width;
+        int r = (index / width) % height;
+        int s = index / (width * height);
+        double w = m->weight[k];
+        for (int f = 0; f < nframes; f++) acc[f] += w * ((const T *)SrcVol->slices[s + f * depth][r])[c];
+      }
+      for (int f = 0; f < nframes; f++) MRIFseq_vox(TrgVol, vno, 0, 0, f) = acc[f];
+    }
+  }
+}
+
+/*!
+  \fn MRI *MRIvol2surfMatApply(const MRI_VOL2SURF_MAT *m, const MRI *SrcVol, MRI *TrgVol)
+  \brief Samples all frames of SrcVol onto the surface. TrgVol is
+  nvertices x 1 x 1 x nframes (MRI_FLOAT), allocated if NULL.
+*/
+MRI *MRIvol2surfMatApply(const MRI_VOL2SURF_MAT *m, const MRI *SrcVol, MRI *TrgVol)
+{
+  if (SrcVol->width != m->width || SrcVol->height != m->height || SrcVol->depth != m->depth)
+    ErrorReturn(NULL,
+                (ERROR_BADPARM,
+                 "MRIvol2surfMatApply: volume is %dx%dx%d, matrix was built for %dx%dx%d",
+                 SrcVol->width, SrcVol->height, SrcVol->depth, m->width, m->height, m->depth));
+
+  if (TrgVol == NULL) {
+    TrgVol = MRIallocSequence(m->nvertices, 1, 1, MRI_FLOAT, SrcVol->nframes);
+    if (TrgVol == NULL) return (NULL);
+    MRIcopyHeader(SrcVol, TrgVol);
+    // Dims here are meaningless, but setting to 1 means "volume" will be
+    // number of vertices.
+    TrgVol->xsize = 1;
+    TrgVol->ysize = 1;
+    TrgVol->zsize = 1;
+  }
+  else if (TrgVol->width != m->nvertices || TrgVol->nframes != SrcVol->nframes || TrgVol->type != MRI_FLOAT)
+    ErrorReturn(NULL, (ERROR_BADPARM, "MRIvol2surfMatApply: output dimension mismatch"));
+
+  switch (SrcVol->type) {
+    case MRI_UCHAR:
+      v2sApplyType<unsigned char>(m, SrcVol, TrgVol);
+      break;
+    case MRI_SHORT:
+      v2sApplyType<short>(m, SrcVol, TrgVol);
+      break;
+    case MRI_INT:
+      v2sApplyType<int>(m, SrcVol, TrgVol);
+      break;
+    case MRI_LONG:
+      v2sApplyType<long>(m, SrcVol, TrgVol);
+      break;
+    case MRI_FLOAT:
+      v2sApplyType<float>(m, SrcVol, TrgVol);
+      break;
+    default:
+      ErrorReturn(NULL, (ERROR_UNSUPPORTED, "MRIvol2surfMatApply: unsupported type %d", SrcVol->type));
+  }
+  return (TrgVol);
+}
+
+/*!
+  \fn int MRIvol2surfMatHits(const MRI_VOL2SURF_MAT *m, MRI *SrcHitVol, int proj)
+  \brief Zeroes SrcHitVol, then counts the number of times each voxel was
+  hit (nearest voxel of each sample) by projection depth proj, or by all
+  depths if proj < 0.
+*/
+int MRIvol2surfMatHits(const MRI_VOL2SURF_MAT *m, MRI *SrcHitVol, int proj)
+{
+  MRIconst(SrcHitVol->width, SrcHitVol->height, SrcHitVol->depth, 1, 0, SrcHitVol);
+  for (int vno = 0; vno < m->nvertices; vno++) {
+    for (int p = 0; p < m->nproj; p++) {
+      if (proj >= 0 && p != proj) continue;
+      int index = m->hitvox[(size_t)vno * m->nproj + p];
+      if (index < 0) continue;
+      int c = index % m->width;
+      int r = (index / m->width) % m->height;
+      int s = index / (m->width * m->height);
+      MRIFseq_vox(SrcHitVol, c, r, s, 0)++;
+    }
+  }
+  return (NO_ERROR);
+}
+
+// fwriteLong() goes through a double, so 64 bit values are written as two ints
+static void v2sWriteLong(long long v, FILE *fp)
+{
+  fwriteInt((int)(v >> 32), fp);
+  fwriteInt((int)(v & 0xffffffffLL), fp);
+}
+
+static long long v2sReadLong(FILE *fp)
+{
+  long long hi = freadInt(fp);
+  long long lo = (unsigned int)freadInt(fp);
+  return ((hi << 32) | lo);
+}
+
+/*!
+  \fn int MRIvol2surfMatWrite(const MRI_VOL2SURF_MAT *m, const char *fname)
+  \brief Saves the matrix (big-endian) so it can be reused by other runs.
+*/
+int MRIvol2surfMatWrite(const MRI_VOL2SURF_MAT *m, const char *fname)
+{
+  FILE *fp = fopen(fname, "wb");
+  if (fp == NULL) ErrorReturn(ERROR_NOFILE, (ERROR_NOFILE, "MRIvol2surfMatWrite: could not open %s", fname));
+
+  fwriteInt(VOL2SURF_MAT_MAGIC, fp);
+  fwriteInt(VOL2SURF_MAT_VERSION, fp);
+  v2sWriteLong((long long)m->key, fp);
+  fwriteInt(m->nvertices, fp);
+  fwriteInt(m->width, fp);
+  fwriteInt(m->height, fp);
+  fwriteInt(m->depth, fp);
+  fwriteInt(m->nproj, fp);
+  v2sWriteLong(m->nnz, fp);
+  for (int vno = 0; vno <= m->nvertices; vno++) v2sWriteLong(m->rowptr[vno], fp);
+  for (long long k = 0; k < m->nnz; k++) fwriteInt(m->col[k], fp);
+  for (long long k = 0; k < m->nnz; k++) fwriteFloat(m->weight[k], fp);
+  for (size_t k = 0; k < (size_t)m->nvertices * m->nproj; k++) fwriteInt(m->hitvox[k], fp);
+
+  int err = ferror(fp);
+  fclose(fp);
+  if (err) ErrorReturn(ERROR_BADFILE, (ERROR_BADFILE, "MRIvol2surfMatWrite: error writing %s", fname));
+  return (NO_ERROR);
+}
+
+/*!
+  \fn MRI_VOL2SURF_MAT *MRIvol2surfMatRead(const char *fname)
+  \brief Reads a matrix saved with MRIvol2surfMatWrite()
+*/
+MRI_VOL2SURF_MAT *MRIvol2surfMatRead(const char *fname)
+{
+  FILE *fp = fopen(fname, "rb");
+  if (fp == NULL) ErrorReturn(NULL, (ERROR_NOFILE, "MRIvol2surfMatRead: could not open %s", fname));
+
+  if (freadInt(fp) != VOL2SURF_MAT_MAGIC || freadInt(fp) != VOL2SURF_MAT_VERSION) {
+    fclose(fp);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIvol2surfMatRead: %s is not a vol2surf matrix", fname));
+  }
+
+  MRI_VOL2SURF_MAT *m = (MRI_VOL2SURF_MAT *)calloc(1, sizeof(MRI_VOL2SURF_MAT));
+  m->key = (unsigned long long)v2sReadLong(fp);
+  m->nvertices = freadInt(fp);
+  m->width = freadInt(fp);
+  m->height = freadInt(fp);
+  m->depth = freadInt(fp);
+  m->nproj = freadInt(fp);
+  m->nnz = v2sReadLong(fp);
+  if (feof(fp) || m->nvertices < 0 || m->nproj < 1 || m->nnz < 0) {
+    fclose(fp);
+    free(m);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIvol2surfMatRead: bad header in %s", fname));
+  }
+
+  m->rowptr = (long long *)calloc(m->nvertices + 1, sizeof(long long));
+  m->col = (int *)calloc(m->nnz > 0 ? m->nnz : 1, sizeof(int));
+  m->weight = (float *)calloc(m->nnz > 0 ? m->nnz : 1, sizeof(float));
+  m->hitvox = (int *)calloc((size_t)m->nvertices * m->nproj, sizeof(int));
+  for (int vno = 0; vno <= m->nvertices; vno++) m->rowptr[vno] = v2sReadLong(fp);
+  for (long long k = 0; k < m->nnz; k++) m->col[k] = freadInt(fp);
+  for (long long k = 0; k < m->nnz; k++) m->weight[k] = freadFloat(fp);
+  for (size_t k = 0; k < (size_t)m->nvertices * m->nproj; k++) m->hitvox[k] = freadInt(fp);
+
+  int bad = ferror(fp) || feof(fp) || m->rowptr[m->nvertices] != m->nnz;
+  fclose(fp);
+  if (bad) {
+    MRIvol2surfMatFree(&m);
+    ErrorReturn(NULL, (ERROR_BADFILE, "MRIvol2surfMatRead: %s is truncated or corrupt", fname));
+  }
+  return (m);
+}
+
+/*!
+  \fn MRI_VOL2SURF_MAT *MRIvol2surfMatLoadOrBuild(const char *cachefile, const MRI *SrcVol, const MATRIX *ras2vox,
+                                                  const MRI_SURFACE *surf, const MRI *vsm,
+                                                  const VOL2SURF_SAMPLING *vs)
+  \brief Reuses the matrix in cachefile if it was built from the same
+  geometry and options, otherwise builds it and saves it to cachefile.
+  cachefile can be NULL, in which case nothing is cached.
+*/
+MRI_VOL2SURF_MAT *MRIvol2surfMatLoadOrBuild(const char *cachefile, const MRI *SrcVol, const MATRIX *ras2vox,
+                                            const MRI_SURFACE *surf, const MRI *vsm,
+                                            const VOL2SURF_SAMPLING *vs)
+{
+  MRI_VOL2SURF_MAT *m;
+
+  if (cachefile && fio_FileExistsReadable(cachefile)) {
+    unsigned long long key = MRIvol2surfMatKey(SrcVol, ras2vox, surf, vsm, vs);
+    m = MRIvol2surfMatRead(cachefile);
+    if (m && m->key == key && m->nvertices == surf->nvertices) {
+      printf("Using cached sampling matrix %s\n", cachefile);
+      return (m);
+    }
+    if (m) {
+      printf("Sampling matrix in %s does not match, rebuilding\n", cachefile);
+      MRIvol2surfMatFree(&m);
+    }
+  }
+
+  m = MRIvol2surfMatBuild(SrcVol, ras2vox, surf, vsm, vs);
+  if (m && cachefile && MRIvol2surfMatWrite(m, cachefile) != NO_ERROR)
+    printf("WARNING: could not save sampling matrix to %s\n", cachefile);
+  return (m);
+}
+
+int MRIvol2surfMatFree(MRI_VOL2SURF_MAT **pm)
+{
+  MRI_VOL2SURF_MAT *m = *pm;
+  if (m == NULL) return (NO_ERROR);
+  free(m->rowptr);
+  free(m->col);
+  free(m->weight);
+  free(m->hitvox);
+  free(m);
+  *pm = NULL;
+  return (NO_ERROR);
+}
@@ -13,6 +13,7 @@
  *
  */
 
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,6 +26,7 @@
 #include "mri.h"
 #include "randomfields.h"
 #include "resample.h"
+#include "romp_support.h"
 #include "transform.h"
 #include "utils.h"
 #define VOLCLUSTER_SRC
@@ -768,6 +770,375 @@ LABEL *clustCluster2Label(
   return (label);
 }
 
+/*-------------------------------------------------------------------------
+  Union-find connected component labeling of the voxels in the threshold
+  range. The parent of a voxel is always a voxel with a lower index so the
+  root of a component is its first voxel in memory order. This makes the
+  result independent of the order in which voxels are merged and so of
+  the number of threads.
+  -------------------------------------------------------------------------*/
+static int clustFindRoot(int *parent, int i)
+{
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return (i);
+}
+
+static void clustUnion(int *parent, int a, int b)
+{
+  a = clustFindRoot(parent, a);
+  b = clustFindRoot(parent, b);
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+
+typedef struct
+{
+  long long key;  // column-major index of the first voxel (clustInitHitMap order)
+  int comp;
+} CLUST_SEED_KEY;
+
+static int clustCompareSeedKey(const void *a, const void *b)
+{
+  const CLUST_SEED_KEY *k1 = (const CLUST_SEED_KEY *)a;
+  const CLUST_SEED_KEY *k2 = (const CLUST_SEED_KEY *)b;
+  if (k1->key < k2->key) return (-1);
+  if (k1->key > k2->key) return (+1);
+  return (0);
+}
+
+/*-------------------------------------------------------------------------
+  clustLabelHits() - labels the clusters of voxels in the threshold range
+  (and in the mask, if given). Returns an array with one int per voxel
+  (index c + r*width + s*width*height) holding the cluster number
+  (1..nClusters) or 0. Clusters are numbered in the order in which the
+  column-major scan of clustGetClusters() finds their seeds. nmembers
+  and seed (linear index of the seed voxel) get one entry per cluster.
+
+  The volume is cut into one slab of slices per thread. Each slab is
+  labeled independently, then the components that touch across slab
+  boundaries are merged.
+  -------------------------------------------------------------------------*/
+static int *clustLabelHits(MRI *vol, int frame, float thmin, float thmax, int thsign,
+                           MRI *binmask, int maskframe, int AllowDiag,
+                           int *nClusters, int **nmembers, int **seed)
+{
+  int width = vol->width, height = vol->height, depth = vol->depth;
+  long long vps = (long long)width * height, nvox = vps * depth;
+  int dc[13], dr[13], ds[13], noff = 0, nslabs = 1, ncomp = 0, n;
+  int *label, *compsize, *compno;
+  CLUST_SEED_KEY *keys;
+
+  *nClusters = 0;
+  if (nvox >= INT_MAX) {
+    printf("ERROR: clustLabelHits: volume too big (%lld voxels)\n", nvox);
+    return (NULL);
+  }
+  label = (int *)malloc(nvox * sizeof(int));
+  if (label == NULL) {
+    printf("ERROR: clustLabelHits: could not alloc %lld\n", nvox);
+    return (NULL);
+  }
+
+  // Neighbors that precede a voxel in memory order
+  for (int s = -1; s <= 0; s++) {
+    for (int r = -1; r <= 1; r++) {
+      for (int c = -1; c <= 1; c++) {
+        if (s == 0 && (r > 0 || (r == 0 && c >= 0))) continue;
+        if (!AllowDiag && abs(c) + abs(r) + abs(s) != 1) continue;
+        dc[noff] = c;
+        dr[noff] = r;
+        ds[noff] = s;
+        noff++;
+      }
+    }
+  }
+
+  // Threshold. Non-hits get -1, hits start out as their own root.
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (int s = 0; s < depth; s++) {
+    ROMP_PFLB_begin
+    for (int r = 0; r < height; r++) {
+      for (int c = 0; c < width; c++) {
+        int idx = c + r * width + s * vps;
+        label[idx] = -1;
+        if (binmask != NULL) {
+          int maskval = MRIgetVoxVal(binmask, c, r, s, maskframe);
+          if (maskval == 0) continue;
+        }
+        if (clustValueInRange(MRIgetVoxVal(vol, c, r, s, frame), thmin, thmax, thsign)) label[idx] = idx;
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+#ifdef HAVE_OPENMP
+  nslabs = omp_get_max_threads();
+#endif
+  if (nslabs > depth) nslabs = depth;
+
+  // Label each slab. Components cannot leave the slab yet, so the
+  // threads never touch the same entries.
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (int slab = 0; slab < nslabs; slab++) {
+    ROMP_PFLB_begin
+    int s0 = (long long)slab * depth / nslabs;
+    int s1 = (long long)(slab + 1) * depth / nslabs;
+    for (int s = s0; s < s1; s++) {
+      for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+          int idx = c + r * width + s * vps;
+          if (label[idx] < 0) continue;
+          for (int k = 0; k < noff; k++) {
+            int c2 = c + dc[k], r2 = r + dr[k], s2 = s + ds[k];
+            if (s2 < s0 || r2 < 0 || r2 >= height || c2 < 0 || c2 >= width) continue;
+            int idx2 = c2 + r2 * width + s2 * vps;
+            if (label[idx2] >= 0) clustUnion(label, idx, idx2);
+          }
+        }
+      }
+    }
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  // Merge across the slab boundaries
+  for (int slab = 1; slab < nslabs; slab++) {
+    int s = (long long)slab * depth / nslabs;
+    for (int r = 0; r < height; r++) {
+      for (int c = 0; c < width; c++) {
+        int idx = c + r * width + s * vps;
+        if (label[idx] < 0) continue;
+        for (int k = 0; k < noff; k++) {
+          if (ds[k] == 0) continue;
+          int c2 = c + dc[k], r2 = r + dr[k];
+          if (r2 < 0 || r2 >= height || c2 < 0 || c2 >= width) continue;
+          int idx2 = c2 + r2 * width + (s - 1) * vps;
+          if (label[idx2] >= 0) clustUnion(label, idx, idx2);
+        }
+      }
+    }
+  }
+
+  // Flatten and give each component an id. Parents precede their
+  // children, so they have already been replaced by -(id+2).
+  for (int idx = 0; idx < nvox; idx++) {
+    int p = label[idx];
+    if (p == -1) continue;
+    if (p == idx)
+      label[idx] = -(ncomp++ + 2);
+    else
+      label[idx] = label[p];
+  }
+
+  // Size of each component and its first voxel in column-major order
+  compsize = (int *)calloc(ncomp + 1, sizeof(int));
+  keys = (CLUST_SEED_KEY *)calloc(ncomp + 1, sizeof(CLUST_SEED_KEY));
+  compno = (int *)calloc(ncomp + 1, sizeof(int));
+  for (n = 0; n < ncomp; n++) {
+    keys[n].key = nvox;
+    keys[n].comp = n;
+  }
+  for (int s = 0; s < depth; s++) {
+    for (int r = 0; r < height; r++) {
+      for (int c = 0; c < width; c++) {
+        int comp = -label[c + r * width + s * vps] - 2;
+        if (comp < 0) continue;
+        long long key = ((long long)c * height + r) * depth + s;
+        compsize[comp]++;
+        if (key < keys[comp].key) keys[comp].key = key;
+      }
+    }
+  }
+  qsort(keys, ncomp, sizeof(CLUST_SEED_KEY), clustCompareSeedKey);
+
+  *nmembers = (int *)calloc(ncomp + 1, sizeof(int));
+  *seed = (int *)calloc(ncomp + 1, sizeof(int));
+  for (n = 0; n < ncomp; n++) {
+    long long key = keys[n].key;
+    int c = key / ((long long)height * depth);
+    int r = (key / depth) % height;
+    int s = key % depth;
+    compno[keys[n].comp] = n + 1;
+    (*nmembers)[n] = compsize[keys[n].comp];
+    (*seed)[n] = c + r * width + s * vps;
+  }
+
+  ROMP_PF_begin
+#ifdef HAVE_OPENMP
+  #pragma omp parallel for if_ROMP(shown_reproducible)
+#endif
+  for (int s = 0; s < depth; s++) {
+    ROMP_PFLB_begin
+    int *lab = &label[s * vps];
+    for (int i = 0; i < vps; i++) lab[i] = (lab[i] == -1) ? 0 : compno[-lab[i] - 2];
+    ROMP_PFLB_end
+  }
+  ROMP_PF_end
+
+  free(compsize);
+  free(keys);
+  free(compno);
+
+  *nClusters = ncomp;
+  return (label);
+}
+
+/*-------------------------------------------------------------------------
+  clustLabelVolume() - labels the clusters of voxels in the threshold
+  range (and in binmask, if not NULL). Returns an MRI_INT volume with
+  the cluster number (1..nClusters) at each voxel or 0. Clusters are
+  numbered in the order in which clustGetClusters() seeds them (ie,
+  before pruning and sorting). If nmembers is not NULL, it gets an array
+  with the number of voxels in each cluster.
+  -------------------------------------------------------------------------*/
+MRI *clustLabelVolume(MRI *vol, int frame, float thmin, float thmax, int thsign,
+                      MRI *binmask, int maskframe, int AllowDiag, int *nClusters, int **nmembers)
+{
+  int *label, *nmemb, *seed, s;
+  long long vps = (long long)vol->width * vol->height;
+  MRI *LabelVol;
+
+  label = clustLabelHits(vol, frame, thmin, thmax, thsign, binmask, maskframe, AllowDiag, nClusters, &nmemb, &seed);
+  if (label == NULL) return (NULL);
+
+  LabelVol = MRIallocSequence(vol->width, vol->height, vol->depth, MRI_INT, 1);
+  if (LabelVol == NULL) {
+    printf("ERROR: clustLabelVolume: could not alloc\n");
+    free(label);
+    free(nmemb);
+    free(seed);
+    return (NULL);
+  }
+  MRIcopyHeader(vol, LabelVol);
+  for (s = 0; s < vol->depth; s++) {
+    for (int r = 0; r < vol->height; r++)
+      memcpy(&MRIIvox(LabelVol, 0, r, s), &label[r * vol->width + s * vps], vol->width * sizeof(int));
+  }
+
+  free(label);
+  free(seed);
+  if (nmembers)
+    *nmembers = nmemb;
+  else
+    free(nmemb);
+  return (LabelVol);
+}
+
+/*-------------------------------------------------------------------------
+  clustMaxClusterCountVolume() - returns the voxel count of the biggest
+  cluster without building the cluster lists. This is all the cluster
+  simulation needs. nClusters gets the number of clusters.
+  -------------------------------------------------------------------------*/
+int clustMaxClusterCountVolume(MRI *vol, int frame, float thmin, float thmax, int thsign,
+                               MRI *binmask, int maskframe, int AllowDiag, int *nClusters)
+{
+  int *label, *nmemb, *seed, n, MaxCount = 0;
+
+  label = clustLabelHits(vol, frame, thmin, thmax, thsign, binmask, maskframe, AllowDiag, nClusters, &nmemb, &seed);
+  if (label == NULL) return (-1);
+  for (n = 0; n < *nClusters; n++)
+    if (nmemb[n] > MaxCount) MaxCount = nmemb[n];
+
+  free(label);
+  free(nmemb);
+  free(seed);
+  return (MaxCount);
+}
+
+/*-------------------------------------------------------------------------
+  clustGrowLabel() - fills the members of vc (allocated for the size of
+  the cluster) starting at the seed. Members are added in the same order
+  as clustGrow() adds them. Voxels are cleared in label as they are
+  added.
+  -------------------------------------------------------------------------*/
+static void clustGrowLabel(VOLCLUSTER *vc, int seed, int *label, int width, int height, int depth, int AllowDiag)
+{
+  long long vps = (long long)width * height;
+  int nadded, nthmember;
+
+  vc->col[0] = seed % width;
+  vc->row[0] = (seed / width) % height;
+  vc->slc[0] = seed / vps;
+  label[seed] = 0;
+  nadded = 1;
+
+  for (nthmember = 0; nthmember < nadded; nthmember++) {
+    int col0 = vc->col[nthmember], row0 = vc->row[nthmember], slc0 = vc->slc[nthmember];
+    for (int dcol = -1; dcol <= +1; dcol++) {
+      int col = col0 + dcol;
+      if (col < 0 || col >= width) continue;
+      for (int drow = -1; drow <= +1; drow++) {
+        int row = row0 + drow;
+        if (row < 0 || row >= height) continue;
+        for (int dslc = -1; dslc <= +1; dslc++) {
+          int slc = slc0 + dslc;
+          if (slc < 0 || slc >= depth) continue;
+          if (!AllowDiag && abs(dcol) + abs(drow) + abs(dslc) != 1) continue;
+          int idx = col + row * width + slc * vps;
+          if (label[idx] == 0) continue;
+          label[idx] = 0;
+          vc->col[nadded] = col;
+          vc->row[nadded] = row;
+          vc->slc[nadded] = slc;
+          nadded++;
+        }
+      }
+    }
+  }
+}
+
+/*-------------------------------------------------------------------------
+  clustLabelClusters() - finds the clusters of voxels in the threshold
+  range (and in binmask, if not NULL) and returns them in the order in
+  which they are seeded by the column-major scan of the hit map, with the
+  members in the order in which clustGrow() would add them and with the
+  maximum member (and Talairach coordinates if XFM is not NULL) already
+  computed. This replaces the clustInitHitMap()/clustGrow() loop with
+  the union-find labeler, giving the same list. Returns NULL on error.
+  -------------------------------------------------------------------------*/
+VOLCLUSTER **clustLabelClusters(MRI *vol, int frame, float thmin, float thmax, int thsign,
+                                MRI *binmask, int maskframe, int AllowDiag, MATRIX *XFM, int *nClusters)
+{
+  int *label, *nmemb, *seed, nlabels, n;
+  float voxsizemm3;
+  VOLCLUSTER **ClusterList;
+
+  voxsizemm3 = vol->xsize * vol->ysize * vol->zsize;
+
+  label = clustLabelHits(vol, frame, thmin, thmax, thsign, binmask, maskframe, AllowDiag, &nlabels, &nmemb, &seed);
+  if (label == NULL) {
+    *nClusters = 0;
+    return (NULL);
+  }
+
+  ClusterList = clustAllocClusterList(nlabels + 1);
+  for (n = 0; n < nlabels; n++) {
+    ClusterList[n] = clustAllocCluster(nmemb[n]);
+    ClusterList[n]->voxsize = voxsizemm3;
+    clustGrowLabel(ClusterList[n], seed[n], label, vol->width, vol->height, vol->depth, AllowDiag);
+    clustMaxMember(ClusterList[n], vol, frame, thsign);
+    if (XFM) clustComputeTal(ClusterList[n], XFM);
+  }
+
+  free(label);
+  free(nmemb);
+  free(seed);
+  *nClusters = nlabels;
+  return (ClusterList);
+}
+
 /*-------------------------------------------------------------*/
 VOLCLUSTER **clustGetClusters(MRI *vol,
                               int frame,
@@ -779,59 +1150,19 @@ VOLCLUSTER **clustGetClusters(MRI *vol,
                               int *nClusters,
                               MATRIX *XFM)
 {
-  int nthhit, nclusters, nhits, *hitcol = NULL, *hitrow = NULL, *hitslc = NULL;
-  int col, row, slc, allowdiag = 0, nprunedclusters;
-  MRI *HitMap;
+  int nclusters, allowdiag = 0, nprunedclusters;
   VOLCLUSTER **ClusterList, **ClusterList2;
   float voxsizemm3, distthresh = 0;
 
   voxsizemm3 = vol->xsize * vol->ysize * vol->zsize;
 
-  /* Initialize the hit map - this is a map of voxels that have been
-     accounted for as either outside of a the threshold range or
-     belonging to a cluster. The initialization is for thresholding */
-  HitMap = clustInitHitMap(vol, frame, threshmin, threshmax, threshsign, &nhits, &hitcol, &hitrow, &hitslc, binmask, 0);
-  if (HitMap == NULL) {
-    // Nothing survived the first thresholding
-    *nClusters = 0;
-    return (NULL);
-  }
-  if (Gdiag_no > 0) printf("INFO: Found %d voxels in threhold range\n", nhits);
-
-  /* Allocate an array of clusters equal to the number of hits -- this
-     is the maximum number of clusters possible */
-  ClusterList = clustAllocClusterList(nhits);
+  /* Label the voxels in the threshold range and grow the clusters */
+  ClusterList = clustLabelClusters(vol, frame, threshmin, threshmax, threshsign, binmask, 0, allowdiag, XFM, &nclusters);
   if (ClusterList == NULL) {
-    printf("ERROR: could not alloc %d clusters\n", nhits);
+    *nClusters = 0;
     return (NULL);
   }
 
-  nclusters = 0;
-  for (nthhit = 0; nthhit < nhits; nthhit++) {
-    /* Determine whether this hit is still valid. It may
-       not be if it was assigned to the cluster of a
-       previous hit */
-    col = hitcol[nthhit];
-    row = hitrow[nthhit];
-    slc = hitslc[nthhit];
-    if (MRIgetVoxVal(HitMap, col, row, slc, 0)) continue;
-
-    /* Grow cluster using this hit as a seed */
-    ClusterList[nclusters] = clustGrow(col, row, slc, HitMap, allowdiag);
-    ClusterList[nclusters]->voxsize = voxsizemm3;
-
-    /* Determine the member with the maximum value */
-    clustMaxMember(ClusterList[nclusters], vol, frame, threshsign);
-
-    if (XFM) clustComputeTal(ClusterList[nclusters], XFM);
-
-    /* increment the number of clusters */
-    nclusters++;
-  }
-  free(hitcol);
-  free(hitrow);
-  free(hitslc);
-
   if (Gdiag_no > 0) printf("INFO: Found %d clusters that meet threshold criteria\n", nclusters);
 
   /* Remove clusters that do not meet the minimum size requirement */
@@ -856,8 +1187,6 @@ VOLCLUSTER **clustGetClusters(MRI *vol,
   clustFreeClusterList(&ClusterList, nclusters);
   ClusterList = ClusterList2;
 
-  MRIfree(&HitMap);
-
   if (Gdiag_no > 0) printf("INFO: Found %d final clusters\n", nclusters);
   *nClusters = nclusters;
   return (ClusterList);